@@ -0,0 +1,456 @@
+/**
+ * CorpusSearch.cpp
+ * Searches the topics of many documents at once with a regular expression.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "CorpusSearch.h"
+
+#include <string.h>
+
+#include "Document.h"
+#include "Errors/ErrorCollection.h"
+#include "Errors/SystemError.h"
+
+using namespace Bolota;
+
+/**
+ * Length of the header of the document file that comes before the sections.
+ */
+#define FILE_HEADER_LEN (BOLOTA_DOC_MAGIC_LEN + sizeof(uint8_t) + \
+	(sizeof(uint32_t) * 2))
+
+/**
+ * Maximum number of bytes read from a document at once.
+ */
+#define READ_CHUNK_LEN (1024 * 1024)
+
+/**
+ * Length of the header of a field in the file.
+ */
+#define FIELD_HEADER_LEN ((sizeof(uint8_t) * 2) + (sizeof(uint16_t) * 2))
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty corpus search.
+ */
+CorpusSearch::CorpusSearch() {
+	m_ulReported = 0;
+	m_func = NULL;
+	m_ctx = NULL;
+	memset(&m_stats, 0, sizeof(bolota_corpus_stats_t));
+}
+
+/**
+ * Frees up the list of files.
+ */
+CorpusSearch::~CorpusSearch() {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Pattern                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Sets the regular expression the topics are searched for.
+ *
+ * @param szPattern   UTF-8 regular expression.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ *
+ * @return TRUE if the pattern is valid, FALSE otherwise.
+ */
+bool CorpusSearch::SetPattern(const char *szPattern, bool bIgnoreCase) {
+	return m_regex.Compile(szPattern, bIgnoreCase);
+}
+
+/**
+ * Gets the regular expression the topics are searched for.
+ *
+ * @return Compiled regular expression.
+ */
+const Regex& CorpusSearch::Pattern() const {
+	return m_regex;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Files                                    |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a document to be searched.
+ *
+ * @param szPath Path to the document.
+ */
+void CorpusSearch::AddFile(LPCTSTR szPath) {
+	m_files.push_back(szPath);
+}
+
+/**
+ * Adds every document in a directory to be searched, in the order of their
+ * paths.
+ *
+ * @param szPath     Path to the directory.
+ * @param bRecursive Should subdirectories be searched as well?
+ *
+ * @return Number of documents added or BOLOTA_ERR_SIZET if the directory
+ *         couldn't be listed.
+ */
+size_t CorpusSearch::AddDirectory(LPCTSTR szPath, bool bRecursive) {
+	size_t ulCount = m_files.size();
+
+	if (!FileUtils::ListFiles(szPath, BOLOTA_CORPUS_EXT, bRecursive,
+			m_files)) {
+		ThrowError(new SystemError(EMSG("Could not list the directory")));
+		return BOLOTA_ERR_SIZET;
+	}
+
+	return m_files.size() - ulCount;
+}
+
+/**
+ * Gets the number of documents to be searched.
+ *
+ * @return Number of documents.
+ */
+size_t CorpusSearch::FileCount() const {
+	return m_files.size();
+}
+
+/**
+ * Gets the path to a document to be searched.
+ *
+ * @param index Index of the document.
+ *
+ * @return Path to the document.
+ */
+LPCTSTR CorpusSearch::File(size_t index) const {
+	return m_files[index].c_str();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Searches every document for the pattern.
+ *
+ * @warning The function is called from the searching threads, one call at a
+ *          time, so it must not throw errors.
+ *
+ * @param uThreads Number of threads to use. 0 uses one per processor.
+ * @param func     Function that receives the matching topics in order.
+ * @param ctx      Context passed along to the function.
+ *
+ * @return Statistics of the search.
+ */
+bolota_corpus_stats_t CorpusSearch::Run(unsigned int uThreads,
+										CorpusHitFunc func, void *ctx) {
+	// Get everything ready.
+	m_results.clear();
+	m_results.resize(m_files.size());
+	m_failed.clear();
+	m_ulReported = 0;
+	m_func = func;
+	m_ctx = ctx;
+	memset(&m_stats, 0, sizeof(bolota_corpus_stats_t));
+
+	// Go through the documents.
+	Threads::InitMutex(&m_mutex);
+	Threads::ParallelForDynamic(m_files.size(), uThreads, 1, SearchRange,
+		this);
+	Threads::DestroyMutex(&m_mutex);
+
+	std::vector<FileResult>().swap(m_results);
+	return m_stats;
+}
+
+/**
+ * Gets the documents that couldn't be read by the last search.
+ *
+ * @return Indexes of the documents, in order.
+ */
+const std::vector<size_t>& CorpusSearch::FailedFiles() const {
+	return m_failed;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Searching Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Searches a chunk of the documents. Called from the searching threads.
+ *
+ * @param ctx     Corpus search object.
+ * @param ulStart Index of the first document.
+ * @param ulEnd   Index after the last document.
+ */
+void CorpusSearch::SearchRange(void *ctx, size_t ulStart, size_t ulEnd) {
+	CorpusSearch *self = static_cast<CorpusSearch*>(ctx);
+	std::vector<uint32_t> vecScratch;
+
+	for (size_t i = ulStart; i < ulEnd; i++) {
+		FileResult result;
+		self->SearchFile(i, result, vecScratch);
+		self->Report(i, result);
+	}
+}
+
+/**
+ * Searches a single document.
+ *
+ * @param index      Index of the document.
+ * @param result     Result to be filled in.
+ * @param vecScratch Scratch space for the regular expression matcher.
+ */
+void CorpusSearch::SearchFile(size_t index, FileResult& result,
+							  std::vector<uint32_t>& vecScratch) const {
+	uint32_t dwProperties = 0;
+
+	result.bDone = true;
+	result.bFailed = false;
+	result.ulBytes = 0;
+	result.ulTopics = 0;
+
+	// Read the file and go through its topics.
+	if (!ReadSections(m_files[index].c_str(), result, &dwProperties) ||
+			!SearchTopics(result, dwProperties, vecScratch)) {
+		result.bFailed = true;
+		std::vector<uint8_t>().swap(result.data);
+		result.fields.clear();
+		result.hits.clear();
+		return;
+	}
+
+	// Only keep the data around if we'll need it to report matches.
+	if (result.hits.empty())
+		std::vector<uint8_t>().swap(result.data);
+}
+
+/**
+ * Reads the properties and topics sections of a document, leaving any
+ * extension sections untouched. No errors are thrown.
+ *
+ * @param szPath        Path to the document.
+ * @param result        Result to store the data of the sections in.
+ * @param pdwProperties Pointer to receive the length of the properties.
+ *
+ * @return TRUE if the sections were read, FALSE if the file couldn't be read
+ *         or isn't a document.
+ */
+bool CorpusSearch::ReadSections(LPCTSTR szPath, FileResult& result,
+								uint32_t *pdwProperties) const {
+	uint8_t header[FILE_HEADER_LEN];
+	uint32_t dwTopics;
+	size_t ulSections;
+	fsize_t dwRead = 0;
+	bool bSuccess = false;
+
+	// Open the file.
+	FHND hFile = FileUtils::Open(szPath, false, true);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Check the header and get the lengths of the sections.
+	if (!FileUtils::Read(hFile, header, FILE_HEADER_LEN, &dwRead) ||
+			(dwRead != FILE_HEADER_LEN))
+		goto cleanup;
+	if ((memcmp(header, BOLOTA_DOC_MAGIC, BOLOTA_DOC_MAGIC_LEN) != 0) ||
+			(header[BOLOTA_DOC_MAGIC_LEN] > BOLOTA_DOC_VER))
+		goto cleanup;
+	memcpy(pdwProperties, header + BOLOTA_DOC_MAGIC_LEN + 1,
+		sizeof(uint32_t));
+	memcpy(&dwTopics, header + BOLOTA_DOC_MAGIC_LEN + 1 + sizeof(uint32_t),
+		sizeof(uint32_t));
+	result.ulBytes = FILE_HEADER_LEN;
+
+	// Read both sections in chunks, so a corrupted length can't make us
+	// allocate much more than the size of the file.
+	ulSections = (size_t)*pdwProperties + dwTopics;
+	while (result.data.size() < ulSections) {
+		size_t ulOffset = result.data.size();
+		size_t ulChunk = ulSections - ulOffset;
+		if (ulChunk > READ_CHUNK_LEN)
+			ulChunk = READ_CHUNK_LEN;
+
+		result.data.resize(ulOffset + ulChunk);
+		if (!FileUtils::Read(hFile, &result.data[ulOffset], ulChunk,
+				&dwRead) || (dwRead != ulChunk)) {
+			goto cleanup;
+		}
+		result.ulBytes += dwRead;
+	}
+	bSuccess = true;
+
+cleanup:
+	FileUtils::Close(hFile);
+	return bSuccess;
+}
+
+/**
+ * Goes through the topics section of a document looking for the pattern.
+ *
+ * @param result     Result with the data of the document. Matches are
+ *                   appended to it.
+ * @param ulStart    Position of the topics section in the data.
+ * @param vecScratch Scratch space for the regular expression matcher.
+ *
+ * @return TRUE if the section was searched, FALSE if it's malformed.
+ */
+bool CorpusSearch::SearchTopics(FileResult& result, size_t ulStart,
+								std::vector<uint32_t>& vecScratch) const {
+	std::vector<uint32_t> vecAncestors;
+	size_t ulLength = result.data.size();
+	size_t pos = ulStart;
+
+	if (ulStart > ulLength)
+		return false;
+
+	while (pos < ulLength) {
+		const uint8_t *buf = &result.data[0] + pos;
+		uint16_t usTextLength;
+		size_t ulExtra = 0;
+		size_t ulMatchStart;
+		size_t ulMatchEnd;
+
+		// Parse the field header.
+		if ((ulLength - pos) < FIELD_HEADER_LEN)
+			return false;
+		uint8_t depth = buf[1];
+		memcpy(&usTextLength, buf + 4, sizeof(uint16_t));
+
+		// Get the size of the type-specific data.
+		switch (buf[0]) {
+		case BOLOTA_TYPE_TEXT:
+		case BOLOTA_TYPE_BLANK:
+			break;
+		case BOLOTA_TYPE_DATE:
+			ulExtra = sizeof(timestamp_t);
+			break;
+		case BOLOTA_TYPE_ICON:
+			ulExtra = sizeof(uint8_t);
+			break;
+		default:
+			return false;
+		}
+		if ((ulLength - pos) < (FIELD_HEADER_LEN + usTextLength + ulExtra))
+			return false;
+
+		// Keep track of the ancestors of the topic.
+		if (depth > vecAncestors.size())
+			return false;
+		vecAncestors.resize(depth);
+		vecAncestors.push_back((uint32_t)pos);
+		result.ulTopics++;
+
+		// Search the text.
+		if ((usTextLength > 0) && m_regex.Search(
+				(const char *)(buf + FIELD_HEADER_LEN), usTextLength,
+				&ulMatchStart, &ulMatchEnd, vecScratch)) {
+			Hit hit;
+			hit.path = (uint32_t)result.fields.size();
+			hit.depth = depth;
+			hit.offset = (uint16_t)ulMatchStart;
+			hit.length = (uint16_t)(ulMatchEnd - ulMatchStart);
+			result.hits.push_back(hit);
+			result.fields.insert(result.fields.end(), vecAncestors.begin(),
+				vecAncestors.end());
+		}
+
+		pos += FIELD_HEADER_LEN + usTextLength + ulExtra;
+	}
+
+	return true;
+}
+
+/**
+ * Hands over the result of a document and reports the matches of every
+ * document, in order, that's ready to be reported.
+ *
+ * @param index  Index of the document.
+ * @param result Result of the document. Its contents are taken over.
+ */
+void CorpusSearch::Report(size_t index, FileResult& result) {
+	const char *texts[256];
+	uint16_t lengths[256];
+	bolota_corpus_hit_t hit;
+
+	Threads::LockMutex(&m_mutex);
+
+	// Store the result.
+	FileResult& stored = m_results[index];
+	stored.bDone = true;
+	stored.bFailed = result.bFailed;
+	stored.ulBytes = result.ulBytes;
+	stored.ulTopics = result.ulTopics;
+	stored.data.swap(result.data);
+	stored.fields.swap(result.fields);
+	stored.hits.swap(result.hits);
+
+	// Report every document that's next in line.
+	while ((m_ulReported < m_results.size()) &&
+			m_results[m_ulReported].bDone) {
+		FileResult& ready = m_results[m_ulReported];
+
+		// Update the statistics.
+		if (ready.bFailed) {
+			m_failed.push_back(m_ulReported);
+			m_stats.failed++;
+		} else {
+			m_stats.files++;
+		}
+		m_stats.bytes += ready.ulBytes;
+		m_stats.topics += ready.ulTopics;
+		m_stats.hits += ready.hits.size();
+
+		// Report the matches.
+		hit.szFile = m_files[m_ulReported].c_str();
+		hit.texts = texts;
+		hit.lengths = lengths;
+		for (size_t i = 0; i < ready.hits.size(); i++) {
+			const Hit& h = ready.hits[i];
+			for (uint32_t j = 0; j <= h.depth; j++) {
+				const uint8_t *buf = &ready.data[0] + ready.fields[h.path + j];
+				texts[j] = (const char *)(buf + FIELD_HEADER_LEN);
+				memcpy(&lengths[j], buf + 4, sizeof(uint16_t));
+			}
+
+			hit.depth = h.depth;
+			hit.offset = h.offset;
+			hit.length = h.length;
+			if (m_func != NULL)
+				m_func(m_ctx, &hit);
+		}
+
+		// Release the data of the document.
+		std::vector<uint8_t>().swap(ready.data);
+		std::vector<uint32_t>().swap(ready.fields);
+		std::vector<Hit>().swap(ready.hits);
+		m_ulReported++;
+	}
+
+	Threads::UnlockMutex(&m_mutex);
+}
@@ -0,0 +1,144 @@
+/**
+ * CorpusSearch.h
+ * Searches the topics of many documents at once with a regular expression.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_CORPUSSEARCH_H
+#define _BOLOTA_CORPUSSEARCH_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "Utilities/FileUtils.h"
+#include "Utilities/Threads.h"
+#include "Regex.h"
+
+/**
+ * Extension of the files picked up when searching directories.
+ */
+#define BOLOTA_CORPUS_EXT _T(".bol")
+
+/**
+ * Topic that matched a corpus search.
+ */
+typedef struct bolota_corpus_hit_s {
+	LPCTSTR szFile;           /* Path of the document. */
+	const char **texts;       /* Texts of the ancestors and the topic itself. */
+	const uint16_t *lengths;  /* Lengths of the texts in bytes. */
+	uint8_t depth;            /* Depth of the topic. (texts has depth + 1) */
+	uint16_t offset;          /* Start of the first match in the topic text. */
+	uint16_t length;          /* Length of the first match in bytes. */
+} bolota_corpus_hit_t;
+
+/**
+ * Statistics of a corpus search.
+ */
+typedef struct bolota_corpus_stats_s {
+	size_t files;   /* Documents that were searched. */
+	size_t failed;  /* Documents that couldn't be read. */
+	size_t bytes;   /* Bytes read from the documents. */
+	size_t topics;  /* Topics that were searched. */
+	size_t hits;    /* Topics that matched. */
+} bolota_corpus_stats_t;
+
+namespace Bolota {
+
+	/**
+	 * Function that receives the topics that matched a corpus search.
+	 */
+	typedef void (*CorpusHitFunc)(void *ctx, const bolota_corpus_hit_t *hit);
+
+	/**
+	 * Searches the topics of many documents at once with a regular expression,
+	 * without building any Document objects. Only the header and the
+	 * properties and topics sections of each file are read, and the topics
+	 * are walked straight from the file data, keeping track of their
+	 * ancestors so that the outline path of each match can be reported.
+	 *
+	 * Documents are spread across threads that steal work from each other, so
+	 * a few large documents don't hold everyone back. Matches are still
+	 * reported in the same order as the files were added, as soon as every
+	 * file before them has been searched.
+	 */
+	class CorpusSearch {
+	protected:
+		// Topic that matched, before it's reported.
+		struct Hit {
+			uint32_t path;
+			uint8_t depth;
+			uint16_t offset;
+			uint16_t length;
+		};
+
+		// Result of searching a single document.
+		struct FileResult {
+			bool bDone;
+			bool bFailed;
+			size_t ulBytes;
+			size_t ulTopics;
+			std::vector<uint8_t> data;
+			std::vector<uint32_t> fields;
+			std::vector<Hit> hits;
+		};
+
+		// Search parameters.
+		Regex m_regex;
+		std::vector<tstring> m_files;
+		std::vector<size_t> m_failed;
+
+		// State of a running search.
+		std::vector<FileResult> m_results;
+		size_t m_ulReported;
+		thread_mutex_t m_mutex;
+		CorpusHitFunc m_func;
+		void *m_ctx;
+		bolota_corpus_stats_t m_stats;
+
+	public:
+		// Constructors and destructors.
+		CorpusSearch();
+		virtual ~CorpusSearch();
+
+		// Pattern.
+		bool SetPattern(const char *szPattern, bool bIgnoreCase);
+		const Regex& Pattern() const;
+
+		// Files.
+		void AddFile(LPCTSTR szPath);
+		size_t AddDirectory(LPCTSTR szPath, bool bRecursive);
+		size_t FileCount() const;
+		LPCTSTR File(size_t index) const;
+
+		// Searching.
+		bolota_corpus_stats_t Run(unsigned int uThreads, CorpusHitFunc func,
+			void *ctx);
+		const std::vector<size_t>& FailedFiles() const;
+
+	protected:
+		// Searching helpers.
+		static void SearchRange(void *ctx, size_t ulStart, size_t ulEnd);
+		void SearchFile(size_t index, FileResult& result,
+			std::vector<uint32_t>& vecScratch) const;
+		bool ReadSections(LPCTSTR szPath, FileResult& result,
+			uint32_t *pdwProperties) const;
+		bool SearchTopics(FileResult& result, size_t ulStart,
+			std::vector<uint32_t>& vecScratch) const;
+		void Report(size_t index, FileResult& result);
+	};
+
+}
+
+#endif // _BOLOTA_CORPUSSEARCH_H
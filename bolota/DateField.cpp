@@ -36,6 +36,22 @@ void DateField::Copy(const DateField *field, bool bReplace) {
 	SetTimestamp(&ts);
 }
 
+/**
+ * Creates an unlinked duplicate of the field. The text buffer is shared with
+ * the original until either one of them is changed.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @return Newly allocated duplicate of the field.
+ */
+Field* DateField::Duplicate() const {
+	DateField *field = new DateField(&m_ts);
+	if (HasText())
+		field->SetText(*m_text);
+
+	return field;
+}
+
 /**
  * Initializes the date field object.
  *
@@ -84,7 +100,7 @@ void DateField::RefreshText() {
 	// Build up an ISO8601 timestamp.
 	LPTSTR szTimestamp;
 	szTimestamp = (LPTSTR)malloc(21 * sizeof(TCHAR));
-	_stprintf(szTimestamp, _T("%04u-%02u-%02uT%02u:%02u:%02uZ"),
+	_sntprintf(szTimestamp, 21, _T("%04u-%02u-%02uT%02u:%02u:%02uZ"),
 		m_ts.year, m_ts.month, m_ts.day, m_ts.hour, m_ts.minute, m_ts.second);
 
 	// Assign the new timestamp to the field's text.
@@ -182,11 +198,12 @@ uint16_t DateField::FieldLength() const {
 	return Field::FieldLength() + sizeof(timestamp_t);
 }
 
-uint8_t DateField::ReadField(FHND hFile, size_t *bytes) {
+uint8_t DateField::ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+							 bolota_text_mode_t mode) {
 	DWORD dwRead = 0;
 
 	// Read the field's base.
-	uint8_t depth = Field::ReadField(hFile, bytes);
+	uint8_t depth = Field::ReadField(hFile, bytes, pool, mode);
 	if (BolotaHasError)
 		return BOLOTA_ERR_UINT8;
 
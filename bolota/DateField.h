@@ -103,6 +103,7 @@ namespace Bolota {
 
 		// Helpers
 		virtual void Copy(const DateField *field, bool bReplace);
+		Field* Duplicate() const override;
 		static DateField* Now();
 		void RefreshText();
 #ifdef _WIN32
@@ -111,7 +112,8 @@ namespace Bolota {
 
 		// Overrides
 		uint16_t FieldLength() const override;
-		uint8_t ReadField(FHND hFile, size_t *bytes) override;
+		uint8_t ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+			bolota_text_mode_t mode) override;
 		size_t Write(FHND hFile) const override;
 
 		// Getters and setters.
@@ -7,9 +7,15 @@
 
 #include "Document.h"
 
+#include "IconField.h"
 #include "Errors/ErrorCollection.h"
 #include "Errors/ConsistencyError.h"
 
+#include <string.h>
+#include <algorithm>
+
+#include "../../shims/cvtutf/Unicode.h"
+
 using namespace Bolota;
 
 /*
@@ -53,6 +59,16 @@ Document::~Document() {
 		m_topics->Destroy(true, true);
 	m_topics = NULL;
 
+	// Destroy the text pool.
+	if (m_pool)
+		delete m_pool;
+	m_pool = NULL;
+
+	// Destroy the trigram index.
+	if (m_trigrams)
+		delete m_trigrams;
+	m_trigrams = NULL;
+
 	// Close the file handle.
 	if ((m_hFile != NULL) && (m_hFile != INVALID_HANDLE_VALUE)) {
 		FileUtils::Close(m_hFile);
@@ -75,6 +91,8 @@ void Document::Initialize(TextField *title, TextField *subtitle,
 	m_subtitle = subtitle;
 	m_date = date;
 	m_topics = NULL;
+	m_pool = NULL;
+	m_trigrams = NULL;
 	m_hFile = hFile;
 	if (szPath != NULL)
 		m_strPath = szPath;
@@ -108,6 +126,18 @@ void Document::SetFirstTopic(Field *topic) {
 	m_topics = topic;
 }
 
+/**
+ * Finds a topic of the document by its stable identifier.
+ *
+ * @param id Identifier of the topic.
+ *
+ * @return Topic with the identifier or NULL if there's no such topic in the
+ *         document.
+ */
+Field* Document::FindTopic(field_id_t id) const {
+	return m_ids.Find(id);
+}
+
 /**
  * Appends a new topic after a field in the topics liked list.
  *
@@ -135,7 +165,8 @@ bool Document::AppendTopic(Field *prev, Field *field) {
 	prev->SetNext(field, false);
 
 done:
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(field);
 	SetDirty(true);
 	return true;
 }
@@ -160,7 +191,8 @@ void Document::PrependTopic(Field *next, Field *field) {
 	if (!field->HasPrevious() && next->HasParent())
 		next->Parent()->SetChild(field, false);
 
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(field);
 	SetDirty(true);
 }
 
@@ -176,6 +208,7 @@ bool Document::AppendTopic(Field *field) {
 	Field* last = m_topics;
 	if (last == NULL) {
 		SetFirstTopic(field);
+		NotifyInserted(field);
 		goto done;
 	}
 
@@ -197,6 +230,9 @@ done:
  * @param field Topic field to be deleted from the document.
  */
 void Document::DeleteTopic(Field *field) {
+	// Let the indexes know before anything changes.
+	NotifyRemoving(field, true);
+
 	// Ensure we pass along the first topic of the linked list.
 	if (m_topics == field)
 		SetFirstTopic(field->Next());
@@ -219,6 +255,38 @@ void Document::DeleteTopic(Field *field) {
 	SetDirty(true);
 }
 
+/**
+ * Replaces a topic with another field, usually to change its type. The new
+ * field takes the place of the old one in the topics tree along with its text
+ * (unless it's a blank field), children and identifier, and the old field is
+ * destroyed.
+ *
+ * @warning Type specific properties are not carried over.
+ *
+ * @param field       Topic field to be replaced and destroyed.
+ * @param replacement Field to take its place. Must not be in the document.
+ */
+void Document::ReplaceTopic(Field *field, Field *replacement) {
+	// Let the indexes know before anything changes. Only the old field is
+	// going away, its children are moving over to the new one.
+	NotifyRemoving(field, false);
+
+	// Take its place in the linked list.
+	replacement->Copy(field, true);
+	replacement->SetID(field->ID());
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		child->SetParent(replacement, true);
+	if (m_topics == field)
+		SetFirstTopic(replacement);
+
+	// Get rid of the old field without taking its relatives with it.
+	delete field;
+
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(replacement);
+	SetDirty(true);
+}
+
 /**
  * Detaches a topic from the document's topic list and fills its gap. Should be
  * used for moving topics around.
@@ -229,6 +297,9 @@ void Document::DeleteTopic(Field *field) {
  * @param field Field to be detached from the topics tree.
  */
 void Document::PopTopic(Field *field) {
+	// Let the indexes know before anything changes.
+	NotifyRemoving(field, false);
+
 	// Fill the space that will be left behind by the detaching topic.
 	if (field->IsFirstChild()) {
 		// Is the first child.
@@ -278,7 +349,8 @@ void Document::MoveTopicToTop(Field *field) {
 	field->SetNext(first, false);
 	SetFirstTopic(field);
 
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(field);
 	SetDirty(true);
 }
 
@@ -297,7 +369,7 @@ void Document::MoveTopicBelow(Field *below, Field *above) {
 	// Shuffle things around to make space for us at our new home.
 	if (above->HasChild()) {
 		// Below will become the first child of above.
-		below->SetParent(above->Parent(), true);
+		below->SetParent(above, true);
 		below->SetNext(above->Child(), false);
 		above->SetChild(below, false);
 	} else {
@@ -306,7 +378,8 @@ void Document::MoveTopicBelow(Field *below, Field *above) {
 		above->SetNext(below, false);
 	}
 
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(below);
 	SetDirty(true);
 }
 
@@ -341,7 +414,8 @@ void Document::IndentTopic(Field *field) {
 		prev->SetChild(field, false);
 	}
 
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(field);
 	SetDirty(true);
 }
 
@@ -368,7 +442,8 @@ void Document::DeindentTopic(Field *field) {
 	field->SetNext(parent->Next(), false);
 	field->SetPrevious(parent, false);
 
-	// Flag unsaved changes.
+	// Update the indexes and flag unsaved changes.
+	NotifyInserted(field);
 	SetDirty(true);
 }
 
@@ -421,6 +496,365 @@ Error* Document::CheckFieldConsistency(Field *ref, Field *parent,Field* child,
 	return NULL;
 }
 
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Auxiliary Indexes                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Attaches an auxiliary index to the document, building it from the current
+ * topics and keeping it up to date from now on.
+ *
+ * @warning The document doesn't take ownership of the index, which must be
+ *          detached before being destroyed.
+ *
+ * @param index Index to be attached.
+ */
+void Document::AttachIndex(DocumentIndex *index) {
+	// Check if it's already attached.
+	for (size_t i = 0; i < m_indexes.size(); i++) {
+		if (m_indexes[i] == index)
+			return;
+	}
+
+	index->Build(m_topics);
+	m_indexes.push_back(index);
+}
+
+/**
+ * Detaches an auxiliary index from the document. It will no longer be kept up
+ * to date.
+ *
+ * @param index Index to be detached.
+ */
+void Document::DetachIndex(DocumentIndex *index) {
+	for (size_t i = 0; i < m_indexes.size(); i++) {
+		if (m_indexes[i] == index) {
+			m_indexes.erase(m_indexes.begin() + i);
+			return;
+		}
+	}
+}
+
+/**
+ * Enables or disables the trigram index of the topic texts, which speeds up
+ * searches and gets saved along with the document so that it doesn't have to
+ * be built again when the file is opened. It's disabled unless asked for, or
+ * the file that was opened already had it, since it takes about as much room
+ * in the file as the texts themselves.
+ *
+ * @param bEnable Should the index be built and kept up to date?
+ */
+void Document::EnableTrigramIndex(bool bEnable) {
+	if (bEnable) {
+		if (m_trigrams != NULL)
+			return;
+
+		m_trigrams = new TrigramIndex();
+		AttachIndex(m_trigrams);
+	} else if (m_trigrams != NULL) {
+		DetachIndex(m_trigrams);
+		delete m_trigrams;
+		m_trigrams = NULL;
+	}
+}
+
+/**
+ * Gets the trigram index of the topic texts.
+ *
+ * @return Trigram index of the document or NULL if it's disabled.
+ */
+TrigramIndex* Document::Trigrams() const {
+	return m_trigrams;
+}
+
+/**
+ * Lets the document know that the contents of a topic were changed directly
+ * through the field object, so that its indexes can be updated.
+ *
+ * @param field Topic that was changed.
+ */
+void Document::TopicChanged(Field *field) {
+	for (size_t i = 0; i < m_indexes.size(); i++)
+		m_indexes[i]->TopicChanged(field);
+
+	// Flag unsaved changes.
+	SetDirty(true);
+}
+
+/**
+ * Sets the icon of a topic and lets the indexes know about it.
+ *
+ * @param field Topic to have its icon changed.
+ * @param icon  New icon of the topic.
+ */
+void Document::SetTopicIcon(IconField *field, field_icon_t icon) {
+	field->SetIconIndex(icon);
+	TopicChanged(field);
+}
+
+/**
+ * Lets the indexes know that a topic and its children were inserted.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void Document::NotifyInserted(Field *field) {
+	m_ids.TopicInserted(field);
+	for (size_t i = 0; i < m_indexes.size(); i++)
+		m_indexes[i]->TopicInserted(field);
+}
+
+/**
+ * Lets the indexes know that a topic and its children are about to be removed.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards?
+ */
+void Document::NotifyRemoving(Field *field, bool bDeleting) {
+	m_ids.TopicRemoving(field, bDeleting);
+	for (size_t i = 0; i < m_indexes.size(); i++)
+		m_indexes[i]->TopicRemoving(field, bDeleting);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Text Interning                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Enables or disables the interning of identical topic texts, which makes them
+ * share a single buffer in memory. Enabling it interns all of the topics that
+ * are already in the document.
+ *
+ * @param bEnable Should identical texts share their buffers?
+ */
+void Document::EnableTextPool(bool bEnable) {
+	if (bEnable) {
+		if (m_pool != NULL)
+			return;
+
+		m_pool = new TextPool();
+		m_pool->BeginBatch();
+		InternTopics(m_topics);
+		m_pool->EndBatch();
+	} else if (m_pool != NULL) {
+		// Interned strings hold references to their buffers.
+		delete m_pool;
+		m_pool = NULL;
+	}
+}
+
+/**
+ * Gets the text pool used to intern the topic texts of the document.
+ *
+ * @return Text pool of the document or NULL if interning is disabled.
+ */
+TextPool* Document::Pool() const {
+	return m_pool;
+}
+
+/**
+ * Sets the text of a topic, sharing the buffer of an identical text in the
+ * document if interning is enabled.
+ *
+ * @param field Topic to have its text changed.
+ * @param mbstr Multi-byte string to be copied into the topic.
+ */
+void Document::SetTopicText(Field *field, const char *mbstr) {
+	field->SetText(mbstr);
+	if ((m_pool != NULL) && field->HasText())
+		m_pool->Intern(field->Text());
+	TopicChanged(field);
+}
+
+/**
+ * Sets the text of a topic, sharing the buffer of an identical text in the
+ * document if interning is enabled.
+ *
+ * @param field Topic to have its text changed.
+ * @param wstr  Wide string to be converted and copied into the topic.
+ */
+void Document::SetTopicText(Field *field, const wchar_t *wstr) {
+	field->SetText(wstr);
+	if ((m_pool != NULL) && field->HasText())
+		m_pool->Intern(field->Text());
+	TopicChanged(field);
+}
+
+/**
+ * Interns the texts of a linked list of topic fields.
+ *
+ * @param field Field to have its text interned, and of its childs and
+ *              simblings.
+ */
+void Document::InternTopics(Field *field) {
+	// Ensure we actually have something to intern.
+	if (field == NULL)
+		return;
+
+	// Go through the fields recursively.
+	do {
+		if (field->HasText())
+			m_pool->Intern(field->Text());
+		if (field->HasChild())
+			InternTopics(field->Child());
+		field = field->Next();
+	} while (field != NULL);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds every occurrence of a literal pattern in the texts of the topics. The
+ * texts are scanned directly, skipping ahead to the positions where both the
+ * first and last bytes of the pattern match using the fastest vector
+ * instructions available. When the trigram index is enabled only the topics
+ * that may contain the pattern get scanned.
+ *
+ * @param szPattern   UTF-8 pattern to look for.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ * @param vecMatches  Vector to receive the matches in document order.
+ *                    Overlapping occurrences are reported only once.
+ *
+ * @return Number of matches found.
+ */
+size_t Document::Find(const char *szPattern, bool bIgnoreCase,
+					  std::vector<TopicMatch>& vecMatches) const {
+	size_t ulLength = strlen(szPattern);
+
+	std::vector<Field*> vecCandidates;
+
+	vecMatches.clear();
+	if (ulLength == 0)
+		return 0;
+
+	// Only search the topics that may contain the pattern if we can.
+	if ((m_trigrams != NULL) &&
+			m_trigrams->Candidates(szPattern, ulLength, vecCandidates)) {
+		for (size_t i = 0; i < vecCandidates.size(); i++) {
+			FindInTopic(vecCandidates[i], szPattern, ulLength, bIgnoreCase,
+				vecMatches);
+		}
+
+		return vecMatches.size();
+	}
+
+	FindInTopics(m_topics, szPattern, ulLength, bIgnoreCase, vecMatches);
+	return vecMatches.size();
+}
+
+/**
+ * Finds every occurrence of a literal pattern in the texts of the topics.
+ *
+ * @param szPattern   Pattern to look for.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ * @param vecMatches  Vector to receive the matches in document order.
+ *
+ * @return Number of matches found.
+ */
+size_t Document::Find(const wchar_t *szPattern, bool bIgnoreCase,
+					  std::vector<TopicMatch>& vecMatches) const {
+	UString strPattern(szPattern);
+
+	vecMatches.clear();
+	if (strPattern.Empty())
+		return 0;
+
+	return Find(strPattern.GetMultiByteString(), bIgnoreCase, vecMatches);
+}
+
+/**
+ * Gets the outline path of a topic.
+ *
+ * @param field   Topic to get the path of.
+ * @param vecPath Vector to receive the path, starting with the top level
+ *                ancestor of the topic and ending with the topic itself.
+ *
+ * @return Depth of the path.
+ */
+size_t Document::TopicPath(Field *field, std::vector<Field*>& vecPath) {
+	vecPath.clear();
+	for (; field != NULL; field = field->Parent())
+		vecPath.push_back(field);
+	std::reverse(vecPath.begin(), vecPath.end());
+
+	return vecPath.size();
+}
+
+/**
+ * Finds every occurrence of a pattern in a linked list of topic fields.
+ *
+ * @param field       Field to be searched, along with its childs and
+ *                    simblings.
+ * @param szPattern   UTF-8 pattern to look for.
+ * @param ulLength    Length of the pattern in bytes.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ * @param vecMatches  Vector to append the matches to.
+ */
+void Document::FindInTopics(Field *field, const char *szPattern,
+							size_t ulLength, bool bIgnoreCase,
+							std::vector<TopicMatch>& vecMatches) {
+	for (; field != NULL; field = field->Next()) {
+		// Search the text of the topic.
+		FindInTopic(field, szPattern, ulLength, bIgnoreCase, vecMatches);
+
+		// Go through the childs.
+		if (field->HasChild()) {
+			FindInTopics(field->Child(), szPattern, ulLength, bIgnoreCase,
+				vecMatches);
+		}
+	}
+}
+
+/**
+ * Finds every occurrence of a pattern in the text of a single topic.
+ *
+ * @param field       Topic to be searched.
+ * @param szPattern   UTF-8 pattern to look for.
+ * @param ulLength    Length of the pattern in bytes.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ * @param vecMatches  Vector to append the matches to.
+ */
+void Document::FindInTopic(Field *field, const char *szPattern,
+						   size_t ulLength, bool bIgnoreCase,
+						   std::vector<TopicMatch>& vecMatches) {
+	const char *mbstr;
+	const char *szEnd;
+	const char *szMatch;
+
+	// Check if the pattern could even fit in the text. Texts that are only in
+	// memory may be longer than what a field can hold in a file.
+	if (!field->HasText())
+		return;
+	mbstr = field->Text()->GetMultiByteString();
+	if (field->Text()->Length() < ulLength)
+		return;
+
+	szEnd = mbstr + field->Text()->Length();
+	szMatch = mbstr;
+	while ((szMatch = Unicode::FindMultiByte(szMatch, szEnd - szMatch,
+			szPattern, ulLength, bIgnoreCase)) != NULL) {
+		TopicMatch match;
+		match.field = field;
+		match.offset = (uint32_t)(szMatch - mbstr);
+		vecMatches.push_back(match);
+
+		szMatch += ulLength;
+	}
+}
+
 /*
  * +===========================================================================+
  * |                                                                           |
@@ -438,6 +872,38 @@ Error* Document::CheckFieldConsistency(Field *ref, Field *parent,Field* child,
  *         an error occurred while trying to parse or read the file.
  */
 Document* Document::ReadFile(LPCTSTR szPath) {
+	return ReadFile(szPath, false);
+}
+
+/**
+ * Reads a document object from a file, optionally making identical topic texts
+ * share a single buffer in memory.
+ *
+ * @param szPath      Path to the file to be read and parsed into an object.
+ * @param bInternText Should identical topic texts share their buffers?
+ *
+ * @return The object representation of the read document or BOLOTA_ERR_NULL if
+ *         an error occurred while trying to parse or read the file.
+ */
+Document* Document::ReadFile(LPCTSTR szPath, bool bInternText) {
+	return ReadFile(szPath, bInternText, BOLOTA_TEXT_LENIENT);
+}
+
+/**
+ * Reads a document object from a file, optionally making identical topic texts
+ * share a single buffer in memory. Texts that aren't valid UTF-8 are either
+ * repaired (replacing invalid sequences with U+FFFD) or make the whole read
+ * fail with an InvalidText error.
+ *
+ * @param szPath      Path to the file to be read and parsed into an object.
+ * @param bInternText Should identical topic texts share their buffers?
+ * @param mode        Should invalid texts be repaired or fail the read?
+ *
+ * @return The object representation of the read document or BOLOTA_ERR_NULL if
+ *         an error occurred while trying to parse or read the file.
+ */
+Document* Document::ReadFile(LPCTSTR szPath, bool bInternText,
+							 bolota_text_mode_t mode) {
 	size_t ulLength = 0;
 	DWORD dwRead = 0;
 
@@ -468,7 +934,7 @@ Document* Document::ReadFile(LPCTSTR szPath) {
 		return BOLOTA_ERR_NULL;
 	}
 	ulLength += dwRead;
-	if (ucVersion < BOLOTA_DOC_VER) {
+	if (ucVersion > BOLOTA_DOC_VER) {
 		ThrowError(new InvalidVersion(hFile));
 		return BOLOTA_ERR_NULL;
 	}
@@ -489,14 +955,36 @@ Document* Document::ReadFile(LPCTSTR szPath) {
 	}
 	ulLength += dwRead;
 
+	// Make sure the sections are actually in the file.
+	uint64_t ullSize = 0;
+	if (!FileUtils::GetSize(hFile, &ullSize)) {
+		ThrowError(new SystemError(EMSG("Could not get the size of the file")));
+		FileUtils::Close(hFile);
+		return BOLOTA_ERR_NULL;
+	}
+	if (((uint64_t)ulLength + dwLengthProp + dwLengthTopics) > ullSize) {
+		ThrowError(EMSG("Document sections go past the end of the file"));
+		FileUtils::Close(hFile);
+		return BOLOTA_ERR_NULL;
+	}
+
 	// Create the new document and start parsing.
 	Document *self = new Document();
 	self->m_hFile = hFile;
 	self->m_strPath = szPath;
-	if (!self->ReadProperties(&ulLength))
+	if (bInternText) {
+		self->m_pool = new TextPool();
+		self->m_pool->BeginBatch();
+	}
+	if (!self->ReadProperties(&ulLength, mode))
 		goto error_handling;
-	if (!self->ReadTopics(dwLengthTopics, &ulLength))
+	if (!self->ReadTopics(dwLengthTopics, &ulLength, mode))
 		goto error_handling;
+	if ((ucVersion >= 2) && !self->ReadExtensions(&ulLength, mode))
+		goto error_handling;
+	self->BuildIDs(BOLOTA_FIELD_ID_NONE);
+	if (bInternText)
+		self->m_pool->EndBatch();
 
 	// Close the file handle and mark as clean.
 	self->CloseFile();
@@ -586,6 +1074,9 @@ size_t Document::WriteFile(LPCTSTR szPath, bool bAssociate) {
 	if (BolotaHasError)
 		return BOLOTA_ERR_SIZET;
 	ulBytes += WriteTopics();
+	if (BolotaHasError)
+		return BOLOTA_ERR_SIZET;
+	ulBytes += WriteExtensions();
 	if (BolotaHasError)
 		return BOLOTA_ERR_SIZET;
 
@@ -601,21 +1092,24 @@ size_t Document::WriteFile(LPCTSTR szPath, bool bAssociate) {
  *
  * @param ulBytes Pointer to the counter storing the number of bytes read from
  *                the file so far.
+ * @param mode    Should invalid texts be repaired or fail the read?
  *
  * @return TRUE if the operation was successful, FALSE otherwise.
  */
-bool Document::ReadProperties(size_t *ulBytes) {
+bool Document::ReadProperties(size_t *ulBytes, bolota_text_mode_t mode) {
 	uint8_t ucDepth = 0;
 
 	// Read each property field in order.
-	m_title = static_cast<TextField*>(Field::Read(m_hFile, ulBytes, &ucDepth));
+	m_title = static_cast<TextField*>(Field::Read(m_hFile, ulBytes, &ucDepth,
+		NULL, mode));
 	if (m_title == BOLOTA_ERR_NULL)
 		return false;
 	m_subtitle = static_cast<TextField*>(Field::Read(m_hFile, ulBytes,
-		&ucDepth));
+		&ucDepth, NULL, mode));
 	if (m_subtitle == BOLOTA_ERR_NULL)
 		return false;
-	m_date = static_cast<DateField*>(Field::Read(m_hFile, ulBytes, &ucDepth));
+	m_date = static_cast<DateField*>(Field::Read(m_hFile, ulBytes, &ucDepth,
+		NULL, mode));
 	if (m_date == BOLOTA_ERR_NULL)
 		return false;
 
@@ -628,10 +1122,12 @@ bool Document::ReadProperties(size_t *ulBytes) {
  * @param dwLengthTopics Length of the topics scetion of the file.
  * @param ulBytes        Pointer to the counter storing the number of bytes read
  *                       from the file so far.
+ * @param mode           Should invalid texts be repaired or fail the read?
  *
  * @return TRUE if the operation was successful, FALSE otherwise.
  */
-bool Document::ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes) {
+bool Document::ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes,
+						  bolota_text_mode_t mode) {
 	size_t ulStartBytes = *ulBytes;
 	uint8_t ucLastDepth = 0;
 	uint8_t ucDepth = 0;
@@ -641,7 +1137,7 @@ bool Document::ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes) {
 	Field *field = NULL;
 	while ((*ulBytes - ulStartBytes) < dwLengthTopics) {
 		// Read the field.
-		field = Field::Read(m_hFile, ulBytes, &ucDepth);
+		field = Field::Read(m_hFile, ulBytes, &ucDepth, m_pool, mode);
 		if (field == BOLOTA_ERR_NULL) {
 			ThrowError(EMSG("Failed to read document topic"));
 			return false;
@@ -666,10 +1162,12 @@ bool Document::ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes) {
 			while (parent->Depth() != ucDepth)
 				parent = parent->Parent();
 			parent->SetNext(field, false);
+		} else if (fieldLast == NULL) {
+			// First topic of the document.
+			SetFirstTopic(field);
 		} else {
 			// This is just the next field in line.
-			if (!AppendTopic(fieldLast, field))
-				return false;
+			fieldLast->SetNext(field, false);
 		}
 
 		// Set the last field for the next iteration.
@@ -680,6 +1178,229 @@ bool Document::ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes) {
 	return true;
 }
 
+/**
+ * Reads the extension sections that follow the topics section until the end of
+ * the file. Sections that we don't know about are skipped.
+ *
+ * @param ulBytes Pointer to the counter storing the number of bytes read from
+ *                the file so far.
+ * @param mode    How texts that aren't valid UTF-8 should be handled.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool Document::ReadExtensions(size_t *ulBytes, bolota_text_mode_t mode) {
+	char szTag[BOLOTA_DOC_EXT_TAG_LEN + 1];
+	uint32_t dwLength;
+	uint64_t ullSize;
+	DWORD dwRead = 0;
+
+	// Get the size of the file to check the lengths of the sections against.
+	if (!FileUtils::GetSize(m_hFile, &ullSize)) {
+		ThrowError(new SystemError(EMSG("Could not get the size of the file")));
+		return false;
+	}
+
+	while (true) {
+		// Read the tag of the section or stop at the end of the file.
+		if (!FileUtils::Read(m_hFile, szTag, BOLOTA_DOC_EXT_TAG_LEN,
+				&dwRead)) {
+			ThrowError(new ReadError(m_hFile, *ulBytes, false));
+			return false;
+		}
+		if (dwRead == 0)
+			return true;
+		if (dwRead != BOLOTA_DOC_EXT_TAG_LEN) {
+			ThrowError(new ReadError(m_hFile, *ulBytes + dwRead, false));
+			return false;
+		}
+		*ulBytes += dwRead;
+		szTag[BOLOTA_DOC_EXT_TAG_LEN] = '\0';
+
+		// Read the length of the section.
+		if (!FileUtils::Read(m_hFile, &dwLength, sizeof(uint32_t), &dwRead) ||
+				(dwRead != sizeof(uint32_t))) {
+			ThrowError(new ReadError(m_hFile, *ulBytes, false));
+			return false;
+		}
+		*ulBytes += dwRead;
+
+		// Make sure a corrupted length can't make us allocate or skip past
+		// the end of the file.
+		if (((uint64_t)*ulBytes + dwLength) > ullSize) {
+			ThrowError(EMSG("Extension section goes past the end of the file"));
+			return false;
+		}
+
+		// Parse the sections we know about.
+		if (strcmp(szTag, BOLOTA_DOC_EXT_FIELD_IDS) == 0) {
+			if (!ReadFieldIDs(dwLength, ulBytes))
+				return false;
+			continue;
+		}
+		if (strcmp(szTag, BOLOTA_DOC_EXT_LONG_TEXTS) == 0) {
+			if (!ReadLongTexts(dwLength, ulBytes, mode))
+				return false;
+			continue;
+		}
+		if (strcmp(szTag, BOLOTA_DOC_EXT_TRIGRAMS) == 0) {
+			if (!ReadTrigrams(dwLength, ulBytes))
+				return false;
+			continue;
+		}
+
+		// Skip over the ones we don't.
+		if (!FileUtils::Seek(m_hFile, dwLength)) {
+			ThrowError(new ReadError(m_hFile, *ulBytes, false));
+			return false;
+		}
+		*ulBytes += dwLength;
+	}
+}
+
+/**
+ * Reads the field identifiers section and gives each topic its identifier.
+ *
+ * @param dwLength Length of the section in bytes.
+ * @param ulBytes  Pointer to the counter storing the number of bytes read from
+ *                 the file so far.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool Document::ReadFieldIDs(uint32_t dwLength, size_t *ulBytes) {
+	DWORD dwRead = 0;
+
+	// Check if the section makes sense.
+	if ((dwLength < sizeof(field_id_t)) || (dwLength % sizeof(field_id_t))) {
+		ThrowError(EMSG("Invalid length of the field identifiers section"));
+		return false;
+	}
+
+	// Read the entire section in one go.
+	std::vector<field_id_t> vecIDs(dwLength / sizeof(field_id_t));
+	if (!FileUtils::Read(m_hFile, &vecIDs[0], dwLength, &dwRead) ||
+			(dwRead != dwLength)) {
+		ThrowError(new ReadError(m_hFile, *ulBytes, false));
+		return false;
+	}
+	*ulBytes += dwRead;
+
+	// Hand the identifiers over to the topics.
+	size_t ulCount = vecIDs.size() - 1;
+	if (ApplyIDs(m_topics, (ulCount > 0) ? &vecIDs[1] : NULL, ulCount) !=
+			ulCount) {
+		ThrowError(EMSG("Number of field identifiers doesn't match the ")
+			_T("number of topics"));
+		return false;
+	}
+	m_ids.SetNextID(vecIDs[0]);
+
+	return true;
+}
+
+/**
+ * Reads the long texts section and appends the rest of each text to the start
+ * that was stored in its field.
+ *
+ * @param dwLength Length of the section in bytes.
+ * @param ulBytes  Pointer to the counter storing the number of bytes read from
+ *                 the file so far.
+ * @param mode     How texts that aren't valid UTF-8 should be handled.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool Document::ReadLongTexts(uint32_t dwLength, size_t *ulBytes,
+							 bolota_text_mode_t mode) {
+	std::vector<Field*> vecFields;
+	DWORD dwRead = 0;
+
+	// Read the entire section in one go.
+	std::vector<char> vecSection(dwLength + 1);
+	if (!FileUtils::Read(m_hFile, &vecSection[0], dwLength, &dwRead) ||
+			(dwRead != dwLength)) {
+		ThrowError(new ReadError(m_hFile, *ulBytes, false));
+		return false;
+	}
+
+	// Go through the texts.
+	CollectFields(vecFields);
+	size_t pos = 0;
+	while (pos < dwLength) {
+		uint32_t dwIndex;
+		uint32_t dwTextLength;
+
+		// Check if the entry makes sense.
+		if ((dwLength - pos) < (sizeof(uint32_t) * 2)) {
+			ThrowError(EMSG("Truncated entry in the long texts section"));
+			return false;
+		}
+		memcpy(&dwIndex, &vecSection[pos], sizeof(uint32_t));
+		memcpy(&dwTextLength, &vecSection[pos + sizeof(uint32_t)],
+			sizeof(uint32_t));
+		pos += sizeof(uint32_t) * 2;
+		if ((dwIndex >= vecFields.size()) || !vecFields[dwIndex]->HasText() ||
+				((dwLength - pos) < dwTextLength)) {
+			ThrowError(EMSG("Invalid entry in the long texts section"));
+			return false;
+		}
+
+		// Make sure the text is valid UTF-8 before anything gets to use it.
+		const char *szText = &vecSection[pos];
+		pos += dwTextLength;
+		size_t ulValid = Unicode::ValidMultiByteLength(szText, dwTextLength);
+		std::vector<char> vecRepaired;
+		if (ulValid < dwTextLength) {
+			if (mode == BOLOTA_TEXT_STRICT) {
+				ThrowError(new InvalidText(m_hFile,
+					*ulBytes + pos - dwTextLength + ulValid, false));
+				return false;
+			}
+
+			vecRepaired.resize(Unicode::RepairMultiByte(szText, dwTextLength,
+				NULL) + 1);
+			dwTextLength = (uint32_t)Unicode::RepairMultiByte(szText,
+				dwTextLength, &vecRepaired[0]);
+			szText = &vecRepaired[0];
+		}
+
+		// Put the text back together. Topics come after the title, subtitle
+		// and date, and the indexes have to know about them.
+		Field *field = vecFields[dwIndex];
+		UString strText(*field->Text());
+		strText.Insert(strText.Length(), szText, dwTextLength);
+		field->SetText(strText);
+		if (dwIndex >= 3)
+			TopicChanged(field);
+	}
+	*ulBytes += dwRead;
+
+	return true;
+}
+
+/**
+ * Reads the trigram index section, which enables the trigram index of the
+ * document. The index is built from the topics if the section is out of date.
+ *
+ * @param dwLength Length of the section in bytes.
+ * @param ulBytes  Pointer to the counter storing the number of bytes read from
+ *                 the file so far.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool Document::ReadTrigrams(uint32_t dwLength, size_t *ulBytes) {
+	bool bAttached = m_trigrams != NULL;
+
+	if (!bAttached)
+		m_trigrams = new TrigramIndex();
+	if (!m_trigrams->Read(m_hFile, dwLength, ulBytes, m_topics))
+		return false;
+
+	// Already built from the section, so it shouldn't be built again.
+	if (!bAttached)
+		m_indexes.push_back(m_trigrams);
+
+	return true;
+}
+
 /**
  * Writes the properties section of the file.
  *
@@ -742,6 +1463,264 @@ size_t Document::WriteTopics() const {
 	return WriteTopics(m_topics);
 }
 
+/**
+ * Writes the extension sections of the file.
+ *
+ * @return Number of bytes written to the file.
+ */
+size_t Document::WriteExtensions() const {
+	size_t ulBytes = 0;
+
+	ulBytes += WriteFieldIDs();
+	if (BolotaHasError)
+		return BOLOTA_ERR_SIZET;
+	ulBytes += WriteLongTexts();
+	if (BolotaHasError)
+		return BOLOTA_ERR_SIZET;
+	ulBytes += WriteTrigrams();
+	if (BolotaHasError)
+		return BOLOTA_ERR_SIZET;
+
+	return ulBytes;
+}
+
+/**
+ * Writes the field identifiers section of the file.
+ *
+ * @return Number of bytes written to the file.
+ */
+size_t Document::WriteFieldIDs() const {
+	std::vector<field_id_t> vecIDs;
+	size_t ulBytes = 0;
+	DWORD dwWritten = 0;
+
+	// Gather the identifiers in the same order as the topics section.
+	vecIDs.push_back(m_ids.NextID());
+	CollectIDs(m_topics, vecIDs);
+	uint32_t dwLength = (uint32_t)(vecIDs.size() * sizeof(field_id_t));
+
+	// Write the section header.
+	if (!FileUtils::Write(m_hFile, BOLOTA_DOC_EXT_FIELD_IDS,
+			BOLOTA_DOC_EXT_TAG_LEN, &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+	if (!FileUtils::Write(m_hFile, &dwLength, sizeof(uint32_t), &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+
+	// Write the identifiers.
+	if (!FileUtils::Write(m_hFile, &vecIDs[0], dwLength, &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+
+	return ulBytes;
+}
+
+/**
+ * Writes the long texts section of the file if any of the fields has a text
+ * that's too long to be stored entirely in it.
+ *
+ * @return Number of bytes written to the file.
+ */
+size_t Document::WriteLongTexts() const {
+	std::vector<Field*> vecFields;
+	std::vector<uint32_t> vecLong;
+	size_t ulBytes = 0;
+	DWORD dwWritten = 0;
+
+	// Find the fields that need the section and measure it.
+	uint64_t ullLength = 0;
+	CollectFields(vecFields);
+	for (size_t i = 0; i < vecFields.size(); i++) {
+		if (!vecFields[i]->HasLongText())
+			continue;
+
+		vecLong.push_back((uint32_t)i);
+		ullLength += (sizeof(uint32_t) * 2) + vecFields[i]->Text()->Length() -
+			vecFields[i]->TextLength();
+	}
+	if (vecLong.empty())
+		return 0;
+	if (ullLength > 0xFFFFFFFF) {
+		ThrowError(EMSG("Texts of the document are too long to be saved"));
+		return BOLOTA_ERR_SIZET;
+	}
+	uint32_t dwLength = (uint32_t)ullLength;
+
+	// Write the section header.
+	if (!FileUtils::Write(m_hFile, BOLOTA_DOC_EXT_LONG_TEXTS,
+			BOLOTA_DOC_EXT_TAG_LEN, &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+	if (!FileUtils::Write(m_hFile, &dwLength, sizeof(uint32_t), &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+
+	// Write the rest of each text.
+	for (size_t i = 0; i < vecLong.size(); i++) {
+		Field *field = vecFields[vecLong[i]];
+		size_t ulStart = field->TextLength();
+		uint32_t entry[2];
+
+		entry[0] = vecLong[i];
+		entry[1] = (uint32_t)(field->Text()->Length() - ulStart);
+		if (!FileUtils::Write(m_hFile, entry, sizeof(entry), &dwWritten)) {
+			ThrowError(new WriteError(m_hFile, ulBytes, true));
+			return BOLOTA_ERR_SIZET;
+		}
+		ulBytes += dwWritten;
+
+		if (!FileUtils::Write(m_hFile,
+				field->Text()->GetMultiByteString() + ulStart, entry[1],
+				&dwWritten)) {
+			ThrowError(new WriteError(m_hFile, ulBytes, true));
+			return BOLOTA_ERR_SIZET;
+		}
+		ulBytes += dwWritten;
+	}
+
+	return ulBytes;
+}
+
+/**
+ * Writes the trigram index section of the file if the index is enabled. Topics
+ * that were edited since the index was built get indexed again beforehand.
+ *
+ * @return Number of bytes written to the file.
+ */
+size_t Document::WriteTrigrams() const {
+	size_t ulBytes = 0;
+	DWORD dwWritten = 0;
+
+	// Is the index even enabled?
+	if (m_trigrams == NULL)
+		return 0;
+
+	// Make sure the section describes the topics we've just written.
+	if (!m_trigrams->IsCurrent())
+		m_trigrams->Refresh(m_topics);
+	uint32_t dwLength = m_trigrams->SectionLength();
+
+	// Write the section header.
+	if (!FileUtils::Write(m_hFile, BOLOTA_DOC_EXT_TRIGRAMS,
+			BOLOTA_DOC_EXT_TAG_LEN, &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+	if (!FileUtils::Write(m_hFile, &dwLength, sizeof(uint32_t), &dwWritten)) {
+		ThrowError(new WriteError(m_hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+
+	// Write the index.
+	ulBytes += m_trigrams->Write(m_hFile);
+	if (BolotaHasError)
+		return BOLOTA_ERR_SIZET;
+
+	return ulBytes;
+}
+
+/**
+ * Registers the identifiers that the topics already have and hands out new ones
+ * to those that don't, never going back on one that's been handed out before.
+ *
+ * @param nextID Next identifier to be handed out according to the file the
+ *               topics came from, or BOLOTA_FIELD_ID_NONE if unknown.
+ */
+void Document::BuildIDs(field_id_t nextID) {
+	m_ids.SetNextID(nextID);
+	m_ids.Build(m_topics);
+}
+
+/**
+ * Gathers the identifiers of a topic field linked list in the same order as
+ * they are written to the file.
+ *
+ * @param field  First field of the list. Will include its childs and simblings.
+ * @param vecIDs Vector to receive the identifiers.
+ */
+void Document::CollectIDs(Field *field, std::vector<field_id_t>& vecIDs) {
+	while (field != NULL) {
+		vecIDs.push_back(field->ID());
+		if (field->HasChild())
+			CollectIDs(field->Child(), vecIDs);
+		field = field->Next();
+	}
+}
+
+/**
+ * Gives the topics of a field linked list their identifiers in the same order
+ * as they are written to the file.
+ *
+ * @param field   First field of the list. Will include its childs and
+ *                simblings.
+ * @param ids     Identifiers to be handed out.
+ * @param ulCount Number of identifiers available.
+ *
+ * @return Number of topics in the list, which may be more than the number of
+ *         identifiers available.
+ */
+size_t Document::ApplyIDs(Field *field, const field_id_t *ids,
+						  size_t ulCount) {
+	size_t ulApplied = 0;
+
+	while (field != NULL) {
+		if (ulApplied < ulCount)
+			field->SetID(ids[ulApplied]);
+		ulApplied++;
+		if (field->HasChild()) {
+			ulApplied += ApplyIDs(field->Child(),
+				(ulApplied < ulCount) ? ids + ulApplied : NULL,
+				(ulApplied < ulCount) ? ulCount - ulApplied : 0);
+		}
+		field = field->Next();
+	}
+
+	return ulApplied;
+}
+
+/**
+ * Gathers every field of the document in the same order as they are written to
+ * the file, starting with the title, subtitle and date.
+ *
+ * @param vecFields Vector to receive the fields.
+ */
+void Document::CollectFields(std::vector<Field*>& vecFields) const {
+	vecFields.push_back(m_title);
+	vecFields.push_back(m_subtitle);
+	vecFields.push_back(m_date);
+	CollectFields(m_topics, vecFields);
+}
+
+/**
+ * Gathers the fields of a topic field linked list in the same order as they
+ * are written to the file.
+ *
+ * @param field     First field of the list. Will include its childs and
+ *                  simblings.
+ * @param vecFields Vector to receive the fields.
+ */
+void Document::CollectFields(Field *field, std::vector<Field*>& vecFields) {
+	while (field != NULL) {
+		vecFields.push_back(field);
+		if (field->HasChild())
+			CollectFields(field->Child(), vecFields);
+		field = field->Next();
+	}
+}
+
 /**
  * Gets the length of the properties section of the file.
  *
@@ -942,3 +1921,145 @@ void Document::SetDirty(bool dirty) {
 bool Document::IsDirty() const {
 	return this->m_bDirty;
 }
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Memory Usage                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets a breakdown of the memory used by the document. Allocator overhead is
+ * an estimate based on a typical malloc implementation, since it can't be
+ * queried portably.
+ *
+ * @return Memory usage statistics of the document.
+ */
+bolota_mem_stats_t Document::MemoryStats() const {
+	std::set<const void*> setBuffers;
+	bolota_mem_stats_t stats;
+
+	// Properties and topics.
+	memset(&stats, 0, sizeof(bolota_mem_stats_t));
+	FieldMemoryStats(m_title, &stats, setBuffers);
+	FieldMemoryStats(m_subtitle, &stats, setBuffers);
+	FieldMemoryStats(m_date, &stats, setBuffers);
+	TopicsMemoryStats(m_topics, &stats, setBuffers);
+
+	// Auxiliary structures owned by the document.
+	stats.indexes += m_ids.HeapSize();
+	if (m_pool != NULL)
+		stats.indexes += sizeof(TextPool) + m_pool->HeapSize();
+	if (m_trigrams != NULL)
+		stats.indexes += sizeof(TrigramIndex) + m_trigrams->HeapSize();
+	stats.indexes += m_indexes.capacity() * sizeof(DocumentIndex*);
+
+	// Errors that haven't been handled yet.
+	for (Error *err = ErrorStack::Top(); err != NULL; err = err->Previous()) {
+		size_t ulSize = sizeof(Error);
+		stats.errors += ulSize;
+		stats.slack += AllocationSize(ulSize) - ulSize;
+
+		if (err->Message() != NULL) {
+			ulSize = (_tcslen(err->Message()) + 1) * sizeof(TCHAR);
+			stats.errors += ulSize;
+			stats.slack += AllocationSize(ulSize) - ulSize;
+		}
+	}
+
+	stats.total = stats.nodes + stats.text + stats.wide + stats.indexes +
+		stats.errors + stats.slack;
+
+	return stats;
+}
+
+/**
+ * Adds the memory used by a single field to the statistics.
+ *
+ * @param field      Field to be measured. Can be NULL.
+ * @param stats      Statistics to be updated.
+ * @param setBuffers Text buffers that have already been counted.
+ */
+void Document::FieldMemoryStats(Field *field, bolota_mem_stats_t *stats,
+								std::set<const void*>& setBuffers) {
+	size_t ulSize;
+
+	if (field == NULL)
+		return;
+
+	// Field object.
+	switch (field->Type()) {
+	case BOLOTA_TYPE_DATE:
+		ulSize = sizeof(DateField);
+		break;
+	case BOLOTA_TYPE_ICON:
+		ulSize = sizeof(IconField);
+		break;
+	default:
+		ulSize = sizeof(Field);
+	}
+	stats->nodes += ulSize;
+	stats->slack += AllocationSize(ulSize) - ulSize;
+	stats->fields++;
+	stats->types[(uint8_t)field->Type()]++;
+
+	// Text object.
+	if (!field->HasText())
+		return;
+	UString *str = field->Text();
+	stats->nodes += sizeof(UString);
+	stats->slack += AllocationSize(sizeof(UString)) - sizeof(UString);
+
+	// Text buffer, only counted once if it's shared.
+	ulSize = str->HeapSize();
+	const void *buf = str->HeapBuffer();
+	if ((buf != NULL) && !setBuffers.insert(buf).second) {
+		stats->shared += ulSize;
+	} else if (ulSize > 0) {
+		stats->text += ulSize;
+		stats->slack += AllocationSize(ulSize) - ulSize;
+	}
+
+	// Cached wide string.
+	ulSize = str->WideSize();
+	if (ulSize > 0) {
+		stats->wide += ulSize;
+		stats->slack += AllocationSize(ulSize) - ulSize;
+	}
+}
+
+/**
+ * Adds the memory used by a topic field linked list to the statistics.
+ *
+ * @param field      Field to be measured. Will include its childs and
+ *                   simblings.
+ * @param stats      Statistics to be updated.
+ * @param setBuffers Text buffers that have already been counted.
+ */
+void Document::TopicsMemoryStats(Field *field, bolota_mem_stats_t *stats,
+								 std::set<const void*>& setBuffers) {
+	while (field != NULL) {
+		FieldMemoryStats(field, stats, setBuffers);
+		if (field->HasChild())
+			TopicsMemoryStats(field->Child(), stats, setBuffers);
+		field = field->Next();
+	}
+}
+
+/**
+ * Estimates how many bytes the allocator actually takes to satisfy a request.
+ * Models the usual malloc behaviour of a size header, rounding to twice the
+ * pointer size and a minimum chunk size.
+ *
+ * @param ulSize Number of bytes requested.
+ *
+ * @return Estimated number of bytes taken from the heap.
+ */
+size_t Document::AllocationSize(size_t ulSize) {
+	size_t ulAlign = 2 * sizeof(void*);
+	size_t ulChunk = (ulSize + sizeof(size_t) + ulAlign - 1) & ~(ulAlign - 1);
+
+	return (ulChunk < (2 * ulAlign)) ? (2 * ulAlign) : ulChunk;
+}
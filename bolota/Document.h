@@ -25,6 +25,14 @@
 #include "UString.h"
 #include "Field.h"
 #include "DateField.h"
+#include "IconField.h"
+#include "TextPool.h"
+#include "Indexes/DocumentIndex.h"
+#include "Indexes/IdIndex.h"
+#include "Indexes/TrigramIndex.h"
+
+#include <vector>
+#include <set>
 
 extern "C" {
 #endif // __cplusplus
@@ -38,7 +46,45 @@ extern "C" {
 /**
  * Document version used by this version of the library.
  */
-#define BOLOTA_DOC_VER 1
+#define BOLOTA_DOC_VER 2
+
+/**
+ * Length of the tag that identifies an extension section.
+ */
+#define BOLOTA_DOC_EXT_TAG_LEN 4
+
+/**
+ * Tag of the extension section with the identifiers of the topics. Contains the
+ * next identifier to be handed out followed by the identifier of each topic in
+ * the same order as the topics section. (all uint64)
+ */
+#define BOLOTA_DOC_EXT_FIELD_IDS "FIDS"
+
+/**
+ * Tag of the extension section with the trigram index of the topic texts. Its
+ * layout is described in Indexes/TrigramIndex.h.
+ */
+#define BOLOTA_DOC_EXT_TRIGRAMS "TRGM"
+
+/**
+ * Tag of the extension section with the rest of the texts that are too long to
+ * fit in a field. (see BOLOTA_FIELD_TEXT_MAX) Contains an entry for each of
+ * these fields with its index (uint32, counting the title, subtitle and date
+ * before the topics in the same order as the topics section), the length of
+ * the rest of the text in bytes (uint32) and the UTF-8 text itself, which gets
+ * appended to the start that's stored in the field.
+ */
+#define BOLOTA_DOC_EXT_LONG_TEXTS "LTXT"
+
+/**
+ * Extension section that may follow the topics section of a document. Readers
+ * must skip the sections they don't know about.
+ */
+typedef struct bolota_doc_ext_s {
+	char tag[4];      /* Identifier of the section. */
+	uint32_t length;  /* Length of the data part of the section in bytes. */
+	uint8_t *data;    /* Contents of the section. */
+} bolota_doc_ext_t;
 
 /**
  * An entire bolota document.
@@ -62,16 +108,47 @@ typedef struct bolota_doc_s {
 
 	/* Section: Sequence of topics fields. */
 	/* Section: Sequence of attachment fields. */
+	/* Section: Sequence of extension sections until the end of the file.
+	 *          (version 2 onwards) */
 } bolota_doc_t;
 
+/**
+ * Breakdown of the memory used by a document that's loaded. All sizes are in
+ * bytes and include the document properties.
+ */
+typedef struct bolota_mem_stats_s {
+	size_t nodes;      /* Field and string objects. */
+	size_t text;       /* UTF-8 texts and ropes. (shared buffers counted once) */
+	size_t shared;     /* Text that would have been duplicated if it wasn't
+	                    * shared between fields. Not included in the total. */
+	size_t wide;       /* Cached wide versions of the texts. */
+	size_t indexes;    /* Identifiers table and text interning pool. */
+	size_t errors;     /* Error objects waiting in the error stack. */
+	size_t slack;      /* Estimated allocator headers and rounding. */
+	size_t total;      /* Everything above, except for the shared text. */
+	size_t fields;     /* Number of fields. */
+	size_t types[256]; /* Number of fields of each bolota_type_t. */
+} bolota_mem_stats_t;
+
 #ifdef __cplusplus
 }
 
 namespace Bolota {
 	/**
+	 * Occurrence of a search pattern in the text of a topic. The outline path
+	 * of the match is given by the parents of the topic. (see TopicPath)
+	 */
+	struct TopicMatch {
+		Field *field;     // Topic where the pattern was found.
+		uint32_t offset;  // Position of the match in the UTF-8 text in bytes.
+	};
+
+	/**
      * Abstraction of a Bolota document.
 	 */
 	class Document {
+		friend class FlatDocument;
+
 	private:
 		// Properties
 		TextField *m_title;
@@ -81,6 +158,14 @@ namespace Bolota {
 		// Sections
 		Field *m_topics;
 
+		// Text interning.
+		TextPool *m_pool;
+
+		// Auxiliary indexes.
+		std::vector<DocumentIndex*> m_indexes;
+		IdIndex m_ids;
+		TrigramIndex *m_trigrams;
+
 		// File handle.
 		FHND m_hFile;
 		UString m_strPath;
@@ -96,10 +181,12 @@ namespace Bolota {
 		// Topic management.
 		Field* FirstTopic() const;
 		void SetFirstTopic(Field *topic);
+		Field* FindTopic(field_id_t id) const;
 		bool AppendTopic(Field *field);
 		bool AppendTopic(Field *prev, Field *field);
 		void PrependTopic(Field *next, Field *field);
 		void DeleteTopic(Field *field);
+		void ReplaceTopic(Field *field, Field *replacement);
 		void PopTopic(Field *field);
 		void MoveTopicToTop(Field *field);
 		void MoveTopicBelow(Field *below, Field *above);
@@ -109,8 +196,32 @@ namespace Bolota {
 		Error* CheckFieldConsistency(Field *ref, Field *parent, Field *child,
 			Field *prev, Field *next);
 
+		// Auxiliary indexes.
+		void AttachIndex(DocumentIndex *index);
+		void DetachIndex(DocumentIndex *index);
+		void TopicChanged(Field *field);
+		void SetTopicIcon(IconField *field, field_icon_t icon);
+		void EnableTrigramIndex(bool bEnable);
+		TrigramIndex* Trigrams() const;
+
+		// Text interning.
+		void EnableTextPool(bool bEnable);
+		TextPool* Pool() const;
+		void SetTopicText(Field *field, const char *mbstr);
+		void SetTopicText(Field *field, const wchar_t *wstr);
+
+		// Searching.
+		size_t Find(const char *szPattern, bool bIgnoreCase,
+			std::vector<TopicMatch>& vecMatches) const;
+		size_t Find(const wchar_t *szPattern, bool bIgnoreCase,
+			std::vector<TopicMatch>& vecMatches) const;
+		static size_t TopicPath(Field *field, std::vector<Field*>& vecPath);
+
 		// File operations.
 		static Document* ReadFile(LPCTSTR szPath);
+		static Document* ReadFile(LPCTSTR szPath, bool bInternText);
+		static Document* ReadFile(LPCTSTR szPath, bool bInternText,
+			bolota_text_mode_t mode);
 		size_t WriteFile();
 		size_t WriteFile(LPCTSTR szPath, bool bAssociate);
 		bool HasFileAssociated() const;
@@ -133,12 +244,30 @@ namespace Bolota {
 		void SetDirty(bool dirty);
 		bool IsDirty() const;
 
+		// Memory usage.
+		bolota_mem_stats_t MemoryStats() const;
+
 	protected:
 		// Construtor helpers.
 		Document();
 		void Initialize(TextField *title, TextField *subtitle, DateField *date,
 			LPCTSTR szPath, FHND hFile);
 
+		// Index notifications.
+		void NotifyInserted(Field *field);
+		void NotifyRemoving(Field *field, bool bDeleting);
+
+		// Text interning helpers.
+		void InternTopics(Field *field);
+
+		// Searching helpers.
+		static void FindInTopics(Field *field, const char *szPattern,
+			size_t ulLength, bool bIgnoreCase,
+			std::vector<TopicMatch>& vecMatches);
+		static void FindInTopic(Field *field, const char *szPattern,
+			size_t ulLength, bool bIgnoreCase,
+			std::vector<TopicMatch>& vecMatches);
+
 		// Section lengths.
 		uint32_t PropertiesLength() const;
 		uint32_t TopicsLength() const;
@@ -148,13 +277,40 @@ namespace Bolota {
 		size_t WriteProperties() const;
 		size_t WriteTopics() const;
 		size_t WriteTopics(Field *field) const;
+		size_t WriteExtensions() const;
+		size_t WriteFieldIDs() const;
+		size_t WriteLongTexts() const;
+		size_t WriteTrigrams() const;
 
 		// Read sections from file.
-		bool ReadProperties(size_t *ulBytes);
-		bool ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes);
+		bool ReadProperties(size_t *ulBytes, bolota_text_mode_t mode);
+		bool ReadTopics(uint32_t dwLengthTopics, size_t *ulBytes,
+			bolota_text_mode_t mode);
+		bool ReadExtensions(size_t *ulBytes, bolota_text_mode_t mode);
+		bool ReadFieldIDs(uint32_t dwLength, size_t *ulBytes);
+		bool ReadLongTexts(uint32_t dwLength, size_t *ulBytes,
+			bolota_text_mode_t mode);
+		bool ReadTrigrams(uint32_t dwLength, size_t *ulBytes);
+
+		// Field identifiers helpers.
+		void BuildIDs(field_id_t nextID);
+		static void CollectIDs(Field *field, std::vector<field_id_t>& vecIDs);
+		static size_t ApplyIDs(Field *field, const field_id_t *ids,
+			size_t ulCount);
+
+		// Long texts helpers.
+		void CollectFields(std::vector<Field*>& vecFields) const;
+		static void CollectFields(Field *field, std::vector<Field*>& vecFields);
 
 		// File operations.
 		void CloseFile();
+
+		// Memory usage helpers.
+		static void FieldMemoryStats(Field *field, bolota_mem_stats_t *stats,
+			std::set<const void*>& setBuffers);
+		static void TopicsMemoryStats(Field *field, bolota_mem_stats_t *stats,
+			std::set<const void*>& setBuffers);
+		static size_t AllocationSize(size_t ulSize);
 	};
 }
 
@@ -83,6 +83,15 @@ const TCHAR* Error::Message() {
 	return this->m_message;
 }
 
+/**
+ * Gets the error that was thrown before this one.
+ *
+ * @return Previous error in the stack or NULL if this is the first one.
+ */
+Error* Error::Previous() const {
+	return this->m_prev;
+}
+
 /**
  * Sets the current error as the previous of the error passed as an argument.
  * 
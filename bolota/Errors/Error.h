@@ -63,6 +63,7 @@ namespace Bolota {
 
 		// Getters and setters.
 		const TCHAR* Message();
+		Error* Previous() const;
 
 		// Stack operations.
 		Error* Push(Error* error);
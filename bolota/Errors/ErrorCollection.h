@@ -178,6 +178,21 @@ namespace Bolota {
 			RefreshMessage(strReadError.c_str());
 		};
 	};
+
+	/**
+	 * Thrown whenever we encounter text that isn't valid UTF-8 while strictly
+	 * reading a document.
+	 */
+	class InvalidText : public ReadError {
+	public:
+		InvalidText(FHND hFile, size_t ulPosition, bool bClose) :
+		ReadError(hFile, ulPosition, bClose) {
+			// Append more information to our message.
+			tstring strReadError(m_message);
+			strReadError += _T(". Encountered text that isn't valid UTF-8");
+			RefreshMessage(strReadError.c_str());
+		};
+	};
 }
 
 #endif // _BOLOTA_ERRORS_ERRORCOLLECTION_H
@@ -9,6 +9,11 @@
 
 #ifndef _WIN32
 	#include <errno.h>
+	#include <string.h>
+
+	#ifdef UNICODE
+		#include "../../shims/cvtutf/Unicode.h"
+	#endif // UNICODE
 
 	/**
 	 * Wrapper for Windows GetLastError() to map to UNIX errno.
@@ -82,7 +87,13 @@ void SystemError::Initialize(const TCHAR *szMessage, DWORD dwError) {
 void SystemError::Initialize(const TCHAR *szMessage, int iError) {
 	// Get last error message.
 	m_iError = iError;
+#ifdef UNICODE
+	LPTSTR szLastErrorMsg = NULL;
+	if (!Unicode::MultiByteToWideChar(strerror(iError), &szLastErrorMsg))
+		szLastErrorMsg = wcsdup(L"Unknown error");
+#else
 	LPTSTR szLastErrorMsg = strdup(strerror(iError));
+#endif // UNICODE
 
 	// Free any previous error message if required.
 	if (m_szLastErrorMessage)
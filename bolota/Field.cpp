@@ -7,6 +7,10 @@
 
 #include "Field.h"
 
+#include <stdlib.h>
+#include <utility>
+
+#include "../../shims/cvtutf/Unicode.h"
 #include "Errors/ErrorCollection.h"
 #include "Errors/ConsistencyError.h"
 #include "DateField.h"
@@ -91,6 +95,7 @@ Field::Field(Field *parent, bolota_type_t type, const wchar_t *wstr) {
  * @param field Field to be copied over.
  */
 Field::Field(const Field *field) {
+	Initialize(field->Type(), NULL, NULL, NULL, NULL, NULL);
 	Copy(field, false);
 }
 
@@ -117,6 +122,7 @@ void Field::Initialize(bolota_type_t type, UString *text, Field *parent,
 	// Set properties.
 	SetType(type);
 	m_text = text;
+	m_id = BOLOTA_FIELD_ID_NONE;
 
 	// Setup the linked list.
 	SetParent(parent, true);
@@ -149,16 +155,17 @@ void Field::Destroy(bool include_child, bool include_next) {
  * Creates a duplicate of the field with the option of taking its place in the
  * linked list.
  *
- * @warning Does not copy the field type.
+ * @warning Does not copy the field type. Blank fields don't get the text.
  *
  * @param field    Field to be copied over.
  * @param bReplace Should we change references in its relatives to point to the
- *                 new copied object?
+ *                 new copied object? The identifier is never copied, use
+ *                 Document::ReplaceTopic to replace a topic of a document.
  */
 void Field::Copy(const Field *field, bool bReplace) {
 	// Basics
-	if (field->HasText())
-		SetText(field->Text()->GetNativeString());
+	if (field->HasText() && (m_type != BOLOTA_TYPE_BLANK))
+		SetText(*field->Text());
 
 	// Linked list.
 	SetParent(field->Parent(), !(bReplace && field->IsFirstChild()));
@@ -167,6 +174,60 @@ void Field::Copy(const Field *field, bool bReplace) {
 	SetNext(field->Next(), !bReplace);
 }
 
+/**
+ * Creates an unlinked duplicate of the field. The text buffer is shared with
+ * the original until either one of them is changed.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @return Newly allocated duplicate of the field.
+ */
+Field* Field::Duplicate() const {
+	Field *field;
+
+	// Create a field of the same kind.
+	if (m_type == BOLOTA_TYPE_BLANK) {
+		field = new BlankField();
+	} else {
+		field = new TextField();
+		field->SetType(m_type);
+	}
+
+	// Share the text.
+	if (HasText())
+		field->SetText(*m_text);
+
+	return field;
+}
+
+/**
+ * Creates an unlinked duplicate of the field alongside all of its children.
+ * Text buffers are shared with the originals until they are changed, so this
+ * only costs the allocation of the new field objects.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @return Newly allocated duplicate of the field with its children attached.
+ */
+Field* Field::DuplicateSubtree() const {
+	Field *root = Duplicate();
+	Field *last = NULL;
+
+	// Duplicate the children.
+	for (Field *child = m_child; child != NULL; child = child->Next()) {
+		Field *dup = child->DuplicateSubtree();
+		if (last == NULL) {
+			root->SetChild(dup, false);
+		} else {
+			last->SetNext(dup, false);
+		}
+
+		last = dup;
+	}
+
+	return root;
+}
+
 /*
  * +===========================================================================+
  * |                                                                           |
@@ -187,6 +248,45 @@ void Field::Copy(const Field *field, bool bReplace) {
  *         appropriate specific object type.
  */
 Field* Field::Read(FHND hFile, size_t *bytes, uint8_t *depth) {
+	return Read(hFile, bytes, depth, NULL);
+}
+
+/**
+ * Reads a field from a file into a fully populated and specific field object
+ * that can later be cast to the appropriate object type for its field type,
+ * sharing the buffer of its text with identical texts in a pool.
+ *
+ * @param hFile File handle to read the field from.
+ * @param bytes Pointer to the counter storing the number of bytes read so far.
+ * @param depth Pointer to store the depth of the field found in the file.
+ * @param pool  Pool to intern the text of the field into or NULL if the text
+ *              shouldn't be interned.
+ *
+ * @return Fully populated field object that can later be cast to the
+ *         appropriate specific object type.
+ */
+Field* Field::Read(FHND hFile, size_t *bytes, uint8_t *depth,
+				   TextPool *pool) {
+	return Read(hFile, bytes, depth, pool, BOLOTA_TEXT_LENIENT);
+}
+
+/**
+ * Reads a field from a file into a fully populated and specific field object
+ * that can later be cast to the appropriate object type for its field type,
+ * checking that its text is valid UTF-8.
+ *
+ * @param hFile File handle to read the field from.
+ * @param bytes Pointer to the counter storing the number of bytes read so far.
+ * @param depth Pointer to store the depth of the field found in the file.
+ * @param pool  Pool to intern the text of the field into or NULL if the text
+ *              shouldn't be interned.
+ * @param mode  Should invalid text be repaired or fail the read?
+ *
+ * @return Fully populated field object that can later be cast to the
+ *         appropriate specific object type.
+ */
+Field* Field::Read(FHND hFile, size_t *bytes, uint8_t *depth,
+				   TextPool *pool, bolota_text_mode_t mode) {
 	Field *self = NULL;
 	uint8_t ucType;
 	DWORD dwRead = 0;
@@ -219,7 +319,7 @@ Field* Field::Read(FHND hFile, size_t *bytes, uint8_t *depth) {
 	}
 
 	// Parse the field.
-	*depth = self->ReadField(hFile, bytes);
+	*depth = self->ReadField(hFile, bytes, pool, mode);
 	if ((*depth == BOLOTA_ERR_UINT8) && BolotaHasError)
 		goto error_handling;
 
@@ -237,11 +337,15 @@ error_handling:
  *
  * @param hFile File handle to read the field from.
  * @param bytes Pointer to the counter storing the number of bytes read so far.
+ * @param pool  Pool to intern the text of the field into or NULL if the text
+ *              shouldn't be interned.
+ * @param mode  Should invalid text be repaired or fail the read?
  *
  * @return Depth of the field found in the file or BOLOTA_ERR_UINT8 if an error
  *         happened.
  */
-uint8_t Field::ReadField(FHND hFile, size_t *bytes) {
+uint8_t Field::ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+						 bolota_text_mode_t mode) {
 	DWORD dwRead = 0;
 	uint8_t depth = 0;
 	uint16_t usFieldLength = 0;
@@ -264,8 +368,12 @@ uint8_t Field::ReadField(FHND hFile, size_t *bytes) {
 	}
 	*bytes += dwRead;
 
-	// Allocate and read the text from the text from the field.
-	char *szText = (char *)malloc((usTextLength + 1) * sizeof(char));
+	// Read the text straight into the string's own buffer, or into the pool's
+	// scratch buffer so that duplicates don't allocate anything.
+	if (!HasText())
+		m_text = new UString();
+	char *szText = (pool != NULL) ? pool->ScratchBuffer(usTextLength) :
+		m_text->PrepareMultiByteString(usTextLength);
 	if (szText == NULL) {
 		ThrowError(new SystemError(EMSG("Failed to allocate memory for field ")
 			_T("text")));
@@ -279,20 +387,72 @@ uint8_t Field::ReadField(FHND hFile, size_t *bytes) {
 		}
 	}
 	*bytes += dwRead;
-	szText[usTextLength] = '\0';
-	SetTextOwner(szText);
 
-#ifdef UNICODE
-	// We no longer need the UTF-8 string, so free it.
-	m_text->GetWideString();
-	m_text->FreeMultiByteString();
-#endif // UNICODE
+	// Make sure the text is valid UTF-8 before anything gets to use it.
+	char *szRepaired = NULL;
+	size_t ulValid = Unicode::ValidMultiByteLength(szText, usTextLength);
+	if (ulValid < usTextLength) {
+		if (mode == BOLOTA_TEXT_STRICT) {
+			// Leave the handle open, the file itself is fine.
+			ThrowError(new InvalidText(hFile, *bytes - usTextLength + ulValid,
+				false));
+			return BOLOTA_ERR_UINT8;
+		}
+
+		szRepaired = RepairText(szText, &usTextLength);
+		if (szRepaired == NULL) {
+			ThrowError(new SystemError(EMSG("Failed to allocate memory for ")
+				_T("repaired field text")));
+			return BOLOTA_ERR_UINT8;
+		}
+		szText = szRepaired;
+		if (pool == NULL)
+			m_text->TakeOwnership(szRepaired, usTextLength);
+	}
+
+	// Share the buffer of an identical text.
+	if (pool != NULL) {
+		pool->Intern(m_text, szText, usTextLength);
+		free(szRepaired);
+	}
 
 	return depth;
 }
 
 /**
- * Writes the field contents to a file.
+ * Replaces every invalid UTF-8 sequence of a text with U+FFFD, making sure it
+ * still fits in a field by dropping the characters that would go over its
+ * maximum length.
+ *
+ * @param mbstr    Text to be repaired.
+ * @param usLength Pointer to the length of the text, which will be updated with
+ *                 the length of the repaired text.
+ *
+ * @return Newly allocated NUL terminated repaired text or NULL if we couldn't
+ *         allocate memory for it.
+ */
+char* Field::RepairText(const char *mbstr, uint16_t *usLength) {
+	size_t ulLength = Unicode::RepairMultiByte(mbstr, *usLength, NULL);
+	char *szRepaired = (char *)malloc((ulLength + 1) * sizeof(char));
+	if (szRepaired == NULL)
+		return NULL;
+	Unicode::RepairMultiByte(mbstr, *usLength, szRepaired);
+
+	// Cut the text at the start of the character that goes over the limit.
+	if (ulLength > 0xFFFF) {
+		ulLength = 0xFFFF;
+		while ((ulLength > 0) && ((szRepaired[ulLength] & 0xC0) == 0x80))
+			ulLength--;
+	}
+	szRepaired[ulLength] = '\0';
+	*usLength = (uint16_t)ulLength;
+
+	return szRepaired;
+}
+
+/**
+ * Writes the field contents to a file. Only the start of long texts is written
+ * (see TextLength), the rest has to be stored somewhere else.
  *
  * @param hFile File handle to write the field to.
  *
@@ -337,18 +497,33 @@ size_t Field::Write(FHND hFile) const {
 	ulBytes += dwWritten;
 
 	// Data of the field.
-	if (m_text) {
+	if (m_text && m_text->IsRope()) {
+		const TextRope *rope = m_text->Rope();
+		size_t ulPos = 0;
+
+		// Stream the rope piece by piece instead of flattening it.
+		while (ulPos < usTextLength) {
+			size_t ulPiece = 0;
+			const char *szPiece = rope->Piece(ulPos, &ulPiece);
+			if (szPiece == NULL)
+				break;
+			if (ulPiece > (size_t)(usTextLength - ulPos))
+				ulPiece = usTextLength - ulPos;
+
+			if (!FileUtils::Write(hFile, szPiece, ulPiece, &dwWritten)) {
+				ThrowError(new WriteError(hFile, ulBytes, true));
+				return BOLOTA_ERR_SIZET;
+			}
+			ulBytes += dwWritten;
+			ulPos += ulPiece;
+		}
+	} else if (m_text) {
 		if (!FileUtils::Write(hFile, m_text->GetMultiByteString(), usTextLength,
 				&dwWritten)) {
 			ThrowError(new WriteError(hFile, ulBytes, true));
 			return BOLOTA_ERR_SIZET;
 		}
 		ulBytes += dwWritten;
-
-#ifdef UNICODE
-		// We no longer need the UTF-8 string, so free it.
-		m_text->FreeMultiByteString();
-#endif // UNICODE
 	}
 
 	return ulBytes;
@@ -433,6 +608,35 @@ void Field::SetText(const wchar_t *wstr) {
 	}
 }
 
+/**
+ * Sets the field's text component to a copy of another string.
+ *
+ * @param text String to be associated with the field.
+ */
+void Field::SetText(const UString& text) {
+	if (HasText()) {
+		*m_text = text;
+	} else {
+		m_text = new UString(text);
+	}
+}
+
+#ifdef USTRING_HAS_MOVE
+/**
+ * Sets the field's text component by moving the contents of another string
+ * into it without copying any of its text.
+ *
+ * @param text String to have its contents moved into the field.
+ */
+void Field::SetText(UString&& text) {
+	if (HasText()) {
+		*m_text = std::move(text);
+	} else {
+		m_text = new UString(std::move(text));
+	}
+}
+#endif // USTRING_HAS_MOVE
+
 /**
  * Sets the field's text component by taking ownership of the passed string.
  *
@@ -447,6 +651,19 @@ void Field::SetTextOwner(char *mbstr) {
 	}
 }
 
+/**
+ * Sets the field's text component by taking ownership of the passed string
+ * whose length is already known.
+ *
+ * @param mbstr    Multi byte string of text to be owned by the field.
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ */
+void Field::SetTextOwner(char *mbstr, size_t ulLength) {
+	if (!HasText())
+		m_text = new UString();
+	m_text->TakeOwnership(mbstr, ulLength);
+}
+
 /**
  * Sets the field's text component by taking ownership of the passed string.
  *
@@ -461,6 +678,19 @@ void Field::SetTextOwner(wchar_t *wstr) {
 	}
 }
 
+/**
+ * Sets the field's text component by taking ownership of an entire string
+ * object.
+ *
+ * @param text String object to be owned by the field. This pointer will now be
+ *             handled by the field, do not free or modify it outside of it.
+ */
+void Field::SetTextOwner(UString *text) {
+	if (HasText() && (m_text != text))
+		delete m_text;
+	m_text = text;
+}
+
 /**
  * Gets the length of the entire field structure when written to a file.
  *
@@ -472,7 +702,9 @@ uint16_t Field::FieldLength() const {
 }
 
 /**
- * Gets the length of the data part of the field when written to a file.
+ * Gets the length of the data part of the field when written to a file. Texts
+ * longer than BOLOTA_FIELD_TEXT_MAX are cut at the start of the character that
+ * goes over the limit.
  *
  * @return Length of the data part of the field structure in bytes.
  */
@@ -480,7 +712,51 @@ uint16_t Field::TextLength() const {
 	if (m_text == NULL)
 		return 0;
 
-	return static_cast<uint16_t>(m_text->Length() * sizeof(char));
+	// Check if the text fits in the field.
+	size_t ulLength = m_text->Length() * sizeof(char);
+	if (ulLength <= BOLOTA_FIELD_TEXT_MAX)
+		return static_cast<uint16_t>(ulLength);
+
+	// Cut it without leaving part of a character behind.
+	const char *mbstr = m_text->GetMultiByteString();
+	ulLength = BOLOTA_FIELD_TEXT_MAX;
+	while ((ulLength > 0) && ((mbstr[ulLength] & 0xC0) == 0x80))
+		ulLength--;
+
+	return static_cast<uint16_t>(ulLength);
+}
+
+/**
+ * Checks if the text of the field is too long to be stored entirely in the
+ * field when written to a file.
+ *
+ * @return TRUE if only the start of the text fits in the field.
+ */
+bool Field::HasLongText() const {
+	return (m_text != NULL) &&
+		((m_text->Length() * sizeof(char)) > BOLOTA_FIELD_TEXT_MAX);
+}
+
+/**
+ * Gets the stable identifier of the field.
+ *
+ * @return Identifier of the field or BOLOTA_FIELD_ID_NONE if it hasn't been
+ *         given one by a document yet.
+ */
+field_id_t Field::ID() const {
+	return m_id;
+}
+
+/**
+ * Sets the stable identifier of the field.
+ *
+ * @warning Identifiers are handed out by the document. Changing the identifier
+ *          of a topic that's part of a document won't update its indexes.
+ *
+ * @param id New identifier of the field.
+ */
+void Field::SetID(field_id_t id) {
+	m_id = id;
 }
 
 /*
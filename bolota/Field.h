@@ -23,12 +23,39 @@
 
 #include "Utilities/FileUtils.h"
 #include "UString.h"
+#include "TextPool.h"
 #include "FieldTypes.h"
 #include "Errors/Error.h"
 
 extern "C" {
 #endif // __cplusplus
 
+/**
+ * Stable identifier of a topic that survives edits, moves and reloads.
+ */
+typedef uint64_t field_id_t;
+
+/**
+ * Identifier of a field that hasn't been given one yet.
+ */
+#define BOLOTA_FIELD_ID_NONE 0
+
+/**
+ * Maximum length in bytes of the text stored in a field, leaving room for the
+ * header and type-specific data within its 16-bit length. Longer texts are cut
+ * at a character boundary and the rest is kept by the document in an extension
+ * section. (see BOLOTA_DOC_EXT_LONG_TEXTS)
+ */
+#define BOLOTA_FIELD_TEXT_MAX 0xFF00
+
+/**
+ * How fields read from a file with text that isn't valid UTF-8 are handled.
+ */
+typedef enum bolota_text_mode_e {
+	BOLOTA_TEXT_LENIENT = 0,  /* Replace invalid sequences with U+FFFD. */
+	BOLOTA_TEXT_STRICT        /* Fail to read the field. */
+} bolota_text_mode_t;
+
 /**
  * A line of a note in a document.
  */
@@ -61,6 +88,7 @@ namespace Bolota {
 		// Internals
 		bolota_type_t m_type;
 		UString *m_text;
+		field_id_t m_id;
 
 		// Linked list.
 		Field *m_parent;
@@ -80,9 +108,15 @@ namespace Bolota {
 		virtual ~Field();
 		void Destroy(bool include_child, bool include_next);
 		virtual void Copy(const Field *field, bool bReplace);
+		virtual Field* Duplicate() const;
+		Field* DuplicateSubtree() const;
 
 		// File operations.
 		static Field* Read(FHND hFile, size_t *bytes, uint8_t *depth);
+		static Field* Read(FHND hFile, size_t *bytes, uint8_t *depth,
+			TextPool *pool);
+		static Field* Read(FHND hFile, size_t *bytes, uint8_t *depth,
+			TextPool *pool, bolota_text_mode_t mode);
 		virtual size_t Write(FHND hFile) const;
 
 		// Getters and setters.
@@ -93,10 +127,19 @@ namespace Bolota {
 		UString* Text() const;
 		void SetText(const char *mbstr);
 		void SetText(const wchar_t *wstr);
+		void SetText(const UString& text);
+#ifdef USTRING_HAS_MOVE
+		void SetText(UString&& text);
+#endif // USTRING_HAS_MOVE
 		void SetTextOwner(char *mbstr);
+		void SetTextOwner(char *mbstr, size_t ulLength);
 		void SetTextOwner(wchar_t *wstr);
+		void SetTextOwner(UString *text);
 		virtual uint16_t FieldLength() const;
 		uint16_t TextLength() const;
+		bool HasLongText() const;
+		field_id_t ID() const;
+		void SetID(field_id_t id);
 
 		// Linked list.
 		bool HasParent() const;
@@ -125,7 +168,9 @@ namespace Bolota {
 			Field *child, Field *prev, Field *next);
 
 		// File operations.
-		virtual uint8_t ReadField(FHND hFile, size_t *bytes);
+		virtual uint8_t ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+			bolota_text_mode_t mode);
+		static char* RepairText(const char *mbstr, uint16_t *usLength);
 	};
 
 	/**
@@ -161,8 +206,10 @@ namespace Bolota {
 		// Hide away things that we cannot change.
 		void SetText(const char* mbstr);
 		void SetText(const wchar_t* wstr);
+		void SetText(const UString& text);
 		void SetTextOwner(char* mbstr);
 		void SetTextOwner(wchar_t* wstr);
+		void SetTextOwner(UString* text);
 
 	public:
 		// Constructors
@@ -0,0 +1,940 @@
+/**
+ * FlatDocument.cpp
+ * Read-only, cache-friendly flattened representation of a Bolota document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "FlatDocument.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "Errors/ErrorCollection.h"
+
+using namespace Bolota;
+
+/**
+ * Number of property fields stored before the topics in the arrays.
+ */
+#define FLAT_PROPS_NUM 3
+
+/**
+ * Length of a field header when saved to a file (type, depth, field length and
+ * text length).
+ */
+#define FIELD_HEADER_LEN ((sizeof(uint8_t) * 2) + (sizeof(uint16_t) * 2))
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty flat document.
+ */
+FlatDocument::FlatDocument() {
+	m_nextID = BOLOTA_FIELD_ID_NONE;
+}
+
+/**
+ * Frees up any resources allocated by the object.
+ */
+FlatDocument::~FlatDocument() {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Conversions                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Reads a document file directly into a flat document without creating any of
+ * the intermediate field objects.
+ *
+ * @param szPath Path to the file to be read.
+ *
+ * @return Flat representation of the document or BOLOTA_ERR_NULL if an error
+ *         occurred while trying to parse or read the file.
+ */
+FlatDocument* FlatDocument::ReadFile(LPCTSTR szPath) {
+	FlatDocument *self = NULL;
+	uint8_t *buf = NULL;
+	size_t ulLength = 0;
+	DWORD dwRead = 0;
+
+	// Open a file handle for us to operate on.
+	FHND hFile = FileUtils::Open(szPath, false, true);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		ThrowError(new SystemError(EMSG("Could not open file for reading")));
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Read the file magic and check if it's a Bolota document.
+	char szMagic[BOLOTA_DOC_MAGIC_LEN + 1];
+	if (!FileUtils::Read(hFile, szMagic, BOLOTA_DOC_MAGIC_LEN, &dwRead)) {
+		ThrowError(new ReadError(hFile, ulLength, true));
+		return BOLOTA_ERR_NULL;
+	}
+	ulLength += dwRead;
+	szMagic[BOLOTA_DOC_MAGIC_LEN] = '\0';
+	if (strcmp(szMagic, BOLOTA_DOC_MAGIC)) {
+		ThrowError(new InvalidMagic(hFile));
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Read and check if the version number is compatible.
+	uint8_t ucVersion = 0;
+	if (!FileUtils::Read(hFile, &ucVersion, sizeof(uint8_t), &dwRead)) {
+		ThrowError(new ReadError(hFile, ulLength, true));
+		return BOLOTA_ERR_NULL;
+	}
+	ulLength += dwRead;
+	if (ucVersion > BOLOTA_DOC_VER) {
+		ThrowError(new InvalidVersion(hFile));
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Read the lengths of the properties and topics sections.
+	uint32_t dwLengthProp = 0;
+	uint32_t dwLengthTopics = 0;
+	if (!FileUtils::Read(hFile, &dwLengthProp, sizeof(uint32_t), &dwRead)) {
+		ThrowError(new ReadError(hFile, ulLength, true));
+		return BOLOTA_ERR_NULL;
+	}
+	ulLength += dwRead;
+	if (!FileUtils::Read(hFile, &dwLengthTopics, sizeof(uint32_t), &dwRead)) {
+		ThrowError(new ReadError(hFile, ulLength, true));
+		return BOLOTA_ERR_NULL;
+	}
+	ulLength += dwRead;
+
+	// Make sure a corrupted length can't make us allocate more than the size
+	// of the file.
+	uint64_t ullSize = 0;
+	if (!FileUtils::GetSize(hFile, &ullSize)) {
+		ThrowError(new SystemError(EMSG("Could not get the size of the file")));
+		FileUtils::Close(hFile);
+		return BOLOTA_ERR_NULL;
+	}
+	if (((uint64_t)ulLength + dwLengthProp + dwLengthTopics) > ullSize) {
+		ThrowError(EMSG("Document sections go past the end of the file"));
+		FileUtils::Close(hFile);
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Slurp both sections in a single go.
+	size_t ulSections = (size_t)dwLengthProp + dwLengthTopics;
+	buf = (uint8_t *)malloc(ulSections + 1);
+	if (buf == NULL) {
+		ThrowError(new SystemError(EMSG("Failed to allocate memory for ")
+			_T("document sections")));
+		FileUtils::Close(hFile);
+		return BOLOTA_ERR_NULL;
+	}
+	if (!FileUtils::Read(hFile, buf, ulSections, &dwRead) ||
+			(dwRead != ulSections)) {
+		ThrowError(new ReadError(hFile, ulLength + dwRead, true));
+		free(buf);
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Parse the sections into our arrays. Texts never take more space in the
+	// heap than they did in the file, so a single reservation is enough.
+	self = new FlatDocument();
+	self->Reserve(ulSections / (FIELD_HEADER_LEN + 8), ulSections);
+	if (!self->ParseFields(buf, dwLengthProp, false))
+		goto error_handling;
+	if (!self->ParseFields(buf + dwLengthProp, dwLengthTopics, true))
+		goto error_handling;
+	if (!self->ComputeSubtrees())
+		goto error_handling;
+
+	// Pick up the identifiers of the topics and the rest of the long texts
+	// from the extension sections.
+	if ((ucVersion >= 2) && !self->ReadExtensions(hFile,
+			ulLength + ulSections, ullSize)) {
+		goto error_handling;
+	}
+
+	FileUtils::Close(hFile);
+	free(buf);
+	return self;
+
+error_handling:
+	FileUtils::Close(hFile);
+	free(buf);
+	delete self;
+	return BOLOTA_ERR_NULL;
+}
+
+/**
+ * Creates a flat representation of a document object.
+ *
+ * @param doc Document to be flattened.
+ *
+ * @return Flat representation of the document.
+ */
+FlatDocument* FlatDocument::FromDocument(const Document *doc) {
+	FlatDocument *self = new FlatDocument();
+	bolota_flat_extra_t extra;
+
+	// Properties.
+	UString *str = doc->Title()->Text();
+	self->PushField(BOLOTA_TYPE_TEXT, 0, (str) ? str->GetMultiByteString() :
+		NULL, (str) ? (uint32_t)str->Length() : 0, NULL);
+	str = doc->SubTitle()->Text();
+	self->PushField(BOLOTA_TYPE_TEXT, 0, (str) ? str->GetMultiByteString() :
+		NULL, (str) ? (uint32_t)str->Length() : 0, NULL);
+	str = doc->Date()->Text();
+	extra.timestamp = doc->Date()->Timestamp();
+	self->PushField(BOLOTA_TYPE_DATE, 0, (str) ? str->GetMultiByteString() :
+		NULL, (str) ? (uint32_t)str->Length() : 0, &extra);
+
+	// Topics.
+	self->FlattenTopics(doc->FirstTopic(), 0);
+	self->ComputeSubtrees();
+	self->m_nextID = doc->m_ids.NextID();
+
+	return self;
+}
+
+/**
+ * Rebuilds a fully editable document object from the flat representation.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @return Newly allocated document object.
+ */
+Document* FlatDocument::ToDocument() const {
+	std::vector<Field*> vecLast;
+
+	// Create the document with its properties.
+	Document *doc = new Document(
+		static_cast<TextField*>(CreateField(0)),
+		static_cast<TextField*>(CreateField(1)),
+		static_cast<DateField*>(CreateField(2)));
+
+	// Link up the topics using the last field seen at each depth.
+	for (uint32_t i = 0; i < Count(); ++i) {
+		Field *field = CreateField(i + FLAT_PROPS_NUM);
+		uint8_t depth = Depth(i);
+		field->SetID(ID(i));
+
+		if (depth == 0) {
+			if (vecLast.empty()) {
+				doc->SetFirstTopic(field);
+			} else {
+				vecLast[0]->SetNext(field, false);
+			}
+		} else if (vecLast.size() > depth) {
+			vecLast[depth]->SetNext(field, false);
+		} else {
+			vecLast[depth - 1]->SetChild(field, false);
+		}
+
+		// Forget about anything deeper than us.
+		vecLast.resize(depth + 1);
+		vecLast[depth] = field;
+	}
+
+	// Register the identifiers just like when reading the document, handing
+	// out new ones to any topics that didn't have them.
+	doc->BuildIDs(m_nextID);
+
+	return doc;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Properties                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the title of the document.
+ *
+ * @return UTF-8 encoded title of the document.
+ */
+const char* FlatDocument::Title() const {
+	return &m_heap[m_offsets[0]];
+}
+
+/**
+ * Gets the subtitle of the document.
+ *
+ * @return UTF-8 encoded subtitle of the document.
+ */
+const char* FlatDocument::SubTitle() const {
+	return &m_heap[m_offsets[1]];
+}
+
+/**
+ * Gets the creation date of the document.
+ *
+ * @return Timestamp of when the document was created.
+ */
+timestamp_t FlatDocument::Date() const {
+	return m_extras[2].timestamp;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Topics                                    |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the document.
+ *
+ * @return Number of topic fields.
+ */
+uint32_t FlatDocument::Count() const {
+	return (uint32_t)(m_types.size() - FLAT_PROPS_NUM);
+}
+
+/**
+ * Checks if the document has no topics.
+ *
+ * @return TRUE if the document has no topics.
+ */
+bool FlatDocument::IsEmpty() const {
+	return Count() == 0;
+}
+
+/**
+ * Gets the type of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Field type.
+ */
+bolota_type_t FlatDocument::Type(uint32_t index) const {
+	return static_cast<bolota_type_t>(m_types[index + FLAT_PROPS_NUM]);
+}
+
+/**
+ * Gets the indentation level of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Depth of the field.
+ */
+uint8_t FlatDocument::Depth(uint32_t index) const {
+	return m_depths[index + FLAT_PROPS_NUM];
+}
+
+/**
+ * Gets the number of descendants of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Number of fields below this one.
+ */
+uint32_t FlatDocument::SubtreeSize(uint32_t index) const {
+	return m_subtrees[index + FLAT_PROPS_NUM];
+}
+
+/**
+ * Gets the index just past the last descendant of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Index of the first field that isn't part of the subtree.
+ */
+uint32_t FlatDocument::SubtreeEnd(uint32_t index) const {
+	return index + 1 + SubtreeSize(index);
+}
+
+/**
+ * Gets the text of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return UTF-8 encoded NUL terminated text of the field.
+ */
+const char* FlatDocument::Text(uint32_t index) const {
+	return &m_heap[m_offsets[index + FLAT_PROPS_NUM]];
+}
+
+/**
+ * Gets the length of the text of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Length of the text in bytes.
+ */
+uint32_t FlatDocument::TextLength(uint32_t index) const {
+	return m_lengths[index + FLAT_PROPS_NUM];
+}
+
+/**
+ * Gets the timestamp of a date topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Timestamp of the field. Only valid for date fields.
+ */
+timestamp_t FlatDocument::Timestamp(uint32_t index) const {
+	return m_extras[index + FLAT_PROPS_NUM].timestamp;
+}
+
+/**
+ * Gets the icon of an icon topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Icon index of the field. Only valid for icon fields.
+ */
+field_icon_t FlatDocument::IconIndex(uint32_t index) const {
+	return (field_icon_t)m_extras[index + FLAT_PROPS_NUM].icon;
+}
+
+/**
+ * Gets the identifier of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Identifier of the topic or BOLOTA_FIELD_ID_NONE if the document
+ *         didn't have any.
+ */
+field_id_t FlatDocument::ID(uint32_t index) const {
+	if (m_ids.empty())
+		return BOLOTA_FIELD_ID_NONE;
+
+	return m_ids[index];
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Navigation                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the parent of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Index of the parent field or BOLOTA_FLAT_NONE if it's a top-level
+ *         topic.
+ */
+uint32_t FlatDocument::Parent(uint32_t index) const {
+	uint8_t depth = Depth(index);
+
+	// Top-level fields have no parents.
+	if (depth == 0)
+		return BOLOTA_FLAT_NONE;
+
+	// Parent is the closest field above us that's shallower.
+	while (index-- > 0) {
+		if (Depth(index) < depth)
+			return index;
+	}
+
+	return BOLOTA_FLAT_NONE;
+}
+
+/**
+ * Gets the first child of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Index of the first child or BOLOTA_FLAT_NONE if there are none.
+ */
+uint32_t FlatDocument::Child(uint32_t index) const {
+	return (SubtreeSize(index) > 0) ? index + 1 : BOLOTA_FLAT_NONE;
+}
+
+/**
+ * Gets the next sibling of a topic field.
+ *
+ * @param index Pre-order index of the topic.
+ *
+ * @return Index of the next sibling or BOLOTA_FLAT_NONE if there are none.
+ */
+uint32_t FlatDocument::Next(uint32_t index) const {
+	uint32_t next = SubtreeEnd(index);
+	if ((next >= Count()) || (Depth(next) != Depth(index)))
+		return BOLOTA_FLAT_NONE;
+
+	return next;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the next topic that contains a string. Since every text in the heap is
+ * NUL terminated a match can never span multiple fields, so the heap is
+ * scanned in a single pass.
+ *
+ * @param szNeedle UTF-8 string to search for.
+ * @param start    Pre-order index of the topic to start searching from.
+ *
+ * @return Index of the first topic at or after start containing the string or
+ *         BOLOTA_FLAT_NONE if none were found.
+ */
+uint32_t FlatDocument::Find(const char *szNeedle, uint32_t start) const {
+	size_t ulNeedle = strlen(szNeedle);
+	if ((ulNeedle == 0) || (start >= Count()))
+		return BOLOTA_FLAT_NONE;
+
+	// Scan the heap for the first byte and then compare the rest.
+	const char *begin = &m_heap[0];
+	const char *pos = begin + m_offsets[start + FLAT_PROPS_NUM];
+	const char *end = begin + m_heap.size() - ulNeedle;
+	while (pos <= end) {
+		pos = (const char *)memchr(pos, szNeedle[0], end - pos + 1);
+		if (pos == NULL)
+			break;
+		if (memcmp(pos, szNeedle, ulNeedle) == 0)
+			goto found;
+		pos++;
+	}
+
+	return BOLOTA_FLAT_NONE;
+
+found:
+	// Map the heap offset back to its field.
+	uint32_t offset = (uint32_t)(pos - begin);
+	std::vector<uint32_t>::const_iterator it = std::upper_bound(
+		m_offsets.begin() + FLAT_PROPS_NUM + start, m_offsets.end(), offset);
+	return (uint32_t)(it - m_offsets.begin()) - 1 - FLAT_PROPS_NUM;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Memory Usage                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of bytes used by the texts heap.
+ *
+ * @return Size of the text heap in bytes.
+ */
+size_t FlatDocument::HeapSize() const {
+	return m_heap.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Builders                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Reserves space in the arrays to avoid reallocations while building.
+ *
+ * @param ulFields Expected number of fields.
+ * @param ulHeap   Expected size of the text heap in bytes.
+ */
+void FlatDocument::Reserve(size_t ulFields, size_t ulHeap) {
+	ulFields += FLAT_PROPS_NUM;
+	m_types.reserve(ulFields);
+	m_depths.reserve(ulFields);
+	m_subtrees.reserve(ulFields);
+	m_offsets.reserve(ulFields);
+	m_lengths.reserve(ulFields);
+	m_extras.reserve(ulFields);
+	m_heap.reserve(ulHeap);
+}
+
+/**
+ * Appends a field to the end of the arrays.
+ *
+ * @param type     Type of the field.
+ * @param depth    Indentation level of the field.
+ * @param szText   Text of the field. Doesn't have to be NUL terminated and
+ *                 can be NULL.
+ * @param ulLength Length of the text in bytes.
+ * @param extra    Type-specific data of the field. Can be NULL.
+ */
+void FlatDocument::PushField(bolota_type_t type, uint8_t depth,
+							 const char *szText, uint32_t ulLength,
+							 const bolota_flat_extra_t *extra) {
+	bolota_flat_extra_t empty;
+	memset(&empty, 0, sizeof(bolota_flat_extra_t));
+	if (szText == NULL)
+		ulLength = 0;
+
+	m_types.push_back((uint8_t)type);
+	m_depths.push_back(depth);
+	m_subtrees.push_back(0);
+	m_offsets.push_back((uint32_t)m_heap.size());
+	m_lengths.push_back(ulLength);
+	m_extras.push_back((extra) ? *extra : empty);
+
+	// Append the text to the heap.
+	m_heap.insert(m_heap.end(), szText, szText + ulLength);
+	m_heap.push_back('\0');
+}
+
+/**
+ * Parses a section of serialized fields into the arrays.
+ *
+ * @param buf      Buffer containing the section.
+ * @param ulLength Length of the section in bytes.
+ * @param bTopics  Is this the topics section? Depth is only kept for topics.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool FlatDocument::ParseFields(const uint8_t *buf, size_t ulLength,
+							   bool bTopics) {
+	bolota_flat_extra_t extra;
+	size_t pos = 0;
+
+	while (pos < ulLength) {
+		uint16_t usTextLength;
+		size_t ulExtra = 0;
+
+		// Parse the field header.
+		if ((ulLength - pos) < FIELD_HEADER_LEN) {
+			ThrowError(EMSG("Truncated field header in document section"));
+			return false;
+		}
+		bolota_type_t type = static_cast<bolota_type_t>(buf[pos]);
+		uint8_t depth = buf[pos + 1];
+		memcpy(&usTextLength, buf + pos + 4, sizeof(uint16_t));
+		memset(&extra, 0, sizeof(bolota_flat_extra_t));
+
+		// Get the size of the type-specific data.
+		switch (type) {
+		case BOLOTA_TYPE_TEXT:
+		case BOLOTA_TYPE_BLANK:
+			break;
+		case BOLOTA_TYPE_DATE:
+			ulExtra = sizeof(timestamp_t);
+			break;
+		case BOLOTA_TYPE_ICON:
+			ulExtra = sizeof(uint8_t);
+			break;
+		default:
+			ThrowError(EMSG("Unknown field type in document section"));
+			return false;
+		}
+
+		// Make sure the entire field is actually in the section.
+		if ((ulLength - pos) < (FIELD_HEADER_LEN + usTextLength + ulExtra)) {
+			ThrowError(EMSG("Truncated field in document section"));
+			return false;
+		}
+
+		// Grab the type-specific data.
+		const uint8_t *data = buf + pos + FIELD_HEADER_LEN + usTextLength;
+		if (type == BOLOTA_TYPE_DATE) {
+			memcpy(&extra.timestamp, data, sizeof(timestamp_t));
+		} else if (type == BOLOTA_TYPE_ICON) {
+			extra.icon = *data;
+		}
+
+		PushField(type, (bTopics) ? depth : 0,
+			(const char *)(buf + pos + FIELD_HEADER_LEN), usTextLength, &extra);
+		pos += FIELD_HEADER_LEN + usTextLength + ulExtra;
+	}
+
+	// Properties section must contain exactly the title, subtitle and date.
+	if (!bTopics && ((m_types.size() != FLAT_PROPS_NUM) ||
+			(m_types[2] != BOLOTA_TYPE_DATE))) {
+		ThrowError(EMSG("Invalid document properties section"));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Computes the subtree sizes of all topics based on their depths.
+ *
+ * @return TRUE if the operation was successful, FALSE if the topics had an
+ *         invalid depth structure.
+ */
+bool FlatDocument::ComputeSubtrees() {
+	std::vector<uint32_t> vecOpen;
+	uint32_t count = (uint32_t)m_types.size();
+
+	for (uint32_t i = FLAT_PROPS_NUM; i < count; ++i) {
+		uint8_t depth = m_depths[i];
+
+		// Depths can only ever go one level deeper at a time.
+		if (depth > vecOpen.size()) {
+			ThrowError(EMSG("Field depth forward jump greater than 1"));
+			return false;
+		}
+
+		// Close every subtree that ended with this field.
+		while (vecOpen.size() > depth) {
+			uint32_t open = vecOpen.back();
+			m_subtrees[open] = i - open - 1;
+			vecOpen.pop_back();
+		}
+		vecOpen.push_back(i);
+	}
+
+	// Close the remaining subtrees.
+	while (!vecOpen.empty()) {
+		uint32_t open = vecOpen.back();
+		m_subtrees[open] = count - open - 1;
+		vecOpen.pop_back();
+	}
+
+	return true;
+}
+
+/**
+ * Appends a topic field linked list in pre-order to the arrays.
+ *
+ * @param field First field of the list. Will include its childs and simblings.
+ * @param depth Indentation level of the list.
+ */
+void FlatDocument::FlattenTopics(Field *field, uint8_t depth) {
+	bolota_flat_extra_t extra;
+
+	while (field != NULL) {
+		memset(&extra, 0, sizeof(bolota_flat_extra_t));
+		if (field->Type() == BOLOTA_TYPE_DATE) {
+			extra.timestamp = static_cast<DateField*>(field)->Timestamp();
+		} else if (field->Type() == BOLOTA_TYPE_ICON) {
+			extra.icon = (uint8_t)static_cast<IconField*>(field)->IconIndex();
+		}
+
+		PushField(field->Type(), depth, (field->HasText()) ?
+			field->Text()->GetMultiByteString() : NULL, (field->HasText()) ?
+			(uint32_t)field->Text()->Length() : 0, &extra);
+		m_ids.push_back(field->ID());
+		if (field->HasChild())
+			FlattenTopics(field->Child(), depth + 1);
+
+		field = field->Next();
+	}
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Extension Sections                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Goes through the extension sections that follow the topics section, picking
+ * up the ones we know about and skipping over the rest.
+ *
+ * @param hFile   Handle of the document file positioned at the first section.
+ * @param ulBytes Number of bytes read from the file so far.
+ * @param ullSize Size of the file in bytes.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool FlatDocument::ReadExtensions(FHND hFile, size_t ulBytes,
+								  uint64_t ullSize) {
+	char szTag[BOLOTA_DOC_EXT_TAG_LEN + 1];
+	uint32_t dwLength;
+	fsize_t dwRead = 0;
+
+	while (true) {
+		// Read the tag of the section or stop at the end of the file.
+		if (!FileUtils::Read(hFile, szTag, BOLOTA_DOC_EXT_TAG_LEN, &dwRead) ||
+				((dwRead != 0) && (dwRead != BOLOTA_DOC_EXT_TAG_LEN))) {
+			ThrowError(new ReadError(hFile, ulBytes + dwRead, false));
+			return false;
+		}
+		if (dwRead == 0)
+			return true;
+		ulBytes += dwRead;
+		szTag[BOLOTA_DOC_EXT_TAG_LEN] = '\0';
+
+		// Read the length of the section and make sure it's in the file.
+		if (!FileUtils::Read(hFile, &dwLength, sizeof(uint32_t), &dwRead) ||
+				(dwRead != sizeof(uint32_t))) {
+			ThrowError(new ReadError(hFile, ulBytes, false));
+			return false;
+		}
+		ulBytes += dwRead;
+		if (((uint64_t)ulBytes + dwLength) > ullSize) {
+			ThrowError(EMSG("Extension section goes past the end of the file"));
+			return false;
+		}
+
+		// Only the identifiers of the topics and the texts are of any use.
+		if (strcmp(szTag, BOLOTA_DOC_EXT_FIELD_IDS) == 0) {
+			if (!ReadFieldIDs(hFile, dwLength, ulBytes))
+				return false;
+		} else if (strcmp(szTag, BOLOTA_DOC_EXT_LONG_TEXTS) == 0) {
+			if (!ReadLongTexts(hFile, dwLength, ulBytes))
+				return false;
+		} else if (!FileUtils::Seek(hFile, dwLength)) {
+			ThrowError(new ReadError(hFile, ulBytes, false));
+			return false;
+		}
+		ulBytes += dwLength;
+	}
+}
+
+/**
+ * Reads the identifiers of the topics from the field identifiers section.
+ *
+ * @param hFile    Handle of the document file positioned at the section data.
+ * @param dwLength Length of the section data in bytes.
+ * @param ulBytes  Number of bytes read from the file so far.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool FlatDocument::ReadFieldIDs(FHND hFile, uint32_t dwLength,
+								size_t ulBytes) {
+	fsize_t dwRead = 0;
+
+	// Check if the section makes sense.
+	if ((dwLength < sizeof(field_id_t)) || (dwLength % sizeof(field_id_t))) {
+		ThrowError(EMSG("Invalid length of the field identifiers section"));
+		return false;
+	}
+	if (((dwLength / sizeof(field_id_t)) - 1) != Count()) {
+		ThrowError(EMSG("Number of field identifiers doesn't match the ")
+			_T("number of topics"));
+		return false;
+	}
+
+	// Read the entire section in one go.
+	std::vector<field_id_t> vecIDs(dwLength / sizeof(field_id_t));
+	if (!FileUtils::Read(hFile, &vecIDs[0], dwLength, &dwRead) ||
+			(dwRead != dwLength)) {
+		ThrowError(new ReadError(hFile, ulBytes, false));
+		return false;
+	}
+
+	// The first one is the next identifier to be handed out.
+	m_nextID = vecIDs[0];
+	m_ids.assign(vecIDs.begin() + 1, vecIDs.end());
+
+	return true;
+}
+
+/**
+ * Reads the long texts section and appends the rest of each text to the start
+ * that was stored in its field, rebuilding the text heap.
+ *
+ * @param hFile    Handle of the document file positioned at the section data.
+ * @param dwLength Length of the section data in bytes.
+ * @param ulBytes  Number of bytes read from the file so far.
+ *
+ * @return TRUE if the operation was successful, FALSE otherwise.
+ */
+bool FlatDocument::ReadLongTexts(FHND hFile, uint32_t dwLength,
+								 size_t ulBytes) {
+	std::vector<size_t> vecStarts(m_types.size(), 0);
+	std::vector<uint32_t> vecTails(m_types.size(), 0);
+	fsize_t dwRead = 0;
+
+	// Read the entire section in one go.
+	std::vector<char> vecSection(dwLength + 1);
+	if (!FileUtils::Read(hFile, &vecSection[0], dwLength, &dwRead) ||
+			(dwRead != dwLength)) {
+		ThrowError(new ReadError(hFile, ulBytes, false));
+		return false;
+	}
+
+	// Find where the rest of each text is.
+	size_t pos = 0;
+	while (pos < dwLength) {
+		uint32_t dwIndex;
+		uint32_t dwTextLength;
+
+		if ((dwLength - pos) < (sizeof(uint32_t) * 2)) {
+			ThrowError(EMSG("Truncated entry in the long texts section"));
+			return false;
+		}
+		memcpy(&dwIndex, &vecSection[pos], sizeof(uint32_t));
+		memcpy(&dwTextLength, &vecSection[pos + sizeof(uint32_t)],
+			sizeof(uint32_t));
+		pos += sizeof(uint32_t) * 2;
+		if ((dwIndex >= m_types.size()) || (vecTails[dwIndex] > 0) ||
+				((dwLength - pos) < dwTextLength)) {
+			ThrowError(EMSG("Invalid entry in the long texts section"));
+			return false;
+		}
+
+		vecStarts[dwIndex] = pos;
+		vecTails[dwIndex] = dwTextLength;
+		pos += dwTextLength;
+	}
+
+	// Put the texts back together in a new heap.
+	std::vector<char> vecHeap;
+	vecHeap.reserve(m_heap.size() + dwLength);
+	for (size_t i = 0; i < m_types.size(); i++) {
+		const char *szText = &m_heap[m_offsets[i]];
+		const char *szTail = &vecSection[vecStarts[i]];
+
+		m_offsets[i] = (uint32_t)vecHeap.size();
+		vecHeap.insert(vecHeap.end(), szText, szText + m_lengths[i]);
+		vecHeap.insert(vecHeap.end(), szTail, szTail + vecTails[i]);
+		vecHeap.push_back('\0');
+		m_lengths[i] += vecTails[i];
+	}
+	m_heap.swap(vecHeap);
+
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Unflatten Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Creates an unlinked field object from an entry in the arrays.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @param index Raw index of the entry in the arrays (includes properties).
+ *
+ * @return Newly allocated field object.
+ */
+Field* FlatDocument::CreateField(uint32_t index) const {
+	const char *szText = &m_heap[m_offsets[index]];
+	Field *field = NULL;
+
+	switch (m_types[index]) {
+	case BOLOTA_TYPE_DATE:
+		field = new DateField(&m_extras[index].timestamp, szText);
+		break;
+	case BOLOTA_TYPE_ICON:
+		field = new IconField((field_icon_t)m_extras[index].icon, szText);
+		break;
+	case BOLOTA_TYPE_BLANK:
+		field = new BlankField();
+		break;
+	default:
+		field = new TextField(szText);
+		break;
+	}
+
+	return field;
+}
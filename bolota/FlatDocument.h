@@ -0,0 +1,132 @@
+/**
+ * FlatDocument.h
+ * Read-only, cache-friendly flattened representation of a Bolota document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_FLATDOCUMENT_H
+#define _BOLOTA_FLATDOCUMENT_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "Utilities/FileUtils.h"
+#include "Document.h"
+#include "IconField.h"
+
+/**
+ * Value returned by index lookups when there is no such field.
+ */
+#define BOLOTA_FLAT_NONE ((uint32_t)-1)
+
+/**
+ * Type-specific data of a flattened field.
+ */
+typedef union bolota_flat_extra_u {
+	timestamp_t timestamp;  /* Timestamp of a date field. */
+	uint8_t icon;           /* Icon index of an icon field. */
+} bolota_flat_extra_t;
+
+namespace Bolota {
+
+	/**
+	 * Read-only, cache-friendly flattened representation of a Bolota document.
+	 * Topics are stored in pre-order as a structure of arrays that share a
+	 * single contiguous text heap, which avoids the pointer chasing of the
+	 * Field linked tree for read-heavy workloads such as searching and
+	 * exporting.
+	 */
+	class FlatDocument {
+	protected:
+		// Structure of arrays (index 0-2 are the document properties).
+		std::vector<uint8_t> m_types;
+		std::vector<uint8_t> m_depths;
+		std::vector<uint32_t> m_subtrees;
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_lengths;
+		std::vector<bolota_flat_extra_t> m_extras;
+
+		// Contiguous heap with all of the NUL terminated texts.
+		std::vector<char> m_heap;
+
+		// Identifiers of the topics (empty if the document had none).
+		std::vector<field_id_t> m_ids;
+		field_id_t m_nextID;
+
+	public:
+		// Constructors and destructors.
+		FlatDocument();
+		virtual ~FlatDocument();
+
+		// Conversions.
+		static FlatDocument* ReadFile(LPCTSTR szPath);
+		static FlatDocument* FromDocument(const Document *doc);
+		Document* ToDocument() const;
+
+		// Properties.
+		const char* Title() const;
+		const char* SubTitle() const;
+		timestamp_t Date() const;
+
+		// Topics.
+		uint32_t Count() const;
+		bool IsEmpty() const;
+		bolota_type_t Type(uint32_t index) const;
+		uint8_t Depth(uint32_t index) const;
+		uint32_t SubtreeSize(uint32_t index) const;
+		uint32_t SubtreeEnd(uint32_t index) const;
+		const char* Text(uint32_t index) const;
+		uint32_t TextLength(uint32_t index) const;
+		timestamp_t Timestamp(uint32_t index) const;
+		field_icon_t IconIndex(uint32_t index) const;
+		field_id_t ID(uint32_t index) const;
+
+		// Navigation.
+		uint32_t Parent(uint32_t index) const;
+		uint32_t Child(uint32_t index) const;
+		uint32_t Next(uint32_t index) const;
+
+		// Searching.
+		uint32_t Find(const char *szNeedle, uint32_t start) const;
+
+		// Memory usage.
+		size_t HeapSize() const;
+
+	protected:
+		// Builders.
+		void Reserve(size_t ulFields, size_t ulHeap);
+		void PushField(bolota_type_t type, uint8_t depth, const char *szText,
+			uint32_t ulLength, const bolota_flat_extra_t *extra);
+		bool ParseFields(const uint8_t *buf, size_t ulLength, bool bTopics);
+		bool ComputeSubtrees();
+		void FlattenTopics(Field *field, uint8_t depth);
+
+		// Extension sections.
+		bool ReadExtensions(FHND hFile, size_t ulBytes, uint64_t ullSize);
+		bool ReadFieldIDs(FHND hFile, uint32_t dwLength, size_t ulBytes);
+		bool ReadLongTexts(FHND hFile, uint32_t dwLength, size_t ulBytes);
+
+		// Unflatten helpers.
+		Field* CreateField(uint32_t index) const;
+	};
+
+}
+
+#endif // __cplusplus
+
+#endif // _BOLOTA_FLATDOCUMENT_H
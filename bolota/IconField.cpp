@@ -75,6 +75,22 @@ void IconField::Copy(const IconField *field, bool bReplace) {
 	SetIconIndex(field->IconIndex());
 }
 
+/**
+ * Creates an unlinked duplicate of the field. The text buffer is shared with
+ * the original until either one of them is changed.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @return Newly allocated duplicate of the field.
+ */
+Field* IconField::Duplicate() const {
+	IconField *field = new IconField(m_icon_index);
+	if (HasText())
+		field->SetText(*m_text);
+
+	return field;
+}
+
 /*
  * +===========================================================================+
  * |                                                                           |
@@ -122,11 +138,12 @@ uint16_t IconField::FieldLength() const {
 	return Field::FieldLength() + sizeof(uint8_t);
 }
 
-uint8_t IconField::ReadField(FHND hFile, size_t *bytes) {
+uint8_t IconField::ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+							 bolota_text_mode_t mode) {
 	DWORD dwRead = 0;
 
 	// Read the field's base.
-	uint8_t depth = Field::ReadField(hFile, bytes);
+	uint8_t depth = Field::ReadField(hFile, bytes, pool, mode);
 	if (BolotaHasError)
 		return BOLOTA_ERR_UINT8;
 
@@ -128,10 +128,12 @@ namespace Bolota {
 
 		// Helpers
 		virtual void Copy(const IconField *field, bool bReplace);
+		Field* Duplicate() const override;
 
 		// Overrides
 		uint16_t FieldLength() const override;
-		uint8_t ReadField(FHND hFile, size_t *bytes) override;
+		uint8_t ReadField(FHND hFile, size_t *bytes, TextPool *pool,
+			bolota_text_mode_t mode) override;
 		size_t Write(FHND hFile) const override;
 
 		// Getters and setters.
@@ -0,0 +1,1006 @@
+/**
+ * Bitmap.cpp
+ * Compressed bitmap of topic positions that can be shifted around as topics
+ * are inserted and removed.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "Bitmap.h"
+
+#include <algorithm>
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty bitmap that doesn't cover any positions.
+ */
+Bitmap::Bitmap() {
+	Reset(0);
+}
+
+/**
+ * Constructs an empty bitmap.
+ *
+ * @param length Number of positions covered by the bitmap.
+ */
+Bitmap::Bitmap(uint32_t length) {
+	Reset(length);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Layout                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Empties the bitmap and lays out its chunks from scratch.
+ *
+ * @param length Number of positions covered by the bitmap.
+ */
+void Bitmap::Reset(uint32_t length) {
+	m_chunks.clear();
+	m_length = length;
+	m_count = 0;
+
+	for (uint32_t start = 0; start < length; start += BOLOTA_BITMAP_CHUNK_LEN) {
+		Chunk chunk;
+		InitChunk(chunk, start,
+			std::min((uint32_t)BOLOTA_BITMAP_CHUNK_LEN, length - start));
+		m_chunks.push_back(chunk);
+	}
+}
+
+/**
+ * Empties the bitmap and gives it the same layout as another one, so that they
+ * can be combined a whole chunk at a time.
+ *
+ * @param layout Bitmap to have its layout copied.
+ */
+void Bitmap::ResetLike(const Bitmap& layout) {
+	m_chunks.resize(layout.m_chunks.size());
+	m_length = layout.m_length;
+	m_count = 0;
+
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		InitChunk(m_chunks[i], layout.m_chunks[i].start,
+			layout.m_chunks[i].length);
+	}
+}
+
+/**
+ * Exchanges the contents of two bitmaps without copying them.
+ *
+ * @param other Bitmap to be swapped with.
+ */
+void Bitmap::Swap(Bitmap& other) {
+	uint32_t ulTemp;
+
+	m_chunks.swap(other.m_chunks);
+	ulTemp = m_length;
+	m_length = other.m_length;
+	other.m_length = ulTemp;
+	ulTemp = m_count;
+	m_count = other.m_count;
+	other.m_count = ulTemp;
+}
+
+/**
+ * Opens up a gap of unset positions, shifting every position after it.
+ *
+ * @param pos   Position where the gap should start. Must not be greater than
+ *              the length of the bitmap.
+ * @param count Number of positions to be inserted.
+ */
+void Bitmap::InsertPositions(uint32_t pos, uint32_t count) {
+	if ((count == 0) || (pos > m_length))
+		return;
+
+	// Empty bitmaps are simply laid out from scratch.
+	if (m_chunks.empty()) {
+		Reset(count);
+		return;
+	}
+
+	// Find the chunk that will hold the gap.
+	size_t index = (pos == m_length) ? m_chunks.size() - 1 : FindChunk(pos);
+	Chunk& chunk = m_chunks[index];
+	uint32_t offset = pos - chunk.start;
+	m_length += count;
+
+	if ((chunk.length + count) > BOLOTA_BITMAP_CHUNK_LEN) {
+		// Chunk got too long and needs to be split up.
+		std::vector<uint32_t> vecOffsets;
+		Explode(chunk, vecOffsets);
+		for (size_t i = 0; i < vecOffsets.size(); i++) {
+			if (vecOffsets[i] >= offset)
+				vecOffsets[i] += count;
+		}
+
+		chunk.length += count;
+		Resplit(index, vecOffsets);
+	} else if (chunk.words.empty()) {
+		// Shift the members of an array.
+		std::vector<uint16_t>::iterator it = std::lower_bound(
+			chunk.values.begin(), chunk.values.end(), (uint16_t)offset);
+		for (; it != chunk.values.end(); ++it)
+			*it = (uint16_t)(*it + count);
+
+		chunk.length += count;
+	} else {
+		// Shift the bits of a bitset.
+		std::vector<uint64_t> vecWords(WordCount(chunk.length + count), 0);
+		CopyBits(vecWords, 0, chunk.words, 0, offset);
+		CopyBits(vecWords, offset + count, chunk.words, offset,
+			chunk.length - offset);
+
+		chunk.words.swap(vecWords);
+		chunk.length += count;
+	}
+
+	UpdateStarts(index);
+}
+
+/**
+ * Removes a range of positions, shifting every position after it to close the
+ * gap.
+ *
+ * @param pos   First position to be removed.
+ * @param count Number of positions to be removed.
+ */
+void Bitmap::RemovePositions(uint32_t pos, uint32_t count) {
+	if ((count == 0) || (pos >= m_length))
+		return;
+	if (count > (m_length - pos))
+		count = m_length - pos;
+
+	// Go through the chunks that overlap the range.
+	uint32_t end = pos + count;
+	size_t first = FindChunk(pos);
+	size_t index = first;
+	while ((index < m_chunks.size()) && (m_chunks[index].start < end)) {
+		Chunk& chunk = m_chunks[index];
+		uint32_t from = std::max(pos, chunk.start) - chunk.start;
+		uint32_t to = std::min(end, chunk.start + chunk.length) - chunk.start;
+		uint32_t len = to - from;
+		m_count -= chunk.count;
+
+		if (chunk.words.empty()) {
+			// Drop the members of the array in the range and shift the rest.
+			std::vector<uint16_t>::iterator begin = std::lower_bound(
+				chunk.values.begin(), chunk.values.end(), (uint16_t)from);
+			std::vector<uint16_t>::iterator it = begin;
+			while ((it != chunk.values.end()) && (*it < to))
+				++it;
+			it = chunk.values.erase(begin, it);
+			for (; it != chunk.values.end(); ++it)
+				*it = (uint16_t)(*it - len);
+
+			chunk.count = (uint32_t)chunk.values.size();
+		} else {
+			// Cut the range out of the bitset.
+			std::vector<uint64_t> vecWords(WordCount(chunk.length - len), 0);
+			CopyBits(vecWords, 0, chunk.words, 0, from);
+			CopyBits(vecWords, from, chunk.words, to, chunk.length - to);
+
+			chunk.words.swap(vecWords);
+			chunk.count = PopCount(chunk.words);
+			Optimize(chunk);
+		}
+
+		// Get rid of chunks that are now empty.
+		chunk.length -= len;
+		m_count += chunk.count;
+		if (chunk.length == 0) {
+			m_chunks.erase(m_chunks.begin() + index);
+		} else {
+			index++;
+		}
+	}
+
+	m_length -= count;
+	if (first > 0)
+		first--;
+	UpdateStarts(first);
+	MergeSmallChunks();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Members                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Checks if a position is set in the bitmap.
+ *
+ * @param pos Position to be checked.
+ *
+ * @return TRUE if the position is set.
+ */
+bool Bitmap::Contains(uint32_t pos) const {
+	if (pos >= m_length)
+		return false;
+
+	const Chunk& chunk = m_chunks[FindChunk(pos)];
+	return ChunkContains(chunk, pos - chunk.start);
+}
+
+/**
+ * Sets a position in the bitmap.
+ *
+ * @param pos Position to be set. Ignored if it's outside of the bitmap.
+ */
+void Bitmap::Add(uint32_t pos) {
+	if (pos >= m_length)
+		return;
+
+	Chunk& chunk = m_chunks[FindChunk(pos)];
+	uint32_t offset = pos - chunk.start;
+	if (chunk.words.empty()) {
+		std::vector<uint16_t>::iterator it = std::lower_bound(
+			chunk.values.begin(), chunk.values.end(), (uint16_t)offset);
+		if ((it != chunk.values.end()) && (*it == offset))
+			return;
+
+		chunk.values.insert(it, (uint16_t)offset);
+	} else {
+		uint64_t mask = (uint64_t)1 << (offset & 63);
+		if (chunk.words[offset >> 6] & mask)
+			return;
+
+		chunk.words[offset >> 6] |= mask;
+	}
+
+	chunk.count++;
+	m_count++;
+	Optimize(chunk);
+}
+
+/**
+ * Sets a range of positions in the bitmap.
+ *
+ * @param start First position to be set.
+ * @param end   Position right after the last one to be set.
+ */
+void Bitmap::AddRange(uint32_t start, uint32_t end) {
+	if (end > m_length)
+		end = m_length;
+	if (start >= end)
+		return;
+
+	for (size_t i = FindChunk(start); (i < m_chunks.size()) &&
+			(m_chunks[i].start < end); i++) {
+		Chunk& chunk = m_chunks[i];
+		uint32_t from = std::max(start, chunk.start) - chunk.start;
+		uint32_t to = std::min(end, chunk.start + chunk.length) - chunk.start;
+		m_count -= chunk.count;
+
+		if (chunk.words.empty() &&
+				((chunk.count + (to - from)) <= BOLOTA_BITMAP_ARRAY_MAX)) {
+			// Small enough ranges replace whatever was in their place in the
+			// array, which is a simple append when building it up in order.
+			std::vector<uint16_t>::iterator it = std::lower_bound(
+				chunk.values.begin(), chunk.values.end(), (uint16_t)from);
+			std::vector<uint16_t>::iterator end = it;
+			while ((end != chunk.values.end()) && (*end < to))
+				++end;
+
+			size_t index = it - chunk.values.begin();
+			chunk.values.erase(it, end);
+			chunk.values.insert(chunk.values.begin() + index, to - from, 0);
+			for (uint32_t offset = from; offset < to; offset++)
+				chunk.values[index++] = (uint16_t)offset;
+
+			chunk.count = (uint32_t)chunk.values.size();
+		} else {
+			// Fill the words of the bitset.
+			ToBitset(chunk);
+			for (uint32_t bit = from; bit < to; ) {
+				uint32_t shift = bit & 63;
+				uint32_t len = std::min(64 - shift, to - bit);
+				uint64_t mask = (len == 64) ? ~(uint64_t)0 :
+					(((uint64_t)1 << len) - 1);
+
+				chunk.words[bit >> 6] |= mask << shift;
+				bit += len;
+			}
+
+			chunk.count = PopCount(chunk.words);
+		}
+
+		m_count += chunk.count;
+	}
+}
+
+/**
+ * Unsets a position in the bitmap.
+ *
+ * @param pos Position to be unset.
+ */
+void Bitmap::Remove(uint32_t pos) {
+	if (pos >= m_length)
+		return;
+
+	Chunk& chunk = m_chunks[FindChunk(pos)];
+	uint32_t offset = pos - chunk.start;
+	if (chunk.words.empty()) {
+		std::vector<uint16_t>::iterator it = std::lower_bound(
+			chunk.values.begin(), chunk.values.end(), (uint16_t)offset);
+		if ((it == chunk.values.end()) || (*it != offset))
+			return;
+
+		chunk.values.erase(it);
+	} else {
+		uint64_t mask = (uint64_t)1 << (offset & 63);
+		if (!(chunk.words[offset >> 6] & mask))
+			return;
+
+		chunk.words[offset >> 6] &= ~mask;
+	}
+
+	chunk.count--;
+	m_count--;
+	Optimize(chunk);
+}
+
+/**
+ * Finds the first position set in the bitmap starting from a position.
+ *
+ * @param pos Position to start looking from. (inclusive)
+ *
+ * @return First position set or BOLOTA_BITMAP_NONE if there are none left.
+ */
+uint32_t Bitmap::Next(uint32_t pos) const {
+	if (pos >= m_length)
+		return BOLOTA_BITMAP_NONE;
+
+	for (size_t i = FindChunk(pos); i < m_chunks.size(); i++) {
+		const Chunk& chunk = m_chunks[i];
+		uint32_t offset = (pos > chunk.start) ? pos - chunk.start : 0;
+		if (chunk.count == 0)
+			continue;
+
+		if (chunk.words.empty()) {
+			// Look it up in the array.
+			std::vector<uint16_t>::const_iterator it = std::lower_bound(
+				chunk.values.begin(), chunk.values.end(), (uint16_t)offset);
+			if (it != chunk.values.end())
+				return chunk.start + *it;
+		} else {
+			// Scan the bitset a word at a time.
+			uint32_t word = offset >> 6;
+			uint64_t bits = chunk.words[word] & (~(uint64_t)0 << (offset & 63));
+			while (true) {
+				if (bits != 0) {
+					return chunk.start + (word << 6) +
+						PopCount((bits & (0 - bits)) - 1);
+				}
+
+				if (++word >= chunk.words.size())
+					break;
+				bits = chunk.words[word];
+			}
+		}
+	}
+
+	return BOLOTA_BITMAP_NONE;
+}
+
+/**
+ * Lists every position set in the bitmap.
+ *
+ * @param vecPositions Vector to receive the positions in ascending order.
+ *
+ * @return Number of positions set.
+ */
+size_t Bitmap::ToVector(std::vector<uint32_t>& vecPositions) const {
+	vecPositions.clear();
+	vecPositions.reserve(m_count);
+
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		const Chunk& chunk = m_chunks[i];
+
+		if (chunk.words.empty()) {
+			for (size_t j = 0; j < chunk.values.size(); j++)
+				vecPositions.push_back(chunk.start + chunk.values[j]);
+			continue;
+		}
+
+		for (uint32_t word = 0; word < chunk.words.size(); word++) {
+			uint64_t bits = chunk.words[word];
+			while (bits != 0) {
+				uint64_t lowest = bits & (0 - bits);
+				vecPositions.push_back(chunk.start + (word << 6) +
+					PopCount(lowest - 1));
+				bits ^= lowest;
+			}
+		}
+	}
+
+	return vecPositions.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Operations                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Keeps only the positions that are also set in another bitmap.
+ *
+ * @param other Bitmap to intersect with.
+ */
+void Bitmap::And(const Bitmap& other) {
+	if (!SameLayout(other)) {
+		std::vector<uint32_t> vecPositions;
+		ToVector(vecPositions);
+		for (size_t i = 0; i < vecPositions.size(); i++) {
+			if (!other.Contains(vecPositions[i]))
+				Remove(vecPositions[i]);
+		}
+
+		return;
+	}
+
+	m_count = 0;
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		AndChunk(m_chunks[i], other.m_chunks[i]);
+		m_count += m_chunks[i].count;
+	}
+}
+
+/**
+ * Sets every position that is set in another bitmap.
+ *
+ * @param other Bitmap to be merged in.
+ */
+void Bitmap::Or(const Bitmap& other) {
+	if (!SameLayout(other)) {
+		std::vector<uint32_t> vecPositions;
+		other.ToVector(vecPositions);
+		for (size_t i = 0; i < vecPositions.size(); i++)
+			Add(vecPositions[i]);
+
+		return;
+	}
+
+	m_count = 0;
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		OrChunk(m_chunks[i], other.m_chunks[i]);
+		m_count += m_chunks[i].count;
+	}
+}
+
+/**
+ * Unsets every position that is set in another bitmap.
+ *
+ * @param other Bitmap with the positions to be removed.
+ */
+void Bitmap::AndNot(const Bitmap& other) {
+	if (!SameLayout(other)) {
+		std::vector<uint32_t> vecPositions;
+		other.ToVector(vecPositions);
+		for (size_t i = 0; i < vecPositions.size(); i++)
+			Remove(vecPositions[i]);
+
+		return;
+	}
+
+	m_count = 0;
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		AndNotChunk(m_chunks[i], other.m_chunks[i]);
+		m_count += m_chunks[i].count;
+	}
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of positions covered by the bitmap.
+ *
+ * @return Length of the bitmap.
+ */
+uint32_t Bitmap::Length() const {
+	return m_length;
+}
+
+/**
+ * Gets the number of positions set in the bitmap.
+ *
+ * @return Number of positions set.
+ */
+uint32_t Bitmap::Count() const {
+	return m_count;
+}
+
+/**
+ * Checks if there are no positions set in the bitmap.
+ *
+ * @return TRUE if the bitmap is empty.
+ */
+bool Bitmap::IsEmpty() const {
+	return m_count == 0;
+}
+
+/**
+ * Estimates the memory used by the bitmap.
+ *
+ * @return Number of bytes allocated by the bitmap.
+ */
+size_t Bitmap::HeapSize() const {
+	size_t ulSize = m_chunks.capacity() * sizeof(Chunk);
+
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		ulSize += (m_chunks[i].values.capacity() * sizeof(uint16_t)) +
+			(m_chunks[i].words.capacity() * sizeof(uint64_t));
+	}
+
+	return ulSize;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Chunk Management                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the chunk that covers a position.
+ *
+ * @param pos Position to look for. Must be within the bitmap.
+ *
+ * @return Index of the chunk.
+ */
+size_t Bitmap::FindChunk(uint32_t pos) const {
+	size_t lo = 0;
+	size_t hi = m_chunks.size();
+
+	// Find the last chunk that starts at or before the position.
+	while ((hi - lo) > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (m_chunks[mid].start <= pos) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Initializes an empty chunk.
+ *
+ * @param chunk  Chunk to be initialized.
+ * @param start  First position covered by the chunk.
+ * @param length Number of positions covered by the chunk.
+ */
+void Bitmap::InitChunk(Chunk& chunk, uint32_t start, uint32_t length) {
+	chunk.start = start;
+	chunk.length = length;
+	chunk.count = 0;
+	std::vector<uint16_t>().swap(chunk.values);
+	std::vector<uint64_t>().swap(chunk.words);
+}
+
+/**
+ * Splits a chunk that got too long into evenly sized ones.
+ *
+ * @param index      Index of the chunk to be split.
+ * @param vecOffsets Offsets of the members of the chunk, in ascending order.
+ */
+void Bitmap::Resplit(size_t index, const std::vector<uint32_t>& vecOffsets) {
+	uint32_t start = m_chunks[index].start;
+	uint32_t length = m_chunks[index].length;
+	uint32_t pieces = (length + BOLOTA_BITMAP_CHUNK_LEN - 1) /
+		BOLOTA_BITMAP_CHUNK_LEN;
+
+	// Make room for the new chunks.
+	Chunk empty;
+	InitChunk(empty, 0, 0);
+	m_chunks.insert(m_chunks.begin() + index + 1, pieces - 1, empty);
+
+	// Lay them out and distribute the members between them.
+	size_t j = 0;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < pieces; i++) {
+		Chunk& chunk = m_chunks[index + i];
+		uint32_t len = (length / pieces) + ((i < (length % pieces)) ? 1 : 0);
+		InitChunk(chunk, start + offset, len);
+
+		for (; (j < vecOffsets.size()) && (vecOffsets[j] < (offset + len));
+				j++) {
+			chunk.values.push_back((uint16_t)(vecOffsets[j] - offset));
+		}
+
+		chunk.count = (uint32_t)chunk.values.size();
+		Optimize(chunk);
+		offset += len;
+	}
+}
+
+/**
+ * Merges neighbouring chunks that got too short after positions were removed.
+ */
+void Bitmap::MergeSmallChunks() {
+	size_t i = 0;
+
+	while ((i + 1) < m_chunks.size()) {
+		Chunk& chunk = m_chunks[i];
+		Chunk& next = m_chunks[i + 1];
+		if ((chunk.length + next.length) > (BOLOTA_BITMAP_CHUNK_LEN / 2)) {
+			i++;
+			continue;
+		}
+
+		// Move the members of the next chunk over to this one.
+		std::vector<uint32_t> vecOffsets;
+		Explode(next, vecOffsets);
+		if (chunk.words.empty() && ((chunk.count + next.count) <=
+				BOLOTA_BITMAP_ARRAY_MAX)) {
+			for (size_t j = 0; j < vecOffsets.size(); j++) {
+				chunk.values.push_back((uint16_t)(chunk.length +
+					vecOffsets[j]));
+			}
+		} else {
+			ToBitset(chunk);
+			chunk.words.resize(WordCount(chunk.length + next.length), 0);
+			for (size_t j = 0; j < vecOffsets.size(); j++) {
+				uint32_t offset = chunk.length + vecOffsets[j];
+				chunk.words[offset >> 6] |= (uint64_t)1 << (offset & 63);
+			}
+		}
+
+		chunk.length += next.length;
+		chunk.count += next.count;
+		Optimize(chunk);
+		m_chunks.erase(m_chunks.begin() + i + 1);
+	}
+}
+
+/**
+ * Recalculates where each chunk starts after one of them changed its length.
+ *
+ * @param index Index of the chunk that changed.
+ */
+void Bitmap::UpdateStarts(size_t index) {
+	if (index >= m_chunks.size())
+		return;
+
+	m_chunks[0].start = 0;
+	for (size_t i = index + 1; i < m_chunks.size(); i++)
+		m_chunks[i].start = m_chunks[i - 1].start + m_chunks[i - 1].length;
+}
+
+/**
+ * Checks if another bitmap has its chunks laid out exactly like ours.
+ *
+ * @param other Bitmap to be compared with.
+ *
+ * @return TRUE if both bitmaps can be combined a chunk at a time.
+ */
+bool Bitmap::SameLayout(const Bitmap& other) const {
+	if ((m_length != other.m_length) ||
+			(m_chunks.size() != other.m_chunks.size())) {
+		return false;
+	}
+
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		if (m_chunks[i].length != other.m_chunks[i].length)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Containers                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Checks if an offset is set in a chunk.
+ *
+ * @param chunk  Chunk to be checked.
+ * @param offset Offset within the chunk.
+ *
+ * @return TRUE if the offset is set.
+ */
+bool Bitmap::ChunkContains(const Chunk& chunk, uint32_t offset) {
+	if (!chunk.words.empty())
+		return (chunk.words[offset >> 6] >> (offset & 63)) & 1;
+
+	return std::binary_search(chunk.values.begin(), chunk.values.end(),
+		(uint16_t)offset);
+}
+
+/**
+ * Lists the offsets that are set in a chunk.
+ *
+ * @param chunk Chunk to be listed.
+ * @param vec   Vector to receive the offsets in ascending order.
+ */
+void Bitmap::Explode(const Chunk& chunk, std::vector<uint32_t>& vec) {
+	vec.clear();
+	vec.reserve(chunk.count);
+
+	if (chunk.words.empty()) {
+		vec.assign(chunk.values.begin(), chunk.values.end());
+		return;
+	}
+
+	for (uint32_t word = 0; word < chunk.words.size(); word++) {
+		uint64_t bits = chunk.words[word];
+		while (bits != 0) {
+			uint64_t lowest = bits & (0 - bits);
+			vec.push_back((word << 6) + PopCount(lowest - 1));
+			bits ^= lowest;
+		}
+	}
+}
+
+/**
+ * Converts an array chunk into a bitset.
+ *
+ * @param chunk Chunk to be converted. Bitsets are left untouched.
+ */
+void Bitmap::ToBitset(Chunk& chunk) {
+	if (!chunk.words.empty() || (chunk.length == 0))
+		return;
+
+	chunk.words.assign(WordCount(chunk.length), 0);
+	for (size_t i = 0; i < chunk.values.size(); i++) {
+		uint32_t offset = chunk.values[i];
+		chunk.words[offset >> 6] |= (uint64_t)1 << (offset & 63);
+	}
+
+	std::vector<uint16_t>().swap(chunk.values);
+}
+
+/**
+ * Picks the most compact container for the number of members of a chunk.
+ *
+ * @param chunk Chunk to be optimized.
+ */
+void Bitmap::Optimize(Chunk& chunk) {
+	if (chunk.words.empty()) {
+		if (chunk.count > BOLOTA_BITMAP_ARRAY_MAX)
+			ToBitset(chunk);
+		return;
+	}
+
+	if (chunk.count > (BOLOTA_BITMAP_ARRAY_MAX / 2))
+		return;
+
+	// Few enough members to be stored as an array. Bitsets are only converted
+	// back well under the limit, so that a chunk hovering around it doesn't
+	// keep switching between the two.
+	std::vector<uint32_t> vecOffsets;
+	Explode(chunk, vecOffsets);
+	chunk.values.assign(vecOffsets.begin(), vecOffsets.end());
+	std::vector<uint64_t>().swap(chunk.words);
+}
+
+/**
+ * Intersects two chunks that cover the same positions.
+ *
+ * @param chunk Chunk to receive the result.
+ * @param other Chunk to intersect with.
+ */
+void Bitmap::AndChunk(Chunk& chunk, const Chunk& other) {
+	if (chunk.words.empty() || other.words.empty()) {
+		// At least one side is an array, so the result is an array as well.
+		const Chunk& array = (chunk.words.empty()) ? chunk : other;
+		const Chunk& test = (chunk.words.empty()) ? other : chunk;
+		std::vector<uint16_t> vecValues;
+
+		vecValues.reserve(array.values.size());
+		for (size_t i = 0; i < array.values.size(); i++) {
+			if (ChunkContains(test, array.values[i]))
+				vecValues.push_back(array.values[i]);
+		}
+
+		chunk.values.swap(vecValues);
+		std::vector<uint64_t>().swap(chunk.words);
+		chunk.count = (uint32_t)chunk.values.size();
+		return;
+	}
+
+	for (size_t i = 0; i < chunk.words.size(); i++)
+		chunk.words[i] &= other.words[i];
+	chunk.count = PopCount(chunk.words);
+	Optimize(chunk);
+}
+
+/**
+ * Merges two chunks that cover the same positions.
+ *
+ * @param chunk Chunk to receive the result.
+ * @param other Chunk to be merged in.
+ */
+void Bitmap::OrChunk(Chunk& chunk, const Chunk& other) {
+	if (other.count == 0)
+		return;
+
+	if (chunk.words.empty() && other.words.empty()) {
+		// Merge two sorted arrays.
+		std::vector<uint16_t> vecValues(chunk.values.size() +
+			other.values.size());
+		vecValues.erase(std::set_union(chunk.values.begin(),
+			chunk.values.end(), other.values.begin(), other.values.end(),
+			vecValues.begin()), vecValues.end());
+
+		chunk.values.swap(vecValues);
+		chunk.count = (uint32_t)chunk.values.size();
+		Optimize(chunk);
+		return;
+	}
+
+	ToBitset(chunk);
+	if (other.words.empty()) {
+		for (size_t i = 0; i < other.values.size(); i++) {
+			uint32_t offset = other.values[i];
+			chunk.words[offset >> 6] |= (uint64_t)1 << (offset & 63);
+		}
+	} else {
+		for (size_t i = 0; i < chunk.words.size(); i++)
+			chunk.words[i] |= other.words[i];
+	}
+
+	chunk.count = PopCount(chunk.words);
+	Optimize(chunk);
+}
+
+/**
+ * Removes the members of a chunk from another that covers the same positions.
+ *
+ * @param chunk Chunk to receive the result.
+ * @param other Chunk with the members to be removed.
+ */
+void Bitmap::AndNotChunk(Chunk& chunk, const Chunk& other) {
+	if ((chunk.count == 0) || (other.count == 0))
+		return;
+
+	if (chunk.words.empty()) {
+		std::vector<uint16_t> vecValues;
+
+		vecValues.reserve(chunk.values.size());
+		for (size_t i = 0; i < chunk.values.size(); i++) {
+			if (!ChunkContains(other, chunk.values[i]))
+				vecValues.push_back(chunk.values[i]);
+		}
+
+		chunk.values.swap(vecValues);
+		chunk.count = (uint32_t)chunk.values.size();
+		return;
+	}
+
+	if (other.words.empty()) {
+		for (size_t i = 0; i < other.values.size(); i++) {
+			uint32_t offset = other.values[i];
+			chunk.words[offset >> 6] &= ~((uint64_t)1 << (offset & 63));
+		}
+	} else {
+		for (size_t i = 0; i < chunk.words.size(); i++)
+			chunk.words[i] &= ~other.words[i];
+	}
+
+	chunk.count = PopCount(chunk.words);
+	Optimize(chunk);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Bit Twiddling                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of words needed to hold a bitset.
+ *
+ * @param length Number of bits in the bitset.
+ *
+ * @return Number of 64-bit words.
+ */
+uint32_t Bitmap::WordCount(uint32_t length) {
+	return (length + 63) / 64;
+}
+
+/**
+ * Counts the bits set in a word.
+ *
+ * @param word Word to be counted.
+ *
+ * @return Number of bits set.
+ */
+uint32_t Bitmap::PopCount(uint64_t word) {
+#ifdef __GNUC__
+	return (uint32_t)__builtin_popcountll(word);
+#else
+	const uint64_t m1 = ((uint64_t)0x55555555 << 32) | 0x55555555;
+	const uint64_t m2 = ((uint64_t)0x33333333 << 32) | 0x33333333;
+	const uint64_t m4 = ((uint64_t)0x0F0F0F0F << 32) | 0x0F0F0F0F;
+	const uint64_t h01 = ((uint64_t)0x01010101 << 32) | 0x01010101;
+
+	word = word - ((word >> 1) & m1);
+	word = (word & m2) + ((word >> 2) & m2);
+	word = (word + (word >> 4)) & m4;
+	return (uint32_t)((word * h01) >> 56);
+#endif // __GNUC__
+}
+
+/**
+ * Counts the bits set in a bitset.
+ *
+ * @param words Words of the bitset.
+ *
+ * @return Number of bits set.
+ */
+uint32_t Bitmap::PopCount(const std::vector<uint64_t>& words) {
+	uint32_t count = 0;
+
+	for (size_t i = 0; i < words.size(); i++)
+		count += PopCount(words[i]);
+
+	return count;
+}
+
+/**
+ * Copies a range of bits from a bitset into another one whose destination
+ * range is still clear.
+ *
+ * @param dst      Bitset to copy the bits into.
+ * @param ulDstBit Position of the first bit in the destination.
+ * @param src      Bitset to copy the bits from.
+ * @param ulSrcBit Position of the first bit in the source.
+ * @param ulCount  Number of bits to be copied.
+ */
+void Bitmap::CopyBits(std::vector<uint64_t>& dst, uint32_t ulDstBit,
+					  const std::vector<uint64_t>& src, uint32_t ulSrcBit,
+					  uint32_t ulCount) {
+	while (ulCount > 0) {
+		// Copy as many bits as fit in both the current words.
+		uint32_t len = std::min(64 - (ulSrcBit & 63), 64 - (ulDstBit & 63));
+		if (len > ulCount)
+			len = ulCount;
+		uint64_t mask = (len == 64) ? ~(uint64_t)0 :
+			(((uint64_t)1 << len) - 1);
+
+		uint64_t bits = (src[ulSrcBit >> 6] >> (ulSrcBit & 63)) & mask;
+		dst[ulDstBit >> 6] |= bits << (ulDstBit & 63);
+
+		ulSrcBit += len;
+		ulDstBit += len;
+		ulCount -= len;
+	}
+}
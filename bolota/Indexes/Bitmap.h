@@ -0,0 +1,135 @@
+/**
+ * Bitmap.h
+ * Compressed bitmap of topic positions that can be shifted around as topics
+ * are inserted and removed.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_BITMAP_H
+#define _BOLOTA_INDEXES_BITMAP_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+/**
+ * Maximum number of positions covered by a single chunk of a bitmap.
+ */
+#define BOLOTA_BITMAP_CHUNK_LEN 65536
+
+/**
+ * Maximum number of members of a chunk stored as a sorted array. Chunks with
+ * more members than this are stored as a plain bitset.
+ */
+#define BOLOTA_BITMAP_ARRAY_MAX 4096
+
+/**
+ * Value returned when there is no such member in a bitmap.
+ */
+#define BOLOTA_BITMAP_NONE ((uint32_t)-1)
+
+namespace Bolota {
+
+	/**
+	 * Compressed bitmap of topic positions in the style of roaring bitmaps.
+	 *
+	 * Positions are split into chunks of up to BOLOTA_BITMAP_CHUNK_LEN, each
+	 * one stored either as a sorted array of 16-bit offsets, when it has few
+	 * members, or as a bitset. Unlike roaring bitmaps the chunks aren't
+	 * aligned to fixed boundaries: inserting or removing positions only
+	 * reshapes the chunk where it happens and moves the start of the ones
+	 * after it, so that bitmaps of topic positions can follow edits to the
+	 * document without being rebuilt.
+	 *
+	 * The way chunks are split and merged only depends on their lengths, so
+	 * bitmaps that went through the same sequence of insertions and removals
+	 * share the same layout and are combined a whole chunk at a time. Bitmaps
+	 * with different layouts are still combined correctly, only slower.
+	 */
+	class Bitmap {
+	protected:
+		// Chunk of positions.
+		struct Chunk {
+			uint32_t start;
+			uint32_t length;
+			uint32_t count;
+			std::vector<uint16_t> values;
+			std::vector<uint64_t> words;
+		};
+
+		std::vector<Chunk> m_chunks;
+		uint32_t m_length;
+		uint32_t m_count;
+
+	public:
+		// Constructors and destructors.
+		Bitmap();
+		Bitmap(uint32_t length);
+
+		// Layout.
+		void Reset(uint32_t length);
+		void ResetLike(const Bitmap& layout);
+		void Swap(Bitmap& other);
+		void InsertPositions(uint32_t pos, uint32_t count);
+		void RemovePositions(uint32_t pos, uint32_t count);
+
+		// Members.
+		bool Contains(uint32_t pos) const;
+		void Add(uint32_t pos);
+		void AddRange(uint32_t start, uint32_t end);
+		void Remove(uint32_t pos);
+		uint32_t Next(uint32_t pos) const;
+		size_t ToVector(std::vector<uint32_t>& vecPositions) const;
+
+		// Operations.
+		void And(const Bitmap& other);
+		void Or(const Bitmap& other);
+		void AndNot(const Bitmap& other);
+
+		// Statistics.
+		uint32_t Length() const;
+		uint32_t Count() const;
+		bool IsEmpty() const;
+		size_t HeapSize() const;
+
+	protected:
+		// Chunk management.
+		size_t FindChunk(uint32_t pos) const;
+		static void InitChunk(Chunk& chunk, uint32_t start, uint32_t length);
+		void Resplit(size_t index, const std::vector<uint32_t>& vecOffsets);
+		void MergeSmallChunks();
+		void UpdateStarts(size_t index);
+		bool SameLayout(const Bitmap& other) const;
+
+		// Containers.
+		static bool ChunkContains(const Chunk& chunk, uint32_t offset);
+		static void Explode(const Chunk& chunk, std::vector<uint32_t>& vec);
+		static void ToBitset(Chunk& chunk);
+		static void Optimize(Chunk& chunk);
+		static void AndChunk(Chunk& chunk, const Chunk& other);
+		static void OrChunk(Chunk& chunk, const Chunk& other);
+		static void AndNotChunk(Chunk& chunk, const Chunk& other);
+
+		// Bit twiddling.
+		static uint32_t WordCount(uint32_t length);
+		static uint32_t PopCount(uint64_t word);
+		static uint32_t PopCount(const std::vector<uint64_t>& words);
+		static void CopyBits(std::vector<uint64_t>& dst, uint32_t ulDstBit,
+			const std::vector<uint64_t>& src, uint32_t ulSrcBit,
+			uint32_t ulCount);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_BITMAP_H
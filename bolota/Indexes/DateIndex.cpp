@@ -0,0 +1,287 @@
+/**
+ * DateIndex.cpp
+ * Sorted index of the timestamps of the date topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "DateIndex.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty date index.
+ */
+DateIndex::DateIndex() {
+}
+
+/**
+ * Frees up the tree of timestamps.
+ */
+DateIndex::~DateIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void DateIndex::Build(Field *first) {
+	Clear();
+
+	for (Field *field = first; field != NULL; field = field->Next())
+		AddSubtree(field);
+}
+
+/**
+ * Removes every topic from the index.
+ */
+void DateIndex::Clear() {
+	m_dates.clear();
+	std::vector<DateMap::iterator>().swap(m_entries);
+	std::vector<uint32_t>().swap(m_free);
+	m_fields.Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a topic and its children to the index.
+ *
+ * @param field Topic that was inserted.
+ */
+void DateIndex::TopicInserted(Field *field) {
+	AddSubtree(field);
+}
+
+/**
+ * Removes a topic and its children from the index.
+ *
+ * @param field     Topic to be removed.
+ * @param bDeleting Ignored. Moved topics are added back when inserted.
+ */
+void DateIndex::TopicRemoving(Field *field, bool bDeleting) {
+	RemoveSubtree(field);
+}
+
+/**
+ * Moves a topic whose timestamp may have changed to its new place in the tree.
+ *
+ * @param field Topic that was changed.
+ */
+void DateIndex::TopicChanged(Field *field) {
+	// Check if we know about this topic.
+	uint32_t slot = m_fields.Find(field);
+	if (slot == BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	// Only touch the tree if the timestamp actually changed.
+	timestamp_t ts = static_cast<DateField*>(field)->Timestamp();
+	uint64_t ullKey = Key(&ts);
+	if (m_entries[slot]->first == ullKey)
+		return;
+
+	m_dates.erase(m_entries[slot]);
+	m_entries[slot] = m_dates.insert(DateMap::value_type(ullKey,
+		static_cast<DateField*>(field)));
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the date topics whose timestamps fall within a range of time.
+ *
+ * @param from       Earliest timestamp. (inclusive)
+ * @param to         Latest timestamp. (inclusive)
+ * @param vecResults Vector to receive the topics in chronological order.
+ *
+ * @return Number of topics found.
+ */
+size_t DateIndex::Between(const timestamp_t *from, const timestamp_t *to,
+						  std::vector<DateField*>& vecResults) const {
+	uint64_t ullFrom = Key(from);
+	uint64_t ullTo = Key(to);
+
+	vecResults.clear();
+	if (ullFrom > ullTo)
+		return 0;
+
+	DateMap::const_iterator end = m_dates.upper_bound(ullTo);
+	for (DateMap::const_iterator it = m_dates.lower_bound(ullFrom); it != end;
+			++it) {
+		vecResults.push_back(it->second);
+	}
+
+	return vecResults.size();
+}
+
+/**
+ * Finds the most recent date topics.
+ *
+ * @param ulCount    Maximum number of topics to get.
+ * @param vecResults Vector to receive the topics, the most recent first.
+ *
+ * @return Number of topics found.
+ */
+size_t DateIndex::Latest(size_t ulCount,
+						 std::vector<DateField*>& vecResults) const {
+	vecResults.clear();
+
+	DateMap::const_reverse_iterator it = m_dates.rbegin();
+	for (; (it != m_dates.rend()) && (vecResults.size() < ulCount); ++it)
+		vecResults.push_back(it->second);
+
+	return vecResults.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of date topics in the index.
+ *
+ * @return Number of date topics.
+ */
+size_t DateIndex::Count() const {
+	return m_dates.size();
+}
+
+/**
+ * Estimates the memory used by the index, including the nodes of the tree.
+ *
+ * @return Number of bytes allocated by the index.
+ */
+size_t DateIndex::HeapSize() const {
+	return (m_dates.size() * (sizeof(DateMap::value_type) +
+		(sizeof(void*) * 4))) +
+		(m_entries.capacity() * sizeof(DateMap::iterator)) +
+		(m_free.capacity() * sizeof(uint32_t)) + m_fields.HeapSize();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                   Keys                                    |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Packs a timestamp into an integer that sorts chronologically.
+ *
+ * @param ts Timestamp to be packed.
+ *
+ * @return Key of the timestamp.
+ */
+uint64_t DateIndex::Key(const timestamp_t *ts) {
+	return ((uint64_t)ts->year << 40) | ((uint64_t)ts->month << 32) |
+		((uint64_t)ts->day << 24) | ((uint64_t)ts->hour << 16) |
+		((uint64_t)ts->minute << 8) | (uint64_t)ts->second;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Topic Management                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds the date topics of a subtree to the index.
+ *
+ * @param field Root of the subtree.
+ */
+void DateIndex::AddSubtree(Field *field) {
+	if (field->Type() == BOLOTA_TYPE_DATE)
+		AddTopic(static_cast<DateField*>(field));
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		AddSubtree(child);
+}
+
+/**
+ * Adds a single date topic to the tree, reusing the slot of a removed one if
+ * there's any.
+ *
+ * @param field Topic to be added.
+ */
+void DateIndex::AddTopic(DateField *field) {
+	timestamp_t ts = field->Timestamp();
+	DateMap::iterator it = m_dates.insert(DateMap::value_type(Key(&ts),
+		field));
+	uint32_t slot;
+
+	if (!m_free.empty()) {
+		slot = m_free.back();
+		m_free.pop_back();
+		m_entries[slot] = it;
+	} else {
+		slot = (uint32_t)m_entries.size();
+		m_entries.push_back(it);
+	}
+
+	m_fields.Insert(field, slot);
+}
+
+/**
+ * Removes the date topics of a subtree from the index.
+ *
+ * @param field Root of the subtree.
+ */
+void DateIndex::RemoveSubtree(Field *field) {
+	if (field->Type() == BOLOTA_TYPE_DATE)
+		RemoveTopic(field);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		RemoveSubtree(child);
+}
+
+/**
+ * Removes a single topic from the tree, if it's in there.
+ *
+ * @param field Topic to be removed.
+ */
+void DateIndex::RemoveTopic(Field *field) {
+	uint32_t slot = m_fields.Find(field);
+	if (slot == BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	m_dates.erase(m_entries[slot]);
+	m_fields.Remove(field);
+	m_free.push_back(slot);
+}
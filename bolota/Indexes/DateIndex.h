@@ -0,0 +1,88 @@
+/**
+ * DateIndex.h
+ * Sorted index of the timestamps of the date topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_DATEINDEX_H
+#define _BOLOTA_INDEXES_DATEINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../DateField.h"
+#include "DocumentIndex.h"
+#include "FieldTable.h"
+
+namespace Bolota {
+
+	/**
+	 * Sorted index of the timestamps of the date topics of a document, which
+	 * answers which topics fall in a range of time or are the most recent
+	 * ones in logarithmic time plus the number of results.
+	 *
+	 * Timestamps are kept in a balanced search tree keyed by their value,
+	 * so edits only touch the topics that were actually changed. Topics with
+	 * the same timestamp are kept in the order they were indexed.
+	 */
+	class DateIndex : public DocumentIndex {
+	protected:
+		// Tree of the timestamps.
+		typedef std::multimap<uint64_t, DateField*> DateMap;
+		DateMap m_dates;
+
+		// Topics in the tree.
+		std::vector<DateMap::iterator> m_entries;
+		std::vector<uint32_t> m_free;
+		FieldTable m_fields;
+
+	public:
+		// Constructors and destructors.
+		DateIndex();
+		virtual ~DateIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Searching.
+		size_t Between(const timestamp_t *from, const timestamp_t *to,
+			std::vector<DateField*>& vecResults) const;
+		size_t Latest(size_t ulCount,
+			std::vector<DateField*>& vecResults) const;
+
+		// Statistics.
+		size_t Count() const;
+		size_t HeapSize() const;
+
+		// Keys.
+		static uint64_t Key(const timestamp_t *ts);
+
+	protected:
+		// Topic management.
+		void AddSubtree(Field *field);
+		void AddTopic(DateField *field);
+		void RemoveSubtree(Field *field);
+		void RemoveTopic(Field *field);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_DATEINDEX_H
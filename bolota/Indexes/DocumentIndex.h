@@ -0,0 +1,71 @@
+/**
+ * DocumentIndex.h
+ * Interface of the auxiliary indexes that are kept up to date by a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_DOCUMENTINDEX_H
+#define _BOLOTA_INDEXES_DOCUMENTINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "../Field.h"
+
+namespace Bolota {
+
+	/**
+	 * Interface of the auxiliary indexes that are kept up to date by a
+	 * document. Once attached to a document an index is built from scratch and
+	 * then notified of every change made through the document's topic
+	 * management methods, so that it can be updated incrementally.
+	 *
+	 * Moving a topic around is reported as it being removed and then inserted
+	 * back at its new location.
+	 */
+	class DocumentIndex {
+	public:
+		virtual ~DocumentIndex() {};
+
+		/**
+		 * Builds the index from scratch.
+		 *
+		 * @param first First topic of the document. Can be NULL.
+		 */
+		virtual void Build(Field *first) = 0;
+
+		/**
+		 * Removes everything from the index.
+		 */
+		virtual void Clear() = 0;
+
+		/**
+		 * A topic and all of its children have been inserted into the tree.
+		 *
+		 * @param field Topic that was inserted, already linked in place.
+		 */
+		virtual void TopicInserted(Field *field) = 0;
+
+		/**
+		 * A topic and all of its children are about to be removed from the
+		 * tree.
+		 *
+		 * @param field     Topic to be removed, still linked in place.
+		 * @param bDeleting Will the fields be destroyed afterwards? FALSE if
+		 *                  they are only being moved.
+		 */
+		virtual void TopicRemoving(Field *field, bool bDeleting) = 0;
+
+		/**
+		 * The contents of a topic (but not its position) have changed.
+		 *
+		 * @param field Topic that was changed.
+		 */
+		virtual void TopicChanged(Field *field) = 0;
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_DOCUMENTINDEX_H
@@ -0,0 +1,496 @@
+/**
+ * FacetIndex.cpp
+ * Bitmaps of the topics of a document by their field type and icon.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "FacetIndex.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty facet index.
+ */
+FacetIndex::FacetIndex() {
+}
+
+/**
+ * Frees up the bitmaps and the positions of the topics.
+ */
+FacetIndex::~FacetIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void FacetIndex::Build(Field *first) {
+	int i;
+
+	// Lay out every bitmap for the topics we've got.
+	m_order.Build(first);
+	uint32_t count = m_order.Count();
+	m_all.Reset(count);
+	m_all.AddRange(0, count);
+	for (i = 0; i < BOLOTA_FACET_TYPES; i++)
+		m_types[i].Reset(count);
+	for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++)
+		m_icons[i].Reset(count);
+	m_empty.Reset(count);
+
+	// Populate the facets.
+	for (uint32_t pos = 0; pos < count; pos++)
+		AddTopic(m_order.At(pos), pos);
+}
+
+/**
+ * Removes every topic from the index.
+ */
+void FacetIndex::Clear() {
+	Build(NULL);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Opens up room for a topic and its children in the bitmaps and adds them to
+ * their facets.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void FacetIndex::TopicInserted(Field *field) {
+	std::vector<Field*> vecFields;
+
+	// Check if we already know about this topic.
+	if (m_order.Position(field) != BOLOTA_POS_NONE)
+		return;
+
+	// Find out where the topic ended up.
+	uint32_t pos = m_order.InsertionPoint(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+	TopicOrder::Collect(field, vecFields);
+	m_order.Insert(pos, vecFields);
+
+	// Shift everything after it and populate the gap.
+	uint32_t count = (uint32_t)vecFields.size();
+	InsertPositions(pos, count);
+	m_all.AddRange(pos, pos + count);
+	for (uint32_t i = 0; i < count; i++)
+		AddTopic(vecFields[i], pos + i);
+}
+
+/**
+ * Removes a topic and its children from the bitmaps, closing the gap they
+ * leave behind.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Ignored. Moved topics are added back when inserted.
+ */
+void FacetIndex::TopicRemoving(Field *field, bool bDeleting) {
+	uint32_t pos = m_order.Position(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+
+	uint32_t count = SubtreeEnd(field) - pos;
+	RemovePositions(pos, count);
+	m_order.Remove(pos, count);
+}
+
+/**
+ * Moves a topic whose icon or type may have changed to its new facets.
+ *
+ * @param field Topic that was changed.
+ */
+void FacetIndex::TopicChanged(Field *field) {
+	uint32_t pos = m_order.Position(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+
+	RemoveTopic(pos);
+	AddTopic(field, pos);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Facets                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the bitmap with every topic of the document, which is handy for
+ * negating filters.
+ *
+ * @return Bitmap of every topic.
+ */
+const Bitmap& FacetIndex::All() const {
+	return m_all;
+}
+
+/**
+ * Gets the topics of a field type.
+ *
+ * @param type Type of the topics.
+ *
+ * @return Bitmap of the topics of the type.
+ */
+const Bitmap& FacetIndex::OfType(bolota_type_t type) const {
+	int slot = TypeSlot(type);
+	return (slot < 0) ? m_empty : m_types[slot];
+}
+
+/**
+ * Gets the icon topics that have a specific icon.
+ *
+ * @param icon Icon of the topics.
+ *
+ * @return Bitmap of the topics with the icon.
+ */
+const Bitmap& FacetIndex::WithIcon(field_icon_t icon) const {
+	if ((uint32_t)icon > BOLOTA_FIELD_ICON_NUM)
+		return m_empty;
+
+	return m_icons[icon];
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Structure                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the direct children of a set of topics.
+ *
+ * @param parents Bitmap of the parent topics.
+ * @param result  Bitmap to receive the children of the topics. Can be the
+ *                same as the parents.
+ */
+void FacetIndex::Children(const Bitmap& parents, Bitmap& result) {
+	Bitmap children;
+	children.ResetLike(m_all);
+
+	for (uint32_t pos = parents.Next(0); pos != BOLOTA_BITMAP_NONE;
+			pos = parents.Next(pos + 1)) {
+		Field *field = m_order.At(pos);
+		if (field == NULL)
+			break;
+
+		if (!field->HasChild())
+			continue;
+
+		// The first child comes right after its parent.
+		children.Add(pos + 1);
+		for (Field *child = field->Child()->Next(); child != NULL;
+				child = child->Next()) {
+			children.Add(m_order.Position(child));
+		}
+	}
+
+	result.Swap(children);
+}
+
+/**
+ * Gets the direct parents of a set of topics.
+ *
+ * @param children Bitmap of the child topics.
+ * @param result   Bitmap to receive the parents of the topics. Can be the
+ *                 same as the children.
+ */
+void FacetIndex::Parents(const Bitmap& children, Bitmap& result) {
+	Field *last = NULL;
+	Bitmap parents;
+	parents.ResetLike(m_all);
+
+	for (uint32_t pos = children.Next(0); pos != BOLOTA_BITMAP_NONE;
+			pos = children.Next(pos + 1)) {
+		Field *field = m_order.At(pos);
+		if (field == NULL)
+			break;
+
+		// Siblings usually come in a row.
+		Field *parent = field->Parent();
+		if ((parent == NULL) || (parent == last))
+			continue;
+
+		parents.Add(m_order.Position(parent));
+		last = parent;
+	}
+
+	result.Swap(parents);
+}
+
+/**
+ * Gets every topic nested under a set of topics, at any depth.
+ *
+ * @param ancestors Bitmap of the ancestor topics.
+ * @param result    Bitmap to receive the descendants of the topics. Can be
+ *                  the same as the ancestors.
+ */
+void FacetIndex::Descendants(const Bitmap& ancestors, Bitmap& result) {
+	Bitmap descendants;
+	descendants.ResetLike(m_all);
+
+	uint32_t pos = ancestors.Next(0);
+	while (pos != BOLOTA_BITMAP_NONE) {
+		Field *field = m_order.At(pos);
+		if (field == NULL)
+			break;
+
+		// Topics without children have nothing to add.
+		if (!field->HasChild()) {
+			pos = ancestors.Next(pos + 1);
+			continue;
+		}
+
+		// Children of a topic occupy the positions right after it, so we can
+		// skip over any ancestors nested in there.
+		uint32_t end = SubtreeEnd(field);
+		descendants.AddRange(pos + 1, end);
+		pos = ancestors.Next(end);
+	}
+
+	result.Swap(descendants);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Topics                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics in the document.
+ */
+uint32_t FacetIndex::Count() const {
+	return m_all.Length();
+}
+
+/**
+ * Gets the position of a topic in the bitmaps.
+ *
+ * @param field Topic to be looked up.
+ *
+ * @return Position of the topic or BOLOTA_POS_NONE if it isn't in the index.
+ */
+uint32_t FacetIndex::Position(Field *field) const {
+	return m_order.Position(field);
+}
+
+/**
+ * Gets the topic at a position of the bitmaps.
+ *
+ * @param pos Position of the topic.
+ *
+ * @return Topic at the position or NULL if it's out of bounds.
+ */
+Field* FacetIndex::At(uint32_t pos) {
+	return m_order.At(pos);
+}
+
+/**
+ * Gets the topics of a bitmap.
+ *
+ * @param bitmap    Bitmap of topic positions.
+ * @param vecFields Vector to receive the topics in display order.
+ *
+ * @return Number of topics in the bitmap.
+ */
+size_t FacetIndex::Fields(const Bitmap& bitmap,
+						  std::vector<Field*>& vecFields) {
+	std::vector<uint32_t> vecPositions;
+
+	bitmap.ToVector(vecPositions);
+	vecFields.clear();
+	vecFields.reserve(vecPositions.size());
+	for (size_t i = 0; i < vecPositions.size(); i++) {
+		Field *field = m_order.At(vecPositions[i]);
+		if (field != NULL)
+			vecFields.push_back(field);
+	}
+
+	return vecFields.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Estimates the memory used by the index, including the list of topics in
+ * display order.
+ *
+ * @return Number of bytes allocated by the index.
+ */
+size_t FacetIndex::HeapSize() const {
+	size_t ulSize = m_order.HeapSize() + m_all.HeapSize() + m_empty.HeapSize();
+	int i;
+
+	for (i = 0; i < BOLOTA_FACET_TYPES; i++)
+		ulSize += m_types[i].HeapSize();
+	for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++)
+		ulSize += m_icons[i].HeapSize();
+
+	return ulSize;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Facet Management                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the bitmap that holds the topics of a field type.
+ *
+ * @param type Type of the topics.
+ *
+ * @return Index of the bitmap or -1 if the type doesn't have one.
+ */
+int FacetIndex::TypeSlot(bolota_type_t type) {
+	switch (type) {
+	case BOLOTA_TYPE_TEXT:
+		return 0;
+	case BOLOTA_TYPE_DATE:
+		return 1;
+	case BOLOTA_TYPE_ICON:
+		return 2;
+	case BOLOTA_TYPE_BLANK:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Adds a single topic to its facets.
+ *
+ * @param field Topic to be added.
+ * @param pos   Position of the topic.
+ */
+void FacetIndex::AddTopic(Field *field, uint32_t pos) {
+	int slot = TypeSlot(field->Type());
+	if (slot >= 0)
+		m_types[slot].Add(pos);
+
+	// Icon topics.
+	if (field->Type() == BOLOTA_TYPE_ICON) {
+		field_icon_t icon = static_cast<IconField*>(field)->IconIndex();
+		if ((uint32_t)icon <= BOLOTA_FIELD_ICON_NUM)
+			m_icons[icon].Add(pos);
+	}
+}
+
+/**
+ * Removes a single topic from every facet, but leaves its position in place.
+ *
+ * @param pos Position of the topic.
+ */
+void FacetIndex::RemoveTopic(uint32_t pos) {
+	int i;
+
+	for (i = 0; i < BOLOTA_FACET_TYPES; i++)
+		m_types[i].Remove(pos);
+	for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++)
+		m_icons[i].Remove(pos);
+}
+
+/**
+ * Opens up a gap of empty positions in every bitmap.
+ *
+ * @param pos   Position where the gap should start.
+ * @param count Number of positions to be inserted.
+ */
+void FacetIndex::InsertPositions(uint32_t pos, uint32_t count) {
+	int i;
+
+	m_all.InsertPositions(pos, count);
+	for (i = 0; i < BOLOTA_FACET_TYPES; i++)
+		m_types[i].InsertPositions(pos, count);
+	for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++)
+		m_icons[i].InsertPositions(pos, count);
+	m_empty.InsertPositions(pos, count);
+}
+
+/**
+ * Removes a range of positions from every bitmap.
+ *
+ * @param pos   First position to be removed.
+ * @param count Number of positions to be removed.
+ */
+void FacetIndex::RemovePositions(uint32_t pos, uint32_t count) {
+	int i;
+
+	m_all.RemovePositions(pos, count);
+	for (i = 0; i < BOLOTA_FACET_TYPES; i++)
+		m_types[i].RemovePositions(pos, count);
+	for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++)
+		m_icons[i].RemovePositions(pos, count);
+	m_empty.RemovePositions(pos, count);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Document Helpers                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the position right after the last child of a topic.
+ *
+ * @param field Reference topic.
+ *
+ * @return Position after the topic and all of its children.
+ */
+uint32_t FacetIndex::SubtreeEnd(Field *field) const {
+	// Find the first topic after this one that isn't one of its children.
+	Field *skip = field;
+	while ((skip != NULL) && !skip->HasNext())
+		skip = skip->Parent();
+	if (skip == NULL)
+		return Count();
+
+	uint32_t pos = m_order.Position(skip->Next());
+	return (pos == BOLOTA_POS_NONE) ? Count() : pos;
+}
@@ -0,0 +1,108 @@
+/**
+ * FacetIndex.h
+ * Bitmaps of the topics of a document by their field type and icon.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_FACETINDEX_H
+#define _BOLOTA_INDEXES_FACETINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../IconField.h"
+#include "Bitmap.h"
+#include "DocumentIndex.h"
+#include "TopicOrder.h"
+
+/**
+ * Number of field types that have their own bitmap.
+ */
+#define BOLOTA_FACET_TYPES 4
+
+namespace Bolota {
+
+	/**
+	 * Bitmaps of the positions of the topics of a document in display
+	 * (pre-)order, one for every field type and one for every icon, which
+	 * answer filters such as "every starred topic" without walking the tree.
+	 *
+	 * Since the children of a topic come right after it, structural filters
+	 * turn into ranges of positions. Combined filters such as "starred
+	 * topics under a checked one" are built by intersecting the facets with
+	 * the bitmaps returned by Children and Descendants.
+	 *
+	 * Every bitmap handed out by the index shares the same layout, so they
+	 * are combined a whole chunk at a time. They're only valid until the
+	 * document is changed.
+	 */
+	class FacetIndex : public DocumentIndex {
+	protected:
+		// Topic positions.
+		TopicOrder m_order;
+
+		// Facets.
+		Bitmap m_all;
+		Bitmap m_types[BOLOTA_FACET_TYPES];
+		Bitmap m_icons[BOLOTA_FIELD_ICON_NUM + 1];
+		Bitmap m_empty;
+
+	public:
+		// Constructors and destructors.
+		FacetIndex();
+		virtual ~FacetIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Facets.
+		const Bitmap& All() const;
+		const Bitmap& OfType(bolota_type_t type) const;
+		const Bitmap& WithIcon(field_icon_t icon) const;
+
+		// Structure.
+		void Children(const Bitmap& parents, Bitmap& result);
+		void Parents(const Bitmap& children, Bitmap& result);
+		void Descendants(const Bitmap& ancestors, Bitmap& result);
+
+		// Topics.
+		uint32_t Count() const;
+		uint32_t Position(Field *field) const;
+		Field* At(uint32_t pos);
+		size_t Fields(const Bitmap& bitmap, std::vector<Field*>& vecFields);
+
+		// Statistics.
+		size_t HeapSize() const;
+
+	protected:
+		// Facet management.
+		static int TypeSlot(bolota_type_t type);
+		void AddTopic(Field *field, uint32_t pos);
+		void RemoveTopic(uint32_t pos);
+		void InsertPositions(uint32_t pos, uint32_t count);
+		void RemovePositions(uint32_t pos, uint32_t count);
+
+		// Document helpers.
+		uint32_t SubtreeEnd(Field *field) const;
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_FACETINDEX_H
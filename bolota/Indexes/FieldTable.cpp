@@ -0,0 +1,222 @@
+/**
+ * FieldTable.cpp
+ * Hash table that maps fields to the slots they occupy in an index.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "FieldTable.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty table.
+ */
+FieldTable::FieldTable() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Operations                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the slot of a field.
+ *
+ * @param field Field to look for.
+ *
+ * @return Slot of the field or BOLOTA_FIELDTABLE_NONE if it isn't in the
+ *         table.
+ */
+uint32_t FieldTable::Find(const Field *field) const {
+	const Entry& entry = m_table[Lookup(field)];
+	return (entry.field == NULL) ? BOLOTA_FIELDTABLE_NONE : entry.slot;
+}
+
+/**
+ * Sets the slot of a field, adding it to the table if needed.
+ *
+ * @param field Field to be inserted.
+ * @param slot  Slot occupied by the field.
+ */
+void FieldTable::Insert(const Field *field, uint32_t slot) {
+	// Keep the load factor under 75%.
+	if ((m_count + 1) * 4 > m_table.size() * 3)
+		Rehash(m_table.size() * 2);
+
+	Entry& entry = m_table[Lookup(field)];
+	if (entry.field == NULL) {
+		entry.field = field;
+		m_count++;
+	}
+	entry.slot = slot;
+}
+
+/**
+ * Removes a field from the table, shifting back the entries that follow it so
+ * that no tombstones are needed.
+ *
+ * @param field Field to be removed.
+ */
+void FieldTable::Remove(const Field *field) {
+	size_t mask = m_table.size() - 1;
+	size_t index = Lookup(field);
+	size_t next = index;
+
+	if (m_table[index].field == NULL)
+		return;
+
+	while (true) {
+		m_table[index].field = NULL;
+
+		// Find the next entry that can take the one that's been emptied.
+		while (true) {
+			next = (next + 1) & mask;
+			if (m_table[next].field == NULL) {
+				m_count--;
+				return;
+			}
+
+			// Entries can only move back towards their home.
+			size_t home = Hash(m_table[next].field) & mask;
+			if (((next - home) & mask) >= ((next - index) & mask))
+				break;
+		}
+
+		m_table[index] = m_table[next];
+		index = next;
+	}
+}
+
+/**
+ * Makes room for a number of fields, so that inserting them won't trigger a
+ * rehash.
+ *
+ * @param ulCount Number of fields the table should be able to hold.
+ */
+void FieldTable::Reserve(size_t ulCount) {
+	size_t ulSlots = m_table.size();
+	while ((ulCount * 4) > (ulSlots * 3))
+		ulSlots *= 2;
+	if (ulSlots != m_table.size())
+		Rehash(ulSlots);
+}
+
+/**
+ * Removes every field from the table and releases its memory.
+ */
+void FieldTable::Clear() {
+	Entry empty;
+	empty.field = NULL;
+	empty.slot = 0;
+
+	std::vector<Entry>(BOLOTA_FIELDTABLE_SLOTS, empty).swap(m_table);
+	m_count = 0;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Statistics                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of fields in the table.
+ *
+ * @return Number of fields.
+ */
+size_t FieldTable::Count() const {
+	return m_count;
+}
+
+/**
+ * Gets the number of bytes allocated for the table.
+ *
+ * @return Size of the table in bytes.
+ */
+size_t FieldTable::HeapSize() const {
+	return m_table.capacity() * sizeof(Entry);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Helpers                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Scrambles the address of a field into a hash.
+ *
+ * @param field Field to be hashed.
+ *
+ * @return Hash of the field.
+ */
+uint32_t FieldTable::Hash(const Field *field) {
+	uint64_t addr = (uint64_t)(size_t)field;
+	uint32_t hash = (uint32_t)(addr >> 4) ^ (uint32_t)(addr >> 32);
+
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3BU;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+ * Looks up the entry of a field in the hash table.
+ *
+ * @param field Field to look for.
+ *
+ * @return Index of the entry of the field or of the empty entry where it
+ *         would go.
+ */
+size_t FieldTable::Lookup(const Field *field) const {
+	size_t mask = m_table.size() - 1;
+	size_t index = Hash(field) & mask;
+
+	while ((m_table[index].field != NULL) && (m_table[index].field != field))
+		index = (index + 1) & mask;
+
+	return index;
+}
+
+/**
+ * Moves every entry into a new hash table.
+ *
+ * @param ulSlots Number of slots of the new table. (must be a power of 2)
+ */
+void FieldTable::Rehash(size_t ulSlots) {
+	Entry empty;
+	empty.field = NULL;
+	empty.slot = 0;
+
+	std::vector<Entry> vecOld(ulSlots, empty);
+	m_table.swap(vecOld);
+
+	size_t mask = ulSlots - 1;
+	for (size_t i = 0; i < vecOld.size(); i++) {
+		if (vecOld[i].field == NULL)
+			continue;
+
+		size_t index = Hash(vecOld[i].field) & mask;
+		while (m_table[index].field != NULL)
+			index = (index + 1) & mask;
+		m_table[index] = vecOld[i];
+	}
+}
@@ -0,0 +1,80 @@
+/**
+ * FieldTable.h
+ * Hash table that maps fields to the slots they occupy in an index.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_FIELDTABLE_H
+#define _BOLOTA_INDEXES_FIELDTABLE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Field.h"
+
+/**
+ * Initial number of slots of the hash table. (must be a power of 2)
+ */
+#define BOLOTA_FIELDTABLE_SLOTS 1024
+
+/**
+ * Value returned for fields that aren't in the table.
+ */
+#define BOLOTA_FIELDTABLE_NONE ((uint32_t)-1)
+
+namespace Bolota {
+
+	/**
+	 * Open addressing hash table that maps fields to the slots they occupy in
+	 * the arrays of an index, which is how the indexes find a topic they were
+	 * notified about. Fields are only compared by their address, so they're
+	 * never dereferenced by the table.
+	 */
+	class FieldTable {
+	protected:
+		// Slot of the open addressing hash table.
+		struct Entry {
+			const Field *field;
+			uint32_t slot;
+		};
+
+		// Hash table.
+		std::vector<Entry> m_table;
+		size_t m_count;
+
+	public:
+		// Constructors and destructors.
+		FieldTable();
+
+		// Operations.
+		uint32_t Find(const Field *field) const;
+		void Insert(const Field *field, uint32_t slot);
+		void Remove(const Field *field);
+		void Reserve(size_t ulCount);
+		void Clear();
+
+		// Statistics.
+		size_t Count() const;
+		size_t HeapSize() const;
+
+	protected:
+		// Helpers.
+		static uint32_t Hash(const Field *field);
+		size_t Lookup(const Field *field) const;
+		void Rehash(size_t ulSlots);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_FIELDTABLE_H
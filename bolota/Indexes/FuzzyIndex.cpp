@@ -0,0 +1,1105 @@
+/**
+ * FuzzyIndex.cpp
+ * Fuzzy finder over the texts of the topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "FuzzyIndex.h"
+
+#include <string.h>
+#include <algorithm>
+
+/**
+ * Characters are looked up 16 bytes at a time where SSE2 is always available.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define FUZZY_HAS_SSE2
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif // _MSC_VER
+	#include <emmintrin.h>
+#endif
+
+/**
+ * Bytes of padding after the texts so that they can be read in whole blocks.
+ */
+#define FUZZY_PADDING 16
+
+/**
+ * Classes of characters, ordered so that everything after CLASS_NONWORD is
+ * part of a word.
+ */
+#define CLASS_WHITE     0
+#define CLASS_NONWORD   1
+#define CLASS_DELIMITER 2
+#define CLASS_LOWER     3
+#define CLASS_UPPER     4
+#define CLASS_LETTER    5
+#define CLASS_NUMBER    6
+
+/**
+ * Scoring of the matches, the same as fzf's.
+ */
+#define SCORE_MATCH              16
+#define SCORE_GAP_START          -3
+#define SCORE_GAP_EXTENSION      -1
+#define BONUS_BOUNDARY           (SCORE_MATCH / 2)
+#define BONUS_BOUNDARY_WHITE     (BONUS_BOUNDARY + 2)
+#define BONUS_BOUNDARY_DELIMITER (BONUS_BOUNDARY + 1)
+#define BONUS_NONWORD            (SCORE_MATCH / 2)
+#define BONUS_CAMEL123           (BONUS_BOUNDARY - 1)
+#define BONUS_CONSECUTIVE        -(SCORE_GAP_START + SCORE_GAP_EXTENSION)
+#define BONUS_FIRST_MULTIPLIER   2
+
+/**
+ * Value returned when a character isn't found.
+ */
+#define FUZZY_NOT_FOUND ((size_t)-1)
+
+using namespace Bolota;
+
+/**
+ * Gets the class of a byte of a text. Bytes of non-ASCII characters are always
+ * letters.
+ *
+ * @param c Byte to be classified.
+ *
+ * @return Class of the character.
+ */
+static inline uint8_t CharClass(unsigned char c) {
+	if ((c >= 'a') && (c <= 'z'))
+		return CLASS_LOWER;
+	if ((c >= 'A') && (c <= 'Z'))
+		return CLASS_UPPER;
+	if ((c >= '0') && (c <= '9'))
+		return CLASS_NUMBER;
+	if (c >= 0x80)
+		return CLASS_LETTER;
+
+	switch (c) {
+	case ' ':
+	case '\t':
+	case '\n':
+	case '\v':
+	case '\f':
+	case '\r':
+		return CLASS_WHITE;
+	case '/':
+	case ',':
+	case ':':
+	case ';':
+	case '|':
+		return CLASS_DELIMITER;
+	default:
+		return CLASS_NONWORD;
+	}
+}
+
+/**
+ * Gets the bonus of matching a character based on what comes before it.
+ *
+ * @param prev Class of the previous character.
+ * @param cls  Class of the character that was matched.
+ *
+ * @return Bonus of the match.
+ */
+static inline int32_t CharBonus(uint8_t prev, uint8_t cls) {
+	// Start of a word.
+	if (cls > CLASS_NONWORD) {
+		if (prev == CLASS_WHITE)
+			return BONUS_BOUNDARY_WHITE;
+		if (prev == CLASS_DELIMITER)
+			return BONUS_BOUNDARY_DELIMITER;
+		if (prev == CLASS_NONWORD)
+			return BONUS_BOUNDARY;
+	}
+
+	// camelCase and letter123 transitions.
+	if (((prev == CLASS_LOWER) && (cls == CLASS_UPPER)) ||
+			((prev != CLASS_NUMBER) && (cls == CLASS_NUMBER))) {
+		return BONUS_CAMEL123;
+	}
+
+	// Punctuation and spaces.
+	if ((cls == CLASS_NONWORD) || (cls == CLASS_DELIMITER))
+		return BONUS_NONWORD;
+	if (cls == CLASS_WHITE)
+		return BONUS_BOUNDARY_WHITE;
+
+	return 0;
+}
+
+/**
+ * Gets the bit of the character mask that stands for a byte. Letters share
+ * the same bit regardless of their case.
+ *
+ * @param c Byte of a text.
+ *
+ * @return Bit of the byte.
+ */
+static inline uint64_t MaskBit(unsigned char c) {
+	if ((c >= 'a') && (c <= 'z'))
+		return (uint64_t)1 << (c - 'a');
+	if ((c >= 'A') && (c <= 'Z'))
+		return (uint64_t)1 << (c - 'A');
+	if ((c >= '0') && (c <= '9'))
+		return (uint64_t)1 << (26 + (c - '0'));
+
+	return (uint64_t)1 << (36 + (c % 28));
+}
+
+/**
+ * Counts the number of trailing zero bits in a mask.
+ *
+ * @param mask Mask to be checked. Must not be zero.
+ *
+ * @return Index of the lowest bit that is set.
+ */
+static inline unsigned int TrailingZeros(uint32_t mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#elif defined(FUZZY_HAS_SSE2)
+	unsigned long ulIndex;
+	_BitScanForward(&ulIndex, mask);
+	return ulIndex;
+#else
+	unsigned int uiIndex = 0;
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		uiIndex++;
+	}
+
+	return uiIndex;
+#endif
+}
+
+/**
+ * Gets the score of a character that matched, keeping track of the bonus of
+ * the first character of a run of consecutive ones.
+ *
+ * @param bonus         Bonus of the character on its own.
+ * @param index         Index of the character in the query.
+ * @param ulConsecutive Number of characters that matched right before it.
+ * @param pFirstBonus   Bonus of the first character of the run. Updated on
+ *                      return.
+ *
+ * @return Score of the character.
+ */
+static inline int32_t MatchScore(int32_t bonus, uint8_t index,
+								 size_t ulConsecutive, int32_t *pFirstBonus) {
+	// Consecutive matches carry the bonus of the first one along.
+	if (ulConsecutive == 0) {
+		*pFirstBonus = bonus;
+	} else {
+		if ((bonus >= BONUS_BOUNDARY) && (bonus > *pFirstBonus))
+			*pFirstBonus = bonus;
+		bonus = std::max(std::max(bonus, *pFirstBonus),
+			(int32_t)BONUS_CONSECUTIVE);
+	}
+
+	// The first character of the query counts for more.
+	if (index == 0)
+		return SCORE_MATCH + (bonus * BONUS_FIRST_MULTIPLIER);
+
+	return SCORE_MATCH + bonus;
+}
+
+/**
+ * Gets the index of the lowest bit that is set in a 64-bit mask.
+ *
+ * @param mask Mask to be checked. Must not be zero.
+ *
+ * @return Index of the lowest bit that is set.
+ */
+static inline unsigned int LowestBit(uint64_t mask) {
+	if ((uint32_t)mask != 0)
+		return TrailingZeros((uint32_t)mask);
+
+	return 32 + TrailingZeros((uint32_t)(mask >> 32));
+}
+
+/**
+ * Gets the index of the highest bit that is set in a 64-bit mask.
+ *
+ * @param mask Mask to be checked. Must not be zero.
+ *
+ * @return Index of the highest bit that is set.
+ */
+static inline unsigned int HighestBit(uint64_t mask) {
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(mask);
+#else
+	unsigned int uiIndex = 0;
+	while (mask >>= 1)
+		uiIndex++;
+
+	return uiIndex;
+#endif
+}
+
+/**
+ * Counts the number of bits that are set in a 64-bit mask.
+ *
+ * @param mask Mask to be counted.
+ *
+ * @return Number of bits set.
+ */
+static inline unsigned int PopCount(uint64_t mask) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(mask);
+#else
+	unsigned int uiCount = 0;
+	for (; mask != 0; mask &= mask - 1)
+		uiCount++;
+
+	return uiCount;
+#endif
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty fuzzy finder.
+ */
+FuzzyIndex::FuzzyIndex() {
+	m_text.assign(FUZZY_PADDING, '\0');
+	m_ulDeadBytes = 0;
+	m_ulDead = 0;
+}
+
+/**
+ * Frees up the texts.
+ */
+FuzzyIndex::~FuzzyIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch. Topics are numbered in document order.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void FuzzyIndex::Build(Field *first) {
+	Clear();
+
+	for (Field *field = first; field != NULL; field = field->Next())
+		AddSubtree(field);
+}
+
+/**
+ * Removes every topic from the index.
+ */
+void FuzzyIndex::Clear() {
+	std::vector<char>(FUZZY_PADDING, '\0').swap(m_text);
+	std::vector<uint64_t>().swap(m_masks);
+	std::vector<Topic>().swap(m_topics);
+	m_fields.Clear();
+	m_ulDeadBytes = 0;
+	m_ulDead = 0;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a topic and all of its children to the index.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void FuzzyIndex::TopicInserted(Field *field) {
+	// Check if we already know about this topic.
+	if (m_fields.Find(field) != BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	AddSubtree(field);
+}
+
+/**
+ * Removes a topic and all of its children from the index.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards?
+ */
+void FuzzyIndex::TopicRemoving(Field *field, bool bDeleting) {
+	RemoveSubtree(field);
+
+	// Get rid of the dead topics once they start to pile up.
+	if (m_ulDead > ((Count() / 2) + BOLOTA_FUZZY_DEAD_MIN))
+		Compact();
+}
+
+/**
+ * Replaces the text of a topic that was changed.
+ *
+ * @param field Topic that was changed.
+ */
+void FuzzyIndex::TopicChanged(Field *field) {
+	uint32_t slot = m_fields.Find(field);
+	if (slot == BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	// Texts that still fit are simply overwritten.
+	Topic& topic = m_topics[slot];
+	uint16_t usLength = (field->HasText()) ? field->TextLength() : 0;
+	if (usLength <= topic.length) {
+		if (usLength > 0) {
+			memcpy(&m_text[topic.offset], field->Text()->GetMultiByteString(),
+				usLength);
+		}
+		m_ulDeadBytes += topic.length - usLength;
+		topic.length = usLength;
+		m_masks[slot] = CharMask(&m_text[topic.offset], usLength);
+		return;
+	}
+
+	// Texts are packed together, so a longer one has to go at the end.
+	RemoveTopic(field, slot);
+	AddTopic(field);
+
+	if (m_ulDead > ((Count() / 2) + BOLOTA_FUZZY_DEAD_MIN))
+		Compact();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the topics that best match a fuzzy query.
+ *
+ * @param szQuery    Characters to look for in order. Only the first
+ *                   BOLOTA_FUZZY_QUERY_MAX characters are used.
+ * @param ulLimit    Maximum number of results.
+ * @param uThreads   Number of threads to use. 0 uses one per processor, as
+ *                   long as each one gets enough topics to be worth it.
+ * @param vecResults Vector to receive the best matches, best first.
+ *
+ * @return Number of results.
+ */
+size_t FuzzyIndex::Search(const char *szQuery, size_t ulLimit,
+						  unsigned int uThreads,
+						  std::vector<FuzzyMatch>& vecResults) const {
+	Pattern pattern;
+	Job job;
+
+	vecResults.clear();
+	if ((ulLimit == 0) || m_topics.empty() || !ParsePattern(szQuery, pattern))
+		return 0;
+
+	// Don't bother with threads that wouldn't have much to do.
+	size_t ulMaxThreads = (m_topics.size() / BOLOTA_FUZZY_THREAD_MIN) + 1;
+	if (uThreads == 0)
+		uThreads = Threads::ProcessorCount();
+	if (uThreads > ulMaxThreads)
+		uThreads = (unsigned int)ulMaxThreads;
+
+	// Score every topic.
+	job.index = this;
+	job.pattern = &pattern;
+	job.ulLimit = ulLimit;
+	job.best.reserve(ulLimit);
+	Threads::InitMutex(&job.mutex);
+	Threads::ParallelFor(m_topics.size(), uThreads, SearchRange, &job);
+	Threads::DestroyMutex(&job.mutex);
+
+	// Put the best ones in order and find out what to highlight.
+	std::sort_heap(job.best.begin(), job.best.end(), Better);
+	vecResults.resize(job.best.size());
+	for (size_t i = 0; i < job.best.size(); i++) {
+		const Topic& topic = m_topics[job.best[i].slot];
+		FuzzyMatch& match = vecResults[i];
+
+		match.field = topic.field;
+		match.count = pattern.count;
+		match.score = Score(&m_text[topic.offset], topic.length, pattern,
+			match.positions);
+	}
+
+	return vecResults.size();
+}
+
+/**
+ * Finds the topics that best match a fuzzy query.
+ *
+ * @param szQuery    Characters to look for in order.
+ * @param ulLimit    Maximum number of results.
+ * @param uThreads   Number of threads to use. 0 uses one per processor.
+ * @param vecResults Vector to receive the best matches, best first.
+ *
+ * @return Number of results.
+ */
+size_t FuzzyIndex::Search(const wchar_t *szQuery, size_t ulLimit,
+						  unsigned int uThreads,
+						  std::vector<FuzzyMatch>& vecResults) const {
+	UString strQuery(szQuery);
+	return Search(strQuery.GetMultiByteString(), ulLimit, uThreads,
+		vecResults);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Statistics                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics.
+ */
+size_t FuzzyIndex::Count() const {
+	return m_topics.size() - m_ulDead;
+}
+
+/**
+ * Estimates the memory used by the index.
+ *
+ * @return Number of bytes allocated by the index.
+ */
+size_t FuzzyIndex::HeapSize() const {
+	return m_text.capacity() + (m_masks.capacity() * sizeof(uint64_t)) +
+		(m_topics.capacity() * sizeof(Topic)) + m_fields.HeapSize();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Topic Management                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a topic and all of its children to the end of the index in display
+ * order.
+ *
+ * @param field Topic to be added.
+ */
+void FuzzyIndex::AddSubtree(Field *field) {
+	AddTopic(field);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		AddSubtree(child);
+}
+
+/**
+ * Adds a single topic to the end of the index.
+ *
+ * @param field Topic to be added.
+ */
+void FuzzyIndex::AddTopic(Field *field) {
+	Topic topic;
+
+	topic.field = field;
+	topic.offset = (uint32_t)(m_text.size() - FUZZY_PADDING);
+	topic.length = 0;
+
+	// Copy the text right before the padding.
+	if (field->HasText()) {
+		const char *mbstr = field->Text()->GetMultiByteString();
+		topic.length = field->TextLength();
+		m_text.insert(m_text.end() - FUZZY_PADDING, mbstr,
+			mbstr + topic.length);
+	}
+
+	m_fields.Insert(field, (uint32_t)m_topics.size());
+	m_masks.push_back(CharMask(&m_text[topic.offset], topic.length));
+	m_topics.push_back(topic);
+}
+
+/**
+ * Marks a topic and all of its children as dead. Their texts are dropped the
+ * next time the index is compacted.
+ *
+ * @param field Topic to be removed.
+ */
+void FuzzyIndex::RemoveSubtree(Field *field) {
+	uint32_t slot = m_fields.Find(field);
+	if (slot != BOLOTA_FIELDTABLE_NONE)
+		RemoveTopic(field, slot);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		RemoveSubtree(child);
+}
+
+/**
+ * Marks a single topic as dead. Its mask is cleared so that it never matches.
+ *
+ * @param field Topic to be removed.
+ * @param slot  Number of the topic in the index.
+ */
+void FuzzyIndex::RemoveTopic(Field *field, uint32_t slot) {
+	m_masks[slot] = 0;
+	m_topics[slot].field = NULL;
+	m_ulDeadBytes += m_topics[slot].length;
+	m_fields.Remove(field);
+	m_ulDead++;
+}
+
+/**
+ * Drops the dead topics and their texts. Topics keep their relative order.
+ */
+void FuzzyIndex::Compact() {
+	std::vector<char> vecText;
+	std::vector<uint64_t> vecMasks;
+	std::vector<Topic> vecTopics;
+
+	vecText.reserve(m_text.size() - m_ulDeadBytes);
+	vecMasks.reserve(Count());
+	vecTopics.reserve(Count());
+	for (size_t i = 0; i < m_topics.size(); i++) {
+		if (m_topics[i].field == NULL)
+			continue;
+
+		Topic topic = m_topics[i];
+		topic.offset = (uint32_t)vecText.size();
+		vecText.insert(vecText.end(), m_text.begin() + m_topics[i].offset,
+			m_text.begin() + m_topics[i].offset + topic.length);
+		vecMasks.push_back(m_masks[i]);
+		vecTopics.push_back(topic);
+	}
+	vecText.insert(vecText.end(), FUZZY_PADDING, '\0');
+
+	// Swap in the new structures and rebuild the hash table.
+	m_text.swap(vecText);
+	m_masks.swap(vecMasks);
+	m_topics.swap(vecTopics);
+	m_ulDeadBytes = 0;
+	m_ulDead = 0;
+	m_fields.Clear();
+	m_fields.Reserve(m_topics.size());
+	for (size_t i = 0; i < m_topics.size(); i++)
+		m_fields.Insert(m_topics[i].field, (uint32_t)i);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Searching Helpers                             |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Scores a range of topics and merges the best ones into the results of the
+ * search.
+ *
+ * @param ctx     Search job.
+ * @param ulStart First topic of the range.
+ * @param ulEnd   Topic right after the last one of the range.
+ */
+void FuzzyIndex::SearchRange(void *ctx, size_t ulStart, size_t ulEnd) {
+	Job *job = static_cast<Job*>(ctx);
+	const FuzzyIndex *index = job->index;
+	const Pattern& pattern = *job->pattern;
+	const uint64_t *masks = &index->m_masks[0];
+	const Topic *topics = &index->m_topics[0];
+	const char *text = &index->m_text[0];
+	std::vector<Candidate> vecBest;
+
+	vecBest.reserve(job->ulLimit);
+	for (size_t i = ulStart; i < ulEnd; i++) {
+		// Throw out the texts that don't have every character of the query.
+		if ((masks[i] & pattern.mask) != pattern.mask)
+			continue;
+
+		// Nothing can beat a full set of perfect matches that are shorter.
+		if ((vecBest.size() == job->ulLimit) &&
+				(vecBest.front().score == pattern.best) &&
+				(vecBest.front().length <= topics[i].length)) {
+			continue;
+		}
+
+		Candidate candidate;
+		candidate.score = Score(text + topics[i].offset, topics[i].length,
+			pattern, NULL);
+		if (candidate.score == BOLOTA_FUZZY_NONE)
+			continue;
+
+		candidate.length = topics[i].length;
+		candidate.slot = (uint32_t)i;
+		Offer(vecBest, job->ulLimit, candidate);
+	}
+
+	// Merge our best with everyone else's.
+	Threads::LockMutex(&job->mutex);
+	for (size_t i = 0; i < vecBest.size(); i++)
+		Offer(job->best, job->ulLimit, vecBest[i]);
+	Threads::UnlockMutex(&job->mutex);
+}
+
+/**
+ * Checks if a candidate is better than another. Higher scores win, then
+ * shorter texts, then the topic that was added first.
+ *
+ * @param a Candidate to be checked.
+ * @param b Candidate to compare against.
+ *
+ * @return TRUE if the first candidate comes before the second.
+ */
+bool FuzzyIndex::Better(const Candidate& a, const Candidate& b) {
+	if (a.score != b.score)
+		return a.score > b.score;
+	if (a.length != b.length)
+		return a.length < b.length;
+
+	return a.slot < b.slot;
+}
+
+/**
+ * Offers a candidate to a bounded heap of the best ones, where the worst of
+ * them is at the top.
+ *
+ * @param vecBest   Heap of the best candidates.
+ * @param ulLimit   Maximum number of candidates in the heap.
+ * @param candidate Candidate to be offered.
+ */
+void FuzzyIndex::Offer(std::vector<Candidate>& vecBest, size_t ulLimit,
+					   const Candidate& candidate) {
+	if (vecBest.size() < ulLimit) {
+		vecBest.push_back(candidate);
+		std::push_heap(vecBest.begin(), vecBest.end(), Better);
+		return;
+	}
+
+	// Replace the worst of the best if it's better than it.
+	if (!Better(candidate, vecBest.front()))
+		return;
+	std::pop_heap(vecBest.begin(), vecBest.end(), Better);
+	vecBest.back() = candidate;
+	std::push_heap(vecBest.begin(), vecBest.end(), Better);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Matching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Parses a query into its characters.
+ *
+ * @param szQuery UTF-8 query to be parsed.
+ * @param pattern Pattern to be populated.
+ *
+ * @return TRUE if there's anything to search for.
+ */
+bool FuzzyIndex::ParsePattern(const char *szQuery, Pattern& pattern) {
+	size_t ulLength = strlen(szQuery);
+	size_t ulPos = 0;
+	uint8_t usBytes = 0;
+
+	pattern.count = 0;
+	pattern.mask = 0;
+	pattern.bFoldCase = true;
+	pattern.bAscii = true;
+	while ((ulPos < ulLength) && (pattern.count < BOLOTA_FUZZY_QUERY_MAX)) {
+		unsigned char c = (unsigned char)szQuery[ulPos];
+		size_t ulChar = 1;
+
+		// Figure out how long the character is.
+		if (c >= 0xF0) {
+			ulChar = 4;
+		} else if (c >= 0xE0) {
+			ulChar = 3;
+		} else if (c >= 0xC0) {
+			ulChar = 2;
+		}
+		if (ulChar > (ulLength - ulPos))
+			ulChar = ulLength - ulPos;
+
+		// Upper case letters make the search case sensitive.
+		if ((c >= 'A') && (c <= 'Z'))
+			pattern.bFoldCase = false;
+
+		if (ulChar > 1)
+			pattern.bAscii = false;
+
+		pattern.starts[pattern.count++] = usBytes;
+		for (size_t i = 0; i < ulChar; i++) {
+			pattern.bytes[usBytes++] = szQuery[ulPos + i];
+			pattern.mask |= MaskBit((unsigned char)szQuery[ulPos + i]);
+		}
+		ulPos += ulChar;
+	}
+	pattern.starts[pattern.count] = usBytes;
+
+	// Every character starting a word is as good as it gets.
+	pattern.best = (pattern.count * (SCORE_MATCH + BONUS_BOUNDARY_WHITE)) +
+		(BONUS_BOUNDARY_WHITE * (BONUS_FIRST_MULTIPLIER - 1));
+
+	// Letters match either case when ignoring it.
+	for (uint8_t i = 0; i < pattern.count; i++) {
+		char c = pattern.bytes[pattern.starts[i]];
+		pattern.alts[i] = c;
+		if (pattern.bFoldCase && (c >= 'a') && (c <= 'z'))
+			pattern.alts[i] = (char)(c - ('a' - 'A'));
+	}
+
+	return pattern.count > 0;
+}
+
+/**
+ * Gets the mask of the characters in a text.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes.
+ *
+ * @return Mask with the bit of every byte of the text set.
+ */
+uint64_t FuzzyIndex::CharMask(const char *mbstr, size_t ulLength) {
+	uint64_t mask = 0;
+
+	for (size_t i = 0; i < ulLength; i++)
+		mask |= MaskBit((unsigned char)mbstr[i]);
+
+	return mask;
+}
+
+/**
+ * Scores a text against a query the way fzf's first algorithm does. The
+ * characters of the query are found in order as early as possible, then
+ * looked for backwards from the end of that to get the shortest stretch of
+ * the text that has them all, which is what gets scored.
+ *
+ * @warning The text must be followed by at least FUZZY_PADDING bytes that can
+ *          be read.
+ *
+ * @param mbstr     UTF-8 text to be scored.
+ * @param ulLength  Length of the text in bytes.
+ * @param pattern   Query to be matched.
+ * @param positions Optional. Array to receive the byte offsets of the
+ *                  characters that were matched.
+ *
+ * @return Score of the match or BOLOTA_FUZZY_NONE if the text doesn't match.
+ */
+int32_t FuzzyIndex::Score(const char *mbstr, size_t ulLength,
+						  const Pattern& pattern, uint16_t *positions) {
+	if (pattern.bAscii && (ulLength <= 64))
+		return ScoreShort(mbstr, ulLength, pattern, positions);
+
+	return ScoreLong(mbstr, ulLength, pattern, positions);
+}
+
+/**
+ * Scores a text of up to 64 bytes against a query made only of ASCII
+ * characters. Where each character of the query appears in the text is worked
+ * out all at once as a bitmask, so finding the characters in order and the
+ * gaps between them are just a few bit operations per character.
+ *
+ * @warning The text must be followed by at least FUZZY_PADDING bytes that can
+ *          be read.
+ *
+ * @param mbstr     UTF-8 text to be scored.
+ * @param ulLength  Length of the text in bytes. Must not be over 64.
+ * @param pattern   Query to be matched.
+ * @param positions Optional. Array to receive the byte offsets of the
+ *                  characters that were matched.
+ *
+ * @return Score of the match or BOLOTA_FUZZY_NONE if the text doesn't match.
+ */
+int32_t FuzzyIndex::ScoreShort(const char *mbstr, size_t ulLength,
+							   const Pattern& pattern, uint16_t *positions) {
+	uint64_t masks[BOLOTA_FUZZY_QUERY_MAX];
+	uint64_t trail;
+	uint64_t allowed;
+	unsigned int pos = 0;
+	uint8_t i;
+
+	// Find the characters in order.
+	CharMasks(mbstr, ulLength, pattern, masks, &trail);
+	allowed = ~(uint64_t)0;
+	for (i = 0; i < pattern.count; i++) {
+		uint64_t found = masks[i] & allowed;
+		if (found == 0)
+			return BOLOTA_FUZZY_NONE;
+
+		pos = LowestBit(found);
+		allowed = (pos < 63) ? (~(uint64_t)0 << (pos + 1)) : 0;
+	}
+
+	// Go back looking for them in reverse to tighten up the match.
+	allowed = (pos < 63) ? (((uint64_t)1 << (pos + 1)) - 1) : ~(uint64_t)0;
+	for (i = pattern.count; i > 0; i--) {
+		pos = HighestBit(masks[i - 1] & allowed);
+		allowed = ((uint64_t)1 << pos) - 1;
+	}
+
+	// Score the characters from there on, with the gaps between them.
+	int32_t score = 0;
+	int32_t firstBonus = 0;
+	size_t ulConsecutive = 0;
+	unsigned int end = pos;
+	allowed = ~(uint64_t)0 << pos;
+	for (i = 0; i < pattern.count; i++) {
+		pos = LowestBit(masks[i] & allowed);
+		allowed = (pos < 63) ? (~(uint64_t)0 << (pos + 1)) : 0;
+
+		// Gaps are measured in characters, not bytes.
+		if (pos > end) {
+			uint64_t gap = (((uint64_t)1 << pos) - 1) &
+				~(((uint64_t)1 << end) - 1) & ~trail;
+			score += SCORE_GAP_START +
+				(SCORE_GAP_EXTENSION * (int32_t)(PopCount(gap) - 1));
+			ulConsecutive = 0;
+		}
+
+		uint8_t prev = (pos > 0) ?
+			CharClass((unsigned char)mbstr[pos - 1]) : CLASS_WHITE;
+		score += MatchScore(CharBonus(prev,
+			CharClass((unsigned char)mbstr[pos])), i, ulConsecutive++,
+			&firstBonus);
+		if (positions != NULL)
+			positions[i] = (uint16_t)pos;
+		end = pos + 1;
+	}
+
+	return score;
+}
+
+/**
+ * Scores a text of any length against any query, one character at a time.
+ *
+ * @warning The text must be followed by at least FUZZY_PADDING bytes that can
+ *          be read.
+ *
+ * @param mbstr     UTF-8 text to be scored.
+ * @param ulLength  Length of the text in bytes.
+ * @param pattern   Query to be matched.
+ * @param positions Optional. Array to receive the byte offsets of the
+ *                  characters that were matched.
+ *
+ * @return Score of the match or BOLOTA_FUZZY_NONE if the text doesn't match.
+ */
+int32_t FuzzyIndex::ScoreLong(const char *mbstr, size_t ulLength,
+							  const Pattern& pattern, uint16_t *positions) {
+	size_t ulPos = 0;
+	size_t ulStart;
+	size_t ulEnd;
+	uint8_t i;
+
+	// Find the characters in order.
+	for (i = 0; i < pattern.count; i++) {
+		ulPos = FindChar(mbstr, ulLength, ulPos, pattern, i);
+		if (ulPos == FUZZY_NOT_FOUND)
+			return BOLOTA_FUZZY_NONE;
+		ulPos += pattern.starts[i + 1] - pattern.starts[i];
+	}
+	ulEnd = ulPos;
+
+	// Go back looking for them in reverse to tighten up the match.
+	ulStart = ulEnd;
+	for (i = pattern.count; i > 0; i--) {
+		do {
+			ulStart--;
+		} while (!CharAt(mbstr, ulLength, ulStart, pattern, i - 1));
+	}
+
+	// Score the stretch of the text that matched.
+	uint8_t prev = (ulStart > 0) ?
+		CharClass((unsigned char)mbstr[ulStart - 1]) : CLASS_WHITE;
+	int32_t score = 0;
+	int32_t firstBonus = 0;
+	size_t ulConsecutive = 0;
+	bool bInGap = false;
+	i = 0;
+	ulPos = ulStart;
+	while (ulPos < ulEnd) {
+		uint8_t cls = CharClass((unsigned char)mbstr[ulPos]);
+
+		if ((i < pattern.count) &&
+				CharAt(mbstr, ulLength, ulPos, pattern, i)) {
+			score += MatchScore(CharBonus(prev, cls), i, ulConsecutive++,
+				&firstBonus);
+			if (positions != NULL)
+				positions[i] = (uint16_t)ulPos;
+
+			ulPos += pattern.starts[i + 1] - pattern.starts[i];
+			bInGap = false;
+			i++;
+		} else {
+			score += (bInGap) ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+			ulConsecutive = 0;
+			bInGap = true;
+
+			// Skip over the rest of the character.
+			ulPos++;
+			while ((ulPos < ulEnd) && ((mbstr[ulPos] & 0xC0) == 0x80))
+				ulPos++;
+		}
+
+		prev = cls;
+	}
+
+	return score;
+}
+
+/**
+ * Works out where each character of an ASCII query appears in a short text.
+ *
+ * @warning The text must be followed by at least FUZZY_PADDING bytes that can
+ *          be read.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes. Must not be over 64.
+ * @param pattern  Query being matched.
+ * @param masks    Array to receive a mask of the positions of each character
+ *                 of the query.
+ * @param trail    Pointer to receive a mask of the positions of the trailing
+ *                 bytes of multi-byte characters.
+ */
+void FuzzyIndex::CharMasks(const char *mbstr, size_t ulLength,
+						   const Pattern& pattern, uint64_t *masks,
+						   uint64_t *trail) {
+	uint64_t valid = (ulLength < 64) ?
+		(((uint64_t)1 << ulLength) - 1) : ~(uint64_t)0;
+	uint8_t i;
+
+	*trail = 0;
+	for (i = 0; i < pattern.count; i++)
+		masks[i] = 0;
+
+#ifdef FUZZY_HAS_SSE2
+	__m128i vtop = _mm_set1_epi8((char)0xC0);
+	__m128i vtrail = _mm_set1_epi8((char)0x80);
+	for (size_t ulPos = 0; ulPos < ulLength; ulPos += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)(mbstr + ulPos));
+
+		*trail |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_and_si128(block, vtop), vtrail)) << ulPos;
+		for (i = 0; i < pattern.count; i++) {
+			// Cases of a letter only differ by a single bit.
+			__m128i fold = _mm_set1_epi8(pattern.bytes[i] ^ pattern.alts[i]);
+			__m128i found = _mm_cmpeq_epi8(_mm_or_si128(block, fold),
+				_mm_set1_epi8(pattern.bytes[i]));
+			masks[i] |= (uint64_t)(uint32_t)_mm_movemask_epi8(found) << ulPos;
+		}
+	}
+#else
+	for (size_t ulPos = 0; ulPos < ulLength; ulPos++) {
+		char c = mbstr[ulPos];
+		uint64_t bit = (uint64_t)1 << ulPos;
+
+		if ((c & 0xC0) == 0x80)
+			*trail |= bit;
+		for (i = 0; i < pattern.count; i++) {
+			if ((c == pattern.bytes[i]) || (c == pattern.alts[i]))
+				masks[i] |= bit;
+		}
+	}
+#endif // FUZZY_HAS_SSE2
+
+	// Ignore whatever came after the text.
+	*trail &= valid;
+	for (i = 0; i < pattern.count; i++)
+		masks[i] &= valid;
+}
+
+/**
+ * Finds the next occurrence of a character of a query in a text.
+ *
+ * @warning The text must be followed by at least FUZZY_PADDING bytes that can
+ *          be read.
+ *
+ * @param mbstr    UTF-8 text to be searched.
+ * @param ulLength Length of the text in bytes.
+ * @param ulPos    Position to start looking from.
+ * @param pattern  Query being matched.
+ * @param index    Index of the character in the query.
+ *
+ * @return Position of the character or FUZZY_NOT_FOUND if it isn't there.
+ */
+size_t FuzzyIndex::FindChar(const char *mbstr, size_t ulLength, size_t ulPos,
+							const Pattern& pattern, uint8_t index) {
+	char c = pattern.bytes[pattern.starts[index]];
+	char alt = pattern.alts[index];
+
+#ifdef FUZZY_HAS_SSE2
+	__m128i vc = _mm_set1_epi8(c);
+	__m128i valt = _mm_set1_epi8(alt);
+	for (; ulPos < ulLength; ulPos += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)(mbstr + ulPos));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(block, vc), _mm_cmpeq_epi8(block, valt)));
+		if ((ulLength - ulPos) < 16)
+			mask &= ((uint32_t)1 << (ulLength - ulPos)) - 1;
+
+		// Check the rest of the bytes of the character.
+		while (mask != 0) {
+			size_t ulFound = ulPos + TrailingZeros(mask);
+			if (CharAt(mbstr, ulLength, ulFound, pattern, index))
+				return ulFound;
+			mask &= mask - 1;
+		}
+	}
+#else
+	for (; ulPos < ulLength; ulPos++) {
+		if (((mbstr[ulPos] == c) || (mbstr[ulPos] == alt)) &&
+				CharAt(mbstr, ulLength, ulPos, pattern, index)) {
+			return ulPos;
+		}
+	}
+#endif // FUZZY_HAS_SSE2
+
+	return FUZZY_NOT_FOUND;
+}
+
+/**
+ * Checks if a character of a query is at a position of a text.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes.
+ * @param ulPos    Position in the text.
+ * @param pattern  Query being matched.
+ * @param index    Index of the character in the query.
+ *
+ * @return TRUE if the character is there.
+ */
+bool FuzzyIndex::CharAt(const char *mbstr, size_t ulLength, size_t ulPos,
+						const Pattern& pattern, uint8_t index) {
+	const char *szChar = pattern.bytes + pattern.starts[index];
+	size_t ulChar = pattern.starts[index + 1] - pattern.starts[index];
+
+	if ((ulLength - ulPos) < ulChar)
+		return false;
+
+	// Only ASCII letters have their case ignored.
+	if (ulChar == 1) {
+		char c = mbstr[ulPos];
+		if (pattern.bFoldCase && (c >= 'A') && (c <= 'Z'))
+			c = (char)(c + ('a' - 'A'));
+
+		return c == *szChar;
+	}
+
+	return memcmp(mbstr + ulPos, szChar, ulChar) == 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * FuzzyIndex.h
+ * Fuzzy finder over the texts of the topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_FUZZYINDEX_H
+#define _BOLOTA_INDEXES_FUZZYINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Utilities/Threads.h"
+#include "DocumentIndex.h"
+#include "FieldTable.h"
+
+/**
+ * Maximum number of characters of a query. Anything after it is ignored.
+ */
+#define BOLOTA_FUZZY_QUERY_MAX 32
+
+/**
+ * Number of removed topics that are tolerated before the texts are compacted,
+ * on top of half the topics that are still in the index.
+ */
+#define BOLOTA_FUZZY_DEAD_MIN 1024
+
+/**
+ * Minimum number of topics worth handing over to a thread of their own.
+ */
+#define BOLOTA_FUZZY_THREAD_MIN 65536
+
+/**
+ * Score of a text that doesn't match a query.
+ */
+#define BOLOTA_FUZZY_NONE ((int32_t)(-2147483647 - 1))
+
+namespace Bolota {
+
+	/**
+	 * Topic that matched a fuzzy query along with the characters that should
+	 * be highlighted.
+	 */
+	struct FuzzyMatch {
+		Field *field;    // Topic that matched.
+		int32_t score;   // How well it matched. Higher is better.
+		uint8_t count;   // Number of characters that matched.
+		uint16_t positions[BOLOTA_FUZZY_QUERY_MAX];  // Byte offsets of the
+		                                             // characters that matched.
+	};
+
+	/**
+	 * Fuzzy finder in the style of fzf for jumping around a document. A topic
+	 * matches a query if the characters of the query appear in its text in
+	 * the same order, and the matches are scored by how close together the
+	 * characters are and how many of them start words, so "bnt" ranks "Bolota
+	 * New Topic" above "cabinet". Case is ignored unless the query has upper
+	 * case letters in it.
+	 *
+	 * Texts are copied into a single buffer next to a mask of the characters
+	 * in each of them, so that a search only has to scan contiguous memory
+	 * and most topics are thrown out with a single comparison. Characters
+	 * are looked up in the texts that are left using vector instructions
+	 * when they're available, and only the best matches are kept in a
+	 * bounded heap. Large documents are split across threads.
+	 *
+	 * Topics are numbered in the order they were added and ties are broken
+	 * by that order, which is the document order unless topics were changed
+	 * or moved around. Removed topics are only marked as dead until there
+	 * are enough of them to compact the texts.
+	 */
+	class FuzzyIndex : public DocumentIndex {
+	protected:
+		// Topic in the index.
+		struct Topic {
+			Field *field;
+			uint32_t offset;
+			uint16_t length;
+		};
+
+		// Parsed query.
+		struct Pattern {
+			char bytes[BOLOTA_FUZZY_QUERY_MAX * 4];
+			char alts[BOLOTA_FUZZY_QUERY_MAX];
+			uint8_t starts[BOLOTA_FUZZY_QUERY_MAX + 1];
+			uint8_t count;
+			uint64_t mask;
+			int32_t best;
+			bool bFoldCase;
+			bool bAscii;
+		};
+
+		// Topic that is in the running to be a result.
+		struct Candidate {
+			int32_t score;
+			uint16_t length;
+			uint32_t slot;
+		};
+
+		// State of a running search.
+		struct Job {
+			const FuzzyIndex *index;
+			const Pattern *pattern;
+			size_t ulLimit;
+			std::vector<Candidate> best;
+			thread_mutex_t mutex;
+		};
+
+		// Texts.
+		std::vector<char> m_text;
+		std::vector<uint64_t> m_masks;
+		size_t m_ulDeadBytes;
+
+		// Topics.
+		std::vector<Topic> m_topics;
+		FieldTable m_fields;
+		size_t m_ulDead;
+
+	public:
+		// Constructors and destructors.
+		FuzzyIndex();
+		virtual ~FuzzyIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Searching.
+		size_t Search(const char *szQuery, size_t ulLimit,
+			unsigned int uThreads, std::vector<FuzzyMatch>& vecResults) const;
+		size_t Search(const wchar_t *szQuery, size_t ulLimit,
+			unsigned int uThreads, std::vector<FuzzyMatch>& vecResults) const;
+
+		// Statistics.
+		size_t Count() const;
+		size_t HeapSize() const;
+
+	protected:
+		// Topic management.
+		void AddSubtree(Field *field);
+		void AddTopic(Field *field);
+		void RemoveSubtree(Field *field);
+		void RemoveTopic(Field *field, uint32_t slot);
+		void Compact();
+
+		// Searching helpers.
+		static void SearchRange(void *ctx, size_t ulStart, size_t ulEnd);
+		static bool Better(const Candidate& a, const Candidate& b);
+		static void Offer(std::vector<Candidate>& vecBest, size_t ulLimit,
+			const Candidate& candidate);
+
+		// Matching.
+		static bool ParsePattern(const char *szQuery, Pattern& pattern);
+		static uint64_t CharMask(const char *mbstr, size_t ulLength);
+		static int32_t Score(const char *mbstr, size_t ulLength,
+			const Pattern& pattern, uint16_t *positions);
+		static int32_t ScoreShort(const char *mbstr, size_t ulLength,
+			const Pattern& pattern, uint16_t *positions);
+		static int32_t ScoreLong(const char *mbstr, size_t ulLength,
+			const Pattern& pattern, uint16_t *positions);
+		static void CharMasks(const char *mbstr, size_t ulLength,
+			const Pattern& pattern, uint64_t *masks, uint64_t *trail);
+		static size_t FindChar(const char *mbstr, size_t ulLength, size_t ulPos,
+			const Pattern& pattern, uint8_t index);
+		static bool CharAt(const char *mbstr, size_t ulLength, size_t ulPos,
+			const Pattern& pattern, uint8_t index);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_FUZZYINDEX_H
@@ -0,0 +1,399 @@
+/**
+ * IdIndex.cpp
+ * Hash table that maps the stable identifiers of topics to their fields.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "IdIndex.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty identifiers index.
+ */
+IdIndex::IdIndex() {
+	Entry empty = { BOLOTA_FIELD_ID_NONE, NULL };
+
+	m_table.assign(BOLOTA_IDINDEX_SLOTS, empty);
+	m_count = 0;
+	m_nextId = 1;
+}
+
+/**
+ * Cleans up the hash table.
+ */
+IdIndex::~IdIndex() {
+	m_table.clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch. Topics keep the identifiers they already have
+ * and the ones without one (or with a duplicate) get a new identifier.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void IdIndex::Build(Field *first) {
+	Entry empty = { BOLOTA_FIELD_ID_NONE, NULL };
+	Field *field;
+
+	// Start with an empty table large enough to avoid growing it while we
+	// build, but never go back on handed out identifiers.
+	size_t ulSlots = BOLOTA_IDINDEX_SLOTS;
+	size_t ulTopics = 0;
+	for (field = first; field != NULL; field = field->Next())
+		ulTopics += CountTopics(field);
+	while ((ulSlots * 3) < (ulTopics * 4))
+		ulSlots *= 2;
+	std::vector<Entry>(ulSlots, empty).swap(m_table);
+	m_count = 0;
+
+	// Keep the existing identifiers before handing out any new ones.
+	for (field = first; field != NULL; field = field->Next())
+		Keep(field);
+	for (field = first; field != NULL; field = field->Next())
+		Register(field);
+}
+
+/**
+ * Removes every topic from the index and starts handing out identifiers from
+ * the beginning.
+ */
+void IdIndex::Clear() {
+	Entry empty = { BOLOTA_FIELD_ID_NONE, NULL };
+
+	std::vector<Entry>(BOLOTA_IDINDEX_SLOTS, empty).swap(m_table);
+	m_count = 0;
+	m_nextId = 1;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Registers a topic and all of its children, giving them an identifier if
+ * needed.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void IdIndex::TopicInserted(Field *field) {
+	Register(field);
+}
+
+/**
+ * Removes a topic and all of its children from the index. The fields keep
+ * their identifiers, so they get them back if they are inserted again.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards?
+ */
+void IdIndex::TopicRemoving(Field *field, bool bDeleting) {
+	Unregister(field);
+}
+
+/**
+ * Changing the contents of a topic doesn't change its identifier.
+ *
+ * @param field Topic that was changed.
+ */
+void IdIndex::TopicChanged(Field *field) {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Lookup                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds a topic by its identifier.
+ *
+ * @param id Identifier of the topic.
+ *
+ * @return Topic with the identifier or NULL if there's no such topic.
+ */
+Field* IdIndex::Find(field_id_t id) const {
+	if (id == BOLOTA_FIELD_ID_NONE)
+		return NULL;
+
+	return m_table[Lookup(id)].field;
+}
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics.
+ */
+size_t IdIndex::Count() const {
+	return m_count;
+}
+
+/**
+ * Gets the number of bytes allocated for the hash table.
+ *
+ * @return Size of the hash table in bytes.
+ */
+size_t IdIndex::HeapSize() const {
+	return m_table.capacity() * sizeof(Entry);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                          Identifier Generation                            |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the identifier that will be given to the next new topic.
+ *
+ * @return Next identifier to be handed out.
+ */
+field_id_t IdIndex::NextID() const {
+	return m_nextId;
+}
+
+/**
+ * Sets the identifier that will be given to the next new topic. Used when
+ * loading a document so that identifiers of deleted topics aren't reused.
+ *
+ * @warning Can't go back to an identifier that's already been handed out.
+ *
+ * @param id Next identifier to be handed out.
+ */
+void IdIndex::SetNextID(field_id_t id) {
+	if (id > m_nextId)
+		m_nextId = id;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Registration Helpers                            |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Registers the identifiers that a topic and its children already have.
+ * Duplicate identifiers are cleared so that a new one can be handed out.
+ *
+ * @param field Topic to be registered.
+ */
+void IdIndex::Keep(Field *field) {
+	field_id_t id = field->ID();
+
+	if (id != BOLOTA_FIELD_ID_NONE) {
+		if (m_table[Lookup(id)].field == NULL) {
+			Insert(id, field);
+		} else {
+			field->SetID(BOLOTA_FIELD_ID_NONE);
+		}
+	}
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		Keep(child);
+}
+
+/**
+ * Registers a topic and its children, giving them a new identifier if they
+ * don't have one yet or if theirs is being used by another topic.
+ *
+ * @param field Topic to be registered.
+ */
+void IdIndex::Register(Field *field) {
+	field_id_t id = field->ID();
+
+	if (id == BOLOTA_FIELD_ID_NONE) {
+		field->SetID(m_nextId);
+		Insert(m_nextId, field);
+	} else {
+		Field *other = m_table[Lookup(id)].field;
+		if (other == NULL) {
+			Insert(id, field);
+		} else if (other != field) {
+			field->SetID(m_nextId);
+			Insert(m_nextId, field);
+		}
+	}
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		Register(child);
+}
+
+/**
+ * Counts a topic and all of its children.
+ *
+ * @param field Topic to be counted.
+ *
+ * @return Number of topics in the subtree.
+ */
+size_t IdIndex::CountTopics(Field *field) {
+	size_t ulCount = 1;
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		ulCount += CountTopics(child);
+
+	return ulCount;
+}
+
+/**
+ * Removes a topic and its children from the hash table.
+ *
+ * @param field Topic to be removed.
+ */
+void IdIndex::Unregister(Field *field) {
+	if (Find(field->ID()) == field)
+		Remove(field->ID());
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		Unregister(child);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Hash Table Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Scrambles an identifier into a hash. Identifiers are mostly sequential, so
+ * this only has to make sure that the bits are spread around.
+ *
+ * @param id Identifier to be hashed.
+ *
+ * @return Hash of the identifier.
+ */
+uint32_t IdIndex::Hash(field_id_t id) {
+	uint32_t hash = (uint32_t)id ^ (uint32_t)(id >> 32);
+
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3BU;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+ * Looks up the slot of an identifier in the hash table.
+ *
+ * @param id Identifier to look for.
+ *
+ * @return Slot of the identifier or of the empty slot where it would go.
+ */
+size_t IdIndex::Lookup(field_id_t id) const {
+	size_t mask = m_table.size() - 1;
+	size_t slot = Hash(id) & mask;
+
+	while ((m_table[slot].field != NULL) && (m_table[slot].id != id))
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+/**
+ * Inserts an identifier that isn't in the hash table yet.
+ *
+ * @param id    Identifier of the topic.
+ * @param field Topic with the identifier.
+ */
+void IdIndex::Insert(field_id_t id, Field *field) {
+	// Keep the load factor under 75%. Identifiers hash very evenly, so this
+	// keeps probe sequences short without wasting too much memory.
+	if ((m_count + 1) * 4 > m_table.size() * 3)
+		Rebuild(m_table.size() * 2);
+
+	size_t slot = Lookup(id);
+	m_table[slot].id = id;
+	m_table[slot].field = field;
+	m_count++;
+
+	// Never hand out an identifier that's been used.
+	if (id >= m_nextId)
+		m_nextId = id + 1;
+}
+
+/**
+ * Removes an identifier from the hash table, shifting back the entries that
+ * follow it so that no tombstones are needed.
+ *
+ * @param id Identifier to be removed.
+ */
+void IdIndex::Remove(field_id_t id) {
+	size_t mask = m_table.size() - 1;
+	size_t slot = Lookup(id);
+	size_t next = slot;
+
+	if (m_table[slot].field == NULL)
+		return;
+
+	while (true) {
+		m_table[slot].field = NULL;
+
+		// Find the next entry that can take the slot that's been emptied.
+		while (true) {
+			next = (next + 1) & mask;
+			if (m_table[next].field == NULL) {
+				m_count--;
+				return;
+			}
+
+			// Entries can only move back towards their home slot.
+			size_t home = Hash(m_table[next].id) & mask;
+			if (((next - home) & mask) >= ((next - slot) & mask))
+				break;
+		}
+
+		m_table[slot] = m_table[next];
+		slot = next;
+	}
+}
+
+/**
+ * Rebuilds the hash table with a different number of slots.
+ *
+ * @param ulSlots Number of slots of the new table. (must be a power of 2)
+ */
+void IdIndex::Rebuild(size_t ulSlots) {
+	Entry empty = { BOLOTA_FIELD_ID_NONE, NULL };
+	std::vector<Entry> vecOld(ulSlots, empty);
+
+	// Reinsert every entry in the new table.
+	vecOld.swap(m_table);
+	size_t mask = m_table.size() - 1;
+	for (size_t i = 0; i < vecOld.size(); i++) {
+		if (vecOld[i].field == NULL)
+			continue;
+
+		size_t slot = Hash(vecOld[i].id) & mask;
+		while (m_table[slot].field != NULL)
+			slot = (slot + 1) & mask;
+		m_table[slot] = vecOld[i];
+	}
+}
@@ -0,0 +1,98 @@
+/**
+ * IdIndex.h
+ * Hash table that maps the stable identifiers of topics to their fields.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_IDINDEX_H
+#define _BOLOTA_INDEXES_IDINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "DocumentIndex.h"
+
+/**
+ * Initial number of slots in the identifiers hash table. (must be a power of 2)
+ */
+#define BOLOTA_IDINDEX_SLOTS 256
+
+namespace Bolota {
+
+	/**
+	 * Hash table that maps the stable identifiers of topics to their fields,
+	 * allowing a topic to be found in constant time from its identifier.
+	 *
+	 * The index is also responsible for handing out identifiers. Topics that
+	 * are inserted without one (or with one that's already taken by another
+	 * topic) get a brand new identifier, while topics that are only being
+	 * moved around keep theirs. Identifiers are never reused, even after the
+	 * topic that had it is deleted.
+	 */
+	class IdIndex : public DocumentIndex {
+	protected:
+		// Slot of the open addressing hash table.
+		struct Entry {
+			field_id_t id;
+			Field *field;
+		};
+
+		// Hash table.
+		std::vector<Entry> m_table;
+		size_t m_count;
+
+		// Identifier to be handed out next.
+		field_id_t m_nextId;
+
+	public:
+		// Constructors and destructors.
+		IdIndex();
+		virtual ~IdIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Lookup.
+		Field* Find(field_id_t id) const;
+		size_t Count() const;
+		size_t HeapSize() const;
+
+		// Identifier generation.
+		field_id_t NextID() const;
+		void SetNextID(field_id_t id);
+
+	protected:
+		// Registration helpers.
+		void Keep(Field *field);
+		void Register(Field *field);
+		void Unregister(Field *field);
+		static size_t CountTopics(Field *field);
+
+		// Hash table helpers.
+		static uint32_t Hash(field_id_t id);
+		size_t Lookup(field_id_t id) const;
+		void Insert(field_id_t id, Field *field);
+		void Remove(field_id_t id);
+		void Rebuild(size_t ulSlots);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_IDINDEX_H
@@ -0,0 +1,360 @@
+/**
+ * NotebookDateIndex.cpp
+ * Sorted index of the timestamps of the date topics of a whole directory of
+ * documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "NotebookDateIndex.h"
+
+#include "../Errors/ErrorCollection.h"
+#include "../FlatDocument.h"
+#include "DateIndex.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty notebook date index.
+ */
+NotebookDateIndex::NotebookDateIndex() {
+	m_bRecursive = false;
+}
+
+/**
+ * Frees up the tree of timestamps and the list of documents.
+ */
+NotebookDateIndex::~NotebookDateIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch with the documents in a directory.
+ *
+ * @param szPath     Path to the directory of the notebook.
+ * @param bRecursive Should documents in subdirectories be included as well?
+ *
+ * @return Number of documents that were read or BOLOTA_ERR_SIZET if the
+ *         directory couldn't be listed.
+ */
+size_t NotebookDateIndex::Build(LPCTSTR szPath, bool bRecursive) {
+	Clear();
+	m_strPath = szPath;
+	m_bRecursive = bRecursive;
+
+	return Refresh();
+}
+
+/**
+ * Brings the index up to date with the directory of the notebook, only reading
+ * the documents that were added or changed since the last time.
+ *
+ * @return Number of documents that were read or BOLOTA_ERR_SIZET if the
+ *         directory couldn't be listed.
+ */
+size_t NotebookDateIndex::Refresh() {
+	std::vector<tstring> vecFiles;
+	size_t ulRead = 0;
+	uint32_t i;
+
+	// Get the documents that are in the notebook right now.
+	if (!FileUtils::ListFiles(m_strPath.c_str(), BOLOTA_NOTEBOOK_EXT,
+			m_bRecursive, vecFiles)) {
+		ThrowError(new SystemError(EMSG("Could not list the notebook ")
+			_T("directory")));
+		return BOLOTA_ERR_SIZET;
+	}
+	std::vector<bool> vecSeen(m_records.size(), false);
+
+	// Read the documents that are new or were changed.
+	for (size_t j = 0; j < vecFiles.size(); j++) {
+		std::map<tstring, uint32_t>::iterator it = m_paths.find(vecFiles[j]);
+		file_info_t info;
+
+		if (it == m_paths.end()) {
+			// Never seen this document before.
+			Record record;
+			record.path = vecFiles[j];
+			record.info.size = 0;
+			record.info.modified = 0;
+			record.bPresent = true;
+			record.bFailed = false;
+
+			uint32_t index = (uint32_t)m_records.size();
+			m_records.push_back(record);
+			m_paths[vecFiles[j]] = index;
+			vecSeen.push_back(true);
+			IndexFile(index);
+			ulRead++;
+		} else {
+			// Only read it again if it was changed or had been removed.
+			Record& record = m_records[it->second];
+			vecSeen[it->second] = true;
+			if (!record.bPresent ||
+					!FileUtils::GetInfo(record.path.c_str(), &info) ||
+					(info.size != record.info.size) ||
+					(info.modified != record.info.modified)) {
+				record.bPresent = true;
+				UnindexFile(it->second);
+				IndexFile(it->second);
+				ulRead++;
+			}
+		}
+	}
+
+	// Drop the documents that are gone and take note of the broken ones.
+	m_failed.clear();
+	for (i = 0; i < m_records.size(); i++) {
+		if (!vecSeen[i]) {
+			UnindexFile(i);
+			m_records[i].bPresent = false;
+		} else if (m_records[i].bFailed) {
+			m_failed.push_back(i);
+		}
+	}
+
+	return ulRead;
+}
+
+/**
+ * Removes every document and topic from the index.
+ */
+void NotebookDateIndex::Clear() {
+	m_dates.clear();
+	std::vector<Record>().swap(m_records);
+	m_paths.clear();
+	m_failed.clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the date topics whose timestamps fall within a range of time.
+ *
+ * @param from       Earliest timestamp. (inclusive)
+ * @param to         Latest timestamp. (inclusive)
+ * @param vecResults Vector to receive the topics in chronological order. Their
+ *                   texts are valid until the index is changed.
+ *
+ * @return Number of topics found.
+ */
+size_t NotebookDateIndex::Between(const timestamp_t *from,
+								  const timestamp_t *to,
+								  std::vector<DatedTopic>& vecResults) const {
+	uint64_t ullFrom = DateIndex::Key(from);
+	uint64_t ullTo = DateIndex::Key(to);
+
+	vecResults.clear();
+	if (ullFrom > ullTo)
+		return 0;
+
+	EntryMap::const_iterator end = m_dates.upper_bound(ullTo);
+	for (EntryMap::const_iterator it = m_dates.lower_bound(ullFrom);
+			it != end; ++it) {
+		vecResults.push_back(MakeResult(it->second));
+	}
+
+	return vecResults.size();
+}
+
+/**
+ * Finds the most recent date topics.
+ *
+ * @param ulCount    Maximum number of topics to get.
+ * @param vecResults Vector to receive the topics, the most recent first. Their
+ *                   texts are valid until the index is changed.
+ *
+ * @return Number of topics found.
+ */
+size_t NotebookDateIndex::Latest(size_t ulCount,
+								 std::vector<DatedTopic>& vecResults) const {
+	vecResults.clear();
+
+	EntryMap::const_reverse_iterator it = m_dates.rbegin();
+	for (; (it != m_dates.rend()) && (vecResults.size() < ulCount); ++it)
+		vecResults.push_back(MakeResult(it->second));
+
+	return vecResults.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Documents                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of documents the index has ever known about, including the
+ * ones that have since been removed.
+ *
+ * @return Number of documents.
+ */
+size_t NotebookDateIndex::FileCount() const {
+	return m_records.size();
+}
+
+/**
+ * Gets the path to a document of the notebook.
+ *
+ * @param index Index of the document.
+ *
+ * @return Path to the document.
+ */
+LPCTSTR NotebookDateIndex::File(size_t index) const {
+	return m_records[index].path.c_str();
+}
+
+/**
+ * Checks if a document was still in the notebook the last time it was
+ * refreshed.
+ *
+ * @param index Index of the document.
+ *
+ * @return TRUE if the document is part of the notebook.
+ */
+bool NotebookDateIndex::IsFilePresent(size_t index) const {
+	return m_records[index].bPresent;
+}
+
+/**
+ * Gets the documents of the notebook that couldn't be read.
+ *
+ * @return Indexes of the documents, in order.
+ */
+const std::vector<size_t>& NotebookDateIndex::FailedFiles() const {
+	return m_failed;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of date topics in the index.
+ *
+ * @return Number of date topics.
+ */
+size_t NotebookDateIndex::Count() const {
+	return m_dates.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Document Management                             |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Reads a document and adds its date topics to the index. Documents that
+ * can't be read are flagged as failed and the errors they threw are
+ * discarded, since they're reported through FailedFiles.
+ *
+ * @param index Index of the document.
+ */
+void NotebookDateIndex::IndexFile(uint32_t index) {
+	Record& record = m_records[index];
+	Error *top = ErrorStack::Top();
+
+	// Remember the state of the file before reading it, so that changes made
+	// while we're at it get picked up by the next refresh.
+	record.bFailed = false;
+	if (!FileUtils::GetInfo(record.path.c_str(), &record.info)) {
+		record.info.size = 0;
+		record.info.modified = 0;
+	}
+
+	// Read the document.
+	FlatDocument *doc = FlatDocument::ReadFile(record.path.c_str());
+	if (doc == BOLOTA_ERR_NULL) {
+		while ((ErrorStack::Top() != NULL) && (ErrorStack::Top() != top))
+			ErrorStack::Instance()->Pop();
+		record.bFailed = true;
+		return;
+	}
+
+	// Add its date topics to the tree.
+	for (uint32_t i = 0; i < doc->Count(); i++) {
+		if (doc->Type(i) != BOLOTA_TYPE_DATE)
+			continue;
+
+		Entry entry;
+		entry.file = index;
+		entry.topic = i;
+		entry.timestamp = doc->Timestamp(i);
+		entry.text.assign(doc->Text(i), doc->TextLength(i));
+		record.entries.push_back(m_dates.insert(EntryMap::value_type(
+			DateIndex::Key(&entry.timestamp), entry)));
+	}
+
+	delete doc;
+}
+
+/**
+ * Removes the date topics of a document from the index.
+ *
+ * @param index Index of the document.
+ */
+void NotebookDateIndex::UnindexFile(uint32_t index) {
+	Record& record = m_records[index];
+
+	for (size_t i = 0; i < record.entries.size(); i++)
+		m_dates.erase(record.entries[i]);
+	std::vector<EntryMap::iterator>().swap(record.entries);
+	record.bFailed = false;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Searching Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds up a search result from a date topic in the tree.
+ *
+ * @param entry Date topic in the tree.
+ *
+ * @return Search result.
+ */
+DatedTopic NotebookDateIndex::MakeResult(const Entry& entry) {
+	DatedTopic result;
+
+	result.file = entry.file;
+	result.topic = entry.topic;
+	result.timestamp = entry.timestamp;
+	result.text = entry.text.c_str();
+
+	return result;
+}
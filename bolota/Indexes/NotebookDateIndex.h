@@ -0,0 +1,126 @@
+/**
+ * NotebookDateIndex.h
+ * Sorted index of the timestamps of the date topics of a whole directory of
+ * documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_NOTEBOOKDATEINDEX_H
+#define _BOLOTA_INDEXES_NOTEBOOKDATEINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Utilities/FileUtils.h"
+#include "../DateField.h"
+
+/**
+ * Extension of the files that make up a notebook.
+ */
+#define BOLOTA_NOTEBOOK_EXT _T(".bol")
+
+namespace Bolota {
+
+	/**
+	 * Date topic found in one of the documents of a notebook.
+	 */
+	struct DatedTopic {
+		uint32_t file;          // Index of the document in the notebook.
+		uint32_t topic;         // Pre-order index of the topic in the document.
+		timestamp_t timestamp;  // Timestamp of the topic.
+		const char *text;       // UTF-8 text of the topic.
+	};
+
+	/**
+	 * Sorted index of the timestamps of the date topics of every document in
+	 * a directory (a notebook), which answers which topics fall in a range of
+	 * time or are the most recent ones in logarithmic time plus the number of
+	 * results.
+	 *
+	 * Documents are read without building their trees and only their date
+	 * topics are kept. The size and modification time of each document is
+	 * remembered, so refreshing the index only reads the documents that were
+	 * added or changed since and drops the ones that were removed. Documents
+	 * keep their index for as long as the object lives.
+	 */
+	class NotebookDateIndex {
+	protected:
+		// Date topic in the tree.
+		struct Entry {
+			uint32_t file;
+			uint32_t topic;
+			timestamp_t timestamp;
+			std::string text;
+		};
+
+		// Document of the notebook.
+		typedef std::multimap<uint64_t, Entry> EntryMap;
+		struct Record {
+			tstring path;
+			file_info_t info;
+			bool bPresent;
+			bool bFailed;
+			std::vector<EntryMap::iterator> entries;
+		};
+
+		// Notebook.
+		tstring m_strPath;
+		bool m_bRecursive;
+		std::vector<Record> m_records;
+		std::map<tstring, uint32_t> m_paths;
+		std::vector<size_t> m_failed;
+
+		// Tree of the timestamps.
+		EntryMap m_dates;
+
+	public:
+		// Constructors and destructors.
+		NotebookDateIndex();
+		virtual ~NotebookDateIndex();
+
+		// Building.
+		size_t Build(LPCTSTR szPath, bool bRecursive);
+		size_t Refresh();
+		void Clear();
+
+		// Searching.
+		size_t Between(const timestamp_t *from, const timestamp_t *to,
+			std::vector<DatedTopic>& vecResults) const;
+		size_t Latest(size_t ulCount,
+			std::vector<DatedTopic>& vecResults) const;
+
+		// Documents.
+		size_t FileCount() const;
+		LPCTSTR File(size_t index) const;
+		bool IsFilePresent(size_t index) const;
+		const std::vector<size_t>& FailedFiles() const;
+
+		// Statistics.
+		size_t Count() const;
+
+	protected:
+		// Document management.
+		void IndexFile(uint32_t index);
+		void UnindexFile(uint32_t index);
+
+		// Searching helpers.
+		static DatedTopic MakeResult(const Entry& entry);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_NOTEBOOKDATEINDEX_H
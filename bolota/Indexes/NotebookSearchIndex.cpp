@@ -0,0 +1,1074 @@
+/**
+ * NotebookSearchIndex.cpp
+ * Persistent index of the words in the topics of a whole directory of
+ * documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "NotebookSearchIndex.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "../Errors/ErrorCollection.h"
+#include "../FlatDocument.h"
+#include "../UString.h"
+#include "TrigramIndex.h"
+
+using namespace Bolota;
+
+// Index of a document that isn't in the index.
+#define BOLOTA_SEARCH_NONE ((uint32_t)-1)
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs a closed notebook search index.
+ */
+NotebookSearchIndex::NotebookSearchIndex() {
+	m_map.data = NULL;
+	m_map.size = 0;
+#ifdef _WIN32
+	m_map.hFile = NULL;
+	m_map.hMapping = NULL;
+#endif // _WIN32
+	m_hdr = NULL;
+	m_files = NULL;
+	m_terms = NULL;
+	m_postings = NULL;
+	m_strings = NULL;
+}
+
+/**
+ * Unmaps the index file.
+ */
+NotebookSearchIndex::~NotebookSearchIndex() {
+	Close();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Opens the index file of a notebook for searching.
+ *
+ * @param szPath Path to the directory of the notebook.
+ *
+ * @return TRUE if the index file exists and is valid.
+ */
+bool NotebookSearchIndex::Open(LPCTSTR szPath) {
+	Close();
+	m_strPath = szPath;
+
+	return Load();
+}
+
+/**
+ * Brings the index file of a notebook up to date with its directory, or
+ * creates it if there isn't a valid one yet. Only the documents that were
+ * added or changed since the last time are read, and the index file is left
+ * untouched if nothing changed at all. The index is left open for searching.
+ *
+ * @param szPath     Path to the directory of the notebook.
+ * @param bRecursive Should documents in subdirectories be included as well?
+ *
+ * @return Number of documents that were read or BOLOTA_ERR_SIZET if the
+ *         directory couldn't be listed or the index couldn't be written.
+ */
+size_t NotebookSearchIndex::Refresh(LPCTSTR szPath, bool bRecursive) {
+	std::vector<tstring> vecFiles;
+	std::vector<Record> vecRecords;
+	Error *top = ErrorStack::Top();
+	size_t ulRead = 0;
+	uint32_t i;
+
+	// Start from the index we already have, if there's a valid one.
+	if (!Open(szPath)) {
+		while ((ErrorStack::Top() != NULL) && (ErrorStack::Top() != top))
+			ErrorStack::Instance()->Pop();
+	}
+
+	// Get the documents that are in the notebook right now.
+	if (!FileUtils::ListFiles(m_strPath.c_str(), BOLOTA_NOTEBOOK_EXT,
+			bRecursive, vecFiles)) {
+		ThrowError(new SystemError(EMSG("Could not list the notebook ")
+			_T("directory")));
+		return BOLOTA_ERR_SIZET;
+	}
+	vecRecords.resize(vecFiles.size());
+	for (i = 0; i < vecRecords.size(); i++) {
+		Record& record = vecRecords[i];
+		record.path = vecFiles[i];
+		record.relative = RelativePath(record.path);
+		record.hash = 0;
+		record.bIndex = true;
+		record.bFailed = false;
+	}
+	std::sort(vecRecords.begin(), vecRecords.end(), RecordLess);
+
+	// Check which documents can be carried over from the old index.
+	std::vector<uint32_t> vecRemap(FileCount(), BOLOTA_SEARCH_NONE);
+	bool bChanged = !IsOpen() || (vecRecords.size() != FileCount());
+	for (i = 0; i < vecRecords.size(); i++) {
+		Record& record = vecRecords[i];
+
+		// Remember the state of the file before reading it, so that changes
+		// made while we're at it get picked up by the next refresh.
+		if (!FileUtils::GetInfo(record.path.c_str(), &record.info)) {
+			record.info.size = 0;
+			record.info.modified = 0;
+		}
+
+		// Documents that weren't touched are taken at their word.
+		uint32_t prev = FindFile(record.relative);
+		if (prev != BOLOTA_SEARCH_NONE) {
+			const bolota_search_file_t& file = m_files[prev];
+			if ((Join(file.size) == record.info.size) &&
+					(Join(file.modified) == record.info.modified)) {
+				record.hash = Join(file.hash);
+				record.bFailed = (file.flags & BOLOTA_SEARCH_FAILED) != 0;
+				record.bIndex = false;
+				vecRemap[prev] = i;
+				if (prev != i)
+					bChanged = true;
+				continue;
+			}
+		}
+
+		// Documents that were touched only need to be parsed if their
+		// contents actually changed.
+		bool bRead = false;
+		record.hash = HashFile(record.path.c_str(), &bRead);
+		bChanged = true;
+		ulRead++;
+		if ((prev != BOLOTA_SEARCH_NONE) && bRead &&
+				(Join(m_files[prev].size) == record.info.size) &&
+				(Join(m_files[prev].hash) == record.hash) &&
+				!(m_files[prev].flags & BOLOTA_SEARCH_FAILED)) {
+			record.bIndex = false;
+			vecRemap[prev] = i;
+		}
+	}
+
+	// Nothing to be written if the index is already up to date.
+	if (!bChanged)
+		return ulRead;
+
+	// Gather up the terms of the old documents and read the new ones.
+	TermTable terms;
+	CopyPostings(vecRemap, terms);
+	for (i = 0; i < vecRecords.size(); i++) {
+		if (vecRecords[i].bIndex)
+			vecRecords[i].bFailed = !IndexFile(vecRecords[i], i, terms);
+	}
+
+	// Replace the index file.
+	if (!Save(vecRecords, terms))
+		return BOLOTA_ERR_SIZET;
+
+	return ulRead;
+}
+
+/**
+ * Unmaps the index file.
+ */
+void NotebookSearchIndex::Close() {
+	FileUtils::UnmapFile(&m_map);
+	m_hdr = NULL;
+	m_files = NULL;
+	m_terms = NULL;
+	m_postings = NULL;
+	m_strings = NULL;
+	m_failed.clear();
+}
+
+/**
+ * Checks if an index file is open for searching.
+ *
+ * @return TRUE if the index is open.
+ */
+bool NotebookSearchIndex::IsOpen() const {
+	return m_hdr != NULL;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the topics that contain every term of a query.
+ *
+ * @param szQuery    UTF-8 query.
+ * @param vecResults Vector to receive the topics, sorted by document and then
+ *                   by topic.
+ *
+ * @return Number of topics found.
+ */
+size_t NotebookSearchIndex::Search(const char *szQuery,
+								   std::vector<NotebookHit>& vecResults) const {
+	std::vector<const bolota_search_term_t*> vecLists;
+	std::vector<std::string> vecTerms;
+	size_t i;
+
+	vecResults.clear();
+	if (!IsOpen())
+		return 0;
+
+	// Look up the terms of the query. A single one missing is enough to know
+	// there are no results.
+	Tokenize(szQuery, strlen(szQuery), vecTerms);
+	std::sort(vecTerms.begin(), vecTerms.end());
+	vecTerms.erase(std::unique(vecTerms.begin(), vecTerms.end()),
+		vecTerms.end());
+	if (vecTerms.empty())
+		return 0;
+	for (i = 0; i < vecTerms.size(); i++) {
+		const bolota_search_term_t *term = FindTerm(vecTerms[i]);
+		if (term == NULL)
+			return 0;
+		vecLists.push_back(term);
+	}
+	std::sort(vecLists.begin(), vecLists.end(), Rarer);
+
+	// Start with the postings of the rarest term.
+	std::vector<bolota_search_posting_t> vecHits(
+		m_postings + vecLists[0]->first,
+		m_postings + vecLists[0]->first + vecLists[0]->count);
+
+	// Only keep the topics that show up in the postings of every other term,
+	// looking for each one after where the last one was found.
+	for (i = 1; (i < vecLists.size()) && !vecHits.empty(); i++) {
+		const bolota_search_posting_t *pos = m_postings + vecLists[i]->first;
+		const bolota_search_posting_t *end = pos + vecLists[i]->count;
+		size_t ulKept = 0;
+
+		for (size_t j = 0; j < vecHits.size(); j++) {
+			pos = std::lower_bound(pos, end, vecHits[j], PostingLess);
+			if (pos == end)
+				break;
+			if (!PostingLess(vecHits[j], *pos))
+				vecHits[ulKept++] = vecHits[j];
+		}
+		vecHits.resize(ulKept);
+	}
+
+	// Build up the results, leaving out anything a broken file points to.
+	vecResults.reserve(vecHits.size());
+	for (i = 0; i < vecHits.size(); i++) {
+		if (vecHits[i].file >= m_hdr->files)
+			continue;
+
+		NotebookHit hit;
+		hit.file = vecHits[i].file;
+		hit.topic = vecHits[i].topic;
+		vecResults.push_back(hit);
+	}
+
+	return vecResults.size();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Documents                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of documents in the index, including the ones that couldn't
+ * be read.
+ *
+ * @return Number of documents.
+ */
+size_t NotebookSearchIndex::FileCount() const {
+	return (IsOpen()) ? m_hdr->files : 0;
+}
+
+/**
+ * Gets the path to a document of the notebook.
+ *
+ * @param index Index of the document.
+ *
+ * @return Path to the document.
+ */
+tstring NotebookSearchIndex::File(size_t index) const {
+	const bolota_search_file_t& file = m_files[index];
+	std::string strRelative(m_strings + file.path, file.length);
+	UString str(strRelative.c_str());
+
+	return IndexPath(str.GetNativeString());
+}
+
+/**
+ * Gets the documents of the notebook that couldn't be read.
+ *
+ * @return Indexes of the documents, in order.
+ */
+const std::vector<size_t>& NotebookSearchIndex::FailedFiles() const {
+	return m_failed;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of distinct terms in the index.
+ *
+ * @return Number of terms.
+ */
+size_t NotebookSearchIndex::TermCount() const {
+	return (IsOpen()) ? m_hdr->terms : 0;
+}
+
+/**
+ * Gets the number of postings in the index, which is the number of times a
+ * term shows up in a topic.
+ *
+ * @return Number of postings.
+ */
+size_t NotebookSearchIndex::PostingCount() const {
+	return (IsOpen()) ? m_hdr->postings : 0;
+}
+
+/**
+ * Gets the size of the index file.
+ *
+ * @return Size of the index file in bytes.
+ */
+size_t NotebookSearchIndex::FileSize() const {
+	return m_map.size;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Terms                                    |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Splits a text into the terms that go into the index. Terms are runs of ASCII
+ * letters and digits and bytes outside of ASCII, with the ASCII letters in
+ * lower case. Terms longer than BOLOTA_SEARCH_TERM_MAX are cut short without
+ * breaking up a UTF-8 character.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes.
+ * @param vecTerms Vector to append the terms to, in the order they appear.
+ */
+void NotebookSearchIndex::Tokenize(const char *mbstr, size_t ulLength,
+								   std::vector<std::string>& vecTerms) {
+	char szTerm[BOLOTA_SEARCH_TERM_MAX];
+	size_t ulPos = 0;
+	size_t ulTerm;
+
+	while ((ulTerm = NextTerm(mbstr, ulLength, &ulPos, szTerm)) > 0)
+		vecTerms.push_back(std::string(szTerm, ulTerm));
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Index File                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Maps the index file of the notebook into memory and checks that everything
+ * in it stays within the file.
+ *
+ * @return TRUE if the index file was mapped and is valid.
+ */
+bool NotebookSearchIndex::Load() {
+	tstring strIndex = IndexPath(BOLOTA_SEARCH_INDEX_FILE);
+	uint64_t ullLength;
+	uint32_t i;
+
+	// Map the file.
+	if (!FileUtils::MapFile(strIndex.c_str(), &m_map)) {
+		ThrowError(new SystemError(EMSG("Could not open the notebook search ")
+			_T("index")));
+		return false;
+	}
+
+	// Check the header.
+	const bolota_search_hdr_t *hdr = (const bolota_search_hdr_t*)m_map.data;
+	if (m_map.size < sizeof(bolota_search_hdr_t))
+		goto error_handling;
+	if (memcmp(hdr->magic, BOLOTA_SEARCH_MAGIC, 4) ||
+			(hdr->version != BOLOTA_SEARCH_VERSION)) {
+		goto error_handling;
+	}
+	ullLength = sizeof(bolota_search_hdr_t) +
+		((uint64_t)hdr->files * sizeof(bolota_search_file_t)) +
+		((uint64_t)hdr->terms * sizeof(bolota_search_term_t)) +
+		((uint64_t)hdr->postings * sizeof(bolota_search_posting_t)) +
+		hdr->strings;
+	if (ullLength != m_map.size)
+		goto error_handling;
+
+	// Find the tables.
+	m_files = (const bolota_search_file_t*)(hdr + 1);
+	m_terms = (const bolota_search_term_t*)(m_files + hdr->files);
+	m_postings = (const bolota_search_posting_t*)(m_terms + hdr->terms);
+	m_strings = (const char*)(m_postings + hdr->postings);
+
+	// Check that the tables only point to what's in the file.
+	for (i = 0; i < hdr->files; i++) {
+		if (((uint64_t)m_files[i].path + m_files[i].length) > hdr->strings)
+			goto error_handling;
+		if (m_files[i].flags & BOLOTA_SEARCH_FAILED)
+			m_failed.push_back(i);
+	}
+	for (i = 0; i < hdr->terms; i++) {
+		if ((((uint64_t)m_terms[i].text + m_terms[i].length) > hdr->strings) ||
+				(((uint64_t)m_terms[i].first + m_terms[i].count) >
+				hdr->postings)) {
+			goto error_handling;
+		}
+	}
+
+	m_hdr = hdr;
+	return true;
+
+error_handling:
+	Close();
+	ThrowError(EMSG("Invalid notebook search index"));
+	return false;
+}
+
+/**
+ * Writes a new index file and opens it in place of the old one.
+ *
+ * @param vecRecords Documents of the notebook, sorted by their paths.
+ * @param terms      Terms and their postings, in any order. They're consumed
+ *                   in the process.
+ *
+ * @return TRUE if the index file was written.
+ */
+bool NotebookSearchIndex::Save(const std::vector<Record>& vecRecords,
+							   TermTable& terms) {
+	std::vector<bolota_search_file_t> vecFiles(vecRecords.size());
+	std::vector<std::pair<std::string, uint32_t> > vecOrder;
+	std::vector<bolota_search_term_t> vecTerms;
+	std::vector<bolota_search_posting_t> vecPostings;
+	std::vector<uint32_t> vecNext;
+	bolota_search_hdr_t hdr;
+	std::string strPool;
+	size_t ulBytes = 0;
+	fsize_t dwWritten = 0;
+	size_t i;
+
+	if ((terms.postings.size() > 0xFFFFFFFF) ||
+			(vecRecords.size() > 0xFFFFFFFF)) {
+		ThrowError(EMSG("Notebook too large for the search index"));
+		return false;
+	}
+
+	// Build up the documents table.
+	for (i = 0; i < vecRecords.size(); i++) {
+		const Record& record = vecRecords[i];
+		bolota_search_file_t& file = vecFiles[i];
+
+		if (record.relative.size() > 0xFFFF) {
+			ThrowError(EMSG("Document path too long for the notebook search ")
+				_T("index"));
+			return false;
+		}
+		Split(record.info.size, file.size);
+		Split(record.info.modified, file.modified);
+		Split(record.hash, file.hash);
+		file.path = (uint32_t)strPool.size();
+		file.length = (uint16_t)record.relative.size();
+		file.flags = (record.bFailed) ? BOLOTA_SEARCH_FAILED : 0;
+		strPool += record.relative;
+	}
+
+	// Sort the terms and count their postings.
+	vecOrder.resize(terms.texts.size());
+	for (i = 0; i < terms.texts.size(); i++) {
+		vecOrder[i].first.swap(terms.texts[i]);
+		vecOrder[i].second = (uint32_t)i;
+	}
+	std::sort(vecOrder.begin(), vecOrder.end());
+	std::vector<uint32_t> vecRank(vecOrder.size());
+	for (i = 0; i < vecOrder.size(); i++)
+		vecRank[vecOrder[i].second] = (uint32_t)i;
+	vecTerms.resize(vecOrder.size());
+	for (i = 0; i < vecTerms.size(); i++)
+		vecTerms[i].count = 0;
+	for (i = 0; i < terms.postings.size(); i++)
+		vecTerms[vecRank[terms.postings[i].term]].count++;
+
+	// Build up the terms table.
+	uint32_t first = 0;
+	vecNext.resize(vecTerms.size());
+	for (i = 0; i < vecTerms.size(); i++) {
+		if (strPool.size() > (0xFFFFFFFF - vecOrder[i].first.size())) {
+			ThrowError(EMSG("Notebook too large for the search index"));
+			return false;
+		}
+
+		vecTerms[i].text = (uint32_t)strPool.size();
+		vecTerms[i].length = (uint32_t)vecOrder[i].first.size();
+		vecTerms[i].first = first;
+		vecNext[i] = first;
+		strPool += vecOrder[i].first;
+		first += vecTerms[i].count;
+	}
+
+	// Group the postings by term, keeping them sorted within each term.
+	vecPostings.resize(terms.postings.size());
+	for (i = 0; i < terms.postings.size(); i++) {
+		const TermPosting& posting = terms.postings[i];
+		bolota_search_posting_t& moved =
+			vecPostings[vecNext[vecRank[posting.term]]++];
+		moved.file = posting.file;
+		moved.topic = posting.topic;
+	}
+	std::vector<TermPosting>().swap(terms.postings);
+	for (i = 0; i < vecTerms.size(); i++) {
+		bolota_search_posting_t *begin = &vecPostings[0] + vecTerms[i].first;
+		bolota_search_posting_t *end = begin + vecTerms[i].count;
+
+		for (bolota_search_posting_t *posting = begin + 1; posting < end;
+				posting++) {
+			if (PostingLess(*posting, *(posting - 1))) {
+				std::sort(begin, end, PostingLess);
+				break;
+			}
+		}
+	}
+
+	// Write everything to a temporary file.
+	tstring strTemp = IndexPath(BOLOTA_SEARCH_INDEX_TEMP);
+	FHND hFile = FileUtils::Open(strTemp.c_str(), true, true);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		ThrowError(new SystemError(EMSG("Could not open the notebook search ")
+			_T("index for writing")));
+		return false;
+	}
+	memcpy(hdr.magic, BOLOTA_SEARCH_MAGIC, 4);
+	hdr.version = BOLOTA_SEARCH_VERSION;
+	hdr.files = (uint32_t)vecFiles.size();
+	hdr.terms = (uint32_t)vecTerms.size();
+	hdr.postings = (uint32_t)vecPostings.size();
+	hdr.strings = (uint32_t)strPool.size();
+	if (!FileUtils::Write(hFile, &hdr, sizeof(bolota_search_hdr_t),
+			&dwWritten)) {
+		goto write_error;
+	}
+	ulBytes += dwWritten;
+	if (!vecFiles.empty()) {
+		if (!FileUtils::Write(hFile, &vecFiles[0],
+				vecFiles.size() * sizeof(bolota_search_file_t), &dwWritten)) {
+			goto write_error;
+		}
+		ulBytes += dwWritten;
+	}
+	if (!vecTerms.empty()) {
+		if (!FileUtils::Write(hFile, &vecTerms[0],
+				vecTerms.size() * sizeof(bolota_search_term_t), &dwWritten)) {
+			goto write_error;
+		}
+		ulBytes += dwWritten;
+	}
+	for (i = 0; i < vecTerms.size(); i++) {
+		if (!FileUtils::Write(hFile, &vecPostings[vecTerms[i].first],
+				vecTerms[i].count * sizeof(bolota_search_posting_t),
+				&dwWritten)) {
+			goto write_error;
+		}
+		ulBytes += dwWritten;
+	}
+	if (!strPool.empty()) {
+		if (!FileUtils::Write(hFile, strPool.data(), strPool.size(),
+				&dwWritten)) {
+			goto write_error;
+		}
+		ulBytes += dwWritten;
+	}
+	FileUtils::Close(hFile);
+
+	// Put it in place of the old one, which can't be mapped while we do it.
+	Close();
+	if (!FileUtils::Rename(strTemp.c_str(),
+			IndexPath(BOLOTA_SEARCH_INDEX_FILE).c_str())) {
+		ThrowError(new SystemError(EMSG("Could not replace the notebook ")
+			_T("search index")));
+		return false;
+	}
+
+	return Load();
+
+write_error:
+	ThrowError(new WriteError(hFile, ulBytes, true));
+	return false;
+}
+
+/**
+ * Builds up the path to a file in the directory of the notebook.
+ *
+ * @param szName Path of the file relative to the notebook.
+ *
+ * @return Full path to the file.
+ */
+tstring NotebookSearchIndex::IndexPath(LPCTSTR szName) const {
+	tstring strPath = m_strPath;
+
+#ifdef _WIN32
+	if (strPath.empty() || ((strPath[strPath.size() - 1] != _T('\\')) &&
+			(strPath[strPath.size() - 1] != _T('/')))) {
+		strPath += _T('\\');
+	}
+#else
+	if (strPath.empty() || (strPath[strPath.size() - 1] != _T('/')))
+		strPath += _T('/');
+#endif // _WIN32
+	strPath += szName;
+
+	return strPath;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Document Management                             |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the path of a document relative to the notebook, which is what's
+ * stored in the index so that the notebook can be moved around.
+ *
+ * @param strPath Full path to the document.
+ *
+ * @return UTF-8 path relative to the directory of the notebook.
+ */
+std::string NotebookSearchIndex::RelativePath(const tstring& strPath) const {
+	size_t ulStart = 0;
+
+	if (strPath.compare(0, m_strPath.size(), m_strPath) == 0)
+		ulStart = m_strPath.size();
+	while ((ulStart < strPath.size()) && ((strPath[ulStart] == _T('/')) ||
+			(strPath[ulStart] == _T('\\')))) {
+		ulStart++;
+	}
+
+	UString str(strPath.substr(ulStart).c_str());
+	return str.GetMultiByteString();
+}
+
+/**
+ * Finds a document in the index file by its path.
+ *
+ * @param strRelative UTF-8 path relative to the notebook.
+ *
+ * @return Index of the document or BOLOTA_SEARCH_NONE if it isn't there.
+ */
+uint32_t NotebookSearchIndex::FindFile(const std::string& strRelative) const {
+	uint32_t lo = 0;
+	uint32_t hi = (uint32_t)FileCount();
+
+	while (lo < hi) {
+		uint32_t mid = lo + ((hi - lo) / 2);
+		int iCompare = Compare(m_strings + m_files[mid].path,
+			m_files[mid].length, strRelative.data(), strRelative.size());
+
+		if (iCompare == 0)
+			return mid;
+		if (iCompare < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return BOLOTA_SEARCH_NONE;
+}
+
+/**
+ * Checks if a document comes before another one in the index file.
+ *
+ * @param a First document.
+ * @param b Second document.
+ *
+ * @return TRUE if the path of the first document comes first.
+ */
+bool NotebookSearchIndex::RecordLess(const Record& a, const Record& b) {
+	return a.relative < b.relative;
+}
+
+/**
+ * Hashes the contents of a file, which tells apart documents that were
+ * changed from the ones that were only touched.
+ *
+ * @param szPath Path to the file.
+ * @param pbRead Set to TRUE if the file could be read.
+ *
+ * @return Hash of the contents of the file.
+ */
+uint64_t NotebookSearchIndex::HashFile(LPCTSTR szPath, bool *pbRead) {
+	file_map_t map;
+
+	*pbRead = FileUtils::MapFile(szPath, &map);
+	if (!*pbRead)
+		return 0;
+
+	uint64_t hash = TrigramIndex::HashText(0, (const char*)map.data,
+		map.size);
+	FileUtils::UnmapFile(&map);
+
+	return hash;
+}
+
+/**
+ * Copies the postings of the documents that are carried over from the index
+ * file, with their new indexes.
+ *
+ * @param vecRemap New index of each document in the index file or
+ *                 BOLOTA_SEARCH_NONE if it's being dropped or read again.
+ * @param terms    Table of the terms to be populated.
+ */
+void NotebookSearchIndex::CopyPostings(const std::vector<uint32_t>& vecRemap,
+									   TermTable& terms) const {
+	terms.postings.reserve(PostingCount());
+	for (uint32_t i = 0; i < TermCount(); i++) {
+		const bolota_search_posting_t *posting = m_postings + m_terms[i].first;
+		const bolota_search_posting_t *end = posting + m_terms[i].count;
+		uint32_t term = BOLOTA_SEARCH_NONE;
+
+		// Documents keep their order, so the postings stay sorted.
+		for (; posting != end; posting++) {
+			if ((posting->file >= vecRemap.size()) ||
+					(vecRemap[posting->file] == BOLOTA_SEARCH_NONE)) {
+				continue;
+			}
+
+			// Only bring in the term if anyone still uses it.
+			if (term == BOLOTA_SEARCH_NONE) {
+				term = Intern(terms, m_strings + m_terms[i].text,
+					m_terms[i].length);
+			}
+
+			TermPosting moved;
+			moved.term = term;
+			moved.file = vecRemap[posting->file];
+			moved.topic = posting->topic;
+			terms.postings.push_back(moved);
+		}
+	}
+}
+
+/**
+ * Reads a document and adds the terms of its topics to the table. Documents
+ * that can't be read throw errors that are discarded, since they're reported
+ * through FailedFiles.
+ *
+ * @param record Document to be read.
+ * @param index  Index of the document in the new index file.
+ * @param terms  Table of the terms to be populated.
+ *
+ * @return TRUE if the document could be read.
+ */
+bool NotebookSearchIndex::IndexFile(const Record& record, uint32_t index,
+									TermTable& terms) {
+	char szTerm[BOLOTA_SEARCH_TERM_MAX];
+	std::vector<uint32_t> vecTerms;
+	Error *top = ErrorStack::Top();
+
+	// Read the document.
+	FlatDocument *doc = FlatDocument::ReadFile(record.path.c_str());
+	if (doc == BOLOTA_ERR_NULL) {
+		while ((ErrorStack::Top() != NULL) && (ErrorStack::Top() != top))
+			ErrorStack::Instance()->Pop();
+		return false;
+	}
+
+	// Add each term of its topics once per topic.
+	for (uint32_t i = 0; i < doc->Count(); i++) {
+		size_t ulPos = 0;
+		size_t ulTerm;
+
+		vecTerms.clear();
+		while ((ulTerm = NextTerm(doc->Text(i), doc->TextLength(i), &ulPos,
+				szTerm)) > 0) {
+			vecTerms.push_back(Intern(terms, szTerm, ulTerm));
+		}
+		std::sort(vecTerms.begin(), vecTerms.end());
+		vecTerms.erase(std::unique(vecTerms.begin(), vecTerms.end()),
+			vecTerms.end());
+
+		for (size_t j = 0; j < vecTerms.size(); j++) {
+			TermPosting posting;
+			posting.term = vecTerms[j];
+			posting.file = index;
+			posting.topic = i;
+			terms.postings.push_back(posting);
+		}
+	}
+
+	delete doc;
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Term Management                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the next term of a text. See Tokenize for what makes up a term.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes.
+ * @param pulPos   Position to start from, which is moved past the term.
+ * @param szTerm   Buffer of BOLOTA_SEARCH_TERM_MAX bytes to receive the term.
+ *                 It's not NUL terminated.
+ *
+ * @return Length of the term in bytes or 0 if there are no more terms.
+ */
+size_t NotebookSearchIndex::NextTerm(const char *mbstr, size_t ulLength,
+									 size_t *pulPos, char *szTerm) {
+	size_t i = *pulPos;
+	size_t ulTerm = 0;
+	bool bCut = false;
+
+	while ((ulTerm == 0) && (i < ulLength)) {
+		// Gather up the bytes of the term.
+		for (; i < ulLength; i++) {
+			uint8_t c = (uint8_t)mbstr[i];
+			if ((c >= 'A') && (c <= 'Z')) {
+				c = c - 'A' + 'a';
+			} else if (!(((c >= 'a') && (c <= 'z')) ||
+					((c >= '0') && (c <= '9')) || (c >= 0x80))) {
+				break;
+			}
+
+			if (ulTerm < BOLOTA_SEARCH_TERM_MAX) {
+				szTerm[ulTerm++] = (char)c;
+			} else {
+				bCut = true;
+			}
+		}
+		i++;
+	}
+	*pulPos = i;
+
+	// Drop the last character if it was cut in half.
+	if (bCut) {
+		size_t ulLead = ulTerm - 1;
+		while ((ulLead > 0) && (((uint8_t)szTerm[ulLead] & 0xC0) == 0x80))
+			ulLead--;
+
+		uint8_t lead = (uint8_t)szTerm[ulLead];
+		size_t ulChar = 1;
+		if ((lead & 0xE0) == 0xC0) {
+			ulChar = 2;
+		} else if ((lead & 0xF0) == 0xE0) {
+			ulChar = 3;
+		} else if ((lead & 0xF8) == 0xF0) {
+			ulChar = 4;
+		}
+		if ((ulLead + ulChar) > ulTerm)
+			ulTerm = ulLead;
+	}
+
+	return ulTerm;
+}
+
+/**
+ * Gets the number of a term in the table, adding it if it's not there yet.
+ *
+ * @param terms    Table of the terms.
+ * @param szTerm   Term. Doesn't need to be NUL terminated.
+ * @param ulLength Length of the term in bytes.
+ *
+ * @return Number of the term.
+ */
+uint32_t NotebookSearchIndex::Intern(TermTable& terms, const char *szTerm,
+									 size_t ulLength) {
+	// Keep the table at most half full.
+	if ((terms.texts.size() * 2) >= terms.slots.size())
+		Rehash(terms);
+
+	// Look for the term.
+	uint64_t hash = TrigramIndex::HashText(0, szTerm, ulLength);
+	size_t ulMask = terms.slots.size() - 1;
+	size_t ulSlot = (size_t)hash & ulMask;
+	while (terms.slots[ulSlot] != 0) {
+		uint32_t term = terms.slots[ulSlot] - 1;
+		if ((terms.hashes[term] == hash) &&
+				(terms.texts[term].size() == ulLength) &&
+				(memcmp(terms.texts[term].data(), szTerm, ulLength) == 0)) {
+			return term;
+		}
+
+		ulSlot = (ulSlot + 1) & ulMask;
+	}
+
+	// Add it.
+	uint32_t term = (uint32_t)terms.texts.size();
+	terms.texts.push_back(std::string(szTerm, ulLength));
+	terms.hashes.push_back(hash);
+	terms.slots[ulSlot] = term + 1;
+
+	return term;
+}
+
+/**
+ * Doubles the number of slots of the table of terms.
+ *
+ * @param terms Table of the terms.
+ */
+void NotebookSearchIndex::Rehash(TermTable& terms) {
+	size_t ulSlots = (terms.slots.empty()) ? 1024 : (terms.slots.size() * 2);
+	size_t ulMask = ulSlots - 1;
+
+	std::vector<uint32_t>(ulSlots, 0).swap(terms.slots);
+	for (uint32_t i = 0; i < terms.texts.size(); i++) {
+		size_t ulSlot = (size_t)terms.hashes[i] & ulMask;
+		while (terms.slots[ulSlot] != 0)
+			ulSlot = (ulSlot + 1) & ulMask;
+		terms.slots[ulSlot] = i + 1;
+	}
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Searching Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds a term in the terms table.
+ *
+ * @param strTerm Term to look for.
+ *
+ * @return Entry of the term or NULL if no topic has it.
+ */
+const bolota_search_term_t* NotebookSearchIndex::FindTerm(
+		const std::string& strTerm) const {
+	uint32_t lo = 0;
+	uint32_t hi = (uint32_t)TermCount();
+
+	while (lo < hi) {
+		uint32_t mid = lo + ((hi - lo) / 2);
+		int iCompare = Compare(m_strings + m_terms[mid].text,
+			m_terms[mid].length, strTerm.data(), strTerm.size());
+
+		if (iCompare == 0)
+			return m_terms + mid;
+		if (iCompare < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Compares two strings byte by byte, the same way std::string does.
+ *
+ * @param a         First string.
+ * @param ulLengthA Length of the first string in bytes.
+ * @param b         Second string.
+ * @param ulLengthB Length of the second string in bytes.
+ *
+ * @return Negative if the first string comes first, positive if it comes
+ *         last and zero if they're the same.
+ */
+int NotebookSearchIndex::Compare(const char *a, size_t ulLengthA,
+								 const char *b, size_t ulLengthB) {
+	int iCompare = memcmp(a, b, (ulLengthA < ulLengthB) ? ulLengthA :
+		ulLengthB);
+	if (iCompare != 0)
+		return iCompare;
+	if (ulLengthA == ulLengthB)
+		return 0;
+
+	return (ulLengthA < ulLengthB) ? -1 : 1;
+}
+
+/**
+ * Checks if a term shows up in fewer topics than another.
+ *
+ * @param a First term.
+ * @param b Second term.
+ *
+ * @return TRUE if the first term has fewer postings.
+ */
+bool NotebookSearchIndex::Rarer(const bolota_search_term_t *a,
+								const bolota_search_term_t *b) {
+	return a->count < b->count;
+}
+
+/**
+ * Checks if a posting comes before another one.
+ *
+ * @param a First posting.
+ * @param b Second posting.
+ *
+ * @return TRUE if the first posting comes first.
+ */
+bool NotebookSearchIndex::PostingLess(const bolota_search_posting_t& a,
+									  const bolota_search_posting_t& b) {
+	if (a.file != b.file)
+		return a.file < b.file;
+
+	return a.topic < b.topic;
+}
+
+/**
+ * Puts together a 64-bit number stored as two halves in the index file.
+ *
+ * @param parts Halves of the number, low part first.
+ *
+ * @return Number.
+ */
+uint64_t NotebookSearchIndex::Join(const uint32_t *parts) {
+	return ((uint64_t)parts[1] << 32) | parts[0];
+}
+
+/**
+ * Splits a 64-bit number into two halves to be stored in the index file.
+ *
+ * @param value Number.
+ * @param parts Halves of the number, low part first.
+ */
+void NotebookSearchIndex::Split(uint64_t value, uint32_t *parts) {
+	parts[0] = (uint32_t)value;
+	parts[1] = (uint32_t)(value >> 32);
+}
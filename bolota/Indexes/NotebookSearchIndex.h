@@ -0,0 +1,234 @@
+/**
+ * NotebookSearchIndex.h
+ * Persistent index of the words in the topics of a whole directory of
+ * documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_NOTEBOOKSEARCHINDEX_H
+#define _BOLOTA_INDEXES_NOTEBOOKSEARCHINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Utilities/FileUtils.h"
+#include "NotebookDateIndex.h"
+
+/**
+ * Name of the index file that is kept in the directory of the notebook.
+ */
+#define BOLOTA_SEARCH_INDEX_FILE _T(".bolota-search")
+
+/**
+ * Name of the file the index is written to before replacing the old one.
+ */
+#define BOLOTA_SEARCH_INDEX_TEMP _T(".bolota-search.tmp")
+
+/**
+ * Magic code of the index file.
+ */
+#define BOLOTA_SEARCH_MAGIC "BSIX"
+
+/**
+ * Version of the layout of the index file.
+ */
+#define BOLOTA_SEARCH_VERSION 1
+
+/**
+ * Maximum length of a term in bytes. Longer words are cut short.
+ */
+#define BOLOTA_SEARCH_TERM_MAX 64
+
+/**
+ * Flag of a document that couldn't be read.
+ */
+#define BOLOTA_SEARCH_FAILED 0x0001
+
+/**
+ * Header of the index file. It's followed by the documents table, the terms
+ * table, the postings and then the strings pool.
+ */
+typedef struct bolota_search_hdr_s {
+	char magic[4];      /* Magic code of the file. */
+	uint32_t version;   /* Version of the layout of the file. */
+	uint32_t files;     /* Number of entries in the documents table. */
+	uint32_t terms;     /* Number of entries in the terms table. */
+	uint32_t postings;  /* Number of postings. */
+	uint32_t strings;   /* Length of the strings pool in bytes. */
+} bolota_search_hdr_t;
+
+/**
+ * Entry of the documents table, which is sorted by path.
+ */
+typedef struct bolota_search_file_s {
+	uint32_t size[2];      /* Size of the document, low part first. */
+	uint32_t modified[2];  /* Modification time, low part first. */
+	uint32_t hash[2];      /* Hash of the contents, low part first. */
+	uint32_t path;         /* Offset of the path in the strings pool. */
+	uint16_t length;       /* Length of the path in bytes. */
+	uint16_t flags;        /* State of the document. */
+} bolota_search_file_t;
+
+/**
+ * Entry of the terms table, which is sorted by the bytes of the terms.
+ */
+typedef struct bolota_search_term_s {
+	uint32_t text;    /* Offset of the term in the strings pool. */
+	uint32_t length;  /* Length of the term in bytes. */
+	uint32_t first;   /* Index of the first posting of the term. */
+	uint32_t count;   /* Number of topics that contain the term. */
+} bolota_search_term_t;
+
+/**
+ * Posting of a term, sorted by document and then topic.
+ */
+typedef struct bolota_search_posting_s {
+	uint32_t file;   /* Index of the document in the documents table. */
+	uint32_t topic;  /* Pre-order index of the topic in the document. */
+} bolota_search_posting_t;
+
+namespace Bolota {
+
+	/**
+	 * Topic found in one of the documents of a notebook.
+	 */
+	struct NotebookHit {
+		uint32_t file;   // Index of the document in the notebook.
+		uint32_t topic;  // Pre-order index of the topic in the document.
+	};
+
+	/**
+	 * Index of the words (terms) in the topics of every document in a
+	 * directory (a notebook) that is kept in a file next to them, so that a
+	 * new process can answer which topics contain all of the words of a query
+	 * by mapping it into memory instead of reading every document again.
+	 *
+	 * Terms are runs of letters and digits, with ASCII letters case folded,
+	 * and any byte outside of ASCII counts as a letter. The terms table is
+	 * binary searched straight from the file and the postings of the terms of
+	 * a query are intersected starting from the rarest one.
+	 *
+	 * The size, modification time and a hash of the contents of each document
+	 * are kept in the index as well, so refreshing it only reads the
+	 * documents that were added or changed since. Documents that were only
+	 * touched are hashed but not parsed. The new index is written to a
+	 * temporary file and renamed over the old one, so other processes never
+	 * see it half written.
+	 */
+	class NotebookSearchIndex {
+	protected:
+		// Document of the notebook while refreshing.
+		struct Record {
+			tstring path;
+			std::string relative;
+			file_info_t info;
+			uint64_t hash;
+			bool bIndex;
+			bool bFailed;
+		};
+
+		// Terms while refreshing.
+		struct TermPosting {
+			uint32_t term;
+			uint32_t file;
+			uint32_t topic;
+		};
+		struct TermTable {
+			std::vector<std::string> texts;
+			std::vector<uint64_t> hashes;
+			std::vector<uint32_t> slots;
+			std::vector<TermPosting> postings;
+		};
+
+		// Notebook.
+		tstring m_strPath;
+		std::vector<size_t> m_failed;
+
+		// Mapped index file.
+		file_map_t m_map;
+		const bolota_search_hdr_t *m_hdr;
+		const bolota_search_file_t *m_files;
+		const bolota_search_term_t *m_terms;
+		const bolota_search_posting_t *m_postings;
+		const char *m_strings;
+
+	public:
+		// Constructors and destructors.
+		NotebookSearchIndex();
+		virtual ~NotebookSearchIndex();
+
+		// Building.
+		bool Open(LPCTSTR szPath);
+		size_t Refresh(LPCTSTR szPath, bool bRecursive);
+		void Close();
+		bool IsOpen() const;
+
+		// Searching.
+		size_t Search(const char *szQuery,
+			std::vector<NotebookHit>& vecResults) const;
+
+		// Documents.
+		size_t FileCount() const;
+		tstring File(size_t index) const;
+		const std::vector<size_t>& FailedFiles() const;
+
+		// Statistics.
+		size_t TermCount() const;
+		size_t PostingCount() const;
+		size_t FileSize() const;
+
+		// Terms.
+		static void Tokenize(const char *mbstr, size_t ulLength,
+			std::vector<std::string>& vecTerms);
+
+	protected:
+		// Index file.
+		bool Load();
+		bool Save(const std::vector<Record>& vecRecords, TermTable& terms);
+		tstring IndexPath(LPCTSTR szName) const;
+
+		// Document management.
+		std::string RelativePath(const tstring& strPath) const;
+		uint32_t FindFile(const std::string& strRelative) const;
+		static bool RecordLess(const Record& a, const Record& b);
+		static uint64_t HashFile(LPCTSTR szPath, bool *pbRead);
+		void CopyPostings(const std::vector<uint32_t>& vecRemap,
+			TermTable& terms) const;
+		static bool IndexFile(const Record& record, uint32_t index,
+			TermTable& terms);
+
+		// Term management.
+		static size_t NextTerm(const char *mbstr, size_t ulLength,
+			size_t *pulPos, char *szTerm);
+		static uint32_t Intern(TermTable& terms, const char *szTerm,
+			size_t ulLength);
+		static void Rehash(TermTable& terms);
+
+		// Searching helpers.
+		const bolota_search_term_t* FindTerm(const std::string& strTerm) const;
+		static int Compare(const char *a, size_t ulLengthA, const char *b,
+			size_t ulLengthB);
+		static bool Rarer(const bolota_search_term_t *a,
+			const bolota_search_term_t *b);
+		static bool PostingLess(const bolota_search_posting_t& a,
+			const bolota_search_posting_t& b);
+		static uint64_t Join(const uint32_t *parts);
+		static void Split(uint64_t value, uint32_t *parts);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_NOTEBOOKSEARCHINDEX_H
@@ -0,0 +1,730 @@
+/**
+ * PositionIndex.cpp
+ * Order statistic index of the topics of a document in display order.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "PositionIndex.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty position index.
+ */
+PositionIndex::PositionIndex() {
+	m_root = NULL;
+	m_seed = 2463534242U;
+	m_detached = NULL;
+}
+
+/**
+ * Frees up the nodes of the index.
+ */
+PositionIndex::~PositionIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch with every topic expanded.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void PositionIndex::Build(Field *first) {
+	Clear();
+
+	for (Field *field = first; field != NULL; field = field->Next())
+		Collect(field, 0, &m_root);
+}
+
+/**
+ * Removes every topic from the index and forgets about their collapse state.
+ */
+void PositionIndex::Clear() {
+	FreeNodes(m_root, true);
+	m_root = NULL;
+	m_nodes.clear();
+	m_collapsed.clear();
+	m_detached = NULL;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Inserts a topic and all of its children at their position in the index.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void PositionIndex::TopicInserted(Field *field) {
+	Node *subtree = NULL;
+	Node *left;
+	Node *right;
+
+	// Check if we already know about this topic.
+	if (m_nodes.find(field) != m_nodes.end())
+		return;
+
+	// A topic that was detached and isn't coming back has just been replaced
+	// by this one, which takes over its children and collapse state.
+	if ((m_detached != NULL) && (m_detached != field) &&
+			(m_collapsed.erase(m_detached) > 0)) {
+		m_collapsed.insert(field);
+	}
+	m_detached = NULL;
+
+	// Find where the topic should be inserted.
+	uint32_t pos = 0;
+	Field *prev = PreorderPrevious(field);
+	if (prev != NULL) {
+		pos = Position(prev);
+		if (pos == BOLOTA_POS_NONE)
+			return;
+		pos++;
+	}
+
+	// Build the new nodes and put them in place.
+	Collect(field, CollapsedAncestors(field), &subtree);
+	Split(m_root, pos, &left, &right);
+	m_root = Merge(Merge(left, subtree), right);
+	m_root->parent = NULL;
+}
+
+/**
+ * Removes a topic and all of its children from the index.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards? FALSE if they are
+ *                  only being moved, in which case their collapse state is
+ *                  remembered.
+ */
+void PositionIndex::TopicRemoving(Field *field, bool bDeleting) {
+	Node *left;
+	Node *middle;
+	Node *right;
+
+	// Find the range occupied by the topic and its children.
+	uint32_t start = Position(field);
+	if (start == BOLOTA_POS_NONE)
+		return;
+	uint32_t end = SubtreeEnd(field);
+
+	// Cut it out of the tree.
+	Split(m_root, start, &left, &right);
+	Split(right, end - start, &middle, &right);
+	m_root = Merge(left, right);
+	if (m_root != NULL)
+		m_root->parent = NULL;
+	FreeNodes(middle, bDeleting);
+	m_detached = (bDeleting) ? NULL : field;
+}
+
+/**
+ * The position of a topic doesn't depend on its contents.
+ *
+ * @param field Topic that was changed.
+ */
+void PositionIndex::TopicChanged(Field *field) {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Collapse State                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Expands or collapses a topic, showing or hiding all of its children.
+ *
+ * @param field     Topic to be expanded or collapsed.
+ * @param bExpanded Should the children of the topic be visible?
+ */
+void PositionIndex::SetExpanded(Field *field, bool bExpanded) {
+	// Check if anything has changed.
+	if (bExpanded == IsExpanded(field))
+		return;
+	if (bExpanded) {
+		m_collapsed.erase(field);
+	} else {
+		m_collapsed.insert(field);
+	}
+
+	// Update the children of the topic.
+	uint32_t start = Position(field);
+	if (start == BOLOTA_POS_NONE)
+		return;
+	AddHidden(start + 1, SubtreeEnd(field), (bExpanded) ? -1 : 1);
+}
+
+/**
+ * Checks if a topic is expanded.
+ *
+ * @param field Topic to be checked.
+ *
+ * @return TRUE if the children of the topic aren't collapsed.
+ */
+bool PositionIndex::IsExpanded(Field *field) const {
+	return m_collapsed.find(field) == m_collapsed.end();
+}
+
+/**
+ * Checks if a topic is visible, meaning none of its ancestors are collapsed.
+ *
+ * @param field Topic to be checked.
+ *
+ * @return TRUE if the topic is visible.
+ */
+bool PositionIndex::IsVisible(Field *field) {
+	return Row(field) != BOLOTA_POS_NONE;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Document Order                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics in the document.
+ */
+uint32_t PositionIndex::Count() const {
+	return Size(m_root);
+}
+
+/**
+ * Gets the position of a topic in the document, counting every topic.
+ *
+ * @param field Topic to be looked up.
+ *
+ * @return Zero-based position of the topic or BOLOTA_POS_NONE if it isn't in
+ *         the index.
+ */
+uint32_t PositionIndex::Position(Field *field) const {
+	std::map<Field*, Node*>::const_iterator it = m_nodes.find(field);
+	if (it == m_nodes.end())
+		return BOLOTA_POS_NONE;
+
+	// Walk up the tree counting everything that comes before us.
+	const Node *node = it->second;
+	uint32_t pos = Size(node->left);
+	while (node->parent != NULL) {
+		if (node == node->parent->right)
+			pos += Size(node->parent->left) + 1;
+		node = node->parent;
+	}
+
+	return pos;
+}
+
+/**
+ * Gets the topic at a position of the document, counting every topic.
+ *
+ * @param pos Zero-based position of the topic.
+ *
+ * @return Topic at the position or NULL if it's out of bounds.
+ */
+Field* PositionIndex::At(uint32_t pos) {
+	Node *node = m_root;
+
+	while (node != NULL) {
+		uint32_t ulLeft = Size(node->left);
+
+		if (pos < ulLeft) {
+			node = node->left;
+		} else if (pos == ulLeft) {
+			return node->field;
+		} else {
+			pos -= ulLeft + 1;
+			node = node->right;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Visible Rows                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics that are currently visible.
+ *
+ * @return Number of visible rows.
+ */
+uint32_t PositionIndex::VisibleCount() const {
+	return Visible(m_root);
+}
+
+/**
+ * Gets the row number of a topic, counting only the visible topics.
+ *
+ * @param field Topic to be looked up.
+ *
+ * @return Zero-based row of the topic or BOLOTA_POS_NONE if it isn't visible
+ *         or in the index.
+ */
+uint32_t PositionIndex::Row(Field *field) {
+	std::map<Field*, Node*>::iterator it = m_nodes.find(field);
+	if (it == m_nodes.end())
+		return BOLOTA_POS_NONE;
+
+	// Make sure every pending update on the way to us has been applied.
+	Node *node = it->second;
+	PushPath(node);
+	if (node->hidden != 0)
+		return BOLOTA_POS_NONE;
+
+	// Walk up the tree counting the visible topics that come before us.
+	uint32_t row = Visible(node->left);
+	while (node->parent != NULL) {
+		if (node == node->parent->right) {
+			row += Visible(node->parent->left);
+			if (node->parent->hidden == 0)
+				row++;
+		}
+		node = node->parent;
+	}
+
+	return row;
+}
+
+/**
+ * Gets the topic at a row, counting only the visible topics.
+ *
+ * @param row Zero-based row number.
+ *
+ * @return Topic at the row or NULL if it's out of bounds.
+ */
+Field* PositionIndex::VisibleAt(uint32_t row) {
+	Node *node = m_root;
+
+	while (node != NULL) {
+		Push(node);
+
+		uint32_t ulLeft = Visible(node->left);
+		if (row < ulLeft) {
+			node = node->left;
+			continue;
+		}
+		row -= ulLeft;
+
+		if (node->hidden == 0) {
+			if (row == 0)
+				return node->field;
+			row--;
+		}
+		node = node->right;
+	}
+
+	return NULL;
+}
+
+/**
+ * Gets the visible topic right above another one.
+ *
+ * @param field Reference topic. Must be visible.
+ *
+ * @return Visible topic above the reference or NULL if there's none.
+ */
+Field* PositionIndex::PreviousVisible(Field *field) {
+	uint32_t row = Row(field);
+	if ((row == BOLOTA_POS_NONE) || (row == 0))
+		return NULL;
+
+	return VisibleAt(row - 1);
+}
+
+/**
+ * Gets the visible topic right below another one.
+ *
+ * @param field Reference topic. Must be visible.
+ *
+ * @return Visible topic below the reference or NULL if there's none.
+ */
+Field* PositionIndex::NextVisible(Field *field) {
+	uint32_t row = Row(field);
+	if (row == BOLOTA_POS_NONE)
+		return NULL;
+
+	return VisibleAt(row + 1);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Document Helpers                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the topic that comes right before another in display order.
+ *
+ * @param field Reference topic.
+ *
+ * @return Previous topic in display order or NULL if this is the first one.
+ */
+Field* PositionIndex::PreorderPrevious(Field *field) {
+	// First children come right after their parents.
+	if (!field->HasPrevious())
+		return field->Parent();
+
+	// Otherwise it's the last descendant of our previous sibling.
+	Field *prev = field->Previous();
+	while (prev->HasChild()) {
+		prev = prev->Child();
+		while (prev->HasNext())
+			prev = prev->Next();
+	}
+
+	return prev;
+}
+
+/**
+ * Gets the first topic after another that isn't one of its children.
+ *
+ * @param field Reference topic.
+ *
+ * @return Topic right after the reference and its children in display order
+ *         or NULL if they are at the end of the document.
+ */
+Field* PositionIndex::PreorderSkip(Field *field) {
+	while (field != NULL) {
+		if (field->HasNext())
+			return field->Next();
+		field = field->Parent();
+	}
+
+	return NULL;
+}
+
+/**
+ * Counts the collapsed ancestors of a topic.
+ *
+ * @param field Reference topic.
+ *
+ * @return Number of collapsed ancestors.
+ */
+int32_t PositionIndex::CollapsedAncestors(Field *field) const {
+	int32_t count = 0;
+
+	for (Field *parent = field->Parent(); parent != NULL;
+			parent = parent->Parent()) {
+		if (!IsExpanded(parent))
+			count++;
+	}
+
+	return count;
+}
+
+/**
+ * Gets the position right after the last child of a topic.
+ *
+ * @param field Reference topic.
+ *
+ * @return Position after the topic and all of its children.
+ */
+uint32_t PositionIndex::SubtreeEnd(Field *field) const {
+	Field *skip = PreorderSkip(field);
+	if (skip == NULL)
+		return Count();
+
+	uint32_t pos = Position(skip);
+	return (pos == BOLOTA_POS_NONE) ? Count() : pos;
+}
+
+/**
+ * Creates the nodes for a topic and all of its children, appending them to a
+ * tree in display order.
+ *
+ * @param field  Topic to be added.
+ * @param hidden Number of collapsed ancestors of the topic.
+ * @param root   Pointer to the root of the tree to be appended to.
+ */
+void PositionIndex::Collect(Field *field, int32_t hidden, Node **root) {
+	*root = Merge(*root, NewNode(field, hidden));
+	(*root)->parent = NULL;
+
+	// Go through the children.
+	if (!IsExpanded(field))
+		hidden++;
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		Collect(child, hidden, root);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Node Management                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Allocates a node for a topic with a random priority and registers it.
+ *
+ * @param field  Topic represented by the node.
+ * @param hidden Number of collapsed ancestors of the topic.
+ *
+ * @return Newly allocated node.
+ */
+PositionIndex::Node* PositionIndex::NewNode(Field *field, int32_t hidden) {
+	Node *node = new Node;
+
+	// Advance our xorshift generator.
+	m_seed ^= m_seed << 13;
+	m_seed ^= m_seed >> 17;
+	m_seed ^= m_seed << 5;
+
+	node->field = field;
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	node->priority = m_seed;
+	node->size = 1;
+	node->hidden = hidden;
+	node->minHidden = hidden;
+	node->minCount = 1;
+	node->lazy = 0;
+	m_nodes[field] = node;
+
+	return node;
+}
+
+/**
+ * Frees a node and all of its descendants, unregistering their topics.
+ *
+ * @param node      Root of the subtree to be free'd.
+ * @param bDeleting Should the collapse state of the topics be forgotten?
+ */
+void PositionIndex::FreeNodes(Node *node, bool bDeleting) {
+	if (node == NULL)
+		return;
+
+	FreeNodes(node->left, bDeleting);
+	FreeNodes(node->right, bDeleting);
+	m_nodes.erase(node->field);
+	if (bDeleting)
+		m_collapsed.erase(node->field);
+	delete node;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Tree Operations                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in a subtree.
+ *
+ * @param node Root of the subtree. Can be NULL.
+ *
+ * @return Number of topics in the subtree.
+ */
+uint32_t PositionIndex::Size(const Node *node) {
+	return (node) ? node->size : 0;
+}
+
+/**
+ * Gets the number of visible topics in a subtree.
+ *
+ * @param node Root of the subtree. Can be NULL.
+ *
+ * @return Number of topics in the subtree without collapsed ancestors.
+ */
+uint32_t PositionIndex::Visible(const Node *node) {
+	if ((node == NULL) || (node->minHidden != 0))
+		return 0;
+
+	return node->minCount;
+}
+
+/**
+ * Adds to the number of collapsed ancestors of an entire subtree, deferring
+ * the update of its children until they are needed.
+ *
+ * @param node  Root of the subtree. Can be NULL.
+ * @param delta Number to be added.
+ */
+void PositionIndex::Apply(Node *node, int32_t delta) {
+	if (node == NULL)
+		return;
+
+	node->hidden += delta;
+	node->minHidden += delta;
+	node->lazy += delta;
+}
+
+/**
+ * Passes a deferred update down to the children of a node.
+ *
+ * @param node Node with a possibly pending update.
+ */
+void PositionIndex::Push(Node *node) {
+	if (node->lazy == 0)
+		return;
+
+	Apply(node->left, node->lazy);
+	Apply(node->right, node->lazy);
+	node->lazy = 0;
+}
+
+/**
+ * Recalculates the aggregates of a node after its children changed.
+ *
+ * @param node Node to be updated.
+ */
+void PositionIndex::Update(Node *node) {
+	node->size = 1 + Size(node->left) + Size(node->right);
+	node->minHidden = node->hidden;
+	node->minCount = 1;
+
+	// Merge in the children.
+	Node *children[2] = { node->left, node->right };
+	for (int i = 0; i < 2; i++) {
+		Node *child = children[i];
+		if (child == NULL)
+			continue;
+
+		child->parent = node;
+		if (child->minHidden < node->minHidden) {
+			node->minHidden = child->minHidden;
+			node->minCount = child->minCount;
+		} else if (child->minHidden == node->minHidden) {
+			node->minCount += child->minCount;
+		}
+	}
+}
+
+/**
+ * Concatenates two subtrees.
+ *
+ * @param left  Subtree with the first topics.
+ * @param right Subtree with the last topics.
+ *
+ * @return Root of the concatenated tree.
+ */
+PositionIndex::Node* PositionIndex::Merge(Node *left, Node *right) {
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+
+	if (left->priority > right->priority) {
+		Push(left);
+		left->right = Merge(left->right, right);
+		Update(left);
+		return left;
+	}
+
+	Push(right);
+	right->left = Merge(left, right->left);
+	Update(right);
+	return right;
+}
+
+/**
+ * Splits a subtree in two at a position.
+ *
+ * @param node  Root of the subtree to be split.
+ * @param pos   Number of topics that should end up in the left subtree.
+ * @param left  Pointer to store the subtree with the first topics.
+ * @param right Pointer to store the subtree with the last topics.
+ */
+void PositionIndex::Split(Node *node, uint32_t pos, Node **left,
+						  Node **right) {
+	// Nothing to split.
+	if (node == NULL) {
+		*left = NULL;
+		*right = NULL;
+		return;
+	}
+
+	Push(node);
+	if (pos <= Size(node->left)) {
+		Split(node->left, pos, left, &node->left);
+		Update(node);
+		*right = node;
+	} else {
+		Split(node->right, pos - Size(node->left) - 1, &node->right, right);
+		Update(node);
+		*left = node;
+	}
+
+	// Subtrees that got detached become roots.
+	if (*left != NULL)
+		(*left)->parent = NULL;
+	if (*right != NULL)
+		(*right)->parent = NULL;
+}
+
+/**
+ * Applies every pending update on the path from the root down to a node.
+ *
+ * @param node Node to have its path updated.
+ */
+void PositionIndex::PushPath(Node *node) {
+	std::vector<Node*> vecPath;
+
+	for (; node != NULL; node = node->parent)
+		vecPath.push_back(node);
+	for (size_t i = vecPath.size(); i > 0; i--)
+		Push(vecPath[i - 1]);
+}
+
+/**
+ * Adds to the number of collapsed ancestors of a range of topics.
+ *
+ * @param start Position of the first topic in the range.
+ * @param end   Position right after the last topic in the range.
+ * @param delta Number to be added.
+ */
+void PositionIndex::AddHidden(uint32_t start, uint32_t end, int32_t delta) {
+	Node *left;
+	Node *middle;
+	Node *right;
+
+	if (start >= end)
+		return;
+
+	Split(m_root, start, &left, &right);
+	Split(right, end - start, &middle, &right);
+	Apply(middle, delta);
+	m_root = Merge(Merge(left, middle), right);
+	if (m_root != NULL)
+		m_root->parent = NULL;
+}
@@ -0,0 +1,123 @@
+/**
+ * PositionIndex.h
+ * Order statistic index of the topics of a document in display order.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_POSITIONINDEX_H
+#define _BOLOTA_INDEXES_POSITIONINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "DocumentIndex.h"
+
+/**
+ * Value returned by position lookups when there is no such topic.
+ */
+#define BOLOTA_POS_NONE ((uint32_t)-1)
+
+namespace Bolota {
+
+	/**
+	 * Order statistic index of the topics of a document in display (pre-)
+	 * order. Maps between topics and their position in the document, or
+	 * their row number counting only the visible topics, in O(log n).
+	 *
+	 * Topics are kept in a randomized balanced tree ordered by their position.
+	 * Each node counts how many of its ancestors are collapsed, which allows
+	 * an entire subtree to be hidden or shown with a single lazy range update.
+	 */
+	class PositionIndex : public DocumentIndex {
+	protected:
+		// Node of the tree.
+		struct Node {
+			Field *field;
+			Node *left;
+			Node *right;
+			Node *parent;
+			uint32_t priority;
+			uint32_t size;
+			int32_t hidden;
+			int32_t minHidden;
+			uint32_t minCount;
+			int32_t lazy;
+		};
+
+		Node *m_root;
+		uint32_t m_seed;
+		std::map<Field*, Node*> m_nodes;
+		std::set<Field*> m_collapsed;
+		Field *m_detached;
+
+	public:
+		// Constructors and destructors.
+		PositionIndex();
+		virtual ~PositionIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Collapse state.
+		void SetExpanded(Field *field, bool bExpanded);
+		bool IsExpanded(Field *field) const;
+		bool IsVisible(Field *field);
+
+		// Document order.
+		uint32_t Count() const;
+		uint32_t Position(Field *field) const;
+		Field* At(uint32_t pos);
+
+		// Visible rows.
+		uint32_t VisibleCount() const;
+		uint32_t Row(Field *field);
+		Field* VisibleAt(uint32_t row);
+		Field* PreviousVisible(Field *field);
+		Field* NextVisible(Field *field);
+
+	protected:
+		// Document helpers.
+		static Field* PreorderPrevious(Field *field);
+		static Field* PreorderSkip(Field *field);
+		int32_t CollapsedAncestors(Field *field) const;
+		uint32_t SubtreeEnd(Field *field) const;
+		void Collect(Field *field, int32_t hidden, Node **root);
+
+		// Node management.
+		Node* NewNode(Field *field, int32_t hidden);
+		void FreeNodes(Node *node, bool bDeleting);
+
+		// Tree operations.
+		static uint32_t Size(const Node *node);
+		static uint32_t Visible(const Node *node);
+		static void Apply(Node *node, int32_t delta);
+		static void Push(Node *node);
+		static void Update(Node *node);
+		static Node* Merge(Node *left, Node *right);
+		static void Split(Node *node, uint32_t pos, Node **left, Node **right);
+		static void PushPath(Node *node);
+		void AddHidden(uint32_t start, uint32_t end, int32_t delta);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_POSITIONINDEX_H
@@ -0,0 +1,875 @@
+/**
+ * TextIndex.cpp
+ * Inverted index of the words in the texts of the topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "TextIndex.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+using namespace Bolota;
+
+/**
+ * Checks if a byte is part of a word. Bytes of non-ASCII characters always
+ * are, so words in any script are kept whole.
+ *
+ * @param c Byte to be checked.
+ *
+ * @return TRUE if the byte is part of a word.
+ */
+static inline bool IsWordByte(unsigned char c) {
+	return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+		((c >= '0') && (c <= '9')) || (c >= 0x80);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty text index.
+ */
+TextIndex::TextIndex() {
+	m_termTable.assign(BOLOTA_TEXTINDEX_SLOTS, 0);
+	m_ulDead = 0;
+	m_ulOrdered = 0;
+}
+
+/**
+ * Frees up the dictionary and postings.
+ */
+TextIndex::~TextIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch. Topics are numbered in document order, so the
+ * postings start out in document order as well.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void TextIndex::Build(Field *first) {
+	Clear();
+
+	for (Field *field = first; field != NULL; field = field->Next())
+		AddSubtree(field);
+	m_order.Build(first);
+	m_ulOrdered = (uint32_t)m_topics.size();
+}
+
+/**
+ * Removes every topic and term from the index.
+ */
+void TextIndex::Clear() {
+	std::vector<char>().swap(m_chars);
+	std::vector<Term>().swap(m_terms);
+	std::vector<uint32_t>(BOLOTA_TEXTINDEX_SLOTS, 0).swap(m_termTable);
+	std::vector<Topic>().swap(m_topics);
+	m_fields.Clear();
+	m_order.Clear();
+	m_ulDead = 0;
+	m_ulOrdered = 0;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Indexes the words of a topic and all of its children.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void TextIndex::TopicInserted(Field *field) {
+	std::vector<Field*> vecFields;
+
+	// Check if we already know about this topic.
+	if (m_fields.Find(field) != BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	// New topics get numbered at the end, so keep track of where they are.
+	uint32_t pos = m_order.InsertionPoint(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+	TopicOrder::Collect(field, vecFields);
+	m_order.Insert(pos, vecFields);
+	AddSubtree(field);
+}
+
+/**
+ * Removes a topic and all of its children from the index. Removing topics
+ * doesn't change the order of the ones that are left.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards?
+ */
+void TextIndex::TopicRemoving(Field *field, bool bDeleting) {
+	uint32_t pos = m_order.Position(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+
+	m_order.Remove(pos, RemoveSubtree(field));
+
+	// Get rid of the dead topics once they start to pile up.
+	if (m_ulDead > ((Count() / 2) + BOLOTA_TEXTINDEX_DEAD_MIN))
+		Compact();
+}
+
+/**
+ * Updates the postings of the words that were added to or removed from the
+ * text of a topic.
+ *
+ * @param field Topic that was changed.
+ */
+void TextIndex::TopicChanged(Field *field) {
+	UpdateTopic(field);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the topics that match a query. Words must all be present in a topic,
+ * double quoted phrases must appear in sequence, and OR separates
+ * alternatives. For example: 'release notes OR "change log"'.
+ *
+ * @param szQuery    Query to be matched.
+ * @param vecResults Vector to receive the matching topics in document order.
+ *
+ * @return Number of matching topics.
+ */
+size_t TextIndex::Search(const char *szQuery, std::vector<Field*>& vecResults) {
+	std::vector<std::vector<Clause> > vecGroups;
+	std::vector<uint32_t> vecSlots;
+	std::vector<uint32_t> vecGroup;
+	std::vector<uint32_t> vecMerged;
+
+	// Parse the query into alternatives.
+	vecResults.clear();
+	if (!ParseQuery(szQuery, vecGroups))
+		return 0;
+
+	// Match each alternative and merge them together.
+	for (size_t i = 0; i < vecGroups.size(); i++) {
+		MatchGroup(vecGroups[i], vecGroup);
+		vecMerged.clear();
+		std::set_union(vecSlots.begin(), vecSlots.end(), vecGroup.begin(),
+			vecGroup.end(), std::back_inserter(vecMerged));
+		vecSlots.swap(vecMerged);
+	}
+
+	// Put the topics in document order. Those numbered when the index was
+	// built or compacted already are.
+	vecResults.reserve(vecSlots.size());
+	for (size_t i = 0; i < vecSlots.size(); i++)
+		vecResults.push_back(m_topics[vecSlots[i]].field);
+	m_order.Sort(vecResults, std::lower_bound(vecSlots.begin(),
+		vecSlots.end(), m_ulOrdered) - vecSlots.begin());
+
+	return vecResults.size();
+}
+
+/**
+ * Finds the topics that match a query.
+ *
+ * @param szQuery    Query to be matched.
+ * @param vecResults Vector to receive the matching topics in document order.
+ *
+ * @return Number of matching topics.
+ */
+size_t TextIndex::Search(const wchar_t *szQuery,
+						 std::vector<Field*>& vecResults) {
+	UString strQuery(szQuery);
+	return Search(strQuery.GetMultiByteString(), vecResults);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Statistics                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics.
+ */
+size_t TextIndex::Count() const {
+	return m_topics.size() - m_ulDead;
+}
+
+/**
+ * Gets the number of distinct terms in the dictionary.
+ *
+ * @return Number of terms.
+ */
+size_t TextIndex::TermCount() const {
+	return m_terms.size();
+}
+
+/**
+ * Gets the number of bytes allocated for the dictionary, postings and tables.
+ *
+ * @return Size of the index in bytes.
+ */
+size_t TextIndex::HeapSize() const {
+	size_t ulSize = m_chars.capacity() +
+		(m_terms.capacity() * sizeof(Term)) +
+		(m_termTable.capacity() * sizeof(uint32_t)) +
+		(m_topics.capacity() * sizeof(Topic)) +
+		m_fields.HeapSize() + m_order.HeapSize();
+	size_t i;
+
+	for (i = 0; i < m_terms.size(); i++)
+		ulSize += m_terms[i].postings.capacity() * sizeof(uint32_t);
+	for (i = 0; i < m_topics.size(); i++)
+		ulSize += m_topics[i].terms.capacity() * sizeof(uint32_t);
+
+	return ulSize;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Tokenization                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the next word in a text.
+ *
+ * @param mbstr    UTF-8 text to be split into words.
+ * @param ulLength Length of the text in bytes.
+ * @param pulPos   Position to start looking from, which gets updated to just
+ *                 after the word that was found.
+ * @param pulStart Position where the word starts.
+ * @param pulEnd   Position just after the end of the word.
+ *
+ * @return TRUE if a word was found, FALSE if we've reached the end of the text.
+ */
+bool TextIndex::NextWord(const char *mbstr, size_t ulLength, size_t *pulPos,
+						 size_t *pulStart, size_t *pulEnd) {
+	const unsigned char *str = (const unsigned char *)mbstr;
+	size_t ulPos = *pulPos;
+
+	// Skip over everything that isn't part of a word.
+	while ((ulPos < ulLength) && !IsWordByte(str[ulPos]))
+		ulPos++;
+	if (ulPos >= ulLength) {
+		*pulPos = ulPos;
+		return false;
+	}
+
+	// Find the end of the word.
+	*pulStart = ulPos;
+	while ((ulPos < ulLength) && IsWordByte(str[ulPos]))
+		ulPos++;
+	*pulEnd = ulPos;
+	*pulPos = ulPos;
+
+	return true;
+}
+
+/**
+ * Converts a word into a term by lowering the case of its ASCII letters and
+ * cutting it at BOLOTA_TEXTINDEX_TERM_MAX bytes, without splitting a
+ * character in half.
+ *
+ * @param mbstr    Word to be converted.
+ * @param ulLength Length of the word in bytes.
+ * @param szTerm   Buffer of at least BOLOTA_TEXTINDEX_TERM_MAX bytes to
+ *                 receive the term. (not NUL terminated)
+ *
+ * @return Length of the term in bytes.
+ */
+size_t TextIndex::Normalize(const char *mbstr, size_t ulLength, char *szTerm) {
+	if (ulLength > BOLOTA_TEXTINDEX_TERM_MAX) {
+		ulLength = BOLOTA_TEXTINDEX_TERM_MAX;
+		while ((ulLength > 0) && ((mbstr[ulLength] & 0xC0) == 0x80))
+			ulLength--;
+	}
+
+	for (size_t i = 0; i < ulLength; i++) {
+		char c = mbstr[i];
+		szTerm[i] = ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+	}
+
+	return ulLength;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Topic Management                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a topic and all of its children to the index.
+ *
+ * @param field Topic to be added.
+ */
+void TextIndex::AddSubtree(Field *field) {
+	AddTopic(field);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		AddSubtree(child);
+}
+
+/**
+ * Adds a single topic to the end of the index. Its number is larger than any
+ * other, so it simply gets appended to the postings of its terms.
+ *
+ * @param field Topic to be added.
+ */
+void TextIndex::AddTopic(Field *field) {
+	uint32_t slot = (uint32_t)m_topics.size();
+
+	// Get the terms of the topic.
+	m_topics.push_back(Topic());
+	m_topics.back().field = field;
+	TermsOf(field, m_topics.back().terms);
+	m_fields.Insert(field, slot);
+
+	// Append it to the postings.
+	const std::vector<uint32_t>& vecTerms = m_topics.back().terms;
+	for (size_t i = 0; i < vecTerms.size(); i++)
+		m_terms[vecTerms[i]].postings.push_back(slot);
+}
+
+/**
+ * Marks a topic and all of its children as dead. They'll be removed from the
+ * postings the next time the index is compacted.
+ *
+ * @param field Topic to be removed.
+ *
+ * @return Number of topics in the subtree.
+ */
+uint32_t TextIndex::RemoveSubtree(Field *field) {
+	uint32_t count = 1;
+	uint32_t slot = m_fields.Find(field);
+	if (slot != BOLOTA_FIELDTABLE_NONE) {
+		m_topics[slot].field = NULL;
+		std::vector<uint32_t>().swap(m_topics[slot].terms);
+		m_fields.Remove(field);
+		m_ulDead++;
+	}
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		count += RemoveSubtree(child);
+
+	return count;
+}
+
+/**
+ * Updates the postings of a topic whose text has changed, only touching the
+ * terms that were actually added or removed.
+ *
+ * @param field Topic that was changed.
+ */
+void TextIndex::UpdateTopic(Field *field) {
+	std::vector<uint32_t> vecTerms;
+
+	// Check if we know about this topic.
+	uint32_t slot = m_fields.Find(field);
+	if (slot == BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	// Compare the old and new terms. (both sorted)
+	TermsOf(field, vecTerms);
+	const std::vector<uint32_t>& vecOld = m_topics[slot].terms;
+	size_t i = 0;
+	size_t j = 0;
+	while ((i < vecOld.size()) || (j < vecTerms.size())) {
+		if ((j >= vecTerms.size()) ||
+				((i < vecOld.size()) && (vecOld[i] < vecTerms[j]))) {
+			RemovePosting(m_terms[vecOld[i]].postings, slot);
+			i++;
+		} else if ((i >= vecOld.size()) || (vecTerms[j] < vecOld[i])) {
+			InsertPosting(m_terms[vecTerms[j]].postings, slot);
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+
+	m_topics[slot].terms.swap(vecTerms);
+}
+
+/**
+ * Gets the distinct terms of the text of a topic, adding new ones to the
+ * dictionary.
+ *
+ * @param field    Topic to get the terms from.
+ * @param vecTerms Vector to receive the sorted terms.
+ */
+void TextIndex::TermsOf(Field *field, std::vector<uint32_t>& vecTerms) {
+	char szTerm[BOLOTA_TEXTINDEX_TERM_MAX];
+	size_t ulPos = 0;
+	size_t ulStart;
+	size_t ulEnd;
+
+	vecTerms.clear();
+	if (!field->HasText())
+		return;
+
+	// Look up every word of the text.
+	const char *mbstr = field->Text()->GetMultiByteString();
+	size_t ulLength = field->TextLength();
+	while (NextWord(mbstr, ulLength, &ulPos, &ulStart, &ulEnd)) {
+		size_t ulTerm = Normalize(mbstr + ulStart, ulEnd - ulStart, szTerm);
+		vecTerms.push_back(AddTerm(szTerm, ulTerm));
+	}
+
+	// Get rid of the repeated ones.
+	std::sort(vecTerms.begin(), vecTerms.end());
+	vecTerms.erase(std::unique(vecTerms.begin(), vecTerms.end()),
+		vecTerms.end());
+}
+
+/**
+ * Gets the terms of the text of a topic in the order they appear in it.
+ *
+ * @param field    Topic to get the terms from.
+ * @param vecTerms Vector to receive the terms. Words that aren't in the
+ *                 dictionary are BOLOTA_TEXTINDEX_NONE.
+ */
+void TextIndex::SequenceOf(Field *field,
+						   std::vector<uint32_t>& vecTerms) const {
+	char szTerm[BOLOTA_TEXTINDEX_TERM_MAX];
+	size_t ulPos = 0;
+	size_t ulStart;
+	size_t ulEnd;
+
+	vecTerms.clear();
+	if (!field->HasText())
+		return;
+
+	const char *mbstr = field->Text()->GetMultiByteString();
+	size_t ulLength = field->TextLength();
+	while (NextWord(mbstr, ulLength, &ulPos, &ulStart, &ulEnd)) {
+		size_t ulTerm = Normalize(mbstr + ulStart, ulEnd - ulStart, szTerm);
+		vecTerms.push_back(FindTerm(szTerm, ulTerm));
+	}
+}
+
+/**
+ * Drops the dead topics from the postings and the terms that are no longer
+ * used by any topic from the dictionary. Topics are numbered again in
+ * document order and terms keep their relative order, so the postings and the
+ * terms of each topic stay sorted.
+ */
+void TextIndex::Compact() {
+	std::vector<uint32_t> vecTermMap(m_terms.size(), BOLOTA_TEXTINDEX_NONE);
+	std::vector<Topic> vecTopics;
+	std::vector<Term> vecTerms;
+	std::vector<char> vecChars;
+	size_t i;
+	size_t j;
+
+	// Keep only the live topics, in document order.
+	vecTopics.reserve(Count());
+	for (uint32_t pos = 0; pos < m_order.Count(); pos++) {
+		uint32_t slot = m_fields.Find(m_order.At(pos));
+		if (slot == BOLOTA_FIELDTABLE_NONE)
+			continue;
+
+		vecTopics.push_back(Topic());
+		vecTopics.back().field = m_topics[slot].field;
+		vecTopics.back().terms.swap(m_topics[slot].terms);
+	}
+
+	// Find out which terms are still being used.
+	for (i = 0; i < vecTopics.size(); i++) {
+		for (j = 0; j < vecTopics[i].terms.size(); j++)
+			vecTermMap[vecTopics[i].terms[j]] = 0;
+	}
+
+	// Build the new dictionary.
+	for (i = 0; i < m_terms.size(); i++) {
+		if (vecTermMap[i] == BOLOTA_TEXTINDEX_NONE)
+			continue;
+
+		vecTermMap[i] = (uint32_t)vecTerms.size();
+		vecTerms.push_back(Term());
+		vecTerms.back().ulOffset = (uint32_t)vecChars.size();
+		vecTerms.back().ulLength = m_terms[i].ulLength;
+		vecTerms.back().hash = m_terms[i].hash;
+		vecChars.insert(vecChars.end(), m_chars.begin() + m_terms[i].ulOffset,
+			m_chars.begin() + m_terms[i].ulOffset + m_terms[i].ulLength);
+	}
+
+	// Renumber everything and rebuild the postings.
+	for (i = 0; i < vecTopics.size(); i++) {
+		std::vector<uint32_t>& vecTopicTerms = vecTopics[i].terms;
+		for (j = 0; j < vecTopicTerms.size(); j++) {
+			vecTopicTerms[j] = vecTermMap[vecTopicTerms[j]];
+			vecTerms[vecTopicTerms[j]].postings.push_back((uint32_t)i);
+		}
+	}
+
+	// Swap in the new structures and rebuild the hash tables.
+	m_topics.swap(vecTopics);
+	m_terms.swap(vecTerms);
+	m_chars.swap(vecChars);
+	m_ulDead = 0;
+	m_ulOrdered = (uint32_t)m_topics.size();
+	RehashTerms(m_termTable.size());
+	m_fields.Clear();
+	m_fields.Reserve(m_topics.size());
+	for (i = 0; i < m_topics.size(); i++)
+		m_fields.Insert(m_topics[i].field, (uint32_t)i);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Query Helpers                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Parses a query into groups of clauses, where each group is an alternative
+ * whose clauses must all match.
+ *
+ * @param szQuery   Query to be parsed.
+ * @param vecGroups Vector to receive the alternatives. Words that aren't in
+ *                  the dictionary are kept as BOLOTA_TEXTINDEX_NONE.
+ *
+ * @return TRUE if there's anything to search for.
+ */
+bool TextIndex::ParseQuery(const char *szQuery,
+						   std::vector<std::vector<Clause> >& vecGroups) const {
+	char szTerm[BOLOTA_TEXTINDEX_TERM_MAX];
+	size_t ulLength = strlen(szQuery);
+	bool bQuoted = false;
+	size_t ulSegment = 0;
+
+	vecGroups.clear();
+	vecGroups.push_back(std::vector<Clause>());
+	while (ulSegment <= ulLength) {
+		// Get the segment up to the next quote.
+		const char *szEnd = strchr(szQuery + ulSegment, '"');
+		size_t ulEnd = (szEnd != NULL) ? (size_t)(szEnd - szQuery) : ulLength;
+		const char *mbstr = szQuery + ulSegment;
+		size_t ulSegLength = ulEnd - ulSegment;
+		size_t ulPos = 0;
+		size_t ulStart;
+		size_t ulWordEnd;
+
+		// Quoted words are all part of a single phrase.
+		Clause phrase;
+		phrase.bPhrase = true;
+		while (NextWord(mbstr, ulSegLength, &ulPos, &ulStart, &ulWordEnd)) {
+			// Start a new alternative.
+			if (!bQuoted && ((ulWordEnd - ulStart) == 2) &&
+					(strncmp(mbstr + ulStart, "OR", 2) == 0)) {
+				if (!vecGroups.back().empty())
+					vecGroups.push_back(std::vector<Clause>());
+				continue;
+			}
+
+			size_t ulTerm = Normalize(mbstr + ulStart, ulWordEnd - ulStart,
+				szTerm);
+			uint32_t term = FindTerm(szTerm, ulTerm);
+			if (bQuoted) {
+				phrase.terms.push_back(term);
+			} else {
+				Clause clause;
+				clause.bPhrase = false;
+				clause.terms.push_back(term);
+				vecGroups.back().push_back(clause);
+			}
+		}
+
+		// Single word phrases don't need to be checked for sequence.
+		if (!phrase.terms.empty()) {
+			phrase.bPhrase = phrase.terms.size() > 1;
+			vecGroups.back().push_back(phrase);
+		}
+
+		bQuoted = !bQuoted;
+		ulSegment = ulEnd + 1;
+	}
+
+	// Drop the empty alternatives.
+	if (vecGroups.back().empty())
+		vecGroups.pop_back();
+
+	return !vecGroups.empty();
+}
+
+/**
+ * Finds the topics that match all the clauses of an alternative, by
+ * intersecting the postings of their terms starting with the shortest ones.
+ *
+ * @param vecClauses Clauses to be matched.
+ * @param vecSlots   Vector to receive the matching topics, sorted by number.
+ */
+void TextIndex::MatchGroup(const std::vector<Clause>& vecClauses,
+						   std::vector<uint32_t>& vecSlots) {
+	std::vector<std::pair<size_t, uint32_t> > vecOrder;
+	std::vector<uint32_t> vecSequence;
+	size_t i;
+	size_t j;
+
+	// Gather the terms ordered by the length of their postings.
+	vecSlots.clear();
+	for (i = 0; i < vecClauses.size(); i++) {
+		for (j = 0; j < vecClauses[i].terms.size(); j++) {
+			uint32_t term = vecClauses[i].terms[j];
+			if (term == BOLOTA_TEXTINDEX_NONE)
+				return;
+
+			vecOrder.push_back(std::make_pair(m_terms[term].postings.size(),
+				term));
+		}
+	}
+	if (vecOrder.empty())
+		return;
+	std::sort(vecOrder.begin(), vecOrder.end());
+
+	// Intersect the postings.
+	const std::vector<uint32_t>& vecFirst =
+		m_terms[vecOrder[0].second].postings;
+	vecSlots.reserve(vecFirst.size());
+	for (i = 0; i < vecFirst.size(); i++) {
+		if (m_topics[vecFirst[i]].field != NULL)
+			vecSlots.push_back(vecFirst[i]);
+	}
+	for (i = 1; (i < vecOrder.size()) && !vecSlots.empty(); i++) {
+		if (vecOrder[i].second != vecOrder[i - 1].second)
+			Intersect(vecSlots, m_terms[vecOrder[i].second].postings);
+	}
+
+	// Check the phrases of the candidates.
+	for (i = 0; i < vecClauses.size(); i++) {
+		if (!vecClauses[i].bPhrase)
+			continue;
+
+		size_t ulKept = 0;
+		for (j = 0; j < vecSlots.size(); j++) {
+			if (MatchPhrase(m_topics[vecSlots[j]].field, vecClauses[i].terms,
+					vecSequence)) {
+				vecSlots[ulKept++] = vecSlots[j];
+			}
+		}
+		vecSlots.resize(ulKept);
+	}
+}
+
+/**
+ * Checks if the words of a phrase appear in sequence in the text of a topic.
+ *
+ * @param field       Topic to be checked.
+ * @param vecPhrase   Terms of the phrase.
+ * @param vecSequence Scratch vector to hold the terms of the topic.
+ *
+ * @return TRUE if the topic contains the phrase.
+ */
+bool TextIndex::MatchPhrase(Field *field,
+							const std::vector<uint32_t>& vecPhrase,
+							std::vector<uint32_t>& vecSequence) const {
+	SequenceOf(field, vecSequence);
+	return std::search(vecSequence.begin(), vecSequence.end(),
+		vecPhrase.begin(), vecPhrase.end()) != vecSequence.end();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Postings Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Keeps only the topics that are also in a list of postings. Both lists are
+ * sorted, so we can skip ahead with a binary search from where we stopped.
+ *
+ * @param vecSlots    Topics to be filtered.
+ * @param vecPostings Postings of a term.
+ */
+void TextIndex::Intersect(std::vector<uint32_t>& vecSlots,
+						  const std::vector<uint32_t>& vecPostings) {
+	std::vector<uint32_t>::const_iterator it = vecPostings.begin();
+	size_t ulKept = 0;
+
+	for (size_t i = 0; (i < vecSlots.size()) && (it != vecPostings.end());
+			i++) {
+		it = std::lower_bound(it, vecPostings.end(), vecSlots[i]);
+		if ((it != vecPostings.end()) && (*it == vecSlots[i]))
+			vecSlots[ulKept++] = vecSlots[i];
+	}
+
+	vecSlots.resize(ulKept);
+}
+
+/**
+ * Inserts a topic into a list of postings, keeping it sorted.
+ *
+ * @param vecPostings Postings of a term.
+ * @param slot        Topic to be inserted.
+ */
+void TextIndex::InsertPosting(std::vector<uint32_t>& vecPostings,
+							  uint32_t slot) {
+	std::vector<uint32_t>::iterator it = std::lower_bound(vecPostings.begin(),
+		vecPostings.end(), slot);
+	if ((it == vecPostings.end()) || (*it != slot))
+		vecPostings.insert(it, slot);
+}
+
+/**
+ * Removes a topic from a list of postings.
+ *
+ * @param vecPostings Postings of a term.
+ * @param slot        Topic to be removed.
+ */
+void TextIndex::RemovePosting(std::vector<uint32_t>& vecPostings,
+							  uint32_t slot) {
+	std::vector<uint32_t>::iterator it = std::lower_bound(vecPostings.begin(),
+		vecPostings.end(), slot);
+	if ((it != vecPostings.end()) && (*it == slot))
+		vecPostings.erase(it);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Dictionary Helpers                             |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Hashes a term using FNV-1a.
+ *
+ * @param szTerm   Term to be hashed.
+ * @param ulLength Length of the term in bytes.
+ *
+ * @return Hash of the term.
+ */
+uint32_t TextIndex::Hash(const char *szTerm, size_t ulLength) {
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < ulLength; i++) {
+		hash ^= (unsigned char)szTerm[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/**
+ * Looks up a term in the dictionary.
+ *
+ * @param szTerm   Normalized term to look for.
+ * @param ulLength Length of the term in bytes.
+ *
+ * @return Number of the term or BOLOTA_TEXTINDEX_NONE if it isn't in the
+ *         dictionary.
+ */
+uint32_t TextIndex::FindTerm(const char *szTerm, size_t ulLength) const {
+	uint32_t hash = Hash(szTerm, ulLength);
+	size_t mask = m_termTable.size() - 1;
+	size_t slot = hash & mask;
+
+	while (m_termTable[slot] != 0) {
+		const Term& term = m_terms[m_termTable[slot] - 1];
+		if ((term.hash == hash) && (term.ulLength == ulLength) &&
+				(memcmp(&m_chars[term.ulOffset], szTerm, ulLength) == 0)) {
+			return m_termTable[slot] - 1;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return BOLOTA_TEXTINDEX_NONE;
+}
+
+/**
+ * Gets the number of a term, adding it to the dictionary if needed.
+ *
+ * @param szTerm   Normalized term.
+ * @param ulLength Length of the term in bytes.
+ *
+ * @return Number of the term.
+ */
+uint32_t TextIndex::AddTerm(const char *szTerm, size_t ulLength) {
+	uint32_t index = FindTerm(szTerm, ulLength);
+	if (index != BOLOTA_TEXTINDEX_NONE)
+		return index;
+
+	// Keep the load factor under 75%.
+	if ((m_terms.size() + 1) * 4 > m_termTable.size() * 3)
+		RehashTerms(m_termTable.size() * 2);
+
+	// Store the term.
+	index = (uint32_t)m_terms.size();
+	m_terms.push_back(Term());
+	Term& term = m_terms.back();
+	term.ulOffset = (uint32_t)m_chars.size();
+	term.ulLength = (uint32_t)ulLength;
+	term.hash = Hash(szTerm, ulLength);
+	m_chars.insert(m_chars.end(), szTerm, szTerm + ulLength);
+
+	// Put it in the hash table.
+	size_t mask = m_termTable.size() - 1;
+	size_t slot = term.hash & mask;
+	while (m_termTable[slot] != 0)
+		slot = (slot + 1) & mask;
+	m_termTable[slot] = index + 1;
+
+	return index;
+}
+
+/**
+ * Rebuilds the hash table of the dictionary.
+ *
+ * @param ulSlots Minimum number of slots of the new table. (must be a power
+ *                of 2)
+ */
+void TextIndex::RehashTerms(size_t ulSlots) {
+	while ((m_terms.size() * 4) > (ulSlots * 3))
+		ulSlots *= 2;
+	std::vector<uint32_t>(ulSlots, 0).swap(m_termTable);
+
+	size_t mask = ulSlots - 1;
+	for (size_t i = 0; i < m_terms.size(); i++) {
+		size_t slot = m_terms[i].hash & mask;
+		while (m_termTable[slot] != 0)
+			slot = (slot + 1) & mask;
+		m_termTable[slot] = (uint32_t)i + 1;
+	}
+}
@@ -0,0 +1,171 @@
+/**
+ * TextIndex.h
+ * Inverted index of the words in the texts of the topics of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_TEXTINDEX_H
+#define _BOLOTA_INDEXES_TEXTINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "DocumentIndex.h"
+#include "FieldTable.h"
+#include "TopicOrder.h"
+
+/**
+ * Initial number of slots of the dictionary hash table. (must be a power of 2)
+ */
+#define BOLOTA_TEXTINDEX_SLOTS 1024
+
+/**
+ * Maximum length of a term in bytes. Longer words are cut short.
+ */
+#define BOLOTA_TEXTINDEX_TERM_MAX 64
+
+/**
+ * Number of removed topics that are tolerated before the postings are
+ * compacted, on top of half the topics that are still in the index.
+ */
+#define BOLOTA_TEXTINDEX_DEAD_MIN 1024
+
+/**
+ * Value used for terms and topics that aren't in the index.
+ */
+#define BOLOTA_TEXTINDEX_NONE ((uint32_t)-1)
+
+namespace Bolota {
+
+	/**
+	 * Inverted index of the words in the texts of the topics of a document,
+	 * mapping each term to the sorted list of topics that contain it.
+	 *
+	 * Words are runs of ASCII letters and digits or of any non-ASCII
+	 * character, compared without regard to ASCII case. Queries are made of
+	 * words that must all be present in a topic, double quoted phrases whose
+	 * words must appear in sequence, and OR to separate alternatives. Phrases
+	 * are matched by looking up the candidates' texts, so positions don't have
+	 * to be stored.
+	 *
+	 * Topics are numbered in the order they were added. Removed topics are
+	 * only marked as dead and get dropped from the postings once there are
+	 * enough of them, which keeps removing large subtrees cheap. Building or
+	 * compacting the index numbers the topics in document order, and a list
+	 * of the topics in display order is kept up to date alongside them, so
+	 * only the results that were inserted since then have to be looked up in
+	 * it to be put in document order.
+	 */
+	class TextIndex : public DocumentIndex {
+	protected:
+		// Term of the dictionary.
+		struct Term {
+			uint32_t ulOffset;
+			uint32_t ulLength;
+			uint32_t hash;
+			std::vector<uint32_t> postings;
+		};
+
+		// Topic in the index.
+		struct Topic {
+			Field *field;
+			std::vector<uint32_t> terms;
+		};
+
+		// Part of a query that must match.
+		struct Clause {
+			std::vector<uint32_t> terms;
+			bool bPhrase;
+		};
+
+		// Dictionary.
+		std::vector<char> m_chars;
+		std::vector<Term> m_terms;
+		std::vector<uint32_t> m_termTable;
+
+		// Topics.
+		std::vector<Topic> m_topics;
+		FieldTable m_fields;
+		size_t m_ulDead;
+
+		// Document order.
+		TopicOrder m_order;
+		uint32_t m_ulOrdered;
+
+	public:
+		// Constructors and destructors.
+		TextIndex();
+		virtual ~TextIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Searching.
+		size_t Search(const char *szQuery, std::vector<Field*>& vecResults);
+		size_t Search(const wchar_t *szQuery, std::vector<Field*>& vecResults);
+
+		// Statistics.
+		size_t Count() const;
+		size_t TermCount() const;
+		size_t HeapSize() const;
+
+		// Tokenization.
+		static bool NextWord(const char *mbstr, size_t ulLength, size_t *pulPos,
+			size_t *pulStart, size_t *pulEnd);
+		static size_t Normalize(const char *mbstr, size_t ulLength,
+			char *szTerm);
+
+	protected:
+		// Topic management.
+		void AddSubtree(Field *field);
+		void AddTopic(Field *field);
+		uint32_t RemoveSubtree(Field *field);
+		void UpdateTopic(Field *field);
+		void TermsOf(Field *field, std::vector<uint32_t>& vecTerms);
+		void SequenceOf(Field *field, std::vector<uint32_t>& vecTerms) const;
+		void Compact();
+
+		// Query helpers.
+		bool ParseQuery(const char *szQuery,
+			std::vector<std::vector<Clause> >& vecGroups) const;
+		void MatchGroup(const std::vector<Clause>& vecClauses,
+			std::vector<uint32_t>& vecSlots);
+		bool MatchPhrase(Field *field, const std::vector<uint32_t>& vecPhrase,
+			std::vector<uint32_t>& vecSequence) const;
+
+		// Postings helpers.
+		static void Intersect(std::vector<uint32_t>& vecSlots,
+			const std::vector<uint32_t>& vecPostings);
+		static void InsertPosting(std::vector<uint32_t>& vecPostings,
+			uint32_t slot);
+		static void RemovePosting(std::vector<uint32_t>& vecPostings,
+			uint32_t slot);
+
+		// Dictionary helpers.
+		static uint32_t Hash(const char *szTerm, size_t ulLength);
+		uint32_t FindTerm(const char *szTerm, size_t ulLength) const;
+		uint32_t AddTerm(const char *szTerm, size_t ulLength);
+		void RehashTerms(size_t ulSlots);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_TEXTINDEX_H
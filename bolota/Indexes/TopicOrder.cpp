@@ -0,0 +1,542 @@
+/**
+ * TopicOrder.cpp
+ * Blocked list of the topics of a document in display order.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "TopicOrder.h"
+
+#include <algorithm>
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty list.
+ */
+TopicOrder::TopicOrder() {
+	m_count = 0;
+}
+
+/**
+ * Frees up the blocks of the list.
+ */
+TopicOrder::~TopicOrder() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the list from scratch.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void TopicOrder::Build(Field *first) {
+	std::vector<Field*> vecFields;
+
+	Clear();
+	for (Field *field = first; field != NULL; field = field->Next())
+		Collect(field, vecFields);
+
+	m_table.Reserve(vecFields.size());
+	Insert(0, vecFields);
+}
+
+/**
+ * Removes every topic from the list.
+ */
+void TopicOrder::Clear() {
+	for (size_t i = 0; i < m_blocks.size(); i++)
+		delete m_blocks[i];
+
+	std::vector<Block*>().swap(m_blocks);
+	std::vector<Block*>().swap(m_ids);
+	std::vector<uint32_t>().swap(m_free);
+	m_table.Clear();
+	m_count = 0;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Editing                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Inserts topics into the list, shifting every topic after them.
+ *
+ * @param pos       Position of the first topic. Must not be greater than the
+ *                  number of topics in the list.
+ * @param vecFields Topics to be inserted, in display order.
+ */
+void TopicOrder::Insert(uint32_t pos, const std::vector<Field*>& vecFields) {
+	if (vecFields.empty() || (pos > m_count))
+		return;
+
+	// Find the block that will hold the topics.
+	if (m_blocks.empty())
+		m_blocks.push_back(NewBlock());
+	size_t index = (pos == m_count) ? m_blocks.size() - 1 : FindBlock(pos);
+	Block *block = m_blocks[index];
+
+	// Put them in place.
+	size_t offset = pos - block->start;
+	m_count += (uint32_t)vecFields.size();
+	if ((block->fields.size() + vecFields.size()) <= BOLOTA_TOPICORDER_BLOCK) {
+		block->fields.insert(block->fields.begin() + offset,
+			vecFields.begin(), vecFields.end());
+		for (size_t i = 0; i < vecFields.size(); i++)
+			m_table.Insert(vecFields[i], block->id);
+	} else {
+		// Too many for a single block, so lay everything out in new ones.
+		std::vector<Field*> vecAll;
+		vecAll.reserve(block->fields.size() + vecFields.size());
+		vecAll.insert(vecAll.end(), block->fields.begin(),
+			block->fields.begin() + offset);
+		vecAll.insert(vecAll.end(), vecFields.begin(), vecFields.end());
+		vecAll.insert(vecAll.end(), block->fields.begin() + offset,
+			block->fields.end());
+
+		Spread(index, vecAll);
+	}
+
+	UpdateStarts(index);
+}
+
+/**
+ * Removes a range of topics from the list, shifting every topic after them.
+ *
+ * @param pos   Position of the first topic to be removed.
+ * @param count Number of topics to be removed.
+ */
+void TopicOrder::Remove(uint32_t pos, uint32_t count) {
+	if ((count == 0) || (pos >= m_count))
+		return;
+	if (count > (m_count - pos))
+		count = m_count - pos;
+
+	// Go through the blocks that overlap the range.
+	size_t first = FindBlock(pos);
+	size_t index = first;
+	uint32_t end = pos + count;
+	while ((index < m_blocks.size()) && (m_blocks[index]->start < end)) {
+		Block *block = m_blocks[index];
+		uint32_t from = std::max(pos, block->start) - block->start;
+		uint32_t to = std::min(end, block->start +
+			(uint32_t)block->fields.size()) - block->start;
+
+		for (uint32_t i = from; i < to; i++)
+			m_table.Remove(block->fields[i]);
+		block->fields.erase(block->fields.begin() + from,
+			block->fields.begin() + to);
+
+		// Get rid of blocks that are now empty.
+		if (block->fields.empty()) {
+			FreeBlock(block);
+			m_blocks.erase(m_blocks.begin() + index);
+		} else {
+			index++;
+		}
+	}
+	m_count -= count;
+
+	// Keep the blocks around the gap from getting too small.
+	if (first > 0)
+		first--;
+	MergeNext(first);
+	MergeNext(first + 1);
+	if (!m_blocks.empty())
+		m_blocks[0]->start = 0;
+	UpdateStarts(first);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Lookups                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the list.
+ *
+ * @return Number of topics.
+ */
+uint32_t TopicOrder::Count() const {
+	return m_count;
+}
+
+/**
+ * Gets the position of a topic in display order.
+ *
+ * @param field Topic to be looked up.
+ *
+ * @return Zero-based position of the topic or BOLOTA_POS_NONE if it isn't in
+ *         the list.
+ */
+uint32_t TopicOrder::Position(const Field *field) const {
+	uint32_t id = m_table.Find(field);
+	if (id == BOLOTA_FIELDTABLE_NONE)
+		return BOLOTA_POS_NONE;
+
+	const Block *block = m_ids[id];
+	for (size_t i = 0; i < block->fields.size(); i++) {
+		if (block->fields[i] == field)
+			return block->start + (uint32_t)i;
+	}
+
+	return BOLOTA_POS_NONE;
+}
+
+/**
+ * Gets the positions of many topics at once. Topics are grouped by the block
+ * they're in, so each block is only scanned once no matter how many of them
+ * it holds.
+ *
+ * @param vecFields    Topics to be looked up.
+ * @param vecPositions Vector to receive the position of each topic or
+ *                     BOLOTA_POS_NONE for the ones that aren't in the list.
+ */
+void TopicOrder::Positions(const std::vector<Field*>& vecFields,
+						   std::vector<uint32_t>& vecPositions) const {
+	std::vector<std::pair<uint32_t, uint32_t> > vecBlocks;
+	std::vector<std::pair<const Field*, uint32_t> > vecGroup;
+	size_t i;
+	size_t j;
+
+	// Find out which block each topic is in.
+	vecPositions.assign(vecFields.size(), BOLOTA_POS_NONE);
+	vecBlocks.reserve(vecFields.size());
+	for (i = 0; i < vecFields.size(); i++) {
+		uint32_t id = m_table.Find(vecFields[i]);
+		if (id != BOLOTA_FIELDTABLE_NONE)
+			vecBlocks.push_back(std::make_pair(id, (uint32_t)i));
+	}
+	std::sort(vecBlocks.begin(), vecBlocks.end());
+
+	// Match the topics of each block in a single pass over it.
+	for (i = 0; i < vecBlocks.size(); i = j) {
+		const Block *block = m_ids[vecBlocks[i].first];
+
+		vecGroup.clear();
+		for (j = i; (j < vecBlocks.size()) &&
+				(vecBlocks[j].first == vecBlocks[i].first); j++) {
+			vecGroup.push_back(std::make_pair(
+				(const Field*)vecFields[vecBlocks[j].second],
+				vecBlocks[j].second));
+		}
+		std::sort(vecGroup.begin(), vecGroup.end());
+
+		for (size_t k = 0; k < block->fields.size(); k++) {
+			const Field *field = block->fields[k];
+			std::vector<std::pair<const Field*, uint32_t> >::iterator it =
+				std::lower_bound(vecGroup.begin(), vecGroup.end(),
+					std::make_pair(field, (uint32_t)0));
+			for (; (it != vecGroup.end()) && (it->first == field); it++)
+				vecPositions[it->second] = block->start + (uint32_t)k;
+		}
+	}
+}
+
+/**
+ * Gets the topic at a position in display order.
+ *
+ * @param pos Zero-based position of the topic.
+ *
+ * @return Topic at the position or NULL if it's out of bounds.
+ */
+Field* TopicOrder::At(uint32_t pos) const {
+	if (pos >= m_count)
+		return NULL;
+
+	const Block *block = m_blocks[FindBlock(pos)];
+	return block->fields[pos - block->start];
+}
+
+/**
+ * Gets the position where a topic that was just linked into the document
+ * should be inserted.
+ *
+ * @param field Topic that was linked into the document.
+ *
+ * @return Position of the topic or BOLOTA_POS_NONE if the topic right before
+ *         it isn't in the list.
+ */
+uint32_t TopicOrder::InsertionPoint(Field *field) const {
+	// First children come right after their parents.
+	if (!field->HasPrevious()) {
+		if (!field->HasParent())
+			return 0;
+
+		uint32_t pos = Position(field->Parent());
+		return (pos == BOLOTA_POS_NONE) ? pos : pos + 1;
+	}
+
+	// Otherwise it's right after the last descendant of our previous sibling.
+	Field *prev = field->Previous();
+	while (prev->HasChild()) {
+		prev = prev->Child();
+		while (prev->HasNext())
+			prev = prev->Next();
+	}
+
+	uint32_t pos = Position(prev);
+	return (pos == BOLOTA_POS_NONE) ? pos : pos + 1;
+}
+
+/**
+ * Sorts a list of topics in display order. The topics at the start of the list
+ * are expected to already be in order, so only the ones after them have to be
+ * looked up and merged in.
+ *
+ * @param vecFields Topics to be sorted. Those that aren't in the list end up
+ *                  at the end.
+ * @param ulOrdered Number of topics at the start that are already in order.
+ */
+void TopicOrder::Sort(std::vector<Field*>& vecFields, size_t ulOrdered) const {
+	std::vector<std::pair<uint32_t, Field*> > vecRanked;
+	std::vector<uint32_t> vecPositions;
+	std::vector<Field*> vecMerged;
+	size_t ulNew = vecFields.size() - ulOrdered;
+	size_t i;
+	size_t j;
+
+	if (ulNew == 0)
+		return;
+
+	// Binary searching for each of the new topics takes a couple dozen
+	// lookups, so it's only worth it while there aren't many of them.
+	if ((ulNew * 32) > ulOrdered)
+		ulOrdered = 0;
+
+	// Put the new topics in order.
+	std::vector<Field*> vecNew(vecFields.begin() + ulOrdered, vecFields.end());
+	Positions(vecNew, vecPositions);
+	vecRanked.reserve(vecNew.size());
+	for (i = 0; i < vecNew.size(); i++)
+		vecRanked.push_back(std::make_pair(vecPositions[i], vecNew[i]));
+	std::sort(vecRanked.begin(), vecRanked.end());
+
+	// Merge them in with the ones that were already in order.
+	vecMerged.reserve(vecFields.size());
+	for (i = 0, j = 0; j < vecRanked.size(); j++) {
+		size_t ulFirst = i;
+		size_t ulLast = ulOrdered;
+
+		// Find the first topic that comes after the new one.
+		while (ulFirst < ulLast) {
+			size_t ulMiddle = ulFirst + ((ulLast - ulFirst) / 2);
+			if (Position(vecFields[ulMiddle]) < vecRanked[j].first) {
+				ulFirst = ulMiddle + 1;
+			} else {
+				ulLast = ulMiddle;
+			}
+		}
+
+		vecMerged.insert(vecMerged.end(), vecFields.begin() + i,
+			vecFields.begin() + ulFirst);
+		vecMerged.push_back(vecRanked[j].second);
+		i = ulFirst;
+	}
+	vecMerged.insert(vecMerged.end(), vecFields.begin() + i,
+		vecFields.begin() + ulOrdered);
+	vecFields.swap(vecMerged);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Statistics                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Estimates the memory used by the list.
+ *
+ * @return Number of bytes allocated by the list.
+ */
+size_t TopicOrder::HeapSize() const {
+	size_t ulSize = (m_blocks.capacity() + m_ids.capacity()) * sizeof(Block*) +
+		(m_free.capacity() * sizeof(uint32_t)) + m_table.HeapSize();
+
+	for (size_t i = 0; i < m_blocks.size(); i++) {
+		ulSize += sizeof(Block) +
+			(m_blocks[i]->fields.capacity() * sizeof(Field*));
+	}
+
+	return ulSize;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Document Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Appends a topic and all of its children to a list in display order.
+ *
+ * @param field     Root of the subtree.
+ * @param vecFields Vector to have the topics appended to.
+ */
+void TopicOrder::Collect(Field *field, std::vector<Field*>& vecFields) {
+	vecFields.push_back(field);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		Collect(child, vecFields);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Block Management                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the block that holds a position.
+ *
+ * @param pos Position to look for. Must be within the list.
+ *
+ * @return Index of the block.
+ */
+size_t TopicOrder::FindBlock(uint32_t pos) const {
+	size_t lo = 0;
+	size_t hi = m_blocks.size();
+
+	// Find the last block that starts at or before the position.
+	while ((hi - lo) > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (m_blocks[mid]->start <= pos) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Allocates an empty block, reusing the identifier of a free'd one if there's
+ * any.
+ *
+ * @return Newly allocated block.
+ */
+TopicOrder::Block* TopicOrder::NewBlock() {
+	Block *block = new Block;
+	block->start = 0;
+
+	if (!m_free.empty()) {
+		block->id = m_free.back();
+		m_free.pop_back();
+		m_ids[block->id] = block;
+	} else {
+		block->id = (uint32_t)m_ids.size();
+		m_ids.push_back(block);
+	}
+
+	return block;
+}
+
+/**
+ * Frees a block and releases its identifier.
+ *
+ * @param block Block to be free'd.
+ */
+void TopicOrder::FreeBlock(Block *block) {
+	m_ids[block->id] = NULL;
+	m_free.push_back(block->id);
+	delete block;
+}
+
+/**
+ * Replaces the contents of a block with a list of topics that is too big for
+ * it, spreading them over half-full blocks.
+ *
+ * @param index     Index of the block to be replaced.
+ * @param vecFields Topics to be put in its place.
+ */
+void TopicOrder::Spread(size_t index, const std::vector<Field*>& vecFields) {
+	Block *block = m_blocks[index];
+	size_t ulSize = vecFields.size();
+	size_t ulPiece = BOLOTA_TOPICORDER_BLOCK / 2;
+	size_t ulPieces = (ulSize + ulPiece - 1) / ulPiece;
+
+	// Fill the block that's being replaced and new ones after it.
+	std::vector<Block*> vecBlocks;
+	for (size_t i = 0; i < ulPieces; i++) {
+		Block *piece = (i == 0) ? block : NewBlock();
+		size_t from = (ulSize * i) / ulPieces;
+		size_t to = (ulSize * (i + 1)) / ulPieces;
+
+		piece->fields.assign(vecFields.begin() + from,
+			vecFields.begin() + to);
+		for (size_t j = 0; j < piece->fields.size(); j++)
+			m_table.Insert(piece->fields[j], piece->id);
+		if (i > 0)
+			vecBlocks.push_back(piece);
+	}
+
+	m_blocks.insert(m_blocks.begin() + index + 1, vecBlocks.begin(),
+		vecBlocks.end());
+}
+
+/**
+ * Merges a block with the one after it if they are both small enough.
+ *
+ * @param index Index of the block to be merged.
+ */
+void TopicOrder::MergeNext(size_t index) {
+	if ((index + 1) >= m_blocks.size())
+		return;
+
+	Block *block = m_blocks[index];
+	Block *next = m_blocks[index + 1];
+	if ((block->fields.size() + next->fields.size()) >
+			(BOLOTA_TOPICORDER_BLOCK / 2)) {
+		return;
+	}
+
+	for (size_t i = 0; i < next->fields.size(); i++)
+		m_table.Insert(next->fields[i], block->id);
+	block->fields.insert(block->fields.end(), next->fields.begin(),
+		next->fields.end());
+
+	FreeBlock(next);
+	m_blocks.erase(m_blocks.begin() + index + 1);
+}
+
+/**
+ * Recalculates where each block starts after one of them changed its size.
+ *
+ * @param index Index of the block that changed.
+ */
+void TopicOrder::UpdateStarts(size_t index) {
+	for (size_t i = index + 1; i < m_blocks.size(); i++) {
+		m_blocks[i]->start = m_blocks[i - 1]->start +
+			(uint32_t)m_blocks[i - 1]->fields.size();
+	}
+}
@@ -0,0 +1,104 @@
+/**
+ * TopicOrder.h
+ * Blocked list of the topics of a document in display order.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_TOPICORDER_H
+#define _BOLOTA_INDEXES_TOPICORDER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Field.h"
+#include "FieldTable.h"
+#include "PositionIndex.h"
+
+/**
+ * Maximum number of topics in a block of the list.
+ */
+#define BOLOTA_TOPICORDER_BLOCK 512
+
+namespace Bolota {
+
+	/**
+	 * List of the topics of a document in display (pre-)order, used by the
+	 * indexes that are keyed by position to map between topics and their
+	 * positions.
+	 *
+	 * Topics are kept in small blocks in order and a hash table tells which
+	 * block each topic is in, so finding the position of a topic only scans
+	 * a single block and finding the topic at a position is a binary search
+	 * over the blocks. Inserting or removing topics only reshapes the blocks
+	 * where it happens.
+	 */
+	class TopicOrder {
+	protected:
+		// Block of topics.
+		struct Block {
+			uint32_t id;
+			uint32_t start;
+			std::vector<Field*> fields;
+		};
+
+		// Blocks in display order.
+		std::vector<Block*> m_blocks;
+		uint32_t m_count;
+
+		// Blocks by their identifier.
+		std::vector<Block*> m_ids;
+		std::vector<uint32_t> m_free;
+		FieldTable m_table;
+
+	public:
+		// Constructors and destructors.
+		TopicOrder();
+		virtual ~TopicOrder();
+
+		// Building.
+		void Build(Field *first);
+		void Clear();
+
+		// Editing.
+		void Insert(uint32_t pos, const std::vector<Field*>& vecFields);
+		void Remove(uint32_t pos, uint32_t count);
+
+		// Lookups.
+		uint32_t Count() const;
+		uint32_t Position(const Field *field) const;
+		void Positions(const std::vector<Field*>& vecFields,
+			std::vector<uint32_t>& vecPositions) const;
+		Field* At(uint32_t pos) const;
+		uint32_t InsertionPoint(Field *field) const;
+		void Sort(std::vector<Field*>& vecFields, size_t ulOrdered) const;
+
+		// Statistics.
+		size_t HeapSize() const;
+
+		// Document helpers.
+		static void Collect(Field *field, std::vector<Field*>& vecFields);
+
+	protected:
+		// Block management.
+		size_t FindBlock(uint32_t pos) const;
+		Block* NewBlock();
+		void FreeBlock(Block *block);
+		void Spread(size_t index, const std::vector<Field*>& vecFields);
+		void MergeNext(size_t index);
+		void UpdateStarts(size_t index);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_TOPICORDER_H
@@ -0,0 +1,1100 @@
+/**
+ * TrigramIndex.cpp
+ * Index of the trigrams of the topic texts that narrows down substring
+ * searches and can be saved along with the document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "TrigramIndex.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+#include "../Errors/ErrorCollection.h"
+
+using namespace Bolota;
+
+/**
+ * Initial number of slots of the hash table used while building the postings.
+ * (must be a power of 2)
+ */
+#define BOLOTA_TRIGRAM_BUILD_SLOTS 4096
+
+/**
+ * Postings of a single trigram while the index is being built.
+ */
+struct TrigramList {
+	uint32_t trigram;
+	uint32_t last;
+	uint32_t count;
+	std::vector<uint8_t> bytes;
+};
+
+/**
+ * Folds the case of an ASCII letter. Every other byte is left as is.
+ *
+ * @param c Byte to be folded.
+ *
+ * @return Lower case version of the byte.
+ */
+static inline uint32_t FoldByte(char c) {
+	uint8_t uc = (uint8_t)c;
+	return ((uc >= 'A') && (uc <= 'Z')) ? (uint32_t)(uc | 0x20) : uc;
+}
+
+/**
+ * Scrambles a trigram into a hash.
+ *
+ * @param trigram Trigram to be hashed.
+ *
+ * @return Hash of the trigram.
+ */
+static inline uint32_t HashTrigram(uint32_t trigram) {
+	trigram *= 0x9E3779B1U;
+	return trigram ^ (trigram >> 15);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty trigram index.
+ */
+TrigramIndex::TrigramIndex() {
+	m_hash = 0;
+	m_ulIndexed = 0;
+	m_ulStale = 0;
+	m_ulDead = 0;
+}
+
+/**
+ * Frees up the postings and tables.
+ */
+TrigramIndex::~TrigramIndex() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the index from scratch.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void TrigramIndex::Build(Field *first) {
+	std::vector<bolota_trigram_t> vecTrigrams;
+	std::vector<uint8_t> vecPostings;
+	std::vector<uint32_t> vecMap;
+
+	Clear();
+	m_hash = Snapshot(first);
+	m_ulIndexed = m_topics.size();
+	BuildPostings(vecMap, vecTrigrams, vecPostings);
+}
+
+/**
+ * Removes every topic and trigram from the index.
+ */
+void TrigramIndex::Clear() {
+	std::vector<bolota_trigram_t>().swap(m_trigrams);
+	std::vector<uint8_t>().swap(m_postings);
+	std::vector<Field*>().swap(m_topics);
+	std::vector<uint8_t>().swap(m_stale);
+	std::vector<uint32_t>().swap(m_staleSlots);
+	m_fields.Clear();
+	m_order.Clear();
+	m_hash = 0;
+	m_ulIndexed = 0;
+	m_ulStale = 0;
+	m_ulDead = 0;
+}
+
+/**
+ * Brings the postings up to date with the topics of the document. The topics
+ * are numbered again, but only the texts of the ones that were marked as stale
+ * have to be gone through, since the postings of every other topic can simply
+ * be renumbered.
+ *
+ * @param first First topic of the document. Can be NULL.
+ */
+void TrigramIndex::Refresh(Field *first) {
+	std::vector<bolota_trigram_t> vecTrigrams;
+	std::vector<uint8_t> vecPostings;
+	std::vector<Field*> vecTopics;
+	std::vector<uint8_t> vecStale;
+	std::vector<uint32_t> vecMap;
+	size_t ulIndexed = m_ulIndexed;
+
+	// Hold on to the postings and number the topics again.
+	vecTrigrams.swap(m_trigrams);
+	vecPostings.swap(m_postings);
+	vecTopics.swap(m_topics);
+	vecStale.swap(m_stale);
+	Clear();
+	m_hash = Snapshot(first);
+	m_ulIndexed = m_topics.size();
+
+	// Find the new numbers of the topics whose postings are still valid.
+	vecMap.assign(ulIndexed, BOLOTA_FIELDTABLE_NONE);
+	for (size_t i = 0; i < ulIndexed; i++) {
+		if ((vecTopics[i] != NULL) && !vecStale[i])
+			vecMap[i] = m_fields.Find(vecTopics[i]);
+	}
+
+	BuildPostings(vecMap, vecTrigrams, vecPostings);
+}
+
+/**
+ * Checks if the postings still describe the topics exactly, in which case the
+ * index can be saved without having to be rebuilt.
+ *
+ * @return TRUE if no topics were changed since the index was built.
+ */
+bool TrigramIndex::IsCurrent() const {
+	return (m_ulStale == 0) && (m_ulDead == 0) &&
+		(m_topics.size() == m_ulIndexed);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Notifications                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a topic and all of its children as stale topics, since they aren't in
+ * the postings.
+ *
+ * @param field Topic that was inserted, already linked in place.
+ */
+void TrigramIndex::TopicInserted(Field *field) {
+	std::vector<Field*> vecFields;
+
+	// Check if we already know about this topic.
+	if (m_fields.Find(field) != BOLOTA_FIELDTABLE_NONE)
+		return;
+
+	// New topics get numbered at the end, so keep track of where they are.
+	uint32_t pos = m_order.InsertionPoint(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+	TopicOrder::Collect(field, vecFields);
+	m_order.Insert(pos, vecFields);
+	AddSubtree(field);
+}
+
+/**
+ * Removes a topic and all of its children from the index. Removing topics
+ * doesn't change the order of the ones that are left.
+ *
+ * @param field     Topic to be removed, still linked in place.
+ * @param bDeleting Will the fields be destroyed afterwards?
+ */
+void TrigramIndex::TopicRemoving(Field *field, bool bDeleting) {
+	uint32_t pos = m_order.Position(field);
+	if (pos == BOLOTA_POS_NONE)
+		return;
+
+	m_order.Remove(pos, RemoveSubtree(field));
+}
+
+/**
+ * Marks a topic as stale, since its text may no longer match its postings.
+ *
+ * @param field Topic that was changed.
+ */
+void TrigramIndex::TopicChanged(Field *field) {
+	uint32_t slot = m_fields.Find(field);
+	if (slot != BOLOTA_FIELDTABLE_NONE)
+		MarkStale(slot);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Searching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the topics that may contain a pattern, regardless of the case of its
+ * ASCII letters. Only these topics have to be searched to find every
+ * occurrence of the pattern.
+ *
+ * @param szPattern UTF-8 pattern to be searched for.
+ * @param ulLength  Length of the pattern in bytes.
+ * @param vecFields Vector to receive the candidate topics in document order.
+ *
+ * @return TRUE if the candidates were found, FALSE if the pattern is too short
+ *         to be looked up and every topic has to be searched.
+ */
+bool TrigramIndex::Candidates(const char *szPattern, size_t ulLength,
+							  std::vector<Field*>& vecFields) {
+	std::vector<std::pair<uint32_t, const bolota_trigram_t*> > vecEntries;
+	std::vector<uint32_t> vecSlots;
+	std::vector<uint32_t> vecStale;
+	std::vector<uint32_t> vecMerged;
+	bool bMissing = false;
+	size_t i;
+
+	vecFields.clear();
+	if (ulLength < 3)
+		return false;
+
+	// Rebuild the index if most candidates would come from stale topics.
+	if ((m_ulStale + m_ulDead) > ((Count() / 4) + BOLOTA_TRIGRAM_STALE_MIN))
+		Update();
+
+	// Look up the trigrams of the pattern.
+	uint32_t trigram = (FoldByte(szPattern[0]) << 8) | FoldByte(szPattern[1]);
+	for (i = 2; (i < ulLength) && !bMissing; i++) {
+		trigram = ((trigram << 8) | FoldByte(szPattern[i])) & 0xFFFFFF;
+		const bolota_trigram_t *entry = FindTrigram(trigram);
+		if (entry == NULL) {
+			bMissing = true;
+		} else {
+			vecEntries.push_back(std::make_pair(entry->count, entry));
+		}
+	}
+
+	// Intersect their postings, starting with the shortest.
+	if (!bMissing) {
+		std::sort(vecEntries.begin(), vecEntries.end());
+		DecodePostings(vecEntries[0].second, vecSlots);
+		for (i = 1; (i < vecEntries.size()) && !vecSlots.empty(); i++) {
+			if (vecEntries[i].second != vecEntries[i - 1].second)
+				IntersectPostings(vecEntries[i].second, vecSlots);
+		}
+
+		// Stale and removed topics are dealt with separately.
+		size_t ulKept = 0;
+		for (i = 0; i < vecSlots.size(); i++) {
+			uint32_t slot = vecSlots[i];
+			if ((slot < m_ulIndexed) && (m_topics[slot] != NULL) &&
+					!m_stale[slot]) {
+				vecSlots[ulKept++] = slot;
+			}
+		}
+		vecSlots.resize(ulKept);
+	}
+
+	// Stale topics always have to be searched.
+	for (i = 0; i < m_staleSlots.size(); i++) {
+		if (m_stale[m_staleSlots[i]])
+			vecStale.push_back(m_staleSlots[i]);
+	}
+	std::sort(vecStale.begin(), vecStale.end());
+	std::set_union(vecSlots.begin(), vecSlots.end(), vecStale.begin(),
+		vecStale.end(), std::back_inserter(vecMerged));
+
+	// Put the topics in document order. Those that were numbered when the
+	// index was built already are.
+	vecFields.reserve(vecMerged.size());
+	for (i = 0; i < vecMerged.size(); i++)
+		vecFields.push_back(m_topics[vecMerged[i]]);
+	m_order.Sort(vecFields, std::lower_bound(vecMerged.begin(),
+		vecMerged.end(), (uint32_t)m_ulIndexed) - vecMerged.begin());
+
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             File Operations                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Reads the trigram index section of a document file. If the section doesn't
+ * match the topics that were read (the file was changed by someone that
+ * didn't update the section) the index is built from the topics instead.
+ *
+ * @param hFile    File to read the section from.
+ * @param dwLength Length of the section in bytes.
+ * @param ulBytes  Pointer to the counter storing the number of bytes read from
+ *                 the file so far.
+ * @param first    First topic of the document, already read.
+ *
+ * @return TRUE if the operation was successful, FALSE if the section couldn't
+ *         be read from the file.
+ */
+bool TrigramIndex::Read(FHND hFile, uint32_t dwLength, size_t *ulBytes,
+						Field *first) {
+	std::vector<bolota_trigram_t> vecTrigrams;
+	std::vector<uint8_t> vecData(dwLength);
+	std::vector<uint8_t> vecPostings;
+	std::vector<uint32_t> vecMap;
+	bolota_trigram_hdr_t hdr;
+	DWORD dwRead = 0;
+
+	// Read the entire section in one go.
+	if (dwLength > 0) {
+		if (!FileUtils::Read(hFile, &vecData[0], dwLength, &dwRead) ||
+				(dwRead != dwLength)) {
+			ThrowError(new ReadError(hFile, *ulBytes, false));
+			return false;
+		}
+		*ulBytes += dwRead;
+	}
+
+	// Hash the topics that were read.
+	Clear();
+	uint64_t hash = Snapshot(first);
+
+	// Check if the section is intact and describes these topics.
+	if (dwLength < sizeof(bolota_trigram_hdr_t))
+		goto rebuild;
+	memcpy(&hdr, &vecData[0], sizeof(bolota_trigram_hdr_t));
+	if ((hdr.version != BOLOTA_TRIGRAM_VERSION) ||
+			(hdr.topics != m_topics.size()) ||
+			(hdr.hash[0] != (uint32_t)hash) ||
+			(hdr.hash[1] != (uint32_t)(hash >> 32))) {
+		goto rebuild;
+	}
+	if ((hdr.table > dwLength) || (hdr.postings > dwLength) ||
+			((sizeof(bolota_trigram_hdr_t) + hdr.table + hdr.postings) !=
+			dwLength) || (hdr.trigrams > (hdr.table / 3))) {
+		goto rebuild;
+	}
+
+	// Take over the postings and make sure the table can be safely searched.
+	m_postings.assign(vecData.begin() + (dwLength - hdr.postings),
+		vecData.end());
+	if (!DecodeTable(&vecData[0] + sizeof(bolota_trigram_hdr_t), hdr.table,
+			hdr.trigrams)) {
+		std::vector<bolota_trigram_t>().swap(m_trigrams);
+		std::vector<uint8_t>().swap(m_postings);
+		goto rebuild;
+	}
+
+	m_hash = hash;
+	m_ulIndexed = m_topics.size();
+	return true;
+
+rebuild:
+	m_hash = hash;
+	m_ulIndexed = m_topics.size();
+	BuildPostings(vecMap, vecTrigrams, vecPostings);
+	return true;
+}
+
+/**
+ * Gets the length of the trigram index section.
+ *
+ * @return Length of the section in bytes.
+ */
+uint32_t TrigramIndex::SectionLength() const {
+	std::vector<uint8_t> vecTable;
+
+	EncodeTable(vecTable);
+	return (uint32_t)(sizeof(bolota_trigram_hdr_t) + vecTable.size() +
+		m_postings.size());
+}
+
+/**
+ * Writes the trigram index section to a document file.
+ *
+ * @warning The index must be current (see IsCurrent) to be written.
+ *
+ * @param hFile File to write the section to.
+ *
+ * @return Number of bytes written to the file.
+ */
+size_t TrigramIndex::Write(FHND hFile) const {
+	std::vector<uint8_t> vecTable;
+	bolota_trigram_hdr_t hdr;
+	size_t ulBytes = 0;
+	DWORD dwWritten = 0;
+
+	// Write the header.
+	EncodeTable(vecTable);
+	hdr.version = BOLOTA_TRIGRAM_VERSION;
+	hdr.topics = (uint32_t)m_topics.size();
+	hdr.hash[0] = (uint32_t)m_hash;
+	hdr.hash[1] = (uint32_t)(m_hash >> 32);
+	hdr.trigrams = (uint32_t)m_trigrams.size();
+	hdr.table = (uint32_t)vecTable.size();
+	hdr.postings = (uint32_t)m_postings.size();
+	if (!FileUtils::Write(hFile, &hdr, sizeof(bolota_trigram_hdr_t),
+			&dwWritten)) {
+		ThrowError(new WriteError(hFile, ulBytes, true));
+		return BOLOTA_ERR_SIZET;
+	}
+	ulBytes += dwWritten;
+
+	// Write the trigrams table.
+	if (!vecTable.empty()) {
+		if (!FileUtils::Write(hFile, &vecTable[0], vecTable.size(),
+				&dwWritten)) {
+			ThrowError(new WriteError(hFile, ulBytes, true));
+			return BOLOTA_ERR_SIZET;
+		}
+		ulBytes += dwWritten;
+	}
+
+	// Write the postings.
+	if (!m_postings.empty()) {
+		if (!FileUtils::Write(hFile, &m_postings[0], m_postings.size(),
+				&dwWritten)) {
+			ThrowError(new WriteError(hFile, ulBytes, true));
+			return BOLOTA_ERR_SIZET;
+		}
+		ulBytes += dwWritten;
+	}
+
+	return ulBytes;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Statistics                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of topics in the index.
+ *
+ * @return Number of topics.
+ */
+size_t TrigramIndex::Count() const {
+	return m_topics.size() - m_ulDead;
+}
+
+/**
+ * Gets the number of distinct trigrams in the postings.
+ *
+ * @return Number of trigrams.
+ */
+size_t TrigramIndex::TrigramCount() const {
+	return m_trigrams.size();
+}
+
+/**
+ * Gets the number of bytes allocated for the postings and tables.
+ *
+ * @return Size of the index in bytes.
+ */
+size_t TrigramIndex::HeapSize() const {
+	return (m_trigrams.capacity() * sizeof(bolota_trigram_t)) +
+		m_postings.capacity() +
+		(m_topics.capacity() * sizeof(Field*)) +
+		m_stale.capacity() +
+		(m_staleSlots.capacity() * sizeof(uint32_t)) +
+		m_fields.HeapSize() + m_order.HeapSize();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Hashing                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Mixes a text into the hash of the texts that came before it, eight bytes at
+ * a time. This is only meant to detect changes, not tampering.
+ *
+ * @param hash     Hash of the previous texts.
+ * @param mbstr    Text to be hashed. Can be NULL if the length is 0.
+ * @param ulLength Length of the text in bytes.
+ *
+ * @return Hash of the texts including this one.
+ */
+uint64_t TrigramIndex::HashText(uint64_t hash, const char *mbstr,
+								size_t ulLength) {
+	const uint64_t mult = ((uint64_t)0x9E3779B9 << 32) | 0x7F4A7C15;
+	uint64_t word;
+	size_t i;
+
+	// Start with the length, so that texts can't run into each other.
+	hash = (hash ^ (uint64_t)ulLength) * mult;
+	hash ^= hash >> 29;
+
+	for (i = 0; (i + 8) <= ulLength; i += 8) {
+		memcpy(&word, mbstr + i, 8);
+		hash = (hash ^ word) * mult;
+		hash ^= hash >> 29;
+	}
+	if (i < ulLength) {
+		word = 0;
+		memcpy(&word, mbstr + i, ulLength - i);
+		hash = (hash ^ word) * mult;
+		hash ^= hash >> 29;
+	}
+
+	return hash;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                            Topic Management                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Rebuilds the index if any topic was changed since it was built.
+ */
+void TrigramIndex::Update() {
+	if (!IsCurrent())
+		Refresh(m_order.At(0));
+}
+
+/**
+ * Numbers the topics of a document in display (pre-)order while hashing their
+ * texts.
+ *
+ * @param first First topic of the document. Can be NULL.
+ *
+ * @return Hash of the texts of the topics.
+ */
+uint64_t TrigramIndex::Snapshot(Field *first) {
+	uint64_t hash = 0;
+	Field *field = first;
+
+	// Make room for every topic up front.
+	m_order.Build(first);
+	m_topics.reserve(m_order.Count());
+	m_stale.reserve(m_order.Count());
+	m_fields.Reserve(m_order.Count());
+
+	while (field != NULL) {
+		uint32_t slot = (uint32_t)m_topics.size();
+		m_topics.push_back(field);
+		m_stale.push_back(0);
+		m_fields.Insert(field, slot);
+
+		// Hash the text of the topic.
+		if (field->HasText()) {
+			hash = HashText(hash, field->Text()->GetMultiByteString(),
+				field->TextLength());
+		} else {
+			hash = HashText(hash, NULL, 0);
+		}
+
+		// Go to the next topic in the document.
+		if (field->HasChild()) {
+			field = field->Child();
+			continue;
+		}
+		while ((field != NULL) && !field->HasNext())
+			field = field->Parent();
+		if (field != NULL)
+			field = field->Next();
+	}
+
+	return hash;
+}
+
+/**
+ * Adds a topic and all of its children to the end of the index as stale
+ * topics.
+ *
+ * @param field Topic to be added.
+ */
+void TrigramIndex::AddSubtree(Field *field) {
+	uint32_t slot = (uint32_t)m_topics.size();
+	m_topics.push_back(field);
+	m_stale.push_back(0);
+	m_fields.Insert(field, slot);
+	MarkStale(slot);
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		AddSubtree(child);
+}
+
+/**
+ * Marks a topic and all of its children as removed.
+ *
+ * @param field Topic to be removed.
+ *
+ * @return Number of topics in the subtree.
+ */
+uint32_t TrigramIndex::RemoveSubtree(Field *field) {
+	uint32_t count = 1;
+	uint32_t slot = m_fields.Find(field);
+	if (slot != BOLOTA_FIELDTABLE_NONE) {
+		if (m_stale[slot]) {
+			m_stale[slot] = 0;
+			m_ulStale--;
+		}
+		m_topics[slot] = NULL;
+		m_fields.Remove(field);
+		m_ulDead++;
+	}
+
+	for (Field *child = field->Child(); child != NULL; child = child->Next())
+		count += RemoveSubtree(child);
+
+	return count;
+}
+
+/**
+ * Marks a topic as stale, so that it's always searched.
+ *
+ * @param slot Number of the topic.
+ */
+void TrigramIndex::MarkStale(uint32_t slot) {
+	if (m_stale[slot])
+		return;
+
+	m_stale[slot] = 1;
+	m_staleSlots.push_back(slot);
+	m_ulStale++;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Postings Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Builds the trigrams table and postings from the texts of the topics, which
+ * must have already been numbered. The postings of the topics that are still
+ * in the old ones are taken from there instead of going through their texts
+ * again.
+ *
+ * @param vecMap         New number of each topic in the old postings or
+ *                       BOLOTA_FIELDTABLE_NONE if it has to be dropped. Empty
+ *                       if every topic has to be indexed.
+ * @param vecOldTrigrams Trigrams table of the old postings.
+ * @param vecOldPostings Old postings.
+ */
+void TrigramIndex::BuildPostings(const std::vector<uint32_t>& vecMap,
+		const std::vector<bolota_trigram_t>& vecOldTrigrams,
+		const std::vector<uint8_t>& vecOldPostings) {
+	std::vector<uint32_t> vecTable(BOLOTA_TRIGRAM_BUILD_SLOTS, 0);
+	std::vector<std::pair<uint32_t, uint32_t> > vecOrder;
+	std::vector<uint8_t> vecIndexed(m_topics.size(), 0);
+	std::vector<TrigramList> vecLists;
+	std::vector<uint32_t> vecOldSlots;
+	std::vector<uint32_t> vecNewSlots;
+	std::vector<uint32_t> vecSlots;
+	const uint8_t *pOldBase = vecOldPostings.empty() ? NULL :
+		&vecOldPostings[0];
+	size_t ulPostings = vecOldPostings.size();
+	size_t i;
+	size_t j;
+
+	// Topics that are still in the old postings don't have to be indexed.
+	for (i = 0; i < vecMap.size(); i++) {
+		if (vecMap[i] != BOLOTA_FIELDTABLE_NONE)
+			vecIndexed[vecMap[i]] = 1;
+	}
+
+	for (uint32_t slot = 0; slot < m_topics.size(); slot++) {
+		Field *field = m_topics[slot];
+		if (vecIndexed[slot] || !field->HasText() ||
+				(field->TextLength() < 3)) {
+			continue;
+		}
+
+		// Go through the trigrams of the text.
+		const char *mbstr = field->Text()->GetMultiByteString();
+		size_t ulLength = field->TextLength();
+		uint32_t trigram = (FoldByte(mbstr[0]) << 8) | FoldByte(mbstr[1]);
+		for (i = 2; i < ulLength; i++) {
+			trigram = ((trigram << 8) | FoldByte(mbstr[i])) & 0xFFFFFF;
+
+			// Look up the postings of the trigram.
+			size_t mask = vecTable.size() - 1;
+			size_t index = HashTrigram(trigram) & mask;
+			while ((vecTable[index] != 0) &&
+					(vecLists[vecTable[index] - 1].trigram != trigram)) {
+				index = (index + 1) & mask;
+			}
+
+			// Start the postings of a new trigram.
+			if (vecTable[index] == 0) {
+				vecLists.push_back(TrigramList());
+				vecLists.back().trigram = trigram;
+				vecLists.back().last = 0;
+				vecLists.back().count = 0;
+				vecTable[index] = (uint32_t)vecLists.size();
+
+				// Keep the load factor under 75%.
+				if ((vecLists.size() * 4) > (vecTable.size() * 3)) {
+					mask = (vecTable.size() * 2) - 1;
+					std::vector<uint32_t>(mask + 1, 0).swap(vecTable);
+					for (j = 0; j < vecLists.size(); j++) {
+						index = HashTrigram(vecLists[j].trigram) & mask;
+						while (vecTable[index] != 0)
+							index = (index + 1) & mask;
+						vecTable[index] = (uint32_t)j + 1;
+					}
+					index = HashTrigram(trigram) & mask;
+					while (vecTable[index] != vecLists.size())
+						index = (index + 1) & mask;
+				}
+			}
+
+			// Skip the trigrams that were already seen in this topic.
+			TrigramList& list = vecLists[vecTable[index] - 1];
+			if ((list.count > 0) && (list.last == slot))
+				continue;
+			AppendVarint(list.bytes, slot - list.last);
+			list.last = slot;
+			list.count++;
+		}
+	}
+
+	// Sort the new postings by trigram.
+	vecOrder.reserve(vecLists.size());
+	for (i = 0; i < vecLists.size(); i++) {
+		vecOrder.push_back(std::make_pair(vecLists[i].trigram, (uint32_t)i));
+		ulPostings += vecLists[i].bytes.size();
+	}
+	std::sort(vecOrder.begin(), vecOrder.end());
+
+	// Lay them out along with the old ones, both sorted by trigram.
+	m_trigrams.reserve(std::max(vecOldTrigrams.size(), vecOrder.size()));
+	m_postings.reserve(ulPostings);
+	i = 0;
+	j = 0;
+	while ((i < vecOldTrigrams.size()) || (j < vecOrder.size())) {
+		bool bOld = (i < vecOldTrigrams.size()) && ((j >= vecOrder.size()) ||
+			(vecOldTrigrams[i].trigram <= vecOrder[j].first));
+		bool bNew = (j < vecOrder.size()) && ((i >= vecOldTrigrams.size()) ||
+			(vecOrder[j].first <= vecOldTrigrams[i].trigram));
+		bolota_trigram_t entry;
+
+		// Renumber the old postings, which are usually still in order.
+		vecOldSlots.clear();
+		if (bOld) {
+			const bolota_trigram_t& old = vecOldTrigrams[i];
+			const uint8_t *pData = pOldBase + old.offset;
+			size_t ulEnd = ((i + 1) < vecOldTrigrams.size()) ?
+				vecOldTrigrams[i + 1].offset : vecOldPostings.size();
+			const uint8_t *pEnd = pOldBase + ulEnd;
+			uint32_t slot = 0;
+			bool bSorted = true;
+
+			entry.trigram = old.trigram;
+			for (uint32_t k = 0; (k < old.count) && (pData < pEnd); k++) {
+				slot += ReadVarint(&pData, pEnd);
+				if ((slot >= vecMap.size()) ||
+						(vecMap[slot] == BOLOTA_FIELDTABLE_NONE)) {
+					continue;
+				}
+
+				if (!vecOldSlots.empty() && (vecMap[slot] < vecOldSlots.back()))
+					bSorted = false;
+				vecOldSlots.push_back(vecMap[slot]);
+			}
+			if (!bSorted)
+				std::sort(vecOldSlots.begin(), vecOldSlots.end());
+			i++;
+		}
+
+		// Take the new postings as they are if there's nothing to merge.
+		entry.offset = (uint32_t)m_postings.size();
+		if (bNew) {
+			TrigramList& list = vecLists[vecOrder[j].second];
+			entry.trigram = list.trigram;
+			j++;
+
+			if (vecOldSlots.empty()) {
+				entry.count = list.count;
+				m_trigrams.push_back(entry);
+				m_postings.insert(m_postings.end(), list.bytes.begin(),
+					list.bytes.end());
+				std::vector<uint8_t>().swap(list.bytes);
+				continue;
+			}
+
+			// Decode them to be merged with the old ones.
+			const uint8_t *pData = &list.bytes[0];
+			const uint8_t *pEnd = pData + list.bytes.size();
+			uint32_t slot = 0;
+			vecNewSlots.clear();
+			while (pData < pEnd) {
+				slot += ReadVarint(&pData, pEnd);
+				vecNewSlots.push_back(slot);
+			}
+			std::vector<uint8_t>().swap(list.bytes);
+
+			vecSlots.clear();
+			std::merge(vecOldSlots.begin(), vecOldSlots.end(),
+				vecNewSlots.begin(), vecNewSlots.end(),
+				std::back_inserter(vecSlots));
+			vecOldSlots.swap(vecSlots);
+		}
+
+		// Trigrams that are no longer in any topic are dropped.
+		if (vecOldSlots.empty())
+			continue;
+		entry.count = (uint32_t)vecOldSlots.size();
+		m_trigrams.push_back(entry);
+
+		// Encode them straight into the postings, with room for the longest
+		// numbers.
+		size_t ulStart = m_postings.size();
+		m_postings.resize(ulStart + (vecOldSlots.size() * 5));
+		uint8_t *pOut = &m_postings[ulStart];
+		uint32_t last = 0;
+		for (size_t k = 0; k < vecOldSlots.size(); k++) {
+			pOut = WriteVarint(pOut, vecOldSlots[k] - last);
+			last = vecOldSlots[k];
+		}
+		m_postings.resize(pOut - &m_postings[0]);
+	}
+}
+
+/**
+ * Encodes the trigrams table to be written to a file, as the difference from
+ * the previous trigram followed by the count and the length of the postings of
+ * each entry.
+ *
+ * @param vecTable Vector to receive the encoded table.
+ */
+void TrigramIndex::EncodeTable(std::vector<uint8_t>& vecTable) const {
+	uint32_t trigram = 0;
+
+	vecTable.clear();
+	vecTable.reserve(m_trigrams.size() * 5);
+	for (size_t i = 0; i < m_trigrams.size(); i++) {
+		size_t ulEnd = ((i + 1) < m_trigrams.size()) ?
+			m_trigrams[i + 1].offset : m_postings.size();
+
+		AppendVarint(vecTable, m_trigrams[i].trigram - trigram);
+		AppendVarint(vecTable, m_trigrams[i].count);
+		AppendVarint(vecTable, (uint32_t)(ulEnd - m_trigrams[i].offset));
+		trigram = m_trigrams[i].trigram;
+	}
+}
+
+/**
+ * Decodes a trigrams table read from a file, working out the offsets of the
+ * entries from the lengths of their postings, which must already be in place.
+ *
+ * @param pData      Encoded table.
+ * @param ulLength   Length of the encoded table in bytes.
+ * @param ulTrigrams Number of entries in the table.
+ *
+ * @return TRUE if the table is consistent with the postings and can be safely
+ *         searched.
+ */
+bool TrigramIndex::DecodeTable(const uint8_t *pData, size_t ulLength,
+							   uint32_t ulTrigrams) {
+	const uint8_t *pEnd = pData + ulLength;
+	uint32_t trigram = 0;
+	size_t ulOffset = 0;
+
+	m_trigrams.resize(ulTrigrams);
+	for (uint32_t i = 0; i < ulTrigrams; i++) {
+		bolota_trigram_t& entry = m_trigrams[i];
+
+		// Read the fields of the entry, which must all be whole.
+		if (pData >= pEnd)
+			return false;
+		uint32_t delta = ReadVarint(&pData, pEnd);
+		if ((pData[-1] & 0x80) || (pData >= pEnd))
+			return false;
+		entry.count = ReadVarint(&pData, pEnd);
+		if ((pData[-1] & 0x80) || (pData >= pEnd))
+			return false;
+		uint32_t length = ReadVarint(&pData, pEnd);
+		if (pData[-1] & 0x80)
+			return false;
+
+		// Trigrams must be in order and appear in at least one topic, which
+		// takes at least a byte of the postings.
+		if (((i > 0) && (delta == 0)) || (entry.count == 0) ||
+				(length < entry.count)) {
+			return false;
+		}
+		trigram += delta;
+		if ((trigram > 0xFFFFFF) || (trigram < delta))
+			return false;
+		entry.trigram = trigram;
+
+		// Its postings must fit in what's left of them.
+		if (length > (m_postings.size() - ulOffset))
+			return false;
+		entry.offset = (uint32_t)ulOffset;
+		ulOffset += length;
+	}
+
+	return (pData == pEnd) && (ulOffset == m_postings.size());
+}
+
+/**
+ * Looks up a trigram in the table.
+ *
+ * @param trigram Trigram to look for.
+ *
+ * @return Entry of the trigram or NULL if no topic contains it.
+ */
+const bolota_trigram_t* TrigramIndex::FindTrigram(uint32_t trigram) const {
+	size_t ulLow = 0;
+	size_t ulHigh = m_trigrams.size();
+
+	while (ulLow < ulHigh) {
+		size_t ulMid = ulLow + ((ulHigh - ulLow) / 2);
+		if (m_trigrams[ulMid].trigram < trigram) {
+			ulLow = ulMid + 1;
+		} else {
+			ulHigh = ulMid;
+		}
+	}
+
+	if ((ulLow < m_trigrams.size()) && (m_trigrams[ulLow].trigram == trigram))
+		return &m_trigrams[ulLow];
+
+	return NULL;
+}
+
+/**
+ * Gets the end of the postings of a trigram, which is where the postings of
+ * the next one start.
+ *
+ * @param entry Entry of the trigram.
+ *
+ * @return End of the postings.
+ */
+const uint8_t* TrigramIndex::PostingsEnd(const bolota_trigram_t *entry) const {
+	const uint8_t *pBase = m_postings.empty() ? NULL : &m_postings[0];
+
+	if (entry == &m_trigrams.back())
+		return pBase + m_postings.size();
+	return pBase + entry[1].offset;
+}
+
+/**
+ * Decodes the postings of a trigram.
+ *
+ * @param entry    Entry of the trigram.
+ * @param vecSlots Vector to receive the sorted topic numbers.
+ */
+void TrigramIndex::DecodePostings(const bolota_trigram_t *entry,
+								  std::vector<uint32_t>& vecSlots) const {
+	const uint8_t *pData = m_postings.empty() ? NULL :
+		&m_postings[0] + entry->offset;
+	const uint8_t *pEnd = PostingsEnd(entry);
+	uint32_t slot = 0;
+
+	vecSlots.clear();
+	vecSlots.reserve(entry->count);
+	for (uint32_t i = 0; (i < entry->count) && (pData < pEnd); i++) {
+		slot += ReadVarint(&pData, pEnd);
+		vecSlots.push_back(slot);
+	}
+}
+
+/**
+ * Keeps only the topics that are also in the postings of a trigram, decoding
+ * them as we go.
+ *
+ * @param entry    Entry of the trigram.
+ * @param vecSlots Sorted topic numbers to be filtered.
+ */
+void TrigramIndex::IntersectPostings(const bolota_trigram_t *entry,
+									 std::vector<uint32_t>& vecSlots) const {
+	const uint8_t *pData = m_postings.empty() ? NULL :
+		&m_postings[0] + entry->offset;
+	const uint8_t *pEnd = PostingsEnd(entry);
+	uint32_t remaining = entry->count;
+	uint32_t slot = 0;
+	size_t ulKept = 0;
+	bool bHasSlot = false;
+
+	for (size_t i = 0; i < vecSlots.size(); i++) {
+		// Decode until we reach the topic we're looking for.
+		while ((!bHasSlot || (slot < vecSlots[i])) && (remaining > 0) &&
+				(pData < pEnd)) {
+			slot += ReadVarint(&pData, pEnd);
+			bHasSlot = true;
+			remaining--;
+		}
+
+		if (bHasSlot && (slot == vecSlots[i])) {
+			vecSlots[ulKept++] = vecSlots[i];
+		} else if (!bHasSlot || (slot < vecSlots[i])) {
+			break;
+		}
+	}
+
+	vecSlots.resize(ulKept);
+}
+
+/**
+ * Appends a variable length integer, 7 bits at a time with the highest bit
+ * set on every byte but the last.
+ *
+ * @param vecBytes Vector to append the integer to.
+ * @param value    Integer to be appended.
+ */
+void TrigramIndex::AppendVarint(std::vector<uint8_t>& vecBytes,
+								uint32_t value) {
+	uint8_t buf[5];
+
+	vecBytes.insert(vecBytes.end(), buf, WriteVarint(buf, value));
+}
+
+/**
+ * Writes a variable length integer to a buffer.
+ *
+ * @param pData Buffer with room for at least 5 bytes.
+ * @param value Integer to be written.
+ *
+ * @return Position right after the integer in the buffer.
+ */
+uint8_t* TrigramIndex::WriteVarint(uint8_t *pData, uint32_t value) {
+	while (value >= 0x80) {
+		*pData++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*pData++ = (uint8_t)value;
+
+	return pData;
+}
+
+/**
+ * Reads a variable length integer.
+ *
+ * @param ppData Pointer to the start of the integer. Updated on return.
+ * @param pEnd   End of the data.
+ *
+ * @return Integer that was read.
+ */
+uint32_t TrigramIndex::ReadVarint(const uint8_t **ppData, const uint8_t *pEnd) {
+	const uint8_t *pData = *ppData;
+	uint32_t value = 0;
+	unsigned int uiShift = 0;
+
+	while ((pData < pEnd) && (uiShift < 32)) {
+		uint8_t uc = *pData++;
+		value |= (uint32_t)(uc & 0x7F) << uiShift;
+		if ((uc & 0x80) == 0)
+			break;
+		uiShift += 7;
+	}
+
+	*ppData = pData;
+	return value;
+}
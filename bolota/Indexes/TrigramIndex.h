@@ -0,0 +1,171 @@
+/**
+ * TrigramIndex.h
+ * Index of the trigrams of the topic texts that narrows down substring
+ * searches and can be saved along with the document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_INDEXES_TRIGRAMINDEX_H
+#define _BOLOTA_INDEXES_TRIGRAMINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "../Utilities/FileUtils.h"
+#include "DocumentIndex.h"
+#include "FieldTable.h"
+#include "TopicOrder.h"
+
+/**
+ * Version of the layout of the trigram index section.
+ */
+#define BOLOTA_TRIGRAM_VERSION 2
+
+/**
+ * Number of topics whose texts may be out of date before the index is rebuilt
+ * by a search, on top of a quarter of the topics in the index.
+ */
+#define BOLOTA_TRIGRAM_STALE_MIN 1024
+
+/**
+ * Header of the trigram index section of a document file. It's followed by the
+ * trigrams table and then the postings.
+ */
+typedef struct bolota_trigram_hdr_s {
+	uint32_t version;   /* Version of the layout of the section. */
+	uint32_t topics;    /* Number of topics that were indexed. */
+	uint32_t hash[2];   /* Hash of the topic texts, low part first. */
+	uint32_t trigrams;  /* Number of entries in the trigrams table. */
+	uint32_t table;     /* Length of the trigrams table in bytes. */
+	uint32_t postings;  /* Length of the postings in bytes. */
+} bolota_trigram_hdr_t;
+
+/**
+ * Entry of the trigrams table, which is sorted by trigram. In the file each
+ * entry is stored as the difference from the previous trigram, the count and
+ * the length of its postings in bytes, all as variable length integers, and
+ * the offsets are worked out from the lengths when it's read.
+ */
+typedef struct bolota_trigram_s {
+	uint32_t trigram;  /* Three bytes of case folded text, first one highest. */
+	uint32_t offset;   /* Start of the postings of the trigram in bytes. */
+	uint32_t count;    /* Number of topics that contain the trigram. */
+} bolota_trigram_t;
+
+namespace Bolota {
+
+	/**
+	 * Index of the trigrams (sequences of three bytes, with ASCII letters case
+	 * folded) found in the texts of the topics. Any text that contains a
+	 * pattern also contains all of its trigrams, so intersecting the postings
+	 * of those trigrams gives a short list of candidate topics to be searched
+	 * instead of the whole document.
+	 *
+	 * Topics are numbered in document order, and the postings of each trigram
+	 * are stored as the differences between those numbers, as variable length
+	 * integers. The postings are written as is to the document file, so
+	 * opening it only has to hash the topic texts to make sure they haven't
+	 * changed since, rather than building the index again.
+	 *
+	 * Edits don't touch the postings. Topics whose texts changed (or that were
+	 * inserted) are marked as stale and always returned as candidates, while
+	 * removed ones are simply ignored. The postings are refreshed when the
+	 * index is saved or once there are too many stale topics, which numbers
+	 * the topics again and only has to go through the texts of the stale ones.
+	 */
+	class TrigramIndex : public DocumentIndex {
+	protected:
+		// Trigrams and postings.
+		std::vector<bolota_trigram_t> m_trigrams;
+		std::vector<uint8_t> m_postings;
+		uint64_t m_hash;
+
+		// Topics.
+		std::vector<Field*> m_topics;
+		std::vector<uint8_t> m_stale;
+		std::vector<uint32_t> m_staleSlots;
+		FieldTable m_fields;
+		size_t m_ulIndexed;
+		size_t m_ulStale;
+		size_t m_ulDead;
+
+		// Document order.
+		TopicOrder m_order;
+
+	public:
+		// Constructors and destructors.
+		TrigramIndex();
+		virtual ~TrigramIndex();
+
+		// Building.
+		void Build(Field *first) override;
+		void Clear() override;
+		void Refresh(Field *first);
+		bool IsCurrent() const;
+
+		// Notifications.
+		void TopicInserted(Field *field) override;
+		void TopicRemoving(Field *field, bool bDeleting) override;
+		void TopicChanged(Field *field) override;
+
+		// Searching.
+		bool Candidates(const char *szPattern, size_t ulLength,
+			std::vector<Field*>& vecFields);
+
+		// File operations.
+		bool Read(FHND hFile, uint32_t dwLength, size_t *ulBytes,
+			Field *first);
+		uint32_t SectionLength() const;
+		size_t Write(FHND hFile) const;
+
+		// Statistics.
+		size_t Count() const;
+		size_t TrigramCount() const;
+		size_t HeapSize() const;
+
+		// Hashing.
+		static uint64_t HashText(uint64_t hash, const char *mbstr,
+			size_t ulLength);
+
+	protected:
+		// Topic management.
+		void Update();
+		uint64_t Snapshot(Field *first);
+		void AddSubtree(Field *field);
+		uint32_t RemoveSubtree(Field *field);
+		void MarkStale(uint32_t slot);
+
+		// Postings helpers.
+		void BuildPostings(const std::vector<uint32_t>& vecMap,
+			const std::vector<bolota_trigram_t>& vecOldTrigrams,
+			const std::vector<uint8_t>& vecOldPostings);
+		void EncodeTable(std::vector<uint8_t>& vecTable) const;
+		bool DecodeTable(const uint8_t *pData, size_t ulLength,
+			uint32_t ulTrigrams);
+		const bolota_trigram_t* FindTrigram(uint32_t trigram) const;
+		const uint8_t* PostingsEnd(const bolota_trigram_t *entry) const;
+		void DecodePostings(const bolota_trigram_t *entry,
+			std::vector<uint32_t>& vecSlots) const;
+		void IntersectPostings(const bolota_trigram_t *entry,
+			std::vector<uint32_t>& vecSlots) const;
+		static void AppendVarint(std::vector<uint8_t>& vecBytes,
+			uint32_t value);
+		static uint8_t* WriteVarint(uint8_t *pData, uint32_t value);
+		static uint32_t ReadVarint(const uint8_t **ppData,
+			const uint8_t *pEnd);
+	};
+
+}
+
+#endif // _BOLOTA_INDEXES_TRIGRAMINDEX_H
@@ -0,0 +1,1103 @@
+/**
+ * PathQuery.cpp
+ * Path queries over the outline of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "PathQuery.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "DateField.h"
+#include "IconField.h"
+#include "Errors/ErrorCollection.h"
+#include "Indexes/DateIndex.h"
+
+using namespace Bolota;
+
+/**
+ * Keys of the filters, in the order they're checked.
+ */
+#define KEY_TYPE  0
+#define KEY_DEPTH 1
+#define KEY_ICON  2
+#define KEY_YEAR  3
+#define KEY_MONTH 4
+#define KEY_DAY   5
+#define KEY_DATE  6
+#define KEY_TEXT  7
+#define KEY_NUM   8
+
+/**
+ * Operators of the filters. Regular expressions are always checked last.
+ */
+#define OP_EQ        0
+#define OP_NE        1
+#define OP_LT        2
+#define OP_LE        3
+#define OP_GT        4
+#define OP_GE        5
+#define OP_MATCH     6
+#define OP_NOT_MATCH 7
+
+/**
+ * Depth limit of a step that may match at any depth.
+ */
+#define PATHQUERY_ANY_DEPTH 0x10000
+
+/**
+ * Names of the keys of the filters.
+ */
+static const char *szKeyNames[KEY_NUM] = {
+	"type", "depth", "icon", "year", "month", "day", "date", "text"
+};
+
+/**
+ * Names of the icons, in the order of their indexes.
+ */
+static const char *szIconNames[BOLOTA_FIELD_ICON_NUM + 1] = {
+	"none", "battery", "box", "calendar", "camera", "check", "clipboard",
+	"clock", "cpu", "find", "folder", "gear", "help", "history", "laptop",
+	"light", "love", "men", "money", "movie", "plus", "redo", "remove",
+	"signpost", "sound", "star", "stop", "tags", "trash", "undo", "woman",
+	"wrench"
+};
+
+/**
+ * Compares two ASCII strings ignoring their case.
+ *
+ * @param szA First string.
+ * @param szB Second string.
+ *
+ * @return TRUE if both strings are the same.
+ */
+static bool SameName(const char *szA, const char *szB) {
+	for (; (*szA != '\0') && (*szB != '\0'); szA++, szB++) {
+		char a = ((*szA >= 'A') && (*szA <= 'Z')) ? (*szA + ('a' - 'A')) : *szA;
+		char b = ((*szB >= 'A') && (*szB <= 'Z')) ? (*szB + ('a' - 'A')) : *szB;
+		if (a != b)
+			return false;
+	}
+
+	return *szA == *szB;
+}
+
+/**
+ * Compares a number against the range of values of a filter.
+ *
+ * @param value Number to be compared.
+ * @param op    Operator of the filter.
+ * @param lo    First value of the range of the filter.
+ * @param hi    Last value of the range of the filter.
+ *
+ * @return TRUE if the comparison holds.
+ */
+static inline bool Compare(uint64_t value, uint8_t op, uint64_t lo,
+						   uint64_t hi) {
+	switch (op) {
+	case OP_EQ:
+		return (value >= lo) && (value <= hi);
+	case OP_NE:
+		return (value < lo) || (value > hi);
+	case OP_LT:
+		return value < lo;
+	case OP_LE:
+		return value <= hi;
+	case OP_GT:
+		return value > hi;
+	case OP_GE:
+		return value >= lo;
+	}
+
+	return false;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty query that never matches.
+ */
+PathQuery::PathQuery() {
+	m_bCompiled = false;
+}
+
+/**
+ * Frees up the compiled query.
+ */
+PathQuery::~PathQuery() {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Compiling                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Compiles a query so that it can be run.
+ *
+ * @param szQuery UTF-8 query to be compiled.
+ *
+ * @return TRUE if the query was compiled, FALSE if it's invalid.
+ */
+bool PathQuery::Compile(const char *szQuery) {
+	const char *pQuery = szQuery;
+	bool bDescendant = false;
+	size_t ulSteps = 0;
+
+	// Start from scratch.
+	m_steps.clear();
+	m_filters.clear();
+	m_regexes.clear();
+	m_bCompiled = false;
+
+	// Get the first separator out of the way.
+	if (*pQuery == '\0') {
+		ThrowError(EMSG("Empty path query"));
+		goto error_handling;
+	}
+	if ((pQuery[0] == '/') && (pQuery[1] == '/')) {
+		bDescendant = true;
+		pQuery += 2;
+	} else if (pQuery[0] == '/') {
+		pQuery++;
+	}
+
+	// Parse the steps.
+	while (*pQuery != '\0') {
+		if (!ParseStep(&pQuery, bDescendant))
+			goto error_handling;
+
+		// Check how to get to the next step.
+		if (*pQuery == '\0')
+			break;
+		if ((pQuery[0] == '/') && (pQuery[1] == '/')) {
+			bDescendant = true;
+			pQuery += 2;
+		} else if (pQuery[0] == '/') {
+			bDescendant = false;
+			pQuery++;
+		} else {
+			ThrowError(EMSG("Expected / after a step in path query"));
+			goto error_handling;
+		}
+
+		if (*pQuery == '\0') {
+			ThrowError(EMSG("Empty step at the end of path query"));
+			goto error_handling;
+		}
+	}
+
+	// Make sure the states of the steps fit in a mask.
+	for (size_t i = 0; i < m_steps.size(); i++) {
+		ulSteps = (m_steps[i].bParent) ? 0 : (ulSteps + 1);
+		if (ulSteps > BOLOTA_PATHQUERY_STEPS_MAX) {
+			ThrowError(EMSG("Too many steps in path query"));
+			goto error_handling;
+		}
+	}
+
+	PushDown();
+	m_bCompiled = true;
+	return true;
+
+error_handling:
+	m_steps.clear();
+	m_filters.clear();
+	m_regexes.clear();
+	return false;
+}
+
+/**
+ * Checks if a query was successfully compiled.
+ *
+ * @return TRUE if the query can be run.
+ */
+bool PathQuery::IsCompiled() const {
+	return m_bCompiled;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Running                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Runs the query on the tree of topics of a document.
+ *
+ * @param doc        Document to be queried.
+ * @param vecResults Vector to receive the topics that matched, in document
+ *                   order.
+ *
+ * @return Number of topics that matched.
+ */
+size_t PathQuery::Run(const Document *doc,
+					  std::vector<Field*>& vecResults) const {
+	std::vector<Field*> vecContexts;
+	std::vector<Field*> vecAncestors;
+	Pass pass;
+	size_t i = 0;
+
+	vecResults.clear();
+	if (!m_bCompiled)
+		return 0;
+
+	// Start at the root of the document.
+	pass.bRoot = true;
+	while (i < m_steps.size()) {
+		// Match the steps up to the next parent step in a single pass.
+		pass.ulFirst = i;
+		while ((i < m_steps.size()) && !m_steps[i].bParent)
+			i++;
+		pass.ulLast = i;
+		if (pass.ulFirst < pass.ulLast) {
+			RunPass(pass, doc->FirstTopic(), 0, (pass.bRoot) ? 1 : 0,
+				vecContexts, vecAncestors, vecResults);
+			vecContexts.assign(vecResults.begin(), vecResults.end());
+			vecResults.clear();
+			pass.bRoot = false;
+		}
+
+		// Go up to the parents of everything that matched.
+		for (; (i < m_steps.size()) && m_steps[i].bParent; i++) {
+			pass.bRoot = false;
+			for (size_t j = 0; j < vecContexts.size(); j++) {
+				vecContexts[j] = vecContexts[j]->Parent();
+				if (vecContexts[j] == NULL)
+					pass.bRoot = true;
+			}
+
+			std::sort(vecContexts.begin(), vecContexts.end());
+			vecContexts.erase(std::unique(vecContexts.begin(),
+				vecContexts.end()), vecContexts.end());
+			if (!vecContexts.empty() && (vecContexts[0] == NULL))
+				vecContexts.erase(vecContexts.begin());
+		}
+
+		// Find out which topics lead to the ones we're starting from.
+		vecAncestors.clear();
+		for (size_t j = 0; j < vecContexts.size(); j++) {
+			for (Field *field = vecContexts[j]->Parent();
+					field != NULL; field = field->Parent()) {
+				vecAncestors.push_back(field);
+			}
+		}
+		std::sort(vecAncestors.begin(), vecAncestors.end());
+		vecAncestors.erase(std::unique(vecAncestors.begin(),
+			vecAncestors.end()), vecAncestors.end());
+	}
+
+	// Put the parents we ended up with in document order.
+	if (!vecContexts.empty() && m_steps.back().bParent) {
+		pass.ulFirst = m_steps.size();
+		pass.ulLast = m_steps.size();
+		RunPass(pass, doc->FirstTopic(), 0, 0, vecContexts, vecAncestors,
+			vecResults);
+	} else {
+		vecResults.assign(vecContexts.begin(), vecContexts.end());
+	}
+
+	return vecResults.size();
+}
+
+/**
+ * Runs the query on a flattened document.
+ *
+ * @param doc        Document to be queried.
+ * @param vecResults Vector to receive the pre-order indexes of the topics that
+ *                   matched, in document order.
+ *
+ * @return Number of topics that matched.
+ */
+size_t PathQuery::Run(const FlatDocument *doc,
+					  std::vector<uint32_t>& vecResults) const {
+	std::vector<uint32_t> vecContexts;
+	Pass pass;
+	size_t i = 0;
+
+	vecResults.clear();
+	if (!m_bCompiled)
+		return 0;
+
+	// Start at the root of the document.
+	pass.bRoot = true;
+	while (i < m_steps.size()) {
+		// Match the steps up to the next parent step in a single pass.
+		pass.ulFirst = i;
+		while ((i < m_steps.size()) && !m_steps[i].bParent)
+			i++;
+		pass.ulLast = i;
+		if (pass.ulFirst < pass.ulLast) {
+			RunPass(pass, doc, vecContexts, vecResults);
+			vecContexts.swap(vecResults);
+			vecResults.clear();
+			pass.bRoot = false;
+		}
+
+		// Go up to the parents of everything that matched.
+		for (; (i < m_steps.size()) && m_steps[i].bParent; i++) {
+			size_t ulCount = 0;
+
+			pass.bRoot = false;
+			for (size_t j = 0; j < vecContexts.size(); j++) {
+				uint32_t parent = doc->Parent(vecContexts[j]);
+				if (parent == BOLOTA_FLAT_NONE) {
+					pass.bRoot = true;
+				} else {
+					vecContexts[ulCount++] = parent;
+				}
+			}
+			vecContexts.resize(ulCount);
+
+			std::sort(vecContexts.begin(), vecContexts.end());
+			vecContexts.erase(std::unique(vecContexts.begin(),
+				vecContexts.end()), vecContexts.end());
+		}
+	}
+
+	// Pre-order indexes are already in document order.
+	vecResults.swap(vecContexts);
+	return vecResults.size();
+}
+
+/**
+ * Matches the steps of a pass against a tree of fields, starting with a list
+ * of siblings.
+ *
+ * @param pass         State of the pass.
+ * @param first        First of the siblings.
+ * @param depth        Depth of the siblings.
+ * @param state        Steps that may be matched by the siblings.
+ * @param vecContexts  Sorted topics that the steps start from, besides the
+ *                     root if the pass says so.
+ * @param vecAncestors Sorted ancestors of the topics that the steps start
+ *                     from.
+ * @param vecResults   Vector to receive the topics that matched every step,
+ *                     or the starting topics if there are no steps.
+ */
+void PathQuery::RunPass(Pass& pass, Field *first, uint8_t depth,
+						uint64_t state,
+						const std::vector<Field*>& vecContexts,
+						const std::vector<Field*>& vecAncestors,
+						std::vector<Field*>& vecResults) const {
+	for (Field *field = first; field != NULL; field = field->Next()) {
+		bool bContext = !vecContexts.empty() && std::binary_search(
+			vecContexts.begin(), vecContexts.end(), field);
+		bool bAncestor = !vecAncestors.empty() && std::binary_search(
+			vecAncestors.begin(), vecAncestors.end(), field);
+
+		// Nothing to see in this subtree.
+		if ((state == 0) && !bContext && !bAncestor)
+			continue;
+
+		// Match the topic.
+		Topic topic;
+		topic.field = field;
+		topic.flat = NULL;
+		topic.index = 0;
+		topic.depth = depth;
+		bool bMatched = false;
+		uint64_t next = Advance(pass, state, topic, &bMatched);
+
+		// Start over from the topics we were asked to.
+		if (bContext) {
+			if (pass.ulFirst == pass.ulLast) {
+				bMatched = true;
+			} else if ((depth + 1) <= m_steps[pass.ulFirst].maxDepth) {
+				next |= 1;
+			}
+		}
+
+		if (bMatched)
+			vecResults.push_back(field);
+		if (field->HasChild() && ((next != 0) || bAncestor)) {
+			RunPass(pass, field->Child(), depth + 1, next, vecContexts,
+				vecAncestors, vecResults);
+		}
+	}
+}
+
+/**
+ * Matches the steps of a pass against a flattened document in a single scan
+ * over its topics.
+ *
+ * @param pass        State of the pass.
+ * @param doc         Document to be scanned.
+ * @param vecContexts Sorted pre-order indexes of the topics that the steps
+ *                    start from, besides the root if the pass says so.
+ * @param vecResults  Vector to receive the indexes of the topics that matched
+ *                    every step.
+ */
+void PathQuery::RunPass(Pass& pass, const FlatDocument *doc,
+						const std::vector<uint32_t>& vecContexts,
+						std::vector<uint32_t>& vecResults) const {
+	uint64_t states[256 + 1];
+	uint32_t count = doc->Count();
+	size_t ulContext = 0;
+	uint32_t index = 0;
+
+	// Steps that may be matched by the children of each depth.
+	states[0] = (pass.bRoot) ? 1 : 0;
+	while (index < count) {
+		Topic topic;
+		topic.field = NULL;
+		topic.flat = doc;
+		topic.index = index;
+		topic.depth = doc->Depth(index);
+
+		// Match the topic.
+		bool bMatched = false;
+		uint64_t next = Advance(pass, states[topic.depth], topic, &bMatched);
+		if ((ulContext < vecContexts.size()) &&
+				(vecContexts[ulContext] == index)) {
+			ulContext++;
+			if ((topic.depth + 1) <= m_steps[pass.ulFirst].maxDepth)
+				next |= 1;
+		}
+
+		if (bMatched)
+			vecResults.push_back(index);
+		states[topic.depth + 1] = next;
+		if (next != 0) {
+			index++;
+			continue;
+		}
+
+		// Skip the whole subtree, unless we have to start from inside it.
+		uint32_t end = doc->SubtreeEnd(index);
+		if ((ulContext < vecContexts.size()) &&
+				(vecContexts[ulContext] < end)) {
+			index = vecContexts[ulContext];
+			for (int depth = topic.depth + 1; depth <= doc->Depth(index);
+					depth++) {
+				states[depth] = 0;
+			}
+		} else {
+			index = end;
+		}
+	}
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Matching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the type of a topic.
+ *
+ * @param topic Topic being matched.
+ *
+ * @return Type of the topic.
+ */
+bolota_type_t PathQuery::Type(const Topic& topic) {
+	if (topic.field != NULL)
+		return topic.field->Type();
+
+	return topic.flat->Type(topic.index);
+}
+
+/**
+ * Gets the text of a topic.
+ *
+ * @param topic     Topic being matched.
+ * @param pulLength Pointer to receive the length of the text in bytes.
+ *
+ * @return UTF-8 text of the topic.
+ */
+const char* PathQuery::Text(const Topic& topic, size_t *pulLength) {
+	if (topic.field == NULL) {
+		*pulLength = topic.flat->TextLength(topic.index);
+		return topic.flat->Text(topic.index);
+	}
+
+	if (!topic.field->HasText()) {
+		*pulLength = 0;
+		return "";
+	}
+
+	*pulLength = topic.field->Text()->Length();
+	return topic.field->Text()->GetMultiByteString();
+}
+
+/**
+ * Matches a topic against the steps that it may match.
+ *
+ * @param pass      State of the pass.
+ * @param state     Steps that the topic may match, relative to the first step
+ *                  of the pass.
+ * @param topic     Topic to be matched.
+ * @param pbMatched Pointer to a flag that is set if the topic matched the last
+ *                  step of the pass.
+ *
+ * @return Steps that the children of the topic may match.
+ */
+uint64_t PathQuery::Advance(Pass& pass, uint64_t state, const Topic& topic,
+							bool *pbMatched) const {
+	size_t ulCount = pass.ulLast - pass.ulFirst;
+	uint64_t next = 0;
+
+	for (size_t i = 0; state != 0; i++, state >>= 1) {
+		if ((state & 1) == 0)
+			continue;
+
+		// Don't bother if the rest of the path can't fit under us.
+		const Step& step = m_steps[pass.ulFirst + i];
+		if (topic.depth > step.maxDepth)
+			continue;
+
+		// Descendants may still match the step further down.
+		if (step.bDescendant && ((topic.depth + 1) <= step.maxDepth))
+			next |= (uint64_t)1 << i;
+
+		if (!Matches(pass, step, topic))
+			continue;
+		if ((i + 1) == ulCount) {
+			*pbMatched = true;
+			continue;
+		}
+
+		// Children may match the next step, if it fits under them.
+		const Step& nextStep = m_steps[pass.ulFirst + i + 1];
+		if ((topic.depth + 1) <= nextStep.maxDepth)
+			next |= (uint64_t)1 << (i + 1);
+	}
+
+	return next;
+}
+
+/**
+ * Checks if a topic matches a step.
+ *
+ * @param pass  State of the pass.
+ * @param step  Step to be matched.
+ * @param topic Topic to be matched.
+ *
+ * @return TRUE if the topic matches the text and every filter of the step.
+ */
+bool PathQuery::Matches(Pass& pass, const Step& step,
+						const Topic& topic) const {
+	size_t ulEnd = step.ulFirstFilter + step.ulFilters;
+	size_t i = step.ulFirstFilter;
+
+	// Cheap filters go before the text.
+	for (; (i < ulEnd) && (m_filters[i].key < KEY_TEXT); i++) {
+		if (!Matches(pass, m_filters[i], topic))
+			return false;
+	}
+
+	// Text of the step.
+	if (!step.bAnyText) {
+		size_t ulLength;
+		const char *mbstr = Text(topic, &ulLength);
+		if ((ulLength != step.text.size()) ||
+				(memcmp(mbstr, step.text.c_str(), ulLength) != 0)) {
+			return false;
+		}
+	}
+
+	// Text filters.
+	for (; i < ulEnd; i++) {
+		if (!Matches(pass, m_filters[i], topic))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Checks if a topic matches a filter.
+ *
+ * @param pass   State of the pass.
+ * @param filter Filter to be checked.
+ * @param topic  Topic to be checked.
+ *
+ * @return TRUE if the topic passes the filter.
+ */
+bool PathQuery::Matches(Pass& pass, const Filter& filter,
+						const Topic& topic) const {
+	bolota_type_t type;
+	timestamp_t ts;
+	field_icon_t icon;
+	const char *mbstr;
+	size_t ulLength;
+	size_t ulStart;
+	size_t ulEnd;
+
+	switch (filter.key) {
+	case KEY_TYPE:
+		return Compare(Type(topic), filter.op, filter.lo, filter.hi);
+	case KEY_DEPTH:
+		return Compare(topic.depth, filter.op, filter.lo, filter.hi);
+	case KEY_ICON:
+		if (Type(topic) != BOLOTA_TYPE_ICON)
+			return false;
+
+		icon = (topic.field != NULL) ?
+			static_cast<const IconField*>(topic.field)->IconIndex() :
+			topic.flat->IconIndex(topic.index);
+		return Compare(icon, filter.op, filter.lo, filter.hi);
+	case KEY_YEAR:
+	case KEY_MONTH:
+	case KEY_DAY:
+	case KEY_DATE:
+		type = Type(topic);
+		if (type != BOLOTA_TYPE_DATE)
+			return false;
+
+		ts = (topic.field != NULL) ?
+			static_cast<const DateField*>(topic.field)->Timestamp() :
+			topic.flat->Timestamp(topic.index);
+		if (filter.key == KEY_YEAR)
+			return Compare(ts.year, filter.op, filter.lo, filter.hi);
+		if (filter.key == KEY_MONTH)
+			return Compare(ts.month, filter.op, filter.lo, filter.hi);
+		if (filter.key == KEY_DAY)
+			return Compare(ts.day, filter.op, filter.lo, filter.hi);
+		return Compare(DateIndex::Key(&ts), filter.op, filter.lo, filter.hi);
+	case KEY_TEXT:
+		mbstr = Text(topic, &ulLength);
+		if ((filter.op == OP_MATCH) || (filter.op == OP_NOT_MATCH)) {
+			bool bFound = m_regexes[(size_t)filter.lo].Search(mbstr, ulLength,
+				&ulStart, &ulEnd, pass.vecScratch);
+			return bFound == (filter.op == OP_MATCH);
+		}
+
+		if ((ulLength == filter.text.size()) &&
+				(memcmp(mbstr, filter.text.c_str(), ulLength) == 0)) {
+			return filter.op == OP_EQ;
+		}
+		return filter.op == OP_NE;
+	}
+
+	return false;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Parsing                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Parses a step of the path along with its filters.
+ *
+ * @param ppQuery     Pointer to the query, moved past the step on return.
+ * @param bDescendant Can the step match descendants at any depth?
+ *
+ * @return TRUE if the step was parsed.
+ */
+bool PathQuery::ParseStep(const char **ppQuery, bool bDescendant) {
+	const char *pQuery = *ppQuery;
+	Step step;
+
+	step.bParent = false;
+	step.bDescendant = bDescendant;
+	step.bAnyText = true;
+	step.ulFirstFilter = m_filters.size();
+	step.ulFilters = 0;
+	step.maxDepth = PATHQUERY_ANY_DEPTH;
+
+	// Parent and current topic.
+	if ((pQuery[0] == '.') && ((pQuery[1] == '/') || (pQuery[1] == '\0'))) {
+		*ppQuery = pQuery + 1;
+		if (bDescendant) {
+			ThrowError(EMSG("Current topic step after // in path query"));
+			return false;
+		}
+
+		return true;
+	} else if ((pQuery[0] == '.') && (pQuery[1] == '.') &&
+			((pQuery[2] == '/') || (pQuery[2] == '\0'))) {
+		*ppQuery = pQuery + 2;
+		if (bDescendant) {
+			ThrowError(EMSG("Parent step after // in path query"));
+			return false;
+		}
+
+		step.bParent = true;
+		m_steps.push_back(step);
+		return true;
+	}
+
+	// Text of the topic.
+	if (*pQuery == '*') {
+		pQuery++;
+	} else if (*pQuery != '[') {
+		if (!ParseString(&pQuery, "/[", step.text))
+			return false;
+		step.bAnyText = false;
+	}
+
+	// Filters.
+	while (*pQuery == '[') {
+		Filter filter;
+
+		pQuery++;
+		if (!ParseFilter(&pQuery, filter))
+			return false;
+		m_filters.push_back(filter);
+		step.ulFilters++;
+	}
+
+	if (pQuery == *ppQuery) {
+		ThrowError(EMSG("Empty step in path query"));
+		return false;
+	}
+
+	*ppQuery = pQuery;
+	m_steps.push_back(step);
+	return true;
+}
+
+/**
+ * Parses a filter of a step.
+ *
+ * @param ppQuery Pointer to the query right after the opening bracket, moved
+ *                past the closing one on return.
+ * @param filter  Filter to be populated.
+ *
+ * @return TRUE if the filter was parsed.
+ */
+bool PathQuery::ParseFilter(const char **ppQuery, Filter& filter) {
+	const char *pQuery = *ppQuery;
+	std::string strKey;
+	std::string strValue;
+	int i;
+
+	// Key.
+	while (((*pQuery >= 'a') && (*pQuery <= 'z')) ||
+			((*pQuery >= 'A') && (*pQuery <= 'Z'))) {
+		strKey += *pQuery++;
+	}
+	for (i = 0; i < KEY_NUM; i++) {
+		if (SameName(strKey.c_str(), szKeyNames[i]))
+			break;
+	}
+	if (i == KEY_NUM) {
+		ThrowError(EMSG("Unknown key in path query filter"));
+		return false;
+	}
+	filter.key = (uint8_t)i;
+
+	// Operator.
+	if ((pQuery[0] == '!') && (pQuery[1] == '=')) {
+		filter.op = OP_NE;
+		pQuery += 2;
+	} else if ((pQuery[0] == '!') && (pQuery[1] == '~')) {
+		filter.op = OP_NOT_MATCH;
+		pQuery += 2;
+	} else if ((pQuery[0] == '<') && (pQuery[1] == '=')) {
+		filter.op = OP_LE;
+		pQuery += 2;
+	} else if ((pQuery[0] == '>') && (pQuery[1] == '=')) {
+		filter.op = OP_GE;
+		pQuery += 2;
+	} else if (*pQuery == '=') {
+		filter.op = OP_EQ;
+		pQuery++;
+	} else if (*pQuery == '<') {
+		filter.op = OP_LT;
+		pQuery++;
+	} else if (*pQuery == '>') {
+		filter.op = OP_GT;
+		pQuery++;
+	} else if (*pQuery == '~') {
+		filter.op = OP_MATCH;
+		pQuery++;
+	} else {
+		ThrowError(EMSG("Missing operator in path query filter"));
+		return false;
+	}
+
+	// Value.
+	if (!ParseString(&pQuery, "]", strValue))
+		return false;
+	if (*pQuery != ']') {
+		ThrowError(EMSG("Missing ] in path query filter"));
+		return false;
+	}
+	*ppQuery = pQuery + 1;
+
+	// Check if the operator makes sense for the key.
+	if ((filter.key == KEY_TEXT) || (filter.key == KEY_TYPE) ||
+			(filter.key == KEY_ICON)) {
+		if ((filter.op != OP_EQ) && (filter.op != OP_NE) &&
+				((filter.key != KEY_TEXT) || (filter.op < OP_MATCH))) {
+			ThrowError(EMSG("Invalid operator for path query filter"));
+			return false;
+		}
+	} else if (filter.op >= OP_MATCH) {
+		ThrowError(EMSG("Invalid operator for path query filter"));
+		return false;
+	}
+
+	// Parse the value.
+	switch (filter.key) {
+	case KEY_TYPE:
+		if (SameName(strValue.c_str(), "text")) {
+			filter.lo = BOLOTA_TYPE_TEXT;
+		} else if (SameName(strValue.c_str(), "icon")) {
+			filter.lo = BOLOTA_TYPE_ICON;
+		} else if (SameName(strValue.c_str(), "date")) {
+			filter.lo = BOLOTA_TYPE_DATE;
+		} else if (SameName(strValue.c_str(), "blank")) {
+			filter.lo = BOLOTA_TYPE_BLANK;
+		} else {
+			ThrowError(EMSG("Invalid type in path query filter"));
+			return false;
+		}
+		filter.hi = filter.lo;
+		break;
+	case KEY_ICON:
+		for (i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++) {
+			if (SameName(strValue.c_str(), szIconNames[i]))
+				break;
+		}
+		filter.lo = (uint64_t)i;
+		if ((i > BOLOTA_FIELD_ICON_NUM) &&
+				(!ParseNumber(strValue, &filter.lo) ||
+				(filter.lo > BOLOTA_FIELD_ICON_NUM))) {
+			ThrowError(EMSG("Invalid icon in path query filter"));
+			return false;
+		}
+		filter.hi = filter.lo;
+		break;
+	case KEY_DATE:
+		if (!ParseDate(strValue, &filter.lo, &filter.hi)) {
+			ThrowError(EMSG("Invalid date in path query filter"));
+			return false;
+		}
+		break;
+	case KEY_TEXT:
+		filter.lo = 0;
+		filter.hi = 0;
+		if (filter.op < OP_MATCH) {
+			filter.text = strValue;
+			break;
+		}
+
+		// Regular expressions live on their own.
+		m_regexes.push_back(Regex());
+		if (!m_regexes.back().Compile(strValue.c_str(), false))
+			return false;
+		filter.lo = m_regexes.size() - 1;
+		filter.hi = filter.lo;
+		break;
+	default:
+		if (!ParseNumber(strValue, &filter.lo)) {
+			ThrowError(EMSG("Invalid number in path query filter"));
+			return false;
+		}
+		filter.hi = filter.lo;
+		break;
+	}
+
+	return true;
+}
+
+/**
+ * Parses a text that is either quoted or goes up to a stop character.
+ *
+ * @param ppQuery Pointer to the query, moved past the text on return.
+ * @param szStop  Characters that end a text that isn't quoted.
+ * @param str     String to receive the text.
+ *
+ * @return TRUE if the text was parsed.
+ */
+bool PathQuery::ParseString(const char **ppQuery, const char *szStop,
+							std::string& str) {
+	const char *pQuery = *ppQuery;
+
+	str.clear();
+	if (*pQuery != '"') {
+		while ((*pQuery != '\0') && (strchr(szStop, *pQuery) == NULL))
+			str += *pQuery++;
+
+		*ppQuery = pQuery;
+		return true;
+	}
+
+	// Quoted text with backslash escapes.
+	for (pQuery++; *pQuery != '"'; pQuery++) {
+		if ((*pQuery == '\\') && (pQuery[1] != '\0'))
+			pQuery++;
+		if (*pQuery == '\0') {
+			ThrowError(EMSG("Missing \" in path query"));
+			return false;
+		}
+
+		str += *pQuery;
+	}
+
+	*ppQuery = pQuery + 1;
+	return true;
+}
+
+/**
+ * Parses a decimal number.
+ *
+ * @param strValue Text to be parsed.
+ * @param value    Pointer to receive the number.
+ *
+ * @return TRUE if the text was a valid number.
+ */
+bool PathQuery::ParseNumber(const std::string& strValue, uint64_t *value) {
+	if (strValue.empty() || (strValue.size() > 9))
+		return false;
+
+	*value = 0;
+	for (size_t i = 0; i < strValue.size(); i++) {
+		if ((strValue[i] < '0') || (strValue[i] > '9'))
+			return false;
+		*value = (*value * 10) + (strValue[i] - '0');
+	}
+
+	return true;
+}
+
+/**
+ * Parses a date in the YYYY-MM-DD[THH:MM:SS] format into the range of
+ * timestamp keys that it covers.
+ *
+ * @param strValue Text to be parsed.
+ * @param lo       Pointer to receive the key of the start of the range.
+ * @param hi       Pointer to receive the key of the end of the range.
+ *
+ * @return TRUE if the text was a valid date.
+ */
+bool PathQuery::ParseDate(const std::string& strValue, uint64_t *lo,
+						  uint64_t *hi) {
+	unsigned int year, month, day;
+	unsigned int hour, minute, second;
+	timestamp_t ts;
+	char sep;
+	int iRead = 0;
+
+	// Date.
+	if ((sscanf(strValue.c_str(), "%4u-%2u-%2u%n", &year, &month, &day,
+			&iRead) != 3) || (month < 1) || (month > 12) || (day < 1) ||
+			(day > 31)) {
+		return false;
+	}
+	ts.year = (uint16_t)year;
+	ts.month = (uint8_t)month;
+	ts.day = (uint8_t)day;
+	ts.reserved = 0;
+
+	// The whole day.
+	if (strValue[iRead] == '\0') {
+		ts.hour = 0;
+		ts.minute = 0;
+		ts.second = 0;
+		*lo = DateIndex::Key(&ts);
+		ts.hour = 23;
+		ts.minute = 59;
+		ts.second = 59;
+		*hi = DateIndex::Key(&ts);
+
+		return true;
+	}
+
+	// A moment in time.
+	const char *szTime = strValue.c_str() + iRead;
+	iRead = 0;
+	if ((sscanf(szTime, "%c%2u:%2u:%2u%n", &sep, &hour, &minute, &second,
+			&iRead) != 4) || (szTime[iRead] != '\0') ||
+			((sep != 'T') && (sep != ' ')) || (hour > 23) || (minute > 59) ||
+			(second > 59)) {
+		return false;
+	}
+	ts.hour = (uint8_t)hour;
+	ts.minute = (uint8_t)minute;
+	ts.second = (uint8_t)second;
+	*lo = DateIndex::Key(&ts);
+	*hi = *lo;
+
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Optimization                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Rearranges the compiled query so that it does as little work as possible.
+ * Filters are sorted so that the cheap ones throw out topics before the text
+ * is even looked at, and the depth limits of each step are pushed down to the
+ * ones before it, so that subtrees that are too deep for the rest of the path
+ * are never visited.
+ */
+void PathQuery::PushDown() {
+	int maxDepth = PATHQUERY_ANY_DEPTH;
+
+	for (size_t i = m_steps.size(); i > 0; i--) {
+		Step& step = m_steps[i - 1];
+
+		// Parent steps let us go back up.
+		if (step.bParent) {
+			maxDepth = PATHQUERY_ANY_DEPTH;
+			continue;
+		}
+
+		// Cheap filters first.
+		std::vector<Filter>::iterator it = m_filters.begin() +
+			step.ulFirstFilter;
+		std::stable_sort(it, it + step.ulFilters, Cheaper);
+
+		// Deepest the step can match at on its own.
+		for (size_t j = 0; j < step.ulFilters; j++) {
+			const Filter& filter = m_filters[step.ulFirstFilter + j];
+			if (filter.key != KEY_DEPTH)
+				continue;
+
+			if ((filter.op == OP_EQ) || (filter.op == OP_LE)) {
+				step.maxDepth = std::min(step.maxDepth, (int)filter.hi);
+			} else if (filter.op == OP_LT) {
+				step.maxDepth = std::min(step.maxDepth, (int)filter.lo - 1);
+			}
+		}
+
+		// Every step after it has to go at least one level deeper.
+		step.maxDepth = std::min(step.maxDepth, maxDepth);
+		maxDepth = step.maxDepth - 1;
+	}
+}
+
+/**
+ * Checks if a filter should be checked before another one.
+ *
+ * @param a Filter to be checked.
+ * @param b Filter to compare against.
+ *
+ * @return TRUE if the first filter is cheaper to check.
+ */
+bool PathQuery::Cheaper(const Filter& a, const Filter& b) {
+	if (a.key != b.key)
+		return a.key < b.key;
+
+	return a.op < b.op;
+}
@@ -0,0 +1,159 @@
+/**
+ * PathQuery.h
+ * Path queries over the outline of a document.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_PATHQUERY_H
+#define _BOLOTA_PATHQUERY_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "Document.h"
+#include "FlatDocument.h"
+#include "Regex.h"
+
+/**
+ * Maximum number of steps of a query between two parent (..) steps.
+ */
+#define BOLOTA_PATHQUERY_STEPS_MAX 64
+
+namespace Bolota {
+
+	/**
+	 * Query that selects topics of a document by their path in the outline,
+	 * in the spirit of XPath. A query is made of steps separated by / for
+	 * children or // for descendants at any depth. Each step matches the
+	 * exact text of a topic, any topic (*), the current one (.) or its
+	 * parent (..), and is optionally followed by filters in brackets:
+	 *
+	 *   /Projects/Bolota/[icon=check]
+	 *   //[type=date][year=2025]/..
+	 *   //[text~"^TODO"][depth<=2]
+	 *
+	 * Filters compare a key with = and !=, numeric keys with <, <=, > and >=
+	 * as well, and texts against a regular expression with ~ and !~. The
+	 * keys are type (text, icon, date or blank), icon (name or number), text,
+	 * depth (top-level topics are 0), date (YYYY-MM-DD[THH:MM:SS], a whole
+	 * day unless the time is given), year, month and day. Only icon topics
+	 * have an icon and only date topics have dates, so every filter on those
+	 * fails for other topics. Texts and values may be quoted with "" when
+	 * they have any of / [ ] in them.
+	 *
+	 * Queries are compiled into a matcher that runs over the tree only once
+	 * per parent step, keeping track of the steps that are still in the
+	 * running at each topic in a bitmask, and skipping the subtrees where
+	 * none are left. Filters are checked cheapest first and depth limits are
+	 * pushed down to every step before them. Queries can be run on a
+	 * Document or on a FlatDocument with the same results, always in
+	 * document order and without duplicates.
+	 */
+	class PathQuery {
+	protected:
+		// Filter of a step.
+		struct Filter {
+			uint8_t key;
+			uint8_t op;
+			uint64_t lo;
+			uint64_t hi;
+			std::string text;
+		};
+
+		// Step of the path.
+		struct Step {
+			bool bParent;
+			bool bDescendant;
+			bool bAnyText;
+			std::string text;
+			size_t ulFirstFilter;
+			size_t ulFilters;
+			int maxDepth;
+		};
+
+		// Topic being matched.
+		struct Topic {
+			const Field *field;
+			const FlatDocument *flat;
+			uint32_t index;
+			uint8_t depth;
+		};
+
+		// State of a pass over the document.
+		struct Pass {
+			size_t ulFirst;
+			size_t ulLast;
+			bool bRoot;
+			std::vector<uint32_t> vecScratch;
+		};
+
+		// Compiled query.
+		std::vector<Step> m_steps;
+		std::vector<Filter> m_filters;
+		std::vector<Regex> m_regexes;
+		bool m_bCompiled;
+
+	public:
+		// Constructors and destructors.
+		PathQuery();
+		virtual ~PathQuery();
+
+		// Compiling.
+		bool Compile(const char *szQuery);
+		bool IsCompiled() const;
+
+		// Running.
+		size_t Run(const Document *doc, std::vector<Field*>& vecResults) const;
+		size_t Run(const FlatDocument *doc,
+			std::vector<uint32_t>& vecResults) const;
+
+	protected:
+		// Parsing.
+		bool ParseStep(const char **ppQuery, bool bDescendant);
+		bool ParseFilter(const char **ppQuery, Filter& filter);
+		static bool ParseString(const char **ppQuery, const char *szStop,
+			std::string& str);
+		static bool ParseNumber(const std::string& strValue, uint64_t *value);
+		static bool ParseDate(const std::string& strValue, uint64_t *lo,
+			uint64_t *hi);
+
+		// Optimization.
+		void PushDown();
+		static bool Cheaper(const Filter& a, const Filter& b);
+
+		// Passes over a tree of fields.
+		void RunPass(Pass& pass, Field *first, uint8_t depth, uint64_t state,
+			const std::vector<Field*>& vecContexts,
+			const std::vector<Field*>& vecAncestors,
+			std::vector<Field*>& vecResults) const;
+
+		// Passes over a flat document.
+		void RunPass(Pass& pass, const FlatDocument *doc,
+			const std::vector<uint32_t>& vecContexts,
+			std::vector<uint32_t>& vecResults) const;
+
+		// Matching.
+		static bolota_type_t Type(const Topic& topic);
+		static const char* Text(const Topic& topic, size_t *pulLength);
+		uint64_t Advance(Pass& pass, uint64_t state, const Topic& topic,
+			bool *pbMatched) const;
+		bool Matches(Pass& pass, const Step& step, const Topic& topic) const;
+		bool Matches(Pass& pass, const Filter& filter,
+			const Topic& topic) const;
+	};
+
+}
+
+#endif // _BOLOTA_PATHQUERY_H
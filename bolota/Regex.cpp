@@ -0,0 +1,1232 @@
+/**
+ * Regex.cpp
+ * Regular expressions matched in linear time over UTF-8 texts.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "Regex.h"
+
+#include <string.h>
+
+#include "../../shims/cvtutf/Unicode.h"
+#include "Errors/ErrorCollection.h"
+
+using namespace Bolota;
+
+/**
+ * Instructions of the program.
+ */
+#define OP_CHAR   0
+#define OP_ANY    1
+#define OP_CLASS  2
+#define OP_ASSERT 3
+#define OP_SPLIT  4
+#define OP_JMP    5
+#define OP_MATCH  6
+
+/**
+ * Types of nodes of the parsed pattern.
+ */
+#define NODE_CHAR   0
+#define NODE_ANY    1
+#define NODE_CLASS  2
+#define NODE_ASSERT 3
+#define NODE_CONCAT 4
+#define NODE_ALT    5
+#define NODE_REPEAT 6
+
+/**
+ * Zero-width assertions.
+ */
+#define ASSERT_BEGIN    0
+#define ASSERT_END      1
+#define ASSERT_WORD     2
+#define ASSERT_NOT_WORD 3
+
+/**
+ * Value used for nodes that couldn't be parsed.
+ */
+#define REGEX_NONE ((uint32_t)-1)
+
+/**
+ * Maximum of an open ended repetition.
+ */
+#define REGEX_INFINITE ((uint32_t)-1)
+
+/**
+ * Invalid UTF-8 bytes are matched as this plus the value of the byte, so that
+ * they never match a proper character.
+ */
+#define REGEX_INVALID_BASE 0x110000
+
+/**
+ * Last code point that can ever be matched. (invalid bytes included)
+ */
+#define REGEX_CHAR_LAST (REGEX_INVALID_BASE + 0xFF)
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty regular expression that never matches.
+ */
+Regex::Regex() {
+	m_bIgnoreCase = false;
+	m_bAnchored = false;
+}
+
+/**
+ * Frees up the program.
+ */
+Regex::~Regex() {
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Compiling                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Compiles a pattern into a program that can be matched.
+ *
+ * @param szPattern   UTF-8 pattern to be compiled.
+ * @param bIgnoreCase Ignore the case of ASCII letters?
+ *
+ * @return TRUE if the pattern was compiled, FALSE if it's invalid.
+ */
+bool Regex::Compile(const char *szPattern, bool bIgnoreCase) {
+	const char *pPattern = szPattern;
+	const char *pEnd = szPattern + strlen(szPattern);
+	uint32_t root;
+
+	// Start from scratch.
+	m_program.clear();
+	m_ranges.clear();
+	m_classes.clear();
+	m_prefix.clear();
+	m_nodes.clear();
+	m_bIgnoreCase = bIgnoreCase;
+	m_bAnchored = false;
+
+	// Parse the pattern.
+	root = ParseAlternation(&pPattern, pEnd, 0);
+	if (root == REGEX_NONE)
+		goto error_handling;
+	if (pPattern != pEnd) {
+		ThrowError(EMSG("Unmatched ) in regular expression"));
+		goto error_handling;
+	}
+
+	// Generate the program.
+	if (!Emit(root)) {
+		ThrowError(EMSG("Regular expression is too large"));
+		goto error_handling;
+	}
+	EmitInst(OP_MATCH, 0, 0);
+	CollectPrefix(root);
+	m_bAnchored = StartsAnchored(root);
+
+	std::vector<Node>().swap(m_nodes);
+	return true;
+
+error_handling:
+	m_program.clear();
+	m_ranges.clear();
+	m_classes.clear();
+	m_prefix.clear();
+	std::vector<Node>().swap(m_nodes);
+	return false;
+}
+
+/**
+ * Checks if a pattern was successfully compiled.
+ *
+ * @return TRUE if there's a program to be matched.
+ */
+bool Regex::IsCompiled() const {
+	return !m_program.empty();
+}
+
+/**
+ * Gets the literal text every match starts with.
+ *
+ * @return Prefix of every match. Empty if the pattern doesn't have one.
+ */
+const std::string& Regex::Prefix() const {
+	return m_prefix;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Matching                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the leftmost match of the pattern in a text.
+ *
+ * @param mbstr    UTF-8 text to be searched.
+ * @param ulLength Length of the text in bytes.
+ * @param pulStart Pointer to receive the offset of the start of the match.
+ * @param pulEnd   Pointer to receive the offset of the end of the match.
+ *
+ * @return TRUE if the pattern was found in the text.
+ */
+bool Regex::Search(const char *mbstr, size_t ulLength, size_t *pulStart,
+				   size_t *pulEnd) const {
+	std::vector<uint32_t> vecScratch;
+	return Search(mbstr, ulLength, pulStart, pulEnd, vecScratch);
+}
+
+/**
+ * Finds the leftmost match of the pattern in a text. Longer matches are
+ * preferred by greedy quantifiers and earlier alternatives are preferred over
+ * later ones, just like backtracking engines do.
+ *
+ * This method doesn't change the object, so the same expression can be used
+ * by many threads at once as long as each one has its own scratch space.
+ *
+ * @param mbstr      UTF-8 text to be searched.
+ * @param ulLength   Length of the text in bytes.
+ * @param pulStart   Pointer to receive the offset of the start of the match.
+ * @param pulEnd     Pointer to receive the offset of the end of the match.
+ * @param vecScratch Scratch space for the matcher. Reusing it between calls
+ *                   avoids allocating memory for every search.
+ *
+ * @return TRUE if the pattern was found in the text.
+ */
+bool Regex::Search(const char *mbstr, size_t ulLength, size_t *pulStart,
+				   size_t *pulEnd, std::vector<uint32_t>& vecScratch) const {
+	size_t ulCount = m_program.size();
+	uint32_t ulCurrent = 0;
+	uint32_t ulNext = 0;
+	uint32_t gen = 0;
+	size_t ulPos = 0;
+	bool bMatched = false;
+
+	if (ulCount == 0)
+		return false;
+
+	// Split the scratch space into the thread lists, marks and stack.
+	if (vecScratch.size() < ((ulCount * 7) + 1))
+		vecScratch.resize((ulCount * 7) + 1);
+	uint32_t *clist = &vecScratch[0];
+	uint32_t *nlist = clist + (ulCount * 2);
+	uint32_t *marks = nlist + (ulCount * 2);
+	uint32_t *stack = marks + ulCount;
+	memset(marks, 0, ulCount * sizeof(uint32_t));
+
+	// Skip ahead to the first place where a match may start.
+	if (!m_prefix.empty()) {
+		const char *szFound = Unicode::FindMultiByte(mbstr, ulLength,
+			m_prefix.c_str(), m_prefix.size(), m_bIgnoreCase);
+		if (szFound == NULL)
+			return false;
+
+		ulPos = szFound - mbstr;
+		if (m_bAnchored && (ulPos > 0))
+			return false;
+	}
+	AddThread(clist, &ulCurrent, marks, ++gen, stack, 0, (uint32_t)ulPos,
+		mbstr, ulLength, ulPos);
+
+	while (true) {
+		uint32_t c = 0;
+		size_t ulAfter = ulPos;
+
+		// Get the character at this position.
+		if (ulPos < ulLength)
+			ulAfter = ulPos + DecodeChar(mbstr, ulLength, ulPos, &c);
+		uint32_t cFolded = (m_bIgnoreCase) ? FoldChar(c) : c;
+
+		// Advance every thread in order of priority.
+		gen++;
+		ulNext = 0;
+		for (uint32_t i = 0; i < ulCurrent; i++) {
+			uint32_t pc = clist[i * 2];
+			uint32_t start = clist[(i * 2) + 1];
+			const Inst& inst = m_program[pc];
+			bool bAdvance = false;
+
+			switch (inst.op) {
+			case OP_MATCH:
+				// Threads with a lower priority are cut off.
+				*pulStart = start;
+				*pulEnd = ulPos;
+				bMatched = true;
+				i = ulCurrent;
+				break;
+			case OP_CHAR:
+				bAdvance = (ulPos < ulLength) && (cFolded == inst.x);
+				break;
+			case OP_ANY:
+				bAdvance = (ulPos < ulLength) && (c != '\n');
+				break;
+			case OP_CLASS:
+				bAdvance = (ulPos < ulLength) && InClass(inst.x, c);
+				break;
+			}
+
+			if (bAdvance) {
+				AddThread(nlist, &ulNext, marks, gen, stack, pc + 1, start,
+					mbstr, ulLength, ulAfter);
+			}
+		}
+		if (ulPos >= ulLength)
+			break;
+		ulPos = ulAfter;
+
+		// Start another attempt here if we haven't found anything yet.
+		if (!bMatched && !m_bAnchored) {
+			if ((ulNext == 0) && !m_prefix.empty()) {
+				const char *szFound = Unicode::FindMultiByte(mbstr + ulPos,
+					ulLength - ulPos, m_prefix.c_str(), m_prefix.size(),
+					m_bIgnoreCase);
+				if (szFound == NULL)
+					break;
+
+				ulPos = szFound - mbstr;
+				gen++;
+			}
+
+			AddThread(nlist, &ulNext, marks, gen, stack, 0, (uint32_t)ulPos,
+				mbstr, ulLength, ulPos);
+		}
+		if ((ulNext == 0) && (bMatched || m_bAnchored))
+			break;
+
+		// Swap the lists.
+		uint32_t *list = clist;
+		clist = nlist;
+		nlist = list;
+		ulCurrent = ulNext;
+	}
+
+	return bMatched;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Parsing                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Appends a node to the parsed pattern.
+ *
+ * @param type  Type of the node.
+ * @param value Character, class or assertion of the node.
+ *
+ * @return Index of the new node.
+ */
+uint32_t Regex::AddNode(uint8_t type, uint32_t value) {
+	Node node;
+
+	node.type = type;
+	node.value = value;
+	node.min = 1;
+	node.max = 1;
+	node.bGreedy = true;
+	m_nodes.push_back(node);
+
+	return (uint32_t)(m_nodes.size() - 1);
+}
+
+/**
+ * Parses alternatives separated by |.
+ *
+ * @param ppPattern Pointer to the current position in the pattern. Updated on
+ *                  return.
+ * @param pEnd      End of the pattern.
+ * @param uDepth    Number of groups we're in.
+ *
+ * @return Index of the node or REGEX_NONE if the pattern is invalid.
+ */
+uint32_t Regex::ParseAlternation(const char **ppPattern, const char *pEnd,
+								 unsigned int uDepth) {
+	uint32_t first;
+	uint32_t alt;
+
+	if (uDepth > BOLOTA_REGEX_NESTING_MAX) {
+		ThrowError(EMSG("Too many nested groups in regular expression"));
+		return REGEX_NONE;
+	}
+
+	// Check if there are any alternatives at all.
+	first = ParseConcatenation(ppPattern, pEnd, uDepth);
+	if ((first == REGEX_NONE) || (*ppPattern >= pEnd) || (**ppPattern != '|'))
+		return first;
+
+	alt = AddNode(NODE_ALT, 0);
+	m_nodes[alt].children.push_back(first);
+	while ((*ppPattern < pEnd) && (**ppPattern == '|')) {
+		(*ppPattern)++;
+		uint32_t node = ParseConcatenation(ppPattern, pEnd, uDepth);
+		if (node == REGEX_NONE)
+			return REGEX_NONE;
+		m_nodes[alt].children.push_back(node);
+	}
+
+	return alt;
+}
+
+/**
+ * Parses a sequence of (possibly repeated) atoms.
+ *
+ * @param ppPattern Pointer to the current position in the pattern. Updated on
+ *                  return.
+ * @param pEnd      End of the pattern.
+ * @param uDepth    Number of groups we're in.
+ *
+ * @return Index of the node or REGEX_NONE if the pattern is invalid.
+ */
+uint32_t Regex::ParseConcatenation(const char **ppPattern, const char *pEnd,
+								   unsigned int uDepth) {
+	uint32_t concat = AddNode(NODE_CONCAT, 0);
+
+	while ((*ppPattern < pEnd) && (**ppPattern != '|') &&
+			(**ppPattern != ')')) {
+		uint32_t node = ParseRepetition(ppPattern, pEnd, uDepth);
+		if (node == REGEX_NONE)
+			return REGEX_NONE;
+		m_nodes[concat].children.push_back(node);
+	}
+
+	return concat;
+}
+
+/**
+ * Parses an atom followed by any number of quantifiers.
+ *
+ * @param ppPattern Pointer to the current position in the pattern. Updated on
+ *                  return.
+ * @param pEnd      End of the pattern.
+ * @param uDepth    Number of groups we're in.
+ *
+ * @return Index of the node or REGEX_NONE if the pattern is invalid.
+ */
+uint32_t Regex::ParseRepetition(const char **ppPattern, const char *pEnd,
+								unsigned int uDepth) {
+	uint32_t node = ParseAtom(ppPattern, pEnd, uDepth);
+
+	while ((node != REGEX_NONE) && (*ppPattern < pEnd)) {
+		const char *pPattern = *ppPattern;
+		uint32_t min;
+		uint32_t max;
+
+		// Get the bounds of the repetition.
+		switch (*pPattern) {
+		case '*':
+			min = 0;
+			max = REGEX_INFINITE;
+			pPattern++;
+			break;
+		case '+':
+			min = 1;
+			max = REGEX_INFINITE;
+			pPattern++;
+			break;
+		case '?':
+			min = 0;
+			max = 1;
+			pPattern++;
+			break;
+		case '{':
+			// Braces that aren't a count are just a literal.
+			if (!ParseCount(&pPattern, pEnd, &min, &max))
+				return node;
+			if (((max != REGEX_INFINITE) && (max > BOLOTA_REGEX_REPEAT_MAX)) ||
+					(min > BOLOTA_REGEX_REPEAT_MAX)) {
+				ThrowError(EMSG("Repetition count too large in regular ")
+					_T("expression"));
+				return REGEX_NONE;
+			}
+			if (min > max) {
+				ThrowError(EMSG("Invalid repetition count in regular ")
+					_T("expression"));
+				return REGEX_NONE;
+			}
+			break;
+		default:
+			return node;
+		}
+
+		// Assertions don't match anything that could be repeated.
+		if (m_nodes[node].type == NODE_ASSERT) {
+			ThrowError(EMSG("Nothing to repeat in regular expression"));
+			return REGEX_NONE;
+		}
+
+		// Wrap the atom in a repetition.
+		uint32_t repeat = AddNode(NODE_REPEAT, 0);
+		m_nodes[repeat].min = min;
+		m_nodes[repeat].max = max;
+		if ((pPattern < pEnd) && (*pPattern == '?')) {
+			m_nodes[repeat].bGreedy = false;
+			pPattern++;
+		}
+		m_nodes[repeat].children.push_back(node);
+
+		node = repeat;
+		*ppPattern = pPattern;
+	}
+
+	return node;
+}
+
+/**
+ * Parses a single character, class, group or assertion.
+ *
+ * @param ppPattern Pointer to the current position in the pattern. Updated on
+ *                  return.
+ * @param pEnd      End of the pattern.
+ * @param uDepth    Number of groups we're in.
+ *
+ * @return Index of the node or REGEX_NONE if the pattern is invalid.
+ */
+uint32_t Regex::ParseAtom(const char **ppPattern, const char *pEnd,
+						  unsigned int uDepth) {
+	uint32_t node;
+	uint32_t c;
+	int shorthand;
+
+	switch (**ppPattern) {
+	case '(':
+		// Groups don't capture anything, so (?: is the same thing.
+		(*ppPattern)++;
+		if (((pEnd - *ppPattern) >= 2) && ((*ppPattern)[0] == '?') &&
+				((*ppPattern)[1] == ':')) {
+			*ppPattern += 2;
+		}
+
+		node = ParseAlternation(ppPattern, pEnd, uDepth + 1);
+		if (node == REGEX_NONE)
+			return REGEX_NONE;
+		if ((*ppPattern >= pEnd) || (**ppPattern != ')')) {
+			ThrowError(EMSG("Missing ) in regular expression"));
+			return REGEX_NONE;
+		}
+		(*ppPattern)++;
+
+		return node;
+	case '[':
+		(*ppPattern)++;
+		return ParseClass(ppPattern, pEnd);
+	case '.':
+		(*ppPattern)++;
+		return AddNode(NODE_ANY, 0);
+	case '^':
+		(*ppPattern)++;
+		return AddNode(NODE_ASSERT, ASSERT_BEGIN);
+	case '$':
+		(*ppPattern)++;
+		return AddNode(NODE_ASSERT, ASSERT_END);
+	case '*':
+	case '+':
+	case '?':
+		ThrowError(EMSG("Nothing to repeat in regular expression"));
+		return REGEX_NONE;
+	case '\\':
+		// Word boundaries only make sense outside of classes.
+		if ((pEnd - *ppPattern) >= 2) {
+			if ((*ppPattern)[1] == 'b') {
+				*ppPattern += 2;
+				return AddNode(NODE_ASSERT, ASSERT_WORD);
+			} else if ((*ppPattern)[1] == 'B') {
+				*ppPattern += 2;
+				return AddNode(NODE_ASSERT, ASSERT_NOT_WORD);
+			}
+		}
+		break;
+	}
+
+	// Single character or one of the shorthand classes.
+	if (!ParseClassChar(ppPattern, pEnd, &c, &shorthand))
+		return REGEX_NONE;
+	if (shorthand == 0)
+		return AddNode(NODE_CHAR, c);
+
+	Class cls;
+	cls.start = (uint32_t)m_ranges.size();
+	cls.bNegated = false;
+	AddShorthand(shorthand);
+	cls.count = (uint32_t)m_ranges.size() - cls.start;
+	m_classes.push_back(cls);
+
+	return AddNode(NODE_CLASS, (uint32_t)(m_classes.size() - 1));
+}
+
+/**
+ * Parses a character class. The opening bracket must have already been
+ * consumed.
+ *
+ * @param ppPattern Pointer to the current position in the pattern. Updated on
+ *                  return.
+ * @param pEnd      End of the pattern.
+ *
+ * @return Index of the node or REGEX_NONE if the pattern is invalid.
+ */
+uint32_t Regex::ParseClass(const char **ppPattern, const char *pEnd) {
+	bool bFirst = true;
+	Class cls;
+
+	cls.start = (uint32_t)m_ranges.size();
+	cls.bNegated = false;
+	if ((*ppPattern < pEnd) && (**ppPattern == '^')) {
+		cls.bNegated = true;
+		(*ppPattern)++;
+	}
+
+	while (true) {
+		uint32_t first;
+		uint32_t last;
+		int shorthand;
+
+		// A closing bracket right at the start is just a character.
+		if (*ppPattern >= pEnd) {
+			ThrowError(EMSG("Missing ] in regular expression"));
+			return REGEX_NONE;
+		}
+		if ((**ppPattern == ']') && !bFirst) {
+			(*ppPattern)++;
+			break;
+		}
+		bFirst = false;
+
+		// Get the start of the range.
+		if (!ParseClassChar(ppPattern, pEnd, &first, &shorthand))
+			return REGEX_NONE;
+		if (shorthand != 0) {
+			AddShorthand(shorthand);
+			continue;
+		}
+
+		// Get the end of the range, if there is one.
+		last = first;
+		if (((pEnd - *ppPattern) >= 2) && (**ppPattern == '-') &&
+				((*ppPattern)[1] != ']')) {
+			(*ppPattern)++;
+			if (!ParseClassChar(ppPattern, pEnd, &last, &shorthand))
+				return REGEX_NONE;
+			if ((shorthand != 0) || (last < first)) {
+				ThrowError(EMSG("Invalid range in regular expression"));
+				return REGEX_NONE;
+			}
+		}
+
+		Range range;
+		range.first = first;
+		range.last = last;
+		m_ranges.push_back(range);
+	}
+
+	cls.count = (uint32_t)m_ranges.size() - cls.start;
+	m_classes.push_back(cls);
+
+	return AddNode(NODE_CLASS, (uint32_t)(m_classes.size() - 1));
+}
+
+/**
+ * Parses the bounds of a counted repetition: {n}, {n,} or {n,m}.
+ *
+ * @param ppPattern Pointer to the opening brace. Updated on return.
+ * @param pEnd      End of the pattern.
+ * @param pMin      Pointer to receive the minimum number of repetitions.
+ * @param pMax      Pointer to receive the maximum number of repetitions.
+ *
+ * @return TRUE if a count was parsed, FALSE if the brace isn't a count.
+ */
+bool Regex::ParseCount(const char **ppPattern, const char *pEnd,
+					   uint32_t *pMin, uint32_t *pMax) {
+	const char *pPattern = *ppPattern + 1;
+	uint32_t *pValue = pMin;
+	bool bDigits = false;
+
+	*pMin = 0;
+	*pMax = REGEX_INFINITE;
+	while (pPattern < pEnd) {
+		char c = *pPattern++;
+
+		if ((c >= '0') && (c <= '9')) {
+			// Saturate so that huge counts are caught later.
+			if (*pValue == REGEX_INFINITE)
+				*pValue = 0;
+			if (*pValue <= BOLOTA_REGEX_REPEAT_MAX)
+				*pValue = (*pValue * 10) + (c - '0');
+			bDigits = true;
+		} else if ((c == ',') && (pValue == pMin) && bDigits) {
+			pValue = pMax;
+		} else if ((c == '}') && bDigits) {
+			if (pValue == pMin)
+				*pMax = *pMin;
+			*ppPattern = pPattern;
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Parses a single (possibly escaped) character of the pattern.
+ *
+ * @param ppPattern   Pointer to the character. Updated on return.
+ * @param pEnd        End of the pattern.
+ * @param pChar       Pointer to receive the code point of the character.
+ * @param pShorthand  Pointer to receive the letter of a shorthand class (such
+ *                    as \d) or 0 if it's a single character.
+ *
+ * @return TRUE if the character was parsed, FALSE if it's invalid.
+ */
+bool Regex::ParseClassChar(const char **ppPattern, const char *pEnd,
+						   uint32_t *pChar, int *pShorthand) {
+	*pShorthand = 0;
+
+	// Handle escape sequences.
+	if (**ppPattern == '\\') {
+		(*ppPattern)++;
+		if (*ppPattern >= pEnd) {
+			ThrowError(EMSG("Trailing backslash in regular expression"));
+			return false;
+		}
+
+		char c = **ppPattern;
+		switch (c) {
+		case 'd':
+		case 'D':
+		case 'w':
+		case 'W':
+		case 's':
+		case 'S':
+			*pShorthand = c;
+			(*ppPattern)++;
+			return true;
+		case 'n':
+			*pChar = '\n';
+			(*ppPattern)++;
+			return true;
+		case 'r':
+			*pChar = '\r';
+			(*ppPattern)++;
+			return true;
+		case 't':
+			*pChar = '\t';
+			(*ppPattern)++;
+			return true;
+		case 'f':
+			*pChar = '\f';
+			(*ppPattern)++;
+			return true;
+		case 'v':
+			*pChar = '\v';
+			(*ppPattern)++;
+			return true;
+		case 'x':
+			// Exactly two hexadecimal digits.
+			*pChar = 0;
+			for (int i = 1; i <= 2; i++) {
+				char h = ((pEnd - *ppPattern) > i) ? (*ppPattern)[i] : '\0';
+				if ((h >= '0') && (h <= '9')) {
+					*pChar = (*pChar << 4) | (h - '0');
+				} else if ((h >= 'a') && (h <= 'f')) {
+					*pChar = (*pChar << 4) | (h - 'a' + 10);
+				} else if ((h >= 'A') && (h <= 'F')) {
+					*pChar = (*pChar << 4) | (h - 'A' + 10);
+				} else {
+					ThrowError(EMSG("Invalid \\x escape in regular ")
+						_T("expression"));
+					return false;
+				}
+			}
+			*ppPattern += 3;
+			return true;
+		}
+
+		// Letters and digits are reserved for future escapes.
+		if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+				((c >= '0') && (c <= '9'))) {
+			ThrowError(EMSG("Unknown escape in regular expression"));
+			return false;
+		}
+	}
+
+	// Decode the character itself.
+	*ppPattern += DecodeChar(*ppPattern, pEnd - *ppPattern, 0, pChar);
+	if (*pChar >= REGEX_INVALID_BASE) {
+		ThrowError(EMSG("Invalid UTF-8 in regular expression"));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Adds the ranges of a shorthand class to the class being parsed.
+ *
+ * @param shorthand Letter of the class. Upper case letters are the negated
+ *                  versions of the lower case ones.
+ */
+void Regex::AddShorthand(int shorthand) {
+	static const Range digits[] = { { '0', '9' } };
+	static const Range words[] = {
+		{ '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' }
+	};
+	static const Range spaces[] = { { '\t', '\r' }, { ' ', ' ' } };
+	const Range *ranges;
+	size_t ulCount;
+	size_t i;
+
+	// Get the ranges of the class.
+	switch (shorthand) {
+	case 'd':
+	case 'D':
+		ranges = digits;
+		ulCount = sizeof(digits) / sizeof(Range);
+		break;
+	case 'w':
+	case 'W':
+		ranges = words;
+		ulCount = sizeof(words) / sizeof(Range);
+		break;
+	default:
+		ranges = spaces;
+		ulCount = sizeof(spaces) / sizeof(Range);
+		break;
+	}
+
+	// Add them as they are.
+	if ((shorthand >= 'a') && (shorthand <= 'z')) {
+		m_ranges.insert(m_ranges.end(), ranges, ranges + ulCount);
+		return;
+	}
+
+	// Add everything in between them.
+	uint32_t first = 0;
+	for (i = 0; i < ulCount; i++) {
+		if (ranges[i].first > first) {
+			Range range;
+			range.first = first;
+			range.last = ranges[i].first - 1;
+			m_ranges.push_back(range);
+		}
+		first = ranges[i].last + 1;
+	}
+
+	Range range;
+	range.first = first;
+	range.last = REGEX_CHAR_LAST;
+	m_ranges.push_back(range);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Code Generation                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Generates the instructions of a node of the parsed pattern.
+ *
+ * @param node Index of the node.
+ *
+ * @return TRUE if successful, FALSE if the program got too large.
+ */
+bool Regex::Emit(uint32_t node) {
+	const Node& n = m_nodes[node];
+	std::vector<uint32_t> vecPatches;
+	uint32_t i;
+
+	if (m_program.size() > BOLOTA_REGEX_PROGRAM_MAX)
+		return false;
+
+	switch (n.type) {
+	case NODE_CHAR:
+		EmitInst(OP_CHAR, (m_bIgnoreCase) ? FoldChar(n.value) : n.value, 0);
+		break;
+	case NODE_ANY:
+		EmitInst(OP_ANY, 0, 0);
+		break;
+	case NODE_CLASS:
+		EmitInst(OP_CLASS, n.value, 0);
+		break;
+	case NODE_ASSERT:
+		EmitInst(OP_ASSERT, n.value, 0);
+		break;
+	case NODE_CONCAT:
+		for (i = 0; i < n.children.size(); i++) {
+			if (!Emit(n.children[i]))
+				return false;
+		}
+		break;
+	case NODE_ALT:
+		// Try each alternative in order, jumping to the end once one matched.
+		for (i = 0; i < n.children.size(); i++) {
+			uint32_t split = REGEX_NONE;
+			if ((i + 1) < n.children.size())
+				split = EmitInst(OP_SPLIT, (uint32_t)m_program.size() + 1, 0);
+			if (!Emit(n.children[i]))
+				return false;
+			if (split != REGEX_NONE) {
+				vecPatches.push_back(EmitInst(OP_JMP, 0, 0));
+				m_program[split].y = (uint32_t)m_program.size();
+			}
+		}
+		for (i = 0; i < vecPatches.size(); i++)
+			m_program[vecPatches[i]].x = (uint32_t)m_program.size();
+		break;
+	case NODE_REPEAT:
+		// Mandatory repetitions.
+		for (i = 0; i < n.min; i++) {
+			if (!Emit(n.children[0]))
+				return false;
+		}
+
+		if (n.max == REGEX_INFINITE) {
+			// Loop back for as long as it matches.
+			uint32_t split = EmitInst(OP_SPLIT, 0, 0);
+			if (!Emit(n.children[0]))
+				return false;
+			EmitInst(OP_JMP, split, 0);
+			vecPatches.push_back(split);
+		} else {
+			// Each optional repetition may skip straight to the end.
+			for (i = n.min; i < n.max; i++) {
+				vecPatches.push_back(EmitInst(OP_SPLIT, 0, 0));
+				if (!Emit(n.children[0]))
+					return false;
+			}
+		}
+
+		// Point the splits at the repetition and the way out of it.
+		for (i = 0; i < vecPatches.size(); i++) {
+			uint32_t body = vecPatches[i] + 1;
+			uint32_t exit = (uint32_t)m_program.size();
+			m_program[vecPatches[i]].x = (n.bGreedy) ? body : exit;
+			m_program[vecPatches[i]].y = (n.bGreedy) ? exit : body;
+		}
+		break;
+	}
+
+	return m_program.size() <= BOLOTA_REGEX_PROGRAM_MAX;
+}
+
+/**
+ * Appends an instruction to the program.
+ *
+ * @param op Operation of the instruction.
+ * @param x  First argument.
+ * @param y  Second argument.
+ *
+ * @return Index of the instruction.
+ */
+uint32_t Regex::EmitInst(uint8_t op, uint32_t x, uint32_t y) {
+	Inst inst;
+
+	inst.op = op;
+	inst.x = x;
+	inst.y = y;
+	m_program.push_back(inst);
+
+	return (uint32_t)(m_program.size() - 1);
+}
+
+/**
+ * Appends the literal text a node always starts with to the prefix of the
+ * pattern.
+ *
+ * @param node Index of the node.
+ *
+ * @return TRUE if the whole node is literal text and the prefix may continue
+ *         with whatever comes after it.
+ */
+bool Regex::CollectPrefix(uint32_t node) {
+	const Node& n = m_nodes[node];
+	char szChar[4];
+	size_t i;
+
+	switch (n.type) {
+	case NODE_CHAR:
+		// Encode the character back into UTF-8.
+		if (n.value < 0x80) {
+			szChar[0] = (char)n.value;
+			i = 1;
+		} else if (n.value < 0x800) {
+			szChar[0] = (char)(0xC0 | (n.value >> 6));
+			szChar[1] = (char)(0x80 | (n.value & 0x3F));
+			i = 2;
+		} else if (n.value < 0x10000) {
+			szChar[0] = (char)(0xE0 | (n.value >> 12));
+			szChar[1] = (char)(0x80 | ((n.value >> 6) & 0x3F));
+			szChar[2] = (char)(0x80 | (n.value & 0x3F));
+			i = 3;
+		} else {
+			szChar[0] = (char)(0xF0 | (n.value >> 18));
+			szChar[1] = (char)(0x80 | ((n.value >> 12) & 0x3F));
+			szChar[2] = (char)(0x80 | ((n.value >> 6) & 0x3F));
+			szChar[3] = (char)(0x80 | (n.value & 0x3F));
+			i = 4;
+		}
+		m_prefix.append(szChar, i);
+		return true;
+	case NODE_ASSERT:
+		// Assertions don't consume anything.
+		return true;
+	case NODE_CONCAT:
+		for (i = 0; i < n.children.size(); i++) {
+			if (!CollectPrefix(n.children[i]))
+				return false;
+		}
+		return true;
+	case NODE_REPEAT:
+		// At least one repetition is guaranteed to be there.
+		if (n.min > 0)
+			CollectPrefix(n.children[0]);
+		return false;
+	}
+
+	return false;
+}
+
+/**
+ * Checks if a node can only ever match at the start of the text.
+ *
+ * @param node Index of the node.
+ *
+ * @return TRUE if the node starts with a ^ assertion.
+ */
+bool Regex::StartsAnchored(uint32_t node) const {
+	const Node& n = m_nodes[node];
+	size_t i;
+
+	switch (n.type) {
+	case NODE_ASSERT:
+		return n.value == ASSERT_BEGIN;
+	case NODE_CONCAT:
+		return !n.children.empty() && StartsAnchored(n.children[0]);
+	case NODE_ALT:
+		for (i = 0; i < n.children.size(); i++) {
+			if (!StartsAnchored(n.children[i]))
+				return false;
+		}
+		return true;
+	case NODE_REPEAT:
+		return (n.min > 0) && StartsAnchored(n.children[0]);
+	}
+
+	return false;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Matching Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Adds a thread to a list, following jumps, splits and assertions until it
+ * reaches instructions that consume characters. Instructions that are already
+ * in the list are skipped, since an earlier thread has priority over them.
+ *
+ * @param list     List of threads as pairs of instruction and match start.
+ * @param pulCount Pointer to the number of threads in the list.
+ * @param marks    Generation in which each instruction was last added.
+ * @param gen      Generation of the list.
+ * @param stack    Scratch stack with room for twice the program size.
+ * @param pc       Instruction of the thread.
+ * @param start    Start of the match of the thread.
+ * @param mbstr    Text being searched.
+ * @param ulLength Length of the text in bytes.
+ * @param ulPos    Position in the text of the thread.
+ */
+void Regex::AddThread(uint32_t *list, uint32_t *pulCount, uint32_t *marks,
+					  uint32_t gen, uint32_t *stack, uint32_t pc,
+					  uint32_t start, const char *mbstr, size_t ulLength,
+					  size_t ulPos) const {
+	uint32_t ulTop = 0;
+	bool bHolds;
+
+	stack[ulTop++] = pc;
+	while (ulTop > 0) {
+		pc = stack[--ulTop];
+		if (marks[pc] == gen)
+			continue;
+		marks[pc] = gen;
+
+		const Inst& inst = m_program[pc];
+		switch (inst.op) {
+		case OP_JMP:
+			// Going around a loop without consuming anything leaves it, just
+			// like backtracking engines stop repeating empty iterations.
+			if ((inst.x < pc) && (marks[inst.x] == gen)) {
+				stack[ulTop++] = pc + 1;
+			} else {
+				stack[ulTop++] = inst.x;
+			}
+			break;
+		case OP_SPLIT:
+			// First branch goes on top so that it's followed first.
+			stack[ulTop++] = inst.y;
+			stack[ulTop++] = inst.x;
+			break;
+		case OP_ASSERT:
+			switch (inst.x) {
+			case ASSERT_BEGIN:
+				bHolds = ulPos == 0;
+				break;
+			case ASSERT_END:
+				bHolds = ulPos == ulLength;
+				break;
+			default:
+				bHolds = (ulPos > 0) && IsWordByte(mbstr[ulPos - 1]);
+				bHolds = bHolds != ((ulPos < ulLength) &&
+					IsWordByte(mbstr[ulPos]));
+				if (inst.x == ASSERT_NOT_WORD)
+					bHolds = !bHolds;
+				break;
+			}
+
+			if (bHolds)
+				stack[ulTop++] = pc + 1;
+			break;
+		default:
+			list[*pulCount * 2] = pc;
+			list[(*pulCount * 2) + 1] = start;
+			(*pulCount)++;
+			break;
+		}
+	}
+}
+
+/**
+ * Checks if a character belongs to a class.
+ *
+ * @param index Index of the class.
+ * @param c     Code point of the character.
+ *
+ * @return TRUE if the character is matched by the class.
+ */
+bool Regex::InClass(uint32_t index, uint32_t c) const {
+	const Class& cls = m_classes[index];
+	uint32_t alt = c;
+	bool bIn = false;
+
+	// Try the other case of ASCII letters as well.
+	if (m_bIgnoreCase && (((c >= 'A') && (c <= 'Z')) ||
+			((c >= 'a') && (c <= 'z')))) {
+		alt = c ^ 0x20;
+	}
+
+	for (uint32_t i = 0; (i < cls.count) && !bIn; i++) {
+		const Range& range = m_ranges[cls.start + i];
+		bIn = ((c >= range.first) && (c <= range.last)) ||
+			((alt >= range.first) && (alt <= range.last));
+	}
+
+	return bIn != cls.bNegated;
+}
+
+/**
+ * Decodes a UTF-8 character. Invalid bytes are decoded one at a time as
+ * values beyond the last code point.
+ *
+ * @param mbstr    UTF-8 text.
+ * @param ulLength Length of the text in bytes.
+ * @param ulPos    Position of the character in the text.
+ * @param pChar    Pointer to receive the code point of the character.
+ *
+ * @return Length of the character in bytes.
+ */
+size_t Regex::DecodeChar(const char *mbstr, size_t ulLength, size_t ulPos,
+						 uint32_t *pChar) {
+	uint8_t uc = (uint8_t)mbstr[ulPos];
+	uint32_t c;
+	uint32_t min;
+	size_t ulSize;
+	size_t i;
+
+	// ASCII is the most common by far.
+	if (uc < 0x80) {
+		*pChar = uc;
+		return 1;
+	}
+
+	// Get the length of the sequence from its leading byte.
+	if ((uc & 0xE0) == 0xC0) {
+		ulSize = 2;
+		c = uc & 0x1F;
+		min = 0x80;
+	} else if ((uc & 0xF0) == 0xE0) {
+		ulSize = 3;
+		c = uc & 0x0F;
+		min = 0x800;
+	} else if ((uc & 0xF8) == 0xF0) {
+		ulSize = 4;
+		c = uc & 0x07;
+		min = 0x10000;
+	} else {
+		goto invalid;
+	}
+	if ((ulLength - ulPos) < ulSize)
+		goto invalid;
+
+	// Decode the continuation bytes.
+	for (i = 1; i < ulSize; i++) {
+		uint8_t cont = (uint8_t)mbstr[ulPos + i];
+		if ((cont & 0xC0) != 0x80)
+			goto invalid;
+		c = (c << 6) | (cont & 0x3F);
+	}
+
+	// Reject overlong encodings, surrogates and values out of range.
+	if ((c < min) || (c > 0x10FFFF) || ((c >= 0xD800) && (c <= 0xDFFF)))
+		goto invalid;
+
+	*pChar = c;
+	return ulSize;
+
+invalid:
+	*pChar = REGEX_INVALID_BASE + uc;
+	return 1;
+}
+
+/**
+ * Folds the case of an ASCII letter.
+ *
+ * @param c Code point of the character.
+ *
+ * @return Lower case version of the character.
+ */
+uint32_t Regex::FoldChar(uint32_t c) {
+	return ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : c;
+}
+
+/**
+ * Checks if a byte is part of a word for the \b and \B assertions.
+ *
+ * @param c Byte to be checked.
+ *
+ * @return TRUE if the byte is an ASCII letter, digit or underscore.
+ */
+bool Regex::IsWordByte(char c) {
+	return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+		((c >= '0') && (c <= '9')) || (c == '_');
+}
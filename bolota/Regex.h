@@ -0,0 +1,155 @@
+/**
+ * Regex.h
+ * Regular expressions matched in linear time over UTF-8 texts.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_REGEX_H
+#define _BOLOTA_REGEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+/**
+ * Maximum number of times a counted repetition may be repeated.
+ */
+#define BOLOTA_REGEX_REPEAT_MAX 1000
+
+/**
+ * Maximum number of instructions of a compiled pattern.
+ */
+#define BOLOTA_REGEX_PROGRAM_MAX 65536
+
+/**
+ * Maximum nesting of groups in a pattern.
+ */
+#define BOLOTA_REGEX_NESTING_MAX 128
+
+namespace Bolota {
+
+	/**
+	 * Regular expression compiled into a program that's run by simulating all
+	 * of its possible paths at once (a Pike VM), so matching takes linear time
+	 * on the length of the text regardless of the pattern.
+	 *
+	 * Supports literals, ., character classes ([a-z], [^...], \d, \w, \s and
+	 * their negations), groups, alternation, the *, +, ? and {m,n} quantifiers
+	 * (followed by ? to make them lazy) and the ^, $, \b and \B assertions.
+	 * Patterns and texts are UTF-8 and matched a code point at a time, while
+	 * case is only ignored for ASCII letters, just like the rest of the
+	 * library does. The anchors match at the start and end of the text, and
+	 * loops stop repeating once an iteration matches nothing.
+	 *
+	 * Patterns that always start with the same literal text only run the
+	 * program where that text is found, which is done using the vectorized
+	 * search of the Unicode shim.
+	 */
+	class Regex {
+	protected:
+		// Instruction of the program.
+		struct Inst {
+			uint8_t op;
+			uint32_t x;
+			uint32_t y;
+		};
+
+		// Range of code points of a character class.
+		struct Range {
+			uint32_t first;
+			uint32_t last;
+		};
+
+		// Character class.
+		struct Class {
+			uint32_t start;
+			uint32_t count;
+			bool bNegated;
+		};
+
+		// Node of the parsed pattern.
+		struct Node {
+			uint8_t type;
+			uint32_t value;
+			uint32_t min;
+			uint32_t max;
+			bool bGreedy;
+			std::vector<uint32_t> children;
+		};
+
+		// Program.
+		std::vector<Inst> m_program;
+		std::vector<Range> m_ranges;
+		std::vector<Class> m_classes;
+		std::string m_prefix;
+		bool m_bIgnoreCase;
+		bool m_bAnchored;
+
+		// Parsed pattern. Only used while compiling.
+		std::vector<Node> m_nodes;
+
+	public:
+		// Constructors and destructors.
+		Regex();
+		virtual ~Regex();
+
+		// Compiling.
+		bool Compile(const char *szPattern, bool bIgnoreCase);
+		bool IsCompiled() const;
+		const std::string& Prefix() const;
+
+		// Matching.
+		bool Search(const char *mbstr, size_t ulLength, size_t *pulStart,
+			size_t *pulEnd) const;
+		bool Search(const char *mbstr, size_t ulLength, size_t *pulStart,
+			size_t *pulEnd, std::vector<uint32_t>& vecScratch) const;
+
+	protected:
+		// Parsing.
+		uint32_t AddNode(uint8_t type, uint32_t value);
+		uint32_t ParseAlternation(const char **ppPattern, const char *pEnd,
+			unsigned int uDepth);
+		uint32_t ParseConcatenation(const char **ppPattern, const char *pEnd,
+			unsigned int uDepth);
+		uint32_t ParseRepetition(const char **ppPattern, const char *pEnd,
+			unsigned int uDepth);
+		uint32_t ParseAtom(const char **ppPattern, const char *pEnd,
+			unsigned int uDepth);
+		uint32_t ParseClass(const char **ppPattern, const char *pEnd);
+		bool ParseCount(const char **ppPattern, const char *pEnd,
+			uint32_t *pMin, uint32_t *pMax);
+		bool ParseClassChar(const char **ppPattern, const char *pEnd,
+			uint32_t *pChar, int *pShorthand);
+		void AddShorthand(int shorthand);
+
+		// Code generation.
+		bool Emit(uint32_t node);
+		uint32_t EmitInst(uint8_t op, uint32_t x, uint32_t y);
+		bool CollectPrefix(uint32_t node);
+		bool StartsAnchored(uint32_t node) const;
+
+		// Matching helpers.
+		void AddThread(uint32_t *list, uint32_t *pulCount, uint32_t *marks,
+			uint32_t gen, uint32_t *stack, uint32_t pc, uint32_t start,
+			const char *mbstr, size_t ulLength, size_t ulPos) const;
+		bool InClass(uint32_t index, uint32_t c) const;
+		static size_t DecodeChar(const char *mbstr, size_t ulLength,
+			size_t ulPos, uint32_t *pChar);
+		static uint32_t FoldChar(uint32_t c);
+		static bool IsWordByte(char c);
+	};
+
+}
+
+#endif // _BOLOTA_REGEX_H
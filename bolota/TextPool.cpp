@@ -0,0 +1,380 @@
+/**
+ * TextPool.cpp
+ * Interning pool that allows identical field texts to share a single buffer.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "TextPool.h"
+
+#include <string.h>
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty text pool.
+ */
+TextPool::TextPool() {
+	Entry entry = { 0, false, NULL };
+	m_table.assign(BOLOTA_TEXTPOOL_SLOTS, entry);
+	m_count = 0;
+	m_bBatch = false;
+	m_ulHits = 0;
+	m_ulSaved = 0;
+}
+
+/**
+ * Frees up the canonical copies of the texts. Strings that were interned keep
+ * their contents, since the buffers are reference counted.
+ */
+TextPool::~TextPool() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Interning                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Makes a string share its buffer with an identical text in the pool. Inside a
+ * batch the text will be remembered in case it shows up again.
+ *
+ * @param str String to be interned.
+ */
+void TextPool::Intern(UString *str) {
+	// Short strings are stored inline and can't be shared.
+	size_t ulLength = str->Length();
+	if (ulLength < USTRING_INLINE_LEN)
+		return;
+
+	// Look the text up in the table.
+	const char *mbstr = str->GetMultiByteString();
+	uint32_t hash = Hash(mbstr, ulLength);
+	size_t slot = Lookup(hash, mbstr, ulLength);
+	if (m_table[slot].str == NULL) {
+		if (m_bBatch)
+			Insert(hash, str, false);
+		return;
+	}
+
+	// Share the buffer if we aren't already using it.
+	if (m_table[slot].str->GetMultiByteString() != mbstr)
+		Share(slot, str);
+}
+
+/**
+ * Sets the contents of a string to a text, sharing the buffer of an identical
+ * text in the pool whenever possible. This avoids allocating memory at all for
+ * texts that are already in the pool.
+ *
+ * @param str      String to receive the text.
+ * @param mbstr    Multi-byte text to be stored. (doesn't have to be NUL
+ *                 terminated)
+ * @param ulLength Length of the text in bytes.
+ */
+void TextPool::Intern(UString *str, const char *mbstr, size_t ulLength) {
+	// Short strings are stored inline and can't be shared.
+	if (ulLength < USTRING_INLINE_LEN) {
+		memcpy(str->PrepareMultiByteString(ulLength), mbstr, ulLength);
+		return;
+	}
+
+	// Share the buffer if the text is already in the pool.
+	uint32_t hash = Hash(mbstr, ulLength);
+	size_t slot = Lookup(hash, mbstr, ulLength);
+	if (m_table[slot].str != NULL) {
+		Share(slot, str);
+		return;
+	}
+
+	// Store a new text and remember it in case it shows up again.
+	memcpy(str->PrepareMultiByteString(ulLength), mbstr, ulLength);
+	if (m_bBatch)
+		Insert(hash, str, false);
+}
+
+/**
+ * Gets a reusable buffer for reading texts that are about to be interned, so
+ * that duplicates never have to allocate memory of their own.
+ *
+ * @warning The buffer is only valid until the next call to this method.
+ *
+ * @param ulLength Length of the text in bytes. (without the NUL terminator)
+ *
+ * @return NUL terminated buffer large enough to hold the text.
+ */
+char* TextPool::ScratchBuffer(size_t ulLength) {
+	if (m_scratch.size() < (ulLength + 1))
+		m_scratch.resize(ulLength + 1);
+	m_scratch[ulLength] = '\0';
+
+	return &m_scratch[0];
+}
+
+/**
+ * Starts a batch of interning operations. While inside a batch the pool will
+ * remember every text interned, so that repeated ones can be found.
+ *
+ * @warning Strings interned during a batch must not be modified or destroyed
+ *          until the batch is over.
+ */
+void TextPool::BeginBatch() {
+	m_bBatch = true;
+}
+
+/**
+ * Ends a batch of interning operations, forgetting about the texts that were
+ * only seen once.
+ */
+void TextPool::EndBatch() {
+	m_bBatch = false;
+	Rebuild(false);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                              Housekeeping                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Removes the texts that are no longer shared with any other string from the
+ * pool, freeing up their memory.
+ *
+ * @return Number of texts removed from the pool.
+ */
+size_t TextPool::Purge() {
+	size_t ulCount = m_count;
+	Rebuild(true);
+
+	return ulCount - m_count;
+}
+
+/**
+ * Removes every text from the pool and resets its statistics.
+ */
+void TextPool::Clear() {
+	for (size_t i = 0; i < m_table.size(); i++) {
+		if (m_table[i].bOwned)
+			delete m_table[i].str;
+		m_table[i].str = NULL;
+		m_table[i].bOwned = false;
+	}
+
+	m_count = 0;
+	m_ulHits = 0;
+	m_ulSaved = 0;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Statistics                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of texts in the pool, including the ones that are only
+ * being remembered for the current batch.
+ *
+ * @return Number of texts in the pool.
+ */
+size_t TextPool::Count() const {
+	return m_count;
+}
+
+/**
+ * Gets the number of times a string was made to share a buffer from the pool.
+ *
+ * @return Number of deduplicated texts.
+ */
+size_t TextPool::Hits() const {
+	return m_ulHits;
+}
+
+/**
+ * Gets the amount of memory that was saved by sharing buffers instead of
+ * allocating new ones.
+ *
+ * @warning This is a running total, strings that were later edited and
+ *          detached from the pool are still accounted for.
+ *
+ * @return Number of bytes that didn't have to be allocated.
+ */
+size_t TextPool::BytesSaved() const {
+	return m_ulSaved;
+}
+
+/**
+ * Gets the number of bytes allocated by the pool itself. Buffers of canonical
+ * copies are only included once no other string is sharing them.
+ *
+ * @return Size of the pool's hash table, scratch buffer and canonical copies.
+ */
+size_t TextPool::HeapSize() const {
+	size_t ulSize = (m_table.capacity() * sizeof(Entry)) + m_scratch.capacity();
+
+	for (size_t i = 0; i < m_table.size(); i++) {
+		const Entry& entry = m_table[i];
+		if ((entry.str == NULL) || !entry.bOwned)
+			continue;
+
+		ulSize += sizeof(UString);
+		if (!entry.str->IsShared())
+			ulSize += entry.str->HeapSize();
+	}
+
+	return ulSize;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                           Hash Table Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Calculates the FNV-1a hash of a text.
+ *
+ * @param mbstr    Text to be hashed.
+ * @param ulLength Length of the text in bytes.
+ *
+ * @return Hash of the text.
+ */
+uint32_t TextPool::Hash(const char *mbstr, size_t ulLength) {
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < ulLength; i++) {
+		hash ^= (uint8_t)mbstr[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/**
+ * Finds the slot of a text in the hash table.
+ *
+ * @param hash     Hash of the text.
+ * @param mbstr    Text to be looked up.
+ * @param ulLength Length of the text in bytes.
+ *
+ * @return Slot that holds the text or the empty slot where it should be
+ *         inserted.
+ */
+size_t TextPool::Lookup(uint32_t hash, const char *mbstr, size_t ulLength) {
+	size_t mask = m_table.size() - 1;
+	size_t slot = hash & mask;
+
+	while (m_table[slot].str != NULL) {
+		Entry& entry = m_table[slot];
+		if ((entry.hash == hash) && (entry.str->Length() == ulLength) &&
+				(memcmp(entry.str->GetMultiByteString(), mbstr,
+					ulLength) == 0)) {
+			return slot;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+ * Inserts a text into the hash table.
+ *
+ * @param hash   Hash of the text.
+ * @param str    String holding the text.
+ * @param bOwned Is this a canonical copy owned by the pool or a string that's
+ *               only being remembered for the current batch?
+ */
+void TextPool::Insert(uint32_t hash, UString *str, bool bOwned) {
+	// Keep the load factor under 50%.
+	if ((m_count + 1) * 2 > m_table.size())
+		Rebuild(false);
+
+	size_t mask = m_table.size() - 1;
+	size_t slot = hash & mask;
+	while (m_table[slot].str != NULL)
+		slot = (slot + 1) & mask;
+
+	m_table[slot].hash = hash;
+	m_table[slot].bOwned = bOwned;
+	m_table[slot].str = str;
+	m_count++;
+}
+
+/**
+ * Makes a string share the buffer of a text in the pool. Texts that were only
+ * being remembered for the current batch get a canonical copy of their own
+ * now that we know they are repeated.
+ *
+ * @param slot Slot of the text in the hash table.
+ * @param str  String to share the buffer of the text.
+ */
+void TextPool::Share(size_t slot, UString *str) {
+	Entry& entry = m_table[slot];
+	if (!entry.bOwned) {
+		entry.str = new UString(*entry.str);
+		entry.bOwned = true;
+	}
+
+	*str = *entry.str;
+	m_ulHits++;
+	m_ulSaved += entry.str->Length() + 1;
+}
+
+/**
+ * Rebuilds the hash table, sizing it to the number of texts that are kept.
+ * Texts that are only being remembered are dropped outside of a batch.
+ *
+ * @param bPurge Should texts that aren't shared anymore be freed?
+ */
+void TextPool::Rebuild(bool bPurge) {
+	std::vector<Entry> vecKeep;
+
+	// Gather the texts that should be kept.
+	for (size_t i = 0; i < m_table.size(); i++) {
+		Entry& entry = m_table[i];
+		if (entry.str == NULL)
+			continue;
+
+		if (!entry.bOwned) {
+			if (m_bBatch)
+				vecKeep.push_back(entry);
+		} else if (bPurge && !entry.str->IsShared()) {
+			delete entry.str;
+		} else {
+			vecKeep.push_back(entry);
+		}
+	}
+
+	// Size the table to keep the load factor under 50% after an insertion.
+	size_t ulSlots = BOLOTA_TEXTPOOL_SLOTS;
+	while ((vecKeep.size() + 1) * 2 > ulSlots)
+		ulSlots *= 2;
+
+	// Reinsert the texts.
+	Entry empty = { 0, false, NULL };
+	std::vector<Entry>(ulSlots, empty).swap(m_table);
+	m_count = 0;
+	for (size_t i = 0; i < vecKeep.size(); i++)
+		Insert(vecKeep[i].hash, vecKeep[i].str, vecKeep[i].bOwned);
+}
@@ -0,0 +1,105 @@
+/**
+ * TextPool.h
+ * Interning pool that allows identical field texts to share a single buffer.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_TEXTPOOL_H
+#define _BOLOTA_TEXTPOOL_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "UString.h"
+
+/**
+ * Initial number of slots in the interning hash table. (must be a power of 2)
+ */
+#define BOLOTA_TEXTPOOL_SLOTS 256
+
+namespace Bolota {
+
+	/**
+	 * Interning pool that allows identical field texts to share a single
+	 * buffer. The pool keeps a canonical copy of the texts it has seen and
+	 * makes interned strings share its buffer. Since shared buffers are never
+	 * modified in place, editing an interned string simply detaches it from
+	 * the pool (copy-on-write).
+	 *
+	 * Only texts that have been seen at least twice are kept in the pool, since
+	 * keeping a canonical copy of a unique text would cost more memory than it
+	 * could ever save. Repeated texts are found by interning strings inside a
+	 * batch (such as while loading a document), where the pool is allowed to
+	 * remember unique texts until the batch is over. Texts short enough to be
+	 * stored inline by UString are never interned.
+	 */
+	class TextPool {
+	protected:
+		// Slot of the open addressing hash table.
+		struct Entry {
+			uint32_t hash;
+			bool bOwned;
+			UString *str;
+		};
+
+		// Hash table.
+		std::vector<Entry> m_table;
+		size_t m_count;
+		bool m_bBatch;
+
+		// Reusable buffer for texts read from files.
+		std::vector<char> m_scratch;
+
+		// Statistics.
+		size_t m_ulHits;
+		size_t m_ulSaved;
+
+	public:
+		// Constructors and destructors.
+		TextPool();
+		virtual ~TextPool();
+
+		// Interning.
+		void Intern(UString *str);
+		void Intern(UString *str, const char *mbstr, size_t ulLength);
+		char* ScratchBuffer(size_t ulLength);
+		void BeginBatch();
+		void EndBatch();
+
+		// Housekeeping.
+		size_t Purge();
+		void Clear();
+
+		// Statistics.
+		size_t Count() const;
+		size_t Hits() const;
+		size_t BytesSaved() const;
+		size_t HeapSize() const;
+
+	protected:
+		// Hash table helpers.
+		static uint32_t Hash(const char *mbstr, size_t ulLength);
+		size_t Lookup(uint32_t hash, const char *mbstr, size_t ulLength);
+		void Insert(uint32_t hash, UString *str, bool bOwned);
+		void Share(size_t slot, UString *str);
+		void Rebuild(bool bPurge);
+	};
+
+}
+
+#endif // __cplusplus
+
+#endif // _BOLOTA_TEXTPOOL_H
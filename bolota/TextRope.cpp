@@ -0,0 +1,430 @@
+/**
+ * TextRope.cpp
+ * Rope used to hold very long strings that are edited in place.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "TextRope.h"
+
+#include <string.h>
+
+/**
+ * Initializes an empty rope.
+ */
+TextRope::TextRope() {
+	m_root = NULL;
+	m_seed = 2463534242U;
+}
+
+/**
+ * Initializes a rope with the contents of a string.
+ *
+ * @param mbstr    UTF-8 encoded multi-byte string.
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ */
+TextRope::TextRope(const char *mbstr, size_t ulLength) {
+	m_root = NULL;
+	m_seed = 2463534242U;
+	m_root = Build(mbstr, ulLength);
+}
+
+/**
+ * Frees up every chunk of the rope.
+ */
+TextRope::~TextRope() {
+	FreeNodes(m_root);
+	m_root = NULL;
+}
+
+/**
+ * Inserts a string at a position of the rope.
+ *
+ * @warning The string to be inserted must not be a piece of this rope.
+ *
+ * @param ulPos    Position in bytes where the string should be inserted.
+ *                 Clamped to the length of the rope.
+ * @param mbstr    String to be inserted. (doesn't have to be NUL terminated)
+ * @param ulLength Length of the string in bytes.
+ */
+void TextRope::Insert(size_t ulPos, const char *mbstr, size_t ulLength) {
+	Node *left;
+	Node *right;
+
+	// Check if there's anything to do.
+	if (ulLength == 0)
+		return;
+	if (ulPos > Length())
+		ulPos = Length();
+
+	// Small insertions usually fit in the chunk they land on.
+	if (InsertInPlace(m_root, ulPos, mbstr, ulLength))
+		return;
+
+	// Split the rope and put the new chunks in between.
+	Split(m_root, ulPos, &left, &right);
+	m_root = Merge(Merge(left, Build(mbstr, ulLength)), right);
+}
+
+/**
+ * Erases a range of the rope.
+ *
+ * @param ulPos    Position in bytes of the start of the range.
+ * @param ulLength Length of the range in bytes. Clamped to the end of the rope.
+ */
+void TextRope::Erase(size_t ulPos, size_t ulLength) {
+	Node *left;
+	Node *middle;
+	Node *right;
+
+	// Check if there's anything to do.
+	if (ulPos >= Length())
+		return;
+	if (ulLength > (Length() - ulPos))
+		ulLength = Length() - ulPos;
+	if (ulLength == 0)
+		return;
+
+	// Small deletions usually happen inside a single chunk.
+	if (EraseInPlace(m_root, ulPos, ulLength))
+		return;
+
+	// Cut the range out of the rope.
+	Split(m_root, ulPos, &left, &right);
+	Split(right, ulLength, &middle, &right);
+	FreeNodes(middle);
+	m_root = Merge(left, right);
+}
+
+/**
+ * Gets the length of the text in the rope.
+ *
+ * @return Length of the text in bytes.
+ */
+size_t TextRope::Length() const {
+	return Total(m_root);
+}
+
+/**
+ * Gets the contiguous piece of the rope that contains a position. This allows
+ * the text to be streamed without ever having to flatten it.
+ *
+ * @param ulPos    Position in bytes inside the rope.
+ * @param ulLength Pointer to store the number of contiguous bytes available
+ *                 starting at the position.
+ *
+ * @return Pointer to the text at the position or NULL if the position is past
+ *         the end of the rope.
+ */
+const char *TextRope::Piece(size_t ulPos, size_t *ulLength) const {
+	const Node *node = m_root;
+
+	while (node != NULL) {
+		size_t ulLeft = Total(node->left);
+
+		if (ulPos < ulLeft) {
+			node = node->left;
+		} else if (ulPos < (ulLeft + node->len)) {
+			*ulLength = node->len - (ulPos - ulLeft);
+			return node->data + (ulPos - ulLeft);
+		} else {
+			ulPos -= ulLeft + node->len;
+			node = node->right;
+		}
+	}
+
+	*ulLength = 0;
+	return NULL;
+}
+
+/**
+ * Copies the entire text of the rope into a buffer.
+ *
+ * @warning The buffer must be at least Length() bytes long. No NUL terminator
+ *          is written.
+ *
+ * @param buf Buffer to receive the text.
+ */
+void TextRope::CopyTo(char *buf) const {
+	CopyNodes(m_root, buf);
+}
+
+/**
+ * Gets the number of bytes allocated for the chunks of the rope.
+ *
+ * @return Size of every chunk of the rope in bytes.
+ */
+size_t TextRope::HeapSize() const {
+	return CountNodes(m_root) * sizeof(Node);
+}
+
+/**
+ * Allocates a new chunk with a random priority.
+ *
+ * @param mbstr    Text of the chunk.
+ * @param ulLength Length of the text, up to TEXTROPE_CHUNK bytes.
+ *
+ * @return Newly allocated chunk.
+ */
+TextRope::Node *TextRope::NewNode(const char *mbstr, size_t ulLength) {
+	Node *node = new Node;
+
+	// Advance our xorshift generator.
+	m_seed ^= m_seed << 13;
+	m_seed ^= m_seed >> 17;
+	m_seed ^= m_seed << 5;
+
+	node->left = NULL;
+	node->right = NULL;
+	node->priority = m_seed;
+	node->len = ulLength;
+	node->total = ulLength;
+	memcpy(node->data, mbstr, ulLength);
+
+	return node;
+}
+
+/**
+ * Frees a node and all of its descendants.
+ *
+ * @param node Root of the subtree to be free'd.
+ */
+void TextRope::FreeNodes(Node *node) {
+	if (node == NULL)
+		return;
+
+	FreeNodes(node->left);
+	FreeNodes(node->right);
+	delete node;
+}
+
+/**
+ * Gets the number of bytes in a subtree.
+ *
+ * @param node Root of the subtree. Can be NULL.
+ *
+ * @return Number of bytes in the subtree.
+ */
+size_t TextRope::Total(const Node *node) {
+	return (node) ? node->total : 0;
+}
+
+/**
+ * Recalculates the number of bytes in a subtree after its children changed.
+ *
+ * @param node Root of the subtree.
+ */
+void TextRope::Update(Node *node) {
+	node->total = Total(node->left) + node->len + Total(node->right);
+}
+
+/**
+ * Concatenates two subtrees.
+ *
+ * @param left  Subtree with the beginning of the text.
+ * @param right Subtree with the end of the text.
+ *
+ * @return Root of the concatenated tree.
+ */
+TextRope::Node *TextRope::Merge(Node *left, Node *right) {
+	if (left == NULL)
+		return right;
+	if (right == NULL)
+		return left;
+
+	if (left->priority > right->priority) {
+		left->right = Merge(left->right, right);
+		Update(left);
+		return left;
+	}
+
+	right->left = Merge(left, right->left);
+	Update(right);
+	return right;
+}
+
+/**
+ * Splits a subtree in two at a position, cutting a chunk in half if needed.
+ *
+ * @param node  Root of the subtree to be split.
+ * @param ulPos Number of bytes that should end up in the left subtree.
+ * @param left  Pointer to store the subtree with the beginning of the text.
+ * @param right Pointer to store the subtree with the end of the text.
+ */
+void TextRope::Split(Node *node, size_t ulPos, Node **left, Node **right) {
+	size_t ulLeft;
+
+	// Nothing to split.
+	if (node == NULL) {
+		*left = NULL;
+		*right = NULL;
+		return;
+	}
+
+	ulLeft = Total(node->left);
+	if (ulPos <= ulLeft) {
+		// Position is in the left subtree.
+		Split(node->left, ulPos, left, &node->left);
+		Update(node);
+		*right = node;
+	} else if (ulPos >= (ulLeft + node->len)) {
+		// Position is in the right subtree.
+		Split(node->right, ulPos - ulLeft - node->len, &node->right, right);
+		Update(node);
+		*left = node;
+	} else {
+		// Position is inside this chunk, so it must be cut in two.
+		size_t ulOffset = ulPos - ulLeft;
+		Node *tail = NewNode(node->data + ulOffset, node->len - ulOffset);
+		Node *rest = node->right;
+
+		node->len = ulOffset;
+		node->right = NULL;
+		Update(node);
+		*left = node;
+		*right = Merge(tail, rest);
+	}
+}
+
+/**
+ * Builds a subtree with the contents of a string.
+ *
+ * @param mbstr    Text to be stored.
+ * @param ulLength Length of the text in bytes.
+ *
+ * @return Root of the newly built subtree.
+ */
+TextRope::Node *TextRope::Build(const char *mbstr, size_t ulLength) {
+	Node *root = NULL;
+
+	while (ulLength > 0) {
+		size_t ulChunk = (ulLength > TEXTROPE_CHUNK) ? TEXTROPE_CHUNK :
+			ulLength;
+
+		root = Merge(root, NewNode(mbstr, ulChunk));
+		mbstr += ulChunk;
+		ulLength -= ulChunk;
+	}
+
+	return root;
+}
+
+/**
+ * Tries to insert a string into the chunk the position lands on without
+ * changing the shape of the tree.
+ *
+ * @param node     Root of the subtree.
+ * @param ulPos    Position relative to the subtree.
+ * @param mbstr    String to be inserted.
+ * @param ulLength Length of the string in bytes.
+ *
+ * @return TRUE if the string fit in the chunk, FALSE otherwise.
+ */
+bool TextRope::InsertInPlace(Node *node, size_t ulPos, const char *mbstr,
+							 size_t ulLength) {
+	size_t ulLeft;
+	bool bInserted;
+
+	if (node == NULL)
+		return false;
+
+	ulLeft = Total(node->left);
+	if (ulPos < ulLeft) {
+		bInserted = InsertInPlace(node->left, ulPos, mbstr, ulLength);
+	} else if (ulPos <= (ulLeft + node->len)) {
+		size_t ulOffset = ulPos - ulLeft;
+
+		// Check if the string fits in this chunk.
+		if ((node->len + ulLength) > TEXTROPE_CHUNK)
+			return false;
+
+		memmove(node->data + ulOffset + ulLength, node->data + ulOffset,
+			node->len - ulOffset);
+		memcpy(node->data + ulOffset, mbstr, ulLength);
+		node->len += ulLength;
+		bInserted = true;
+	} else {
+		bInserted = InsertInPlace(node->right, ulPos - ulLeft - node->len,
+			mbstr, ulLength);
+	}
+
+	if (bInserted)
+		node->total += ulLength;
+
+	return bInserted;
+}
+
+/**
+ * Tries to erase a range that lies entirely inside a single chunk without
+ * changing the shape of the tree.
+ *
+ * @param node     Root of the subtree.
+ * @param ulPos    Position relative to the subtree.
+ * @param ulLength Length of the range in bytes.
+ *
+ * @return TRUE if the range was erased, FALSE if it spans multiple chunks.
+ */
+bool TextRope::EraseInPlace(Node *node, size_t ulPos, size_t ulLength) {
+	size_t ulLeft;
+	bool bErased;
+
+	if (node == NULL)
+		return false;
+
+	ulLeft = Total(node->left);
+	if (ulPos < ulLeft) {
+		bErased = EraseInPlace(node->left, ulPos, ulLength);
+	} else if (ulPos < (ulLeft + node->len)) {
+		size_t ulOffset = ulPos - ulLeft;
+
+		// Check if the range ends inside this chunk.
+		if ((ulOffset + ulLength) > node->len)
+			return false;
+
+		memmove(node->data + ulOffset, node->data + ulOffset + ulLength,
+			node->len - ulOffset - ulLength);
+		node->len -= ulLength;
+		bErased = true;
+	} else {
+		bErased = EraseInPlace(node->right, ulPos - ulLeft - node->len,
+			ulLength);
+	}
+
+	if (bErased)
+		node->total -= ulLength;
+
+	return bErased;
+}
+
+/**
+ * Copies the text of a subtree into a buffer.
+ *
+ * @param node Root of the subtree.
+ * @param buf  Buffer to receive the text.
+ *
+ * @return Pointer to the end of the copied text in the buffer.
+ */
+char *TextRope::CopyNodes(const Node *node, char *buf) {
+	if (node == NULL)
+		return buf;
+
+	buf = CopyNodes(node->left, buf);
+	memcpy(buf, node->data, node->len);
+	buf = CopyNodes(node->right, buf + node->len);
+
+	return buf;
+}
+
+/**
+ * Counts the chunks in a subtree.
+ *
+ * @param node Root of the subtree.
+ *
+ * @return Number of chunks in the subtree.
+ */
+size_t TextRope::CountNodes(const Node *node) {
+	if (node == NULL)
+		return 0;
+
+	return 1 + CountNodes(node->left) + CountNodes(node->right);
+}
@@ -0,0 +1,86 @@
+/**
+ * TextRope.h
+ * Rope used to hold very long strings that are edited in place.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _INNOVE_TEXTROPE_H
+#define _INNOVE_TEXTROPE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+/**
+ * Maximum number of bytes stored in a single piece of the rope.
+ */
+#define TEXTROPE_CHUNK 512
+
+/**
+ * Rope used to hold very long strings that are edited in place. The text is
+ * split into small chunks kept in a randomized balanced tree ordered by their
+ * position in the string, so insertions and deletions take O(log n) instead
+ * of having to copy the entire string.
+ */
+class TextRope {
+protected:
+	// Chunk of the text and node of the tree.
+	struct Node {
+		Node *left;
+		Node *right;
+		uint32_t priority;
+		size_t total;
+		size_t len;
+		char data[TEXTROPE_CHUNK];
+	};
+
+	Node *m_root;
+	uint32_t m_seed;
+
+public:
+	// Constructors and destructors.
+	TextRope();
+	TextRope(const char *mbstr, size_t ulLength);
+	virtual ~TextRope();
+
+	// Editing.
+	void Insert(size_t ulPos, const char *mbstr, size_t ulLength);
+	void Erase(size_t ulPos, size_t ulLength);
+
+	// Access to the contents.
+	size_t Length() const;
+	const char *Piece(size_t ulPos, size_t *ulLength) const;
+	void CopyTo(char *buf) const;
+
+	// Memory usage.
+	size_t HeapSize() const;
+
+protected:
+	// Node management.
+	Node *NewNode(const char *mbstr, size_t ulLength);
+	static void FreeNodes(Node *node);
+	static size_t Total(const Node *node);
+	static void Update(Node *node);
+
+	// Tree operations.
+	static Node *Merge(Node *left, Node *right);
+	void Split(Node *node, size_t ulPos, Node **left, Node **right);
+	Node *Build(const char *mbstr, size_t ulLength);
+	static bool InsertInPlace(Node *node, size_t ulPos, const char *mbstr,
+		size_t ulLength);
+	static bool EraseInPlace(Node *node, size_t ulPos, size_t ulLength);
+	static char *CopyNodes(const Node *node, char *buf);
+	static size_t CountNodes(const Node *node);
+};
+
+#endif // _INNOVE_TEXTROPE_H
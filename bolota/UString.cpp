@@ -14,9 +14,79 @@
 		#include <wce_string.h>
 	#endif // UNDER_CE && !WIN32_PLATFORM_PSPC && !WIN32_PLATFORM_WFSP
 #endif // _WIN32
+#include <list>
+#include <map>
 
 #include "../../shims/cvtutf/Unicode.h"
 #include "Errors/Error.h"
+#include "Utilities/Threads.h"
+
+/**
+ * An entry in the wide string transcoding cache.
+ */
+struct WideCacheEntry {
+	const UString *owner;
+	thread_id_t thread;
+	wchar_t *wstr;
+	size_t ulBytes;
+};
+
+/**
+ * Wide string transcoding cache shared by every string object. Entries are kept
+ * in most recently used order and are only ever evicted by the thread that made
+ * the conversion, with everything in here being guarded by the mutex.
+ */
+struct WideCache {
+	thread_mutex_t mutex;
+	std::list<WideCacheEntry> lstEntries;
+	std::map<const UString*, std::list<WideCacheEntry>::iterator> mapOwners;
+	size_t ulBytes;
+	size_t ulMaxEntries;
+	size_t ulMaxBytes;
+};
+
+/**
+ * Global transcoding cache. Allocated on first use and never destroyed, so that
+ * static string objects can safely be destructed in any order.
+ */
+static WideCache *s_wcache = NULL;
+
+/**
+ * Gets the global transcoding cache, creating it if needed.
+ *
+ * @return Global transcoding cache.
+ */
+static WideCache *GetWideCache() {
+	if (s_wcache == NULL) {
+		s_wcache = new WideCache();
+		Threads::InitMutex(&s_wcache->mutex);
+		s_wcache->ulBytes = 0;
+		s_wcache->ulMaxEntries = USTRING_WCACHE_ENTRIES;
+		s_wcache->ulMaxBytes = USTRING_WCACHE_BYTES;
+	}
+
+	return s_wcache;
+}
+
+/**
+ * Creates the cache during static initialization, while there's still a single
+ * thread around, so that it never has to be created lazily by racing threads.
+ */
+static bool s_bWideCacheReady = GetWideCache() != NULL;
+
+/**
+ * Removes an entry from the transcoding cache. The cache must be locked.
+ *
+ * @param cache Transcoding cache.
+ * @param it    Entry to be removed.
+ */
+static void EraseWideEntry(WideCache *cache,
+						   std::list<WideCacheEntry>::iterator it) {
+	cache->ulBytes -= it->ulBytes;
+	free(it->wstr);
+	cache->mapOwners.erase(it->owner);
+	cache->lstEntries.erase(it);
+}
 
 /**
  * Initializes an empty universal Unicode string.
@@ -33,7 +103,7 @@ UString::UString() {
  */
 UString::UString(const char *mbstr) {
 	Initialize();
-	SetString(_strdup(mbstr));
+	CopyString(mbstr);
 }
 
 /**
@@ -43,24 +113,39 @@ UString::UString(const char *mbstr) {
  */
 UString::UString(const wchar_t *wstr) {
 	Initialize();
-	SetString(_wcsdup(wstr));
+	CopyString(wstr);
+}
+
+/**
+ * Initializes a universal Unicode string as a copy of another one.
+ *
+ * @param other String to be copied.
+ */
+UString::UString(const UString& other) {
+	Initialize();
+	ShareString(other);
 }
 
+#ifdef USTRING_HAS_MOVE
+/**
+ * Initializes a universal Unicode string by stealing the contents of another
+ * one, which will be left empty.
+ *
+ * @param other String to have its contents moved into the new object.
+ */
+UString::UString(UString&& other) {
+	Initialize();
+	Swap(other);
+}
+#endif // USTRING_HAS_MOVE
+
 /**
  * Cleans up any memory dynamically allocated by us.
  */
 UString::~UString() {
 	m_length = 0;
-
-	if (m_mbstr) {
-		free(m_mbstr);
-		m_mbstr = NULL;
-	}
-
-	if (m_wstr) {
-		free(m_wstr);
-		m_wstr = NULL;
-	}
+	ReleaseMultiByteString();
+	InvalidateWideString();
 }
 
 /**
@@ -68,8 +153,10 @@ UString::~UString() {
  */
 void UString::Initialize() {
 	m_mbstr = NULL;
-	m_wstr = NULL;
 	m_length = 0;
+	m_bWideCached = false;
+	m_shared = NULL;
+	m_rope = NULL;
 }
 
 /**
@@ -82,6 +169,23 @@ void UString::TakeOwnership(char *mbstr) {
 	SetString(mbstr);
 }
 
+/**
+ * Takes ownership of an UTF-8 encoded multi-byte C string whose length is
+ * already known, avoiding having to measure it again.
+ *
+ * @param mbstr    String to take ownership of. This pointer will now be handled
+ *                 by this object, do not free or modify it outside of the
+ *                 object.
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ */
+void UString::TakeOwnership(char *mbstr, size_t ulLength) {
+	ReleaseMultiByteString();
+	InvalidateWideString();
+
+	m_mbstr = mbstr;
+	m_length = (mbstr) ? ulLength : 0;
+}
+
 /**
  * Takes ownership of an UTF-16 encoded wide string.
  *
@@ -92,6 +196,218 @@ void UString::TakeOwnership(wchar_t *wstr) {
 	SetString(wstr);
 }
 
+/**
+ * Swaps the contents of two strings without copying any dynamically allocated
+ * buffers.
+ *
+ * @param other String to swap contents with.
+ */
+void UString::Swap(UString& other) {
+	char szInline[USTRING_INLINE_LEN];
+	bool bInline = IsInline(m_mbstr);
+	bool bOtherInline = other.IsInline(other.m_mbstr);
+	char *mbstr = m_mbstr;
+	size_t ulLength = m_length;
+	UStringShared *shared = m_shared;
+	TextRope *rope = m_rope;
+
+	// Cached conversions are tied to their objects.
+	InvalidateWideString();
+	other.InvalidateWideString();
+
+	// Swap the inline buffers.
+	memcpy(szInline, m_mbbuf, USTRING_INLINE_LEN);
+	memcpy(m_mbbuf, other.m_mbbuf, USTRING_INLINE_LEN);
+	memcpy(other.m_mbbuf, szInline, USTRING_INLINE_LEN);
+
+	// Swap the string pointers taking care of the inline buffers.
+	m_mbstr = (bOtherInline) ? m_mbbuf : other.m_mbstr;
+	other.m_mbstr = (bInline) ? other.m_mbbuf : mbstr;
+	m_length = other.m_length;
+	other.m_length = ulLength;
+	m_shared = other.m_shared;
+	other.m_shared = shared;
+	m_rope = other.m_rope;
+	other.m_rope = rope;
+}
+
+/**
+ * Prepares an internal UTF-8 buffer to be filled directly by the caller,
+ * avoiding an intermediate allocation and copy. Short strings are kept inside
+ * the object itself.
+ *
+ * @warning The caller must write exactly ulLength bytes into the buffer. The
+ *          NUL terminator is already taken care of.
+ *
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ *
+ * @return Buffer to be filled with the string or BOLOTA_ERR_NULL if we failed
+ *         to allocate it.
+ */
+char *UString::PrepareMultiByteString(size_t ulLength) {
+	ReleaseMultiByteString();
+	InvalidateWideString();
+	m_length = 0;
+
+	// Get a buffer large enough for the string.
+	if (ulLength < USTRING_INLINE_LEN) {
+		m_mbstr = m_mbbuf;
+	} else {
+		m_mbstr = (char *)malloc((ulLength + 1) * sizeof(char));
+		if (m_mbstr == NULL) {
+			ThrowError(EMSG("Failed to allocate memory for string"));
+			return BOLOTA_ERR_NULL;
+		}
+	}
+
+	m_mbstr[ulLength] = '\0';
+	m_length = ulLength;
+
+	return m_mbstr;
+}
+
+/**
+ * Inserts a string at a position. Long strings are moved into a rope, so that
+ * further edits don't have to copy the entire string.
+ *
+ * @param ulPos Position in bytes where the string should be inserted. Clamped
+ *              to the length of the string.
+ * @param mbstr UTF-8 encoded multi-byte string to be inserted.
+ */
+void UString::Insert(size_t ulPos, const char *mbstr) {
+	if (mbstr != NULL)
+		Insert(ulPos, mbstr, strlen(mbstr));
+}
+
+/**
+ * Inserts a string whose length is already known at a position. Long strings
+ * are moved into a rope, so that further edits don't have to copy the entire
+ * string.
+ *
+ * @warning The string to be inserted must not be a piece of our own rope.
+ *
+ * @param ulPos    Position in bytes where the string should be inserted.
+ *                 Clamped to the length of the string.
+ * @param mbstr    UTF-8 encoded multi-byte string to be inserted. (doesn't have
+ *                 to be NUL terminated)
+ * @param ulLength Length of the string to be inserted in bytes.
+ */
+void UString::Insert(size_t ulPos, const char *mbstr, size_t ulLength) {
+	TextRope *rope;
+	char *buf;
+
+	// Check if there's anything to do.
+	if ((mbstr == NULL) || (ulLength == 0))
+		return;
+	if (ulPos > m_length)
+		ulPos = m_length;
+	InvalidateWideString();
+
+	// Long strings are edited inside a rope.
+	if ((m_rope != NULL) || ((m_length + ulLength) >= USTRING_ROPE_MIN)) {
+		rope = (m_rope != NULL) ? m_rope : new TextRope(m_mbstr, m_length);
+		rope->Insert(ulPos, mbstr, ulLength);
+		SetRope(rope);
+
+		return;
+	}
+
+	// Short ones are simply rebuilt.
+	buf = (char *)malloc((m_length + ulLength + 1) * sizeof(char));
+	if (buf == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for string"));
+		return;
+	}
+	if (m_length > 0)
+		memcpy(buf, m_mbstr, ulPos * sizeof(char));
+	memcpy(buf + ulPos, mbstr, ulLength * sizeof(char));
+	if (m_length > 0) {
+		memcpy(buf + ulPos + ulLength, m_mbstr + ulPos,
+			(m_length - ulPos) * sizeof(char));
+	}
+	buf[m_length + ulLength] = '\0';
+	AdoptString(buf, m_length + ulLength);
+}
+
+/**
+ * Erases a range of the string. Long strings are moved into a rope, so that
+ * further edits don't have to copy the entire string.
+ *
+ * @param ulPos    Position in bytes of the start of the range.
+ * @param ulLength Length of the range in bytes. Clamped to the end of the
+ *                 string.
+ */
+void UString::Erase(size_t ulPos, size_t ulLength) {
+	TextRope *rope;
+	char *buf;
+	size_t len;
+
+	// Check if there's anything to do.
+	if (ulPos >= m_length)
+		return;
+	if (ulLength > (m_length - ulPos))
+		ulLength = m_length - ulPos;
+	if (ulLength == 0)
+		return;
+	InvalidateWideString();
+	len = m_length - ulLength;
+
+	// Long strings are edited inside a rope.
+	if ((m_rope != NULL) || (m_length >= USTRING_ROPE_MIN)) {
+		rope = (m_rope != NULL) ? m_rope : new TextRope(m_mbstr, m_length);
+		rope->Erase(ulPos, ulLength);
+		if (len >= (USTRING_ROPE_MIN / 4)) {
+			SetRope(rope);
+			return;
+		}
+
+		// Ropes that got small again go back to being a flat string.
+		buf = (char *)malloc((len + 1) * sizeof(char));
+		if (buf == NULL) {
+			ThrowError(EMSG("Failed to allocate memory for string"));
+			return;
+		}
+		rope->CopyTo(buf);
+		buf[len] = '\0';
+		if (rope != m_rope)
+			delete rope;
+		AdoptString(buf, len);
+
+		return;
+	}
+
+	// Short ones are simply rebuilt.
+	buf = (char *)malloc((len + 1) * sizeof(char));
+	if (buf == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for string"));
+		return;
+	}
+	memcpy(buf, m_mbstr, ulPos * sizeof(char));
+	memcpy(buf + ulPos, m_mbstr + ulPos + ulLength,
+		(m_length - ulPos - ulLength) * sizeof(char));
+	buf[len] = '\0';
+	AdoptString(buf, len);
+}
+
+/**
+ * Checks if the string is currently being held in a rope.
+ *
+ * @return TRUE if the string is stored in a rope.
+ */
+bool UString::IsRope() const {
+	return m_rope != NULL;
+}
+
+/**
+ * Gets the rope holding the string, which allows it to be streamed piece by
+ * piece without having to be flattened.
+ *
+ * @return Rope holding the string or NULL if it's a flat string.
+ */
+const TextRope *UString::Rope() const {
+	return m_rope;
+}
+
 /**
  * Sets the internal multi-byte string and performs all the necessary operations
  * to keep consistency inside the object.
@@ -99,15 +415,9 @@ void UString::TakeOwnership(wchar_t *wstr) {
  * @param mbstr New base string.
  */
 void UString::SetString(char *mbstr) {
-	// If we already have something in our UTF-8 string it should be free'd.
-	if (m_mbstr)
-		free(m_mbstr);
-
-	// If we already have something in our UTF-16 string it should also go.
-	if (m_wstr) {
-		free(m_wstr);
-		m_wstr = NULL;
-	}
+	// If we already have something in our string it should be free'd.
+	ReleaseMultiByteString();
+	InvalidateWideString();
 
 	// Set the UTF-8 string and cache its length.
 	m_mbstr = mbstr;
@@ -115,25 +425,245 @@ void UString::SetString(char *mbstr) {
 }
 
 /**
- * Sets the internal multi-byte string and performs all the necessary operations
- * to keep consistency inside the object.
+ * Sets the internal string from a wide string, converting it to UTF-8 right
+ * away since that's the only representation we store.
  *
- * @param wstr New base string.
+ * @param wstr New base string. Will be free'd by this method.
  */
 void UString::SetString(wchar_t *wstr) {
-	// If we already have something in our UTF-16 string it should be free'd.
-	if (m_wstr)
-		free(m_wstr);
+	CopyString(wstr);
+	if (wstr)
+		free(wstr);
+}
 
-	// If we already have something in our UTF-8 string it should also go.
-	if (m_mbstr) {
-		free(m_mbstr);
+/**
+ * Sets the internal multi-byte string to a copy of another string, keeping it
+ * inside the object if it's short enough.
+ *
+ * @param mbstr String to be copied.
+ */
+void UString::CopyString(const char *mbstr) {
+	size_t len;
+
+	// Empty strings are easy.
+	if (mbstr == NULL) {
+		SetString((char *)NULL);
+		return;
+	}
+
+	// Copy the string over.
+	len = strlen(mbstr);
+	CopyString(mbstr, len);
+}
+
+/**
+ * Sets the internal multi-byte string to a copy of another string whose length
+ * is already known, keeping it inside the object if it's short enough.
+ *
+ * @param mbstr    String to be copied. Can be NULL.
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ */
+void UString::CopyString(const char *mbstr, size_t ulLength) {
+	char *buf;
+
+	// Empty strings are easy.
+	if (mbstr == NULL) {
+		SetString((char *)NULL);
+		return;
+	}
+
+	// Short strings are kept inline.
+	if (ulLength < USTRING_INLINE_LEN) {
+		// Copy before releasing since we may be copying our own string.
+		memmove(m_mbbuf, mbstr, ulLength * sizeof(char));
+		m_mbbuf[ulLength] = '\0';
+		if (!IsInline(m_mbstr))
+			ReleaseMultiByteString();
+		InvalidateWideString();
+		m_mbstr = m_mbbuf;
+		m_length = ulLength;
+
+		return;
+	}
+
+	// Longer ones need a buffer of their own.
+	buf = (char *)malloc((ulLength + 1) * sizeof(char));
+	if (buf == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for string"));
+		return;
+	}
+	memcpy(buf, mbstr, ulLength * sizeof(char));
+	buf[ulLength] = '\0';
+	TakeOwnership(buf, ulLength);
+}
+
+/**
+ * Sets the internal string to a copy of a wide string converted to UTF-8,
+ * keeping it inside the object if it's short enough.
+ *
+ * @param wstr String to be converted and copied.
+ */
+void UString::CopyString(const wchar_t *wstr) {
+	char szInline[USTRING_INLINE_LEN];
+	size_t ulWide;
+	size_t ulLength;
+	char *buf;
+
+	// Empty strings are easy.
+	if (wstr == NULL) {
+		SetString((char *)NULL);
+		return;
+	}
+
+	// Measure the conversion so that it can go straight to where it'll live.
+	ulWide = wcslen(wstr);
+	ulLength = Unicode::MultiByteLength(wstr, ulWide);
+
+	// Short strings are converted on the stack and kept inline. The wide
+	// string may be our own cached one, so convert before releasing anything.
+	if (ulLength < USTRING_INLINE_LEN) {
+		if (!Unicode::WideCharToMultiByte(wstr, ulWide, szInline,
+				USTRING_INLINE_LEN)) {
+			ThrowError(EMSG("Failed to convert UTF-16 string to UTF-8"));
+			SetString((char *)NULL);
+			return;
+		}
+
+		CopyString(szInline, ulLength);
+		return;
+	}
+
+	// Longer ones get a buffer of exactly the right size.
+	buf = (char *)malloc((ulLength + 1) * sizeof(char));
+	if (buf == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for string"));
+		return;
+	}
+	if (!Unicode::WideCharToMultiByte(wstr, ulWide, buf, ulLength + 1)) {
+		free(buf);
+		ThrowError(EMSG("Failed to convert UTF-16 string to UTF-8"));
+		SetString((char *)NULL);
+		return;
+	}
+	TakeOwnership(buf, ulLength);
+}
+
+/**
+ * Sets the internal multi-byte string to the same buffer as another string,
+ * sharing it between the objects. Short strings are simply copied.
+ *
+ * @param other String to share the buffer with.
+ */
+void UString::ShareString(const UString& other) {
+	// Ropes are never shared, so we get a flat copy of them.
+	if (other.m_rope != NULL) {
+		size_t len = other.m_length;
+		char *buf = (char *)malloc((len + 1) * sizeof(char));
+		if (buf == NULL) {
+			ThrowError(EMSG("Failed to allocate memory for string"));
+			return;
+		}
+		other.m_rope->CopyTo(buf);
+		buf[len] = '\0';
+		TakeOwnership(buf, len);
+
+		return;
+	}
+
+	// Inline strings are cheaper to copy than to share.
+	if ((other.m_mbstr == NULL) || other.IsInline(other.m_mbstr)) {
+		CopyString(other.m_mbstr, other.m_length);
+		return;
+	}
+
+	// Are we already sharing this buffer?
+	if (m_mbstr == other.m_mbstr)
+		return;
+
+	// Start counting references to the buffer.
+	if (other.m_shared == NULL) {
+		other.m_shared = new UStringShared;
+		other.m_shared->ulRefs = 1;
+	}
+	other.m_shared->ulRefs++;
+
+	// Let go of our string and point to the shared one.
+	ReleaseMultiByteString();
+	InvalidateWideString();
+	m_mbstr = other.m_mbstr;
+	m_length = other.m_length;
+	m_shared = other.m_shared;
+}
+
+/**
+ * Checks if a multi-byte string is stored inside the object itself.
+ *
+ * @param mbstr String to be checked.
+ *
+ * @return TRUE if the string lives in our inline buffer.
+ */
+bool UString::IsInline(const char *mbstr) const {
+	return mbstr == m_mbbuf;
+}
+
+/**
+ * Releases the internal multi-byte string, freeing it if it was dynamically
+ * allocated and no other object is sharing it.
+ */
+void UString::ReleaseMultiByteString() {
+	// Ropes are owned by us alone.
+	if (m_rope != NULL) {
+		delete m_rope;
+		m_rope = NULL;
+	}
+
+	// Shared buffers are only free'd by their last owner.
+	if (m_shared != NULL) {
+		if (--m_shared->ulRefs == 0) {
+			free(m_mbstr);
+			delete m_shared;
+		}
+
+		m_shared = NULL;
 		m_mbstr = NULL;
+		return;
 	}
 
-	// Set the UTF-8 string and cache its length.
-	m_wstr = wstr;
-	m_length = (wstr) ? wcslen(wstr) : 0;
+	if ((m_mbstr != NULL) && !IsInline(m_mbstr))
+		free(m_mbstr);
+	m_mbstr = NULL;
+}
+
+/**
+ * Makes a rope the storage of the string, letting go of our flat buffer since
+ * it no longer reflects the contents of the rope.
+ *
+ * @param rope Rope to be owned by this object.
+ */
+void UString::SetRope(TextRope *rope) {
+	// Keep the rope from being free'd along with the buffer.
+	m_rope = NULL;
+	ReleaseMultiByteString();
+
+	m_rope = rope;
+	m_length = rope->Length();
+}
+
+/**
+ * Takes ownership of a freshly built buffer, moving its contents inside the
+ * object if it's short enough.
+ *
+ * @param mbstr    Dynamically allocated buffer with the new string.
+ * @param ulLength Length of the string in bytes (excluding NUL terminator).
+ */
+void UString::AdoptString(char *mbstr, size_t ulLength) {
+	if (ulLength < USTRING_INLINE_LEN) {
+		CopyString(mbstr, ulLength);
+		free(mbstr);
+		return;
+	}
+
+	TakeOwnership(mbstr, ulLength);
 }
 
 /**
@@ -146,13 +676,44 @@ void UString::SetString(wchar_t *wstr) {
  * @return UTF-16 encoded wide string.
  */
 wchar_t *UString::ToWideString(const char *mbstr) {
-	wchar_t *wstr = NULL;
+	return ToWideString(mbstr, strlen(mbstr), NULL);
+}
+
+/**
+ * Converts an UTF-8 multi-byte string whose length is already known into an
+ * UTF-16 wide string allocated with the exact size needed.
+ *
+ * @warning This method allocates memory dynamically.
+ *
+ * @param mbstr         UTF-8 encoded multi-byte string.
+ * @param ulLength      Length of the string in bytes (excluding NUL
+ *                      terminator).
+ * @param pulWideLength Optional pointer to store the length of the converted
+ *                      string (excluding NUL terminator).
+ *
+ * @return UTF-16 encoded wide string.
+ */
+wchar_t *UString::ToWideString(const char *mbstr, size_t ulLength,
+							   size_t *pulWideLength) {
+	size_t ulWide = Unicode::WideCharLength(mbstr, ulLength);
+	wchar_t *wstr;
 
-	if (!Unicode::MultiByteToWideChar(mbstr, &wstr)) {
+	// Allocate the exact amount of memory for the conversion.
+	wstr = (wchar_t *)malloc((ulWide + 1) * sizeof(wchar_t));
+	if (wstr == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for string"));
+		return BOLOTA_ERR_NULL;
+	}
+
+	// Convert the string.
+	if (!Unicode::MultiByteToWideChar(mbstr, ulLength, wstr, ulWide + 1)) {
+		free(wstr);
 		ThrowError(EMSG("Failed to convert UTF-8 string to UTF-16"));
 		return BOLOTA_ERR_NULL;
 	}
 
+	if (pulWideLength != NULL)
+		*pulWideLength = ulWide;
 	return wstr;
 }
 
@@ -183,40 +744,79 @@ char *UString::ToMultiByteString(const wchar_t *wstr) {
  *         contents of the object change.
  */
 const char *UString::GetMultiByteString() {
-	// Check if we have a string to return.
-	if (m_mbstr == NULL) {
-		// Check if we have no string at all.
-		if (m_wstr == NULL)
-			return NULL;
-
-		// Perform a conversion to make the string available.
-		m_mbstr = ToMultiByteString(m_wstr);
-
-		// Ensure we base our length from this string.
-		m_length = strlen(m_mbstr);
+	// Ropes are flattened on demand and kept until the next edit.
+	if ((m_rope != NULL) && (m_mbstr == NULL)) {
+		m_mbstr = (char *)malloc((m_length + 1) * sizeof(char));
+		if (m_mbstr == NULL) {
+			ThrowError(EMSG("Failed to allocate memory for string"));
+			return BOLOTA_ERR_NULL;
+		}
+		m_rope->CopyTo(m_mbstr);
+		m_mbstr[m_length] = '\0';
 	}
 
 	return const_cast<const char*>(m_mbstr);
 }
 
 /**
- * Gets the internal wide string for interoperability with C libraries.
+ * Gets a wide version of the string for interoperability with C libraries. The
+ * conversion is kept in a shared cache, so repeated calls are cheap.
  *
- * @return Pointer to the internal wide string. Pointer changes whenever the
- *         contents of the object change.
+ * @warning The returned pointer is only valid until the contents of the object
+ *          change or the entry gets evicted from the cache by later
+ *          conversions of other strings on the same thread, so it should be
+ *          used right away rather than stored. Conversions on other threads
+ *          never evict it.
+ *
+ * @return Pointer to the wide string or NULL if the string is empty or the
+ *         conversion failed.
  */
 const wchar_t *UString::GetWideString() {
+	WideCache *cache = GetWideCache();
+	WideCacheEntry entry;
+	size_t ulWide;
+
 	// Check if we have a string to return.
-	if (m_wstr == NULL) {
-		// Check if we have no string at all.
-		if (m_mbstr == NULL)
-			return NULL;
+	if (GetMultiByteString() == NULL)
+		return NULL;
+
+	// Check if our cached conversion is still around.
+	if (m_bWideCached) {
+		const wchar_t *wstr = NULL;
 
-		// Perform a conversion to make the string available.
-		m_wstr = ToWideString(m_mbstr);
+		Threads::LockMutex(&cache->mutex);
+		std::map<const UString*, std::list<WideCacheEntry>::iterator>::iterator
+			it = cache->mapOwners.find(this);
+		if (it != cache->mapOwners.end()) {
+			cache->lstEntries.splice(cache->lstEntries.begin(),
+				cache->lstEntries, it->second);
+			wstr = it->second->wstr;
+		}
+		Threads::UnlockMutex(&cache->mutex);
+
+		if (wstr != NULL)
+			return wstr;
+		m_bWideCached = false;
 	}
 
-	return const_cast<const wchar_t *>(m_wstr);
+	// Perform a conversion to make the string available.
+	entry.owner = this;
+	entry.thread = Threads::CurrentThread();
+	entry.wstr = ToWideString(m_mbstr, m_length, &ulWide);
+	if (entry.wstr == NULL)
+		return NULL;
+	entry.ulBytes = (ulWide + 1) * sizeof(wchar_t);
+
+	// Cache the conversion and make sure the cache stays within its limits.
+	Threads::LockMutex(&cache->mutex);
+	cache->lstEntries.push_front(entry);
+	cache->mapOwners[this] = cache->lstEntries.begin();
+	cache->ulBytes += entry.ulBytes;
+	TrimWideCache(cache->ulMaxEntries, cache->ulMaxBytes);
+	Threads::UnlockMutex(&cache->mutex);
+	m_bWideCached = true;
+
+	return const_cast<const wchar_t *>(entry.wstr);
 }
 
 /**
@@ -233,58 +833,93 @@ const TCHAR *UString::GetNativeString() {
 }
 
 /**
- * Frees the internal multi-byte string if you deem it's no longer going to be
- * used in the short term and freeing up memory is more important.
+ * Evicts the wide version of this string from the cache if you deem it's no
+ * longer going to be used in the short term and freeing up memory is more
+ * important.
  */
-void UString::FreeMultiByteString() {
-	// Is this even needed?
-	if (m_mbstr == NULL)
-		return;
+void UString::FreeWideString() {
+	InvalidateWideString();
+}
 
-#ifdef DEBUG
-	// Ensure you're not doing something stupid.
-	if (m_wstr == NULL) {
-#ifdef _WIN32
-		MessageBox(NULL, EMSG("Trying to free a multi-byte string with no backup."),
-			_T("Bug Alert!"), MB_OK | MB_ICONERROR);
-#else
-		printf(EMSG("BUG ALERT: Trying to free a multi-byte string with no backup.")
-			"\n");
-#endif // _WIN32
-		return;
-	}
-#endif // DEBUG
+/**
+ * Sets the limits of the shared wide string transcoding cache, evicting any
+ * entries that no longer fit.
+ *
+ * @param ulEntries Maximum number of strings to be kept in the cache.
+ * @param ulBytes   Maximum number of bytes used by the cached strings.
+ */
+void UString::SetWideCacheLimits(size_t ulEntries, size_t ulBytes) {
+	WideCache *cache = GetWideCache();
 
-	// Free up the unused buffer.
-	free(m_mbstr);
-	m_mbstr = NULL;
+	Threads::LockMutex(&cache->mutex);
+	cache->ulMaxEntries = (ulEntries > 0) ? ulEntries : 1;
+	cache->ulMaxBytes = ulBytes;
+	TrimWideCache(cache->ulMaxEntries, cache->ulMaxBytes);
+	Threads::UnlockMutex(&cache->mutex);
 }
 
 /**
- * Frees the internal wide character string if you deem it's no longer going to
- * be used in the short term and freeing up memory is more important.
+ * Evicts every entry the calling thread has put in the shared wide string
+ * transcoding cache.
  */
-void UString::FreeWideString() {
+void UString::FlushWideCache() {
+	WideCache *cache = GetWideCache();
+
+	Threads::LockMutex(&cache->mutex);
+	TrimWideCache(0, 0);
+	Threads::UnlockMutex(&cache->mutex);
+}
+
+/**
+ * Removes the cached wide version of this string, if there's one. Only the
+ * object itself changes its flag, evictions simply drop the entry.
+ */
+void UString::InvalidateWideString() {
+	WideCache *cache;
+
 	// Is this even needed?
-	if (m_wstr == NULL)
+	if (!m_bWideCached)
 		return;
 
-#ifdef DEBUG
-	// Ensure you're not doing something stupid.
-	if (m_mbstr == NULL) {
-#ifdef _WIN32
-		MessageBox(NULL, EMSG("Trying to free a wide string with no backup."),
-			_T("Bug Alert!"), MB_OK | MB_ICONERROR);
-#else
-		printf(EMSG("BUG ALERT: Trying to free a wide string with no backup.\n"));
-#endif // _WIN32
-		return;
-	}
-#endif // DEBUG
+	// Remove our entry from the cache if it wasn't evicted already.
+	cache = GetWideCache();
+	Threads::LockMutex(&cache->mutex);
+	std::map<const UString*, std::list<WideCacheEntry>::iterator>::iterator it =
+		cache->mapOwners.find(this);
+	if (it != cache->mapOwners.end())
+		EraseWideEntry(cache, it->second);
+	Threads::UnlockMutex(&cache->mutex);
+	m_bWideCached = false;
+}
 
-	// Free up the unused buffer.
-	free(m_wstr);
-	m_wstr = NULL;
+/**
+ * Evicts the least recently used entries the calling thread has put in the
+ * cache until it's within the specified limits, leaving the conversions of
+ * other threads alone. The most recently used entry is only evicted when the
+ * limits are zero. The cache must be locked.
+ *
+ * @param ulEntries Maximum number of entries allowed in the cache.
+ * @param ulBytes   Maximum number of bytes allowed in the cache.
+ */
+void UString::TrimWideCache(size_t ulEntries, size_t ulBytes) {
+	WideCache *cache = GetWideCache();
+	thread_id_t thread = Threads::CurrentThread();
+	std::list<WideCacheEntry>::iterator it = cache->lstEntries.end();
+
+	while (it != cache->lstEntries.begin()) {
+		size_t ulCount = cache->mapOwners.size();
+
+		// Check if we are within our limits.
+		if ((ulCount <= ulEntries) && (cache->ulBytes <= ulBytes))
+			break;
+
+		// Evict the least recently used entry that belongs to us.
+		--it;
+		if ((it == cache->lstEntries.begin()) && (ulEntries > 0))
+			break;
+		if (Threads::SameThread(it->thread, thread))
+			EraseWideEntry(cache, it++);
+	}
 }
 
 /**
@@ -293,10 +928,6 @@ void UString::FreeWideString() {
  * @return Length of the string.
  */
 size_t UString::Length() {
-	// Ensure we have the UTF-8 string to get its length.
-	if (m_mbstr == NULL)
-		GetMultiByteString();
-
 	return m_length;
 }
 
@@ -309,13 +940,74 @@ bool UString::Empty() const {
 	return m_length == 0;
 }
 
+/**
+ * Checks if the string buffer is currently shared with other objects.
+ *
+ * @return TRUE if another object is using the same buffer.
+ */
+bool UString::IsShared() const {
+	return (m_shared != NULL) && (m_shared->ulRefs > 1);
+}
+
+/**
+ * Gets the heap allocation that holds the text of the string. Useful for
+ * telling apart strings that are sharing the same buffer.
+ *
+ * @return Heap buffer or rope with the text or NULL if the string is stored
+ *         inline.
+ */
+const void *UString::HeapBuffer() const {
+	if ((m_mbstr != NULL) && !IsInline(m_mbstr))
+		return m_mbstr;
+
+	return m_rope;
+}
+
+/**
+ * Gets the number of bytes allocated on the heap to hold the text of the
+ * string, including its rope and the reference counter of shared buffers. The
+ * object itself and the cached wide string aren't included.
+ *
+ * @return Number of bytes allocated for the text.
+ */
+size_t UString::HeapSize() const {
+	size_t ulSize = 0;
+
+	if ((m_mbstr != NULL) && !IsInline(m_mbstr))
+		ulSize += (m_length + 1) * sizeof(char);
+	if (m_shared != NULL)
+		ulSize += sizeof(UStringShared);
+	if (m_rope != NULL)
+		ulSize += sizeof(TextRope) + m_rope->HeapSize();
+
+	return ulSize;
+}
+
+/**
+ * Gets the number of bytes used by the cached wide version of the string.
+ *
+ * @return Size of the cached wide string or 0 if it isn't in the cache.
+ */
+size_t UString::WideSize() const {
+	if (!m_bWideCached)
+		return 0;
+
+	WideCache *cache = GetWideCache();
+	std::map<const UString*, std::list<WideCacheEntry>::iterator>::iterator it =
+		cache->mapOwners.find(this);
+	if (it == cache->mapOwners.end())
+		return 0;
+
+	return it->second->ulBytes;
+}
+
 /**
  * Sets the string contents using a multi-byte character string.
  *
  * @param mbstr Multi-byte character string.
  */
 UString& UString::operator=(const char *mbstr) {
-	SetString(_strdup(mbstr));
+	CopyString(mbstr);
 	return *this;
 }
 
@@ -325,6 +1017,35 @@ UString& UString::operator=(const char *mbstr) {
  * @param wstr Wide character string.
  */
 UString& UString::operator=(const wchar_t *wstr) {
-	SetString(_wcsdup(wstr));
+	CopyString(wstr);
+	return *this;
+}
+
+/**
+ * Sets the string contents to a copy of another string.
+ *
+ * @param other String to be copied.
+ */
+UString& UString::operator=(const UString& other) {
+	if (this != &other)
+		ShareString(other);
+
+	return *this;
+}
+
+#ifdef USTRING_HAS_MOVE
+/**
+ * Sets the string contents by stealing the contents of another string, which
+ * will be left empty.
+ *
+ * @param other String to have its contents moved into this object.
+ */
+UString& UString::operator=(UString&& other) {
+	if (this != &other) {
+		SetString((char *)NULL);
+		Swap(other);
+	}
+
 	return *this;
 }
+#endif // USTRING_HAS_MOVE
@@ -17,6 +17,8 @@
 #include <string.h>
 #include <tchar.h>
 
+#include "TextRope.h"
+
 /**
  * Definition of the system's preferred line ending sequence.
  */
@@ -30,47 +32,127 @@
 	#define LINENDT LINEND
 #endif // _WIN32
 
+/**
+ * Number of characters (including the NUL terminator) that can be stored inside
+ * the object without having to allocate memory dynamically.
+ */
+#define USTRING_INLINE_LEN 24
+
+/**
+ * Length from which edited strings switch to a rope instead of being copied
+ * whole on every change. Ropes shrinking to a quarter of it are flattened.
+ */
+#define USTRING_ROPE_MIN (4 * 1024)
+
+/**
+ * Default limits of the shared wide string transcoding cache.
+ */
+#define USTRING_WCACHE_ENTRIES 512
+#define USTRING_WCACHE_BYTES   (256 * 1024)
+
+/**
+ * Move semantics are only available on compilers that support C++11.
+ */
+#if (__cplusplus >= 201103L) || (defined(_MSC_VER) && (_MSC_VER >= 1600))
+	#define USTRING_HAS_MOVE
+#endif
+
+/**
+ * Reference counter of a string buffer that is shared between objects.
+ */
+struct UStringShared {
+	unsigned long ulRefs;
+};
+
 /**
  * A universal string class that can be used to represent both UTF-8 and UTF-16
  * encoded strings and work with them at the same time.
+ *
+ * Copying a string that isn't stored inline shares its buffer instead of
+ * duplicating it. Buffers are never modified in place, so any change to a
+ * string simply detaches it from the shared buffer.
+ *
+ * Long strings that are edited in place with Insert and Erase are kept in a
+ * rope, which is only flattened when the contents are requested as a C string.
+ *
+ * UTF-8 is the only representation stored by the object. Wide strings are
+ * converted on demand and kept in a bounded cache shared by every object, with
+ * the least recently used entries being evicted once the limits are reached.
+ * The cache is locked and entries are only evicted by the thread that converted
+ * them, so strings may be used from different threads, as long as each object
+ * is only used by one of them at a time.
  */
 class UString {
 private:
 	char *m_mbstr;
-	wchar_t *m_wstr;
 	size_t m_length;
+	bool m_bWideCached;
+	mutable UStringShared *m_shared;
+	TextRope *m_rope;
+
+	// Inline storage for short strings.
+	char m_mbbuf[USTRING_INLINE_LEN];
 
 public:
 	// Constructors and destructors.
 	UString();
 	UString(const char *mbstr);
 	UString(const wchar_t *wstr);
+	UString(const UString& other);
+#ifdef USTRING_HAS_MOVE
+	UString(UString&& other);
+#endif // USTRING_HAS_MOVE
 	virtual ~UString();
 
 	// Ownership handling.
 	void TakeOwnership(char *mbstr);
+	void TakeOwnership(char *mbstr, size_t ulLength);
 	void TakeOwnership(wchar_t *wstr);
+	void Swap(UString& other);
+	char *PrepareMultiByteString(size_t ulLength);
+
+	// In place editing.
+	void Insert(size_t ulPos, const char *mbstr);
+	void Insert(size_t ulPos, const char *mbstr, size_t ulLength);
+	void Erase(size_t ulPos, size_t ulLength);
+	bool IsRope() const;
+	const TextRope *Rope() const;
 
 	// Access to the internal strings.
 	const char *GetMultiByteString();
+	// Only valid until the string changes or conversions of other strings on
+	// the same thread evict it. Use ToWideString for a copy that outlives it.
 	const wchar_t *GetWideString();
 	const TCHAR *GetNativeString();
 
-	// Free up unused internal strings.
-	void FreeMultiByteString();
+	// Wide string transcoding cache.
 	void FreeWideString();
+	static void SetWideCacheLimits(size_t ulEntries, size_t ulBytes);
+	static void FlushWideCache();
 
 	// Encoding converters.
 	static wchar_t *ToWideString(const char* mbstr);
+	static wchar_t *ToWideString(const char* mbstr, size_t ulLength,
+		size_t *pulWideLength);
 	static char *ToMultiByteString(const wchar_t* wstr);
 
 	// Getters
 	size_t Length();
 	bool Empty() const;
+	bool IsShared() const;
+
+	// Memory usage.
+	const void *HeapBuffer() const;
+	size_t HeapSize() const;
+	size_t WideSize() const;
 
 	// Operators
 	UString& operator=(const char *mbstr);
 	UString& operator=(const wchar_t *wstr);
+	UString& operator=(const UString& other);
+#ifdef USTRING_HAS_MOVE
+	UString& operator=(UString&& other);
+#endif // USTRING_HAS_MOVE
 
 protected:
 	// Constructor helper.
@@ -79,6 +161,20 @@ protected:
 	// Setters for internal strings.
 	void SetString(char *mbstr);
 	void SetString(wchar_t *wstr);
+	void CopyString(const char *mbstr);
+	void CopyString(const char *mbstr, size_t ulLength);
+	void ShareString(const UString& other);
+	void CopyString(const wchar_t *wstr);
+
+	// Internal buffer management.
+	bool IsInline(const char *mbstr) const;
+	void ReleaseMultiByteString();
+	void SetRope(TextRope *rope);
+	void AdoptString(char *mbstr, size_t ulLength);
+
+	// Wide string transcoding cache helpers.
+	void InvalidateWideString();
+	static void TrimWideCache(size_t ulEntries, size_t ulBytes);
 };
 
 #endif // _INNOVE_USTRING_H
@@ -7,6 +7,24 @@
 
 #include "FileUtils.h"
 
+#include <string.h>
+#include <algorithm>
+#ifndef _WIN32
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif // !_WIN32
+#if !defined(_WIN32) && defined(UNICODE)
+	#include "../../shims/cvtutf/Unicode.h"
+#endif // !_WIN32 && UNICODE
+
+// Private helpers.
+static bool ListDirectory(const tstring& strPath, LPCTSTR szExtension,
+						  bool bRecursive, std::vector<tstring>& vecFiles);
+static bool HasExtension(const tstring& strName, LPCTSTR szExtension);
+
 /**
  * Opens a file handle.
  *
@@ -34,8 +52,16 @@ FHND FileUtils::Open(LPCTSTR szFilename, bool bWrite, bool bBinary) {
 	flags[1] = (bBinary) ? 'b' : '\0';
 	flags[2] = '\0';
 
-	// Open the file.
+	// Open the file. Paths are UTF-8 on this side of the fence.
+#ifdef UNICODE
+	char *szPath = NULL;
+	if (!Unicode::WideCharToMultiByte(szFilename, &szPath))
+		return INVALID_HANDLE_VALUE;
+	FHND hFile = fopen(szPath, flags);
+	free(szPath);
+#else
 	FHND hFile = fopen(szFilename, flags);
+#endif // UNICODE
 	if (hFile == NULL)
 		return INVALID_HANDLE_VALUE;
 #endif // _WIN32
@@ -119,3 +145,420 @@ bool FileUtils::Write(FHND hFile, const void* lpBuffer, fsize_t nBytesToWrite,
 	return true;
 #endif // _WIN32
 }
+
+/**
+ * Skips over some bytes of a binary file without reading them.
+ *
+ * @param hFile  File handle.
+ * @param nBytes Number of bytes to skip forward.
+ *
+ * @return TRUE on success, FALSE otherwise.
+ */
+bool FileUtils::Seek(FHND hFile, fsize_t nBytes) {
+#ifdef _WIN32
+	LONG lHigh = 0;
+
+	if ((SetFilePointer(hFile, (LONG)nBytes, &lHigh, FILE_CURRENT) ==
+			0xFFFFFFFF) && (GetLastError() != NO_ERROR)) {
+		return false;
+	}
+
+	return true;
+#else
+	return fseek(hFile, (long)nBytes, SEEK_CUR) == 0;
+#endif // _WIN32
+}
+
+/**
+ * Gets the size of an opened file.
+ *
+ * @param hFile File handle.
+ * @param size  Size of the file in bytes.
+ *
+ * @return TRUE on success, FALSE otherwise.
+ */
+bool FileUtils::GetSize(FHND hFile, uint64_t *size) {
+#ifdef _WIN32
+	DWORD dwHigh = 0;
+	DWORD dwLow = GetFileSize(hFile, &dwHigh);
+
+	if ((dwLow == 0xFFFFFFFF) && (GetLastError() != NO_ERROR))
+		return false;
+
+	*size = ((uint64_t)dwHigh << 32) | dwLow;
+#else
+	struct stat st;
+
+	if (fstat(fileno(hFile), &st) != 0)
+		return false;
+
+	*size = (uint64_t)st.st_size;
+#endif // _WIN32
+
+	return true;
+}
+
+/**
+ * Gets the size and modification time of a file.
+ *
+ * @param szPath Path to the file.
+ * @param info   Information about the file.
+ *
+ * @return TRUE if the file exists and we could get its information.
+ */
+bool FileUtils::GetInfo(LPCTSTR szPath, file_info_t *info) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+
+	if (!GetFileAttributesEx(szPath, GetFileExInfoStandard, &fad))
+		return false;
+
+	info->size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+	info->modified = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+		fad.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+
+	// Paths are UTF-8 on this side of the fence.
+#ifdef UNICODE
+	char *szMultiPath = NULL;
+	if (!Unicode::WideCharToMultiByte(szPath, &szMultiPath))
+		return false;
+	int iStatus = stat(szMultiPath, &st);
+	free(szMultiPath);
+#else
+	int iStatus = stat(szPath, &st);
+#endif // UNICODE
+	if (iStatus != 0)
+		return false;
+
+	info->size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+	info->modified = ((uint64_t)st.st_mtimespec.tv_sec * 1000000000) +
+		st.st_mtimespec.tv_nsec;
+#else
+	info->modified = ((uint64_t)st.st_mtim.tv_sec * 1000000000) +
+		st.st_mtim.tv_nsec;
+#endif // __APPLE__
+#endif // _WIN32
+
+	return true;
+}
+
+/**
+ * Lists the files in a directory that have a specific extension, regardless of
+ * its case, sorted by their paths. Just like grep, links found in the
+ * directory are not followed.
+ *
+ * @param szPath      Path to the directory.
+ * @param szExtension Extension of the files, including the dot.
+ * @param bRecursive  Should subdirectories be listed as well?
+ * @param vecFiles    Vector to append the paths of the files to.
+ *
+ * @return TRUE if the directory was listed. Subdirectories that can't be
+ *         listed are skipped.
+ */
+bool FileUtils::ListFiles(LPCTSTR szPath, LPCTSTR szExtension, bool bRecursive,
+						  std::vector<tstring>& vecFiles) {
+	std::vector<tstring> vecFound;
+
+	if (!ListDirectory(szPath, szExtension, bRecursive, vecFound))
+		return false;
+
+	std::sort(vecFound.begin(), vecFound.end());
+	vecFiles.insert(vecFiles.end(), vecFound.begin(), vecFound.end());
+
+	return true;
+}
+
+/**
+ * Renames a file, replacing the one at the destination if it already exists.
+ *
+ * @param szFrom Current path of the file.
+ * @param szTo   New path of the file.
+ *
+ * @return TRUE if the file was renamed.
+ */
+bool FileUtils::Rename(LPCTSTR szFrom, LPCTSTR szTo) {
+#ifdef _WIN32
+	// Windows 9x doesn't know how to replace files in one go.
+	if (MoveFileEx(szFrom, szTo, MOVEFILE_REPLACE_EXISTING))
+		return true;
+	DeleteFile(szTo);
+
+	return MoveFile(szFrom, szTo) != 0;
+#else
+	// Paths are UTF-8 on this side of the fence.
+#ifdef UNICODE
+	char *szMultiFrom = NULL;
+	char *szMultiTo = NULL;
+	if (!Unicode::WideCharToMultiByte(szFrom, &szMultiFrom))
+		return false;
+	if (!Unicode::WideCharToMultiByte(szTo, &szMultiTo)) {
+		free(szMultiFrom);
+		return false;
+	}
+	int iStatus = rename(szMultiFrom, szMultiTo);
+	free(szMultiFrom);
+	free(szMultiTo);
+#else
+	int iStatus = rename(szFrom, szTo);
+#endif // UNICODE
+
+	return iStatus == 0;
+#endif // _WIN32
+}
+
+/**
+ * Maps the contents of a file into memory for reading. The file can't be
+ * written to while it's mapped, so files that need to be replaced should be
+ * written somewhere else and renamed over it after being unmapped.
+ *
+ * @param szPath Path to the file.
+ * @param map    Mapping to be populated. Must be released with UnmapFile.
+ *
+ * @return TRUE if the file was mapped.
+ */
+bool FileUtils::MapFile(LPCTSTR szPath, file_map_t *map) {
+	map->data = NULL;
+	map->size = 0;
+
+#ifdef _WIN32
+	map->hMapping = NULL;
+	map->hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (map->hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files can't be mapped, but they're perfectly fine files.
+	DWORD dwSizeHigh = 0;
+	DWORD dwSize = GetFileSize(map->hFile, &dwSizeHigh);
+	if ((dwSizeHigh != 0) || (dwSize == 0xFFFFFFFF))
+		goto error_handling;
+	if (dwSize == 0)
+		return true;
+
+	map->hMapping = CreateFileMapping(map->hFile, NULL, PAGE_READONLY, 0, 0,
+		NULL);
+	if (map->hMapping == NULL)
+		goto error_handling;
+	map->data = (const uint8_t*)MapViewOfFile(map->hMapping, FILE_MAP_READ,
+		0, 0, 0);
+	if (map->data == NULL)
+		goto error_handling;
+	map->size = dwSize;
+
+	return true;
+
+error_handling:
+	UnmapFile(map);
+	return false;
+#else
+	struct stat st;
+
+	// Paths are UTF-8 on this side of the fence.
+#ifdef UNICODE
+	char *szMultiPath = NULL;
+	if (!Unicode::WideCharToMultiByte(szPath, &szMultiPath))
+		return false;
+	int fd = open(szMultiPath, O_RDONLY);
+	free(szMultiPath);
+#else
+	int fd = open(szPath, O_RDONLY);
+#endif // UNICODE
+	if (fd < 0)
+		return false;
+
+	// Empty files can't be mapped, but they're perfectly fine files.
+	if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// The mapping holds on to the file by itself.
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	map->data = (const uint8_t*)data;
+	map->size = (size_t)st.st_size;
+
+	return true;
+#endif // _WIN32
+}
+
+/**
+ * Releases a file that was mapped into memory. Safe to call on a mapping
+ * that failed or was already released.
+ *
+ * @param map Mapping to be released.
+ */
+void FileUtils::UnmapFile(file_map_t *map) {
+#ifdef _WIN32
+	if (map->data != NULL)
+		UnmapViewOfFile(map->data);
+	if (map->hMapping != NULL)
+		CloseHandle(map->hMapping);
+	if ((map->hFile != NULL) && (map->hFile != INVALID_HANDLE_VALUE))
+		CloseHandle(map->hFile);
+
+	map->hFile = NULL;
+	map->hMapping = NULL;
+#else
+	if (map->data != NULL)
+		munmap((void*)map->data, map->size);
+#endif // _WIN32
+
+	map->data = NULL;
+	map->size = 0;
+}
+
+/**
+ * Appends the files in a directory that have a specific extension to a list.
+ *
+ * @param strPath     Path to the directory.
+ * @param szExtension Extension of the files, including the dot.
+ * @param bRecursive  Should subdirectories be listed as well?
+ * @param vecFiles    Vector to append the paths of the files to.
+ *
+ * @return TRUE if the directory was listed.
+ */
+static bool ListDirectory(const tstring& strPath, LPCTSTR szExtension,
+						  bool bRecursive, std::vector<tstring>& vecFiles) {
+#ifdef _WIN32
+	WIN32_FIND_DATA wfd;
+	tstring strQuery = strPath + _T("\\*");
+
+	HANDLE hFind = FindFirstFile(strQuery.c_str(), &wfd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do {
+		tstring strName = wfd.cFileName;
+		if ((strName == _T(".")) || (strName == _T("..")))
+			continue;
+
+		tstring strChild = strPath + _T("\\") + strName;
+		if (wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			if (bRecursive)
+				ListDirectory(strChild, szExtension, bRecursive, vecFiles);
+		} else if (HasExtension(strName, szExtension)) {
+			vecFiles.push_back(strChild);
+		}
+	} while (FindNextFile(hFind, &wfd));
+
+	FindClose(hFind);
+	return true;
+#else
+	struct dirent *entry;
+	struct stat st;
+
+	// Paths are UTF-8 on this side of the fence.
+#ifdef UNICODE
+	char *szPath = NULL;
+	if (!Unicode::WideCharToMultiByte(strPath.c_str(), &szPath))
+		return false;
+	DIR *dir = opendir(szPath);
+	free(szPath);
+#else
+	DIR *dir = opendir(strPath.c_str());
+#endif // UNICODE
+	if (dir == NULL)
+		return false;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if ((strcmp(entry->d_name, ".") == 0) ||
+				(strcmp(entry->d_name, "..") == 0)) {
+			continue;
+		}
+
+		// Build up the path of the entry.
+#ifdef UNICODE
+		wchar_t *szName = NULL;
+		if (!Unicode::MultiByteToWideChar(entry->d_name, &szName))
+			continue;
+		tstring strName = szName;
+		free(szName);
+#else
+		tstring strName = entry->d_name;
+#endif // UNICODE
+		tstring strChild = strPath;
+		if (strChild.empty() || (strChild[strChild.size() - 1] != _T('/')))
+			strChild += _T('/');
+		strChild += strName;
+
+		// Check what kind of entry it is, only asking the file system when
+		// the listing doesn't say. Links are not followed.
+		bool bDirectory = false;
+		bool bRegular = false;
+		bool bAsk = true;
+#ifdef DT_UNKNOWN
+		if (entry->d_type != DT_UNKNOWN) {
+			bDirectory = entry->d_type == DT_DIR;
+			bRegular = entry->d_type == DT_REG;
+			bAsk = false;
+		}
+#endif // DT_UNKNOWN
+		if (bAsk) {
+#ifdef UNICODE
+			char *szChild = NULL;
+			if (!Unicode::WideCharToMultiByte(strChild.c_str(), &szChild))
+				continue;
+			int iStatus = lstat(szChild, &st);
+			free(szChild);
+#else
+			int iStatus = lstat(strChild.c_str(), &st);
+#endif // UNICODE
+			if (iStatus != 0)
+				continue;
+
+			bDirectory = S_ISDIR(st.st_mode);
+			bRegular = S_ISREG(st.st_mode);
+		}
+
+		if (bDirectory) {
+			if (bRecursive)
+				ListDirectory(strChild, szExtension, bRecursive, vecFiles);
+		} else if (bRegular && HasExtension(strName, szExtension)) {
+			vecFiles.push_back(strChild);
+		}
+	}
+
+	closedir(dir);
+	return true;
+#endif // _WIN32
+}
+
+/**
+ * Checks if a file name ends with an extension, regardless of case.
+ *
+ * @param strName     Name of the file.
+ * @param szExtension Extension including the dot.
+ *
+ * @return TRUE if the file has the extension.
+ */
+static bool HasExtension(const tstring& strName, LPCTSTR szExtension) {
+	size_t ulLength = _tcslen(szExtension);
+
+	if (strName.size() < ulLength)
+		return false;
+
+	size_t ulOffset = strName.size() - ulLength;
+	for (size_t i = 0; i < ulLength; i++) {
+		TCHAR a = strName[ulOffset + i];
+		TCHAR b = szExtension[i];
+		if ((a >= _T('A')) && (a <= _T('Z')))
+			a = a - _T('A') + _T('a');
+		if ((b >= _T('A')) && (b <= _T('Z')))
+			b = b - _T('A') + _T('a');
+		if (a != b)
+			return false;
+	}
+
+	return true;
+}
@@ -16,8 +16,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <tchar.h>
+#include <string>
+#include <vector>
 #ifdef _WIN32
 	#include <windows.h>
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
 #else
 	#include <stdbool.h>
 #endif // _WIN32
@@ -47,6 +52,27 @@ typedef size_t fsize_t;
 	#define INVALID_HANDLE_VALUE (FHND)((size_t)-1)
 #endif
 
+/**
+ * Information about a file in the file system.
+ */
+typedef struct file_info_s {
+	uint64_t size;      /* Size of the file in bytes. */
+	uint64_t modified;  /* Time of the last modification in a platform-specific
+	                     * unit. Only meant to be compared. */
+} file_info_t;
+
+/**
+ * File mapped into memory for reading.
+ */
+typedef struct file_map_s {
+	const uint8_t *data;  /* Contents of the file. */
+	size_t size;          /* Size of the contents in bytes. */
+#ifdef _WIN32
+	HANDLE hFile;         /* Handle of the mapped file. */
+	HANDLE hMapping;      /* Handle of the mapping object. */
+#endif // _WIN32
+} file_map_t;
+
 namespace FileUtils {
 
 FHND Open(LPCTSTR szFilename, bool bWrite, bool bBinary);
@@ -55,6 +81,16 @@ bool Read(FHND hFile, void* lpBuffer, fsize_t nBytesToRead,
 	fsize_t* lpnBytesRead);
 bool Write(FHND hFile, const void* lpBuffer, fsize_t nBytesToWrite,
 	fsize_t* lpnBytesWritten);
+bool Seek(FHND hFile, fsize_t nBytes);
+bool GetSize(FHND hFile, uint64_t *size);
+
+bool GetInfo(LPCTSTR szPath, file_info_t *info);
+bool ListFiles(LPCTSTR szPath, LPCTSTR szExtension, bool bRecursive,
+	std::vector<tstring>& vecFiles);
+bool Rename(LPCTSTR szFrom, LPCTSTR szTo);
+
+bool MapFile(LPCTSTR szPath, file_map_t *map);
+void UnmapFile(file_map_t *map);
 
 }
 
@@ -0,0 +1,432 @@
+/**
+ * Threads.cpp
+ * A shim for splitting work across a bunch of threads.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "Threads.h"
+
+#ifndef _WIN32
+	#include <unistd.h>
+#endif // !_WIN32
+
+/**
+ * Slice of a job handed to a single thread.
+ */
+typedef struct {
+	Threads::RangeFunc func;
+	void *ctx;
+	size_t ulStart;
+	size_t ulEnd;
+} range_job_t;
+
+/**
+ * Thread entry point that runs a slice of a job.
+ *
+ * @param lpParam Slice of the job to be run.
+ *
+ * @return Always 0.
+ */
+#ifdef _WIN32
+static DWORD WINAPI RangeThreadProc(LPVOID lpParam) {
+#else
+static void* RangeThreadProc(void *lpParam) {
+#endif // _WIN32
+	range_job_t *job = (range_job_t *)lpParam;
+	job->func(job->ctx, job->ulStart, job->ulEnd);
+
+	return 0;
+}
+
+/**
+ * Range of items owned by a thread of a dynamic job. Other threads steal from
+ * its end once they run out of items of their own.
+ */
+typedef struct {
+	thread_mutex_t mutex;
+	size_t ulNext;
+	size_t ulEnd;
+} steal_range_t;
+
+/**
+ * Worker of a dynamic job.
+ */
+typedef struct {
+	Threads::RangeFunc func;
+	void *ctx;
+	size_t ulGrain;
+	steal_range_t *ranges;
+	unsigned int uThreads;
+	unsigned int uIndex;
+} steal_job_t;
+
+/**
+ * Takes the next chunk of items from the front of a range.
+ *
+ * @param range    Range to take the items from.
+ * @param ulGrain  Maximum number of items to take.
+ * @param pulStart Pointer to receive the first item of the chunk.
+ * @param pulEnd   Pointer to receive the end of the chunk.
+ *
+ * @return TRUE if any items were taken, FALSE if the range is empty.
+ */
+static bool TakeChunk(steal_range_t *range, size_t ulGrain, size_t *pulStart,
+					  size_t *pulEnd) {
+	bool bTaken = false;
+
+	Threads::LockMutex(&range->mutex);
+	if (range->ulNext < range->ulEnd) {
+		*pulStart = range->ulNext;
+		*pulEnd = ((range->ulEnd - range->ulNext) > ulGrain) ?
+			range->ulNext + ulGrain : range->ulEnd;
+		range->ulNext = *pulEnd;
+		bTaken = true;
+	}
+	Threads::UnlockMutex(&range->mutex);
+
+	return bTaken;
+}
+
+/**
+ * Steals the back half of the items left in the range of another thread.
+ *
+ * @param job Worker that ran out of items.
+ *
+ * @return TRUE if any items were stolen, FALSE if every range is empty.
+ */
+static bool StealItems(steal_job_t *job) {
+	steal_range_t *own = &job->ranges[job->uIndex];
+
+	for (unsigned int i = 1; i < job->uThreads; i++) {
+		steal_range_t *victim = &job->ranges[(job->uIndex + i) % job->uThreads];
+		size_t ulStart = 0;
+		size_t ulEnd = 0;
+
+		// Take half of what's left, rounding up so that single items move.
+		Threads::LockMutex(&victim->mutex);
+		if (victim->ulNext < victim->ulEnd) {
+			ulEnd = victim->ulEnd;
+			ulStart = ulEnd - (((ulEnd - victim->ulNext) + 1) / 2);
+			victim->ulEnd = ulStart;
+		}
+		Threads::UnlockMutex(&victim->mutex);
+
+		if (ulStart < ulEnd) {
+			Threads::LockMutex(&own->mutex);
+			own->ulNext = ulStart;
+			own->ulEnd = ulEnd;
+			Threads::UnlockMutex(&own->mutex);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Thread entry point that runs the items of a dynamic job until there are
+ * none left to be stolen.
+ *
+ * @param lpParam Worker of the job.
+ *
+ * @return Always 0.
+ */
+#ifdef _WIN32
+static DWORD WINAPI StealThreadProc(LPVOID lpParam) {
+#else
+static void* StealThreadProc(void *lpParam) {
+#endif // _WIN32
+	steal_job_t *job = (steal_job_t *)lpParam;
+	size_t ulStart;
+	size_t ulEnd;
+
+	do {
+		while (TakeChunk(&job->ranges[job->uIndex], job->ulGrain, &ulStart,
+				&ulEnd)) {
+			job->func(job->ctx, ulStart, ulEnd);
+		}
+	} while (StealItems(job));
+
+	return 0;
+}
+
+/**
+ * Starts a thread.
+ *
+ * @param phThread Pointer to receive the handle of the thread.
+ * @param lpParam  Parameter passed along to the entry point.
+ * @param bSteal   Run a dynamic job instead of a slice?
+ *
+ * @return TRUE if the thread was started.
+ */
+#ifdef _WIN32
+static bool StartThread(HANDLE *phThread, void *lpParam, bool bSteal) {
+	*phThread = CreateThread(NULL, 0,
+		(bSteal) ? StealThreadProc : RangeThreadProc, lpParam, 0, NULL);
+	return *phThread != NULL;
+}
+#else
+static bool StartThread(pthread_t *phThread, void *lpParam, bool bSteal) {
+	return pthread_create(phThread, NULL,
+		(bSteal) ? StealThreadProc : RangeThreadProc, lpParam) == 0;
+}
+#endif // _WIN32
+
+/**
+ * Waits for a thread to finish and releases it.
+ *
+ * @param hThread Handle of the thread.
+ */
+#ifdef _WIN32
+static void JoinThread(HANDLE hThread) {
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+}
+#else
+static void JoinThread(pthread_t hThread) {
+	pthread_join(hThread, NULL);
+}
+#endif // _WIN32
+
+/**
+ * Gets the number of processors available to the application.
+ *
+ * @return Number of processors. Always at least 1.
+ */
+unsigned int Threads::ProcessorCount() {
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (si.dwNumberOfProcessors > 0) ? si.dwNumberOfProcessors : 1;
+#else
+	long lCount = sysconf(_SC_NPROCESSORS_ONLN);
+	return (lCount > 0) ? (unsigned int)lCount : 1;
+#endif // _WIN32
+}
+
+/**
+ * Runs a job over the items [0, ulCount) splitting them into contiguous slices
+ * of roughly the same size, one per thread. The calling thread takes care of
+ * the first slice and only returns once every slice has been processed.
+ *
+ * @warning The function is called concurrently, so it must only touch the
+ *          items of its own slice. Errors can't be thrown from inside it since
+ *          the error stack isn't thread safe.
+ *
+ * @param ulCount  Number of items to be processed.
+ * @param uThreads Number of threads to use. 0 uses one per processor.
+ * @param func     Function that processes a slice of the items.
+ * @param ctx      Context passed along to the function.
+ */
+void Threads::ParallelFor(size_t ulCount, unsigned int uThreads,
+						  RangeFunc func, void *ctx) {
+	range_job_t jobs[BOLOTA_THREADS_MAX];
+#ifdef _WIN32
+	HANDLE hThreads[BOLOTA_THREADS_MAX];
+#else
+	pthread_t hThreads[BOLOTA_THREADS_MAX];
+#endif // _WIN32
+	bool bStarted[BOLOTA_THREADS_MAX];
+	unsigned int i;
+
+	// Never use more threads than there are items.
+	if (uThreads == 0)
+		uThreads = ProcessorCount();
+	if (uThreads > BOLOTA_THREADS_MAX)
+		uThreads = BOLOTA_THREADS_MAX;
+	if (uThreads > ulCount)
+		uThreads = (unsigned int)ulCount;
+	if (uThreads <= 1) {
+		if (ulCount > 0)
+			func(ctx, 0, ulCount);
+		return;
+	}
+
+	// Slice up the job and start the other threads.
+	for (i = 0; i < uThreads; i++) {
+		jobs[i].func = func;
+		jobs[i].ctx = ctx;
+		jobs[i].ulStart = (ulCount * i) / uThreads;
+		jobs[i].ulEnd = (ulCount * (i + 1)) / uThreads;
+		bStarted[i] = false;
+		if (i == 0)
+			continue;
+
+		bStarted[i] = StartThread(&hThreads[i], &jobs[i], false);
+	}
+
+	// Do our part of the job, along with any slice that didn't get a thread.
+	for (i = 0; i < uThreads; i++) {
+		if (!bStarted[i])
+			RangeThreadProc(&jobs[i]);
+	}
+
+	// Wait for everyone to finish.
+	for (i = 1; i < uThreads; i++) {
+		if (bStarted[i])
+			JoinThread(hThreads[i]);
+	}
+}
+
+/**
+ * Runs a job over the items [0, ulCount) when the items may take very
+ * different amounts of time to process. Each thread starts with a contiguous
+ * slice of the items and processes it a few items at a time, and once it runs
+ * out it steals half of what's left of the slice of another thread. The
+ * calling thread takes part in the job and only returns once every item has
+ * been processed.
+ *
+ * @warning The same rules as ParallelFor apply to the function.
+ *
+ * @param ulCount  Number of items to be processed.
+ * @param uThreads Number of threads to use. 0 uses one per processor.
+ * @param ulGrain  Maximum number of items handed to the function at a time.
+ * @param func     Function that processes a chunk of the items.
+ * @param ctx      Context passed along to the function.
+ */
+void Threads::ParallelForDynamic(size_t ulCount, unsigned int uThreads,
+								 size_t ulGrain, RangeFunc func, void *ctx) {
+	steal_range_t ranges[BOLOTA_THREADS_MAX];
+	steal_job_t jobs[BOLOTA_THREADS_MAX];
+#ifdef _WIN32
+	HANDLE hThreads[BOLOTA_THREADS_MAX];
+#else
+	pthread_t hThreads[BOLOTA_THREADS_MAX];
+#endif // _WIN32
+	bool bStarted[BOLOTA_THREADS_MAX];
+	unsigned int i;
+
+	// Never use more threads than there are items.
+	if (ulGrain == 0)
+		ulGrain = 1;
+	if (uThreads == 0)
+		uThreads = ProcessorCount();
+	if (uThreads > BOLOTA_THREADS_MAX)
+		uThreads = BOLOTA_THREADS_MAX;
+	if (uThreads > ulCount)
+		uThreads = (unsigned int)ulCount;
+	if (uThreads <= 1) {
+		size_t ulStart = 0;
+		while (ulStart < ulCount) {
+			size_t ulEnd = ((ulCount - ulStart) > ulGrain) ?
+				ulStart + ulGrain : ulCount;
+			func(ctx, ulStart, ulEnd);
+			ulStart = ulEnd;
+		}
+
+		return;
+	}
+
+	// Hand out the initial slices before anyone gets a chance to steal.
+	for (i = 0; i < uThreads; i++) {
+		InitMutex(&ranges[i].mutex);
+		ranges[i].ulNext = (ulCount * i) / uThreads;
+		ranges[i].ulEnd = (ulCount * (i + 1)) / uThreads;
+
+		jobs[i].func = func;
+		jobs[i].ctx = ctx;
+		jobs[i].ulGrain = ulGrain;
+		jobs[i].ranges = ranges;
+		jobs[i].uThreads = uThreads;
+		jobs[i].uIndex = i;
+	}
+
+	// Start the other threads. Slices without a thread simply get stolen.
+	bStarted[0] = false;
+	for (i = 1; i < uThreads; i++)
+		bStarted[i] = StartThread(&hThreads[i], &jobs[i], true);
+
+	// Do our part of the job and wait for everyone to finish.
+	StealThreadProc(&jobs[0]);
+	for (i = 1; i < uThreads; i++) {
+		if (bStarted[i])
+			JoinThread(hThreads[i]);
+	}
+
+	for (i = 0; i < uThreads; i++)
+		DestroyMutex(&ranges[i].mutex);
+}
+
+/**
+ * Initializes a mutual exclusion lock.
+ *
+ * @param mutex Lock to be initialized.
+ */
+void Threads::InitMutex(thread_mutex_t *mutex) {
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif // _WIN32
+}
+
+/**
+ * Releases the resources of a mutual exclusion lock.
+ *
+ * @param mutex Lock to be destroyed. Must not be held by anyone.
+ */
+void Threads::DestroyMutex(thread_mutex_t *mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif // _WIN32
+}
+
+/**
+ * Acquires a mutual exclusion lock, waiting for it to be released if another
+ * thread holds it.
+ *
+ * @param mutex Lock to be acquired.
+ */
+void Threads::LockMutex(thread_mutex_t *mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif // _WIN32
+}
+
+/**
+ * Releases a mutual exclusion lock.
+ *
+ * @param mutex Lock to be released.
+ */
+void Threads::UnlockMutex(thread_mutex_t *mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif // _WIN32
+}
+
+/**
+ * Gets the identifier of the calling thread.
+ *
+ * @return Identifier of the current thread.
+ */
+thread_id_t Threads::CurrentThread() {
+#ifdef _WIN32
+	return GetCurrentThreadId();
+#else
+	return pthread_self();
+#endif // _WIN32
+}
+
+/**
+ * Checks if two thread identifiers refer to the same thread.
+ *
+ * @param a First thread identifier.
+ * @param b Second thread identifier.
+ *
+ * @return TRUE if both identify the same thread.
+ */
+bool Threads::SameThread(thread_id_t a, thread_id_t b) {
+#ifdef _WIN32
+	return a == b;
+#else
+	return pthread_equal(a, b) != 0;
+#endif // _WIN32
+}
@@ -0,0 +1,69 @@
+/**
+ * Threads.h
+ * A shim for splitting work across a bunch of threads.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_UTILS_THREADS_H
+#define _BOLOTA_UTILS_THREADS_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdlib.h>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <stdbool.h>
+	#include <pthread.h>
+#endif // _WIN32
+
+/**
+ * Maximum number of threads that will ever be used for a single job.
+ */
+#define BOLOTA_THREADS_MAX 64
+
+/**
+ * Mutual exclusion lock.
+ */
+#ifdef _WIN32
+typedef CRITICAL_SECTION thread_mutex_t;
+#else
+typedef pthread_mutex_t thread_mutex_t;
+#endif // _WIN32
+
+/**
+ * Identifier of a thread.
+ */
+#ifdef _WIN32
+typedef DWORD thread_id_t;
+#else
+typedef pthread_t thread_id_t;
+#endif // _WIN32
+
+namespace Threads {
+
+/**
+ * Function that processes the items [ulStart, ulEnd) of a job.
+ */
+typedef void (*RangeFunc)(void *ctx, size_t ulStart, size_t ulEnd);
+
+unsigned int ProcessorCount();
+void ParallelFor(size_t ulCount, unsigned int uThreads, RangeFunc func,
+	void *ctx);
+void ParallelForDynamic(size_t ulCount, unsigned int uThreads, size_t ulGrain,
+	RangeFunc func, void *ctx);
+
+void InitMutex(thread_mutex_t *mutex);
+void DestroyMutex(thread_mutex_t *mutex);
+void LockMutex(thread_mutex_t *mutex);
+void UnlockMutex(thread_mutex_t *mutex);
+
+thread_id_t CurrentThread();
+bool SameThread(thread_id_t a, thread_id_t b);
+
+}
+
+#endif // _BOLOTA_UTILS_THREADS_H
@@ -0,0 +1,440 @@
+/**
+ * WideTextBlock.cpp
+ * Batch conversion of the texts of a document into a single wide buffer.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "WideTextBlock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "../../shims/cvtutf/Unicode.h"
+#include "Document.h"
+#include "Errors/Error.h"
+#include "Utilities/Threads.h"
+
+using namespace Bolota;
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                      Constructors and destructors                         |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Constructs an empty block.
+ */
+WideTextBlock::WideTextBlock() {
+	m_buffer = NULL;
+	m_ulSize = 0;
+}
+
+/**
+ * Frees the converted texts.
+ */
+WideTextBlock::~WideTextBlock() {
+	Clear();
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Building                                  |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Converts every text of a document, including its properties, using as many
+ * threads as it's worth for the amount of text.
+ *
+ * @param doc Document to have its texts converted.
+ *
+ * @return TRUE if the operation was successful.
+ */
+bool WideTextBlock::Build(Document *doc) {
+	return Build(doc, 0);
+}
+
+/**
+ * Converts every text of a document, including its properties.
+ *
+ * @param doc      Document to have its texts converted.
+ * @param uThreads Maximum number of threads to use. 0 uses one per processor.
+ *
+ * @return TRUE if the operation was successful.
+ */
+bool WideTextBlock::Build(Document *doc, unsigned int uThreads) {
+	Clear();
+
+	// Gather up every text in the document.
+	m_entries.reserve(CountFields(doc->FirstTopic()) + 3);
+	if (doc->Title() != NULL)
+		Collect(doc->Title(), false);
+	if (doc->SubTitle() != NULL)
+		Collect(doc->SubTitle(), false);
+	if (doc->Date() != NULL)
+		Collect(doc->Date(), false);
+	for (Field *topic = doc->FirstTopic(); topic != NULL; topic = topic->Next())
+		Collect(topic, true);
+
+	return Transcode(uThreads);
+}
+
+/**
+ * Converts the texts of a topic and all of its children, using as many threads
+ * as it's worth for the amount of text.
+ *
+ * @param topic Topic at the root of the subtree to be converted.
+ *
+ * @return TRUE if the operation was successful.
+ */
+bool WideTextBlock::Build(Field *topic) {
+	return Build(topic, 0);
+}
+
+/**
+ * Converts the texts of a topic and all of its children.
+ *
+ * @param topic    Topic at the root of the subtree to be converted.
+ * @param uThreads Maximum number of threads to use. 0 uses one per processor.
+ *
+ * @return TRUE if the operation was successful.
+ */
+bool WideTextBlock::Build(Field *topic, unsigned int uThreads) {
+	Clear();
+
+	if (topic != NULL) {
+		m_entries.reserve(1 + CountFields(topic->Child()));
+		Collect(topic, true);
+	}
+
+	return Transcode(uThreads);
+}
+
+/**
+ * Frees the converted texts and empties the block.
+ */
+void WideTextBlock::Clear() {
+	if (m_buffer != NULL)
+		free(m_buffer);
+	m_buffer = NULL;
+	m_ulSize = 0;
+
+	std::vector<Entry>().swap(m_entries);
+	std::vector<FieldSlot>().swap(m_lookup);
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                  Access                                   |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the number of texts in the block.
+ *
+ * @return Number of texts in the block.
+ */
+size_t WideTextBlock::Count() const {
+	return m_entries.size();
+}
+
+/**
+ * Gets the field that a text in the block came from. Texts are kept in
+ * document order.
+ *
+ * @param ulIndex Index of the text in the block.
+ *
+ * @return Field of the text.
+ */
+Field* WideTextBlock::FieldAt(size_t ulIndex) const {
+	return m_entries[ulIndex].field;
+}
+
+/**
+ * Gets a converted text.
+ *
+ * @warning The pointer is only valid until the block is rebuilt or cleared.
+ *
+ * @param ulIndex Index of the text in the block.
+ *
+ * @return NUL terminated wide version of the text.
+ */
+const wchar_t* WideTextBlock::TextAt(size_t ulIndex) const {
+	return m_buffer + m_entries[ulIndex].ulOffset;
+}
+
+/**
+ * Gets the length of a converted text.
+ *
+ * @param ulIndex Index of the text in the block.
+ *
+ * @return Length of the text in characters (excluding NUL terminator).
+ */
+size_t WideTextBlock::LengthAt(size_t ulIndex) const {
+	return m_entries[ulIndex].ulWide;
+}
+
+/**
+ * Finds the converted text of a field. The table used to find them is built on
+ * the first call.
+ *
+ * @warning The pointer is only valid until the block is rebuilt or cleared.
+ *
+ * @param field Field to have its text looked up.
+ *
+ * @return NUL terminated wide version of the text or NULL if the field wasn't
+ *         part of the block.
+ */
+const wchar_t* WideTextBlock::Find(const Field *field) const {
+	FieldSlot key = { field, 0 };
+	std::vector<FieldSlot>::const_iterator it;
+
+	// The lookup table is only built when it's first needed.
+	if (m_lookup.size() != m_entries.size())
+		BuildLookup();
+	it = std::lower_bound(m_lookup.begin(), m_lookup.end(), key, CompareSlots);
+	if ((it == m_lookup.end()) || (it->field != field))
+		return NULL;
+
+	return TextAt(it->ulIndex);
+}
+
+/**
+ * Gets the number of bytes allocated for the converted texts and the tables
+ * used to find them.
+ *
+ * @return Size of the block in bytes.
+ */
+size_t WideTextBlock::HeapSize() const {
+	return (m_ulSize * sizeof(wchar_t)) +
+		(m_entries.capacity() * sizeof(Entry)) +
+		(m_lookup.capacity() * sizeof(FieldSlot));
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Building Helpers                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Counts a list of sibling fields and all of their children.
+ *
+ * @param field First field of the list. Can be NULL.
+ *
+ * @return Number of fields.
+ */
+size_t WideTextBlock::CountFields(Field *field) {
+	size_t ulCount = 0;
+
+	for (; field != NULL; field = field->Next())
+		ulCount += 1 + CountFields(field->Child());
+
+	return ulCount;
+}
+
+/**
+ * Adds the text of a field to the list of texts to be converted.
+ *
+ * @param field     Field to be added.
+ * @param bChildren Should the children of the field be added as well?
+ */
+void WideTextBlock::Collect(Field *field, bool bChildren) {
+	Entry entry;
+
+	// Ropes are flattened here, since it can't be done from other threads.
+	entry.field = field;
+	entry.mbstr = NULL;
+	entry.ulLength = 0;
+	entry.ulOffset = 0;
+	entry.ulWide = 0;
+	if (field->HasText()) {
+		entry.mbstr = field->Text()->GetMultiByteString();
+		if (entry.mbstr != NULL)
+			entry.ulLength = field->Text()->Length();
+	}
+	m_entries.push_back(entry);
+
+	if (bChildren) {
+		for (Field *child = field->Child(); child != NULL;
+				child = child->Next()) {
+			Collect(child, true);
+		}
+	}
+}
+
+/**
+ * Converts every text that has been collected into a single buffer.
+ *
+ * @param uThreads Maximum number of threads to use. 0 uses one per processor.
+ *
+ * @return TRUE if the operation was successful.
+ */
+bool WideTextBlock::Transcode(unsigned int uThreads) {
+	std::vector<size_t> vecBounds;
+	std::vector<char> vecFailed;
+	size_t i;
+	Job job;
+
+	// Give every text a slot large enough for any conversion of it.
+	m_ulSize = 0;
+	for (i = 0; i < m_entries.size(); i++) {
+		m_entries[i].ulOffset = m_ulSize;
+		m_ulSize += m_entries[i].ulLength + 1;
+	}
+	m_buffer = (wchar_t *)malloc(((m_ulSize > 0) ? m_ulSize : 1) *
+		sizeof(wchar_t));
+	if (m_buffer == NULL) {
+		ThrowError(EMSG("Failed to allocate memory for wide text block"));
+		Clear();
+		return false;
+	}
+
+	// Only split the job across threads if there's enough text to go around.
+	if ((m_ulSize - m_entries.size()) < BOLOTA_WIDEBLOCK_PARALLEL_MIN) {
+		uThreads = 1;
+	} else if (uThreads == 0) {
+		uThreads = Threads::ProcessorCount();
+	}
+	Slice(vecBounds, uThreads);
+	vecFailed.assign(vecBounds.size(), 0);
+	job.entries = (m_entries.empty()) ? NULL : &m_entries[0];
+	job.buffer = m_buffer;
+	job.pulBounds = &vecBounds[0];
+	job.pcFailed = &vecFailed[0];
+
+	// Convert every text straight into its slot.
+	Threads::ParallelFor(vecBounds.size() - 1, uThreads, ConvertSlices, &job);
+	for (i = 0; i < (vecBounds.size() - 1); i++) {
+		if (job.pcFailed[i]) {
+			ThrowError(EMSG("Failed to convert UTF-8 string to wide string"));
+			Clear();
+			return false;
+		}
+	}
+
+	// Get rid of the space that wasn't needed.
+	Pack();
+
+	return true;
+}
+
+/**
+ * Splits the collected texts into slices holding about the same amount of
+ * text, so that every thread gets a fair share of the work.
+ *
+ * @param vecBounds Index of the first entry of each slice, followed by the
+ *                  number of entries.
+ * @param uThreads  Number of slices to be created.
+ */
+void WideTextBlock::Slice(std::vector<size_t>& vecBounds,
+						  unsigned int uThreads) const {
+	size_t ulTotal = 0;
+	size_t ulSoFar = 0;
+	size_t i;
+
+	for (i = 0; i < m_entries.size(); i++)
+		ulTotal += m_entries[i].ulLength + 1;
+
+	// Start a new slice every time we've gone past its share of the text.
+	vecBounds.clear();
+	vecBounds.push_back(0);
+	for (i = 0; i < m_entries.size(); i++) {
+		if ((ulSoFar * uThreads) >= (ulTotal * vecBounds.size()))
+			vecBounds.push_back(i);
+		ulSoFar += m_entries[i].ulLength + 1;
+	}
+	vecBounds.push_back(m_entries.size());
+}
+
+/**
+ * Converts the texts of a range of slices into their places in the buffer.
+ *
+ * @param ctx     Transcoding job.
+ * @param ulStart First slice to be processed.
+ * @param ulEnd   Slice after the last one to be processed.
+ */
+void WideTextBlock::ConvertSlices(void *ctx, size_t ulStart, size_t ulEnd) {
+	Job *job = (Job *)ctx;
+
+	for (size_t s = ulStart; s < ulEnd; s++) {
+		for (size_t i = job->pulBounds[s]; i < job->pulBounds[s + 1]; i++) {
+			Entry *entry = &job->entries[i];
+			wchar_t *wstr = job->buffer + entry->ulOffset;
+
+			if (entry->mbstr == NULL) {
+				*wstr = L'\0';
+			} else if (!Unicode::MultiByteToWideChar(entry->mbstr,
+					entry->ulLength, wstr, entry->ulLength + 1,
+					&entry->ulWide)) {
+				job->pcFailed[s] = 1;
+			}
+		}
+	}
+}
+
+/**
+ * Packs the converted texts together, getting rid of the unused space at the
+ * end of their slots, and trims the buffer to its final size.
+ */
+void WideTextBlock::Pack() {
+	size_t ulPos = 0;
+
+	// Pure ASCII texts fill their slots, so nothing moves until we find one
+	// that didn't.
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		Entry *entry = &m_entries[i];
+
+		if (entry->ulOffset != ulPos) {
+			memmove(m_buffer + ulPos, m_buffer + entry->ulOffset,
+				(entry->ulWide + 1) * sizeof(wchar_t));
+			entry->ulOffset = ulPos;
+		}
+		ulPos += entry->ulWide + 1;
+	}
+
+	// Give the rest of the buffer back.
+	if (ulPos < m_ulSize) {
+		wchar_t *buf = (wchar_t *)realloc(m_buffer, ((ulPos > 0) ? ulPos : 1) *
+			sizeof(wchar_t));
+		if (buf != NULL)
+			m_buffer = buf;
+		m_ulSize = ulPos;
+	}
+}
+
+/**
+ * Builds the table used to find the texts of fields.
+ */
+void WideTextBlock::BuildLookup() const {
+	m_lookup.resize(m_entries.size());
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		m_lookup[i].field = m_entries[i].field;
+		m_lookup[i].ulIndex = i;
+	}
+
+	std::sort(m_lookup.begin(), m_lookup.end(), CompareSlots);
+}
+
+/**
+ * Orders the lookup table by field.
+ *
+ * @param a First slot to be compared.
+ * @param b Second slot to be compared.
+ *
+ * @return TRUE if the first slot goes before the second one.
+ */
+bool WideTextBlock::CompareSlots(const FieldSlot& a, const FieldSlot& b) {
+	return a.field < b.field;
+}
@@ -0,0 +1,122 @@
+/**
+ * WideTextBlock.h
+ * Batch conversion of the texts of a document into a single wide buffer.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_WIDETEXTBLOCK_H
+#define _BOLOTA_WIDETEXTBLOCK_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <vector>
+
+#ifdef _WIN32
+	#if _MSC_VER <= 1200
+		#include <newcpp.h>
+	#endif // _MSC_VER == 1200
+#endif // _WIN32
+
+#include "Field.h"
+
+/**
+ * Amount of UTF-8 text (in bytes) from which a conversion is split across
+ * multiple threads. Smaller jobs aren't worth the cost of starting them.
+ */
+#define BOLOTA_WIDEBLOCK_PARALLEL_MIN (512 * 1024)
+
+namespace Bolota {
+
+	// Forward declaration.
+	class Document;
+
+	/**
+	 * Wide versions of the texts of a whole document (or a subtree of it)
+	 * converted in a single pass into one contiguous buffer, instead of having
+	 * each field convert and allocate its own wide string.
+	 *
+	 * Since a UTF-8 string never converts to more wide characters than it has
+	 * bytes, every text is given a slot of that size in a single buffer and
+	 * converted straight into it, without having to measure the conversions
+	 * beforehand. This pass can be split across threads, since every text has
+	 * a slot of its own. The slots are then packed together and the buffer
+	 * trimmed to its final size.
+	 *
+	 * The block is a snapshot. It doesn't follow changes made to the fields
+	 * afterwards, so it must be rebuilt (or cleared) once the document is
+	 * edited.
+	 */
+	class WideTextBlock {
+	protected:
+		// Text of a single field.
+		struct Entry {
+			Field *field;
+			const char *mbstr;
+			size_t ulLength;
+			size_t ulOffset;
+			size_t ulWide;
+		};
+
+		// Entry of the lookup table sorted by field.
+		struct FieldSlot {
+			const Field *field;
+			size_t ulIndex;
+		};
+
+		// Slices of a transcoding pass split across threads.
+		struct Job {
+			Entry *entries;
+			wchar_t *buffer;
+			const size_t *pulBounds;
+			char *pcFailed;
+		};
+
+		// Converted texts.
+		wchar_t *m_buffer;
+		size_t m_ulSize;
+		std::vector<Entry> m_entries;
+		mutable std::vector<FieldSlot> m_lookup;
+
+	public:
+		// Constructors and destructors.
+		WideTextBlock();
+		virtual ~WideTextBlock();
+
+		// Building.
+		bool Build(Document *doc);
+		bool Build(Document *doc, unsigned int uThreads);
+		bool Build(Field *topic);
+		bool Build(Field *topic, unsigned int uThreads);
+		void Clear();
+
+		// Access.
+		size_t Count() const;
+		Field* FieldAt(size_t ulIndex) const;
+		const wchar_t* TextAt(size_t ulIndex) const;
+		size_t LengthAt(size_t ulIndex) const;
+		const wchar_t* Find(const Field *field) const;
+		size_t HeapSize() const;
+
+	protected:
+		// Building helpers.
+		static size_t CountFields(Field *field);
+		void Collect(Field *field, bool bChildren);
+		bool Transcode(unsigned int uThreads);
+		void Slice(std::vector<size_t>& vecBounds, unsigned int uThreads) const;
+		void Pack();
+		static void ConvertSlices(void *ctx, size_t ulStart, size_t ulEnd);
+		void BuildLookup() const;
+		static bool CompareSlots(const FieldSlot& a, const FieldSlot& b);
+	};
+
+}
+
+#endif // __cplusplus
+
+#endif // _BOLOTA_WIDETEXTBLOCK_H
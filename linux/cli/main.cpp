@@ -0,0 +1,1006 @@
+/**
+ * bolota
+ * Command line utility to inspect Bolota documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "CorpusSearch.h"
+#include "Document.h"
+#include "FlatDocument.h"
+#include "Indexes/DateIndex.h"
+#include "Indexes/FacetIndex.h"
+#include "Indexes/FuzzyIndex.h"
+#include "Indexes/NotebookDateIndex.h"
+#include "Indexes/NotebookSearchIndex.h"
+#include "FieldTypes.h"
+#include "PathQuery.h"
+
+using namespace Bolota;
+
+/**
+ * Command line command definition.
+ */
+typedef struct {
+	const char *name;
+	const char *args;
+	const char *desc;
+	int (*func)(int argc, char **argv);
+} command_t;
+
+// Commands.
+int CommandStats(int argc, char **argv);
+int CommandFind(int argc, char **argv);
+int CommandGrep(int argc, char **argv);
+int CommandDates(int argc, char **argv);
+int CommandFacets(int argc, char **argv);
+int CommandJump(int argc, char **argv);
+int CommandQuery(int argc, char **argv);
+int CommandIndex(int argc, char **argv);
+
+/**
+ * List of available commands.
+ */
+static const command_t commands[] = {
+	{ "stats", "[-i] [-s] FILE",
+		"Shows where the memory used by a document goes",
+		CommandStats },
+	{ "find", "[-i] [-b] [-c] FILE PATTERN",
+		"Finds a pattern in the topics, ignoring case (-i), showing the byte "
+		"offset of each match (-b) or only counting them (-c)",
+		CommandFind },
+	{ "grep", "[-i] [-r] [-q] [-j THREADS] PATTERN PATH...",
+		"Searches documents and directories of documents (recursively with "
+		"-r) for a regular expression, ignoring case (-i) and reporting the "
+		"throughput to stderr unless quiet (-q)",
+		CommandGrep },
+	{ "dates", "[-r] [-n COUNT] PATH [FROM [TO]]",
+		"Lists the date topics of a document or a directory of documents "
+		"(recursively with -r) between two dates (YYYY-MM-DD[THH:MM:SS]) or "
+		"the latest COUNT of them",
+		CommandDates },
+	{ "facets", "[-a] [-c] FILE [ICON [PARENT]]",
+		"Counts the topics of a document by type and icon or lists the ones "
+		"with an icon (name or number), optionally only those right under a "
+		"topic with another icon or anywhere under one (-a), or only counts "
+		"them (-c)",
+		CommandFacets },
+	{ "jump", "[-n COUNT] [-j THREADS] FILE QUERY",
+		"Lists the topics that best match a fuzzy query, with the matched "
+		"characters in brackets, and reports the search time to stderr",
+		CommandJump },
+	{ "query", "[-f] [-c] FILE QUERY",
+		"Lists the topics selected by a path query such as "
+		"/Projects/*/[icon=check] or //[type=date][year=2025]/.., reading the "
+		"document into a flat array of topics (-f) or only counting them (-c)",
+		CommandQuery },
+	{ "index", "[-r] [-u] [-n COUNT] DIR [QUERY]",
+		"Refreshes the search index kept in a directory of documents "
+		"(recursively with -r) or lists the first COUNT topics that have "
+		"every word of a query, refreshing it first with -u, and reports the "
+		"time it took to stderr",
+		CommandIndex },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/**
+ * Prints the usage message of the utility.
+ *
+ * @param szProgram Name of the executable.
+ */
+void Usage(const char *szProgram) {
+	printf("Usage: %s COMMAND [ARGS...]" LINEND LINEND, szProgram);
+	printf("Commands:" LINEND);
+	for (const command_t *cmd = commands; cmd->name != NULL; cmd++) {
+		printf("  %s %s" LINEND, cmd->name, cmd->args);
+		printf("      %s" LINEND, cmd->desc);
+	}
+}
+
+/**
+ * Converts a command line argument into the native string type of the library,
+ * which is a wide string in UNICODE builds.
+ *
+ * @param szString UTF-8 encoded string.
+ *
+ * @return Native version of the string.
+ */
+tstring Native(const char *szString) {
+#ifdef UNICODE
+	wchar_t *wstr = UString::ToWideString(szString);
+	if (wstr == NULL)
+		return tstring();
+
+	tstring str(wstr);
+	free(wstr);
+	return str;
+#else
+	return tstring(szString);
+#endif // UNICODE
+}
+
+/**
+ * Converts a native string from the library into an UTF-8 one that can be
+ * printed.
+ *
+ * @param szString Native string.
+ *
+ * @return UTF-8 encoded version of the string.
+ */
+std::string MultiByte(LPCTSTR szString) {
+#ifdef UNICODE
+	char *mbstr = UString::ToMultiByteString(szString);
+	if (mbstr == NULL)
+		return std::string();
+
+	std::string str(mbstr);
+	free(mbstr);
+	return str;
+#else
+	return std::string(szString);
+#endif // UNICODE
+}
+
+/**
+ * Prints the errors that are waiting on the error stack and clears it.
+ *
+ * @return Error return code of the application.
+ */
+int PrintErrors() {
+	for (Error *err = ErrorStack::Top(); err != NULL; err = err->Previous())
+		fprintf(stderr, "Error: %s" LINEND, MultiByte(err->Message()).c_str());
+	ErrorStack::Instance()->Clear();
+
+	return 1;
+}
+
+/**
+ * Prints a single line of the memory statistics.
+ *
+ * @param szLabel Description of the value.
+ * @param ulBytes Number of bytes.
+ * @param ulTotal Total number of bytes, used to calculate the percentage.
+ */
+void PrintMemoryLine(const char *szLabel, size_t ulBytes, size_t ulTotal) {
+	printf("  %-12s %12zu  %5.1f%%" LINEND, szLabel, ulBytes,
+		(ulTotal > 0) ? (ulBytes * 100.0) / ulTotal : 0.0);
+}
+
+/**
+ * Shows a breakdown of the memory used by a document once it's loaded.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandStats(int argc, char **argv) {
+	bolota_text_mode_t mode = BOLOTA_TEXT_LENIENT;
+	bool bIntern = false;
+	const char *szPath = NULL;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-i") == 0) {
+			bIntern = true;
+		} else if (strcmp(argv[i], "-s") == 0) {
+			mode = BOLOTA_TEXT_STRICT;
+		} else {
+			szPath = argv[i];
+		}
+	}
+	if (szPath == NULL) {
+		fprintf(stderr, "No document file specified" LINEND);
+		return 1;
+	}
+
+	// Load the document.
+	Document *doc = Document::ReadFile(Native(szPath).c_str(), bIntern, mode);
+	if (doc == BOLOTA_ERR_NULL)
+		return PrintErrors();
+	bolota_mem_stats_t stats = doc->MemoryStats();
+
+	// Field counts, with the names as wide as the longest one.
+	printf("Fields: %zu" LINEND, stats.fields);
+	std::vector<FieldType*>& types = FieldTypeList::List();
+	int iWidth = 12;
+	for (size_t i = 0; i < types.size(); i++) {
+		int iLength = (int)strlen(types[i]->name->GetMultiByteString());
+		if (iLength > iWidth)
+			iWidth = iLength;
+	}
+	for (size_t i = 0; i < types.size(); i++) {
+		printf("  %-*s %12zu" LINEND, iWidth,
+			types[i]->name->GetMultiByteString(),
+			stats.types[(uint8_t)types[i]->code]);
+		stats.types[(uint8_t)types[i]->code] = 0;
+	}
+	for (size_t i = 0; i < 256; i++) {
+		if (stats.types[i] > 0) {
+			char szType[16];
+			snprintf(szType, sizeof(szType), "Type 0x%02zX", i);
+			printf("  %-*s %12zu" LINEND, iWidth, szType, stats.types[i]);
+		}
+	}
+
+	// Memory breakdown.
+	printf(LINEND "Memory (bytes):" LINEND);
+	PrintMemoryLine("Nodes", stats.nodes, stats.total);
+	PrintMemoryLine("Text", stats.text, stats.total);
+	PrintMemoryLine("Wide text", stats.wide, stats.total);
+	PrintMemoryLine("Indexes", stats.indexes, stats.total);
+	PrintMemoryLine("Errors", stats.errors, stats.total);
+	PrintMemoryLine("Slack", stats.slack, stats.total);
+	PrintMemoryLine("Total", stats.total, stats.total);
+	printf("  %-12s %12zu" LINEND, "Shared text", stats.shared);
+
+	delete doc;
+	return 0;
+}
+
+/**
+ * Prints the outline path of a topic.
+ *
+ * @param field Topic to have its path printed.
+ */
+void PrintTopicPath(Field *field) {
+	std::vector<Field*> vecPath;
+
+	Document::TopicPath(field, vecPath);
+	for (size_t i = 0; i < vecPath.size(); i++) {
+		printf("%s%s", (i > 0) ? " > " : "", vecPath[i]->HasText() ?
+			vecPath[i]->Text()->GetMultiByteString() : "");
+	}
+	printf(LINEND);
+}
+
+/**
+ * Finds a literal pattern in the topics of a document and prints the path of
+ * each topic where it was found.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandFind(int argc, char **argv) {
+	std::vector<TopicMatch> vecMatches;
+	bool bIgnoreCase = false;
+	bool bOffsets = false;
+	bool bCount = false;
+	const char *szPath = NULL;
+	const char *szPattern = NULL;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-i") == 0) {
+			bIgnoreCase = true;
+		} else if (strcmp(argv[i], "-b") == 0) {
+			bOffsets = true;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			bCount = true;
+		} else if (szPath == NULL) {
+			szPath = argv[i];
+		} else {
+			szPattern = argv[i];
+		}
+	}
+	if ((szPath == NULL) || (szPattern == NULL)) {
+		fprintf(stderr, "No document file or pattern specified" LINEND);
+		return 1;
+	}
+
+	// Load the document and search it.
+	Document *doc = Document::ReadFile(Native(szPath).c_str());
+	if (doc == BOLOTA_ERR_NULL)
+		return PrintErrors();
+	doc->Find(szPattern, bIgnoreCase, vecMatches);
+
+	// Print out the matches.
+	if (bCount) {
+		printf("%zu" LINEND, vecMatches.size());
+	} else {
+		for (size_t i = 0; i < vecMatches.size(); i++) {
+			// Only show each topic once unless we want every offset.
+			if (bOffsets) {
+				printf("%u: ", vecMatches[i].offset);
+			} else if ((i > 0) &&
+					(vecMatches[i].field == vecMatches[i - 1].field)) {
+				continue;
+			}
+
+			PrintTopicPath(vecMatches[i].field);
+		}
+	}
+
+	delete doc;
+	return vecMatches.empty() ? 1 : 0;
+}
+
+/**
+ * Prints a topic that matched a corpus search along with its outline path.
+ *
+ * @param ctx Unused.
+ * @param hit Topic that matched.
+ */
+void PrintCorpusHit(void *ctx, const bolota_corpus_hit_t *hit) {
+	printf("%s: ", MultiByte(hit->szFile).c_str());
+	for (uint8_t i = 0; i <= hit->depth; i++) {
+		printf("%s%.*s", (i > 0) ? " > " : "", (int)hit->lengths[i],
+			hit->texts[i]);
+	}
+	printf(LINEND);
+}
+
+/**
+ * Gets the current time in seconds.
+ *
+ * @return Seconds since the epoch.
+ */
+double Now() {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/**
+ * Searches a whole bunch of documents for a regular expression and prints the
+ * path of each topic where it was found.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandGrep(int argc, char **argv) {
+	CorpusSearch search;
+	std::vector<const char*> vecPaths;
+	bool bIgnoreCase = false;
+	bool bRecursive = false;
+	bool bQuiet = false;
+	unsigned int uThreads = 0;
+	const char *szPattern = NULL;
+	struct stat st;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-i") == 0) {
+			bIgnoreCase = true;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			bRecursive = true;
+		} else if (strcmp(argv[i], "-q") == 0) {
+			bQuiet = true;
+		} else if ((strcmp(argv[i], "-j") == 0) && ((i + 1) < argc)) {
+			uThreads = (unsigned int)atoi(argv[++i]);
+		} else if (szPattern == NULL) {
+			szPattern = argv[i];
+		} else {
+			vecPaths.push_back(argv[i]);
+		}
+	}
+	if ((szPattern == NULL) || vecPaths.empty()) {
+		fprintf(stderr, "No pattern or document path specified" LINEND);
+		return 1;
+	}
+
+	// Set everything up.
+	if (!search.SetPattern(szPattern, bIgnoreCase))
+		return PrintErrors();
+	for (size_t i = 0; i < vecPaths.size(); i++) {
+		tstring strPath = Native(vecPaths[i]);
+		if ((stat(vecPaths[i], &st) == 0) && S_ISDIR(st.st_mode)) {
+			if (search.AddDirectory(strPath.c_str(), bRecursive) ==
+					BOLOTA_ERR_SIZET) {
+				return PrintErrors();
+			}
+		} else {
+			search.AddFile(strPath.c_str());
+		}
+	}
+
+	// Search the documents.
+	double dStart = Now();
+	bolota_corpus_stats_t stats = search.Run(uThreads, PrintCorpusHit, NULL);
+	double dElapsed = Now() - dStart;
+
+	// Report the documents that couldn't be read and the throughput.
+	const std::vector<size_t>& vecFailed = search.FailedFiles();
+	for (size_t i = 0; i < vecFailed.size(); i++) {
+		fprintf(stderr, "Error: Could not read document %s" LINEND,
+			MultiByte(search.File(vecFailed[i])).c_str());
+	}
+	if (!bQuiet) {
+		if (dElapsed <= 0)
+			dElapsed = 0.000001;
+		fprintf(stderr, "%zu files (%zu failed), %zu topics, %zu matches in "
+			"%.3fs: %.0f files/s, %.1f MB/s" LINEND, stats.files,
+			stats.failed, stats.topics, stats.hits, dElapsed,
+			(stats.files + stats.failed) / dElapsed,
+			(stats.bytes / (1024.0 * 1024.0)) / dElapsed);
+	}
+
+	if (!vecFailed.empty())
+		return 2;
+	return (stats.hits > 0) ? 0 : 1;
+}
+
+/**
+ * Parses a timestamp in the YYYY-MM-DD[THH:MM:SS] format.
+ *
+ * @param szDate Text to be parsed.
+ * @param bEnd   Should a missing time be the end of the day?
+ * @param ts     Timestamp to be filled in.
+ *
+ * @return TRUE if the text was a valid timestamp.
+ */
+bool ParseTimestamp(const char *szDate, bool bEnd, timestamp_t *ts) {
+	unsigned int year, month, day;
+	unsigned int hour = 0;
+	unsigned int minute = 0;
+	unsigned int second = 0;
+	char sep;
+
+	int iFields = sscanf(szDate, "%u-%u-%u%c%u:%u:%u", &year, &month, &day,
+		&sep, &hour, &minute, &second);
+	if (iFields == 3) {
+		if (bEnd) {
+			hour = 23;
+			minute = 59;
+			second = 59;
+		}
+	} else if ((iFields != 7) || ((sep != 'T') && (sep != ' '))) {
+		return false;
+	}
+
+	ts->year = (uint16_t)year;
+	ts->month = (uint8_t)month;
+	ts->day = (uint8_t)day;
+	ts->hour = (uint8_t)hour;
+	ts->minute = (uint8_t)minute;
+	ts->second = (uint8_t)second;
+	ts->reserved = 0;
+
+	return true;
+}
+
+/**
+ * Prints a timestamp in the YYYY-MM-DD HH:MM:SS format.
+ *
+ * @param ts Timestamp to be printed.
+ */
+void PrintTimestamp(const timestamp_t *ts) {
+	printf("%04u-%02u-%02u %02u:%02u:%02u", ts->year, ts->month, ts->day,
+		ts->hour, ts->minute, ts->second);
+}
+
+/**
+ * Lists the date topics of a document or a whole directory of them, either
+ * in a range of time or the most recent ones.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandDates(int argc, char **argv) {
+	timestamp_t from;
+	timestamp_t to;
+	bool bRecursive = false;
+	bool bRange = false;
+	size_t ulCount = 10;
+	std::vector<const char*> vecArgs;
+	struct stat st;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0) {
+			bRecursive = true;
+		} else if ((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc)) {
+			ulCount = (size_t)atol(argv[++i]);
+		} else {
+			vecArgs.push_back(argv[i]);
+		}
+	}
+	if (vecArgs.empty() || (vecArgs.size() > 3)) {
+		fprintf(stderr, "No document path specified" LINEND);
+		return 1;
+	}
+
+	// Get the range of time.
+	if (vecArgs.size() > 1) {
+		bRange = true;
+		if (!ParseTimestamp(vecArgs[1], false, &from)) {
+			fprintf(stderr, "Invalid date '%s'" LINEND, vecArgs[1]);
+			return 1;
+		}
+
+		to.year = 0xFFFF;
+		to.month = 12;
+		to.day = 31;
+		to.hour = 23;
+		to.minute = 59;
+		to.second = 59;
+		if ((vecArgs.size() > 2) && !ParseTimestamp(vecArgs[2], true, &to)) {
+			fprintf(stderr, "Invalid date '%s'" LINEND, vecArgs[2]);
+			return 1;
+		}
+	}
+
+	if ((stat(vecArgs[0], &st) == 0) && S_ISDIR(st.st_mode)) {
+		std::vector<DatedTopic> vecResults;
+		NotebookDateIndex index;
+
+		// Go through the whole notebook.
+		tstring strPath = Native(vecArgs[0]);
+		if (index.Build(strPath.c_str(), bRecursive) == BOLOTA_ERR_SIZET)
+			return PrintErrors();
+		if (bRange) {
+			index.Between(&from, &to, vecResults);
+		} else {
+			index.Latest(ulCount, vecResults);
+		}
+
+		for (size_t i = 0; i < vecResults.size(); i++) {
+			PrintTimestamp(&vecResults[i].timestamp);
+			printf("  %s: %s" LINEND,
+				MultiByte(index.File(vecResults[i].file)).c_str(),
+				vecResults[i].text);
+		}
+
+		const std::vector<size_t>& vecFailed = index.FailedFiles();
+		for (size_t i = 0; i < vecFailed.size(); i++) {
+			fprintf(stderr, "Error: Could not read document %s" LINEND,
+				MultiByte(index.File(vecFailed[i])).c_str());
+		}
+
+		return vecResults.empty() ? 1 : 0;
+	} else {
+		std::vector<DateField*> vecResults;
+		DateIndex index;
+
+		// Load the document and index its dates.
+		Document *doc = Document::ReadFile(Native(vecArgs[0]).c_str());
+		if (doc == BOLOTA_ERR_NULL)
+			return PrintErrors();
+		doc->AttachIndex(&index);
+		if (bRange) {
+			index.Between(&from, &to, vecResults);
+		} else {
+			index.Latest(ulCount, vecResults);
+		}
+
+		for (size_t i = 0; i < vecResults.size(); i++) {
+			timestamp_t ts = vecResults[i]->Timestamp();
+			PrintTimestamp(&ts);
+			printf("  ");
+			PrintTopicPath(vecResults[i]);
+		}
+
+		doc->DetachIndex(&index);
+		delete doc;
+		return vecResults.empty() ? 1 : 0;
+	}
+}
+
+/**
+ * Names of the icons of icon topics, in the order of their indexes.
+ */
+static const char *szIconNames[BOLOTA_FIELD_ICON_NUM + 1] = {
+	"none", "battery", "box", "calendar", "camera", "check", "clipboard",
+	"clock", "cpu", "find", "folder", "gear", "help", "history", "laptop",
+	"light", "love", "men", "money", "movie", "plus", "redo", "remove",
+	"signpost", "sound", "star", "stop", "tags", "trash", "undo", "woman",
+	"wrench"
+};
+
+/**
+ * Parses the name or the number of an icon.
+ *
+ * @param szIcon Name or number of the icon.
+ * @param icon   Pointer to the icon to be populated.
+ *
+ * @return TRUE if the icon is valid.
+ */
+bool ParseIcon(const char *szIcon, field_icon_t *icon) {
+	char *szEnd;
+
+	// Icon names.
+	for (int i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++) {
+		if (strcmp(szIcon, szIconNames[i]) == 0) {
+			*icon = (field_icon_t)i;
+			return true;
+		}
+	}
+
+	// Icon numbers.
+	long lIndex = strtol(szIcon, &szEnd, 10);
+	if ((*szIcon == '\0') || (*szEnd != '\0') || (lIndex < 0) ||
+			(lIndex > BOLOTA_FIELD_ICON_NUM)) {
+		return false;
+	}
+
+	*icon = (field_icon_t)lIndex;
+	return true;
+}
+
+/**
+ * Counts the topics of a document by their type and icon, or lists the ones
+ * with an icon that are under topics with another one.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandFacets(int argc, char **argv) {
+	std::vector<const char*> vecArgs;
+	bool bAncestors = false;
+	bool bCount = false;
+	field_icon_t icon;
+	field_icon_t parent;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-a") == 0) {
+			bAncestors = true;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			bCount = true;
+		} else {
+			vecArgs.push_back(argv[i]);
+		}
+	}
+	if (vecArgs.empty() || (vecArgs.size() > 3)) {
+		fprintf(stderr, "No document file specified" LINEND);
+		return 1;
+	}
+	for (size_t i = 1; i < vecArgs.size(); i++) {
+		if (!ParseIcon(vecArgs[i], (i == 1) ? &icon : &parent)) {
+			fprintf(stderr, "Invalid icon '%s'" LINEND, vecArgs[i]);
+			return 1;
+		}
+	}
+
+	// Load the document and index its facets.
+	Document *doc = Document::ReadFile(Native(vecArgs[0]).c_str());
+	if (doc == BOLOTA_ERR_NULL)
+		return PrintErrors();
+	FacetIndex index;
+	doc->AttachIndex(&index);
+
+	// Just count everything.
+	if (vecArgs.size() == 1) {
+		printf("%u topics: %u text, %u icon, %u date" LINEND, index.Count(),
+			index.OfType(BOLOTA_TYPE_TEXT).Count(),
+			index.OfType(BOLOTA_TYPE_ICON).Count(),
+			index.OfType(BOLOTA_TYPE_DATE).Count());
+		for (int i = 0; i <= BOLOTA_FIELD_ICON_NUM; i++) {
+			uint32_t count = index.WithIcon((field_icon_t)i).Count();
+			if (count > 0)
+				printf("  %-10s %u" LINEND, szIconNames[i], count);
+		}
+
+		doc->DetachIndex(&index);
+		delete doc;
+		return 0;
+	}
+
+	// Filter the topics.
+	Bitmap result;
+	if (vecArgs.size() > 2) {
+		if (bAncestors) {
+			index.Descendants(index.WithIcon(parent), result);
+		} else {
+			index.Children(index.WithIcon(parent), result);
+		}
+		result.And(index.WithIcon(icon));
+	} else {
+		result = index.WithIcon(icon);
+	}
+
+	// Print out the results.
+	if (bCount) {
+		printf("%u" LINEND, result.Count());
+	} else {
+		std::vector<Field*> vecFields;
+		index.Fields(result, vecFields);
+		for (size_t i = 0; i < vecFields.size(); i++)
+			PrintTopicPath(vecFields[i]);
+	}
+
+	doc->DetachIndex(&index);
+	delete doc;
+	return result.IsEmpty() ? 1 : 0;
+}
+
+/**
+ * Prints the text of a topic with the characters of a fuzzy match in
+ * brackets.
+ *
+ * @param match Match to be printed.
+ */
+void PrintFuzzyMatch(const FuzzyMatch& match) {
+	const char *mbstr = "";
+	size_t ulLength = 0;
+	uint8_t i = 0;
+
+	if (match.field->HasText()) {
+		mbstr = match.field->Text()->GetMultiByteString();
+		ulLength = match.field->TextLength();
+	}
+
+	printf("%5d  ", match.score);
+	for (size_t ulPos = 0; ulPos < ulLength; ulPos++) {
+		// Open the brackets at the start of a matched character.
+		bool bMatched = (i < match.count) && (match.positions[i] == ulPos);
+		if (bMatched) {
+			putchar('[');
+			i++;
+		}
+
+		// Print the whole character before closing them.
+		putchar(mbstr[ulPos]);
+		while (((ulPos + 1) < ulLength) &&
+				((mbstr[ulPos + 1] & 0xC0) == 0x80)) {
+			putchar(mbstr[++ulPos]);
+		}
+		if (bMatched)
+			putchar(']');
+	}
+	printf(LINEND);
+}
+
+/**
+ * Finds the topics of a document that best match a fuzzy query, the way a
+ * quick jump dialog would.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandJump(int argc, char **argv) {
+	std::vector<const char*> vecArgs;
+	std::vector<FuzzyMatch> vecResults;
+	size_t ulCount = 20;
+	unsigned int uThreads = 0;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if ((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc)) {
+			ulCount = (size_t)atol(argv[++i]);
+		} else if ((strcmp(argv[i], "-j") == 0) && ((i + 1) < argc)) {
+			uThreads = (unsigned int)atoi(argv[++i]);
+		} else {
+			vecArgs.push_back(argv[i]);
+		}
+	}
+	if (vecArgs.size() != 2) {
+		fprintf(stderr, "No document file or query specified" LINEND);
+		return 1;
+	}
+
+	// Load the document and index its topics.
+	Document *doc = Document::ReadFile(Native(vecArgs[0]).c_str());
+	if (doc == BOLOTA_ERR_NULL)
+		return PrintErrors();
+	FuzzyIndex index;
+	doc->AttachIndex(&index);
+
+	// Search for the query.
+	double dStart = Now();
+	index.Search(vecArgs[1], ulCount, uThreads, vecResults);
+	double dElapsed = Now() - dStart;
+
+	for (size_t i = 0; i < vecResults.size(); i++)
+		PrintFuzzyMatch(vecResults[i]);
+	fprintf(stderr, "%zu of %zu topics in %.3fms" LINEND, vecResults.size(),
+		index.Count(), dElapsed * 1000);
+
+	doc->DetachIndex(&index);
+	delete doc;
+	return vecResults.empty() ? 1 : 0;
+}
+
+/**
+ * Prints the outline path of a topic of a flattened document.
+ *
+ * @param doc   Document the topic belongs to.
+ * @param index Pre-order index of the topic.
+ */
+void PrintFlatTopicPath(const FlatDocument *doc, uint32_t index) {
+	std::vector<uint32_t> vecPath;
+
+	for (; index != BOLOTA_FLAT_NONE; index = doc->Parent(index))
+		vecPath.push_back(index);
+	for (size_t i = vecPath.size(); i > 0; i--) {
+		printf("%s%s", (i < vecPath.size()) ? " > " : "",
+			doc->Text(vecPath[i - 1]));
+	}
+	printf(LINEND);
+}
+
+/**
+ * Lists the topics of a document that are selected by a path query.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandQuery(int argc, char **argv) {
+	std::vector<const char*> vecArgs;
+	bool bFlat = false;
+	bool bCount = false;
+	PathQuery query;
+	size_t ulCount;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0) {
+			bFlat = true;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			bCount = true;
+		} else {
+			vecArgs.push_back(argv[i]);
+		}
+	}
+	if (vecArgs.size() != 2) {
+		fprintf(stderr, "No document file or query specified" LINEND);
+		return 1;
+	}
+	if (!query.Compile(vecArgs[1]))
+		return PrintErrors();
+
+	if (bFlat) {
+		std::vector<uint32_t> vecResults;
+
+		// Query the flattened document.
+		FlatDocument *doc = FlatDocument::ReadFile(Native(vecArgs[0]).c_str());
+		if (doc == BOLOTA_ERR_NULL)
+			return PrintErrors();
+		ulCount = query.Run(doc, vecResults);
+		for (size_t i = 0; !bCount && (i < vecResults.size()); i++)
+			PrintFlatTopicPath(doc, vecResults[i]);
+
+		delete doc;
+	} else {
+		std::vector<Field*> vecResults;
+
+		// Query the tree of topics.
+		Document *doc = Document::ReadFile(Native(vecArgs[0]).c_str());
+		if (doc == BOLOTA_ERR_NULL)
+			return PrintErrors();
+		ulCount = query.Run(doc, vecResults);
+		for (size_t i = 0; !bCount && (i < vecResults.size()); i++)
+			PrintTopicPath(vecResults[i]);
+
+		delete doc;
+	}
+
+	if (bCount)
+		printf("%zu" LINEND, ulCount);
+	return (ulCount > 0) ? 0 : 1;
+}
+
+/**
+ * Refreshes the search index of a notebook or searches it for topics that have
+ * every word of a query.
+ *
+ * @param argc Number of command arguments.
+ * @param argv Command arguments.
+ *
+ * @return Application's return code.
+ */
+int CommandIndex(int argc, char **argv) {
+	std::vector<const char*> vecArgs;
+	std::vector<NotebookHit> vecResults;
+	NotebookSearchIndex index;
+	bool bRecursive = false;
+	bool bRefresh = false;
+	size_t ulCount = 20;
+
+	// Parse the arguments.
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0) {
+			bRecursive = true;
+		} else if (strcmp(argv[i], "-u") == 0) {
+			bRefresh = true;
+		} else if ((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc)) {
+			ulCount = (size_t)atol(argv[++i]);
+		} else {
+			vecArgs.push_back(argv[i]);
+		}
+	}
+	if (vecArgs.empty() || (vecArgs.size() > 2)) {
+		fprintf(stderr, "No notebook directory specified" LINEND);
+		return 1;
+	}
+
+	// Bring the index up to date.
+	if (bRefresh || (vecArgs.size() == 1)) {
+		double dStart = Now();
+		size_t ulRead = index.Refresh(Native(vecArgs[0]).c_str(), bRecursive);
+		double dElapsed = Now() - dStart;
+		if (ulRead == BOLOTA_ERR_SIZET)
+			return PrintErrors();
+
+		const std::vector<size_t>& vecFailed = index.FailedFiles();
+		for (size_t i = 0; i < vecFailed.size(); i++) {
+			fprintf(stderr, "Error: Could not read document %s" LINEND,
+				MultiByte(index.File(vecFailed[i]).c_str()).c_str());
+		}
+		fprintf(stderr, "%zu of %zu documents read in %.3fms, %zu terms, "
+			"%zu postings, %zu bytes" LINEND, ulRead, index.FileCount(),
+			dElapsed * 1000, index.TermCount(), index.PostingCount(),
+			index.FileSize());
+		if (vecArgs.size() == 1)
+			return 0;
+	}
+
+	// Search for the query straight from the index file.
+	double dStart = Now();
+	if (!index.IsOpen() && !index.Open(Native(vecArgs[0]).c_str()))
+		return PrintErrors();
+	index.Search(vecArgs[1], vecResults);
+	double dElapsed = Now() - dStart;
+
+	// Show the topics, reading each document only once.
+	FlatDocument *doc = NULL;
+	for (size_t i = 0; (i < vecResults.size()) && (i < ulCount); i++) {
+		tstring strPath = index.File(vecResults[i].file);
+		if ((i == 0) || (vecResults[i].file != vecResults[i - 1].file)) {
+			if (doc != NULL)
+				delete doc;
+			doc = FlatDocument::ReadFile(strPath.c_str());
+			if (doc == BOLOTA_ERR_NULL)
+				ErrorStack::Instance()->Clear();
+		}
+
+		printf("%s: ", MultiByte(strPath.c_str()).c_str());
+		if ((doc != NULL) && (vecResults[i].topic < doc->Count())) {
+			PrintFlatTopicPath(doc, vecResults[i].topic);
+		} else {
+			printf("topic %u" LINEND, vecResults[i].topic);
+		}
+	}
+	if (doc != NULL)
+		delete doc;
+	fprintf(stderr, "%zu topics in %zu documents in %.3fms" LINEND,
+		vecResults.size(), index.FileCount(), dElapsed * 1000);
+
+	return vecResults.empty() ? 1 : 0;
+}
+
+/**
+ * Application's main entry point
+ *
+ * @param argc Number of command-line arguments passed to the application.
+ * @param argv Command-line arguments.
+ *
+ * @return Application's return code.
+ */
+int main(int argc, char **argv) {
+	// Check if we have a command to run.
+	if (argc < 2) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	// Find the command and run it.
+	for (const command_t *cmd = commands; cmd->name != NULL; cmd++) {
+		if (strcmp(cmd->name, argv[1]) == 0)
+			return cmd->func(argc - 2, argv + 2);
+	}
+
+	fprintf(stderr, "Unknown command '%s'" LINEND LINEND, argv[1]);
+	Usage(argv[0]);
+	return 1;
+}
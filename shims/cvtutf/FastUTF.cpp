@@ -0,0 +1,2134 @@
+/**
+ * FastUTF.cpp
+ * Vectorized fast paths for the UTF-8 <-> UTF-16/32 conversions of CVTUTF.
+ *
+ * These functions have exactly the same interface and results as the ones in
+ * ConvertUTF.h. Runs of ASCII characters are converted in blocks using SIMD
+ * instructions (picked at runtime from what the processor supports) and
+ * well-formed multi-byte sequences are handled by a streamlined scalar loop.
+ * Anything out of the ordinary (malformed input, truncated sequences, not
+ * enough room in the output buffer) is handed over to the reference
+ * implementation from the position where it was found, so that errors are
+ * reported in exactly the same way.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "FastUTF.h"
+
+#include <string.h>
+
+#if defined(FASTUTF_HAS_SSE2)
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif // _MSC_VER
+	#include <emmintrin.h>
+#endif // FASTUTF_HAS_SSE2
+#if defined(FASTUTF_HAS_AVX2)
+	#include <immintrin.h>
+#endif // FASTUTF_HAS_AVX2
+
+/**
+ * Allows the compiler to emit instructions for a specific extension in a single
+ * function without having to enable it for the whole project.
+ */
+#ifdef __GNUC__
+	#define FASTUTF_TARGET_SSE2 __attribute__((target("sse2")))
+	#define FASTUTF_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define FASTUTF_TARGET_SSE2
+	#define FASTUTF_TARGET_AVX2
+#endif // __GNUC__
+
+namespace Unicode {
+
+/**
+ * Converts as many ASCII characters as possible from the start of a UTF-8
+ * buffer. Stops at the first non-ASCII byte, at the end of the input or when
+ * the output buffer doesn't have enough room for another block.
+ */
+typedef void (*AsciiRun8Func)(const UTF8** sourceStart, const UTF8* sourceEnd,
+	UTF16** targetStart, UTF16* targetEnd);
+
+/**
+ * Converts as many ASCII characters as possible from the start of a UTF-16
+ * buffer. Stops at the first non-ASCII unit, at the end of the input or when
+ * the output buffer doesn't have enough room for another block.
+ */
+typedef void (*AsciiRun16Func)(const UTF16** sourceStart,
+	const UTF16* sourceEnd, UTF8** targetStart, UTF8* targetEnd);
+
+/**
+ * Counts the number of UTF-16 units needed to hold the conversion of a UTF-8
+ * buffer.
+ */
+typedef size_t (*Length8Func)(const UTF8* sourceStart, const UTF8* sourceEnd);
+
+/**
+ * Counts the number of bytes needed to hold the conversion of a UTF-16 buffer
+ * to UTF-8.
+ */
+typedef size_t (*Length16Func)(const UTF16* sourceStart,
+	const UTF16* sourceEnd);
+
+/**
+ * Same as AsciiRun8Func but converting to UTF-32.
+ */
+typedef void (*AsciiRun8to32Func)(const UTF8** sourceStart,
+	const UTF8* sourceEnd, UTF32** targetStart, UTF32* targetEnd);
+
+/**
+ * Same as AsciiRun16Func but converting from UTF-32.
+ */
+typedef void (*AsciiRun32Func)(const UTF32** sourceStart,
+	const UTF32* sourceEnd, UTF8** targetStart, UTF8* targetEnd);
+
+/**
+ * Finds the first occurrence of a pattern in a UTF-8 buffer.
+ */
+typedef const UTF8* (*Find8Func)(const UTF8* sourceStart,
+	const UTF8* sourceEnd, const UTF8* pattern, size_t patternLength,
+	bool bFoldCase);
+
+/**
+ * Functions that make up a conversion kernel.
+ */
+typedef struct {
+	ConversionKernel kernel;
+	AsciiRun8Func pfnAsciiRun8;
+	AsciiRun16Func pfnAsciiRun16;
+	Length8Func pfnLength8;
+	Length16Func pfnLength16;
+	AsciiRun8to32Func pfnAsciiRun8to32;
+	AsciiRun32Func pfnAsciiRun32;
+	Length8Func pfnLength8to32;
+	Length8Func pfnValidLength8;
+	Find8Func pfnFind8;
+} KernelTable;
+
+/**
+ * Counts the number of trailing zero bits in a mask.
+ *
+ * @param mask Mask to be checked. Must not be zero.
+ *
+ * @return Index of the lowest bit that is set.
+ */
+static inline unsigned int CountTrailingZeros(UTF32 mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#elif defined(FASTUTF_HAS_SSE2)
+	unsigned long ulIndex;
+	_BitScanForward(&ulIndex, mask);
+	return ulIndex;
+#else
+	unsigned int uiIndex = 0;
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		uiIndex++;
+	}
+
+	return uiIndex;
+#endif
+}
+
+/**
+ * Gets the smallest of two lengths.
+ *
+ * @param a First length.
+ * @param b Second length.
+ *
+ * @return Smallest length.
+ */
+static inline size_t Shortest(size_t a, size_t b) {
+	return (a < b) ? a : b;
+}
+
+/**
+ * Checks the multi-byte UTF-8 sequence at the start of a buffer, following the
+ * same rules as isLegalUTF8.
+ *
+ * @param sourceStart Start of the sequence. Must not be an ASCII character.
+ * @param sourceEnd   End of the input.
+ * @param pbValid     Set to whether the sequence is well-formed.
+ *
+ * @return Length of the sequence if it's well-formed, otherwise the length of
+ *         its maximal subpart (the longest prefix of a well-formed sequence,
+ *         or 1) which is what gets replaced by a single U+FFFD.
+ */
+static size_t CheckSequence(const UTF8* sourceStart, const UTF8* sourceEnd,
+							bool* pbValid) {
+	UTF8 ch = *sourceStart;
+	UTF8 lo = 0x80;
+	UTF8 hi = 0xBF;
+	size_t ulLength;
+	size_t i;
+
+	// Get the length and the range of the second byte from the lead byte.
+	*pbValid = false;
+	if ((ch >= 0xC2) && (ch <= 0xDF)) {
+		ulLength = 2;
+	} else if ((ch >= 0xE0) && (ch <= 0xEF)) {
+		ulLength = 3;
+		if (ch == 0xE0) {
+			lo = 0xA0;
+		} else if (ch == 0xED) {
+			hi = 0x9F;
+		}
+	} else if ((ch >= 0xF0) && (ch <= 0xF4)) {
+		ulLength = 4;
+		if (ch == 0xF0) {
+			lo = 0x90;
+		} else if (ch == 0xF4) {
+			hi = 0x8F;
+		}
+	} else {
+		return 1;
+	}
+
+	// Check the continuation bytes.
+	if (((sourceEnd - sourceStart) < 2) || (sourceStart[1] < lo) ||
+			(sourceStart[1] > hi)) {
+		return 1;
+	}
+	for (i = 2; i < ulLength; i++) {
+		if (((sourceStart + i) >= sourceEnd) ||
+				((sourceStart[i] & 0xC0) != 0x80)) {
+			return i;
+		}
+	}
+
+	*pbValid = true;
+	return ulLength;
+}
+
+/**
+ * Folds the case of an ASCII letter. Every other byte is left as is.
+ *
+ * @param ch Byte to be folded.
+ *
+ * @return Lower case version of the byte.
+ */
+static inline UTF8 FoldASCII(UTF8 ch) {
+	return ((ch >= 'A') && (ch <= 'Z')) ? (UTF8)(ch | 0x20) : ch;
+}
+
+/**
+ * Checks if a pattern is found at a position of a buffer.
+ *
+ * @param source        Position to be checked. Must have at least
+ *                      patternLength bytes available.
+ * @param pattern       Pattern to look for.
+ * @param patternLength Length of the pattern in bytes.
+ * @param bFoldCase     Ignore the case of ASCII letters?
+ *
+ * @return TRUE if the pattern is at this position.
+ */
+static inline bool MatchesAt(const UTF8* source, const UTF8* pattern,
+							 size_t patternLength, bool bFoldCase) {
+	if (!bFoldCase)
+		return memcmp(source, pattern, patternLength) == 0;
+
+	for (size_t i = 0; i < patternLength; i++) {
+		if (FoldASCII(source[i]) != FoldASCII(pattern[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                               Scalar Kernel                               |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Converts a run of ASCII characters from UTF-8 to UTF-16 checking 4 bytes at
+ * a time.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+static void AsciiRun8Scalar(const UTF8** sourceStart, const UTF8* sourceEnd,
+							UTF16** targetStart, UTF16* targetEnd) {
+	const UTF8* src = *sourceStart;
+	UTF16* dst = *targetStart;
+
+	while (((sourceEnd - src) >= 4) && ((targetEnd - dst) >= 4)) {
+		UTF32 word;
+		memcpy(&word, src, 4);
+		if (word & 0x80808080U)
+			break;
+
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = src[3];
+		src += 4;
+		dst += 4;
+	}
+	while ((src < sourceEnd) && (dst < targetEnd) && (*src < 0x80))
+		*dst++ = *src++;
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-16 to UTF-8.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+static void AsciiRun16Scalar(const UTF16** sourceStart, const UTF16* sourceEnd,
+							 UTF8** targetStart, UTF8* targetEnd) {
+	const UTF16* src = *sourceStart;
+	UTF8* dst = *targetStart;
+
+	while ((src < sourceEnd) && (dst < targetEnd) && (*src < 0x80))
+		*dst++ = (UTF8)*src++;
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-8 to UTF-32 checking 4 bytes at
+ * a time.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+static void AsciiRun8to32Scalar(const UTF8** sourceStart,
+								const UTF8* sourceEnd, UTF32** targetStart,
+								UTF32* targetEnd) {
+	const UTF8* src = *sourceStart;
+	UTF32* dst = *targetStart;
+
+	while (((sourceEnd - src) >= 4) && ((targetEnd - dst) >= 4)) {
+		UTF32 word;
+		memcpy(&word, src, 4);
+		if (word & 0x80808080U)
+			break;
+
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = src[3];
+		src += 4;
+		dst += 4;
+	}
+	while ((src < sourceEnd) && (dst < targetEnd) && (*src < 0x80))
+		*dst++ = *src++;
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-32 to UTF-8.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+static void AsciiRun32Scalar(const UTF32** sourceStart, const UTF32* sourceEnd,
+							 UTF8** targetStart, UTF8* targetEnd) {
+	const UTF32* src = *sourceStart;
+	UTF8* dst = *targetStart;
+
+	while ((src < sourceEnd) && (dst < targetEnd) && (*src < 0x80))
+		*dst++ = (UTF8)*src++;
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Counts the number of UTF-16 units needed to hold the conversion of a UTF-8
+ * buffer. Every byte that isn't a continuation byte starts a character, and
+ * the ones that start a 4 byte sequence need a surrogate pair.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-16 units of the conversion.
+ */
+static size_t Length8Scalar(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	size_t ulLength = 0;
+
+	while (sourceStart < sourceEnd) {
+		UTF8 ch = *sourceStart++;
+		ulLength += ((ch & 0xC0) != 0x80) + (ch >= 0xF0);
+	}
+
+	return ulLength;
+}
+
+/**
+ * Counts the number of bytes needed to hold the conversion of a UTF-16 buffer
+ * to UTF-8. Unpaired surrogates are counted as they are converted in lenient
+ * mode.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes of the conversion.
+ */
+static size_t Length16Scalar(const UTF16* sourceStart,
+							 const UTF16* sourceEnd) {
+	size_t ulLength = 0;
+
+	while (sourceStart < sourceEnd) {
+		UTF32 ch = *sourceStart++;
+
+		if (ch < 0x80) {
+			ulLength += 1;
+		} else if (ch < 0x800) {
+			ulLength += 2;
+		} else if (((ch & 0xFC00) == 0xD800) && (sourceStart < sourceEnd) &&
+				((*sourceStart & 0xFC00) == 0xDC00)) {
+			ulLength += 4;
+			sourceStart++;
+		} else {
+			ulLength += 3;
+		}
+	}
+
+	return ulLength;
+}
+
+/**
+ * Counts the number of UTF-32 units needed to hold the conversion of a UTF-8
+ * buffer, which is the number of bytes that aren't continuation bytes.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-32 units of the conversion.
+ */
+static size_t Length8to32Scalar(const UTF8* sourceStart,
+								const UTF8* sourceEnd) {
+	size_t ulLength = 0;
+
+	while (sourceStart < sourceEnd)
+		ulLength += ((*sourceStart++ & 0xC0) != 0x80);
+
+	return ulLength;
+}
+
+/**
+ * Gets the length of the longest well-formed prefix of a UTF-8 buffer, skipping
+ * over ASCII characters 8 bytes at a time.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes before the first ill-formed sequence.
+ */
+static size_t ValidLength8Scalar(const UTF8* sourceStart,
+								 const UTF8* sourceEnd) {
+	const UTF8* src = sourceStart;
+	bool bValid;
+
+	while (src < sourceEnd) {
+		// Skip over the ASCII characters.
+		while ((sourceEnd - src) >= 8) {
+			UTF32 words[2];
+			memcpy(words, src, 8);
+			if ((words[0] | words[1]) & 0x80808080U)
+				break;
+			src += 8;
+		}
+		while ((src < sourceEnd) && (*src < 0x80))
+			src++;
+		if (src >= sourceEnd)
+			break;
+
+		// Check the multi-byte sequence.
+		size_t ulLength = CheckSequence(src, sourceEnd, &bValid);
+		if (!bValid)
+			break;
+		src += ulLength;
+	}
+
+	return src - sourceStart;
+}
+
+/**
+ * Finds the first occurrence of a pattern by looking for its first byte with
+ * memchr, which is already vectorized by most C libraries.
+ *
+ * @param sourceStart   Start of the input.
+ * @param sourceEnd     End of the input.
+ * @param pattern       Pattern to look for. Must not be empty.
+ * @param patternLength Length of the pattern in bytes.
+ * @param bFoldCase     Ignore the case of ASCII letters?
+ *
+ * @return Start of the first occurrence or NULL if there isn't one.
+ */
+static const UTF8* Find8Scalar(const UTF8* sourceStart, const UTF8* sourceEnd,
+							   const UTF8* pattern, size_t patternLength,
+							   bool bFoldCase) {
+	const UTF8* src = sourceStart;
+	UTF8 first = FoldASCII(pattern[0]);
+	UTF8 last = FoldASCII(pattern[patternLength - 1]);
+
+	if ((size_t)(sourceEnd - sourceStart) < patternLength)
+		return NULL;
+	const UTF8* lastStart = sourceEnd - patternLength;
+
+	// Letters have to be checked in both cases.
+	if (bFoldCase && (first >= 'a') && (first <= 'z')) {
+		for (; src <= lastStart; src++) {
+			if ((FoldASCII(*src) == first) &&
+					(FoldASCII(src[patternLength - 1]) == last) &&
+					MatchesAt(src, pattern, patternLength, true)) {
+				return src;
+			}
+		}
+
+		return NULL;
+	}
+
+	// Jump straight to the candidates.
+	while (src <= lastStart) {
+		src = (const UTF8*)memchr(src, pattern[0], (lastStart - src) + 1);
+		if (src == NULL)
+			return NULL;
+		if (MatchesAt(src, pattern, patternLength, bFoldCase))
+			return src;
+		src++;
+	}
+
+	return NULL;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                SSE2 Kernel                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+#ifdef FASTUTF_HAS_SSE2
+
+/**
+ * Converts a run of ASCII characters from UTF-8 to UTF-16 in blocks of 16
+ * bytes.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_SSE2
+static void AsciiRun8SSE2(const UTF8** sourceStart, const UTF8* sourceEnd,
+						  UTF16** targetStart, UTF16* targetEnd) {
+	const UTF8* src = *sourceStart;
+	UTF16* dst = *targetStart;
+	const __m128i zero = _mm_setzero_si128();
+
+	while (((sourceEnd - src) >= 16) && ((targetEnd - dst) >= 16)) {
+		__m128i block = _mm_loadu_si128((const __m128i*)src);
+		int mask = _mm_movemask_epi8(block);
+
+		// Copy the ASCII characters before the first multi-byte sequence.
+		if (mask != 0) {
+			UTF8 const* end = src + CountTrailingZeros(mask);
+			while (src < end)
+				*dst++ = *src++;
+			break;
+		}
+
+		_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(block, zero));
+		_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi8(block, zero));
+		src += 16;
+		dst += 16;
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-16 to UTF-8 in blocks of 16
+ * units.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_SSE2
+static void AsciiRun16SSE2(const UTF16** sourceStart, const UTF16* sourceEnd,
+						   UTF8** targetStart, UTF8* targetEnd) {
+	const UTF16* src = *sourceStart;
+	UTF8* dst = *targetStart;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high = _mm_set1_epi16((short)0xFF80);
+
+	while (((sourceEnd - src) >= 16) && ((targetEnd - dst) >= 16)) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)src);
+		__m128i hi = _mm_loadu_si128((const __m128i*)(src + 8));
+		__m128i bits = _mm_and_si128(_mm_or_si128(lo, hi), high);
+
+		// Copy the ASCII characters before the first non-ASCII one.
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) != 0xFFFF) {
+			while (*src < 0x80)
+				*dst++ = (UTF8)*src++;
+			break;
+		}
+
+		_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+		src += 16;
+		dst += 16;
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Counts the number of UTF-16 units needed to hold the conversion of a UTF-8
+ * buffer in blocks of 16 bytes.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-16 units of the conversion.
+ */
+FASTUTF_TARGET_SSE2
+static size_t Length8SSE2(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i cont = _mm_set1_epi8((char)0xBF);
+	const __m128i four = _mm_set1_epi8((char)0xF0);
+	size_t ulLength = 0;
+
+	while ((sourceEnd - sourceStart) >= 16) {
+		// Each block adds at most 2 to a lane, so flush before they overflow.
+		size_t ulBlocks = Shortest((sourceEnd - sourceStart) / 16, 127);
+		__m128i sums = zero;
+
+		while (ulBlocks-- > 0) {
+			__m128i block = _mm_loadu_si128((const __m128i*)sourceStart);
+
+			// Lanes are -1 for the bytes that start a character and for the
+			// ones that start a surrogate pair.
+			sums = _mm_sub_epi8(sums, _mm_cmpgt_epi8(block, cont));
+			sums = _mm_sub_epi8(sums, _mm_cmpeq_epi8(_mm_max_epu8(block, four),
+				block));
+			sourceStart += 16;
+		}
+
+		sums = _mm_sad_epu8(sums, zero);
+		ulLength += (size_t)_mm_cvtsi128_si32(sums) +
+			(size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+
+	return ulLength + Length8Scalar(sourceStart, sourceEnd);
+}
+
+/**
+ * Counts the number of bytes needed to hold the conversion of a UTF-16 buffer
+ * to UTF-8 in blocks of 8 units.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes of the conversion.
+ */
+FASTUTF_TARGET_SSE2
+static size_t Length16SSE2(const UTF16* sourceStart, const UTF16* sourceEnd) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i mask1 = _mm_set1_epi16((short)0xFF80);
+	const __m128i mask2 = _mm_set1_epi16((short)0xF800);
+	const __m128i maskSur = _mm_set1_epi16((short)0xFC00);
+	const __m128i high = _mm_set1_epi16((short)0xD800);
+	const __m128i low = _mm_set1_epi16((short)0xDC00);
+	size_t ulLength = 0;
+
+	// Every unit starts out as 3 bytes, with the lanes counting how many
+	// bytes to take off. The high half of a surrogate pair takes off 2, so
+	// blocks peek at the unit that follows them.
+	while ((sourceEnd - sourceStart) > 8) {
+		// Each block takes at most 4 from a lane, so flush before overflowing.
+		size_t ulBlocks = Shortest((sourceEnd - sourceStart - 1) / 8, 8191);
+		__m128i sums = zero;
+
+		ulLength += ulBlocks * 8 * 3;
+		while (ulBlocks-- > 0) {
+			__m128i block = _mm_loadu_si128((const __m128i*)sourceStart);
+			__m128i next = _mm_loadu_si128((const __m128i*)(sourceStart + 1));
+
+			// ASCII and 2 byte characters are shorter.
+			sums = _mm_add_epi16(sums, _mm_cmpeq_epi16(
+				_mm_and_si128(block, mask1), zero));
+			sums = _mm_add_epi16(sums, _mm_cmpeq_epi16(
+				_mm_and_si128(block, mask2), zero));
+
+			// Surrogate pairs are 4 bytes instead of 3 + 3.
+			__m128i pairs = _mm_and_si128(
+				_mm_cmpeq_epi16(_mm_and_si128(block, maskSur), high),
+				_mm_cmpeq_epi16(_mm_and_si128(next, maskSur), low));
+			sums = _mm_add_epi16(sums, _mm_add_epi16(pairs, pairs));
+			sourceStart += 8;
+		}
+
+		// Sum up the lanes.
+		sums = _mm_madd_epi16(sums, ones);
+		sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+		sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 4));
+		ulLength -= (size_t)(-_mm_cvtsi128_si32(sums));
+	}
+
+	return ulLength + Length16Scalar(sourceStart, sourceEnd);
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-8 to UTF-32 in blocks of 16
+ * bytes.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_SSE2
+static void AsciiRun8to32SSE2(const UTF8** sourceStart, const UTF8* sourceEnd,
+							  UTF32** targetStart, UTF32* targetEnd) {
+	const UTF8* src = *sourceStart;
+	UTF32* dst = *targetStart;
+	const __m128i zero = _mm_setzero_si128();
+
+	while (((sourceEnd - src) >= 16) && ((targetEnd - dst) >= 16)) {
+		__m128i block = _mm_loadu_si128((const __m128i*)src);
+		int mask = _mm_movemask_epi8(block);
+
+		// Copy the ASCII characters before the first multi-byte sequence.
+		if (mask != 0) {
+			UTF8 const* end = src + CountTrailingZeros(mask);
+			while (src < end)
+				*dst++ = *src++;
+			break;
+		}
+
+		__m128i lo = _mm_unpacklo_epi8(block, zero);
+		__m128i hi = _mm_unpackhi_epi8(block, zero);
+		_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128((__m128i*)(dst + 12), _mm_unpackhi_epi16(hi, zero));
+		src += 16;
+		dst += 16;
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-32 to UTF-8 in blocks of 16
+ * units.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_SSE2
+static void AsciiRun32SSE2(const UTF32** sourceStart, const UTF32* sourceEnd,
+						   UTF8** targetStart, UTF8* targetEnd) {
+	const UTF32* src = *sourceStart;
+	UTF8* dst = *targetStart;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high = _mm_set1_epi32((int)0xFFFFFF80);
+
+	while (((sourceEnd - src) >= 16) && ((targetEnd - dst) >= 16)) {
+		__m128i a = _mm_loadu_si128((const __m128i*)src);
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + 4));
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + 8));
+		__m128i d = _mm_loadu_si128((const __m128i*)(src + 12));
+		__m128i bits = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b),
+			_mm_or_si128(c, d)), high);
+
+		// Copy the ASCII characters before the first non-ASCII one.
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, zero)) != 0xFFFF) {
+			while (*src < 0x80)
+				*dst++ = (UTF8)*src++;
+			break;
+		}
+
+		_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(
+			_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+		src += 16;
+		dst += 16;
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+}
+
+/**
+ * Counts the number of UTF-32 units needed to hold the conversion of a UTF-8
+ * buffer in blocks of 16 bytes.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-32 units of the conversion.
+ */
+FASTUTF_TARGET_SSE2
+static size_t Length8to32SSE2(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i cont = _mm_set1_epi8((char)0xBF);
+	size_t ulLength = 0;
+
+	while ((sourceEnd - sourceStart) >= 16) {
+		// Each block adds at most 1 to a lane, so flush before they overflow.
+		size_t ulBlocks = Shortest((sourceEnd - sourceStart) / 16, 255);
+		__m128i sums = zero;
+
+		while (ulBlocks-- > 0) {
+			__m128i block = _mm_loadu_si128((const __m128i*)sourceStart);
+			sums = _mm_sub_epi8(sums, _mm_cmpgt_epi8(block, cont));
+			sourceStart += 16;
+		}
+
+		sums = _mm_sad_epu8(sums, zero);
+		ulLength += (size_t)_mm_cvtsi128_si32(sums) +
+			(size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+
+	return ulLength + Length8to32Scalar(sourceStart, sourceEnd);
+}
+
+/**
+ * Gets the length of the longest well-formed prefix of a UTF-8 buffer, skipping
+ * over ASCII characters in blocks of 16 bytes.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes before the first ill-formed sequence.
+ */
+FASTUTF_TARGET_SSE2
+static size_t ValidLength8SSE2(const UTF8* sourceStart,
+							   const UTF8* sourceEnd) {
+	const UTF8* src = sourceStart;
+	bool bValid;
+
+	while (src < sourceEnd) {
+		// Skip over the ASCII characters.
+		while ((sourceEnd - src) >= 16) {
+			UTF32 mask = (UTF32)_mm_movemask_epi8(
+				_mm_loadu_si128((const __m128i*)src));
+			if (mask != 0) {
+				src += CountTrailingZeros(mask);
+				break;
+			}
+			src += 16;
+		}
+		while ((src < sourceEnd) && (*src < 0x80))
+			src++;
+		if (src >= sourceEnd)
+			break;
+
+		// Check the multi-byte sequence.
+		size_t ulLength = CheckSequence(src, sourceEnd, &bValid);
+		if (!bValid)
+			break;
+		src += ulLength;
+	}
+
+	return src - sourceStart;
+}
+
+/**
+ * Finds the first occurrence of a pattern in blocks of 16 bytes, only checking
+ * the positions where both its first and last bytes are in place.
+ *
+ * @param sourceStart   Start of the input.
+ * @param sourceEnd     End of the input.
+ * @param pattern       Pattern to look for. Must not be empty.
+ * @param patternLength Length of the pattern in bytes.
+ * @param bFoldCase     Ignore the case of ASCII letters?
+ *
+ * @return Start of the first occurrence or NULL if there isn't one.
+ */
+FASTUTF_TARGET_SSE2
+static const UTF8* Find8SSE2(const UTF8* sourceStart, const UTF8* sourceEnd,
+							 const UTF8* pattern, size_t patternLength,
+							 bool bFoldCase) {
+	const UTF8* src = sourceStart;
+	UTF8 first = bFoldCase ? FoldASCII(pattern[0]) : pattern[0];
+	UTF8 last = bFoldCase ? FoldASCII(pattern[patternLength - 1]) :
+		pattern[patternLength - 1];
+
+	// Setting bit 5 turns upper case letters into lower case ones.
+	__m128i vFirst = _mm_set1_epi8((char)first);
+	__m128i vLast = _mm_set1_epi8((char)last);
+	__m128i vFoldFirst = _mm_set1_epi8((bFoldCase && (first >= 'a') &&
+		(first <= 'z')) ? 0x20 : 0);
+	__m128i vFoldLast = _mm_set1_epi8((bFoldCase && (last >= 'a') &&
+		(last <= 'z')) ? 0x20 : 0);
+
+	while ((size_t)(sourceEnd - src) >= (patternLength + 15)) {
+		__m128i head = _mm_or_si128(_mm_loadu_si128((const __m128i*)src),
+			vFoldFirst);
+		__m128i tail = _mm_or_si128(_mm_loadu_si128(
+			(const __m128i*)(src + patternLength - 1)), vFoldLast);
+		UTF32 mask = (UTF32)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(head, vFirst), _mm_cmpeq_epi8(tail, vLast)));
+
+		// Check the candidates.
+		while (mask != 0) {
+			const UTF8* candidate = src + CountTrailingZeros(mask);
+			if (MatchesAt(candidate, pattern, patternLength, bFoldCase))
+				return candidate;
+			mask &= mask - 1;
+		}
+
+		src += 16;
+	}
+
+	return Find8Scalar(src, sourceEnd, pattern, patternLength, bFoldCase);
+}
+
+
+#endif // FASTUTF_HAS_SSE2
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                AVX2 Kernel                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+#ifdef FASTUTF_HAS_AVX2
+
+/**
+ * Converts a run of ASCII characters from UTF-8 to UTF-16 in blocks of 32
+ * bytes.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_AVX2
+static void AsciiRun8AVX2(const UTF8** sourceStart, const UTF8* sourceEnd,
+						  UTF16** targetStart, UTF16* targetEnd) {
+	const UTF8* src = *sourceStart;
+	UTF16* dst = *targetStart;
+
+	while (((sourceEnd - src) >= 32) && ((targetEnd - dst) >= 32)) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)src);
+		UTF32 mask = (UTF32)_mm256_movemask_epi8(block);
+
+		// Copy the ASCII characters before the first multi-byte sequence.
+		if (mask != 0) {
+			UTF8 const* end = src + CountTrailingZeros(mask);
+			while (src < end)
+				*dst++ = *src++;
+
+			*sourceStart = src;
+			*targetStart = dst;
+			return;
+		}
+
+		_mm256_storeu_si256((__m256i*)dst,
+			_mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+		_mm256_storeu_si256((__m256i*)(dst + 16),
+			_mm256_cvtepu8_epi16(_mm256_extracti128_si256(block, 1)));
+		src += 32;
+		dst += 32;
+	}
+
+	// Let the narrower kernel deal with what's left.
+	*sourceStart = src;
+	*targetStart = dst;
+	AsciiRun8SSE2(sourceStart, sourceEnd, targetStart, targetEnd);
+}
+
+/**
+ * Converts a run of ASCII characters from UTF-16 to UTF-8 in blocks of 32
+ * units.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ */
+FASTUTF_TARGET_AVX2
+static void AsciiRun16AVX2(const UTF16** sourceStart, const UTF16* sourceEnd,
+						   UTF8** targetStart, UTF8* targetEnd) {
+	const UTF16* src = *sourceStart;
+	UTF8* dst = *targetStart;
+	const __m256i high = _mm256_set1_epi16((short)0xFF80);
+
+	while (((sourceEnd - src) >= 32) && ((targetEnd - dst) >= 32)) {
+		__m256i lo = _mm256_loadu_si256((const __m256i*)src);
+		__m256i hi = _mm256_loadu_si256((const __m256i*)(src + 16));
+
+		// Copy the ASCII characters before the first non-ASCII one.
+		if (!_mm256_testz_si256(_mm256_or_si256(lo, hi), high)) {
+			while (*src < 0x80)
+				*dst++ = (UTF8)*src++;
+
+			*sourceStart = src;
+			*targetStart = dst;
+			return;
+		}
+
+		// Packing works on each 128-bit lane, so the halves must be reordered.
+		__m256i packed = _mm256_packus_epi16(lo, hi);
+		_mm256_storeu_si256((__m256i*)dst,
+			_mm256_permute4x64_epi64(packed, 0xD8));
+		src += 32;
+		dst += 32;
+	}
+
+	// Let the narrower kernel deal with what's left.
+	*sourceStart = src;
+	*targetStart = dst;
+	AsciiRun16SSE2(sourceStart, sourceEnd, targetStart, targetEnd);
+}
+
+/**
+ * Error flags of the UTF-8 validation lookup tables. Each table maps a nibble
+ * of the input to the errors it could be part of, so an error is only flagged
+ * when all three nibbles of a pair of bytes agree on it.
+ */
+#define VALID8_TOO_SHORT      (1 << 0)  // Lead not followed by continuation.
+#define VALID8_TOO_LONG       (1 << 1)  // Continuation after ASCII.
+#define VALID8_OVERLONG_3     (1 << 2)  // E0 followed by 80..9F.
+#define VALID8_TOO_LARGE      (1 << 3)  // Above U+10FFFF.
+#define VALID8_SURROGATE      (1 << 4)  // ED followed by A0..BF.
+#define VALID8_OVERLONG_2     (1 << 5)  // C0 or C1.
+#define VALID8_TOO_LARGE_1000 (1 << 6)  // F5 and above followed by 80..8F.
+#define VALID8_OVERLONG_4     (1 << 6)  // F0 followed by 80..8F.
+#define VALID8_TWO_CONTS      (1 << 7)  // Continuation after continuation.
+#define VALID8_CARRY (VALID8_TOO_SHORT | VALID8_TOO_LONG | VALID8_TWO_CONTS)
+
+/**
+ * Errors flagged by the high nibble of the first byte of each pair.
+ */
+static const UTF8 g_aucValid8Byte1High[16] = {
+	// 0___ (ASCII)
+	VALID8_TOO_LONG, VALID8_TOO_LONG, VALID8_TOO_LONG, VALID8_TOO_LONG,
+	VALID8_TOO_LONG, VALID8_TOO_LONG, VALID8_TOO_LONG, VALID8_TOO_LONG,
+	// 10__ (continuation)
+	VALID8_TWO_CONTS, VALID8_TWO_CONTS, VALID8_TWO_CONTS, VALID8_TWO_CONTS,
+	// 1100 (2 byte lead)
+	VALID8_TOO_SHORT | VALID8_OVERLONG_2,
+	// 1101 (2 byte lead)
+	VALID8_TOO_SHORT,
+	// 1110 (3 byte lead)
+	VALID8_TOO_SHORT | VALID8_OVERLONG_3 | VALID8_SURROGATE,
+	// 1111 (4 byte lead)
+	VALID8_TOO_SHORT | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000 |
+		VALID8_OVERLONG_4
+};
+
+/**
+ * Errors flagged by the low nibble of the first byte of each pair.
+ */
+static const UTF8 g_aucValid8Byte1Low[16] = {
+	// 0000
+	VALID8_CARRY | VALID8_OVERLONG_3 | VALID8_OVERLONG_2 | VALID8_OVERLONG_4,
+	// 0001
+	VALID8_CARRY | VALID8_OVERLONG_2,
+	// 001_
+	VALID8_CARRY,
+	VALID8_CARRY,
+	// 0100
+	VALID8_CARRY | VALID8_TOO_LARGE,
+	// 0101 to 1100
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	// 1101
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000 | VALID8_SURROGATE,
+	// 111_
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000,
+	VALID8_CARRY | VALID8_TOO_LARGE | VALID8_TOO_LARGE_1000
+};
+
+/**
+ * Errors flagged by the high nibble of the second byte of each pair.
+ */
+static const UTF8 g_aucValid8Byte2High[16] = {
+	// 0___ (ASCII)
+	VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT,
+	VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT,
+	// 1000 (continuation)
+	VALID8_TOO_LONG | VALID8_OVERLONG_2 | VALID8_TWO_CONTS | VALID8_OVERLONG_3 |
+		VALID8_TOO_LARGE_1000 | VALID8_OVERLONG_4,
+	// 1001 (continuation)
+	VALID8_TOO_LONG | VALID8_OVERLONG_2 | VALID8_TWO_CONTS | VALID8_OVERLONG_3 |
+		VALID8_TOO_LARGE,
+	// 101_ (continuation)
+	VALID8_TOO_LONG | VALID8_OVERLONG_2 | VALID8_TWO_CONTS | VALID8_SURROGATE |
+		VALID8_TOO_LARGE,
+	VALID8_TOO_LONG | VALID8_OVERLONG_2 | VALID8_TWO_CONTS | VALID8_SURROGATE |
+		VALID8_TOO_LARGE,
+	// 11__ (lead)
+	VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT, VALID8_TOO_SHORT
+};
+
+/**
+ * Looks up a table of 16 bytes using each byte of a block as the index.
+ *
+ * @param nibbles Block of indexes, all between 0 and 15.
+ * @param table   Table to be looked up.
+ *
+ * @return Block of looked up values.
+ */
+FASTUTF_TARGET_AVX2
+static inline __m256i Lookup16AVX2(__m256i nibbles, const UTF8* table) {
+	return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i*)table)), nibbles);
+}
+
+/**
+ * Shifts a block back by N bytes (1 to 3), shifting in the bytes at the end of
+ * the previous block.
+ */
+#define PrevAVX2(block, prev, N) _mm256_alignr_epi8((block), \
+	_mm256_permute2x128_si256((prev), (block), 0x21), 16 - (N))
+
+/**
+ * Finds the errors in a block of UTF-8 using the nibble lookup tables.
+ *
+ * @param block Block to be checked.
+ * @param prev  Previous block, for the characters that started in it.
+ *
+ * @return Block that's all zeros if there were no errors.
+ */
+FASTUTF_TARGET_AVX2
+static inline __m256i ErrorsAVX2(__m256i block, __m256i prev) {
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+	// Check every pair of bytes against the lookup tables.
+	__m256i prev1 = PrevAVX2(block, prev, 1);
+	__m256i errors = _mm256_and_si256(_mm256_and_si256(
+		Lookup16AVX2(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble),
+			g_aucValid8Byte1High),
+		Lookup16AVX2(_mm256_and_si256(prev1, nibble), g_aucValid8Byte1Low)),
+		Lookup16AVX2(_mm256_and_si256(_mm256_srli_epi16(block, 4), nibble),
+			g_aucValid8Byte2High));
+
+	// Third and fourth bytes must be continuations, and the lookup tables have
+	// already flagged every other continuation after a continuation.
+	__m256i third = _mm256_subs_epu8(PrevAVX2(block, prev, 2),
+		_mm256_set1_epi8((char)(0xE0 - 0x80)));
+	__m256i fourth = _mm256_subs_epu8(PrevAVX2(block, prev, 3),
+		_mm256_set1_epi8((char)(0xF0 - 0x80)));
+	return _mm256_xor_si256(errors, _mm256_and_si256(
+		_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80)));
+}
+
+/**
+ * Gets the length of the longest well-formed prefix of a UTF-8 buffer,
+ * validating blocks of 32 bytes at once with nibble lookup tables (as described
+ * by Keiser and Lemire) instead of decoding each sequence. The last block is
+ * padded with NULs, so that short texts also get validated in a single go. The
+ * exact position of an error is found by the narrower kernel, starting from
+ * the character that was being validated when the block began.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes before the first ill-formed sequence.
+ */
+FASTUTF_TARGET_AVX2
+static size_t ValidLength8AVX2(const UTF8* sourceStart,
+							   const UTF8* sourceEnd) {
+	const UTF8* src = sourceStart;
+	const __m256i last = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	__m256i prev = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+	UTF8 tail[32];
+
+	while (src < sourceEnd) {
+		size_t ulLeft = sourceEnd - src;
+		__m256i block;
+
+		// Pad the last block with NULs, which also flags the characters that
+		// were cut short by the end of the input.
+		if (ulLeft < 32) {
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, src, ulLeft);
+			block = _mm256_loadu_si256((const __m256i*)tail);
+		} else {
+			block = _mm256_loadu_si256((const __m256i*)src);
+		}
+
+		// ASCII blocks can only be wrong if the previous one was cut short.
+		if (_mm256_movemask_epi8(block) == 0) {
+			if (!_mm256_testz_si256(incomplete, incomplete))
+				break;
+		} else {
+			__m256i errors = ErrorsAVX2(block, prev);
+			if (!_mm256_testz_si256(errors, errors))
+				break;
+			incomplete = _mm256_subs_epu8(block, last);
+		}
+
+		prev = block;
+		src += Shortest(ulLeft, 32);
+	}
+
+	// Only a character cut short by the end of the input can be left.
+	if ((src >= sourceEnd) && _mm256_testz_si256(incomplete, incomplete))
+		return src - sourceStart;
+
+	// Back up to the start of the character that may continue past where we
+	// stopped and let the narrower kernel find the exact position.
+	const UTF8* start = src;
+	while ((start > sourceStart) && ((src - start) < 3) &&
+			((start[-1] & 0xC0) == 0x80)) {
+		start--;
+	}
+	if ((start > sourceStart) && (start[-1] >= 0xC0))
+		src = start - 1;
+
+	return (src - sourceStart) + ValidLength8SSE2(src, sourceEnd);
+}
+
+/**
+ * Finds the first occurrence of a pattern in blocks of 32 bytes, only checking
+ * the positions where both its first and last bytes are in place.
+ *
+ * @param sourceStart   Start of the input.
+ * @param sourceEnd     End of the input.
+ * @param pattern       Pattern to look for. Must not be empty.
+ * @param patternLength Length of the pattern in bytes.
+ * @param bFoldCase     Ignore the case of ASCII letters?
+ *
+ * @return Start of the first occurrence or NULL if there isn't one.
+ */
+FASTUTF_TARGET_AVX2
+static const UTF8* Find8AVX2(const UTF8* sourceStart, const UTF8* sourceEnd,
+							 const UTF8* pattern, size_t patternLength,
+							 bool bFoldCase) {
+	const UTF8* src = sourceStart;
+	UTF8 first = bFoldCase ? FoldASCII(pattern[0]) : pattern[0];
+	UTF8 last = bFoldCase ? FoldASCII(pattern[patternLength - 1]) :
+		pattern[patternLength - 1];
+
+	// Setting bit 5 turns upper case letters into lower case ones.
+	__m256i vFirst = _mm256_set1_epi8((char)first);
+	__m256i vLast = _mm256_set1_epi8((char)last);
+	__m256i vFoldFirst = _mm256_set1_epi8((bFoldCase && (first >= 'a') &&
+		(first <= 'z')) ? 0x20 : 0);
+	__m256i vFoldLast = _mm256_set1_epi8((bFoldCase && (last >= 'a') &&
+		(last <= 'z')) ? 0x20 : 0);
+
+	while ((size_t)(sourceEnd - src) >= (patternLength + 31)) {
+		__m256i head = _mm256_or_si256(_mm256_loadu_si256(
+			(const __m256i*)src), vFoldFirst);
+		__m256i tail = _mm256_or_si256(_mm256_loadu_si256(
+			(const __m256i*)(src + patternLength - 1)), vFoldLast);
+		UTF32 mask = (UTF32)_mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(head, vFirst), _mm256_cmpeq_epi8(tail, vLast)));
+
+		// Check the candidates.
+		while (mask != 0) {
+			const UTF8* candidate = src + CountTrailingZeros(mask);
+			if (MatchesAt(candidate, pattern, patternLength, bFoldCase))
+				return candidate;
+			mask &= mask - 1;
+		}
+
+		src += 32;
+	}
+
+	return Find8SSE2(src, sourceEnd, pattern, patternLength, bFoldCase);
+}
+
+
+#endif // FASTUTF_HAS_AVX2
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                             Kernel Selection                              |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Checks if the processor (and operating system) supports a kernel.
+ *
+ * @param kernel Kernel to be checked.
+ *
+ * @return TRUE if the kernel can be used on this machine.
+ */
+static bool KernelSupported(ConversionKernel kernel) {
+	switch (kernel) {
+	case kernelScalar:
+		return true;
+#if defined(FASTUTF_HAS_SSE2) && defined(__GNUC__)
+	case kernelSSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") != 0;
+#elif defined(FASTUTF_HAS_SSE2)
+	case kernelSSE2: {
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+	}
+#endif
+#if defined(FASTUTF_HAS_AVX2) && defined(__GNUC__)
+	case kernelAVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#elif defined(FASTUTF_HAS_AVX2)
+	case kernelAVX2: {
+		int info[4];
+
+		// Check if the operating system saves the AVX registers.
+		__cpuid(info, 1);
+		if (((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0))
+			return false;
+		if ((_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+// Kernels that were built.
+static const KernelTable g_tblScalar = {
+	kernelScalar, AsciiRun8Scalar, AsciiRun16Scalar, Length8Scalar,
+	Length16Scalar, AsciiRun8to32Scalar, AsciiRun32Scalar, Length8to32Scalar,
+	ValidLength8Scalar, Find8Scalar
+};
+#ifdef FASTUTF_HAS_SSE2
+static const KernelTable g_tblSSE2 = {
+	kernelSSE2, AsciiRun8SSE2, AsciiRun16SSE2, Length8SSE2, Length16SSE2,
+	AsciiRun8to32SSE2, AsciiRun32SSE2, Length8to32SSE2, ValidLength8SSE2,
+	Find8SSE2
+};
+#endif // FASTUTF_HAS_SSE2
+#ifdef FASTUTF_HAS_AVX2
+static const KernelTable g_tblAVX2 = {
+	kernelAVX2, AsciiRun8AVX2, AsciiRun16AVX2, Length8SSE2, Length16SSE2,
+	AsciiRun8to32SSE2, AsciiRun32SSE2, Length8to32SSE2, ValidLength8AVX2,
+	Find8AVX2
+};
+#endif // FASTUTF_HAS_AVX2
+
+// Kernel currently in use. Conversions read this pointer once and only go
+// through the table it points to, so they never mix functions of different
+// kernels. It starts out as the scalar kernel, which is set before any code
+// gets to run, so conversions made by other static initializers still work.
+static const KernelTable *g_kernel = &g_tblScalar;
+
+/**
+ * Gets the functions of a kernel.
+ *
+ * @param kernel Kernel to get the functions of.
+ *
+ * @return Table of functions or NULL if the kernel wasn't built.
+ */
+static const KernelTable* KernelFunctions(ConversionKernel kernel) {
+	switch (kernel) {
+	case kernelScalar:
+		return &g_tblScalar;
+#ifdef FASTUTF_HAS_SSE2
+	case kernelSSE2:
+		return &g_tblSSE2;
+#endif // FASTUTF_HAS_SSE2
+#ifdef FASTUTF_HAS_AVX2
+	case kernelAVX2:
+		return &g_tblAVX2;
+#endif // FASTUTF_HAS_AVX2
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Picks the fastest kernel supported by the machine.
+ *
+ * @return Always TRUE since the scalar kernel is always supported.
+ */
+static bool SelectKernel() {
+	if (SetConversionKernel(kernelAVX2))
+		return true;
+	if (SetConversionKernel(kernelSSE2))
+		return true;
+
+	return SetConversionKernel(kernelScalar);
+}
+
+/**
+ * Gets the kernel that is being used for the conversions.
+ *
+ * @return Kernel in use.
+ */
+ConversionKernel GetConversionKernel() {
+	return g_kernel->kernel;
+}
+
+/**
+ * Forces the conversions to use a specific kernel. Mostly useful to compare
+ * them against each other.
+ *
+ * @warning This isn't thread safe. It must not be called while other threads
+ *          may be converting text.
+ *
+ * @param kernel Kernel to be used.
+ *
+ * @return TRUE if the kernel is supported and is now in use. FALSE otherwise.
+ */
+bool SetConversionKernel(ConversionKernel kernel) {
+	const KernelTable *table = KernelFunctions(kernel);
+
+	if ((table == NULL) || !KernelSupported(kernel))
+		return false;
+
+	g_kernel = table;
+	return true;
+}
+
+// The kernel is picked while the program is being initialized, before any
+// other threads can be started, so they never race to pick it.
+static bool g_bKernelSelected = SelectKernel();
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Conversions                                |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Decodes well-formed multi-byte UTF-8 sequences until it reaches an ASCII
+ * character that can be handed back to the block converters.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param bTail       Also convert ASCII characters? Used when the block
+ *                    converters can't go any further.
+ *
+ * @return FALSE if something must be handled by the reference implementation.
+ */
+static bool DecodeUTF8(const UTF8** sourceStart, const UTF8* sourceEnd,
+					   UTF16** targetStart, UTF16* targetEnd, bool bTail) {
+	const UTF8* src = *sourceStart;
+	UTF16* dst = *targetStart;
+	bool bRegular = true;
+
+	while (src < sourceEnd) {
+		UTF32 ch = *src;
+		UTF32 c1;
+
+		// ASCII characters.
+		if (ch < 0x80) {
+			if (!bTail)
+				break;
+			if (dst >= targetEnd) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = (UTF16)ch;
+			src++;
+			continue;
+		}
+
+		// Make sure we have enough room for a surrogate pair.
+		if ((targetEnd - dst) < 2) {
+			bRegular = false;
+			break;
+		}
+
+		// Decode the sequence, checking for it in the same way as isLegalUTF8.
+		if ((ch >= 0xC2) && (ch <= 0xDF)) {
+			if (((sourceEnd - src) < 2) || ((src[1] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = (UTF16)(((ch & 0x1F) << 6) | (src[1] & 0x3F));
+			src += 2;
+		} else if ((ch >= 0xE0) && (ch <= 0xEF)) {
+			if ((sourceEnd - src) < 3) {
+				bRegular = false;
+				break;
+			}
+
+			c1 = src[1];
+			if ((c1 < ((ch == 0xE0) ? 0xA0U : 0x80U)) ||
+					(c1 > ((ch == 0xED) ? 0x9FU : 0xBFU)) ||
+					((src[2] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = (UTF16)(((ch & 0x0F) << 12) | ((c1 & 0x3F) << 6) |
+				(src[2] & 0x3F));
+			src += 3;
+		} else if ((ch >= 0xF0) && (ch <= 0xF4)) {
+			if ((sourceEnd - src) < 4) {
+				bRegular = false;
+				break;
+			}
+
+			c1 = src[1];
+			if ((c1 < ((ch == 0xF0) ? 0x90U : 0x80U)) ||
+					(c1 > ((ch == 0xF4) ? 0x8FU : 0xBFU)) ||
+					((src[2] & 0xC0) != 0x80) || ((src[3] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			ch = (((ch & 0x07) << 18) | ((c1 & 0x3F) << 12) |
+				((src[2] & 0x3F) << 6) | (src[3] & 0x3F)) - 0x10000;
+			dst[0] = (UTF16)(0xD800 + (ch >> 10));
+			dst[1] = (UTF16)(0xDC00 + (ch & 0x3FF));
+			dst += 2;
+			src += 4;
+		} else {
+			bRegular = false;
+			break;
+		}
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+	return bRegular;
+}
+
+/**
+ * Encodes non-ASCII UTF-16 characters until it reaches an ASCII one that can
+ * be handed back to the block converters.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ * @param bTail       Also convert ASCII characters? Used when the block
+ *                    converters can't go any further.
+ *
+ * @return FALSE if something must be handled by the reference implementation.
+ */
+static bool EncodeUTF8(const UTF16** sourceStart, const UTF16* sourceEnd,
+					   UTF8** targetStart, UTF8* targetEnd,
+					   ConversionFlags flags, bool bTail) {
+	const UTF16* src = *sourceStart;
+	UTF8* dst = *targetStart;
+	bool bRegular = true;
+
+	while (src < sourceEnd) {
+		UTF32 ch = *src;
+
+		// ASCII characters.
+		if (ch < 0x80) {
+			if (!bTail)
+				break;
+			if (dst >= targetEnd) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = (UTF8)ch;
+			src++;
+			continue;
+		}
+
+		// Make sure we have enough room for the longest sequence.
+		if ((targetEnd - dst) < 4) {
+			bRegular = false;
+			break;
+		}
+
+		// Characters of the same length tend to come in runs, so convert them
+		// in a tight loop over as many as are guaranteed to fit.
+		if (ch < 0x800) {
+			size_t ulRun = Shortest(sourceEnd - src, (targetEnd - dst) / 2);
+			do {
+				dst[0] = (UTF8)(0xC0 | (ch >> 6));
+				dst[1] = (UTF8)(0x80 | (ch & 0x3F));
+				dst += 2;
+				src++;
+			} while ((--ulRun > 0) && ((ch = *src) >= 0x80) && (ch < 0x800));
+		} else if ((ch - 0xD800) >= 0x800) {
+			size_t ulRun = Shortest(sourceEnd - src, (targetEnd - dst) / 3);
+			do {
+				dst[0] = (UTF8)(0xE0 | (ch >> 12));
+				dst[1] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+				dst[2] = (UTF8)(0x80 | (ch & 0x3F));
+				dst += 3;
+				src++;
+			} while ((--ulRun > 0) && ((ch = *src) >= 0x800) &&
+				((ch - 0xD800) >= 0x800));
+		} else if ((ch <= 0xDBFF) && ((sourceEnd - src) >= 2) &&
+				((UTF32)(src[1] - 0xDC00) < 0x400)) {
+			ch = ((ch - 0xD800) << 10) + (src[1] - 0xDC00) + 0x10000;
+			dst[0] = (UTF8)(0xF0 | (ch >> 18));
+			dst[1] = (UTF8)(0x80 | ((ch >> 12) & 0x3F));
+			dst[2] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+			dst[3] = (UTF8)(0x80 | (ch & 0x3F));
+			dst += 4;
+			src += 2;
+		} else if ((flags == strictConversion) ||
+				((ch <= 0xDBFF) && ((sourceEnd - src) < 2))) {
+			// Unpaired surrogates are only passed through in lenient mode, and
+			// a high surrogate at the end of the input may be a partial pair.
+			bRegular = false;
+			break;
+		} else {
+			dst[0] = (UTF8)(0xE0 | (ch >> 12));
+			dst[1] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+			dst[2] = (UTF8)(0x80 | (ch & 0x3F));
+			dst += 3;
+			src++;
+		}
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+	return bRegular;
+}
+
+/**
+ * Decodes well-formed multi-byte UTF-8 sequences into UTF-32 until it reaches
+ * an ASCII character that can be handed back to the block converters.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param bTail       Also convert ASCII characters? Used when the block
+ *                    converters can't go any further.
+ *
+ * @return FALSE if something must be handled by the reference implementation.
+ */
+static bool DecodeUTF8toUTF32(const UTF8** sourceStart, const UTF8* sourceEnd,
+							  UTF32** targetStart, UTF32* targetEnd,
+							  bool bTail) {
+	const UTF8* src = *sourceStart;
+	UTF32* dst = *targetStart;
+	bool bRegular = true;
+
+	while (src < sourceEnd) {
+		UTF32 ch = *src;
+		UTF32 c1;
+
+		// Make sure we have room for another character.
+		if (dst >= targetEnd) {
+			bRegular = (ch < 0x80) && !bTail;
+			break;
+		}
+
+		// ASCII characters.
+		if (ch < 0x80) {
+			if (!bTail)
+				break;
+
+			*dst++ = ch;
+			src++;
+			continue;
+		}
+
+		// Decode the sequence, checking for it in the same way as isLegalUTF8.
+		if ((ch >= 0xC2) && (ch <= 0xDF)) {
+			if (((sourceEnd - src) < 2) || ((src[1] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = ((ch & 0x1F) << 6) | (src[1] & 0x3F);
+			src += 2;
+		} else if ((ch >= 0xE0) && (ch <= 0xEF)) {
+			if ((sourceEnd - src) < 3) {
+				bRegular = false;
+				break;
+			}
+
+			c1 = src[1];
+			if ((c1 < ((ch == 0xE0) ? 0xA0U : 0x80U)) ||
+					(c1 > ((ch == 0xED) ? 0x9FU : 0xBFU)) ||
+					((src[2] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = ((ch & 0x0F) << 12) | ((c1 & 0x3F) << 6) | (src[2] & 0x3F);
+			src += 3;
+		} else if ((ch >= 0xF0) && (ch <= 0xF4)) {
+			if ((sourceEnd - src) < 4) {
+				bRegular = false;
+				break;
+			}
+
+			c1 = src[1];
+			if ((c1 < ((ch == 0xF0) ? 0x90U : 0x80U)) ||
+					(c1 > ((ch == 0xF4) ? 0x8FU : 0xBFU)) ||
+					((src[2] & 0xC0) != 0x80) || ((src[3] & 0xC0) != 0x80)) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = ((ch & 0x07) << 18) | ((c1 & 0x3F) << 12) |
+				((src[2] & 0x3F) << 6) | (src[3] & 0x3F);
+			src += 4;
+		} else {
+			bRegular = false;
+			break;
+		}
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+	return bRegular;
+}
+
+/**
+ * Encodes non-ASCII UTF-32 characters until it reaches an ASCII one that can
+ * be handed back to the block converters.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ * @param bTail       Also convert ASCII characters? Used when the block
+ *                    converters can't go any further.
+ *
+ * @return FALSE if something must be handled by the reference implementation.
+ */
+static bool EncodeUTF32toUTF8(const UTF32** sourceStart,
+							  const UTF32* sourceEnd, UTF8** targetStart,
+							  UTF8* targetEnd, ConversionFlags flags,
+							  bool bTail) {
+	const UTF32* src = *sourceStart;
+	UTF8* dst = *targetStart;
+	bool bRegular = true;
+
+	while (src < sourceEnd) {
+		UTF32 ch = *src;
+
+		// ASCII characters.
+		if (ch < 0x80) {
+			if (!bTail)
+				break;
+			if (dst >= targetEnd) {
+				bRegular = false;
+				break;
+			}
+
+			*dst++ = (UTF8)ch;
+			src++;
+			continue;
+		}
+
+		// Make sure we have enough room for the longest sequence.
+		if ((targetEnd - dst) < 4) {
+			bRegular = false;
+			break;
+		}
+
+		// Characters of the same length tend to come in runs, so convert them
+		// in a tight loop over as many as are guaranteed to fit.
+		if (ch < 0x800) {
+			size_t ulRun = Shortest(sourceEnd - src, (targetEnd - dst) / 2);
+			do {
+				dst[0] = (UTF8)(0xC0 | (ch >> 6));
+				dst[1] = (UTF8)(0x80 | (ch & 0x3F));
+				dst += 2;
+				src++;
+			} while ((--ulRun > 0) && ((ch = *src) >= 0x80) && (ch < 0x800));
+		} else if ((ch < 0x10000) && ((ch - 0xD800) >= 0x800)) {
+			size_t ulRun = Shortest(sourceEnd - src, (targetEnd - dst) / 3);
+			do {
+				dst[0] = (UTF8)(0xE0 | (ch >> 12));
+				dst[1] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+				dst[2] = (UTF8)(0x80 | (ch & 0x3F));
+				dst += 3;
+				src++;
+			} while ((--ulRun > 0) && ((ch = *src) >= 0x800) &&
+				(ch < 0x10000) && ((ch - 0xD800) >= 0x800));
+		} else if ((ch >= 0x10000) && (ch <= 0x10FFFF)) {
+			dst[0] = (UTF8)(0xF0 | (ch >> 18));
+			dst[1] = (UTF8)(0x80 | ((ch >> 12) & 0x3F));
+			dst[2] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+			dst[3] = (UTF8)(0x80 | (ch & 0x3F));
+			dst += 4;
+			src++;
+		} else if ((flags == strictConversion) || (ch > 0x10FFFF)) {
+			// Surrogates are only passed through in lenient mode, and values
+			// out of range are always reported.
+			bRegular = false;
+			break;
+		} else {
+			dst[0] = (UTF8)(0xE0 | (ch >> 12));
+			dst[1] = (UTF8)(0x80 | ((ch >> 6) & 0x3F));
+			dst[2] = (UTF8)(0x80 | (ch & 0x3F));
+			dst += 3;
+			src++;
+		}
+	}
+
+	*sourceStart = src;
+	*targetStart = dst;
+	return bRegular;
+}
+
+/**
+ * Converts a UTF-8 buffer to UTF-16. Same as ConvertUTF8toUTF16.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ *
+ * @return Result of the conversion.
+ */
+ConversionResult FastConvertUTF8toUTF16(const UTF8** sourceStart,
+										const UTF8* sourceEnd,
+										UTF16** targetStart, UTF16* targetEnd,
+										ConversionFlags flags) {
+	const KernelTable *kernel = g_kernel;
+
+	while (*sourceStart < sourceEnd) {
+		const UTF8* before = *sourceStart;
+
+		// Take care of the ASCII characters in blocks. If that didn't go
+		// anywhere while sitting on an ASCII character we are near the end of
+		// one of the buffers and have to finish the job one at a time.
+		kernel->pfnAsciiRun8(sourceStart, sourceEnd, targetStart, targetEnd);
+		bool bTail = (*sourceStart == before) && (*sourceStart < sourceEnd) &&
+			(**sourceStart < 0x80);
+
+		if (!DecodeUTF8(sourceStart, sourceEnd, targetStart, targetEnd,
+				bTail)) {
+			return ConvertUTF8toUTF16(sourceStart, sourceEnd, targetStart,
+				targetEnd, flags);
+		}
+	}
+
+	return conversionOK;
+}
+
+/**
+ * Converts a UTF-16 buffer to UTF-8. Same as ConvertUTF16toUTF8.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ *
+ * @return Result of the conversion.
+ */
+ConversionResult FastConvertUTF16toUTF8(const UTF16** sourceStart,
+										const UTF16* sourceEnd,
+										UTF8** targetStart, UTF8* targetEnd,
+										ConversionFlags flags) {
+	const KernelTable *kernel = g_kernel;
+
+	while (*sourceStart < sourceEnd) {
+		const UTF16* before = *sourceStart;
+
+		// Take care of the ASCII characters in blocks. If that didn't go
+		// anywhere while sitting on an ASCII character we are near the end of
+		// one of the buffers and have to finish the job one at a time.
+		kernel->pfnAsciiRun16(sourceStart, sourceEnd, targetStart, targetEnd);
+		bool bTail = (*sourceStart == before) && (*sourceStart < sourceEnd) &&
+			(**sourceStart < 0x80);
+
+		if (!EncodeUTF8(sourceStart, sourceEnd, targetStart, targetEnd, flags,
+				bTail)) {
+			return ConvertUTF16toUTF8(sourceStart, sourceEnd, targetStart,
+				targetEnd, flags);
+		}
+	}
+
+	return conversionOK;
+}
+
+/**
+ * Converts a UTF-8 buffer to UTF-32. Same as ConvertUTF8toUTF32.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ *
+ * @return Result of the conversion.
+ */
+ConversionResult FastConvertUTF8toUTF32(const UTF8** sourceStart,
+										const UTF8* sourceEnd,
+										UTF32** targetStart, UTF32* targetEnd,
+										ConversionFlags flags) {
+	const KernelTable *kernel = g_kernel;
+
+	while (*sourceStart < sourceEnd) {
+		const UTF8* before = *sourceStart;
+
+		// Take care of the ASCII characters in blocks. If that didn't go
+		// anywhere while sitting on an ASCII character we are near the end of
+		// one of the buffers and have to finish the job one at a time.
+		kernel->pfnAsciiRun8to32(sourceStart, sourceEnd, targetStart,
+			targetEnd);
+		bool bTail = (*sourceStart == before) && (*sourceStart < sourceEnd) &&
+			(**sourceStart < 0x80);
+
+		if (!DecodeUTF8toUTF32(sourceStart, sourceEnd, targetStart, targetEnd,
+				bTail)) {
+			return ConvertUTF8toUTF32(sourceStart, sourceEnd, targetStart,
+				targetEnd, flags);
+		}
+	}
+
+	return conversionOK;
+}
+
+/**
+ * Converts a UTF-32 buffer to UTF-8. Same as ConvertUTF32toUTF8.
+ *
+ * @param sourceStart Pointer to the start of the input. Updated on return.
+ * @param sourceEnd   End of the input.
+ * @param targetStart Pointer to the start of the output. Updated on return.
+ * @param targetEnd   End of the output buffer.
+ * @param flags       Conversion flags.
+ *
+ * @return Result of the conversion.
+ */
+ConversionResult FastConvertUTF32toUTF8(const UTF32** sourceStart,
+										const UTF32* sourceEnd,
+										UTF8** targetStart, UTF8* targetEnd,
+										ConversionFlags flags) {
+	const KernelTable *kernel = g_kernel;
+
+	while (*sourceStart < sourceEnd) {
+		const UTF32* before = *sourceStart;
+
+		// Take care of the ASCII characters in blocks. If that didn't go
+		// anywhere while sitting on an ASCII character we are near the end of
+		// one of the buffers and have to finish the job one at a time.
+		kernel->pfnAsciiRun32(sourceStart, sourceEnd, targetStart, targetEnd);
+		bool bTail = (*sourceStart == before) && (*sourceStart < sourceEnd) &&
+			(**sourceStart < 0x80);
+
+		if (!EncodeUTF32toUTF8(sourceStart, sourceEnd, targetStart, targetEnd,
+				flags, bTail)) {
+			return ConvertUTF32toUTF8(sourceStart, sourceEnd, targetStart,
+				targetEnd, flags);
+		}
+	}
+
+	return conversionOK;
+}
+
+/**
+ * Calculates the number of UTF-16 units needed to hold the conversion of a
+ * UTF-8 buffer, allowing the output to be allocated with the exact size.
+ *
+ * @warning Only exact for well-formed input, which is the only kind that can
+ *          be converted successfully.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-16 units of the conversion.
+ */
+size_t UTF16LengthOfUTF8(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	return g_kernel->pfnLength8(sourceStart, sourceEnd);
+}
+
+/**
+ * Calculates the number of bytes needed to hold the conversion of a UTF-16
+ * buffer to UTF-8, allowing the output to be allocated with the exact size.
+ * Unpaired surrogates are counted as they are converted in lenient mode.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes of the conversion.
+ */
+size_t UTF8LengthOfUTF16(const UTF16* sourceStart, const UTF16* sourceEnd) {
+	return g_kernel->pfnLength16(sourceStart, sourceEnd);
+}
+
+/**
+ * Calculates the number of UTF-32 units needed to hold the conversion of a
+ * UTF-8 buffer, allowing the output to be allocated with the exact size.
+ *
+ * @warning Only exact for well-formed input, which is the only kind that can
+ *          be converted successfully.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of UTF-32 units of the conversion.
+ */
+size_t UTF32LengthOfUTF8(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	return g_kernel->pfnLength8to32(sourceStart, sourceEnd);
+}
+
+/**
+ * Calculates the number of bytes needed to hold the conversion of a UTF-32
+ * buffer to UTF-8, allowing the output to be allocated with the exact size.
+ * Surrogates are counted as they are converted in lenient mode.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes of the conversion.
+ */
+size_t UTF8LengthOfUTF32(const UTF32* sourceStart, const UTF32* sourceEnd) {
+	size_t ulLength = 0;
+
+	while (sourceStart < sourceEnd) {
+		UTF32 ch = *sourceStart++;
+
+		if (ch < 0x80) {
+			ulLength += 1;
+		} else if (ch < 0x800) {
+			ulLength += 2;
+		} else if ((ch < 0x10000) || (ch > 0x10FFFF)) {
+			ulLength += 3;
+		} else {
+			ulLength += 4;
+		}
+	}
+
+	return ulLength;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                Validation                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Gets the length of the longest well-formed prefix of a UTF-8 buffer, which
+ * is the whole buffer if it's valid UTF-8.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ *
+ * @return Number of bytes before the first ill-formed sequence.
+ */
+size_t ValidUTF8Length(const UTF8* sourceStart, const UTF8* sourceEnd) {
+	return g_kernel->pfnValidLength8(sourceStart, sourceEnd);
+}
+
+/**
+ * Repairs a UTF-8 buffer by replacing each ill-formed sequence (its maximal
+ * subpart, as recommended by the Unicode standard) with U+FFFD. Calling it
+ * without an output buffer gives the length of the repaired text, which may be
+ * longer than the input.
+ *
+ * @param sourceStart Start of the input.
+ * @param sourceEnd   End of the input.
+ * @param target      Buffer to receive the repaired text or NULL if we only
+ *                    want to know its length.
+ *
+ * @return Length of the repaired text in bytes.
+ */
+size_t RepairUTF8(const UTF8* sourceStart, const UTF8* sourceEnd,
+				  UTF8* target) {
+	const UTF8* src = sourceStart;
+	size_t ulLength = 0;
+	bool bValid;
+
+	const KernelTable *kernel = g_kernel;
+	while (src < sourceEnd) {
+		// Copy over everything that's well-formed.
+		size_t ulValid = kernel->pfnValidLength8(src, sourceEnd);
+		if (target != NULL)
+			memcpy(target + ulLength, src, ulValid);
+		ulLength += ulValid;
+		src += ulValid;
+		if (src >= sourceEnd)
+			break;
+
+		// Replace the ill-formed sequence.
+		src += CheckSequence(src, sourceEnd, &bValid);
+		if (target != NULL) {
+			target[ulLength] = 0xEF;
+			target[ulLength + 1] = 0xBF;
+			target[ulLength + 2] = 0xBD;
+		}
+		ulLength += 3;
+	}
+
+	return ulLength;
+}
+
+/*
+ * +===========================================================================+
+ * |                                                                           |
+ * |                                 Searching                                 |
+ * |                                                                           |
+ * +===========================================================================+
+ */
+
+/**
+ * Finds the first occurrence of a pattern in a UTF-8 buffer. Since UTF-8 is
+ * self-synchronizing, a match of a well-formed pattern always starts and ends
+ * on character boundaries.
+ *
+ * @param sourceStart   Start of the input.
+ * @param sourceEnd     End of the input.
+ * @param pattern       Pattern to look for.
+ * @param patternLength Length of the pattern in bytes.
+ * @param bFoldCase     Ignore the case of ASCII letters? Other characters
+ *                      always have to match exactly.
+ *
+ * @return Start of the first occurrence or NULL if there isn't one. An empty
+ *         pattern is found at the start of the input.
+ */
+const UTF8* FindUTF8(const UTF8* sourceStart, const UTF8* sourceEnd,
+					 const UTF8* pattern, size_t patternLength,
+					 bool bFoldCase) {
+	if (patternLength == 0)
+		return sourceStart;
+
+	return g_kernel->pfnFind8(sourceStart, sourceEnd, pattern, patternLength,
+		bFoldCase);
+}
+
+} // namespace Unicode
@@ -0,0 +1,80 @@
+/**
+ * FastUTF.h
+ * Vectorized fast paths for the UTF-8 <-> UTF-16/32 conversions of CVTUTF.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _SHIMS_CVTUTF_FASTUTF_H
+#define _SHIMS_CVTUTF_FASTUTF_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stddef.h>
+
+#include "ConvertUTF.h"
+
+/**
+ * SIMD kernels are only built for x86 compilers that ship the intrinsics.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define FASTUTF_HAS_SSE2
+	#define FASTUTF_HAS_AVX2
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#if _MSC_VER >= 1400
+		#define FASTUTF_HAS_SSE2
+	#endif // _MSC_VER >= 1400
+	#if _MSC_VER >= 1700
+		#define FASTUTF_HAS_AVX2
+	#endif // _MSC_VER >= 1700
+#endif
+
+namespace Unicode {
+
+/**
+ * Implementations of the conversion fast paths.
+ */
+typedef enum {
+	kernelScalar = 0,
+	kernelSSE2,
+	kernelAVX2
+} ConversionKernel;
+
+// Conversion functions.
+ConversionResult FastConvertUTF8toUTF16(const UTF8** sourceStart,
+	const UTF8* sourceEnd, UTF16** targetStart, UTF16* targetEnd,
+	ConversionFlags flags);
+ConversionResult FastConvertUTF16toUTF8(const UTF16** sourceStart,
+	const UTF16* sourceEnd, UTF8** targetStart, UTF8* targetEnd,
+	ConversionFlags flags);
+ConversionResult FastConvertUTF8toUTF32(const UTF8** sourceStart,
+	const UTF8* sourceEnd, UTF32** targetStart, UTF32* targetEnd,
+	ConversionFlags flags);
+ConversionResult FastConvertUTF32toUTF8(const UTF32** sourceStart,
+	const UTF32* sourceEnd, UTF8** targetStart, UTF8* targetEnd,
+	ConversionFlags flags);
+
+// Conversion lengths.
+size_t UTF16LengthOfUTF8(const UTF8* sourceStart, const UTF8* sourceEnd);
+size_t UTF8LengthOfUTF16(const UTF16* sourceStart, const UTF16* sourceEnd);
+size_t UTF32LengthOfUTF8(const UTF8* sourceStart, const UTF8* sourceEnd);
+size_t UTF8LengthOfUTF32(const UTF32* sourceStart, const UTF32* sourceEnd);
+
+// Validation.
+size_t ValidUTF8Length(const UTF8* sourceStart, const UTF8* sourceEnd);
+size_t RepairUTF8(const UTF8* sourceStart, const UTF8* sourceEnd,
+	UTF8* target);
+
+// Searching.
+const UTF8* FindUTF8(const UTF8* sourceStart, const UTF8* sourceEnd,
+	const UTF8* pattern, size_t patternLength, bool bFoldCase);
+
+// Kernel selection.
+ConversionKernel GetConversionKernel();
+bool SetConversionKernel(ConversionKernel kernel);
+
+} // namespace Unicode
+
+#endif // _SHIMS_CVTUTF_FASTUTF_H
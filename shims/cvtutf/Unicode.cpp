@@ -11,28 +11,106 @@
 #include <string.h>
 
 #include "ConvertUTF.h"
+#include "FastUTF.h"
 
 namespace Unicode {
 
 /**
- * Margin used to allocate a buffer that can hold the conversion result, defined
- * as: Allocation Margin = Original Buffer + Margin.
- */
-#define UTF16_ALLOC_MARGIN 1.5f
-#define UTF8_ALLOC_MARGIN  3
-
-/**
- * Checks if the wchar_t is the same size as UTF-16 (2 bytes) and if char is the
- * same as UTF-8 (1 byte).
+ * Checks if the wchar_t is the same size as UTF-16 (2 bytes, Windows) or
+ * UTF-32 (4 bytes, most other platforms) and if char is the same as UTF-8
+ * (1 byte).
  * 
  * @warning This check is REQUIRED to be done by your application once at
  *          startup. If it fails you have to abort since all other operations
- *          assume that wchar_t is 2 bytes long and char is 1 byte long.
+ *          assume that wchar_t holds either UTF-16 or UTF-32 and char is 1
+ *          byte long.
  * 
  * @return TRUE if wchar_t and char are properly defined. FALSE otherwise.
  */
 bool AssumptionsCheck() {
-	return (sizeof(wchar_t) == sizeof(UTF16)) && (sizeof(char) == sizeof(UTF8));
+	return ((sizeof(wchar_t) == sizeof(UTF16)) ||
+		(sizeof(wchar_t) == sizeof(UTF32))) && (sizeof(char) == sizeof(UTF8));
+}
+
+/**
+ * Calculates the number of wide characters needed to hold the conversion of a
+ * multi-byte string (UTF-8) to a wide-character string (UTF-16 or UTF-32
+ * depending on the size of wchar_t).
+ *
+ * @param mbstr UTF-8 string to be measured.
+ * @param len   Length of the string in bytes (excluding NUL terminator).
+ *
+ * @return Number of wide characters (excluding NUL terminator).
+ */
+size_t WideCharLength(const char* mbstr, size_t len) {
+	if (sizeof(wchar_t) == sizeof(UTF32))
+		return UTF32LengthOfUTF8((const UTF8*)mbstr, (const UTF8*)mbstr + len);
+
+	return UTF16LengthOfUTF8((const UTF8*)mbstr, (const UTF8*)mbstr + len);
+}
+
+/**
+ * Calculates the number of bytes needed to hold the conversion of a
+ * wide-character string (UTF-16 or UTF-32) to a multi-byte string (UTF-8).
+ *
+ * @param wstr Wide string to be measured.
+ * @param len  Length of the string in characters (excluding NUL terminator).
+ *
+ * @return Number of bytes (excluding NUL terminator).
+ */
+size_t MultiByteLength(const wchar_t* wstr, size_t len) {
+	if (sizeof(wchar_t) == sizeof(UTF32))
+		return UTF8LengthOfUTF32((const UTF32*)wstr,
+			(const UTF32*)(wstr + len));
+
+	return UTF8LengthOfUTF16((const UTF16*)wstr, (const UTF16*)(wstr + len));
+}
+
+/**
+ * Checks how much of a multi-byte string is valid UTF-8.
+ *
+ * @param mbstr UTF-8 string to be checked.
+ * @param len   Length of the string in bytes (excluding NUL terminator).
+ *
+ * @return Number of bytes before the first ill-formed sequence, which is the
+ *         length of the string if it's valid.
+ */
+size_t ValidMultiByteLength(const char* mbstr, size_t len) {
+	return ValidUTF8Length((const UTF8*)mbstr, (const UTF8*)mbstr + len);
+}
+
+/**
+ * Repairs a multi-byte string (UTF-8) by replacing every ill-formed sequence
+ * with the replacement character (U+FFFD).
+ *
+ * @param mbstr  UTF-8 string to be repaired.
+ * @param len    Length of the string in bytes (excluding NUL terminator).
+ * @param output Buffer where the repaired string will be stored (without a
+ *               NUL terminator) or NULL to only calculate its length.
+ *
+ * @return Length of the repaired string in bytes.
+ */
+size_t RepairMultiByte(const char* mbstr, size_t len, char* output) {
+	return RepairUTF8((const UTF8*)mbstr, (const UTF8*)mbstr + len,
+		(UTF8*)output);
+}
+
+/**
+ * Finds the first occurrence of a pattern in a multi-byte string (UTF-8).
+ *
+ * @param mbstr      UTF-8 string to be searched.
+ * @param len        Length of the string in bytes (excluding NUL terminator).
+ * @param pattern    UTF-8 pattern to look for.
+ * @param lenPattern Length of the pattern in bytes (excluding NUL terminator).
+ * @param ignoreCase Ignore the case of ASCII letters?
+ *
+ * @return Pointer to the start of the first occurrence or NULL if the pattern
+ *         wasn't found.
+ */
+const char* FindMultiByte(const char* mbstr, size_t len, const char* pattern,
+						  size_t lenPattern, bool ignoreCase) {
+	return (const char*)FindUTF8((const UTF8*)mbstr, (const UTF8*)mbstr + len,
+		(const UTF8*)pattern, lenPattern, ignoreCase);
 }
 
 /**
@@ -46,43 +124,94 @@ bool AssumptionsCheck() {
  * @return TRUE if the conversion was successful, FALSE otherwise.
  */
 bool MultiByteToWideChar(const char* mbstr, wchar_t** wstr) {
-	const char* szInputStart = mbstr;
-	const char* szInputEnd = NULL;
-	wchar_t* szOutputStart = NULL;
-	wchar_t* szOutputEnd = NULL;
-
-	// Measure the input buffer and get the location of the NUL terminator.
-	size_t len = strlen(szInputStart);
-	szInputEnd = szInputStart + len;
-	len = (size_t)(len * UTF16_ALLOC_MARGIN);
-
-	// Allocate the new buffer and get its end target (NUL terminator).
-	szOutputStart = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
-	if (szOutputStart == NULL)
+	// Measure the input and output so that we allocate exactly what's needed.
+	size_t len = strlen(mbstr);
+	size_t lenOutput = WideCharLength(mbstr, len) + 1;
+
+	// Allocate the new buffer.
+	wchar_t* szOutput = (wchar_t*)malloc(lenOutput * sizeof(wchar_t));
+	if (szOutput == NULL)
 		return false;
-	szOutputEnd = szOutputStart + len;
 
 	// Perform the conversion.
-	const UTF8* szInput = (const UTF8*)szInputStart;
-	UTF16* szOutput = (UTF16*)szOutputStart;
-	ConversionResult res = ConvertUTF8toUTF16(&szInput, (const UTF8*)szInputEnd,
-		&szOutput, (UTF16*)szOutputEnd, lenientConversion);
-	if (res != conversionOK) {
-		free(szOutputStart);
+	if (!MultiByteToWideChar(mbstr, len, szOutput, lenOutput)) {
+		free(szOutput);
 		*wstr = NULL;
 		return false;
 	}
-	*szOutput = (UTF16)L'\0';
 
-	// Trim output buffer size if needed.
-	size_t lenOutput = szOutput - (UTF16*)szOutputStart + 1;
-	if (lenOutput < len) {
-		szOutputStart = (wchar_t*)realloc(szOutputStart, lenOutput *
-			sizeof(wchar_t));
+	// Set the output pointer and return.
+	*wstr = szOutput;
+	return true;
+}
+
+/**
+ * Converts a multi-byte string (UTF-8) to a wide-character string (UTF-16)
+ * into a buffer provided by the caller, which can be sized with
+ * WideCharLength.
+ *
+ * @param mbstr     UTF-8 string to be converted.
+ * @param len       Length of the string in bytes (excluding NUL terminator).
+ * @param wstr      Buffer where the NUL terminated UTF-16 string will be
+ *                  stored.
+ * @param lenOutput Size of the buffer in characters (including NUL
+ *                  terminator).
+ *
+ * @return TRUE if the conversion was successful, FALSE otherwise or if the
+ *         buffer is too small.
+ */
+bool MultiByteToWideChar(const char* mbstr, size_t len, wchar_t* wstr,
+						 size_t lenOutput) {
+	return MultiByteToWideChar(mbstr, len, wstr, lenOutput, NULL);
+}
+
+/**
+ * Converts a multi-byte string (UTF-8) to a wide-character string (UTF-16)
+ * into a buffer provided by the caller, also reporting the length of the
+ * conversion. A buffer with as many characters as the UTF-8 string has bytes
+ * (plus the NUL terminator) is always large enough.
+ *
+ * @param mbstr        UTF-8 string to be converted.
+ * @param len          Length of the string in bytes (excluding NUL
+ *                     terminator).
+ * @param wstr         Buffer where the NUL terminated UTF-16 string will be
+ *                     stored.
+ * @param lenOutput    Size of the buffer in characters (including NUL
+ *                     terminator).
+ * @param lenConverted Optional. Length of the converted string in characters
+ *                     (excluding NUL terminator).
+ *
+ * @return TRUE if the conversion was successful, FALSE otherwise or if the
+ *         buffer is too small.
+ */
+bool MultiByteToWideChar(const char* mbstr, size_t len, wchar_t* wstr,
+						 size_t lenOutput, size_t* lenConverted) {
+	// Make sure we at least have room for the NUL terminator.
+	if (lenOutput == 0)
+		return false;
+
+	// Perform the conversion to whatever wchar_t holds on this platform.
+	const UTF8* szInput = (const UTF8*)mbstr;
+	if (sizeof(wchar_t) == sizeof(UTF32)) {
+		UTF32* szOutput = (UTF32*)wstr;
+		ConversionResult res = FastConvertUTF8toUTF32(&szInput, szInput + len,
+			&szOutput, (UTF32*)(wstr + lenOutput - 1), lenientConversion);
+		if (res != conversionOK)
+			return false;
+		*szOutput = (UTF32)L'\0';
+		if (lenConverted != NULL)
+			*lenConverted = szOutput - (UTF32*)wstr;
+	} else {
+		UTF16* szOutput = (UTF16*)wstr;
+		ConversionResult res = FastConvertUTF8toUTF16(&szInput, szInput + len,
+			&szOutput, (UTF16*)(wstr + lenOutput - 1), lenientConversion);
+		if (res != conversionOK)
+			return false;
+		*szOutput = (UTF16)L'\0';
+		if (lenConverted != NULL)
+			*lenConverted = szOutput - (UTF16*)wstr;
 	}
 
-	// Set the output pointer and return.
-	*wstr = szOutputStart;
 	return true;
 }
 
@@ -97,42 +226,64 @@ bool MultiByteToWideChar(const char* mbstr, wchar_t** wstr) {
  * @return TRUE if the conversion was successful, FALSE otherwise.
  */
 bool WideCharToMultiByte(const wchar_t* wstr, char** mbstr) {
-	const wchar_t* szInputStart = wstr;
-	const wchar_t* szInputEnd = NULL;
-	char* szOutputStart = NULL;
-	char* szOutputEnd = NULL;
-
-	// Measure the input buffer and get the location of the NUL terminator.
-	size_t len = wcslen(szInputStart);
-	szInputEnd = szInputStart + len;
-	len = (size_t)(len * UTF8_ALLOC_MARGIN);
-
-	// Allocate the new buffer and get its end target (NUL terminator).
-	szOutputStart = (char*)malloc((len + 1) * sizeof(char));
-	if (szOutputStart == NULL)
+	// Measure the input and output so that we allocate exactly what's needed.
+	size_t len = wcslen(wstr);
+	size_t lenOutput = MultiByteLength(wstr, len) + 1;
+
+	// Allocate the new buffer.
+	char* szOutput = (char*)malloc(lenOutput * sizeof(char));
+	if (szOutput == NULL)
 		return false;
-	szOutputEnd = szOutputStart + len;
 
 	// Perform the conversion.
-	const UTF16* szInput = (const UTF16*)szInputStart;
-	UTF8* szOutput = (UTF8*)szOutputStart;
-	ConversionResult res = ConvertUTF16toUTF8(&szInput,
-		(const UTF16*)szInputEnd, &szOutput, (UTF8*)szOutputEnd,
-		lenientConversion);
-	if (res != conversionOK) {
-		free(szOutputStart);
+	if (!WideCharToMultiByte(wstr, len, szOutput, lenOutput)) {
+		free(szOutput);
 		*mbstr = NULL;
 		return false;
 	}
-	*szOutput = (UTF8)'\0';
-
-	// Trim output buffer size if needed.
-	size_t lenOutput = szOutput - (UTF8*)szOutputStart + 1;
-	if (lenOutput < len)
-		szOutputStart = (char*)realloc(szOutputStart, lenOutput * sizeof(char));
 
 	// Set the output pointer and return.
-	*mbstr = szOutputStart;
+	*mbstr = szOutput;
+	return true;
+}
+
+/**
+ * Converts a wide-character string (UTF-16) to a multi-byte string (UTF-8)
+ * into a buffer provided by the caller, which can be sized with
+ * MultiByteLength.
+ *
+ * @param wstr      UTF-16 string to be converted.
+ * @param len       Length of the string in characters (excluding NUL
+ *                  terminator).
+ * @param mbstr     Buffer where the NUL terminated UTF-8 string will be
+ *                  stored.
+ * @param lenOutput Size of the buffer in bytes (including NUL terminator).
+ *
+ * @return TRUE if the conversion was successful, FALSE otherwise or if the
+ *         buffer is too small.
+ */
+bool WideCharToMultiByte(const wchar_t* wstr, size_t len, char* mbstr,
+						 size_t lenOutput) {
+	// Make sure we at least have room for the NUL terminator.
+	if (lenOutput == 0)
+		return false;
+
+	// Perform the conversion from whatever wchar_t holds on this platform.
+	UTF8* szOutput = (UTF8*)mbstr;
+	ConversionResult res;
+	if (sizeof(wchar_t) == sizeof(UTF32)) {
+		const UTF32* szInput = (const UTF32*)wstr;
+		res = FastConvertUTF32toUTF8(&szInput, (const UTF32*)(wstr + len),
+			&szOutput, (UTF8*)(mbstr + lenOutput - 1), lenientConversion);
+	} else {
+		const UTF16* szInput = (const UTF16*)wstr;
+		res = FastConvertUTF16toUTF8(&szInput, (const UTF16*)(wstr + len),
+			&szOutput, (UTF8*)(mbstr + lenOutput - 1), lenientConversion);
+	}
+	if (res != conversionOK)
+		return false;
+	*szOutput = (UTF8)'\0';
+
 	return true;
 }
 
@@ -12,15 +12,34 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include <stddef.h>
 #include <wchar.h>
 
 namespace Unicode {
 	// Runtime assumptions check.
 	bool AssumptionsCheck();
 
+	// Conversion lengths.
+	size_t WideCharLength(const char* mbstr, size_t len);
+	size_t MultiByteLength(const wchar_t* wstr, size_t len);
+
+	// Validation.
+	size_t ValidMultiByteLength(const char* mbstr, size_t len);
+	size_t RepairMultiByte(const char* mbstr, size_t len, char* output);
+
+	// Searching.
+	const char* FindMultiByte(const char* mbstr, size_t len,
+		const char* pattern, size_t lenPattern, bool ignoreCase);
+
 	// Conversion functions.
 	bool MultiByteToWideChar(const char* mbstr, wchar_t** wstr);
+	bool MultiByteToWideChar(const char* mbstr, size_t len, wchar_t* wstr,
+		size_t lenOutput);
+	bool MultiByteToWideChar(const char* mbstr, size_t len, wchar_t* wstr,
+		size_t lenOutput, size_t* lenConverted);
 	bool WideCharToMultiByte(const wchar_t* wstr, char** mbstr);
+	bool WideCharToMultiByte(const wchar_t* wstr, size_t len, char* mbstr,
+		size_t lenOutput);
 }
 
 #endif // _SHIMS_CVTUTF_WRAPPER_H
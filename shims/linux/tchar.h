@@ -27,17 +27,59 @@ typedef size_t DWORD;
  */
 typedef uint8_t UINT8;
 
+#ifdef UNICODE
+	#include <wchar.h>
+#endif // UNICODE
+
 #ifdef __cplusplus
 
 /**
  * Universal C++ std::string.
  */
-#define tstring std::string
+#ifdef UNICODE
+	#define tstring std::wstring
+#else
+	#define tstring std::string
+#endif // UNICODE
 
 extern "C" {
 
 #endif // __cplusplus
 
+#ifdef UNICODE
+
+/**
+ * Unicode text wrapper. Goes through another macro so that other macros (such
+ * as __FILE__) get expanded before the prefix is pasted.
+ */
+#define __T(str) L ## str
+#define _T(str) __T(str)
+
+/**
+ * Universal character definition.
+ */
+typedef wchar_t TCHAR;
+
+/**
+ * Universal string definition.
+ */
+typedef wchar_t* LPTSTR;
+
+/**
+ * Universal constant pointer string definition.
+ */
+typedef const wchar_t* LPCTSTR;
+
+/* stdio non-standard naming. The wide sprintf always takes a buffer size. */
+#define _sntprintf swprintf
+#define _stprintf swprintf
+#define _strdup strdup
+#define _wcsdup wcsdup
+#define _tcsdup wcsdup
+#define _tcslen wcslen
+
+#else
+
 /**
  * Unicode text wrapper.
  */
@@ -64,7 +106,9 @@ typedef const char* LPCTSTR;
 #define _strdup strdup
 #define _wcsdup wcsdup
 #define _tcsdup strdup
+#define _tcslen strlen
 
+#endif // UNICODE
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,142 @@
+/**
+ * FacetIndexTest.cpp
+ * Applies random edits to a document and compares its facet index against
+ * filtering every topic.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <vector>
+
+#include "Document.h"
+#include "Indexes/FacetIndex.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random edits applied to the document.
+ */
+#define EDITS 6000
+
+/**
+ * Number of edits between each comparison against brute force.
+ */
+#define CHECK_EVERY 7
+
+/**
+ * Checks if a topic has an icon.
+ *
+ * @param field Topic to be checked.
+ * @param icon  Icon it should have.
+ *
+ * @return TRUE if the topic is an icon field with the icon.
+ */
+bool HasIcon(Field *field, field_icon_t icon) {
+	return (field != NULL) && (field->Type() == BOLOTA_TYPE_ICON) &&
+		(static_cast<IconField*>(field)->IconIndex() == icon);
+}
+
+/**
+ * Compares the facets of the topics against filtering every topic.
+ *
+ * @param index Facet index attached to the document.
+ * @param doc   Document being edited.
+ */
+void CheckFacets(FacetIndex& index, Document *doc) {
+	static const bolota_type_t types[] = {
+		BOLOTA_TYPE_TEXT, BOLOTA_TYPE_DATE, BOLOTA_TYPE_ICON, BOLOTA_TYPE_BLANK
+	};
+	std::vector<Field*> vecTopics;
+	std::vector<Field*> vecResults;
+	std::vector<Field*> vecExpected;
+	Bitmap bitmap;
+	size_t i;
+
+	// Positions.
+	PreOrder(doc->FirstTopic(), vecTopics);
+	TEST_CHECK(index.Count() == vecTopics.size(), "Topics in the facets");
+	for (i = 0; i < vecTopics.size(); i++) {
+		TEST_CHECK(index.At((uint32_t)i) == vecTopics[i], "Topic at position");
+		TEST_CHECK(index.Position(vecTopics[i]) == i, "Position of a topic");
+	}
+
+	// Types.
+	for (size_t t = 0; t < (sizeof(types) / sizeof(types[0])); t++) {
+		vecExpected.clear();
+		for (i = 0; i < vecTopics.size(); i++) {
+			if (vecTopics[i]->Type() == types[t])
+				vecExpected.push_back(vecTopics[i]);
+		}
+
+		index.Fields(index.OfType(types[t]), vecResults);
+		TEST_CHECK(vecResults == vecExpected, "Topics of a type");
+	}
+
+	// Icons along with their children and descendants.
+	field_icon_t icon = (field_icon_t)TestRandom(TOPICS_ICONS);
+	vecExpected.clear();
+	for (i = 0; i < vecTopics.size(); i++) {
+		if (HasIcon(vecTopics[i], icon))
+			vecExpected.push_back(vecTopics[i]);
+	}
+	index.Fields(index.WithIcon(icon), vecResults);
+	TEST_CHECK(vecResults == vecExpected, "Topics with an icon");
+
+	vecExpected.clear();
+	for (i = 0; i < vecTopics.size(); i++) {
+		if (HasIcon(vecTopics[i]->Parent(), icon))
+			vecExpected.push_back(vecTopics[i]);
+	}
+	index.Children(index.WithIcon(icon), bitmap);
+	index.Fields(bitmap, vecResults);
+	TEST_CHECK(vecResults == vecExpected, "Children of topics with an icon");
+
+	vecExpected.clear();
+	for (i = 0; i < vecTopics.size(); i++) {
+		for (Field *parent = vecTopics[i]->Parent(); parent != NULL;
+				parent = parent->Parent()) {
+			if (HasIcon(parent, icon)) {
+				vecExpected.push_back(vecTopics[i]);
+				break;
+			}
+		}
+	}
+	index.Descendants(index.WithIcon(icon), bitmap);
+	index.Fields(bitmap, vecResults);
+	TEST_CHECK(vecResults == vecExpected,
+		"Descendants of topics with an icon");
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	FacetIndex facets;
+
+	TestInit(argc, argv);
+
+	// Start with some topics and let the edits shape them.
+	Document *doc = RandomDocument(40);
+	doc->AttachIndex(&facets);
+	for (int i = 0; i < EDITS; i++) {
+		RandomEdit(doc, NULL);
+		TEST_CHECK(!BolotaHasError, "Document edit failed");
+		if (BolotaHasError)
+			break;
+
+		if ((i % CHECK_EVERY) == 0)
+			CheckFacets(facets, doc);
+	}
+
+	doc->DetachIndex(&facets);
+	delete doc;
+
+	return TestReport("FacetIndexTest");
+}
@@ -0,0 +1,224 @@
+/**
+ * FastUTFBench.cpp
+ * Measures the throughput of the UTF conversions of every kernel on ASCII,
+ * Latin, CJK and emoji-heavy text.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../shims/cvtutf/ConvertUTF.h"
+#include "../shims/cvtutf/FastUTF.h"
+#include "Test.h"
+
+using namespace Unicode;
+
+/**
+ * Size of the UTF-8 text of each corpus in bytes.
+ */
+#define CORPUS_SIZE (1024 * 1024)
+
+/**
+ * Minimum amount of time spent measuring each conversion in seconds.
+ */
+#define MIN_SECONDS 0.25
+
+/**
+ * Conversions that are measured.
+ */
+typedef enum {
+	convUTF8toUTF16 = 0,
+	convUTF16toUTF8,
+	convUTF8toUTF32,
+	convUTF32toUTF8
+} Conversion;
+#define CONVERSIONS_NUM 4
+
+/**
+ * Text to be converted in every encoding, along with room for the outputs.
+ */
+typedef struct {
+	const char *szName;
+	std::vector<UTF8> vec8;
+	std::vector<UTF16> vec16;
+	std::vector<UTF32> vec32;
+	std::vector<UTF8> vecOut8;
+	std::vector<UTF16> vecOut16;
+	std::vector<UTF32> vecOut32;
+} Corpus;
+
+// Words each corpus is made out of.
+static const char *g_ascii[] = {
+	"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "notes",
+	"outline", "Bolota", "topic,", "field.", "1984", "(draft)"
+};
+static const char *g_latin[] = {
+	"a\xC3\xA7\xC3\xA3o", "cora\xC3\xA7\xC3\xA3o", "p\xC3\xA3o", "voc\xC3\xAA",
+	"av\xC3\xB4", "\xC3\xA9", "caf\xC3\xA9", "na\xC3\xAFve", "stra\xC3\x9F" "e",
+	"notas", "de", "uma", "bolota", "para", "o", "jantar"
+};
+static const char *g_cjk[] = {
+	"\xE6\xA9\xA1\xE5\xAD\x90", "\xE7\xAD\x86\xE8\xA8\x98",
+	"\xE6\x96\x87\xE6\x9B\xB8", "\xE3\x81\x93\xE3\x82\x93\xE3\x81\xAB",
+	"\xE3\x81\xA1\xE3\x81\xAF", "\xED\x95\x9C\xEA\xB5\xAD\xEC\x96\xB4",
+	"\xE4\xB8\xAD\xE6\x96\x87", "\xE3\x80\x82"
+};
+static const char *g_emoji[] = {
+	"\xF0\x9F\x8C\xB0", "\xF0\x9F\x93\x9D", "\xF0\x9F\x98\x80",
+	"\xF0\x9F\x9A\x80\xF0\x9F\x9A\x80", "\xF0\x9F\x91\x8D", "ok",
+	"\xF0\x9F\x8E\x89", "\xF0\x9F\x94\xA5"
+};
+
+/**
+ * Builds a corpus out of random words.
+ *
+ * @param corpus  Corpus to be built.
+ * @param szName  Name of the corpus.
+ * @param words   Words to build the text out of.
+ * @param ulWords Number of words.
+ */
+void BuildCorpus(Corpus& corpus, const char *szName, const char **words,
+				 size_t ulWords) {
+	std::string str;
+
+	// Build the UTF-8 text.
+	corpus.szName = szName;
+	while (str.size() < CORPUS_SIZE) {
+		str += words[TestRandom((uint32_t)ulWords)];
+		str += (TestRandom(12) == 0) ? "\n" : " ";
+	}
+	corpus.vec8.assign(str.begin(), str.end());
+
+	// Convert it with the reference implementation.
+	const UTF8 *src8 = &corpus.vec8[0];
+	corpus.vec16.resize(corpus.vec8.size());
+	UTF16 *dst16 = &corpus.vec16[0];
+	ConvertUTF8toUTF16(&src8, src8 + corpus.vec8.size(), &dst16,
+		dst16 + corpus.vec16.size(), strictConversion);
+	corpus.vec16.resize(dst16 - &corpus.vec16[0]);
+
+	src8 = &corpus.vec8[0];
+	corpus.vec32.resize(corpus.vec8.size());
+	UTF32 *dst32 = &corpus.vec32[0];
+	ConvertUTF8toUTF32(&src8, src8 + corpus.vec8.size(), &dst32,
+		dst32 + corpus.vec32.size(), strictConversion);
+	corpus.vec32.resize(dst32 - &corpus.vec32[0]);
+
+	// Room for the outputs.
+	corpus.vecOut8.resize(corpus.vec8.size());
+	corpus.vecOut16.resize(corpus.vec16.size());
+	corpus.vecOut32.resize(corpus.vec32.size());
+}
+
+/**
+ * Converts the text of a corpus once.
+ *
+ * @param corpus     Corpus to be converted.
+ * @param conv       Conversion to be made.
+ * @param bReference Use the reference implementation of CVTUTF?
+ *
+ * @return TRUE if the whole text was converted.
+ */
+bool Convert(Corpus& corpus, Conversion conv, bool bReference) {
+	const UTF8 *src8 = &corpus.vec8[0];
+	const UTF16 *src16 = &corpus.vec16[0];
+	const UTF32 *src32 = &corpus.vec32[0];
+	UTF8 *dst8 = &corpus.vecOut8[0];
+	UTF16 *dst16 = &corpus.vecOut16[0];
+	UTF32 *dst32 = &corpus.vecOut32[0];
+	UTF8 *end8 = dst8 + corpus.vecOut8.size();
+	UTF16 *end16 = dst16 + corpus.vecOut16.size();
+	UTF32 *end32 = dst32 + corpus.vecOut32.size();
+	ConversionResult res;
+
+	switch (conv) {
+	case convUTF8toUTF16:
+		res = (bReference ? ConvertUTF8toUTF16 : FastConvertUTF8toUTF16)(
+			&src8, src8 + corpus.vec8.size(), &dst16, end16, strictConversion);
+		break;
+	case convUTF16toUTF8:
+		res = (bReference ? ConvertUTF16toUTF8 : FastConvertUTF16toUTF8)(
+			&src16, src16 + corpus.vec16.size(), &dst8, end8, strictConversion);
+		break;
+	case convUTF8toUTF32:
+		res = (bReference ? ConvertUTF8toUTF32 : FastConvertUTF8toUTF32)(
+			&src8, src8 + corpus.vec8.size(), &dst32, end32, strictConversion);
+		break;
+	default:
+		res = (bReference ? ConvertUTF32toUTF8 : FastConvertUTF32toUTF8)(
+			&src32, src32 + corpus.vec32.size(), &dst8, end8, strictConversion);
+		break;
+	}
+
+	return res == conversionOK;
+}
+
+/**
+ * Measures the throughput of a conversion.
+ *
+ * @param corpus     Corpus to be converted.
+ * @param conv       Conversion to be measured.
+ * @param bReference Use the reference implementation of CVTUTF?
+ *
+ * @return Throughput in gigabytes of UTF-8 text per second.
+ */
+double Measure(Corpus& corpus, Conversion conv, bool bReference) {
+	unsigned long ulRounds = 0;
+	double dStart = TestSeconds();
+	double dElapsed;
+
+	do {
+		TEST_CHECK(Convert(corpus, conv, bReference), "Corpus conversion");
+		ulRounds++;
+		dElapsed = TestSeconds() - dStart;
+	} while (dElapsed < MIN_SECONDS);
+
+	return ((double)corpus.vec8.size() * ulRounds) / dElapsed / 1e9;
+}
+
+/**
+ * Runs the benchmark.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	static const char *convs[CONVERSIONS_NUM] = {
+		"UTF-8 -> UTF-16", "UTF-16 -> UTF-8", "UTF-8 -> UTF-32",
+		"UTF-32 -> UTF-8"
+	};
+	Corpus corpora[4];
+
+	TestInit(argc, argv);
+	BuildCorpus(corpora[0], "ASCII", g_ascii, sizeof(g_ascii) / sizeof(char*));
+	BuildCorpus(corpora[1], "Latin", g_latin, sizeof(g_latin) / sizeof(char*));
+	BuildCorpus(corpora[2], "CJK", g_cjk, sizeof(g_cjk) / sizeof(char*));
+	BuildCorpus(corpora[3], "Emoji", g_emoji, sizeof(g_emoji) / sizeof(char*));
+
+	printf("Throughput in GB/s of UTF-8 text (%d KB per corpus)\n",
+		CORPUS_SIZE / 1024);
+	printf("%-16s %-6s %8s %8s %8s %8s\n", "Conversion", "Corpus", "CVTUTF",
+		"Scalar", "SSE2", "AVX2");
+	for (int c = 0; c < CONVERSIONS_NUM; c++) {
+		for (int i = 0; i < 4; i++) {
+			printf("%-16s %-6s %8.2f", convs[c], corpora[i].szName,
+				Measure(corpora[i], (Conversion)c, true));
+
+			for (int k = kernelScalar; k <= kernelAVX2; k++) {
+				if (SetConversionKernel((ConversionKernel)k)) {
+					printf(" %8.2f", Measure(corpora[i], (Conversion)c, false));
+				} else {
+					printf(" %8s", "-");
+				}
+			}
+			printf("\n");
+		}
+	}
+
+	return TestReport("FastUTFBench");
+}
@@ -0,0 +1,298 @@
+/**
+ * FastUTFTest.cpp
+ * Compares the fast UTF conversions of every kernel against the reference
+ * implementation of CVTUTF using random (and often broken) text.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <string.h>
+#include <vector>
+
+#include "../shims/cvtutf/ConvertUTF.h"
+#include "../shims/cvtutf/FastUTF.h"
+#include "Test.h"
+
+using namespace Unicode;
+
+/**
+ * Number of random texts checked with each kernel.
+ */
+#define ROUNDS 20000
+
+/**
+ * Maximum number of characters in a random text.
+ */
+#define MAX_CHARS 160
+
+// Stand-ins for the contents of empty texts.
+static const UTF8 g_empty8[1] = { 0 };
+static const UTF16 g_empty16[1] = { 0 };
+
+/**
+ * Gets a random code point, mostly well-formed and sometimes not.
+ *
+ * @return Random code point, which may be a surrogate or out of range.
+ */
+UTF32 RandomCodePoint() {
+	switch (TestRandom(10)) {
+	case 0:
+		return 0x80 + TestRandom(0x780);
+	case 1:
+		return 0x800 + TestRandom(0xF800);
+	case 2:
+		return 0x10000 + TestRandom(0x100000);
+	case 3:
+		return (TestRandom(8) == 0) ? 0xD800 + TestRandom(0x800) :
+			0x4E00 + TestRandom(0x5200);
+	case 4:
+		return (TestRandom(16) == 0) ? 0x110000 + TestRandom(0x1000) :
+			TestRandom(0x80);
+	default:
+		return TestRandom(0x80);
+	}
+}
+
+/**
+ * Generates a random UTF-8 text, with long runs of ASCII and the occasional
+ * stray byte.
+ *
+ * @param vecText Vector to receive the text.
+ */
+void RandomUTF8(std::vector<UTF8>& vecText) {
+	size_t ulChars = TestRandom(MAX_CHARS);
+	bool bBroken = TestRandom(3) == 0;
+
+	vecText.clear();
+	for (size_t i = 0; i < ulChars; i++) {
+		UTF8 buf[4];
+		UTF32 cp = RandomCodePoint();
+		const UTF32 *src = &cp;
+		UTF8 *dst = buf;
+
+		if (bBroken && (TestRandom(12) == 0)) {
+			vecText.push_back((UTF8)TestRandom(0x100));
+			continue;
+		}
+
+		ConvertUTF32toUTF8(&src, src + 1, &dst, buf + 4, lenientConversion);
+		vecText.insert(vecText.end(), buf, dst);
+	}
+}
+
+/**
+ * Generates a random UTF-16 text, sometimes with unpaired surrogates.
+ *
+ * @param vecText Vector to receive the text.
+ */
+void RandomUTF16(std::vector<UTF16>& vecText) {
+	size_t ulChars = TestRandom(MAX_CHARS);
+
+	vecText.clear();
+	for (size_t i = 0; i < ulChars; i++) {
+		UTF32 cp = RandomCodePoint();
+		if (cp > 0x10FFFF)
+			cp = TestRandom(0x80);
+
+		if (cp >= 0x10000) {
+			cp -= 0x10000;
+			vecText.push_back((UTF16)(0xD800 + (cp >> 10)));
+			vecText.push_back((UTF16)(0xDC00 + (cp & 0x3FF)));
+		} else {
+			vecText.push_back((UTF16)cp);
+		}
+	}
+}
+
+/**
+ * Compares both UTF-8 to UTF-16 conversions.
+ *
+ * @param vecText UTF-8 text to be converted.
+ * @param flags   Conversion flags.
+ */
+void CheckUTF8toUTF16(const std::vector<UTF8>& vecText,
+					  ConversionFlags flags) {
+	size_t ulRoom = TestRandom((uint32_t)vecText.size() + 8);
+	std::vector<UTF16> vecRef(ulRoom + 1);
+	std::vector<UTF16> vecFast(ulRoom + 1);
+	const UTF8 *begin = vecText.empty() ? g_empty8 : &vecText[0];
+	const UTF8 *end = begin + vecText.size();
+	const UTF8 *srcRef = begin;
+	const UTF8 *srcFast = begin;
+	UTF16 *dstRef = &vecRef[0];
+	UTF16 *dstFast = &vecFast[0];
+
+	ConversionResult resRef = ConvertUTF8toUTF16(&srcRef, end, &dstRef,
+		dstRef + ulRoom, flags);
+	ConversionResult resFast = FastConvertUTF8toUTF16(&srcFast, end,
+		&dstFast, dstFast + ulRoom, flags);
+	size_t ulOut = dstRef - &vecRef[0];
+
+	TEST_CHECK(resRef == resFast, "UTF-8 to UTF-16 result");
+	TEST_CHECK(srcRef == srcFast, "UTF-8 to UTF-16 input consumed");
+	TEST_CHECK(dstRef - &vecRef[0] == dstFast - &vecFast[0],
+		"UTF-8 to UTF-16 output length");
+	TEST_CHECK(memcmp(&vecRef[0], &vecFast[0], ulOut * sizeof(UTF16)) == 0,
+		"UTF-8 to UTF-16 output");
+
+	// The length is only exact for text that can be converted.
+	if ((resRef == conversionOK) && (flags == strictConversion)) {
+		TEST_CHECK(UTF16LengthOfUTF8(begin, end) == ulOut,
+			"UTF-16 length of UTF-8");
+	}
+}
+
+/**
+ * Compares both UTF-16 to UTF-8 conversions.
+ *
+ * @param vecText UTF-16 text to be converted.
+ * @param flags   Conversion flags.
+ */
+void CheckUTF16toUTF8(const std::vector<UTF16>& vecText,
+					  ConversionFlags flags) {
+	size_t ulRoom = TestRandom((uint32_t)(vecText.size() * 3) + 8);
+	std::vector<UTF8> vecRef(ulRoom + 1);
+	std::vector<UTF8> vecFast(ulRoom + 1);
+	const UTF16 *begin = vecText.empty() ? g_empty16 : &vecText[0];
+	const UTF16 *end = begin + vecText.size();
+	const UTF16 *srcRef = begin;
+	const UTF16 *srcFast = begin;
+	UTF8 *dstRef = &vecRef[0];
+	UTF8 *dstFast = &vecFast[0];
+
+	ConversionResult resRef = ConvertUTF16toUTF8(&srcRef, end, &dstRef,
+		dstRef + ulRoom, flags);
+	ConversionResult resFast = FastConvertUTF16toUTF8(&srcFast, end,
+		&dstFast, dstFast + ulRoom, flags);
+	size_t ulOut = dstRef - &vecRef[0];
+
+	TEST_CHECK(resRef == resFast, "UTF-16 to UTF-8 result");
+	TEST_CHECK(srcRef == srcFast, "UTF-16 to UTF-8 input consumed");
+	TEST_CHECK(dstRef - &vecRef[0] == dstFast - &vecFast[0],
+		"UTF-16 to UTF-8 output length");
+	TEST_CHECK(memcmp(&vecRef[0], &vecFast[0], ulOut) == 0,
+		"UTF-16 to UTF-8 output");
+	if (resRef == conversionOK) {
+		TEST_CHECK(UTF8LengthOfUTF16(begin, end) == ulOut,
+			"UTF-8 length of UTF-16");
+	}
+}
+
+/**
+ * Compares both UTF-8 to UTF-32 conversions.
+ *
+ * @param vecText UTF-8 text to be converted.
+ * @param flags   Conversion flags.
+ */
+void CheckUTF8toUTF32(const std::vector<UTF8>& vecText,
+					  ConversionFlags flags) {
+	size_t ulRoom = TestRandom((uint32_t)vecText.size() + 8);
+	std::vector<UTF32> vecRef(ulRoom + 1);
+	std::vector<UTF32> vecFast(ulRoom + 1);
+	const UTF8 *begin = vecText.empty() ? g_empty8 : &vecText[0];
+	const UTF8 *end = begin + vecText.size();
+	const UTF8 *srcRef = begin;
+	const UTF8 *srcFast = begin;
+	UTF32 *dstRef = &vecRef[0];
+	UTF32 *dstFast = &vecFast[0];
+
+	ConversionResult resRef = ConvertUTF8toUTF32(&srcRef, end, &dstRef,
+		dstRef + ulRoom, flags);
+	ConversionResult resFast = FastConvertUTF8toUTF32(&srcFast, end,
+		&dstFast, dstFast + ulRoom, flags);
+	size_t ulOut = dstRef - &vecRef[0];
+
+	TEST_CHECK(resRef == resFast, "UTF-8 to UTF-32 result");
+	TEST_CHECK(srcRef == srcFast, "UTF-8 to UTF-32 input consumed");
+	TEST_CHECK(dstRef - &vecRef[0] == dstFast - &vecFast[0],
+		"UTF-8 to UTF-32 output length");
+	TEST_CHECK(memcmp(&vecRef[0], &vecFast[0], ulOut * sizeof(UTF32)) == 0,
+		"UTF-8 to UTF-32 output");
+	if ((resRef == conversionOK) && (flags == strictConversion)) {
+		TEST_CHECK(UTF32LengthOfUTF8(begin, end) == ulOut,
+			"UTF-32 length of UTF-8");
+	}
+}
+
+/**
+ * Checks the validation and searching of UTF-8 text against the reference
+ * conversion and a naive search.
+ *
+ * @param vecText UTF-8 text to be checked.
+ */
+void CheckValidation(const std::vector<UTF8>& vecText) {
+	std::vector<UTF32> vecOut(vecText.size() + 1);
+	const UTF8 *begin = vecText.empty() ? g_empty8 : &vecText[0];
+	const UTF8 *end = begin + vecText.size();
+	const UTF8 *src = begin;
+	UTF32 *dst = &vecOut[0];
+
+	// The reference conversion stops right at the first ill-formed sequence.
+	ConvertUTF8toUTF32(&src, end, &dst, dst + vecOut.size(),
+		strictConversion);
+	TEST_CHECK(ValidUTF8Length(begin, end) == (size_t)(src - begin),
+		"Length of the valid UTF-8 prefix");
+
+	// Repaired text must always be valid and keep the valid prefix.
+	size_t ulRepaired = RepairUTF8(begin, end, NULL);
+	std::vector<UTF8> vecRepaired(ulRepaired + 1);
+	TEST_CHECK(RepairUTF8(begin, end, &vecRepaired[0]) == ulRepaired,
+		"Length of the repaired UTF-8");
+	TEST_CHECK(ValidUTF8Length(&vecRepaired[0], &vecRepaired[0] +
+		ulRepaired) == ulRepaired, "Repaired UTF-8 is valid");
+	TEST_CHECK(memcmp(begin, &vecRepaired[0], src - begin) == 0,
+		"Repaired UTF-8 keeps the valid prefix");
+
+	// Search for a piece of the text, which is found at its first occurrence.
+	if (vecText.empty())
+		return;
+	size_t ulStart = TestRandom((uint32_t)vecText.size());
+	size_t ulLength = 1 + TestRandom((uint32_t)(vecText.size() - ulStart));
+	if (ulLength > 8)
+		ulLength = 1 + TestRandom(8);
+	const UTF8 *pattern = begin + ulStart;
+	const UTF8 *naive = NULL;
+	for (const UTF8 *p = begin; (p + ulLength) <= end; p++) {
+		if (memcmp(p, pattern, ulLength) == 0) {
+			naive = p;
+			break;
+		}
+	}
+	TEST_CHECK(FindUTF8(begin, end, pattern, ulLength, false) == naive,
+		"Position of a UTF-8 pattern");
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	std::vector<UTF8> vec8;
+	std::vector<UTF16> vec16;
+
+	TestInit(argc, argv);
+	for (int k = kernelScalar; k <= kernelAVX2; k++) {
+		// Skip kernels that this machine can't run.
+		if (!SetConversionKernel((ConversionKernel)k))
+			continue;
+
+		for (int i = 0; i < ROUNDS; i++) {
+			ConversionFlags flags = (TestRandom(2) == 0) ?
+				strictConversion : lenientConversion;
+
+			RandomUTF8(vec8);
+			CheckUTF8toUTF16(vec8, flags);
+			CheckUTF8toUTF32(vec8, flags);
+			CheckValidation(vec8);
+
+			RandomUTF16(vec16);
+			CheckUTF16toUTF8(vec16, flags);
+		}
+	}
+
+	return TestReport("FastUTFTest");
+}
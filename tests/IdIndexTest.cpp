@@ -0,0 +1,188 @@
+/**
+ * IdIndexTest.cpp
+ * Checks that topics keep unique identifiers that can be looked up through
+ * random edits and round trips through files and flat documents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <set>
+#include <vector>
+
+#include "Document.h"
+#include "FlatDocument.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random edits applied to the document.
+ */
+#define EDITS 6000
+
+/**
+ * Number of edits between each comparison against brute force.
+ */
+#define CHECK_EVERY 7
+
+/**
+ * Number of random documents written to a file and read back.
+ */
+#define DOCUMENTS 60
+
+/**
+ * File used to store the documents.
+ */
+#define TEMP_FILE "IdIndexTest.bol"
+
+/**
+ * Compares the identifiers of the topics against the document lookups.
+ *
+ * @param doc     Document to be checked.
+ * @param vecGone Identifiers of topics that were deleted.
+ */
+void CheckIdentifiers(Document *doc, const std::vector<field_id_t>& vecGone) {
+	std::vector<Field*> vecTopics;
+	std::set<field_id_t> setIDs;
+
+	PreOrder(doc->FirstTopic(), vecTopics);
+	for (size_t i = 0; i < vecTopics.size(); i++) {
+		field_id_t id = vecTopics[i]->ID();
+
+		TEST_CHECK(id != BOLOTA_FIELD_ID_NONE, "Topic without an identifier");
+		TEST_CHECK(setIDs.insert(id).second, "Duplicate topic identifier");
+		TEST_CHECK(doc->FindTopic(id) == vecTopics[i],
+			"Topic found by its identifier");
+	}
+	for (size_t i = 0; i < vecGone.size(); i++) {
+		TEST_CHECK(doc->FindTopic(vecGone[i]) == NULL,
+			"Deleted topic found by its identifier");
+	}
+}
+
+/**
+ * Checks that a new topic doesn't reuse any of the identifiers of the topics
+ * that are already in a document.
+ *
+ * @param doc       Document to add the topic to.
+ * @param vecTopics Topics that were in the document.
+ */
+void CheckNewIdentifier(Document *doc, const std::vector<Field*>& vecTopics) {
+	Field *field = new TextField("New");
+
+	doc->AppendTopic(field);
+	for (size_t i = 0; i < vecTopics.size(); i++) {
+		TEST_CHECK(vecTopics[i]->ID() != field->ID(),
+			"Identifier of a new topic");
+	}
+	doc->DeleteTopic(field);
+}
+
+/**
+ * Checks the identifiers of a flat document read from a file.
+ *
+ * @param szPath    Path to the file.
+ * @param vecTopics Topics of the original document in display order.
+ */
+void CheckFlat(LPCTSTR szPath, const std::vector<Field*>& vecTopics) {
+	FlatDocument *flat = FlatDocument::ReadFile(szPath);
+	TEST_CHECK(flat != NULL, "Reading the flat document");
+	if (flat == NULL)
+		return;
+
+	// Identifiers of the flattened topics.
+	TEST_CHECK(flat->Count() == vecTopics.size(), "Number of flat topics");
+	for (uint32_t i = 0; (i < flat->Count()) && (i < vecTopics.size()); i++) {
+		TEST_CHECK(flat->ID(i) == vecTopics[i]->ID(),
+			"Identifier of a flat topic");
+		TEST_CHECK(strcmp(flat->Text(i), TextOf(vecTopics[i])) == 0,
+			"Text of a flat topic");
+	}
+
+	// Unflatten it and make sure the identifiers are still usable.
+	Document *doc = flat->ToDocument();
+	delete flat;
+	TEST_CHECK(doc != NULL, "Unflattened document");
+	if (doc == NULL)
+		return;
+	CompareTopics(vecTopics.empty() ? NULL : vecTopics[0], doc->FirstTopic());
+	for (size_t i = 0; i < vecTopics.size(); i++) {
+		Field *field = doc->FindTopic(vecTopics[i]->ID());
+		TEST_CHECK((field != NULL) && SameField(field, vecTopics[i]),
+			"Unflattened topic found by its identifier");
+	}
+	CheckNewIdentifier(doc, vecTopics);
+	delete doc;
+}
+
+/**
+ * Writes random documents to a file and checks the identifiers of the topics
+ * that are read back.
+ */
+void CheckRoundTrips() {
+	UString strPath(TEMP_FILE);
+
+	for (int i = 0; i < DOCUMENTS; i++) {
+		std::vector<Field*> vecTopics;
+		Document *doc = RandomDocument(TestRandom(300));
+		PreOrder(doc->FirstTopic(), vecTopics);
+
+		// Write the document and read it back.
+		TEST_CHECK(doc->WriteFile(strPath.GetNativeString(), false) !=
+			BOLOTA_ERR_SIZET, "Writing the document");
+		Document *loaded = Document::ReadFile(strPath.GetNativeString());
+		TEST_CHECK(loaded != NULL, "Reading the document");
+		if (loaded == NULL) {
+			delete doc;
+			break;
+		}
+
+		// Compare the topics and their lookups.
+		CompareTopics(doc->FirstTopic(), loaded->FirstTopic());
+		for (size_t j = 0; j < vecTopics.size(); j++) {
+			Field *field = loaded->FindTopic(vecTopics[j]->ID());
+			TEST_CHECK((field != NULL) && SameField(field, vecTopics[j]),
+				"Read topic found by its identifier");
+		}
+		CheckNewIdentifier(loaded, vecTopics);
+		CheckFlat(strPath.GetNativeString(), vecTopics);
+
+		delete loaded;
+		delete doc;
+	}
+
+	remove(TEMP_FILE);
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	std::vector<field_id_t> vecGone;
+
+	TestInit(argc, argv);
+
+	// Edit a document and look its topics up along the way.
+	Document *doc = RandomDocument(40);
+	for (int i = 0; i < EDITS; i++) {
+		RandomEdit(doc, &vecGone);
+		TEST_CHECK(!BolotaHasError, "Document edit failed");
+		if (BolotaHasError)
+			break;
+
+		if ((i % CHECK_EVERY) == 0)
+			CheckIdentifiers(doc, vecGone);
+	}
+	delete doc;
+
+	CheckRoundTrips();
+
+	return TestReport("IdIndexTest");
+}
@@ -0,0 +1,210 @@
+/**
+ * LongTextTest.cpp
+ * Writes documents with texts that are too long to fit in a field and checks
+ * that they are read back whole.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+#include "FlatDocument.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random documents written to a file and read back.
+ */
+#define DOCUMENTS 40
+
+/**
+ * File used to store the documents.
+ */
+#define TEMP_FILE "LongTextTest.bol"
+
+/**
+ * Builds a random text around a length, with characters of every size so that
+ * some of them end up straddling the limit of a field.
+ *
+ * @param ulLength Approximate length of the text in bytes.
+ *
+ * @return Random text.
+ */
+std::string LongText(size_t ulLength) {
+	std::string str;
+
+	while (str.size() < ulLength) {
+		str += g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+		str += " ";
+	}
+
+	return str;
+}
+
+/**
+ * Gives a topic a long text, sometimes by editing it in place so that it ends
+ * up in a rope.
+ *
+ * @param doc   Document the topic belongs to.
+ * @param field Topic to get the text.
+ */
+void SetLongText(Document *doc, Field *field) {
+	size_t ulLength = BOLOTA_FIELD_TEXT_MAX - 8 + TestRandom(16);
+
+	switch (TestRandom(4)) {
+	case 0:
+		ulLength = BOLOTA_FIELD_TEXT_MAX + 1 + TestRandom(300000);
+		break;
+	case 1:
+		if (field->HasText() && !field->Text()->Empty()) {
+			UString strText(*field->Text());
+			std::string strLong = LongText(ulLength);
+
+			strText.Insert((TestRandom(2) == 0) ? 0 : strText.Length(),
+				strLong.c_str());
+			field->SetText(strText);
+			doc->TopicChanged(field);
+			return;
+		}
+		break;
+	}
+
+	doc->SetTopicText(field, LongText(ulLength).c_str());
+}
+
+/**
+ * Checks that the part of the texts stored in the fields is cut at a character
+ * boundary and fits in them.
+ *
+ * @param vecTopics Topics of the document in display order.
+ */
+void CheckCuts(const std::vector<Field*>& vecTopics) {
+	for (size_t i = 0; i < vecTopics.size(); i++) {
+		Field *field = vecTopics[i];
+		if (!field->HasText())
+			continue;
+
+		size_t ulLength = field->Text()->Length();
+		uint16_t usStored = field->TextLength();
+		TEST_CHECK(field->HasLongText() == (ulLength > BOLOTA_FIELD_TEXT_MAX),
+			"Long text flag");
+		TEST_CHECK(usStored <= BOLOTA_FIELD_TEXT_MAX, "Stored text length");
+		TEST_CHECK(field->FieldLength() > usStored, "Field length overflow");
+		if (field->HasLongText()) {
+			const char *mbstr = field->Text()->GetMultiByteString();
+			TEST_CHECK((usStored + 4) > BOLOTA_FIELD_TEXT_MAX,
+				"Too much of the text left out");
+			TEST_CHECK((mbstr[usStored] & 0xC0) != 0x80,
+				"Text cut in the middle of a character");
+		} else {
+			TEST_CHECK(usStored == ulLength, "Short text length");
+		}
+	}
+}
+
+/**
+ * Compares the texts of a flat document against the original topics.
+ *
+ * @param flat      Flat document to be checked.
+ * @param doc       Original document.
+ * @param vecTopics Topics of the original document in display order.
+ */
+void CheckFlat(FlatDocument *flat, Document *doc,
+			   const std::vector<Field*>& vecTopics) {
+	TEST_CHECK(strcmp(flat->Title(), TextOf(doc->Title())) == 0,
+		"Flat title");
+	TEST_CHECK(flat->Count() == vecTopics.size(), "Number of flat topics");
+	for (uint32_t i = 0; (i < flat->Count()) && (i < vecTopics.size()); i++) {
+		TEST_CHECK(strcmp(flat->Text(i), TextOf(vecTopics[i])) == 0,
+			"Text of a flat topic");
+		TEST_CHECK(flat->TextLength(i) == strlen(TextOf(vecTopics[i])),
+			"Length of a flat topic");
+	}
+}
+
+/**
+ * Writes a document to a file and checks what's read back.
+ *
+ * @param doc Document to be written.
+ */
+void CheckRoundTrip(Document *doc) {
+	UString strPath(TEMP_FILE);
+	std::vector<Field*> vecTopics;
+
+	PreOrder(doc->FirstTopic(), vecTopics);
+	CheckCuts(vecTopics);
+	TEST_CHECK(doc->WriteFile(strPath.GetNativeString(), false) !=
+		BOLOTA_ERR_SIZET, "Writing the document");
+
+	// Read it back, both with and without interning the texts.
+	for (int i = 0; i < 2; i++) {
+		Document *loaded = Document::ReadFile(strPath.GetNativeString(),
+			i == 1, BOLOTA_TEXT_STRICT);
+		TEST_CHECK(loaded != NULL, "Reading the document");
+		if (loaded == NULL)
+			return;
+
+		TEST_CHECK(strcmp(TextOf(loaded->Title()), TextOf(doc->Title())) == 0,
+			"Title of the document");
+		TEST_CHECK(strcmp(TextOf(loaded->SubTitle()),
+			TextOf(doc->SubTitle())) == 0, "Subtitle of the document");
+		CompareTopics(doc->FirstTopic(), loaded->FirstTopic());
+		delete loaded;
+	}
+
+	// Flat documents read from the file and from the object.
+	FlatDocument *flat = FlatDocument::ReadFile(strPath.GetNativeString());
+	TEST_CHECK(flat != NULL, "Reading the flat document");
+	if (flat != NULL) {
+		CheckFlat(flat, doc, vecTopics);
+
+		Document *unflat = flat->ToDocument();
+		CompareTopics(doc->FirstTopic(), unflat->FirstTopic());
+		delete unflat;
+		delete flat;
+	}
+	flat = FlatDocument::FromDocument(doc);
+	CheckFlat(flat, doc, vecTopics);
+	delete flat;
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	TestInit(argc, argv);
+
+	for (int i = 0; i < DOCUMENTS; i++) {
+		std::vector<Field*> vecTopics;
+		Document *doc = RandomDocument(TestRandom(100));
+
+		// Make some of the texts too long for their fields.
+		PreOrder(doc->FirstTopic(), vecTopics);
+		for (size_t j = 0; j < vecTopics.size(); j++) {
+			if ((vecTopics[j]->Type() != BOLOTA_TYPE_BLANK) &&
+					(TestRandom(8) == 0)) {
+				SetLongText(doc, vecTopics[j]);
+			}
+		}
+		if (TestRandom(4) == 0)
+			doc->Title()->SetText(LongText(BOLOTA_FIELD_TEXT_MAX + 10).c_str());
+		if (TestRandom(4) == 0)
+			doc->EnableTrigramIndex(true);
+
+		CheckRoundTrip(doc);
+		delete doc;
+	}
+
+	remove(TEMP_FILE);
+	return TestReport("LongTextTest");
+}
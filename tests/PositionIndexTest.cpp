@@ -0,0 +1,169 @@
+/**
+ * PositionIndexTest.cpp
+ * Applies random edits and collapses to a document and compares its position
+ * index against walking every topic.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <set>
+#include <vector>
+
+#include "Document.h"
+#include "Indexes/PositionIndex.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random edits applied to the document.
+ */
+#define EDITS 6000
+
+/**
+ * Number of edits between each comparison against brute force.
+ */
+#define CHECK_EVERY 7
+
+/**
+ * Checks if a topic should be visible, meaning none of its ancestors are
+ * collapsed.
+ *
+ * @param field        Topic to be checked.
+ * @param setCollapsed Identifiers of the collapsed topics.
+ *
+ * @return TRUE if the topic should be visible.
+ */
+bool ShouldBeVisible(Field *field, const std::set<field_id_t>& setCollapsed) {
+	for (Field *parent = field->Parent(); parent != NULL;
+			parent = parent->Parent()) {
+		if (setCollapsed.count(parent->ID()) > 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Compares the positions and visible rows of the topics against walking
+ * every topic of the document.
+ *
+ * @param index        Position index attached to the document.
+ * @param doc          Document being edited.
+ * @param setCollapsed Identifiers of the topics that were collapsed.
+ */
+void CheckPositions(PositionIndex& index, Document *doc,
+					const std::set<field_id_t>& setCollapsed) {
+	std::vector<Field*> vecTopics;
+	std::vector<Field*> vecVisible;
+	size_t i;
+
+	// Positions.
+	PreOrder(doc->FirstTopic(), vecTopics);
+	TEST_CHECK(index.Count() == vecTopics.size(), "Topics in the index");
+	for (i = 0; i < vecTopics.size(); i++) {
+		TEST_CHECK(index.At((uint32_t)i) == vecTopics[i], "Topic at position");
+		TEST_CHECK(index.Position(vecTopics[i]) == i, "Position of a topic");
+		TEST_CHECK(index.IsExpanded(vecTopics[i]) ==
+			(setCollapsed.count(vecTopics[i]->ID()) == 0),
+			"Collapse state of a topic");
+
+		if (ShouldBeVisible(vecTopics[i], setCollapsed)) {
+			vecVisible.push_back(vecTopics[i]);
+		} else {
+			TEST_CHECK(!index.IsVisible(vecTopics[i]), "Hidden topic");
+			TEST_CHECK(index.Row(vecTopics[i]) == BOLOTA_POS_NONE,
+				"Row of a hidden topic");
+		}
+	}
+	TEST_CHECK(index.At((uint32_t)vecTopics.size()) == NULL,
+		"Topic past the end");
+
+	// Visible rows.
+	TEST_CHECK(index.VisibleCount() == vecVisible.size(), "Visible topics");
+	for (i = 0; i < vecVisible.size(); i++) {
+		Field *prev = (i > 0) ? vecVisible[i - 1] : NULL;
+		Field *next = ((i + 1) < vecVisible.size()) ? vecVisible[i + 1] : NULL;
+
+		TEST_CHECK(index.IsVisible(vecVisible[i]), "Visible topic");
+		TEST_CHECK(index.Row(vecVisible[i]) == i, "Row of a topic");
+		TEST_CHECK(index.VisibleAt((uint32_t)i) == vecVisible[i],
+			"Topic at a row");
+		TEST_CHECK(index.PreviousVisible(vecVisible[i]) == prev,
+			"Previous visible topic");
+		TEST_CHECK(index.NextVisible(vecVisible[i]) == next,
+			"Next visible topic");
+	}
+	TEST_CHECK(index.VisibleAt((uint32_t)vecVisible.size()) == NULL,
+		"Topic past the last row");
+}
+
+/**
+ * Expands or collapses a random topic.
+ *
+ * @param index        Position index attached to the document.
+ * @param doc          Document being edited.
+ * @param setCollapsed Identifiers of the collapsed topics to be kept up to
+ *                     date.
+ */
+void RandomCollapse(PositionIndex& index, Document *doc,
+					std::set<field_id_t>& setCollapsed) {
+	std::vector<Field*> vecTopics;
+
+	PreOrder(doc->FirstTopic(), vecTopics);
+	if (vecTopics.empty())
+		return;
+
+	Field *field = vecTopics[TestRandom((uint32_t)vecTopics.size())];
+	bool bExpanded = TestRandom(3) == 0;
+	index.SetExpanded(field, bExpanded);
+	if (bExpanded) {
+		setCollapsed.erase(field->ID());
+	} else {
+		setCollapsed.insert(field->ID());
+	}
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	std::set<field_id_t> setCollapsed;
+	std::vector<field_id_t> vecGone;
+	PositionIndex positions;
+
+	TestInit(argc, argv);
+
+	// Start with some topics and let the edits and collapses shape them.
+	Document *doc = RandomDocument(40);
+	doc->AttachIndex(&positions);
+	for (int i = 0; i < EDITS; i++) {
+		if (TestRandom(3) == 0) {
+			RandomCollapse(positions, doc, setCollapsed);
+		} else {
+			// Replaced topics keep their identifier and collapse state while
+			// deleted ones are forgotten.
+			vecGone.clear();
+			RandomEdit(doc, &vecGone);
+			TEST_CHECK(!BolotaHasError, "Document edit failed");
+			if (BolotaHasError)
+				break;
+			for (size_t j = 0; j < vecGone.size(); j++)
+				setCollapsed.erase(vecGone[j]);
+		}
+
+		if ((i % CHECK_EVERY) == 0)
+			CheckPositions(positions, doc, setCollapsed);
+	}
+
+	doc->DetachIndex(&positions);
+	delete doc;
+
+	return TestReport("PositionIndexTest");
+}
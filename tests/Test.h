@@ -0,0 +1,126 @@
+/**
+ * Test.h
+ * Tiny helpers shared by the randomized tests of the library.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_TESTS_TEST_H
+#define _BOLOTA_TESTS_TEST_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Seed used when none is given in the command line, so that every run checks
+ * the same cases unless asked otherwise.
+ */
+#define TEST_DEFAULT_SEED 1
+
+/**
+ * Maximum number of failures that are reported before going quiet.
+ */
+#define TEST_MAX_REPORTS 10
+
+/**
+ * Checks a condition, reporting it as a failure if it doesn't hold.
+ */
+#define TEST_CHECK(cond, desc) \
+	do { \
+		if (!(cond)) \
+			TestFail(__FILE__, __LINE__, desc); \
+	} while (0)
+
+// State of the test.
+static uint64_t g_ullTestSeed = TEST_DEFAULT_SEED;
+static uint64_t g_ullTestState = TEST_DEFAULT_SEED;
+static unsigned long g_ulTestFailures = 0;
+
+/**
+ * Sets up the random number generator from the command line. The first
+ * argument, if any, is the seed to be used.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ */
+static inline void TestInit(int argc, char **argv) {
+	if (argc > 1)
+		g_ullTestSeed = strtoull(argv[1], NULL, 10);
+	g_ullTestState = (g_ullTestSeed != 0) ? g_ullTestSeed : TEST_DEFAULT_SEED;
+}
+
+/**
+ * Gets the next random number. (xorshift64*)
+ *
+ * @return Random 32-bit number.
+ */
+static inline uint32_t TestRandom() {
+	g_ullTestState ^= g_ullTestState >> 12;
+	g_ullTestState ^= g_ullTestState << 25;
+	g_ullTestState ^= g_ullTestState >> 27;
+
+	return (uint32_t)((g_ullTestState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/**
+ * Gets a random number below a limit.
+ *
+ * @param ulLimit Upper limit (exclusive). Must not be zero.
+ *
+ * @return Random number between 0 and ulLimit - 1.
+ */
+static inline uint32_t TestRandom(uint32_t ulLimit) {
+	return TestRandom() % ulLimit;
+}
+
+/**
+ * Gets the time from a monotonic clock, for timing benchmarks.
+ *
+ * @return Time in seconds from an arbitrary starting point.
+ */
+static inline double TestSeconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * Reports a failed check.
+ *
+ * @param szFile Source file of the check.
+ * @param iLine  Line of the check.
+ * @param szDesc Description of what was being checked.
+ */
+static inline void TestFail(const char *szFile, int iLine,
+							const char *szDesc) {
+	if (g_ulTestFailures++ < TEST_MAX_REPORTS)
+		fprintf(stderr, "%s:%d: %s\n", szFile, iLine, szDesc);
+}
+
+/**
+ * Prints the outcome of the test.
+ *
+ * @param szName Name of the test.
+ *
+ * @return Exit code of the test.
+ */
+static inline int TestReport(const char *szName) {
+	if (g_ulTestFailures > 0) {
+		printf("%s: %lu failures (seed %llu)\n", szName, g_ulTestFailures,
+			(unsigned long long)g_ullTestSeed);
+		return 1;
+	}
+
+	printf("%s: passed (seed %llu)\n", szName,
+		(unsigned long long)g_ullTestSeed);
+	return 0;
+}
+
+#endif // _BOLOTA_TESTS_TEST_H
@@ -0,0 +1,222 @@
+/**
+ * TextIndexTest.cpp
+ * Applies random edits to a document and compares the results of queries on
+ * its text index against matching the text of every topic.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+#include "Indexes/TextIndex.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random edits applied to the document.
+ */
+#define EDITS 6000
+
+/**
+ * Number of edits between each comparison against brute force.
+ */
+#define CHECK_EVERY 7
+
+/**
+ * Number of edits between each rebuild of the index, which numbers the topics
+ * in document order again.
+ */
+#define REBUILD_EVERY 300
+
+/**
+ * Number of random queries made on each comparison.
+ */
+#define QUERIES 8
+
+/**
+ * Part of a query that must match, made of normalized terms.
+ */
+struct Clause {
+	std::vector<std::string> terms;
+	bool bPhrase;
+};
+
+/**
+ * Splits a text into normalized terms the same way the index does.
+ *
+ * @param mbstr UTF-8 text to be split.
+ *
+ * @return Normalized terms in the order they appear in the text.
+ */
+std::vector<std::string> TermsOf(const char *mbstr) {
+	std::vector<std::string> vecTerms;
+	char szTerm[BOLOTA_TEXTINDEX_TERM_MAX];
+	size_t ulLength = strlen(mbstr);
+	size_t ulPos = 0;
+	size_t ulStart;
+	size_t ulEnd;
+
+	while (TextIndex::NextWord(mbstr, ulLength, &ulPos, &ulStart, &ulEnd)) {
+		size_t ulTerm = TextIndex::Normalize(mbstr + ulStart, ulEnd - ulStart,
+			szTerm);
+		vecTerms.push_back(std::string(szTerm, ulTerm));
+	}
+
+	return vecTerms;
+}
+
+/**
+ * Checks if a topic matches every clause of an alternative.
+ *
+ * @param vecTerms   Terms of the topic in the order they appear.
+ * @param vecClauses Clauses that must all match.
+ *
+ * @return TRUE if the topic matches.
+ */
+bool MatchesGroup(const std::vector<std::string>& vecTerms,
+				  const std::vector<Clause>& vecClauses) {
+	for (size_t i = 0; i < vecClauses.size(); i++) {
+		const std::vector<std::string>& vecClause = vecClauses[i].terms;
+		bool bFound = false;
+
+		// Words may be anywhere, but phrases must be in sequence.
+		if (vecClauses[i].bPhrase) {
+			bFound = std::search(vecTerms.begin(), vecTerms.end(),
+				vecClause.begin(), vecClause.end()) != vecTerms.end();
+		} else {
+			bFound = true;
+			for (size_t j = 0; j < vecClause.size(); j++) {
+				if (std::find(vecTerms.begin(), vecTerms.end(), vecClause[j]) ==
+						vecTerms.end()) {
+					bFound = false;
+				}
+			}
+		}
+
+		if (!bFound)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Builds a random query along with the alternatives it's made of.
+ *
+ * @param vecGroups Vector to receive the alternatives of the query.
+ *
+ * @return Text of the query.
+ */
+std::string RandomQuery(std::vector<std::vector<Clause> >& vecGroups) {
+	uint32_t ulGroups = 1 + TestRandom(2);
+	std::string strQuery;
+
+	vecGroups.clear();
+	for (uint32_t i = 0; i < ulGroups; i++) {
+		uint32_t ulClauses = 1 + TestRandom(2);
+
+		if (i > 0)
+			strQuery += " OR ";
+		vecGroups.push_back(std::vector<Clause>());
+		for (uint32_t j = 0; j < ulClauses; j++) {
+			std::string strWords = g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+			Clause clause;
+
+			// Some of the clauses are phrases of a couple of words.
+			clause.bPhrase = TestRandom(3) == 0;
+			if (clause.bPhrase) {
+				strWords += " ";
+				strWords += g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+			}
+			clause.terms = TermsOf(strWords.c_str());
+
+			if (j > 0)
+				strQuery += " ";
+			strQuery += clause.bPhrase ? ("\"" + strWords + "\"") : strWords;
+			vecGroups.back().push_back(clause);
+		}
+	}
+
+	return strQuery;
+}
+
+/**
+ * Compares the results of random queries against matching the text of every
+ * topic of the document.
+ *
+ * @param index Text index attached to the document.
+ * @param doc   Document being edited.
+ */
+void CheckQueries(TextIndex& index, Document *doc) {
+	std::vector<std::vector<std::string> > vecTexts;
+	std::vector<std::vector<Clause> > vecGroups;
+	std::vector<Field*> vecTopics;
+	std::vector<Field*> vecResults;
+	std::vector<Field*> vecExpected;
+
+	// Split the texts of the topics up front.
+	PreOrder(doc->FirstTopic(), vecTopics);
+	TEST_CHECK(index.Count() == vecTopics.size(), "Topics in the index");
+	for (size_t i = 0; i < vecTopics.size(); i++)
+		vecTexts.push_back(TermsOf(TextOf(vecTopics[i])));
+
+	for (int q = 0; q < QUERIES; q++) {
+		std::string strQuery = RandomQuery(vecGroups);
+
+		// Any of the alternatives may match, in document order.
+		vecExpected.clear();
+		for (size_t i = 0; i < vecTopics.size(); i++) {
+			for (size_t j = 0; j < vecGroups.size(); j++) {
+				if (MatchesGroup(vecTexts[i], vecGroups[j])) {
+					vecExpected.push_back(vecTopics[i]);
+					break;
+				}
+			}
+		}
+
+		TEST_CHECK(index.Search(strQuery.c_str(), vecResults) ==
+			vecExpected.size(), "Number of matching topics");
+		TEST_CHECK(vecResults == vecExpected, "Topics matching a query");
+	}
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	TextIndex index;
+
+	TestInit(argc, argv);
+
+	// Start with some topics and let the edits shape them.
+	Document *doc = RandomDocument(40);
+	doc->AttachIndex(&index);
+	for (int i = 0; i < EDITS; i++) {
+		RandomEdit(doc, NULL);
+		TEST_CHECK(!BolotaHasError, "Document edit failed");
+		if (BolotaHasError)
+			break;
+
+		if ((i % REBUILD_EVERY) == 0) {
+			doc->DetachIndex(&index);
+			doc->AttachIndex(&index);
+		}
+		if ((i % CHECK_EVERY) == 0)
+			CheckQueries(index, doc);
+	}
+
+	doc->DetachIndex(&index);
+	delete doc;
+
+	return TestReport("TextIndexTest");
+}
@@ -0,0 +1,280 @@
+/**
+ * Topics.h
+ * Random topics and edits shared by the tests of documents and their indexes.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BOLOTA_TESTS_TOPICS_H
+#define _BOLOTA_TESTS_TOPICS_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+#include "Test.h"
+
+/**
+ * Number of different icons used by the random topics.
+ */
+#define TOPICS_ICONS 5
+
+/**
+ * Smallest number of topics that random edits leave in a document.
+ */
+#define TOPICS_MIN 30
+
+/**
+ * Words used to build the texts of the topics, in different cases and
+ * scripts, with a few of them overlapping each other.
+ */
+static const char *g_topicWords[] = {
+	"alpha", "Beta", "gamma", "DELTA", "epsilon", "zeta", "\xC3\xA9" "clair",
+	"na\xC3\xAFve", "\xE6\xA9\xA1\xE5\xAD\x90", "\xF0\x9F\x8C\xB0", "aaa",
+	"ab", "x", "42"
+};
+#define TOPICS_WORDS_NUM (sizeof(g_topicWords) / sizeof(g_topicWords[0]))
+
+/**
+ * Gathers the topics of a document in display (pre-)order.
+ *
+ * @param field     First topic of the list.
+ * @param vecFields Vector to append the topics to.
+ */
+static inline void PreOrder(Bolota::Field *field,
+							std::vector<Bolota::Field*>& vecFields) {
+	for (; field != NULL; field = field->Next()) {
+		vecFields.push_back(field);
+		PreOrder(field->Child(), vecFields);
+	}
+}
+
+/**
+ * Checks if a topic is the same as another one or is nested under it.
+ *
+ * @param field    Topic to be checked.
+ * @param ancestor Possible ancestor of the topic.
+ *
+ * @return TRUE if the topic is in the subtree of the ancestor.
+ */
+static inline bool IsInSubtree(Bolota::Field *field,
+							   Bolota::Field *ancestor) {
+	for (; field != NULL; field = field->Parent()) {
+		if (field == ancestor)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Gets the text of a topic. Topics without a text are read back from a file
+ * with an empty one, so both are considered the same.
+ *
+ * @param field Topic to get the text from.
+ *
+ * @return UTF-8 text of the topic.
+ */
+static inline const char* TextOf(Bolota::Field *field) {
+	return field->HasText() ? field->Text()->GetMultiByteString() : "";
+}
+
+/**
+ * Checks if two topics hold the same contents.
+ *
+ * @param a First topic.
+ * @param b Second topic.
+ *
+ * @return TRUE if the type, text and properties of the topics are the same.
+ */
+static inline bool SameField(Bolota::Field *a, Bolota::Field *b) {
+	if ((a->Type() != b->Type()) || (strcmp(TextOf(a), TextOf(b)) != 0))
+		return false;
+
+	if (a->Type() == BOLOTA_TYPE_DATE) {
+		timestamp_t ta = static_cast<Bolota::DateField*>(a)->Timestamp();
+		timestamp_t tb = static_cast<Bolota::DateField*>(b)->Timestamp();
+		return (ta.year == tb.year) && (ta.month == tb.month) &&
+			(ta.day == tb.day) && (ta.hour == tb.hour) &&
+			(ta.minute == tb.minute) && (ta.second == tb.second);
+	} else if (a->Type() == BOLOTA_TYPE_ICON) {
+		return static_cast<Bolota::IconField*>(a)->IconIndex() ==
+			static_cast<Bolota::IconField*>(b)->IconIndex();
+	}
+
+	return true;
+}
+
+/**
+ * Compares two lists of topics along with their childs.
+ *
+ * @param a First list of topics.
+ * @param b Second list of topics.
+ */
+static inline void CompareTopics(Bolota::Field *a, Bolota::Field *b) {
+	for (; (a != NULL) && (b != NULL); a = a->Next(), b = b->Next()) {
+		TEST_CHECK(SameField(a, b), "Contents of a topic");
+		TEST_CHECK(a->ID() == b->ID(), "Identifier of a topic");
+		TEST_CHECK(a->HasChild() == b->HasChild(), "Topic with childs");
+		CompareTopics(a->Child(), b->Child());
+	}
+
+	TEST_CHECK((a == NULL) && (b == NULL), "Number of topics");
+}
+
+/**
+ * Builds a random text out of the words.
+ *
+ * @return Random text.
+ */
+static inline std::string RandomText() {
+	std::string str;
+	uint32_t ulWords = TestRandom(6);
+
+	for (uint32_t i = 0; i < ulWords; i++) {
+		if (i > 0)
+			str += (TestRandom(4) == 0) ? ", " : " ";
+		str += g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+	}
+
+	return str;
+}
+
+/**
+ * Creates a random topic that isn't part of any document.
+ *
+ * @return Newly allocated topic.
+ */
+static inline Bolota::Field* RandomField() {
+	std::string strText = RandomText();
+	timestamp_t ts;
+
+	switch (TestRandom(6)) {
+	case 0:
+		memset(&ts, 0, sizeof(timestamp_t));
+		ts.year = 1990 + TestRandom(40);
+		ts.month = 1 + TestRandom(12);
+		ts.day = 1 + TestRandom(28);
+		ts.hour = TestRandom(24);
+		ts.minute = TestRandom(60);
+		ts.second = TestRandom(60);
+		return new Bolota::DateField(&ts, strText.c_str());
+	case 1:
+	case 2:
+		return new Bolota::IconField((field_icon_t)TestRandom(TOPICS_ICONS),
+			strText.c_str());
+	case 3:
+		return new Bolota::BlankField();
+	default:
+		return new Bolota::TextField(strText.c_str());
+	}
+}
+
+/**
+ * Applies a random edit to a document through its public interface.
+ *
+ * @param doc     Document to be edited.
+ * @param vecGone Vector to append the identifiers of deleted topics to or
+ *                NULL if they aren't needed.
+ */
+static inline void RandomEdit(Bolota::Document *doc,
+							  std::vector<field_id_t> *vecGone) {
+	std::vector<Bolota::Field*> vecTopics;
+	Bolota::Field *field;
+	Bolota::Field *other;
+
+	// Make sure there's something to edit.
+	PreOrder(doc->FirstTopic(), vecTopics);
+	if (vecTopics.empty()) {
+		doc->AppendTopic(RandomField());
+		return;
+	}
+	field = vecTopics[TestRandom((uint32_t)vecTopics.size())];
+	other = vecTopics[TestRandom((uint32_t)vecTopics.size())];
+
+	switch (TestRandom(12)) {
+	case 0:
+	case 1:
+		doc->AppendTopic(field, RandomField());
+		break;
+	case 2:
+		doc->PrependTopic(field, RandomField());
+		break;
+	case 3:
+		// Keep the document from shrinking down to nothing.
+		if (vecTopics.size() < TOPICS_MIN)
+			break;
+		if (vecGone != NULL) {
+			std::vector<Bolota::Field*> vecSubtree;
+			vecSubtree.push_back(field);
+			PreOrder(field->Child(), vecSubtree);
+			for (size_t i = 0; i < vecSubtree.size(); i++)
+				vecGone->push_back(vecSubtree[i]->ID());
+		}
+		doc->DeleteTopic(field);
+		break;
+	case 4:
+		if (field != doc->FirstTopic())
+			doc->MoveTopicToTop(field);
+		break;
+	case 5:
+		if (!IsInSubtree(other, field))
+			doc->MoveTopicBelow(field, other);
+		break;
+	case 6:
+		if (field->HasPrevious())
+			doc->IndentTopic(field);
+		break;
+	case 7:
+		if (field->HasParent())
+			doc->DeindentTopic(field);
+		break;
+	case 8:
+		if (field->Type() != BOLOTA_TYPE_BLANK)
+			doc->SetTopicText(field, RandomText().c_str());
+		break;
+	case 9:
+		if (field->Type() == BOLOTA_TYPE_ICON) {
+			doc->SetTopicIcon(static_cast<Bolota::IconField*>(field),
+				(field_icon_t)TestRandom(TOPICS_ICONS));
+		}
+		break;
+	case 10:
+		if (field->Type() == BOLOTA_TYPE_DATE) {
+			Bolota::DateField *date = static_cast<Bolota::DateField*>(field);
+			timestamp_t ts = date->Timestamp();
+			ts.year = 1990 + TestRandom(40);
+			date->SetTimestamp(&ts);
+			doc->TopicChanged(field);
+		}
+		break;
+	default:
+		doc->ReplaceTopic(field, RandomField());
+		break;
+	}
+}
+
+/**
+ * Creates a document with random topics nested in random ways.
+ *
+ * @param ulEdits Number of random edits used to build the document.
+ *
+ * @return Newly allocated document.
+ */
+static inline Bolota::Document* RandomDocument(uint32_t ulEdits) {
+	Bolota::Document *doc = new Bolota::Document(
+		new Bolota::TextField(RandomText().c_str()),
+		new Bolota::TextField(RandomText().c_str()), new Bolota::DateField());
+
+	for (uint32_t i = 0; i < ulEdits; i++)
+		RandomEdit(doc, NULL);
+
+	return doc;
+}
+
+#endif // _BOLOTA_TESTS_TOPICS_H
@@ -0,0 +1,258 @@
+/**
+ * TrigramBench.cpp
+ * Measures the size of the trigram index section, how long it takes to save a
+ * document after a few edits, and how long it takes to look up patterns after
+ * topics were inserted.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+#include "Indexes/TrigramIndex.h"
+#include "Test.h"
+
+using namespace Bolota;
+
+/**
+ * Number of topics in each document.
+ */
+#define TOPICS 200000
+
+/**
+ * Number of distinct words the texts are made out of.
+ */
+#define VOCABULARY 20000
+
+/**
+ * Number of topics edited between each save.
+ */
+#define EDITS 100
+
+/**
+ * Number of rounds each measurement is averaged over.
+ */
+#define ROUNDS 5
+
+/**
+ * Number of patterns looked up after each insertion.
+ */
+#define PATTERNS 20
+
+/**
+ * File used to store the documents.
+ */
+#define TEMP_FILE "TrigramBench.bol"
+
+/**
+ * Builds a vocabulary of made up words out of random syllables.
+ *
+ * @param vecWords Vector to receive the words.
+ */
+void BuildVocabulary(std::vector<std::string>& vecWords) {
+	static const char *consonants = "bcdfghjklmnprstvwxz";
+	static const char *vowels = "aeiou";
+
+	for (int i = 0; i < VOCABULARY; i++) {
+		uint32_t ulSyllables = 1 + TestRandom(4);
+		std::string str;
+
+		for (uint32_t j = 0; j < ulSyllables; j++) {
+			str += consonants[TestRandom((uint32_t)strlen(consonants))];
+			str += vowels[TestRandom((uint32_t)strlen(vowels))];
+			if (TestRandom(3) == 0)
+				str += consonants[TestRandom((uint32_t)strlen(consonants))];
+		}
+		if (TestRandom(8) == 0)
+			str[0] = (char)(str[0] & ~0x20);
+
+		vecWords.push_back(str);
+	}
+}
+
+/**
+ * Builds a random text with some words being a lot more common than others.
+ *
+ * @param vecWords Vocabulary to build the text out of.
+ *
+ * @return Random text.
+ */
+std::string RandomText(const std::vector<std::string>& vecWords) {
+	uint32_t ulWords = 1 + TestRandom(16);
+	std::string str;
+
+	for (uint32_t i = 0; i < ulWords; i++) {
+		uint32_t r = TestRandom(VOCABULARY);
+		if (i > 0)
+			str += " ";
+		str += vecWords[((uint64_t)r * r) / VOCABULARY];
+	}
+
+	return str;
+}
+
+/**
+ * Builds a document with random topics nested a few levels deep.
+ *
+ * @param vecWords  Vocabulary to build the texts out of.
+ * @param vecTopics Vector to receive the topics of the document.
+ *
+ * @return Newly allocated document.
+ */
+Document* BuildDocument(const std::vector<std::string>& vecWords,
+						std::vector<Field*>& vecTopics) {
+	Document *doc = new Document(new TextField("Benchmark"),
+		new TextField("Trigram index"), new DateField());
+	Field *prev = NULL;
+
+	for (int i = 0; i < TOPICS; i++) {
+		Field *field = new TextField(RandomText(vecWords).c_str());
+
+		if (prev == NULL) {
+			doc->AppendTopic(field);
+		} else {
+			doc->AppendTopic(prev, field);
+			if ((TestRandom(3) == 0) && (field->Depth() < 4))
+				doc->IndentTopic(field);
+		}
+
+		vecTopics.push_back(field);
+		prev = field;
+	}
+
+	return doc;
+}
+
+/**
+ * Writes a document to the temporary file.
+ *
+ * @param doc Document to be written.
+ *
+ * @return Time it took in milliseconds.
+ */
+double Save(Document *doc) {
+	UString strPath(TEMP_FILE);
+	double dStart = TestSeconds();
+
+	TEST_CHECK(doc->WriteFile(strPath.GetNativeString(), false) !=
+		BOLOTA_ERR_SIZET, "Writing the document");
+
+	return (TestSeconds() - dStart) * 1000;
+}
+
+/**
+ * Reads the temporary file back.
+ *
+ * @return Time it took in milliseconds.
+ */
+double Open() {
+	UString strPath(TEMP_FILE);
+	double dStart = TestSeconds();
+
+	Document *doc = Document::ReadFile(strPath.GetNativeString());
+	double dElapsed = (TestSeconds() - dStart) * 1000;
+	TEST_CHECK(doc != NULL, "Reading the document");
+	delete doc;
+
+	return dElapsed;
+}
+
+/**
+ * Edits the texts of random topics.
+ *
+ * @param doc       Document to be edited.
+ * @param vecWords  Vocabulary to build the texts out of.
+ * @param vecTopics Topics of the document.
+ */
+void EditTopics(Document *doc, const std::vector<std::string>& vecWords,
+				const std::vector<Field*>& vecTopics) {
+	for (int i = 0; i < EDITS; i++) {
+		doc->SetTopicText(vecTopics[TestRandom((uint32_t)vecTopics.size())],
+			RandomText(vecWords).c_str());
+	}
+}
+
+/**
+ * Runs the benchmark.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	std::vector<std::string> vecWords;
+	std::vector<Field*> vecTopics;
+	std::vector<Field*> vecCandidates;
+	double dSave = 0;
+	double dSaveIndexed = 0;
+	double dOpen = 0;
+	double dOpenIndexed = 0;
+	double dStart;
+	size_t ulText = 0;
+	int i;
+
+	TestInit(argc, argv);
+	BuildVocabulary(vecWords);
+	Document *doc = BuildDocument(vecWords, vecTopics);
+	for (size_t t = 0; t < vecTopics.size(); t++)
+		ulText += vecTopics[t]->Text()->Length();
+
+	// Saving and opening without the index.
+	for (i = 0; i < ROUNDS; i++) {
+		EditTopics(doc, vecWords, vecTopics);
+		dSave += Save(doc);
+		dOpen += Open();
+	}
+
+	// Building it from scratch.
+	dStart = TestSeconds();
+	doc->EnableTrigramIndex(true);
+	double dBuild = (TestSeconds() - dStart) * 1000;
+	TrigramIndex *index = doc->Trigrams();
+	uint32_t ulSection = index->SectionLength();
+
+	// Saving and opening with the index.
+	for (i = 0; i < ROUNDS; i++) {
+		EditTopics(doc, vecWords, vecTopics);
+		dSaveIndexed += Save(doc);
+		dOpenIndexed += Open();
+	}
+
+	printf("%d topics, %lu KB of text, %lu trigrams\n", TOPICS,
+		(unsigned long)(ulText / 1024), (unsigned long)index->TrigramCount());
+	printf("Section: %lu KB (%.2fx the text)\n",
+		(unsigned long)(ulSection / 1024), (double)ulSection / ulText);
+	printf("Build from scratch: %8.2f ms\n", dBuild);
+	printf("Save after %d edits: %8.2f ms (%.2f ms without the index)\n",
+		EDITS, dSaveIndexed / ROUNDS, dSave / ROUNDS);
+	printf("Open: %8.2f ms (%.2f ms without the index)\n",
+		dOpenIndexed / ROUNDS, dOpen / ROUNDS);
+
+	// Looking up patterns right after a topic was inserted.
+	double dQuery = 0;
+	size_t ulCandidates = 0;
+	for (i = 0; i < ROUNDS; i++) {
+		doc->AppendTopic(vecTopics[TestRandom((uint32_t)vecTopics.size())],
+			new TextField(RandomText(vecWords).c_str()));
+
+		dStart = TestSeconds();
+		for (int p = 0; p < PATTERNS; p++) {
+			const std::string& str = vecWords[TestRandom(VOCABULARY / 8)];
+			index->Candidates(str.c_str(), str.size(), vecCandidates);
+			ulCandidates += vecCandidates.size();
+		}
+		dQuery += (TestSeconds() - dStart) * 1000;
+	}
+	printf("Query after an insertion: %8.3f ms (%lu candidates on average)\n",
+		dQuery / (ROUNDS * PATTERNS),
+		(unsigned long)(ulCandidates / (ROUNDS * PATTERNS)));
+
+	delete doc;
+	remove(TEMP_FILE);
+
+	return TestReport("TrigramBench");
+}
@@ -0,0 +1,246 @@
+/**
+ * TrigramIndexTest.cpp
+ * Applies random edits to a document and compares the candidates of its
+ * trigram index against searching every topic, along with saving the index
+ * and reading it back.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+#include "Indexes/TrigramIndex.h"
+#include "Test.h"
+#include "Topics.h"
+
+using namespace Bolota;
+
+/**
+ * Number of random edits applied to the document.
+ */
+#define EDITS 6000
+
+/**
+ * Number of edits between each comparison against brute force.
+ */
+#define CHECK_EVERY 7
+
+/**
+ * Number of edits between each time the document is saved.
+ */
+#define SAVE_EVERY 97
+
+/**
+ * Number of random patterns looked up on each comparison.
+ */
+#define PATTERNS 8
+
+/**
+ * File used to store the document.
+ */
+#define TEMP_FILE "TrigramIndexTest.bol"
+
+/**
+ * Checks if a text contains a pattern, regardless of the case of its ASCII
+ * letters.
+ *
+ * @param mbstr      UTF-8 text to be searched.
+ * @param strPattern Pattern to search for.
+ *
+ * @return TRUE if the pattern was found.
+ */
+bool ContainsFolded(const char *mbstr, const std::string& strPattern) {
+	size_t ulLength = strlen(mbstr);
+
+	for (size_t i = 0; (i + strPattern.size()) <= ulLength; i++) {
+		size_t j;
+		for (j = 0; j < strPattern.size(); j++) {
+			char a = mbstr[i + j];
+			char b = strPattern[j];
+			if ((a >= 'A') && (a <= 'Z'))
+				a |= 0x20;
+			if ((b >= 'A') && (b <= 'Z'))
+				b |= 0x20;
+			if (a != b)
+				break;
+		}
+
+		if (j == strPattern.size())
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Picks a random pattern out of the texts of the topics or the words they're
+ * made of.
+ *
+ * @param vecTopics Topics of the document.
+ *
+ * @return Pattern to be looked up.
+ */
+std::string RandomPattern(const std::vector<Field*>& vecTopics) {
+	// Part of the text of a topic, which may cut a character in half.
+	if (!vecTopics.empty() && (TestRandom(2) == 0)) {
+		const char *mbstr =
+			TextOf(vecTopics[TestRandom((uint32_t)vecTopics.size())]);
+		size_t ulLength = strlen(mbstr);
+		if (ulLength >= 3) {
+			size_t ulSize = 3 + TestRandom((uint32_t)(ulLength - 2));
+			size_t ulStart = TestRandom((uint32_t)(ulLength - ulSize + 1));
+			return std::string(mbstr + ulStart, ulSize);
+		}
+	}
+
+	// Words on their own or running into each other.
+	std::string str = g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+	if (TestRandom(2) == 0) {
+		str += (TestRandom(2) == 0) ? " " : "";
+		str += g_topicWords[TestRandom(TOPICS_WORDS_NUM)];
+	}
+
+	return str;
+}
+
+/**
+ * Checks that the candidates of a pattern include every topic that contains
+ * it, in document order.
+ *
+ * @param index     Trigram index of the document.
+ * @param vecTopics Topics of the document in display order.
+ */
+void CheckCandidates(TrigramIndex *index,
+					const std::vector<Field*>& vecTopics) {
+	std::vector<Field*> vecCandidates;
+
+	TEST_CHECK(index->Count() == vecTopics.size(), "Topics in the index");
+	for (int p = 0; p < PATTERNS; p++) {
+		std::string strPattern = RandomPattern(vecTopics);
+		size_t c = 0;
+
+		if (!index->Candidates(strPattern.c_str(), strPattern.size(),
+				vecCandidates)) {
+			TEST_CHECK(strPattern.size() < 3, "Pattern that can be looked up");
+			continue;
+		}
+
+		// Walk both lists at once, since they should be in the same order.
+		for (size_t i = 0; i < vecTopics.size(); i++) {
+			bool bCandidate = (c < vecCandidates.size()) &&
+				(vecCandidates[c] == vecTopics[i]);
+			if (bCandidate)
+				c++;
+
+			if (ContainsFolded(TextOf(vecTopics[i]), strPattern))
+				TEST_CHECK(bCandidate, "Topic with the pattern left out");
+		}
+		TEST_CHECK(c == vecCandidates.size(), "Candidates in document order");
+	}
+}
+
+/**
+ * Checks that the postings that were refreshed when the document was saved
+ * are the same as the ones built from scratch and that they're read back from
+ * the file as they were.
+ *
+ * @param doc Document that was just saved.
+ */
+void CheckSaved(Document *doc) {
+	std::vector<Field*> vecCandidates;
+	std::vector<Field*> vecExpected;
+	std::vector<Field*> vecTopics;
+	TrigramIndex *index = doc->Trigrams();
+	TrigramIndex fresh;
+
+	// Refreshed postings against a new index.
+	TEST_CHECK(index->IsCurrent(), "Index refreshed when saved");
+	fresh.Build(doc->FirstTopic());
+	TEST_CHECK(index->TrigramCount() == fresh.TrigramCount(),
+		"Trigrams of the refreshed index");
+	TEST_CHECK(index->SectionLength() == fresh.SectionLength(),
+		"Section length of the refreshed index");
+
+	// Index read back from the file.
+	UString strPath(TEMP_FILE);
+	Document *loaded = Document::ReadFile(strPath.GetNativeString());
+	TEST_CHECK(loaded != NULL, "Reading the document");
+	if (loaded == NULL)
+		return;
+	TEST_CHECK(loaded->Trigrams() != NULL, "Index read from the file");
+	if (loaded->Trigrams() != NULL) {
+		TEST_CHECK(loaded->Trigrams()->IsCurrent(), "Index read as is");
+		TEST_CHECK(loaded->Trigrams()->TrigramCount() == fresh.TrigramCount(),
+			"Trigrams read from the file");
+		TEST_CHECK(loaded->Trigrams()->SectionLength() == fresh.SectionLength(),
+			"Section length read from the file");
+	}
+
+	// Candidates of all three should be exactly the same.
+	PreOrder(doc->FirstTopic(), vecTopics);
+	for (int p = 0; p < PATTERNS; p++) {
+		std::string strPattern = RandomPattern(vecTopics);
+
+		fresh.Candidates(strPattern.c_str(), strPattern.size(), vecExpected);
+		index->Candidates(strPattern.c_str(), strPattern.size(),
+			vecCandidates);
+		TEST_CHECK(vecCandidates == vecExpected, "Refreshed candidates");
+
+		if (loaded->Trigrams() == NULL)
+			continue;
+		loaded->Trigrams()->Candidates(strPattern.c_str(), strPattern.size(),
+			vecCandidates);
+		TEST_CHECK(vecCandidates.size() == vecExpected.size(),
+			"Number of candidates read from the file");
+		for (size_t i = 0; (i < vecCandidates.size()) &&
+				(i < vecExpected.size()); i++) {
+			TEST_CHECK(vecCandidates[i]->ID() == vecExpected[i]->ID(),
+				"Candidate read from the file");
+		}
+	}
+
+	delete loaded;
+}
+
+/**
+ * Runs the test.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments.
+ *
+ * @return Exit code.
+ */
+int main(int argc, char **argv) {
+	UString strPath(TEMP_FILE);
+
+	TestInit(argc, argv);
+
+	// Start with some topics and let the edits shape them.
+	Document *doc = RandomDocument(40);
+	doc->EnableTrigramIndex(true);
+	for (int i = 0; i < EDITS; i++) {
+		RandomEdit(doc, NULL);
+		TEST_CHECK(!BolotaHasError, "Document edit failed");
+		if (BolotaHasError)
+			break;
+
+		if ((i % CHECK_EVERY) == 0) {
+			std::vector<Field*> vecTopics;
+			PreOrder(doc->FirstTopic(), vecTopics);
+			CheckCandidates(doc->Trigrams(), vecTopics);
+		}
+		if ((i % SAVE_EVERY) == 0) {
+			TEST_CHECK(doc->WriteFile(strPath.GetNativeString(), false) !=
+				BOLOTA_ERR_SIZET, "Writing the document");
+			CheckSaved(doc);
+		}
+	}
+
+	delete doc;
+	remove(TEMP_FILE);
+
+	return TestReport("TrigramIndexTest");
+}
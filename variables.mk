@@ -26,7 +26,18 @@ MAKE  = make
 # Flags
 CFLAGS  = -Wall -Wno-psabi --std=c++11 -I$(ROOT)/shims/linux -I$(SRCDIR)
 LDFLAGS =
-LIBS    =
+LIBS    = -lpthread
+
+# Build with wide (wchar_t) TCHAR strings, just like a UNICODE Windows build.
+ifeq ($(UNICODE), 1)
+	CFLAGS += -DUNICODE -D_UNICODE
+endif
+
+# Build with optimizations, kept apart from the regular build. (Benchmarks)
+ifeq ($(RELEASE), 1)
+	BUILDDIR := $(BUILDDIR)/release
+	CFLAGS += -O2
+endif
 
 # Handle OS X-specific tools.
 ifeq ($(PLATFORM), Darwin)
@@ -543,7 +543,7 @@ LRESULT BolotaView::OpenFieldManager(FieldManagerDialog::DialogType type) {
 
 	// Setup and open the manager dialog.
 	FieldManagerDialog dlgManager(this->m_hInst, this->m_hWnd, m_imlFieldIcons,
-		type, (fldNew) ? &fldNew : &field, field);
+		type, m_doc, (fldNew) ? &fldNew : &field, field);
 	INT_PTR iRet = dlgManager.ShowModal();
 
 	// Check if the dialog returned from a Cancel operation.
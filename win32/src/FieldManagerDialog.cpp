@@ -33,17 +33,19 @@ using namespace Bolota;
  * @param hInst         Application's instance that this dialog belongs to.
  * @param hwndParent    Parent window handle.
  * @param imlFieldIcons Field icons ImageList manager.
+ * @param doc           Document that the field belongs to.
  * @param field         Field to be associated with this dialog.
  * @param context       Field providing context to the operation.
  */
 FieldManagerDialog::FieldManagerDialog(HINSTANCE& hInst, HWND& hwndParent,
 									   FieldImageList *imlFieldIcons, DialogType type,
-									   Field **field, Field *context) :
+									   Document *doc, Field **field, Field *context) :
 	DialogWindow(hInst, hwndParent, IDD_FIELDMAN, false) {
 	SetType(type);
 	m_imlFieldIcons = imlFieldIcons;
 	
 	SetAlternativeSelected(false);
+	m_doc = doc;
 	m_field = field;
 	m_context = context;
 	m_fieldType = NULL;
@@ -408,14 +410,28 @@ bool FieldManagerDialog::OnOK() {
 			return false;
 		}
 		
-		// Replace the actual field.
-		(*m_field)->Copy(old, true);
-		delete old;
+		// Replace the actual field, letting the document know if it's in it.
+		if (m_type == EditField) {
+			m_doc->ReplaceTopic(old, *m_field);
+		} else {
+			(*m_field)->Copy(old, true);
+			delete old;
+		}
 	}
 
-	// Set the field's values.
-	if (AssociatedField()->Type() != BOLOTA_TYPE_BLANK)
-		AssociatedField()->SetTextOwner(GetContentText());
+	// Set the field's values. Fields that are already in the document must go
+	// through it in order to keep its indexes up to date.
+	bool bInDocument = m_type == EditField;
+	if (AssociatedField()->Type() != BOLOTA_TYPE_BLANK) {
+		if (bInDocument) {
+			LPTSTR szText = GetContentText();
+			m_doc->SetTopicText(AssociatedField(),
+				(szText != NULL) ? szText : _T(""));
+			free(szText);
+		} else {
+			AssociatedField()->SetTextOwner(GetContentText());
+		}
+	}
 	switch (AssociatedField()->Type()) {
 	case BOLOTA_TYPE_TEXT:
 	case BOLOTA_TYPE_BLANK:
@@ -423,11 +439,17 @@ bool FieldManagerDialog::OnOK() {
 	case BOLOTA_TYPE_DATE: {
 		DateField *field = static_cast<DateField*>(AssociatedField());
 		field->SetTimestamp(&m_stTimestamp);
+		if (bInDocument)
+			m_doc->TopicChanged(field);
 		break;
 	}
 	case BOLOTA_TYPE_ICON: {
 		IconField *field = static_cast<IconField*>(AssociatedField());
-		field->SetIconIndex(m_fiIndex);
+		if (bInDocument) {
+			m_doc->SetTopicIcon(field, m_fiIndex);
+		} else {
+			field->SetIconIndex(m_fiIndex);
+		}
 		break;
 	}
 	default:
@@ -16,6 +16,7 @@
 #include "stdafx.h"
 #include "Utilities/DialogWindow.h"
 #include "Components/FieldImageList.h"
+#include "../../Bolota/Document.h"
 #include "../../Bolota/Field.h"
 
 /**
@@ -34,6 +35,7 @@ public:
 protected:
 	// Properties
 	DialogType m_type;
+	Bolota::Document *m_doc;
 	Bolota::Field **m_field;
 	Bolota::Field *m_context;
 	Bolota::FieldType *m_fieldType;
@@ -94,7 +96,8 @@ public:
 	// Constructors and destructors.
 	FieldManagerDialog(HINSTANCE& hInst, HWND& hwndParent,
 		FieldImageList *imlFieldIcons, DialogType type,
-		Bolota::Field **field, Bolota::Field *context);
+		Bolota::Document *doc, Bolota::Field **field,
+		Bolota::Field *context);
 
 	// Getters
 	DialogType Type() const;
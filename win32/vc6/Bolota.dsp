@@ -320,6 +320,110 @@ SOURCE=..\..\bolota\Errors\SystemError.cpp
 SOURCE=..\..\bolota\Errors\SystemError.h
 # End Source File
 # End Group
+# Begin Group "Indexes"
+
+# PROP Default_Filter ""
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\DocumentIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\IdIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\IdIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\PositionIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\PositionIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TextIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TextIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FieldTable.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FieldTable.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TrigramIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TrigramIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\DateIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\DateIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\NotebookDateIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\NotebookDateIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\NotebookSearchIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\NotebookSearchIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\Bitmap.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\Bitmap.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TopicOrder.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\TopicOrder.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FacetIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FacetIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FuzzyIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Indexes\FuzzyIndex.h
+# End Source File
+# End Group
 # Begin Group "Fields"
 
 # PROP Default_Filter ""
@@ -350,6 +454,14 @@ SOURCE=..\..\bolota\Document.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\bolota\CorpusSearch.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\CorpusSearch.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\bolota\Field.cpp
 # End Source File
 # Begin Source File
@@ -366,12 +478,60 @@ SOURCE=..\..\bolota\FieldTypes.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\bolota\FlatDocument.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\FlatDocument.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Regex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Regex.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\PathQuery.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\PathQuery.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\TextPool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\TextPool.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\TextRope.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\TextRope.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\bolota\UString.cpp
 # End Source File
 # Begin Source File
 
 SOURCE=..\..\bolota\UString.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\WideTextBlock.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\WideTextBlock.h
+# End Source File
 # End Group
 # Begin Group "Windows and Dialogs"
 
@@ -453,6 +613,14 @@ SOURCE=..\..\shims\cvtutf\ConvertUTF.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\shims\cvtutf\FastUTF.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\shims\cvtutf\FastUTF.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\shims\cvtutf\Unicode.cpp
 # End Source File
 # Begin Source File
@@ -506,6 +674,14 @@ SOURCE=..\..\bolota\Utilities\FileUtils.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\bolota\Utilities\Threads.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bolota\Utilities\Threads.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\Utilities\ImageList.cpp
 # End Source File
 # Begin Source File